@@ -0,0 +1,131 @@
+/**
+ * @file load_bench.cpp
+ * @brief Times streaming a file into staging memory through a buffered read and an AssetFile
+ *
+ * A buffered load reads the whole file into the heap, as assets were read before they were
+ * mapped, then copies it into staging memory. A load through an AssetFile copies into staging
+ * memory straight from the page cache when the file is mapped. Each round runs both, so only
+ * the first load of the first round can read from disk unless the page cache is dropped in
+ * between. Each round prints the time and bandwidth of both loads.
+ *
+ * Usage: load_bench PATH [--rounds N]
+ */
+#include "asset_file.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Reads a whole file into a buffer, the way assets were read before they were mapped
+ * @throws std::runtime_error if the file cannot be read
+ */
+std::vector<char> readWholeFile(const std::string &path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file " + path);
+    }
+    std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+        throw std::runtime_error("failed to read file " + path);
+    }
+    return buffer;
+}
+
+void benchmark(const std::string &path, int rounds) {
+    // Stands in for a mapped staging buffer, which an upload fills one block at a time
+    std::vector<uint8_t> staging(64 * 1024 * 1024);
+    uint64_t checksum = 0;
+    auto upload = [&staging, &checksum](const char *data, size_t size) {
+        for (size_t offset = 0; offset < size; offset += staging.size()) {
+            size_t block = std::min(staging.size(), size - offset);
+            std::memcpy(staging.data(), data + offset, block);
+            checksum += staging[block - 1];
+        }
+    };
+    auto getSeconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    for (int round = 0; round < rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        size_t size;
+        {
+            std::vector<char> buffered = readWholeFile(path);
+            size = buffered.size();
+            if (size == 0) {
+                throw std::runtime_error("load benchmark file " + path + " is empty");
+            }
+            upload(buffered.data(), buffered.size());
+        }
+        double bufferedSeconds = getSeconds(start);
+
+        start = std::chrono::steady_clock::now();
+        bool mapped;
+        {
+            AssetFile file(path);
+            mapped = file.isMapped();
+            upload(file.data(), file.size());
+        }
+        double mappedSeconds = getSeconds(start);
+
+        std::printf("round %d  %.2f GB  buffered %7.2f s %7.2f GB/s  %-10s %7.2f s %7.2f GB/s\n",
+                    round + 1, size / 1e9, bufferedSeconds, size / bufferedSeconds / 1e9,
+                    mapped ? "mapped" : "asset file", mappedSeconds, size / mappedSeconds / 1e9);
+    }
+
+    // Keeps the copies into staging memory observable
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: load_bench PATH [--rounds N]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string path;
+    int rounds = 3;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg != "--rounds") {
+            if (!path.empty() || arg.empty() || arg[0] == '-') {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+            path = arg;
+            continue;
+        }
+        char *end = nullptr;
+        long value = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : -1;
+        if (end == nullptr || *end != '\0' || value < 1 || value > 1000000000) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        rounds = static_cast<int>(value);
+        ++i;
+    }
+    if (path.empty()) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        benchmark(path, rounds);
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file motion_bench.cpp
+ * @brief Times the motion search kernels on synthetic 1080p content
+ *
+ * The SAD and SATD kernels of every block size compare each block of a frame with the same
+ * block of the next frame, once with the scalar kernels and once with the kernels selected for
+ * the CPU, and print their throughput and the speedup. The 6-tap filter then interpolates the
+ * half-pel planes of the frame, padding included. Build with MODE=release for meaningful
+ * timings.
+ *
+ * Usage: motion_bench [--rounds N]
+ */
+#include "motion_search.hpp"
+#include "pixel.hpp"
+#include "yuv_frame.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+/**
+ * @brief Fills a frame with a synthetic picture that pans and changes brightness over time, as
+ * the application's encoder benchmark does
+ * @param frame The frame to fill, allocated for the picture size
+ * @param index Index of the frame, which sets the motion
+ */
+void fillSyntheticFrame(YuvFrame &frame, uint32_t index) {
+    for (int plane = 0; plane < 3; ++plane) {
+        uint32_t shift = plane == 0 ? 0 : 1;
+        uint32_t width = frame.width >> shift;
+        uint32_t height = frame.height >> shift;
+        uint32_t pan = (index * 3) >> shift;
+        size_t stride = frame.stride(plane);
+        uint8_t *row = frame.planes[plane].data();
+
+        for (uint32_t y = 0; y < height; ++y, row += stride) {
+            for (uint32_t x = 0; x < width; ++x) {
+                uint32_t u = x + pan;
+                uint32_t v = y + (pan >> 1);
+                uint32_t value = plane == 0 ? 16 + ((u + v) >> 3) % 128 + (((u ^ v) >> 4) & 1) * 64
+                                            : 64 * plane + ((u >> 2) + (v >> 3)) % 64;
+                row[x] = static_cast<uint8_t>(value);
+            }
+        }
+    }
+}
+
+void benchmark(uint32_t rounds) {
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+
+    YuvFrame frames[2];
+    for (uint32_t i = 0; i < 2; ++i) {
+        frames[i].allocate(width, height);
+        fillSyntheticFrame(frames[i], i);
+    }
+    const uint8_t *current = frames[0].planes[0].data();
+    const uint8_t *next = frames[1].planes[0].data();
+    const ptrdiff_t stride = static_cast<ptrdiff_t>(frames[0].stride(0));
+
+    auto getSeconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    // Keeps the kernel results observable
+    uint64_t checksum = 0;
+    auto getBlocksPerSecond = [&](PixelCompare compare, BlockSize size) {
+        int blockWidth = blockWidths[static_cast<size_t>(size)];
+        int blockHeight = blockHeights[static_cast<size_t>(size)];
+        uint64_t blocks = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t round = 0; round < rounds; ++round) {
+            for (uint32_t y = 0; y + blockHeight <= height; y += blockHeight) {
+                for (uint32_t x = 0; x + blockWidth <= width; x += blockWidth) {
+                    ptrdiff_t offset = static_cast<ptrdiff_t>(y) * stride + x;
+                    checksum += compare(current + offset, stride, next + offset, stride);
+                    ++blocks;
+                }
+            }
+        }
+        return blocks / getSeconds(start);
+    };
+
+    const PixelFunctions &scalar = getScalarPixelFunctions();
+    const PixelFunctions &selected = getPixelFunctions();
+    const char *sizeNames[blockSizeCount] = {"16x16", "16x8", "8x8", "4x4"};
+    for (size_t size = 0; size < blockSizeCount; ++size) {
+        for (bool satd : {false, true}) {
+            PixelCompare scalarKernel = satd ? scalar.satd[size] : scalar.sad[size];
+            PixelCompare selectedKernel = satd ? selected.satd[size] : selected.sad[size];
+            double scalarRate = getBlocksPerSecond(scalarKernel, static_cast<BlockSize>(size));
+            double selectedRate =
+                getBlocksPerSecond(selectedKernel, static_cast<BlockSize>(size));
+            std::string name = std::string(satd ? "satd " : "sad ") + sizeNames[size];
+            std::printf("%-10s scalar %9.2f Mblocks/s  selected %9.2f Mblocks/s  %6.2fx\n",
+                        name.c_str(), scalarRate / 1e6, selectedRate / 1e6,
+                        selectedRate / scalarRate);
+        }
+    }
+
+    ReferenceFrame reference;
+    PlaneView luma = {current, width, height, stride};
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; ++round) {
+        reference.build(luma);
+        checksum += *reference.fullPel(0, 0);
+    }
+    double seconds = getSeconds(start);
+    std::printf("half-pel 6-tap %9.2f Mpixels/s  %.2f ms per frame\n",
+                static_cast<double>(width) * height * rounds / seconds / 1e6,
+                seconds * 1e3 / rounds);
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: motion_bench [--rounds N]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int rounds = 50;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char *end = nullptr;
+        long value = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : -1;
+        if (arg != "--rounds" || end == nullptr || *end != '\0' || value < 1 ||
+            value > 1000000000) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        rounds = static_cast<int>(value);
+        ++i;
+    }
+
+    benchmark(static_cast<uint32_t>(rounds));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file shader_bench.cpp
+ * @brief Times creating the renderer's shader modules from files and from the embedded SPIR-V
+ *
+ * Each round creates and destroys a module for every shader, first from the files in
+ * "shaders/" read into buffers, as at startup before the shaders were embedded, then from the
+ * words embedded into the binary. The first round, which may read the files from disk, and the
+ * mean of the rest, which read them from the page cache, are printed for both. "make shaders"
+ * writes the files, and the benchmark must run from the directory that holds "shaders/". The
+ * device is selected as for the application, through VULKAN_DEVICE_INDEX or
+ * VULKAN_DEVICE_UUID.
+ *
+ * Usage: shader_bench [--rounds N]
+ */
+#include "context.hpp"
+#include "device_placement.hpp"
+#include "shader_registry.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Reads a whole file into a buffer, the way shaders were read before they were embedded
+ * @throws std::runtime_error if the file cannot be read
+ */
+std::vector<char> readWholeFile(const std::string &path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file " + path + " (make shaders writes it)");
+    }
+    std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()))) {
+        throw std::runtime_error("failed to read file " + path);
+    }
+    return buffer;
+}
+
+void benchmark(uint32_t rounds) {
+    ContextConfig config;
+    config.device = getEnvironmentDeviceSelection();
+    VulkanContext context(nullptr, config);
+    VkDevice device = context.getDevice();
+
+    auto createModule = [device](const uint32_t *code, size_t codeSize) {
+        VkShaderModuleCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = codeSize;
+        createInfo.pCode = code;
+        VkShaderModule module;
+        if (vkCreateShaderModule(device, &createInfo, nullptr, &module) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module");
+        }
+        vkDestroyShaderModule(device, module, nullptr);
+    };
+    auto measure = [rounds](const char *source, auto load) {
+        double firstMs = 0.0;
+        double totalMs = 0.0;
+        for (uint32_t i = 0; i < rounds; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            for (const EmbeddedShader &shader : embeddedShaders) {
+                load(shader);
+            }
+            std::chrono::duration<double, std::milli> time =
+                std::chrono::steady_clock::now() - start;
+            (i == 0 ? firstMs : totalMs) += time.count();
+        }
+        std::printf("%-8s first %9.3f ms  mean after %9.3f ms\n", source, firstMs,
+                    rounds > 1 ? totalMs / (rounds - 1) : firstMs);
+    };
+
+    measure("files", [&createModule](const EmbeddedShader &shader) {
+        std::vector<char> code = readWholeFile("shaders/" + std::string(shader.name));
+        createModule(reinterpret_cast<const uint32_t *>(code.data()), code.size());
+    });
+    measure("embedded", [&createModule](const EmbeddedShader &shader) {
+        createModule(shader.code, shader.codeSize);
+    });
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: shader_bench [--rounds N]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int rounds = 100;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char *end = nullptr;
+        long value = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : -1;
+        if (arg != "--rounds" || end == nullptr || *end != '\0' || value < 1 ||
+            value > 1000000000) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        rounds = static_cast<int>(value);
+        ++i;
+    }
+
+    try {
+        benchmark(static_cast<uint32_t>(rounds));
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file upload_bench.cpp
+ * @brief Times streaming textures to the device at a sweep of per-frame budgets
+ *
+ * Each budget from 4 to 64 MiB queues the same textures on a fresh uploader and flushes it as
+ * fast as it accepts work, as a renderer with no other work would once per frame. Each step
+ * prints the upload bandwidth, including mip generation, the flushes it took, the longest a
+ * flush blocked the calling thread and whether the dedicated transfer queue was used. The
+ * device is selected as for the application, through VULKAN_DEVICE_INDEX or
+ * VULKAN_DEVICE_UUID.
+ *
+ * Usage: upload_bench [--textures N] [--width N] [--height N]
+ */
+#include "context.hpp"
+#include "device_placement.hpp"
+#include "renderer.hpp"
+#include "texture_uploader.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void benchmark(uint32_t textures, uint32_t width, uint32_t height) {
+    RendererConfig config;
+    config.context.device = getEnvironmentDeviceSelection();
+    auto context = std::make_shared<VulkanContext>(nullptr, config.context);
+
+    // Every texture reads the same pixels, so that generating them stays out of the measurement
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = static_cast<uint8_t>((i * 2654435761u) >> 24);
+    }
+
+    for (size_t budgetMiB : {4, 8, 16, 32, 64}) {
+        // The ring holds every batch in flight, so that the budget alone limits a flush
+        TextureUploadConfig upload = config.textureUpload;
+        upload.frameBudget = budgetMiB * 1024 * 1024;
+        upload.stagingSize = std::max(upload.stagingSize,
+                                      upload.frameBudget * std::max(upload.batchesInFlight, 1u));
+        TextureUploader uploader(context, upload);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < textures; ++i) {
+            uploader.createTexture(width, height, pixels.data());
+        }
+
+        uint32_t flushes = 0;
+        double maxFlushMs = 0.0;
+        while (uploader.getPendingBytes() > 0) {
+            auto flushStart = std::chrono::steady_clock::now();
+            size_t copied = uploader.flush();
+            if (copied == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::chrono::duration<double, std::milli> flushTime =
+                std::chrono::steady_clock::now() - flushStart;
+            maxFlushMs = std::max(maxFlushMs, flushTime.count());
+            ++flushes;
+        }
+        uploader.waitIdle();
+        double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double bytes = static_cast<double>(pixels.size()) * textures;
+        std::printf("budget %2zu MiB  %7.2f GB/s  %5u flushes  max flush %8.2f ms  "
+                    "transfer queue %s\n",
+                    budgetMiB, bytes / seconds / 1e9, flushes, maxFlushMs,
+                    uploader.usesTransferQueue() ? "yes" : "no");
+    }
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: upload_bench [--textures N] [--width N] [--height N]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int textures = 32;
+    int width = 2048;
+    int height = 2048;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char *end = nullptr;
+        long value = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : -1;
+        if ((arg != "--textures" && arg != "--width" && arg != "--height") || end == nullptr ||
+            *end != '\0' || value < 1 || value > 16384) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        (arg == "--textures" ? textures : arg == "--width" ? width : height) =
+            static_cast<int>(value);
+        ++i;
+    }
+
+    try {
+        benchmark(static_cast<uint32_t>(textures), static_cast<uint32_t>(width),
+                  static_cast<uint32_t>(height));
+    } catch (std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
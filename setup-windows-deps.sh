@@ -14,6 +14,8 @@ VULKAN_HEADERS_INSTALL_DIR="$VULKAN_HEADERS_DIR/install"
 VULKAN_LOADER_DIR="$BASE_DIR/Vulkan-Loader"
 VULKAN_LOADER_BUILD_DIR="$VULKAN_LOADER_DIR/build"
 VULKAN_LOADER_INSTALL_DIR="$VULKAN_LOADER_DIR/install"
+ZLIB_DIR="$BASE_DIR/zlib"
+ZLIB_INSTALL_DIR="$ZLIB_DIR/install"
 
 VULKAN_BUILD_DIR="$BASE_DIR/vulkan-win64-build"
 
@@ -143,8 +145,32 @@ make -j$(nproc)
 echo "Installing Vulkan-Loader to $VULKAN_LOADER_INSTALL_DIR"
 make install
 
+# Back to base directory
+cd "$BASE_DIR"
+
+# Clone zlib if not present (PNG snapshots are deflated with it)
+if [[ ! -d "$ZLIB_DIR" ]]; then
+    echo "Cloning zlib..."
+    git clone https://github.com/madler/zlib.git "$ZLIB_DIR"
+fi
+
+# Build a static zlib for Windows with its MinGW makefile, which names it libz.a
+cd $ZLIB_DIR
+mkdir -p $ZLIB_INSTALL_DIR
+
+echo "Building zlib..."
+make -f win32/Makefile.gcc PREFIX=x86_64-w64-mingw32- -j$(nproc) libz.a
+
+echo "Installing zlib to $ZLIB_INSTALL_DIR"
+make -f win32/Makefile.gcc PREFIX=x86_64-w64-mingw32- \
+    BINARY_PATH="$ZLIB_INSTALL_DIR/bin" \
+    INCLUDE_PATH="$ZLIB_INSTALL_DIR/include" \
+    LIBRARY_PATH="$ZLIB_INSTALL_DIR/lib" \
+    install
+
 echo
 echo "All done."
 echo "GLFW built and installed to: $GLFW_INSTALL_DIR"
 echo "Vulkan-Headers built and installed to: $VULKAN_HEADERS_INSTALL_DIR"
 echo "Vulkan-Loader built and installed to: $VULKAN_LOADER_INSTALL_DIR"
+echo "zlib built and installed to: $ZLIB_INSTALL_DIR"
@@ -0,0 +1,12 @@
+#version 450
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+// The frame's output, drawn into a swapchain image that cannot be blitted into
+layout(set = 0, binding = 0) uniform sampler2D outputFrame;
+
+void main() {
+    outColor = vec4(texture(outputFrame, fragTexCoord).rgb, 1.0);
+}
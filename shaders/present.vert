@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) out vec2 fragTexCoord;
+
+layout(push_constant) uniform Present {
+    vec2 scale; // fraction of the padded output image the frame covers
+} present;
+
+void main() {
+    // One triangle covering the viewport, whose texture coordinates span the frame across it
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    fragTexCoord = position * present.scale;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,9 +1,40 @@
 #version 450
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+layout(std140, set = 0, binding = 1) uniform Frame {
+    vec4 camera;   // xy = centre of the view, z = zoom
+    vec4 time;     // x = seconds, y = frame number
+    vec4 viewport; // xy = size of the render target in pixels, zw = reciprocal
+} frame;
+
+layout(push_constant) uniform Draw {
+    vec4 tint;
+    float spin;  // radians per second
+    float noise; // amplitude of the per-pixel noise
+} draw;
+
+// The scene texture, or a white placeholder until it has streamed in
+layout(set = 0, binding = 2) uniform sampler2D sceneTexture;
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    // Noise that differs for every pixel of every frame, which no encoder can predict
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    uint seed = pixel.y * uint(frame.viewport.x) + pixel.x;
+    float noise = float(hash(seed ^ hash(uint(frame.time.y)))) / 4294967295.0 - 0.5;
+
+    vec3 albedo = fragColor * texture(sceneTexture, fragTexCoord).rgb;
+    outColor = vec4(albedo * draw.tint.rgb + noise * draw.noise, 1.0);
 }
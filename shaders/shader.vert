@@ -1,6 +1,29 @@
 #version 450
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+struct Instance {
+    vec4 bounds;    // xyz = bounding sphere centre, w = radius
+    vec4 transform; // xy = offset, z = scale
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+// One slot of the per-frame uniform ring, selected by a dynamic offset
+layout(std140, set = 0, binding = 1) uniform Frame {
+    vec4 camera;   // xy = centre of the view, z = zoom
+    vec4 time;     // x = seconds, y = frame number
+    vec4 viewport; // xy = size of the render target in pixels, zw = reciprocal
+} frame;
+
+layout(push_constant) uniform Draw {
+    vec4 tint;
+    float spin;  // radians per second
+    float noise; // amplitude of the per-pixel noise
+} draw;
 
 vec2 positions[3] = vec2[](
     vec2(0.0, -0.5),
@@ -15,6 +38,15 @@ vec3 colors[3] = vec3[](
 );
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    vec4 transform = instances[gl_InstanceIndex].transform;
+
+    // Instances spin about their own centre, so they stay inside their bounding sphere. The
+    // rate varies between instances so the scene never repeats as a whole
+    float angle = frame.time.x * draw.spin * (1.0 + float(gl_InstanceIndex % 7) * 0.25);
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+
+    vec2 position = rotation * positions[gl_VertexIndex] * transform.z + transform.xy;
+    gl_Position = vec4((position - frame.camera.xy) * frame.camera.z, 0.0, 1.0);
     fragColor = colors[gl_VertexIndex];
+    fragTexCoord = positions[gl_VertexIndex] + 0.5;
 }
@@ -0,0 +1,109 @@
+#include "asset_file.hpp"
+#include "logger.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+AssetFile::AssetFile(const std::string &path) {
+#ifdef _WIN32
+    readBuffered(path);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open file " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat file " + path);
+    }
+
+    fileSize = static_cast<size_t>(st.st_size);
+    if (fileSize < mmapThreshold) {
+        close(fd);
+        readBuffered(path);
+        return;
+    }
+
+    mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping holds its own reference to the file, so the descriptor is no longer needed
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error("failed to map file " + path);
+    }
+
+    // Hints only: a failure here does not affect correctness
+    if (madvise(mapping, fileSize, MADV_SEQUENTIAL) != 0 ||
+        madvise(mapping, fileSize, MADV_WILLNEED) != 0) {
+        LOG_DEBUG("madvise failed for " + path);
+    }
+
+    LOG_VERBOSE("Mapped " + path + " (" + std::to_string(fileSize) + " bytes)");
+#endif
+}
+
+AssetFile::~AssetFile() {
+    release();
+}
+
+AssetFile::AssetFile(AssetFile &&other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)),
+      fileSize(std::exchange(other.fileSize, 0)), buffer(std::move(other.buffer)) {}
+
+AssetFile &AssetFile::operator=(AssetFile &&other) noexcept {
+    if (this != &other) {
+        release();
+        mapping = std::exchange(other.mapping, nullptr);
+        fileSize = std::exchange(other.fileSize, 0);
+        buffer = std::move(other.buffer);
+    }
+    return *this;
+}
+
+const char *AssetFile::data() const {
+    return mapping != nullptr ? static_cast<const char *>(mapping) : buffer.data();
+}
+
+size_t AssetFile::size() const {
+    return fileSize;
+}
+
+bool AssetFile::isMapped() const {
+    return mapping != nullptr;
+}
+
+void AssetFile::readBuffered(const std::string &path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open file " + path);
+    }
+
+    fileSize = (size_t)file.tellg();
+    buffer.resize(fileSize);
+
+    file.seekg(0);
+    if (!file.read(buffer.data(), fileSize)) {
+        throw std::runtime_error("failed to read file " + path);
+    }
+}
+
+void AssetFile::release() {
+#ifndef _WIN32
+    if (mapping != nullptr) {
+        munmap(mapping, fileSize);
+        mapping = nullptr;
+    }
+#endif
+}
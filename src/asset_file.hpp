@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @class AssetFile
+ * @brief Read-only view of a file on disk with RAII lifetime
+ *
+ * Large files are memory-mapped so that uploads can copy straight from the page cache into
+ * staging memory, without an intermediate heap copy. The mapping is advised as sequential and
+ * will-need so the kernel reads ahead aggressively. Files smaller than "mmapThreshold" (and all
+ * files on platforms without mmap) are read into an owned buffer instead, where the cost of
+ * setting up a mapping would outweigh the copy.
+ *
+ * The data pointer is at least 16-byte aligned in both modes, so it can be reinterpreted as
+ * SPIR-V words or other 32-bit data.
+ */
+class AssetFile {
+  public:
+    /// @brief Files at least this large are memory-mapped rather than read into a buffer
+    static constexpr size_t mmapThreshold = 64 * 1024;
+
+    /**
+     * @brief Opens and maps (or reads) the given file
+     * @param path Path to the file
+     * @throws std::runtime_error if the file cannot be opened, mapped or read
+     */
+    explicit AssetFile(const std::string &path);
+
+    /**
+     * @brief Unmaps the file or releases the owned buffer
+     */
+    ~AssetFile();
+
+    AssetFile(AssetFile &&other) noexcept;
+    AssetFile &operator=(AssetFile &&other) noexcept;
+    AssetFile(const AssetFile &) = delete;
+    AssetFile &operator=(const AssetFile &) = delete;
+
+    /**
+     * @brief Returns a pointer to the first byte of the file contents
+     */
+    const char *data() const;
+
+    /**
+     * @brief Returns the size of the file in bytes
+     */
+    size_t size() const;
+
+    /**
+     * @brief Returns true if the contents are memory-mapped rather than buffered
+     */
+    bool isMapped() const;
+
+  protected:
+    /// @brief Base address of the mapping, or nullptr when the file is buffered
+    void *mapping = nullptr;
+
+    /// @brief Size of the file (and of the mapping, if any) in bytes
+    size_t fileSize = 0;
+
+    /// @brief Owned copy of the file contents for small files
+    std::vector<char> buffer;
+
+    /**
+     * @brief Reads the whole file into the owned buffer
+     * @param path Path to the file
+     */
+    void readBuffered(const std::string &path);
+
+    /**
+     * @brief Releases the mapping, if any
+     */
+    void release();
+};
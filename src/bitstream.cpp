@@ -0,0 +1,125 @@
+#include "bitstream.hpp"
+#include <stdexcept>
+
+namespace {
+
+int bitLength(uint64_t value) {
+    int length = 0;
+    while (value != 0) {
+        value >>= 1;
+        ++length;
+    }
+    return length;
+}
+
+} // namespace
+
+int ueBits(uint32_t value) {
+    return 2 * bitLength(static_cast<uint64_t>(value) + 1) - 1;
+}
+
+void BitWriter::writeUe(uint32_t value) {
+    uint64_t code = static_cast<uint64_t>(value) + 1;
+    int length = bitLength(code);
+    writeBits(0, length - 1);
+    if (length > 32) {
+        // Only 2^32 - 1 has a 33-bit code number: a one followed by 32 zeros
+        writeBits(1, 1);
+        writeBits(0, 32);
+    } else {
+        writeBits(static_cast<uint32_t>(code), length);
+    }
+}
+
+void BitWriter::writeSe(int32_t value) {
+    writeUe(seCodeNumber(value));
+}
+
+void BitWriter::writeTrailingBits() {
+    writeBit(true);
+    if (!isAligned()) {
+        writeBits(0, 8 - (pending & 7));
+    }
+}
+
+void BitWriter::alignWithOnes() {
+    if (!isAligned()) {
+        int count = 8 - (pending & 7);
+        writeBits((1u << count) - 1, count);
+    }
+}
+
+void BitWriter::appendBytes(const uint8_t *data, size_t size) {
+    getBytes();
+    bytes.insert(bytes.end(), data, data + size);
+}
+
+const std::vector<uint8_t> &BitWriter::getBytes() {
+    if (!isAligned()) {
+        throw std::runtime_error("bitstream is not byte aligned");
+    }
+    while (pending >= 8) {
+        pending -= 8;
+        bytes.push_back(static_cast<uint8_t>(accumulator >> pending));
+    }
+    accumulator = 0;
+    return bytes;
+}
+
+void BitWriter::clear() {
+    bytes.clear();
+    accumulator = 0;
+    pending = 0;
+}
+
+void BitWriter::flushWord() {
+    pending -= 32;
+    uint32_t word = static_cast<uint32_t>(accumulator >> pending);
+    bytes.push_back(static_cast<uint8_t>(word >> 24));
+    bytes.push_back(static_cast<uint8_t>(word >> 16));
+    bytes.push_back(static_cast<uint8_t>(word >> 8));
+    bytes.push_back(static_cast<uint8_t>(word));
+    accumulator &= (uint64_t(1) << pending) - 1;
+}
+
+void BitCounter::writeUe(uint32_t value) {
+    bits += ueBits(value);
+}
+
+void BitCounter::writeSe(int32_t value) {
+    bits += ueBits(seCodeNumber(value));
+}
+
+size_t writeNalUnit(uint8_t *out, int nalRefIdc, int nalUnitType, const uint8_t *rbsp,
+                    size_t size) {
+    uint8_t *start = out;
+    *out++ = 0;
+    *out++ = 0;
+    *out++ = 0;
+    *out++ = 1;
+    *out++ = static_cast<uint8_t>((nalRefIdc << 5) | nalUnitType);
+
+    int zeros = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (zeros == 2 && rbsp[i] <= 3) {
+            *out++ = 3;
+            zeros = 0;
+        }
+        *out++ = rbsp[i];
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+    return static_cast<size_t>(out - start);
+}
+
+size_t maxNalUnitSize(size_t size) {
+    // At most one emulation prevention byte per three payload bytes
+    return 5 + size + size / 2;
+}
+
+void appendNalUnit(std::vector<uint8_t> &stream, int nalRefIdc, int nalUnitType,
+                   const uint8_t *rbsp, size_t size) {
+    size_t offset = stream.size();
+    stream.resize(offset + maxNalUnitSize(size));
+    size_t written = writeNalUnit(stream.data() + offset, nalRefIdc, nalUnitType, rbsp, size);
+    stream.resize(offset + written);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class BitWriter
+ * @brief Writes an MSB-first bitstream, as H.264 syntax elements are laid out
+ *
+ * Bits gather in a 64-bit accumulator and reach the byte buffer 32 at a time, so writing a
+ * syntax element is a shift and an or in the common case
+ */
+class BitWriter {
+  public:
+    /**
+     * @brief Writes the low bits of a value
+     * @param value The value, whose bits above "count" must be zero
+     * @param count Number of bits to write (0 to 32)
+     */
+    void writeBits(uint32_t value, int count) {
+        accumulator = (accumulator << count) | value;
+        pending += count;
+        if (pending >= 32) {
+            flushWord();
+        }
+    }
+
+    /**
+     * @brief Writes a single bit
+     */
+    void writeBit(bool bit) { writeBits(bit ? 1 : 0, 1); }
+
+    /**
+     * @brief Writes an unsigned Exp-Golomb code, ue(v)
+     */
+    void writeUe(uint32_t value);
+
+    /**
+     * @brief Writes a signed Exp-Golomb code, se(v)
+     */
+    void writeSe(int32_t value);
+
+    /**
+     * @brief Writes rbsp_trailing_bits: a one bit, then zero bits up to a byte boundary
+     */
+    void writeTrailingBits();
+
+    /**
+     * @brief Pads to a byte boundary with one bits (cabac_alignment_one_bit)
+     */
+    void alignWithOnes();
+
+    /**
+     * @brief Appends whole bytes, e.g. the output of an arithmetic coder
+     * @throws std::runtime_error if the stream is not byte aligned
+     */
+    void appendBytes(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Returns whether the stream ends on a byte boundary
+     */
+    bool isAligned() const { return (pending & 7) == 0; }
+
+    /**
+     * @brief Returns the number of bits written
+     */
+    uint64_t getBitCount() const { return bytes.size() * 8 + pending; }
+
+    /**
+     * @brief Returns the written bytes
+     * @throws std::runtime_error if the stream is not byte aligned
+     */
+    const std::vector<uint8_t> &getBytes();
+
+    /**
+     * @brief Discards everything written
+     */
+    void clear();
+
+  protected:
+    /// @brief Completed bytes
+    std::vector<uint8_t> bytes;
+
+    /// @brief Bits not yet moved to the byte buffer, in the low "pending" bits
+    uint64_t accumulator = 0;
+
+    /// @brief Number of bits in the accumulator
+    int pending = 0;
+
+    /**
+     * @brief Moves the oldest 32 pending bits to the byte buffer
+     */
+    void flushWord();
+};
+
+/**
+ * @class BitCounter
+ * @brief Stands in for a BitWriter when only the size of the syntax is needed
+ *
+ * Entropy coders are templates over their output, so the same code measures the cost of a
+ * choice (e.g. during rate-distortion optimisation) without producing a stream
+ */
+class BitCounter {
+  public:
+    void writeBits(uint32_t, int count) { bits += count; }
+    void writeBit(bool) { ++bits; }
+    void writeUe(uint32_t value);
+    void writeSe(int32_t value);
+
+    /**
+     * @brief Returns the number of bits counted
+     */
+    uint64_t getBitCount() const { return bits; }
+
+    /**
+     * @brief Resets the count to zero
+     */
+    void clear() { bits = 0; }
+
+  protected:
+    /// @brief Number of bits counted
+    uint64_t bits = 0;
+};
+
+/**
+ * @brief Returns the length of an unsigned Exp-Golomb code
+ */
+int ueBits(uint32_t value);
+
+/**
+ * @brief Maps a signed value to the code number of its se(v) code
+ */
+inline uint32_t seCodeNumber(int32_t value) {
+    return value > 0 ? 2 * static_cast<uint32_t>(value) - 1 : 2 * static_cast<uint32_t>(-value);
+}
+
+/**
+ * @brief Writes a NAL unit with its start code to memory, as appendNalUnit() does
+ * @param out Destination, with room for maxNalUnitSize(size) bytes
+ * @param nalRefIdc nal_ref_idc (0 for pictures that are not referenced)
+ * @param nalUnitType nal_unit_type
+ * @param rbsp The payload, ending with its trailing bits
+ * @param size Size of the payload in bytes
+ * @return Number of bytes written
+ */
+size_t writeNalUnit(uint8_t *out, int nalRefIdc, int nalUnitType, const uint8_t *rbsp,
+                    size_t size);
+
+/**
+ * @brief Returns the largest size of a NAL unit written from a payload of the given size
+ */
+size_t maxNalUnitSize(size_t size);
+
+/**
+ * @brief Appends a NAL unit to an Annex B byte stream
+ *
+ * Writes a four-byte start code and the NAL header, then the payload with an
+ * emulation_prevention_three_byte inserted wherever it would otherwise contain a start code
+ *
+ * @param stream The byte stream
+ * @param nalRefIdc nal_ref_idc (0 for pictures that are not referenced)
+ * @param nalUnitType nal_unit_type
+ * @param rbsp The payload, ending with its trailing bits
+ * @param size Size of the payload in bytes
+ */
+void appendNalUnit(std::vector<uint8_t> &stream, int nalRefIdc, int nalUnitType,
+                   const uint8_t *rbsp, size_t size);
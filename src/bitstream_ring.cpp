@@ -0,0 +1,164 @@
+#include "bitstream_ring.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+BitstreamRing::BitstreamRing(size_t initialCapacity, size_t alignment)
+    : nextCapacity(initialCapacity), alignment(std::max<size_t>(alignment, 1)) {}
+
+BitstreamSpan BitstreamRing::reserve(size_t maxSize) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t size = std::max(align(maxSize), alignment);
+
+    auto current = blocks.find(currentBlock);
+    size_t offset = current != blocks.end() ? place(current->second, size) : SIZE_MAX;
+    if (offset == SIZE_MAX) {
+        // Grow into a new block; frames in the old one stay where they are until released
+        if (current != blocks.end()) {
+            nextCapacity = std::max(nextCapacity, current->second.capacity * 2);
+            if (current->second.liveCount == 0) {
+                freeBlock(current->first);
+                blocks.erase(current);
+            }
+        }
+        nextCapacity = std::max(nextCapacity, size);
+
+        Block block;
+        block.capacity = nextCapacity;
+        currentBlock = nextBlockId++;
+        block.data = allocateBlock(currentBlock, block.capacity);
+        current = blocks.emplace(currentBlock, block).first;
+        offset = 0;
+    }
+
+    Block &block = current->second;
+    if (block.liveCount == 0) {
+        block.tail = offset;
+    }
+    block.head = offset + size;
+    ++block.liveCount;
+
+    BitstreamSpan span;
+    span.sequence = nextSequence++;
+    span.block = currentBlock;
+    span.offset = offset;
+    span.capacity = size;
+    span.data = block.data + offset;
+
+    entries.push_back({span.sequence, span.block, offset, false});
+    return span;
+}
+
+BitstreamView BitstreamRing::commit(const BitstreamSpan &span, size_t size) {
+    if (size > span.capacity) {
+        throw std::runtime_error("coded frame overflows its bitstream reservation");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!entries.empty() && entries.back().sequence == span.sequence &&
+        span.block == currentBlock) {
+        blocks[currentBlock].head = span.offset + std::max(align(size), alignment);
+    }
+
+    BitstreamView view;
+    view.sequence = span.sequence;
+    view.data = span.data;
+    view.size = size;
+    return view;
+}
+
+void BitstreamRing::cancel(const BitstreamSpan &span) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // The newest reservation is simply undone, so its number and space are reused
+    if (!entries.empty() && entries.back().sequence == span.sequence) {
+        Block &block = blocks[span.block];
+        entries.pop_back();
+        --nextSequence;
+        if (--block.liveCount == 0 && span.block != currentBlock) {
+            freeBlock(span.block);
+            blocks.erase(span.block);
+        } else {
+            block.head = span.offset;
+        }
+        return;
+    }
+
+    entries[span.sequence - entries.front().sequence].released = true;
+    reclaim();
+}
+
+void BitstreamRing::release(const BitstreamView &view) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[view.sequence - entries.front().sequence].released = true;
+    reclaim();
+}
+
+size_t BitstreamRing::getCapacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto current = blocks.find(currentBlock);
+    return current != blocks.end() ? current->second.capacity : nextCapacity;
+}
+
+size_t BitstreamRing::align(size_t size) const {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+size_t BitstreamRing::place(const Block &block, size_t size) const {
+    if (block.liveCount == 0) {
+        return size <= block.capacity ? 0 : SIZE_MAX;
+    }
+
+    // Live frames occupy [tail, head), or [tail, end) and [0, head) once the ring has wrapped
+    if (block.head > block.tail) {
+        if (block.capacity - block.head >= size) {
+            return block.head;
+        }
+        return size <= block.tail ? 0 : SIZE_MAX;
+    }
+    return block.tail - block.head >= size ? block.head : SIZE_MAX;
+}
+
+void BitstreamRing::reclaim() {
+    while (!entries.empty() && entries.front().released) {
+        uint32_t id = entries.front().block;
+        entries.pop_front();
+
+        Block &block = blocks[id];
+        if (--block.liveCount > 0) {
+            // A block's reservations are contiguous in the ring, so the next one is in it too
+            block.tail = entries.front().offset;
+        } else if (id != currentBlock) {
+            freeBlock(id);
+            blocks.erase(id);
+        } else {
+            block.head = 0;
+            block.tail = 0;
+        }
+    }
+}
+
+void BitstreamRing::freeBlocks() {
+    for (const auto &block : blocks) {
+        freeBlock(block.first);
+    }
+    blocks.clear();
+    entries.clear();
+}
+
+HostBitstreamRing::HostBitstreamRing(size_t initialCapacity)
+    : BitstreamRing(initialCapacity, 64) {}
+
+HostBitstreamRing::~HostBitstreamRing() {
+    freeBlocks();
+}
+
+uint8_t *HostBitstreamRing::allocateBlock(uint32_t id, size_t capacity) {
+    std::unique_ptr<uint8_t[]> &block = storage[id];
+    block.reset(new uint8_t[capacity]);
+    return block.get();
+}
+
+void HostBitstreamRing::freeBlock(uint32_t id) {
+    storage.erase(id);
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/**
+ * @struct BitstreamSpan
+ * @brief Region of a BitstreamRing reserved for one coded frame
+ */
+struct BitstreamSpan {
+    /// @brief Reservation number, increasing with every reserve()
+    uint64_t sequence = 0;
+
+    /// @brief Block of the ring the region lies in
+    uint32_t block = 0;
+
+    /// @brief Offset of the region within its block, in bytes
+    size_t offset = 0;
+
+    /// @brief Size of the region in bytes
+    size_t capacity = 0;
+
+    /// @brief First byte of the region
+    uint8_t *data = nullptr;
+};
+
+/**
+ * @struct BitstreamView
+ * @brief A coded frame in a BitstreamRing, valid until it is released
+ */
+struct BitstreamView {
+    /// @brief Reservation the frame was written into, which release() takes
+    uint64_t sequence = 0;
+
+    /// @brief First byte of the frame
+    const uint8_t *data = nullptr;
+
+    /// @brief Size of the frame in bytes
+    size_t size = 0;
+};
+
+/**
+ * @class BitstreamRing
+ * @brief Ring of coded frames that encoders write into and consumers read in place
+ *
+ * An encoder reserves room for a frame with an upper bound on its size, writes it, and
+ * commits the actual size. Consumers receive a view of the bytes where they were written
+ * and release it once done, so frames are never copied on their way out. Space is reclaimed
+ * in reservation order as frames are released.
+ *
+ * When a reservation does not fit, the ring grows into a new, larger block. Frames still in
+ * the old block stay valid and the block is freed once they have all been released, so
+ * growing never moves a frame. Backends provide the blocks, such as host memory for the
+ * software encoder. All methods are thread-safe
+ */
+class BitstreamRing {
+  public:
+    /**
+     * @brief Creates an empty ring; the first block is allocated on the first reservation
+     * @param initialCapacity Size of the first block in bytes
+     * @param alignment Alignment of reservation offsets and sizes (a power of two)
+     */
+    BitstreamRing(size_t initialCapacity, size_t alignment);
+
+    virtual ~BitstreamRing() = default;
+
+    BitstreamRing(const BitstreamRing &) = delete;
+    BitstreamRing &operator=(const BitstreamRing &) = delete;
+
+    /**
+     * @brief Reserves room for a frame, growing the ring if it does not fit
+     * @param maxSize Largest number of bytes the frame may take
+     * @return The reserved region
+     */
+    BitstreamSpan reserve(size_t maxSize);
+
+    /**
+     * @brief Marks a reservation as holding a frame
+     *
+     * If it is the newest reservation, the space beyond the frame is handed back at once
+     *
+     * @param span The reservation
+     * @param size Size of the frame in bytes (at most span.capacity)
+     * @return A view of the frame, to be released by its last consumer
+     * @throws std::runtime_error if the frame is larger than the reservation
+     */
+    BitstreamView commit(const BitstreamSpan &span, size_t size);
+
+    /**
+     * @brief Gives up a reservation that will not be committed, e.g. after an overflow
+     */
+    void cancel(const BitstreamSpan &span);
+
+    /**
+     * @brief Releases a committed frame, whose view must no longer be used
+     */
+    void release(const BitstreamView &view);
+
+    /**
+     * @brief Returns the capacity of the block new reservations are made in
+     */
+    size_t getCapacity() const;
+
+  protected:
+    /**
+     * @struct Block
+     * @brief A contiguous region frames are written into
+     */
+    struct Block {
+        /// @brief First byte of the block
+        uint8_t *data = nullptr;
+
+        /// @brief Size of the block in bytes
+        size_t capacity = 0;
+
+        /// @brief Offset of the next reservation
+        size_t head = 0;
+
+        /// @brief Offset of the oldest live reservation
+        size_t tail = 0;
+
+        /// @brief Number of reservations not yet released
+        uint32_t liveCount = 0;
+    };
+
+    /**
+     * @struct Entry
+     * @brief A reservation not yet reclaimed
+     */
+    struct Entry {
+        /// @brief Reservation number
+        uint64_t sequence;
+
+        /// @brief Block of the reservation
+        uint32_t block;
+
+        /// @brief Offset of the reservation within its block
+        size_t offset;
+
+        /// @brief Whether the reservation has been released or cancelled
+        bool released;
+    };
+
+    /**
+     * @brief Allocates the storage of a block
+     * @param id Identifier of the block, passed back to freeBlock()
+     * @param capacity Size of the block in bytes
+     * @return The first byte of the block
+     */
+    virtual uint8_t *allocateBlock(uint32_t id, size_t capacity) = 0;
+
+    /**
+     * @brief Frees the storage of a block
+     */
+    virtual void freeBlock(uint32_t id) = 0;
+
+    /// @brief Guards the ring state
+    mutable std::mutex mutex;
+
+    /// @brief Blocks still holding live reservations, and the current block
+    std::map<uint32_t, Block> blocks;
+
+    /// @brief Reservations in order, oldest first
+    std::deque<Entry> entries;
+
+    /// @brief Block new reservations are made in
+    uint32_t currentBlock = 0;
+
+    /// @brief Identifier of the next block
+    uint32_t nextBlockId = 0;
+
+    /// @brief Capacity of the next block to allocate
+    size_t nextCapacity;
+
+    /// @brief Alignment of reservation offsets and sizes
+    size_t alignment;
+
+    /// @brief Number of the next reservation
+    uint64_t nextSequence = 0;
+
+    /**
+     * @brief Rounds a size up to the alignment
+     */
+    size_t align(size_t size) const;
+
+    /**
+     * @brief Finds room for a reservation in the current block
+     * @return Offset of the room, or SIZE_MAX if it does not fit
+     */
+    size_t place(const Block &block, size_t size) const;
+
+    /**
+     * @brief Reclaims released reservations from the front of the ring
+     */
+    void reclaim();
+
+    /**
+     * @brief Frees the storage of every block. Called by backend destructors
+     */
+    void freeBlocks();
+};
+
+/**
+ * @class HostBitstreamRing
+ * @brief BitstreamRing backed by host memory, for the software encoder
+ */
+class HostBitstreamRing : public BitstreamRing {
+  public:
+    /**
+     * @brief Creates an empty ring
+     * @param initialCapacity Size of the first block in bytes
+     */
+    explicit HostBitstreamRing(size_t initialCapacity);
+
+    ~HostBitstreamRing() override;
+
+  protected:
+    /// @brief Storage of each block
+    std::map<uint32_t, std::unique_ptr<uint8_t[]>> storage;
+
+    uint8_t *allocateBlock(uint32_t id, size_t capacity) override;
+    void freeBlock(uint32_t id) override;
+};
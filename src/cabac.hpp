@@ -0,0 +1,274 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Number of CABAC context variables (ctxIdx 0 to 1023)
+constexpr size_t cabacContextCount = 1024;
+
+/**
+ * @struct CabacInitValue
+ * @brief The (m, n) pair from which a context variable is initialised
+ */
+struct CabacInitValue {
+    int8_t m;
+    int8_t n;
+};
+
+/**
+ * @brief (m, n) pairs of the contexts of I slices, by ctxIdx
+ */
+extern const CabacInitValue cabacInitIntra[cabacContextCount];
+
+/**
+ * @brief (m, n) pairs of the contexts of P slices, by cabac_init_idc and ctxIdx
+ */
+extern const CabacInitValue cabacInitInter[3][cabacContextCount];
+
+/**
+ * @brief Width of the LPS subrange, by probability state and quantised range
+ */
+extern const uint8_t cabacRangeLps[64][4];
+
+/**
+ * @brief Next context, by context ((state << 1) | MPS) and coded bin
+ */
+extern const uint8_t cabacTransition[128][2];
+
+/**
+ * @brief Cost in 1/256 bits of coding a bin, by context xor bin
+ *
+ * The low bit of the index is set when the bin is the LPS
+ */
+extern const uint16_t cabacBinCost[128];
+
+/**
+ * @class CabacContextModel
+ * @brief The adaptive probability models of a slice
+ *
+ * Each context is stored as (state << 1) | MPS, so that a table lookup both updates it and
+ * prices a bin
+ */
+class CabacContextModel {
+  public:
+    /**
+     * @brief Initialises the contexts for a slice
+     *
+     * Contexts the table does not cover start equiprobable. The table is indexed by ctxIdx and
+     * must be the one of the slice type and cabac_init_idc the slice header signals
+     *
+     * @param qp SliceQP
+     * @param table (m, n) pairs from ctxIdx 0
+     * @param count Number of pairs
+     */
+    void initialize(int qp, const CabacInitValue *table, size_t count);
+
+    /**
+     * @brief Initialises the contexts for a slice from the standard tables
+     * @param qp SliceQP
+     * @param intra Whether the slice is an I slice
+     * @param cabacInitIdc cabac_init_idc of a P slice (0 to 2), ignored for I slices
+     * @throws std::runtime_error if cabacInitIdc is out of range
+     */
+    void initialize(int qp, bool intra, int cabacInitIdc = 0);
+
+    /**
+     * @brief Returns the packed state of a context
+     */
+    uint8_t getContext(int context) const { return contexts[context]; }
+
+  protected:
+    /// @brief Packed context variables, by ctxIdx
+    std::array<uint8_t, cabacContextCount> contexts{};
+};
+
+/**
+ * @class CabacEncoder
+ * @brief Binary arithmetic coder of CABAC slice data
+ *
+ * The low register holds the unresolved bits and is emptied a byte at a time; runs of 0xFF
+ * bytes that a later carry could still change are counted rather than stored
+ */
+class CabacEncoder : public CabacContextModel {
+  public:
+    /**
+     * @brief Codes a bin with an adaptive context
+     * @param context ctxIdx of the bin
+     * @param bin The bin (0 or 1)
+     */
+    void encodeDecision(int context, int bin) {
+        int state = contexts[context];
+        int rangeLps = cabacRangeLps[state >> 1][(range >> 6) & 3];
+        range -= rangeLps;
+        if (bin != (state & 1)) {
+            low += range;
+            range = rangeLps;
+        }
+        contexts[context] = cabacTransition[state][bin];
+        int shift = __builtin_clz(range) - 23;
+        range <<= shift;
+        low <<= shift;
+        queue += shift;
+        if (queue >= 0) {
+            putByte();
+        }
+    }
+
+    /**
+     * @brief Codes an equiprobable bin
+     */
+    void encodeBypass(int bin) {
+        low <<= 1;
+        low += -bin & range;
+        if (++queue >= 0) {
+            putByte();
+        }
+    }
+
+    /**
+     * @brief Codes a bin with the non-adapting terminating context (end_of_slice_flag etc.)
+     *
+     * A one ends the arithmetic codeword: the coder is flushed, the last bit written being the
+     * rbsp_stop_one_bit, and padded with zero bits to a byte boundary
+     */
+    void encodeTerminate(int bin);
+
+    /**
+     * @brief Returns the coded bytes, complete once a terminating one has been coded
+     */
+    const std::vector<uint8_t> &getBytes() const { return bytes; }
+
+    /**
+     * @brief Discards the output and restarts the arithmetic coder, keeping the contexts
+     */
+    void reset();
+
+  protected:
+    /// @brief Coded bytes
+    std::vector<uint8_t> bytes;
+
+    /// @brief Lower end of the interval, with unresolved bits above the 10-bit register
+    uint32_t low = 0;
+
+    /// @brief Width of the interval (9 bits)
+    uint32_t range = 0x1fe;
+
+    /// @brief Bits pending above the register, minus 8; a byte is ready when non-negative
+    int queue = -9;
+
+    /// @brief Number of 0xFF bytes held back until a carry is resolved
+    int outstanding = 0;
+
+    /**
+     * @brief Moves the oldest pending byte to the output, propagating any carry
+     */
+    void putByte();
+};
+
+/**
+ * @class CabacEstimator
+ * @brief Stands in for a CabacEncoder when only the cost of some syntax is needed
+ *
+ * Bins are priced from the probability of their context, which is then updated as the coder
+ * would update it, so estimating a choice needs a copy of the model the choice starts from
+ */
+class CabacEstimator : public CabacContextModel {
+  public:
+    CabacEstimator() = default;
+
+    /**
+     * @brief Starts from the contexts of another model
+     */
+    explicit CabacEstimator(const CabacContextModel &model) : CabacContextModel(model) {}
+
+    void encodeDecision(int context, int bin) {
+        int state = contexts[context];
+        cost += cabacBinCost[state ^ bin];
+        contexts[context] = cabacTransition[state][bin];
+    }
+
+    void encodeBypass(int) { cost += 256; }
+
+    void encodeTerminate(int bin);
+
+    /**
+     * @brief Returns the estimated cost in 1/256 bits
+     */
+    uint32_t getCost() const { return cost; }
+
+    /**
+     * @brief Resets the cost to zero, keeping the contexts
+     */
+    void clearCost() { cost = 0; }
+
+  protected:
+    /// @brief Estimated cost so far, in 1/256 bits
+    uint32_t cost = 0;
+};
+
+/**
+ * @class CabacBinCounter
+ * @brief Stands in for a CabacEncoder to count the bins of some syntax
+ *
+ * The count is what the standard bounds per picture (BinCountsInNALunits), and what coder
+ * throughput is measured in
+ */
+class CabacBinCounter {
+  public:
+    void encodeDecision(int, int) { ++bins; }
+
+    void encodeBypass(int) { ++bins; }
+
+    void encodeTerminate(int) { ++bins; }
+
+    /**
+     * @brief Returns the number of bins counted
+     */
+    uint64_t getBins() const { return bins; }
+
+  protected:
+    /// @brief Bins counted so far
+    uint64_t bins = 0;
+};
+
+/**
+ * @enum CabacBlockCategory
+ * @brief ctxBlockCat of a residual block
+ */
+enum class CabacBlockCategory : uint8_t {
+    /// @brief Intra16x16 luma DC (16 coefficients)
+    LumaDc,
+
+    /// @brief Intra16x16 luma AC (15 coefficients)
+    LumaAc,
+
+    /// @brief Luma 4x4 (16 coefficients)
+    Luma4x4,
+
+    /// @brief 4:2:0 chroma DC (4 coefficients)
+    ChromaDc,
+
+    /// @brief Chroma AC (15 coefficients)
+    ChromaAc,
+
+    /// @brief Luma 8x8 (64 coefficients)
+    Luma8x8,
+};
+
+/**
+ * @brief Codes a residual block with CABAC (residual_block_cabac)
+ *
+ * The coder is a CabacEncoder, a CabacEstimator to price the block or a CabacBinCounter. A Luma8x8 block has no
+ * coded_block_flag, as its coded_block_pattern bit stands for it, so it must have a non-zero
+ * level or nothing is coded
+ *
+ * @param coder Codes the bins
+ * @param coefficients Levels in scan order
+ * @param category Kind of block, which also sets the number of coefficients
+ * @param codedBlockFlagInc ctxIdxInc of coded_block_flag, derived from the neighbouring blocks
+ * (ignored for Luma8x8 blocks)
+ */
+template <typename Coder>
+void writeCabacResidual(Coder &coder, const int16_t *coefficients, CabacBlockCategory category,
+                        int codedBlockFlagInc);
@@ -0,0 +1,406 @@
+#include "cavlc.hpp"
+#include "bitstream.hpp"
+#include <cstdlib>
+
+namespace {
+
+/// @brief coeff_token lengths, by nC range, TotalCoeff and TrailingOnes
+constexpr uint8_t coeffTokenLength[4][17][4] = {
+    {
+        {1, 0, 0, 0},
+        {6, 2, 0, 0},
+        {8, 6, 3, 0},
+        {9, 8, 7, 5},
+        {10, 9, 8, 6},
+        {11, 10, 9, 7},
+        {13, 11, 10, 8},
+        {13, 13, 11, 9},
+        {13, 13, 13, 10},
+        {14, 14, 13, 11},
+        {14, 14, 14, 13},
+        {15, 15, 14, 14},
+        {15, 15, 15, 14},
+        {16, 15, 15, 15},
+        {16, 16, 16, 15},
+        {16, 16, 16, 16},
+        {16, 16, 16, 16},
+    },
+    {
+        {2, 0, 0, 0},
+        {6, 2, 0, 0},
+        {6, 5, 3, 0},
+        {7, 6, 6, 4},
+        {8, 6, 6, 4},
+        {8, 7, 7, 5},
+        {9, 8, 8, 6},
+        {11, 9, 9, 6},
+        {11, 11, 11, 7},
+        {12, 11, 11, 9},
+        {12, 12, 12, 11},
+        {12, 12, 12, 11},
+        {13, 13, 13, 12},
+        {13, 13, 13, 13},
+        {13, 14, 13, 13},
+        {14, 14, 14, 13},
+        {14, 14, 14, 14},
+    },
+    {
+        {4, 0, 0, 0},
+        {6, 4, 0, 0},
+        {6, 5, 4, 0},
+        {6, 5, 5, 4},
+        {7, 5, 5, 4},
+        {7, 5, 5, 4},
+        {7, 6, 6, 4},
+        {7, 6, 6, 4},
+        {8, 7, 7, 5},
+        {8, 8, 7, 6},
+        {9, 8, 8, 7},
+        {9, 9, 8, 8},
+        {9, 9, 9, 8},
+        {10, 9, 9, 9},
+        {10, 10, 10, 10},
+        {10, 10, 10, 10},
+        {10, 10, 10, 10},
+    },
+    {
+        {6, 0, 0, 0},
+        {6, 6, 0, 0},
+        {6, 6, 6, 0},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+        {6, 6, 6, 6},
+    },
+};
+
+/// @brief coeff_token codes, laid out as coeffTokenLength
+constexpr uint8_t coeffTokenCode[4][17][4] = {
+    {
+        {1, 0, 0, 0},
+        {5, 1, 0, 0},
+        {7, 4, 1, 0},
+        {7, 6, 5, 3},
+        {7, 6, 5, 3},
+        {7, 6, 5, 4},
+        {15, 6, 5, 4},
+        {11, 14, 5, 4},
+        {8, 10, 13, 4},
+        {15, 14, 9, 4},
+        {11, 10, 13, 12},
+        {15, 14, 9, 12},
+        {11, 10, 13, 8},
+        {15, 1, 9, 12},
+        {11, 14, 13, 8},
+        {7, 10, 9, 12},
+        {4, 6, 5, 8},
+    },
+    {
+        {3, 0, 0, 0},
+        {11, 2, 0, 0},
+        {7, 7, 3, 0},
+        {7, 10, 9, 5},
+        {7, 6, 5, 4},
+        {4, 6, 5, 6},
+        {7, 6, 5, 8},
+        {15, 6, 5, 4},
+        {11, 14, 13, 4},
+        {15, 10, 9, 4},
+        {11, 14, 13, 12},
+        {8, 10, 9, 8},
+        {15, 14, 13, 12},
+        {11, 10, 9, 12},
+        {7, 11, 6, 8},
+        {9, 8, 10, 1},
+        {7, 6, 5, 4},
+    },
+    {
+        {15, 0, 0, 0},
+        {15, 14, 0, 0},
+        {11, 15, 13, 0},
+        {8, 12, 14, 12},
+        {15, 10, 11, 11},
+        {11, 8, 9, 10},
+        {9, 14, 13, 9},
+        {8, 10, 9, 8},
+        {15, 14, 13, 13},
+        {11, 14, 10, 12},
+        {15, 10, 13, 12},
+        {11, 14, 9, 12},
+        {8, 10, 13, 8},
+        {13, 7, 9, 12},
+        {9, 12, 11, 10},
+        {5, 8, 7, 6},
+        {1, 4, 3, 2},
+    },
+    {
+        {3, 0, 0, 0},
+        {0, 1, 0, 0},
+        {4, 5, 6, 0},
+        {8, 9, 10, 11},
+        {12, 13, 14, 15},
+        {16, 17, 18, 19},
+        {20, 21, 22, 23},
+        {24, 25, 26, 27},
+        {28, 29, 30, 31},
+        {32, 33, 34, 35},
+        {36, 37, 38, 39},
+        {40, 41, 42, 43},
+        {44, 45, 46, 47},
+        {48, 49, 50, 51},
+        {52, 53, 54, 55},
+        {56, 57, 58, 59},
+        {60, 61, 62, 63},
+    },
+};
+
+/// @brief Chroma DC coeff_token lengths, by TotalCoeff and TrailingOnes
+constexpr uint8_t chromaDcCoeffTokenLength[5][4] = {
+    {2, 0, 0, 0},
+    {6, 1, 0, 0},
+    {6, 6, 3, 0},
+    {6, 7, 7, 6},
+    {6, 8, 8, 7},
+};
+
+/// @brief Chroma DC coeff_token codes
+constexpr uint8_t chromaDcCoeffTokenCode[5][4] = {
+    {1, 0, 0, 0},
+    {7, 1, 0, 0},
+    {4, 6, 1, 0},
+    {3, 3, 2, 5},
+    {2, 3, 2, 0},
+};
+
+/// @brief total_zeros lengths of 4x4 blocks, by TotalCoeff - 1 and total_zeros
+constexpr uint8_t totalZerosLength[15][16] = {
+    {1, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9},
+    {3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6, 6, 6, 6, 0},
+    {4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 6, 5, 6, 0, 0},
+    {5, 3, 4, 4, 3, 3, 3, 4, 3, 4, 5, 5, 5, 0, 0, 0},
+    {4, 4, 4, 3, 3, 3, 3, 3, 4, 5, 4, 5, 0, 0, 0, 0},
+    {6, 5, 3, 3, 3, 3, 3, 3, 4, 3, 6, 0, 0, 0, 0, 0},
+    {6, 5, 3, 3, 3, 2, 3, 4, 3, 6, 0, 0, 0, 0, 0, 0},
+    {6, 4, 5, 3, 2, 2, 3, 3, 6, 0, 0, 0, 0, 0, 0, 0},
+    {6, 6, 4, 2, 2, 3, 2, 5, 0, 0, 0, 0, 0, 0, 0, 0},
+    {5, 5, 3, 2, 2, 2, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {4, 4, 3, 3, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {4, 4, 2, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 3, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+
+/// @brief total_zeros codes of 4x4 blocks
+constexpr uint8_t totalZerosCode[15][16] = {
+    {1, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1},
+    {7, 6, 5, 4, 3, 5, 4, 3, 2, 3, 2, 3, 2, 1, 0, 0},
+    {5, 7, 6, 5, 4, 3, 4, 3, 2, 3, 2, 1, 1, 0, 0, 0},
+    {3, 7, 5, 4, 6, 5, 4, 3, 3, 2, 2, 1, 0, 0, 0, 0},
+    {5, 4, 3, 7, 6, 5, 4, 3, 2, 1, 1, 0, 0, 0, 0, 0},
+    {1, 1, 7, 6, 5, 4, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0},
+    {1, 1, 5, 4, 3, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 1, 3, 3, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 0, 1, 3, 2, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 0, 1, 3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 2, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+};
+
+/// @brief total_zeros lengths of chroma DC blocks, by TotalCoeff - 1 and total_zeros
+constexpr uint8_t chromaDcTotalZerosLength[3][4] = {
+    {1, 2, 3, 3},
+    {1, 2, 2, 0},
+    {1, 1, 0, 0},
+};
+
+/// @brief total_zeros codes of chroma DC blocks
+constexpr uint8_t chromaDcTotalZerosCode[3][4] = {
+    {1, 1, 1, 0},
+    {1, 1, 0, 0},
+    {1, 0, 0, 0},
+};
+
+/// @brief run_before lengths, by min(zerosLeft, 7) - 1 and run_before
+constexpr uint8_t runBeforeLength[7][15] = {
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 2, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 2, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 2, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {2, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 3, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11},
+};
+
+/// @brief run_before codes
+constexpr uint8_t runBeforeCode[7][15] = {
+    {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 2, 3, 2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {3, 0, 1, 3, 2, 5, 4, 0, 0, 0, 0, 0, 0, 0, 0},
+    {7, 6, 5, 4, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+};
+
+int bitLength(uint32_t value) {
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+/**
+ * @brief Writes a level_prefix and level_suffix
+ * @param levelCode The level mapped to an unsigned code, with the first-level adjustment applied
+ * @param suffixLength Current suffixLength
+ */
+template <typename Sink>
+void writeLevel(Sink &sink, uint32_t levelCode, int suffixLength) {
+    // level_prefix is unary: "prefix" zeros then a one, i.e. the value 1 in prefix + 1 bits
+    if (suffixLength == 0) {
+        if (levelCode < 14) {
+            sink.writeBits(1, levelCode + 1);
+            return;
+        }
+        if (levelCode < 30) {
+            sink.writeBits(1, 15);
+            sink.writeBits(levelCode - 14, 4);
+            return;
+        }
+        levelCode -= 30;
+    } else {
+        uint32_t prefix = levelCode >> suffixLength;
+        if (prefix < 15) {
+            sink.writeBits(1, prefix + 1);
+            sink.writeBits(levelCode & ((1u << suffixLength) - 1), suffixLength);
+            return;
+        }
+        levelCode -= 15u << suffixLength;
+    }
+
+    // Escape: prefix 15 carries a 12-bit suffix, longer prefixes (High profiles) carry more
+    if (levelCode < 4096) {
+        sink.writeBits(1, 16);
+        sink.writeBits(levelCode, 12);
+        return;
+    }
+    int prefix = bitLength(levelCode + 4096) + 2;
+    sink.writeBits(1, prefix + 1);
+    sink.writeBits(levelCode - ((1u << (prefix - 3)) - 4096), prefix - 3);
+}
+
+} // namespace
+
+int predictCavlcNc(int left, int top) {
+    if (left >= 0 && top >= 0) {
+        return (left + top + 1) >> 1;
+    }
+    if (left >= 0) {
+        return left;
+    }
+    return top >= 0 ? top : 0;
+}
+
+template <typename Sink>
+int writeCavlcResidual(Sink &sink, const int16_t *coefficients, int count, int nC) {
+    // Non-zero levels from the highest frequency down, and the zeros below each
+    int16_t levels[16];
+    uint8_t runs[16];
+    int totalCoeff = 0;
+    int totalZeros = 0;
+    int last = count - 1;
+    while (last >= 0 && coefficients[last] == 0) {
+        --last;
+    }
+    for (int i = last; i >= 0; --i) {
+        if (coefficients[i] != 0) {
+            levels[totalCoeff] = coefficients[i];
+            runs[totalCoeff] = 0;
+            ++totalCoeff;
+        } else {
+            ++runs[totalCoeff - 1];
+            ++totalZeros;
+        }
+    }
+
+    int trailingOnes = 0;
+    while (trailingOnes < totalCoeff && trailingOnes < 3 &&
+           std::abs(levels[trailingOnes]) == 1) {
+        ++trailingOnes;
+    }
+
+    if (nC < 0) {
+        sink.writeBits(chromaDcCoeffTokenCode[totalCoeff][trailingOnes],
+                       chromaDcCoeffTokenLength[totalCoeff][trailingOnes]);
+    } else {
+        int table = nC < 2 ? 0 : nC < 4 ? 1 : nC < 8 ? 2 : 3;
+        sink.writeBits(coeffTokenCode[table][totalCoeff][trailingOnes],
+                       coeffTokenLength[table][totalCoeff][trailingOnes]);
+    }
+    if (totalCoeff == 0) {
+        return 0;
+    }
+
+    uint32_t signs = 0;
+    for (int i = 0; i < trailingOnes; ++i) {
+        signs = (signs << 1) | (levels[i] < 0 ? 1 : 0);
+    }
+    sink.writeBits(signs, trailingOnes);
+
+    int suffixLength = totalCoeff > 10 && trailingOnes < 3 ? 1 : 0;
+    for (int i = trailingOnes; i < totalCoeff; ++i) {
+        int level = levels[i];
+        uint32_t absLevel = std::abs(level);
+        uint32_t levelCode = 2 * absLevel - (level > 0 ? 2 : 1);
+        // The first level after fewer than three trailing ones cannot be +-1, so it is coded
+        // one magnitude smaller
+        if (i == trailingOnes && trailingOnes < 3) {
+            levelCode -= 2;
+        }
+        writeLevel(sink, levelCode, suffixLength);
+        if (suffixLength == 0) {
+            suffixLength = 1;
+        }
+        if (absLevel > (3u << (suffixLength - 1)) && suffixLength < 6) {
+            ++suffixLength;
+        }
+    }
+
+    if (totalCoeff < count) {
+        if (nC < 0) {
+            sink.writeBits(chromaDcTotalZerosCode[totalCoeff - 1][totalZeros],
+                           chromaDcTotalZerosLength[totalCoeff - 1][totalZeros]);
+        } else {
+            sink.writeBits(totalZerosCode[totalCoeff - 1][totalZeros],
+                           totalZerosLength[totalCoeff - 1][totalZeros]);
+        }
+    }
+
+    int zerosLeft = totalZeros;
+    for (int i = 0; i < totalCoeff - 1 && zerosLeft > 0; ++i) {
+        int table = (zerosLeft < 7 ? zerosLeft : 7) - 1;
+        sink.writeBits(runBeforeCode[table][runs[i]], runBeforeLength[table][runs[i]]);
+        zerosLeft -= runs[i];
+    }
+    return totalCoeff;
+}
+
+template int writeCavlcResidual<BitWriter>(BitWriter &, const int16_t *, int, int);
+template int writeCavlcResidual<BitCounter>(BitCounter &, const int16_t *, int, int);
+
+int cavlcResidualBits(const int16_t *coefficients, int count, int nC) {
+    BitCounter counter;
+    writeCavlcResidual(counter, coefficients, count, nC);
+    return static_cast<int>(counter.getBitCount());
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * @brief Predicts nC, which selects the coeff_token table of a 4x4 block
+ * @param left TotalCoeff of the block to the left, or -1 if unavailable
+ * @param top TotalCoeff of the block above, or -1 if unavailable
+ * @return The predicted number of non-zero coefficients
+ */
+int predictCavlcNc(int left, int top);
+
+/**
+ * @brief Writes a residual block with CAVLC (residual_block_cavlc)
+ *
+ * The sink is a BitWriter, or a BitCounter to measure the block without writing it
+ *
+ * @param sink Receives the syntax elements
+ * @param coefficients Levels in scan order
+ * @param count Number of coefficients in the block: 4 for chroma DC, 15 for AC blocks whose DC
+ * is coded separately, 16 otherwise
+ * @param nC Predicted number of non-zero coefficients, or -1 for chroma DC blocks
+ * @return TotalCoeff of the block, from which later blocks predict nC
+ */
+template <typename Sink>
+int writeCavlcResidual(Sink &sink, const int16_t *coefficients, int count, int nC);
+
+/**
+ * @brief Returns the number of bits writeCavlcResidual would write
+ */
+int cavlcResidualBits(const int16_t *coefficients, int count, int nC);
@@ -0,0 +1,969 @@
+#include "context.hpp"
+
+VulkanContext::VulkanContext(SurfaceProvider *surfaceProvider, const ContextConfig &config)
+    : config(config), surfaceProvider(surfaceProvider) {
+    init();
+}
+
+VkInstance VulkanContext::getInstance() const {
+    return instance;
+}
+
+VkPhysicalDevice VulkanContext::getPhysicalDevice() const {
+    return physicalDevice;
+}
+
+VkDevice VulkanContext::getDevice() const {
+    return device;
+}
+
+VkSurfaceKHR VulkanContext::getSurface() const {
+    return surface;
+}
+
+SurfaceProvider *VulkanContext::getSurfaceProvider() const {
+    return surfaceProvider;
+}
+
+VkQueue VulkanContext::getGraphicsQueue() const {
+    return graphicsQueue;
+}
+
+VkQueue VulkanContext::getTransferQueue() const {
+    return transferQueue;
+}
+
+const VulkanContext::QueueFamilyIndices &VulkanContext::getQueueFamilies() const {
+    return queueFamilies;
+}
+
+VkPipelineCache VulkanContext::getPipelineCache() const {
+    return pipelineCache;
+}
+
+uint32_t VulkanContext::getPhysicalDeviceIndex() const {
+    return physicalDeviceIndex;
+}
+
+const std::vector<DeviceCandidate> &VulkanContext::getDeviceCandidates() const {
+    return deviceCandidates;
+}
+
+bool VulkanContext::isDrawIndirectCountSupported() const {
+    return drawIndirectCountSupported;
+}
+
+bool VulkanContext::isMultiDrawIndirectSupported() const {
+    return multiDrawIndirectSupported;
+}
+
+bool VulkanContext::isDrawIndirectFirstInstanceSupported() const {
+    return drawIndirectFirstInstanceSupported;
+}
+
+bool VulkanContext::isTimelineSemaphoreSupported() const {
+    return timelineSemaphoreSupported;
+}
+
+bool VulkanContext::isExternalMemorySupported() const {
+    return externalMemorySupported;
+}
+
+bool VulkanContext::isTimestampSupported() const {
+    return timestampSupported;
+}
+
+float VulkanContext::getTimestampPeriod() const {
+    return timestampPeriod;
+}
+
+bool VulkanContext::sampleCalibratedTimestamps(uint64_t &deviceTicks,
+                                               uint64_t &hostNanoseconds) const {
+    if (getCalibratedTimestamps == nullptr) {
+        return false;
+    }
+
+    VkCalibratedTimestampInfoEXT infos[2] = {};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+
+    uint64_t timestamps[2];
+    uint64_t maxDeviation;
+    if (getCalibratedTimestamps(device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS) {
+        return false;
+    }
+    deviceTicks = timestamps[0];
+    hostNanoseconds = timestamps[1];
+    return true;
+}
+
+VulkanContext::SwapChainSupportDetails VulkanContext::querySwapChainSupport() const {
+    return querySwapChainSupport(physicalDevice);
+}
+
+VkResult VulkanContext::submit(const VkSubmitInfo &submitInfo, VkFence fence) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence);
+}
+
+VkResult VulkanContext::submitTransfer(const VkSubmitInfo &submitInfo, VkFence fence) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return vkQueueSubmit(transferQueue, 1, &submitInfo, fence);
+}
+
+VkResult VulkanContext::present(const VkPresentInfoKHR &presentInfo) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return vkQueuePresentKHR(presentQueue, &presentInfo);
+}
+
+void VulkanContext::waitIdle() {
+    vkDeviceWaitIdle(device);
+}
+
+void VulkanContext::init() {
+    LOG_INFO("Initialising Vulkan context...");
+
+    // Create the Vulkan instance (entry point into the Vulkan API)
+    createInstance();
+
+    // Set up the debug messenger (if validation layers are enabled)
+    setupDebugMessenger();
+
+    // If we have a surface provider, create and attach the VK surface
+    if (surfaceProvider) {
+        surface = surfaceProvider->createSurface(instance);
+        if (surface != VK_NULL_HANDLE) {
+            LOG_DEBUG("VK surface attached. Enabling extension " +
+                      std::string(VK_KHR_SWAPCHAIN_EXTENSION_NAME));
+            deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
+    }
+
+    // Pick the physical device
+    pickPhysicalDevice();
+
+    // The destructor does not run if the constructor throws, so a stream placed on the device
+    // is removed here
+    try {
+        // Create a logical device from the physical device
+        createLogicalDevice();
+
+        // Create the pipeline cache shared by every stream
+        createPipelineCache();
+
+        registerMemoryMetrics();
+    } catch (...) {
+        if (placedDeviceIndex.has_value()) {
+            config.placement->release(placedDeviceIndex.value());
+        }
+        throw;
+    }
+}
+
+void VulkanContext::setupDebugMessenger() {
+    if (!enableValidationLayers) {
+        return;
+    }
+
+    VkDebugUtilsMessengerCreateInfoEXT createInfo = {};
+    populateDebugMessengerCreateInfo(createInfo);
+
+    // Create the Vulkan debug messenger extension if available
+    if (createDebugUtilsMessengerEXT(&createInfo, nullptr) != VK_SUCCESS) {
+        throw std::runtime_error("failed to set up debug messenger");
+    }
+}
+
+void VulkanContext::populateDebugMessengerCreateInfo(
+    VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
+    createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+
+    // Configure what severity levels will trigger the callback
+    createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+                                 VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+                                 VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+
+    // Configure which message types will be handled
+    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+
+    createInfo.pfnUserCallback = debugCallback;
+    createInfo.pUserData = nullptr; // Optional user-specific data
+}
+
+VkResult
+VulkanContext::createDebugUtilsMessengerEXT(const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+                                             const VkAllocationCallbacks *pAllocator) {
+    // Query function pointer to the extension function (not loaded by default)
+    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+        instance, "vkCreateDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        return func(instance, pCreateInfo, pAllocator, &debugMessenger);
+    } else {
+        return VK_ERROR_EXTENSION_NOT_PRESENT;
+    }
+}
+
+void VulkanContext::destroyDebugUtilsMessenger(const VkAllocationCallbacks *pAllocator) {
+    // Destroy the debug messenger via its extension
+    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+        instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (func != nullptr) {
+        func(instance, debugMessenger, pAllocator);
+    }
+}
+
+void VulkanContext::createInstance() {
+    // Fail early if validation layers are requested but unavailable
+    if (enableValidationLayers && !checkValidationLayerSupport()) {
+        throw std::runtime_error("validation layers requested but not available");
+    }
+
+    // Fill in application info (optional, but helps some drivers optimise)
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Vulkan Renderer and Encoder";
+    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.pEngineName = "No Engine";
+    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.apiVersion = VK_API_VERSION_1_3;
+
+    // Fill in instance creation info
+    VkInstanceCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+
+    // Vulkan is a platform agnostic API, which means we need to pass an extension interface.
+    // List required extensions (e.g. from GLFW)
+    auto extensions = getRequiredExtensions();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
+
+    // Enable validation layers if requested (when running in debug mode)
+    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = {};
+    if (enableValidationLayers) {
+        createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+        createInfo.ppEnabledLayerNames = validationLayers.data();
+
+        // Hook debug messenger creation into instance creation
+        populateDebugMessengerCreateInfo(debugCreateInfo);
+        createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
+    } else {
+        createInfo.enabledLayerCount = 0;
+        createInfo.pNext = nullptr;
+    }
+
+    // Finally, create the Vulkan instance
+    if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create vulkan instance");
+    }
+}
+
+void VulkanContext::pickPhysicalDevice() {
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+
+    if (deviceCount == 0) {
+        throw std::runtime_error("failed to find GPUs with Vulkan support");
+    }
+
+    // Retrieve all physical devices
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+    // Score every suitable physical device
+    std::vector<DeviceCandidate> candidates;
+    for (uint32_t i = 0; i < deviceCount; ++i) {
+        if (!isDeviceSuitable(devices[i])) {
+            continue;
+        }
+
+        VkPhysicalDeviceIDProperties idProperties = {};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &idProperties;
+        vkGetPhysicalDeviceProperties2(devices[i], &properties);
+
+        DeviceCandidate candidate = {i, formatDeviceUuid(idProperties.deviceUUID),
+                                     properties.properties.deviceName, rateDevice(devices[i])};
+        LOG_DEBUG("Device " + std::to_string(i) + ": " + candidate.name + " [" + candidate.uuid +
+                  "] score = " + std::to_string(candidate.score));
+        candidates.push_back(candidate);
+    }
+
+    if (candidates.empty()) {
+        throw std::runtime_error("failed to find a suitable GPU");
+    }
+
+    // Select by configuration, then by placement, then by score
+    const DeviceCandidate *selected = nullptr;
+    if (config.device.index.has_value()) {
+        for (const auto &candidate : candidates) {
+            if (candidate.index == config.device.index.value()) {
+                selected = &candidate;
+            }
+        }
+        if (selected == nullptr) {
+            throw std::runtime_error("configured device index " +
+                                     std::to_string(config.device.index.value()) +
+                                     " is missing or unsuitable");
+        }
+    } else if (config.device.uuid.has_value()) {
+        std::string uuid = normaliseDeviceUuid(config.device.uuid.value());
+        for (const auto &candidate : candidates) {
+            if (normaliseDeviceUuid(candidate.uuid) == uuid) {
+                selected = &candidate;
+            }
+        }
+        if (selected == nullptr) {
+            throw std::runtime_error("configured device " + config.device.uuid.value() +
+                                     " is missing or unsuitable");
+        }
+    }
+
+    DeviceCandidate chosen;
+    if (selected != nullptr) {
+        chosen = *selected;
+    } else if (config.placement != nullptr) {
+        chosen = config.placement->acquire(candidates);
+        placedDeviceIndex = chosen.index;
+    } else {
+        chosen = *std::max_element(candidates.begin(), candidates.end(),
+                                   [](const DeviceCandidate &a, const DeviceCandidate &b) {
+                                       return a.score < b.score;
+                                   });
+    }
+
+    physicalDevice = devices[chosen.index];
+    physicalDeviceIndex = chosen.index;
+    deviceCandidates = candidates;
+
+    // Log the selected device name
+    LOG_INFO("Using device " + chosen.name + " (score " + std::to_string(chosen.score) + ")");
+}
+
+int64_t VulkanContext::rateDevice(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+    // Prefer dedicated hardware over integrated, virtual and software devices
+    int64_t score = 0;
+    switch (deviceProperties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        score += 10000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        score += 5000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        score += 2000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        score += 100;
+        break;
+    default:
+        break;
+    }
+
+    // One point per 64 MiB of device-local memory
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memProperties);
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; ++i) {
+        if (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            score += static_cast<int64_t>(memProperties.memoryHeaps[i].size >> 26);
+        }
+    }
+
+    // Dedicated queues let culling and uploads overlap with rendering
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+    for (const auto &family : queueFamilies) {
+        bool graphics = family.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+        bool compute = family.queueFlags & VK_QUEUE_COMPUTE_BIT;
+        if (!graphics && compute) {
+            score += 500;
+        } else if (!graphics && !compute && (family.queueFlags & VK_QUEUE_TRANSFER_BIT)) {
+            score += 250;
+        }
+    }
+
+    return score;
+}
+
+void VulkanContext::createLogicalDevice() {
+    // Find queue family indices for the selected physical device
+    QueueFamilyIndices indicies = findQueueFamilies(physicalDevice);
+    queueFamilies = indicies;
+
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    std::set<uint32_t> uniqueQueueFamilies = {indicies.graphicsFamily.value()};
+
+    // If surface is attached insert present queue family
+    if (surface != VK_NULL_HANDLE) {
+        uniqueQueueFamilies.insert(indicies.presentFamily.value());
+    }
+
+    if (indicies.transferFamily.has_value()) {
+        uniqueQueueFamilies.insert(indicies.transferFamily.value());
+    }
+
+    // Iterate over queue families and fill queue create info
+    float queuePriority = 1.0f;
+    for (uint32_t queueFamily : uniqueQueueFamilies) {
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = queueFamily;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
+    // Query optional features used for indirect drawing
+    VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+    supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supportedFeatures = {};
+    supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedFeatures.pNext = &supportedVulkan12Features;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+    // GPU culling writes the draw count on the device, which requires drawIndirectCount
+    drawIndirectCountSupported = supportedVulkan12Features.drawIndirectCount == VK_TRUE;
+    multiDrawIndirectSupported = supportedFeatures.features.multiDrawIndirect == VK_TRUE;
+
+    // Indirect draws name their instance through firstInstance, which must otherwise be 0
+    drawIndirectFirstInstanceSupported =
+        supportedFeatures.features.drawIndirectFirstInstance == VK_TRUE;
+
+    // Texture uploads track when staging space and batches may be reused with timeline values
+    timelineSemaphoreSupported = supportedVulkan12Features.timelineSemaphore == VK_TRUE;
+
+    // Enable required device features
+    VkPhysicalDeviceFeatures deviceFeatures = {};
+    deviceFeatures.multiDrawIndirect = supportedFeatures.features.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.features.drawIndirectFirstInstance;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+    vulkan12Features.timelineSemaphore = supportedVulkan12Features.timelineSemaphore;
+
+    // GPU spans of traces are timed with timestamp queries on the graphics queue
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampSupported = timestampPeriod > 0.0f &&
+                         families[indicies.graphicsFamily.value()].timestampValidBits > 0;
+    bool calibratedTimestampsSupported = timestampSupported && checkCalibratedTimestampSupport();
+    memoryBudgetSupported = supportsExtensions(physicalDevice, memoryBudgetExtensions);
+    externalMemorySupported = supportsExtensions(physicalDevice, externalMemoryExtensions);
+
+    // Fill in the device creation info
+    VkDeviceCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &vulkan12Features;
+    createInfo.pQueueCreateInfos = queueCreateInfos.data();
+    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+
+    createInfo.pEnabledFeatures = &deviceFeatures;
+
+    // Enable device extensions (e.g. calibrated timestamps, if supported)
+    std::vector<const char *> enabledExtensions = deviceExtensions;
+    if (calibratedTimestampsSupported) {
+        enabledExtensions.insert(enabledExtensions.end(), calibratedTimestampExtensions.begin(),
+                                 calibratedTimestampExtensions.end());
+    }
+    if (memoryBudgetSupported) {
+        enabledExtensions.insert(enabledExtensions.end(), memoryBudgetExtensions.begin(),
+                                 memoryBudgetExtensions.end());
+    }
+    if (externalMemorySupported) {
+        enabledExtensions.insert(enabledExtensions.end(), externalMemoryExtensions.begin(),
+                                 externalMemoryExtensions.end());
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
+
+    // Enable validation layers if requested
+    if (enableValidationLayers) {
+        createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+        createInfo.ppEnabledLayerNames = validationLayers.data();
+    } else {
+        createInfo.enabledLayerCount = 0;
+    }
+
+    // Create the logical device
+    if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create logical device");
+    }
+
+    // Retrieve a handle to the graphics queue from the created device
+    vkGetDeviceQueue(device, indicies.graphicsFamily.value(), 0, &graphicsQueue);
+
+    // Optionally retrieve handle to the present queue from the created device
+    if (surface != VK_NULL_HANDLE) {
+        vkGetDeviceQueue(device, indicies.presentFamily.value(), 0, &presentQueue);
+    }
+
+    if (indicies.transferFamily.has_value()) {
+        vkGetDeviceQueue(device, indicies.transferFamily.value(), 0, &transferQueue);
+    }
+
+    if (calibratedTimestampsSupported) {
+        getCalibratedTimestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(
+            device, "vkGetCalibratedTimestampsEXT");
+    }
+
+    LOG_INFO("Vulkan logical device created.");
+}
+
+void VulkanContext::createPipelineCache() {
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline cache");
+    }
+}
+
+uint32_t VulkanContext::findMemoryType(uint32_t typeFilter,
+                                       VkMemoryPropertyFlags properties) const {
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type");
+}
+
+void VulkanContext::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                                 VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                                 VkDeviceMemory &bufferMemory) const {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate buffer memory");
+    }
+
+    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+}
+
+void VulkanContext::createImage(uint32_t width, uint32_t height, VkFormat format,
+                                VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                                VkImage &image, VkDeviceMemory &imageMemory,
+                                uint32_t mipLevels) const {
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create image");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate image memory");
+    }
+
+    vkBindImageMemory(device, image, imageMemory, 0);
+}
+
+bool VulkanContext::isDeviceSuitable(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    std::string deviceName = deviceProperties.deviceName;
+
+    QueueFamilyIndices indicies = findQueueFamilies(device);
+    bool extensionsSupported = checkDeviceExtensionSupport(device);
+
+    bool swapChainAdequate = true; // If no surface attached simply set this to true
+    if (surface != VK_NULL_HANDLE) {
+        swapChainAdequate = false;
+        if (extensionsSupported) {
+            // Swap chain support is sufficient for this tutorial if there is at least one supported
+            // image format and one supported presentation mode
+            SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+            swapChainAdequate =
+                !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+        }
+    }
+
+    if (!indicies.isComplete(surface)) {
+        LOG_WARN("Device " + std::string(deviceProperties.deviceName) +
+                 " is missing required queue families");
+    }
+
+    if (!extensionsSupported) {
+        LOG_WARN("Device " + std::string(deviceProperties.deviceName) +
+                 " is missing required extensions");
+    }
+
+    if (surface != VK_NULL_HANDLE && !swapChainAdequate) {
+        LOG_WARN("Device " + std::string(deviceProperties.deviceName) +
+                 " is missing swap chain support");
+    }
+
+    return indicies.isComplete(surface) && extensionsSupported && swapChainAdequate;
+}
+
+bool VulkanContext::checkDeviceExtensionSupport(VkPhysicalDevice device) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         availableExtensions.data());
+
+    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+    for (const auto &extension : availableExtensions) {
+        LOG_VERBOSE("Found device extension " + std::string(extension.extensionName));
+
+        std::size_t erased = requiredExtensions.erase(extension.extensionName);
+        if (erased > 0) {
+            LOG_DEBUG("Found required device extension " + std::string(extension.extensionName));
+        }
+    }
+
+    if (!requiredExtensions.empty()) {
+        for (const auto &missing : requiredExtensions) {
+            LOG_WARN("Missing device extension: " + std::string(missing));
+        }
+    }
+
+    return requiredExtensions.empty();
+}
+
+bool VulkanContext::supportsExtensions(VkPhysicalDevice device,
+                                        const std::vector<const char *> &extensions) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         availableExtensions.data());
+
+    std::set<std::string> remaining(extensions.begin(), extensions.end());
+    for (const auto &extension : availableExtensions) {
+        remaining.erase(extension.extensionName);
+    }
+
+    return remaining.empty();
+}
+
+bool VulkanContext::checkCalibratedTimestampSupport() {
+#ifdef _WIN32
+    // The host time domain there is QueryPerformanceCounter, which the tracer does not read
+    return false;
+#else
+    if (!supportsExtensions(physicalDevice, calibratedTimestampExtensions)) {
+        return false;
+    }
+
+    auto getTimeDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(
+        instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+    if (getTimeDomains == nullptr) {
+        return false;
+    }
+
+    uint32_t domainCount = 0;
+    getTimeDomains(physicalDevice, &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    getTimeDomains(physicalDevice, &domainCount, domains.data());
+
+    bool deviceDomain = false, monotonicDomain = false;
+    for (VkTimeDomainEXT domain : domains) {
+        deviceDomain |= domain == VK_TIME_DOMAIN_DEVICE_EXT;
+        monotonicDomain |= domain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+    }
+    return deviceDomain && monotonicDomain;
+#endif
+}
+
+void VulkanContext::registerMemoryMetrics() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    MetricsRegistry &registry = MetricsRegistry::getDefault();
+    VkPhysicalDevice queried = physicalDevice;
+    for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; ++heap) {
+        MetricLabels labels = {{"device", properties.deviceName}, {"heap", std::to_string(heap)}};
+        double size = static_cast<double>(memoryProperties.memoryHeaps[heap].size);
+        memoryMetricCallbacks.push_back(registry.addCallback(
+            "vulkantest_device_memory_heap_bytes", "Size of a device memory heap", labels,
+            [size] { return size; }));
+        if (!memoryBudgetSupported) {
+            continue;
+        }
+
+        // Read from the driver when scraped, so they follow allocations as they happen
+        auto readBudget = [queried, heap](bool usage) {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+            budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+            VkPhysicalDeviceMemoryProperties2 memory = {};
+            memory.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            memory.pNext = &budget;
+            vkGetPhysicalDeviceMemoryProperties2(queried, &memory);
+            return static_cast<double>(usage ? budget.heapUsage[heap] : budget.heapBudget[heap]);
+        };
+        memoryMetricCallbacks.push_back(registry.addCallback(
+            "vulkantest_device_memory_usage_bytes",
+            "Device memory of a heap in use by this process, as the driver reports it", labels,
+            [readBudget] { return readBudget(true); }));
+        memoryMetricCallbacks.push_back(registry.addCallback(
+            "vulkantest_device_memory_budget_bytes",
+            "Device memory of a heap this process can use without degrading performance", labels,
+            [readBudget] { return readBudget(false); }));
+    }
+
+    if (!memoryBudgetSupported) {
+        LOG_DEBUG("VK_EXT_memory_budget is unsupported; only memory heap sizes are exported.");
+    }
+}
+
+VulkanContext::QueueFamilyIndices VulkanContext::findQueueFamilies(VkPhysicalDevice device) {
+    QueueFamilyIndices indices;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+    for (std::size_t i = 0; i < queueFamilies.size(); ++i) {
+        // Look for a queue family that supports graphics commands
+        if (!indices.graphicsFamily.has_value() &&
+            (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            indices.graphicsFamily = i;
+        }
+
+        // Uploads get a queue of their own on a transfer-only family, as long as it can copy
+        // arbitrary regions of an image rather than whole mip levels only
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        VkExtent3D granularity = queueFamilies[i].minImageTransferGranularity;
+        if (!indices.transferFamily.has_value() && (flags & VK_QUEUE_TRANSFER_BIT) &&
+            !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+            granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+            indices.transferFamily = i;
+        }
+
+        // Check to see if present support is available for the device.
+        // Only needed if we have a surface attached
+        if (surface != VK_NULL_HANDLE) {
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+
+            if (presentSupport && !indices.presentFamily.has_value()) {
+                indices.presentFamily = i;
+            }
+        }
+
+        // Stop early if all required queues (and the transfer queue) are found
+        if (indices.isComplete(surface) && indices.transferFamily.has_value()) {
+            break;
+        }
+    }
+
+    return indices;
+}
+
+VulkanContext::SwapChainSupportDetails
+VulkanContext::querySwapChainSupport(VkPhysicalDevice device) const {
+    SwapChainSupportDetails details;
+
+    if (surface != VK_NULL_HANDLE) {
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+        uint32_t formatCount;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+
+        if (formatCount != 0) {
+            details.formats.resize(formatCount);
+            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount,
+                                                 details.formats.data());
+        }
+
+        uint32_t presentModeCount;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+
+        if (presentModeCount != 0) {
+            details.presentModes.resize(presentModeCount);
+            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount,
+                                                      details.presentModes.data());
+        }
+    }
+
+    return details;
+}
+
+bool VulkanContext::checkValidationLayerSupport() {
+    uint32_t layerCount;
+    vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+
+    std::vector<VkLayerProperties> availableLayers(layerCount);
+    vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+
+    // Check if all requested validation layers are available
+    for (const char *layerName : validationLayers) {
+        bool layerFound = false;
+
+        for (const auto &layerProperties : availableLayers) {
+            if (strcmp(layerName, layerProperties.layerName) == 0) {
+                layerFound = true;
+                break;
+            }
+        }
+
+        if (!layerFound) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<const char *> VulkanContext::getRequiredExtensions() {
+    std::vector<const char *> extensions;
+
+    if (surfaceProvider) {
+        extensions = surfaceProvider->getRequiredInstanceExtensions();
+    }
+
+    // Add debug utils extension if validation is enabled
+    if (enableValidationLayers) {
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    }
+
+    return extensions;
+}
+
+VulkanContext::~VulkanContext() {
+    LOG_INFO("Shutting down Vulkan context.");
+
+    // Scrapes must not query the device once it is gone
+    for (uint64_t callback : memoryMetricCallbacks) {
+        MetricsRegistry::getDefault().removeCallback(callback);
+    }
+
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
+    vkDestroyDevice(device, nullptr);
+
+    if (enableValidationLayers) {
+        destroyDebugUtilsMessenger(nullptr);
+    }
+
+    if (surface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
+
+    vkDestroyInstance(instance, nullptr);
+
+    if (placedDeviceIndex.has_value()) {
+        config.placement->release(placedDeviceIndex.value());
+    }
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL VulkanContext::debugCallback(
+    VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+    VkDebugUtilsMessageTypeFlagsEXT messageType,
+    const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData) {
+
+    // Map enum values to strings for readable output
+    std::map<VkDebugUtilsMessageTypeFlagsEXT, std::string> messageTypes{
+        {VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT, "General"},
+        {VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT, "Performance"},
+        {VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT, "Validation"}};
+    std::map<VkDebugUtilsMessageSeverityFlagBitsEXT, std::string> messageSeverityTypes{
+        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "Verbose"},
+        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT, "Info"},
+        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "Warning"},
+        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "Error"}};
+
+    // Log formatted debug message at relevant log-level
+    std::string message = "SEVERITY = " + messageSeverityTypes[messageSeverity] +
+                          ", TYPE = " + messageTypes[messageType] + ": " + pCallbackData->pMessage;
+    switch (messageSeverity) {
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
+        LOG_VERBOSE(message);
+        if (pUserData != nullptr) {
+            LOG_VERBOSE("User data: " + std::string((char *)pUserData));
+        }
+        break;
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
+        LOG_INFO(message);
+        if (pUserData != nullptr) {
+            LOG_INFO("User data: " + std::string((char *)pUserData));
+        }
+        break;
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
+        LOG_WARN(message);
+        if (pUserData != nullptr) {
+            LOG_WARN("User data: " + std::string((char *)pUserData));
+        }
+        break;
+    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
+        LOG_ERROR(message);
+        if (pUserData != nullptr) {
+            LOG_ERROR("User data: " + std::string((char *)pUserData));
+        }
+        break;
+    default:
+        LOG_INFO(message);
+        if (pUserData != nullptr) {
+            LOG_INFO("User data: " + std::string((char *)pUserData));
+        }
+    }
+
+    return VK_FALSE; // Always return false to not interrupt Vulkan calls
+}
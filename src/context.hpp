@@ -0,0 +1,560 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "device_placement.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "surface_provider.hpp"
+#include <GLFW/glfw3.h>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @struct ContextConfig
+ * @brief Configuration options for a VulkanContext
+ */
+struct ContextConfig {
+    /// @brief Explicit physical device selection. If empty, the device is chosen by score
+    DeviceSelection device;
+
+    /// @brief Optional placement layer shared between contexts to spread them across devices.
+    /// Ignored when an explicit device is selected
+    DevicePlacement *placement = nullptr;
+};
+
+/**
+ * @class VulkanContext
+ * @brief Owns the device-level Vulkan state shared by every stream in a process
+ *
+ * This covers the instance, debug messenger, optional presentation surface, the physical and
+ * logical device, its queues, the pipeline cache and memory allocation helpers. Per-stream
+ * state (render targets, command buffers, sync objects, encoder sessions) lives in
+ * VulkanRenderer and VulkanEncoder, so many streams can share one context. Queue submission
+ * goes through submit() and present(), which serialise access to the shared queues.
+ */
+class VulkanContext {
+  public:
+    /**
+     * @struct SwapChainSupportDetails
+     * @brief Holds details about swap chain support for a physical device
+     *
+     * This structure is populated by querying the Vulkan physical device and surface
+     * for information needed to create a swap chain. It includes capabilities,
+     * supported surface formats, and present modes
+     */
+    struct SwapChainSupportDetails {
+        /// @brief Surface capabilities, such as min/max image count and size
+        VkSurfaceCapabilitiesKHR capabilities;
+
+        /// @brief List of supported surface formats
+        std::vector<VkSurfaceFormatKHR> formats;
+
+        /// @brief List of supported presentation modes
+        std::vector<VkPresentModeKHR> presentModes;
+    };
+
+    /**
+     * @brief Holds indices of queue families supported by a physical device
+     *
+     * This struct is used to track which queue families (e.g. graphics, compute, etc.)
+     * are available on a Vulkan physical device. Only the graphics queue family is
+     * currently required and checked.
+     */
+    struct QueueFamilyIndices {
+        /// @brief Index of a queue family that supports graphics commands
+        std::optional<uint32_t> graphicsFamily;
+
+        /// @brief Index of a queue family that supports presenting/drawing
+        std::optional<uint32_t> presentFamily;
+
+        /// @brief Index of a transfer-only queue family (typically a DMA engine) that copies at
+        /// single texel granularity, if the device has one
+        std::optional<uint32_t> transferFamily;
+
+        /**
+         * @brief Checks if all required queue families have been found
+         *
+         * @return true if the graphics queue family has been assigned
+         */
+        bool isComplete(VkSurfaceKHR surface) const {
+
+            // If we have no surface attached, do not check for queue family that supports drawing
+            if (surface == VK_NULL_HANDLE) {
+                return graphicsFamily.has_value();
+            }
+
+            return graphicsFamily.has_value() && presentFamily.has_value();
+        }
+    };
+
+    /**
+     * @brief Creates the instance, picks a physical device and creates the logical device
+     * @param surfaceProvider Optional provider of a presentation surface (nullptr for headless)
+     * @param config Context configuration options
+     */
+    VulkanContext(SurfaceProvider *surfaceProvider = nullptr,
+                  const ContextConfig &config = ContextConfig());
+
+    /**
+     * @brief Destroys the device and instance level Vulkan objects
+     */
+    ~VulkanContext();
+
+    VulkanContext(const VulkanContext &) = delete;
+    VulkanContext &operator=(const VulkanContext &) = delete;
+
+    /**
+     * @brief Returns the Vulkan instance
+     */
+    VkInstance getInstance() const;
+
+    /**
+     * @brief Returns the selected physical device
+     */
+    VkPhysicalDevice getPhysicalDevice() const;
+
+    /**
+     * @brief Returns the logical device
+     */
+    VkDevice getDevice() const;
+
+    /**
+     * @brief Returns the presentation surface, or VK_NULL_HANDLE for headless contexts
+     */
+    VkSurfaceKHR getSurface() const;
+
+    /**
+     * @brief Returns the surface provider the context was created with (may be nullptr)
+     */
+    SurfaceProvider *getSurfaceProvider() const;
+
+    /**
+     * @brief Returns the graphics queue
+     */
+    VkQueue getGraphicsQueue() const;
+
+    /**
+     * @brief Returns the dedicated transfer queue, or VK_NULL_HANDLE if the device has none
+     */
+    VkQueue getTransferQueue() const;
+
+    /**
+     * @brief Returns the queue family indices of the selected physical device
+     */
+    const QueueFamilyIndices &getQueueFamilies() const;
+
+    /**
+     * @brief Returns the pipeline cache shared by every pipeline created on this context
+     */
+    VkPipelineCache getPipelineCache() const;
+
+    /**
+     * @brief Returns the index of the selected device in vkEnumeratePhysicalDevices order
+     */
+    uint32_t getPhysicalDeviceIndex() const;
+
+    /**
+     * @brief Returns every suitable physical device with its score, in enumeration order.
+     * Indices are the same for every context in the process
+     */
+    const std::vector<DeviceCandidate> &getDeviceCandidates() const;
+
+    /**
+     * @brief Returns whether the drawIndirectCount feature was enabled on the device
+     */
+    bool isDrawIndirectCountSupported() const;
+
+    /**
+     * @brief Returns whether the multiDrawIndirect feature was enabled on the device
+     */
+    bool isMultiDrawIndirectSupported() const;
+
+    /**
+     * @brief Returns whether the drawIndirectFirstInstance feature was enabled on the device
+     */
+    bool isDrawIndirectFirstInstanceSupported() const;
+
+    /**
+     * @brief Returns whether the timelineSemaphore feature was enabled on the device
+     */
+    bool isTimelineSemaphoreSupported() const;
+
+    /**
+     * @brief Returns whether device memory and semaphores can be exported as file descriptors
+     */
+    bool isExternalMemorySupported() const;
+
+    /**
+     * @brief Returns whether the graphics queue can write timestamps
+     */
+    bool isTimestampSupported() const;
+
+    /**
+     * @brief Returns the number of nanoseconds a timestamp tick lasts
+     */
+    float getTimestampPeriod() const;
+
+    /**
+     * @brief Samples the device timestamp and the host's CLOCK_MONOTONIC at the same instant
+     *
+     * Needs VK_EXT_calibrated_timestamps, which is enabled when the device can calibrate
+     * against CLOCK_MONOTONIC
+     *
+     * @param deviceTicks Receives the device timestamp in ticks
+     * @param hostNanoseconds Receives the host time in nanoseconds
+     * @return false if calibrated timestamps are unavailable or the query failed
+     */
+    bool sampleCalibratedTimestamps(uint64_t &deviceTicks, uint64_t &hostNanoseconds) const;
+
+    /**
+     * @brief Queries the swap chain support details of the selected device for the surface
+     */
+    SwapChainSupportDetails querySwapChainSupport() const;
+
+    /**
+     * @brief Submits work to the graphics queue
+     *
+     * Vulkan requires external synchronisation of queue access, so submissions from all streams
+     * are serialised here
+     *
+     * @param submitInfo The submission
+     * @param fence Fence to signal on completion (may be VK_NULL_HANDLE)
+     * @return The result of vkQueueSubmit
+     */
+    VkResult submit(const VkSubmitInfo &submitInfo, VkFence fence);
+
+    /**
+     * @brief Submits work to the dedicated transfer queue, serialised like submit()
+     * @param submitInfo The submission
+     * @param fence Fence to signal on completion (may be VK_NULL_HANDLE)
+     * @return The result of vkQueueSubmit
+     */
+    VkResult submitTransfer(const VkSubmitInfo &submitInfo, VkFence fence);
+
+    /**
+     * @brief Presents a swapchain image on the present queue
+     * @param presentInfo The present request
+     * @return The result of vkQueuePresentKHR
+     */
+    VkResult present(const VkPresentInfoKHR &presentInfo);
+
+    /**
+     * @brief Waits for the logical device to become idle
+     */
+    void waitIdle();
+
+    /**
+     * @brief Finds a memory type that satisfies the given requirements
+     * @param typeFilter Bitmask of acceptable memory type indices
+     * @param properties Required memory property flags
+     * @return Index of a matching memory type
+     * @throws std::runtime_error if no suitable memory type exists
+     */
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+    /**
+     * @brief Creates a buffer and allocates and binds memory for it
+     * @param size Size of the buffer in bytes
+     * @param usage Buffer usage flags
+     * @param properties Required memory property flags
+     * @param buffer Receives the created buffer
+     * @param bufferMemory Receives the allocated memory
+     * @throws std::runtime_error if the buffer or its memory cannot be created
+     */
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                      VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                      VkDeviceMemory &bufferMemory) const;
+
+    /**
+     * @brief Creates a 2D image and allocates and binds device memory for it
+     * @param width Width of the image in pixels
+     * @param height Height of the image in pixels
+     * @param format Format of the image
+     * @param usage Image usage flags
+     * @param properties Required memory property flags
+     * @param image Receives the created image
+     * @param imageMemory Receives the allocated memory
+     * @param mipLevels Number of mip levels of the image
+     * @throws std::runtime_error if the image or its memory cannot be created
+     */
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                     VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory,
+                     uint32_t mipLevels = 1) const;
+
+  protected:
+    /// @brief Configuration the context was created with
+    ContextConfig config;
+
+    /// @brief The Vulkan instance
+    VkInstance instance;
+
+    /// @brief The debug messenger for Vulkan validation layer messages
+    VkDebugUtilsMessengerEXT debugMessenger;
+
+    /// @brief Optional surface provider used to create a rendering surface (e.g. window
+    /// surface)
+    SurfaceProvider *surfaceProvider;
+
+    /// @brief The Vulkan surface used for presentation, if attached (may be VK_NULL_HANDLE for
+    /// headless rendering)
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+    /// @brief The selected physical GPU device
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+
+    /// @brief Index of the selected physical device in vkEnumeratePhysicalDevices order
+    uint32_t physicalDeviceIndex = 0;
+
+    /// @brief Every suitable physical device, with its score
+    std::vector<DeviceCandidate> deviceCandidates;
+
+    /// @brief Index of the device acquired from the placement layer, if the context was placed
+    std::optional<uint32_t> placedDeviceIndex;
+
+    /// @brief The logical device created from the selected physical GPU
+    VkDevice device;
+
+    /// @brief Queue family indices of the selected physical device
+    QueueFamilyIndices queueFamilies;
+
+    /// @brief Graphics queue retrieved from the logical device
+    VkQueue graphicsQueue;
+
+    /// @brief Present queue retrieved from the logical device (if surface attached)
+    VkQueue presentQueue = VK_NULL_HANDLE;
+
+    /// @brief Dedicated transfer queue retrieved from the logical device (if the device has one)
+    VkQueue transferQueue = VK_NULL_HANDLE;
+
+    /// @brief Serialises access to the graphics, present and transfer queues
+    std::mutex queueMutex;
+
+    /// @brief Pipeline cache shared by all pipelines created on this device
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+    /// @brief List of Vulkan validation layers to enable (if supported)
+    const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
+
+    /// @brief List of Vulkan device extensions that must be supported
+    std::vector<const char *> deviceExtensions = {};
+
+    /// @brief Whether the drawIndirectCount feature is enabled on the logical device
+    bool drawIndirectCountSupported = false;
+
+    /// @brief Whether the multiDrawIndirect feature is enabled on the logical device
+    bool multiDrawIndirectSupported = false;
+
+    /// @brief Whether the drawIndirectFirstInstance feature is enabled on the logical device
+    bool drawIndirectFirstInstanceSupported = false;
+
+    /// @brief Whether the timelineSemaphore feature is enabled on the logical device
+    bool timelineSemaphoreSupported = false;
+
+    /// @brief Whether the graphics queue family has valid timestamp bits
+    bool timestampSupported = false;
+
+    /// @brief Nanoseconds per timestamp tick
+    float timestampPeriod = 0.0f;
+
+    /// @brief Extension used to correlate device timestamps with the host clock
+    const std::vector<const char *> calibratedTimestampExtensions = {
+        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME};
+
+    /// @brief Samples calibrated timestamps, or nullptr if the extension is not enabled
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+
+    /// @brief Extension reporting the memory usage and budget of each heap
+    const std::vector<const char *> memoryBudgetExtensions = {
+        VK_EXT_MEMORY_BUDGET_EXTENSION_NAME};
+
+    /// @brief Whether the memory budget extension is enabled on the logical device
+    bool memoryBudgetSupported = false;
+
+    /// @brief Extensions exporting device memory and semaphores as POSIX file descriptors
+    const std::vector<const char *> externalMemoryExtensions = {
+        VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME};
+
+    /// @brief Whether the external memory extensions are enabled on the logical device
+    bool externalMemorySupported = false;
+
+    /// @brief Callback gauges of the device memory metrics, removed on destruction
+    std::vector<uint64_t> memoryMetricCallbacks;
+
+    /// @brief Whether to enable validation layers (only in debug builds)
+#ifdef NDEBUG
+    const bool enableValidationLayers = false;
+#else
+    const bool enableValidationLayers = true;
+#endif
+
+    /**
+     * @brief Initialises Vulkan (instance, debug layers, surface, devices)
+     */
+    void init();
+
+    /**
+     * @brief Sets up the Vulkan debug messenger for validation callback
+     */
+    void setupDebugMessenger();
+
+    /**
+     * @brief Populates the debug messenger creation info struct
+     * @param createInfo The struct to fill with layer callback info.
+     */
+    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
+
+    /**
+     * @brief Manually creates the debug messenger (if extension is available)
+     * @param pCreateInfo Creation parameters
+     * @param pAllocator Optional custom memory allocator
+     * @return VK_SUCCESS or error code
+     */
+    VkResult createDebugUtilsMessengerEXT(const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+                                          const VkAllocationCallbacks *pAllocator);
+
+    /**
+     * @brief Manually destroys the debug messenger
+     * @param pAllocator Optional custom memory allocator
+     */
+    void destroyDebugUtilsMessenger(const VkAllocationCallbacks *pAllocator);
+
+    /**
+     * @brief Creates the Vulkan instance
+     */
+    void createInstance();
+
+    /**
+     * @brief Picks a suitable physical GPU device that supports required features
+     *
+     * Enumerates all Vulkan-compatible devices and scores those that meet application
+     * requirements. A device selected by index or UUID in the configuration is used if it is
+     * suitable. Otherwise the context is placed through the configured DevicePlacement, or the
+     * highest scored device is used
+     *
+     * @throws std::runtime_error if no suitable GPU is found, or the configured one is unsuitable
+     */
+    void pickPhysicalDevice();
+
+    /**
+     * @brief Scores a suitable physical device
+     *
+     * Considers the device type, the size of device-local memory and the queue topology
+     * (dedicated compute and transfer queues)
+     *
+     * @param device The physical device to score
+     * @return The device score, higher is better
+     */
+    int64_t rateDevice(VkPhysicalDevice device);
+
+    /**
+     * @brief Creates the Vulkan logical device and retrieves the graphics queue
+     *
+     * This function selects the appropriate queue family from the physical device,
+     * enables required features, and creates a logical device interface
+     *
+     * @throws std::runtime_error if device creation fails.
+     */
+    void createLogicalDevice();
+
+    /**
+     * @brief Creates the pipeline cache shared by all pipelines on the device
+     *
+     * @throws std::runtime_error if pipeline cache creation fails
+     */
+    void createPipelineCache();
+
+    /**
+     * @brief Checks if a given physical device is suitable for use
+     *
+     * Currently checks for graphics queue family support
+     *
+     * @param device The physical device to evaluate
+     * @return true if the device meets the required criteria
+     */
+    bool isDeviceSuitable(VkPhysicalDevice device);
+
+    /**
+     * @brief Finds queue families that support required capabilities on a device
+     *
+     * Searches for queue families that support graphics commands
+     *
+     * @param device The physical device to query
+     * @return A QueueFamilyIndices struct with matching queue families
+     */
+    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
+
+    /**
+     * @brief Checks whether a physical device supports all required Vulkan device extensions
+     *
+     * This function queries all available extensions on the provided Vulkan physical device
+     * and compares them against the list of required extensions defined in "deviceExtensions".
+     * It logs found and missing extensions for debugging purposes.
+     *
+     * @param device The Vulkan physical device to query for extension support.
+     * @return true if all required extensions are supported by the device, false otherwise.
+     */
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+
+    /**
+     * @brief Checks whether a physical device supports every extension in a list
+     * @param device The physical device to query
+     * @param extensions The extension names to look for
+     * @return true if all extensions are supported
+     */
+    bool supportsExtensions(VkPhysicalDevice device, const std::vector<const char *> &extensions);
+
+    /**
+     * @brief Checks whether the selected device can calibrate its timestamps against the
+     * host's CLOCK_MONOTONIC, which the tracer's steady clock reads on Linux
+     * @return true if the calibrated timestamps extension should be enabled
+     */
+    bool checkCalibratedTimestampSupport();
+
+    /**
+     * @brief Adds gauges for the size of each memory heap and, with the memory budget
+     * extension, its usage and budget, read from the device when scraped
+     */
+    void registerMemoryMetrics();
+
+    /**
+     * @brief Queries the swap chain support details for a given physical device
+     *
+     * This function checks the capabilities, supported formats, and present modes
+     * of the swap chain for the currently attached Vulkan surface (if any).
+     * If no surface is present (headless mode), the returned details will be empty
+     *
+     * @param device The physical Vulkan device to query.
+     * @return A SwapChainSupportDetails struct containing surface capabilities,
+     *         supported formats, and present modes for the specified device
+     */
+    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device) const;
+
+    /**
+     * @brief Checks if the requested validation layers are available
+     * @return True if all requested layers are supported
+     */
+    bool checkValidationLayerSupport();
+
+    /**
+     * @brief Gets the required extensions for Vulkan initialisation
+     * @return A list of extension names
+     */
+    std::vector<const char *> getRequiredExtensions();
+
+    /**
+     * @brief Callback for Vulkan validation layer messages
+     * @param messageSeverity Severity of the message
+     * @param messageType Type of message (general, validation, performance)
+     * @param pCallbackData Message details
+     * @param pUserData Optional user data
+     * @return VK_FALSE to indicate message should not abort execution
+     */
+    static VKAPI_ATTR VkBool32 VKAPI_CALL
+    debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+                  VkDebugUtilsMessageTypeFlagsEXT messageType,
+                  const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData);
+};
@@ -0,0 +1,98 @@
+#include "device_placement.hpp"
+#include "logger.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+std::string formatDeviceUuid(const uint8_t uuid[VK_UUID_SIZE]) {
+    static const char *digits = "0123456789abcdef";
+
+    std::string result;
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            result.push_back('-');
+        }
+        result.push_back(digits[uuid[i] >> 4]);
+        result.push_back(digits[uuid[i] & 0xf]);
+    }
+    return result;
+}
+
+std::string normaliseDeviceUuid(const std::string &uuid) {
+    std::string result;
+    for (char c : uuid) {
+        if (c != '-') {
+            result.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+    }
+    return result;
+}
+
+DeviceSelection getEnvironmentDeviceSelection() {
+    DeviceSelection selection;
+    if (const char *index = std::getenv("VULKAN_DEVICE_INDEX")) {
+        selection.index = static_cast<uint32_t>(std::stoul(index));
+    }
+    if (const char *uuid = std::getenv("VULKAN_DEVICE_UUID")) {
+        selection.uuid = uuid;
+    }
+    return selection;
+}
+
+DeviceCandidate DevicePlacement::acquire(const std::vector<DeviceCandidate> &candidates) {
+    if (candidates.empty()) {
+        throw std::runtime_error("cannot place stream, no candidate devices");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const DeviceCandidate *best = nullptr;
+    uint32_t bestStreams = 0;
+    for (const DeviceCandidate &candidate : candidates) {
+        auto it = devices.find(candidate.index);
+        if (it == devices.end()) {
+            DeviceLoad load = {candidate.index, candidate.uuid, candidate.name, candidate.score, 0};
+            it = devices.emplace(candidate.index, load).first;
+        }
+
+        uint32_t streams = it->second.streams;
+        if (best == nullptr || streams < bestStreams ||
+            (streams == bestStreams && candidate.score > best->score)) {
+            best = &candidate;
+            bestStreams = streams;
+        }
+    }
+
+    devices[best->index].streams++;
+    LOG_INFO("Placed stream on device " + std::to_string(best->index) + ": " + best->name +
+             " (" + std::to_string(bestStreams + 1) + " streams)");
+
+    return *best;
+}
+
+void DevicePlacement::release(uint32_t index) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = devices.find(index);
+    if (it != devices.end() && it->second.streams > 0) {
+        it->second.streams--;
+    }
+}
+
+std::vector<DeviceLoad> DevicePlacement::getLoad() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<DeviceLoad> load;
+    for (const auto &entry : devices) {
+        load.push_back(entry.second);
+    }
+    return load;
+}
+
+void DevicePlacement::logLoad() const {
+    for (const DeviceLoad &device : getLoad()) {
+        LOG_INFO("Device " + std::to_string(device.index) + ": " + device.name + " [" +
+                 device.uuid + "]: score = " + std::to_string(device.score) +
+                 ", streams = " + std::to_string(device.streams));
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+/**
+ * @struct DeviceSelection
+ * @brief Explicit physical device selection from configuration
+ *
+ * If both fields are empty the renderer picks a device by score (or through a DevicePlacement).
+ * The index takes precedence over the UUID when both are set.
+ */
+struct DeviceSelection {
+    /// @brief Index of the device in vkEnumeratePhysicalDevices order
+    std::optional<uint32_t> index;
+
+    /// @brief Device UUID as 32 hex digits, optionally separated by dashes
+    std::optional<std::string> uuid;
+};
+
+/**
+ * @struct DeviceCandidate
+ * @brief A suitable physical device together with its score
+ */
+struct DeviceCandidate {
+    /// @brief Index of the device in vkEnumeratePhysicalDevices order
+    uint32_t index;
+
+    /// @brief Device UUID as formatted by formatDeviceUuid
+    std::string uuid;
+
+    /// @brief Human readable device name
+    std::string name;
+
+    /// @brief Suitability score, higher is better
+    int64_t score;
+};
+
+/**
+ * @struct DeviceLoad
+ * @brief Number of streams currently placed on a device
+ */
+struct DeviceLoad {
+    /// @brief Index of the device in vkEnumeratePhysicalDevices order
+    uint32_t index;
+
+    /// @brief Device UUID as formatted by formatDeviceUuid
+    std::string uuid;
+
+    /// @brief Human readable device name
+    std::string name;
+
+    /// @brief Suitability score of the device
+    int64_t score;
+
+    /// @brief Number of renderer/encoder instances placed on the device
+    uint32_t streams;
+};
+
+/**
+ * @brief Formats a device UUID as lowercase hex in the canonical 8-4-4-4-12 layout
+ * @param uuid The raw UUID bytes from VkPhysicalDeviceIDProperties
+ * @return The formatted UUID string
+ */
+std::string formatDeviceUuid(const uint8_t uuid[VK_UUID_SIZE]);
+
+/**
+ * @brief Normalises a user supplied UUID for comparison (lowercase, dashes removed)
+ * @param uuid The UUID string to normalise
+ * @return The normalised UUID string
+ */
+std::string normaliseDeviceUuid(const std::string &uuid);
+
+/**
+ * @brief Reads an explicit device selection from the VULKAN_DEVICE_INDEX and
+ * VULKAN_DEVICE_UUID environment variables
+ * @return The selection, empty if neither variable is set
+ * @throws std::invalid_argument if VULKAN_DEVICE_INDEX is not a number
+ */
+DeviceSelection getEnvironmentDeviceSelection();
+
+/**
+ * @class DevicePlacement
+ * @brief Distributes renderer/encoder instances across all suitable physical devices
+ *
+ * Each instance presents the devices it considers suitable (with their scores) and is placed
+ * on the least loaded of them, ties going to the higher scored device. Devices are identified
+ * by their enumeration index, which is the same for every Vulkan instance in the process, so
+ * one DevicePlacement can be shared by every renderer in the process. Unlike UUIDs, indices
+ * also tell identical devices apart, such as several lavapipe devices exposed by one driver
+ * file each. All methods are thread-safe.
+ */
+class DevicePlacement {
+  public:
+    /**
+     * @brief Places a new stream on the least loaded candidate device
+     * @param candidates Devices the caller can use
+     * @return The candidate the stream was placed on
+     * @throws std::runtime_error if there are no candidates
+     */
+    DeviceCandidate acquire(const std::vector<DeviceCandidate> &candidates);
+
+    /**
+     * @brief Removes a stream previously placed with acquire()
+     * @param index Index of the device the stream was placed on
+     */
+    void release(uint32_t index);
+
+    /**
+     * @brief Returns the current load of every device seen so far
+     */
+    std::vector<DeviceLoad> getLoad() const;
+
+    /**
+     * @brief Logs the current load of every device seen so far
+     */
+    void logLoad() const;
+
+  protected:
+    /// @brief Guards the device map
+    mutable std::mutex mutex;
+
+    /// @brief Load of each known device, keyed by index
+    std::map<uint32_t, DeviceLoad> devices;
+};
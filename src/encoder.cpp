@@ -1,129 +1,115 @@
 #include "encoder.hpp"
 #include "renderer.hpp"
+#include "trace.hpp"
 
-VulkanEncoder::VulkanEncoder(VulkanRenderer *renderer, const std::string &outputPath)
+VulkanEncoder::VulkanEncoder(VulkanRenderer *renderer, const std::string &outputPath,
+                             const RateControlConfig &rateControlConfig,
+                             const SoftwareEncoderConfig &softwareConfig, ThreadPool *pool)
     : renderer(renderer), outputPath(outputPath) {
-    init();
+    init(rateControlConfig, softwareConfig, pool);
 }
 
-void VulkanEncoder::init() {
-    LOG_INFO("Initialising Vulkan encoder...");
-    device = renderer->getDevice();
-    physicalDevice = renderer->getPhysicalDevice();
-    LOG_INFO("Device handle: " + std::to_string(reinterpret_cast<uintptr_t>(device)));
-    LOG_INFO("Physical Device handle: " +
-             std::to_string(reinterpret_cast<uintptr_t>(physicalDevice)));
-
-    // TODO: Select queue family with encode support and init videoQueue
-    createVideoSession();
-    createCommandBuffer();
-    createOutputBuffer();
-}
-
-void VulkanEncoder::createVideoSession() {
-    // TODO: Fill VkVideoSessionCreateInfoKHR and call vkCreateVideoSessionKHR
-    // TODO: Create VkVideoSessionParametersKHR
-}
-
-void VulkanEncoder::createCommandBuffer() {
-    VkCommandPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = renderer->getGraphicsQueueFamilyIndex();
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create command pool for encoder");
-    }
-
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
-
-    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate encoder command buffer");
+void VulkanEncoder::openOutput() {
+    output.open(outputPath, std::ios::out | std::ios::binary);
+    if (!output.is_open()) {
+        throw std::runtime_error("failed to open output file for writing");
     }
 }
 
-void VulkanEncoder::createOutputBuffer() {
-    VkBufferCreateInfo bufferInfo = {};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = 10 * 1024 * 1024; // 10MB buffer for encoded output
-    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if (vkCreateBuffer(device, &bufferInfo, nullptr, &encodedOutputBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create encoded output buffer");
-    }
+void VulkanEncoder::init(const RateControlConfig &rateControlConfig,
+                         const SoftwareEncoderConfig &softwareConfig, ThreadPool *pool) {
+    openOutput();
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, encodedOutputBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = 0;
-
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((memRequirements.memoryTypeBits & (1 << i)) &&
-            (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
-            allocInfo.memoryTypeIndex = i;
-            break;
-        }
+    if (pool == nullptr) {
+        ownedPool = std::make_unique<ThreadPool>();
+        pool = ownedPool.get();
     }
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &encodedMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate output buffer memory");
-    }
-
-    vkBindBufferMemory(device, encodedOutputBuffer, encodedMemory, 0);
+    this->pool = pool;
+
+    SoftwareEncoderConfig config = softwareConfig;
+    VkExtent2D extent = renderer->getExtent();
+    config.width = extent.width;
+    config.height = extent.height;
+
+    // A raw luma plane is a generous first block; the ring grows if frames are larger
+    bitstream = std::make_unique<HostBitstreamRing>(static_cast<size_t>(extent.width) *
+                                                    extent.height);
+
+    // Frames are output in order, one at a time, so the file needs no further locking
+    auto deliver = [this](const EncodedFrame &frame) { deliverFrame(frame); };
+    softwareEncoder = std::make_unique<SoftwareEncoder>(config, rateControlConfig, *pool,
+                                                        deliver, bitstream.get());
+
+    LOG_INFO("Using the software H.264 encoder (" + std::to_string(extent.width) + "x" +
+             std::to_string(extent.height) + ", " +
+             std::to_string(softwareEncoder->getSliceCount()) + " slices, " +
+             std::to_string(pool->size()) + " threads).");
 }
 
-void VulkanEncoder::copyFramebufferToImage() {
-    // TODO: Transition and copy image from framebuffer to format supported by encoder
-}
-
-void VulkanEncoder::performEncoding() {
-    // TODO: Fill VkVideoEncodeInfoKHR and submit it via vkCmdEncodeVideoKHR
+void VulkanEncoder::deliverFrame(const EncodedFrame &frame) {
+    output.write(reinterpret_cast<const char *>(frame.view.data),
+                 static_cast<std::streamsize>(frame.view.size));
+    for (const FrameConsumer &consumer : consumers) {
+        consumer(frame);
+    }
+    bitstream->release(frame.view);
 }
 
 void VulkanEncoder::encodeFrame() {
-    copyFramebufferToImage();
-    performEncoding();
+    TRACE_SCOPE("encode frame");
+
+    // The conversion writes into its own frame, which outlives it in the queue
+    auto frame = std::make_unique<YuvFrame>();
+    YuvFrame *target = frame.get();
+    auto convert = [target](const uint8_t *rgba, VkExtent2D extent) {
+        TRACE_SCOPE("rgba to yuv");
+        target->allocate(extent.width, extent.height);
+        convertRgbaToYuv(rgba, extent.width * 4, extent.width, extent.height, *target);
+    };
+    conversions.push_back({renderer->readFrameAsync(*pool, convert), std::move(frame)});
+
+    // Finished conversions are queued right away. One readback slot is kept free, so the
+    // next frame's readback never waits for a conversion
+    while (!conversions.empty() &&
+           (conversions.size() >= VulkanRenderer::readbackSlotCount ||
+            conversions.front().done.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready)) {
+        queueConversion();
+    }
 }
 
-void VulkanEncoder::saveEncodedOutput() {
-    void *data;
-    vkMapMemory(device, encodedMemory, 0, VK_WHOLE_SIZE, 0, &data);
-
-    std::ofstream file(outputPath, std::ios::out | std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open output file for writing");
+void VulkanEncoder::queueConversion() {
+    Conversion conversion = std::move(conversions.front());
+    conversions.pop_front();
+    {
+        TRACE_SCOPE("wait for conversion");
+        conversion.done.get();
     }
-
-    file.write(static_cast<char *>(data), 1024); // Replace size with actual size after encoding
-
-    file.close();
-    vkUnmapMemory(device, encodedMemory);
+    softwareEncoder->encodeFrame(std::move(*conversion.frame));
 }
 
 void VulkanEncoder::finish() {
-    saveEncodedOutput();
+    while (!conversions.empty()) {
+        queueConversion();
+    }
+    softwareEncoder->flush();
+    output.flush();
+}
+
+void VulkanEncoder::addConsumer(FrameConsumer consumer) {
+    consumers.push_back(std::move(consumer));
 }
 
 void VulkanEncoder::shutdown() {
-    if (encodedOutputBuffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(device, encodedOutputBuffer, nullptr);
-    }
-    if (encodedMemory != VK_NULL_HANDLE) {
-        vkFreeMemory(device, encodedMemory, nullptr);
-    }
-    if (commandPool != VK_NULL_HANDLE) {
-        vkDestroyCommandPool(device, commandPool, nullptr);
+    // Conversions write into frames owned here, so they are waited for first
+    for (const Conversion &conversion : conversions) {
+        conversion.done.wait();
     }
+    conversions.clear();
+
+    // Waits for the software encoder's running tasks, which write to the output and ring
+    softwareEncoder.reset();
+    bitstream.reset();
 }
 
 VulkanEncoder::~VulkanEncoder() {
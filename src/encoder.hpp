@@ -1,28 +1,58 @@
 #pragma once
-// #include <fstream>
-// #include <iostream>
-// #include <stdexcept>
 #include <string>
-// #include <vector>
+#include "bitstream_ring.hpp"
 #include "logger.hpp"
+#include "rate_control.hpp"
 #include "renderer.hpp"
+#include "software_encoder.hpp"
+#include "thread_pool.hpp"
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
 #include <vulkan/vulkan.h>
 
 class VulkanRenderer;
 
 /**
  * @class VulkanEncoder
- * @brief Encodes rendered frames from VulkanRenderer using Vulkan Video (H.264) and writes to file
+ * @brief Encodes rendered frames from VulkanRenderer to H.264 and writes them to file
+ *
+ * Frames are read back, converted to YUV 4:2:0 and coded by a SoftwareEncoder on a thread
+ * pool
  */
 class VulkanEncoder {
   public:
+    /**
+     * @brief Receives each coded frame after it is written to the output file
+     *
+     * The frame's view points into the bitstream ring and is only valid during the call.
+     * Consumers are called on a worker thread
+     */
+    using FrameConsumer = std::function<void(const EncodedFrame &)>;
+
     /**
      * @brief Constructs the encoder with a VulkanRenderer context and output path
+     * @param renderer The renderer whose frames are encoded
+     * @param outputPath Path of the H.264 Annex B output
+     * @param rateControlConfig Rate control options
+     * @param softwareConfig Software encoder options (the picture size is taken from the
+     * renderer)
+     * @param pool Pool the software encoder runs on, shared with other encoders. If null, the
+     * encoder creates its own
+     * @throws std::runtime_error if the output file cannot be opened
      */
-    VulkanEncoder(VulkanRenderer *renderer, const std::string &outputPath);
+    VulkanEncoder(VulkanRenderer *renderer, const std::string &outputPath,
+                  const RateControlConfig &rateControlConfig = RateControlConfig(),
+                  const SoftwareEncoderConfig &softwareConfig = SoftwareEncoderConfig(),
+                  ThreadPool *pool = nullptr);
 
     /**
      * @brief Captures and encodes one frame
+     *
+     * Returns once the frame's readback is submitted. The frame is converted to YUV on the
+     * pool while earlier frames are still being coded
      */
     void encodeFrame();
 
@@ -31,6 +61,11 @@ class VulkanEncoder {
      */
     void finish();
 
+    /**
+     * @brief Adds a consumer of the coded frames. Must be called before the first frame
+     */
+    void addConsumer(FrameConsumer consumer);
+
     /**
      * @brief Destroys encoder resources
      */
@@ -40,63 +75,61 @@ class VulkanEncoder {
     VulkanRenderer *renderer;
     std::string outputPath;
 
-    VkDevice device;
-    VkPhysicalDevice physicalDevice;
-    VkQueue videoQueue;
-    uint32_t videoQueueFamilyIndex;
+    /// @brief Coded frames, read in place by the output file and consumers
+    std::unique_ptr<BitstreamRing> bitstream;
 
-    VkCommandPool commandPool;
-    VkCommandBuffer commandBuffer;
+    /// @brief Receive the coded frames after the output file
+    std::vector<FrameConsumer> consumers;
 
-    /**
-     * @brief Framebuffer image source
-     */
-    VkImage srcImage;
-    /**
-     * @brief Converted image for encoding
-     */
-    VkImage dstImage;
-    VkBuffer encodedOutputBuffer;
-    VkDeviceMemory encodedMemory;
+    /// @brief Pool created for the software encoder when none was shared with this encoder
+    std::unique_ptr<ThreadPool> ownedPool;
 
-    VkVideoSessionKHR videoSession;
-    VkVideoSessionParametersKHR videoSessionParams;
-    VkVideoEncodeInfoKHR encodeInfo;
+    /// @brief Codes the converted frames
+    std::unique_ptr<SoftwareEncoder> softwareEncoder;
 
-    /**
-     * @brief Initialises encoding resources (session, buffers, command pool)
-     */
-    void init();
+    /// @brief H.264 Annex B output, written from the software encoder's worker threads
+    std::ofstream output;
 
-    /**
-     * @brief Creates and configures the video encoding session
-     */
-    void createVideoSession();
+    /// @brief Pool the software encoder and its conversions run on
+    ThreadPool *pool = nullptr;
 
     /**
-     * @brief Creates the Vulkan command buffer used for encoding commands
+     * @struct Conversion
+     * @brief A frame being read back and converted to YUV on the pool
      */
-    void createCommandBuffer();
+    struct Conversion {
+        /// @brief Becomes ready once the frame is converted
+        std::shared_future<void> done;
+
+        /// @brief The converted frame, written by the conversion
+        std::unique_ptr<YuvFrame> frame;
+    };
+
+    /// @brief Conversions in flight, handed to the software encoder in order
+    std::deque<Conversion> conversions;
 
     /**
-     * @brief Creates the output buffer where the encoded video data will be stored
+     * @brief Creates the software encoder and opens its output file
      */
-    void createOutputBuffer();
+    void init(const RateControlConfig &rateControlConfig,
+              const SoftwareEncoderConfig &softwareConfig, ThreadPool *pool);
 
     /**
-     * @brief Copies the framebuffer image data to a Vulkan image for encoding
+     * @brief Waits for the oldest conversion and queues its frame on the software encoder
+     * @throws Whatever the readback or conversion threw
      */
-    void copyFramebufferToImage();
+    void queueConversion();
 
     /**
-     * @brief Performs the actual video encoding process using the prepared buffers and session
+     * @brief Opens the output file
      */
-    void performEncoding();
+    void openOutput();
 
     /**
-     * @brief Saves the encoded video output buffer to disk
+     * @brief Writes a coded frame to the output file, passes it to the consumers and
+     * releases its view
      */
-    void saveEncodedOutput();
+    void deliverFrame(const EncodedFrame &frame);
 
     /**
      * @brief Shuts down the encoder and releases resources
@@ -0,0 +1,157 @@
+#include "frame_export_client.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+FrameExportClient::FrameExportClient(const std::string &socketPath) {
+#ifdef _WIN32
+    (void)socketPath;
+    throw std::runtime_error("frame export is not supported on Windows");
+#else
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0 ||
+        connect(connection, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        std::string error = std::strerror(errno);
+        release();
+        throw std::runtime_error("failed to connect to " + socketPath + ": " + error);
+    }
+    try {
+        receiveRing();
+    } catch (...) {
+        release();
+        throw;
+    }
+#endif
+}
+
+FrameExportClient::~FrameExportClient() {
+    release();
+}
+
+const FrameExportDescriptor &FrameExportClient::getDescriptor() const {
+    return descriptor;
+}
+
+const FrameExportControl &FrameExportClient::getControl() const {
+    return *control;
+}
+
+int FrameExportClient::getMemoryFd(uint32_t slot) const {
+    return fds[1 + slot];
+}
+
+int FrameExportClient::getTimelineFd() const {
+    return fds[1 + descriptor.slotCount];
+}
+
+bool FrameExportClient::receive(uint64_t &frame) {
+#ifndef _WIN32
+    ssize_t result;
+    do {
+        result = recv(connection, &frame, sizeof(frame), MSG_WAITALL);
+    } while (result < 0 && errno == EINTR);
+    return result == static_cast<ssize_t>(sizeof(frame));
+#else
+    (void)frame;
+    return false;
+#endif
+}
+
+bool FrameExportClient::readSharedFrame(uint64_t frame, std::vector<uint8_t> &pixels) const {
+    uint32_t slotIndex = static_cast<uint32_t>(frame % descriptor.slotCount);
+    const FrameExportSlot &slot = control->slots[slotIndex];
+    if (data == nullptr || slot.frame.load(std::memory_order_acquire) != frame) {
+        return false;
+    }
+    const uint8_t *slotData = data + slotIndex * descriptor.slotSize;
+    pixels.assign(slotData, slotData + descriptor.slotSize);
+
+    // The producer clears the slot's frame number before it starts overwriting the data
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.frame.load(std::memory_order_relaxed) == frame;
+}
+
+void FrameExportClient::receiveRing() {
+#ifndef _WIN32
+    std::vector<char> ancillary(CMSG_SPACE(sizeof(int) * (frameExportMaxSlots + 2)));
+    iovec iov = {&descriptor, sizeof(descriptor)};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = ancillary.data();
+    message.msg_controllen = ancillary.size();
+    ssize_t result;
+    do {
+        result = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    } while (result < 0 && errno == EINTR);
+
+    // Descriptors that arrived are adopted first, so they are closed even if the ring is bad
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr;
+         header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            fds.resize(count);
+            std::memcpy(fds.data(), CMSG_DATA(header), count * sizeof(int));
+        }
+    }
+    if (result != static_cast<ssize_t>(sizeof(descriptor))) {
+        throw std::runtime_error("failed to receive the ring descriptor");
+    }
+    if (descriptor.magic != frameExportMagic || descriptor.version != frameExportVersion) {
+        throw std::runtime_error("the producer speaks another protocol version");
+    }
+    uint32_t expectedFds = descriptor.transport == FrameExportTransport::DeviceMemory
+                               ? descriptor.slotCount + 2
+                               : 2;
+    if (descriptor.slotCount == 0 || descriptor.slotCount > frameExportMaxSlots ||
+        fds.size() != descriptor.fdCount || fds.size() != expectedFds) {
+        throw std::runtime_error("malformed ring descriptor");
+    }
+
+    void *mapped = mmap(nullptr, sizeof(FrameExportControl), PROT_READ, MAP_SHARED, fds[0], 0);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("failed to map the control block");
+    }
+    control = static_cast<const FrameExportControl *>(mapped);
+
+    if (descriptor.transport == FrameExportTransport::SharedMemory) {
+        mapped = mmap(nullptr, descriptor.slotSize * descriptor.slotCount, PROT_READ, MAP_SHARED,
+                      fds[1], 0);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("failed to map the frame data");
+        }
+        data = static_cast<const uint8_t *>(mapped);
+    }
+#endif
+}
+
+void FrameExportClient::release() {
+#ifndef _WIN32
+    if (control != nullptr) {
+        munmap(const_cast<FrameExportControl *>(control), sizeof(FrameExportControl));
+        control = nullptr;
+    }
+    if (data != nullptr) {
+        munmap(const_cast<uint8_t *>(data), descriptor.slotSize * descriptor.slotCount);
+        data = nullptr;
+    }
+    for (int fd : fds) {
+        close(fd);
+    }
+    fds.clear();
+    if (connection >= 0) {
+        close(connection);
+        connection = -1;
+    }
+#endif
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "frame_export_protocol.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class FrameExportClient
+ * @brief Consumer side of the frame export socket
+ *
+ * Connects to a FrameExportServer, receives the ring's descriptor and file descriptors and
+ * maps the shared control block and, for the SharedMemory transport, the frame data. Frames
+ * exported in device memory still have to be imported into a device by the caller, from
+ * getMemoryFd and getTimelineFd. Vulkan-free, so consumers outside the application can use
+ * it as well.
+ */
+class FrameExportClient {
+  public:
+    /**
+     * @brief Connects to the export socket and receives the ring
+     * @param socketPath Path of the Unix socket the producer listens on
+     * @throws std::runtime_error if the producer cannot be reached, speaks another protocol
+     * version or sends a malformed ring, or on Windows
+     */
+    explicit FrameExportClient(const std::string &socketPath);
+
+    /**
+     * @brief Disconnects and unmaps the ring
+     */
+    ~FrameExportClient();
+
+    FrameExportClient(const FrameExportClient &) = delete;
+    FrameExportClient &operator=(const FrameExportClient &) = delete;
+
+    /**
+     * @brief Returns the descriptor of the ring
+     */
+    const FrameExportDescriptor &getDescriptor() const;
+
+    /**
+     * @brief Returns the shared control block
+     */
+    const FrameExportControl &getControl() const;
+
+    /**
+     * @brief Returns the memory fd of a slot (DeviceMemory). The client keeps ownership
+     */
+    int getMemoryFd(uint32_t slot) const;
+
+    /**
+     * @brief Returns the timeline semaphore fd (DeviceMemory). The client keeps ownership
+     */
+    int getTimelineFd() const;
+
+    /**
+     * @brief Waits for the next frame notification
+     * @param frame Receives the number of the frame
+     * @return false once the producer has closed the connection
+     */
+    bool receive(uint64_t &frame);
+
+    /**
+     * @brief Copies a frame out of shared memory
+     * @param frame Number of the frame
+     * @param pixels Receives the frame in the exported layout
+     * @return false if the producer replaced the frame before or during the copy
+     */
+    bool readSharedFrame(uint64_t frame, std::vector<uint8_t> &pixels) const;
+
+  protected:
+    /// @brief Descriptor of the ring
+    FrameExportDescriptor descriptor;
+
+    /// @brief Control block, then the memory of every slot and the timeline, or the data
+    std::vector<int> fds;
+
+    /// @brief Connection to the producer, which carries frame notifications
+    int connection = -1;
+
+    /// @brief The mapped control block
+    const FrameExportControl *control = nullptr;
+
+    /// @brief The mapped frame data (SharedMemory)
+    const uint8_t *data = nullptr;
+
+    /**
+     * @brief Receives the descriptor and file descriptors and maps the shared memory
+     * @throws std::runtime_error on failure
+     */
+    void receiveRing();
+
+    /**
+     * @brief Closes every descriptor and unmaps the shared memory
+     */
+    void release();
+};
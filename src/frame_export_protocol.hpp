@@ -0,0 +1,133 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file frame_export_protocol.hpp
+ * @brief Wire format shared by the frame export server and its consumers
+ *
+ * A consumer connects to the export socket and receives one FrameExportDescriptor, carrying
+ * file descriptors as SCM_RIGHTS ancillary data in this order:
+ * - the FrameExportControl block, to be mapped shared
+ * - DeviceMemory: one memory fd per slot (OPAQUE_FD), then the timeline semaphore (OPAQUE_FD)
+ * - SharedMemory: the frame data, slotCount slots of slotSize bytes each
+ *
+ * After the handshake, the producer sends the number of every published frame as a uint64_t
+ * on the same connection. Frame n lives in slot n % slotCount and, in DeviceMemory mode, is
+ * ready once the timeline semaphore reaches n. Notifications are dropped rather than waited
+ * for when a consumer falls behind, so consumers should go by FrameExportControl::latestFrame.
+ */
+
+/// @brief First field of every descriptor ("VTFX")
+constexpr uint32_t frameExportMagic = 0x58465456;
+
+/// @brief Protocol version, bumped on any change to the structures below
+constexpr uint32_t frameExportVersion = 1;
+
+/// @brief Largest number of slots in a frame ring
+constexpr uint32_t frameExportMaxSlots = 8;
+
+/**
+ * @enum FrameExportTransport
+ * @brief How the frame data reaches consumers
+ */
+enum class FrameExportTransport : uint32_t {
+    DeviceMemory = 0, ///< Exported device memory, imported by the consumer into its own device
+    SharedMemory = 1  ///< Frames read back by the producer into POSIX shared memory
+};
+
+/**
+ * @enum FrameExportFormat
+ * @brief Layout of the exported frames
+ */
+enum class FrameExportFormat : uint32_t {
+    Rgba = 0, ///< 8-bit RGBA, width * 4 bytes per row
+    Nv12 = 1  ///< Full-resolution Y plane followed by a half-resolution interleaved CbCr plane
+};
+
+/**
+ * @struct FrameExportDescriptor
+ * @brief Describes the frame ring; sent once to every consumer
+ */
+struct FrameExportDescriptor {
+    /// @brief frameExportMagic
+    uint32_t magic = frameExportMagic;
+
+    /// @brief frameExportVersion
+    uint32_t version = frameExportVersion;
+
+    /// @brief How the frame data is shared
+    FrameExportTransport transport = FrameExportTransport::SharedMemory;
+
+    /// @brief Layout of the frames
+    FrameExportFormat format = FrameExportFormat::Rgba;
+
+    /// @brief Width of the frames in pixels
+    uint32_t width = 0;
+
+    /// @brief Height of the frames in pixels
+    uint32_t height = 0;
+
+    /// @brief Number of slots in the ring
+    uint32_t slotCount = 0;
+
+    /// @brief Number of file descriptors sent with the descriptor
+    uint32_t fdCount = 0;
+
+    /// @brief Bytes per slot: the allocation size of each image, or the size of a frame in
+    /// shared memory
+    uint64_t slotSize = 0;
+
+    /// @brief VkFormat of the exported images (DeviceMemory only)
+    uint32_t vkFormat = 0;
+
+    /// @brief VkImageUsageFlags the images were created with (DeviceMemory only)
+    uint32_t imageUsage = 0;
+
+    /// @brief VkImageTiling of the images (DeviceMemory only)
+    uint32_t imageTiling = 0;
+
+    /// @brief Padding, zero
+    uint32_t reserved = 0;
+
+    /// @brief deviceUUID of the producer's device; memory can only be imported by the same one
+    uint8_t deviceUuid[16] = {};
+
+    /// @brief driverUUID of the producer's driver
+    uint8_t driverUuid[16] = {};
+};
+
+/**
+ * @struct FrameExportSlot
+ * @brief Producer-side state of one slot of the ring
+ *
+ * frame is cleared before the slot is overwritten and set once the new frame is published, so
+ * a consumer that reads the same frame number before and after using the slot knows the data
+ * was not replaced in between.
+ */
+struct FrameExportSlot {
+    /// @brief Number of the frame in the slot, 0 while it is being replaced
+    std::atomic<uint64_t> frame{0};
+
+    /// @brief CLOCK_MONOTONIC time the frame was submitted for rendering, in nanoseconds
+    std::atomic<uint64_t> submitTime{0};
+
+    /// @brief CLOCK_MONOTONIC time the frame was published, in nanoseconds
+    std::atomic<uint64_t> publishTime{0};
+};
+
+/**
+ * @struct FrameExportControl
+ * @brief Control block shared between the producer and every consumer
+ */
+struct FrameExportControl {
+    /// @brief Number of the last published frame. Frames are numbered from 1
+    std::atomic<uint64_t> latestFrame{0};
+
+    /// @brief Per-slot state; only the first slotCount entries are used
+    FrameExportSlot slots[frameExportMaxSlots];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the control block is shared between processes and needs lock-free atomics");
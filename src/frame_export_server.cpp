@@ -0,0 +1,293 @@
+#include "frame_export_server.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * @struct ExportMetrics
+ * @brief Metrics shared by every frame export server of the process
+ */
+struct ExportMetrics {
+    Counter &published;
+    Gauge &consumers;
+};
+
+const ExportMetrics &getExportMetrics() {
+    static const ExportMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        return ExportMetrics{
+            registry.getCounter("vulkantest_frames_exported_total",
+                                "Frames published to export consumers"),
+            registry.getGauge("vulkantest_export_consumers", "Connected export consumers")};
+    }();
+    return metrics;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Creates an anonymous POSIX shared memory object of the given size
+ *
+ * The name is unlinked straight away, so the object lives only as long as descriptors to it
+ */
+int createSharedMemoryObject(size_t size) {
+    static std::atomic<uint32_t> counter{0};
+    std::string name = "/vulkan-frame-export-" + std::to_string(getpid()) + "-" +
+                       std::to_string(counter.fetch_add(1));
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("failed to create shared memory " + name + ": " +
+                                 std::strerror(errno));
+    }
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to size shared memory " + name + ": " +
+                                 std::strerror(errno));
+    }
+    return fd;
+}
+
+void *mapShared(int fd, size_t size) {
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("failed to map shared memory: " +
+                                 std::string(std::strerror(errno)));
+    }
+    return mapped;
+}
+#endif
+
+} // namespace
+
+FrameExportServer::FrameExportServer(const std::string &socketPath,
+                                     const FrameExportDescriptor &descriptor,
+                                     const std::vector<int> &resourceFds)
+    : socketPath(socketPath), descriptor(descriptor) {
+#ifdef _WIN32
+    throw std::runtime_error("frame export is not supported on Windows");
+#else
+    // The control block always goes first; keep its place while the resources are adopted
+    fds.push_back(-1);
+    fds.insert(fds.end(), resourceFds.begin(), resourceFds.end());
+    try {
+        if (descriptor.slotCount == 0 || descriptor.slotCount > frameExportMaxSlots) {
+            throw std::runtime_error("frame export needs between 1 and " +
+                                     std::to_string(frameExportMaxSlots) + " slots");
+        }
+        createSharedMemory();
+        this->descriptor.fdCount = static_cast<uint32_t>(fds.size());
+        listen();
+        if (pipe2(wakeFds, O_CLOEXEC) != 0) {
+            throw std::runtime_error("failed to create the frame export wake pipe");
+        }
+    } catch (...) {
+        release();
+        throw;
+    }
+    thread = std::thread(&FrameExportServer::serve, this);
+#endif
+}
+
+FrameExportServer::~FrameExportServer() {
+#ifndef _WIN32
+    if (thread.joinable()) {
+        char wake = 0;
+        while (write(wakeFds[1], &wake, 1) < 0 && errno == EINTR) {
+        }
+        thread.join();
+    }
+    release();
+#endif
+}
+
+const FrameExportDescriptor &FrameExportServer::getDescriptor() const {
+    return descriptor;
+}
+
+uint8_t *FrameExportServer::getSlotData(uint32_t slot) const {
+    if (data == nullptr) {
+        return nullptr;
+    }
+    return data + static_cast<size_t>(slot) * descriptor.slotSize;
+}
+
+void FrameExportServer::beginSlot(uint32_t slot) {
+    control->slots[slot].frame.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void FrameExportServer::publish(uint64_t frame, uint64_t submitTime) {
+#ifndef _WIN32
+    FrameExportSlot &slot = control->slots[frame % descriptor.slotCount];
+    slot.submitTime.store(submitTime, std::memory_order_relaxed);
+    slot.publishTime.store(Tracer::now(), std::memory_order_relaxed);
+    slot.frame.store(frame, std::memory_order_release);
+    control->latestFrame.store(frame, std::memory_order_release);
+    getExportMetrics().published.add();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = consumers.begin(); it != consumers.end();) {
+        // A full socket means the consumer is behind; it catches up from latestFrame
+        ssize_t result = send(*it, &frame, sizeof(frame), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (result < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LOG_INFO("Frame export consumer disconnected.");
+            getExportMetrics().consumers.add(-1.0);
+            close(*it);
+            it = consumers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#else
+    (void)frame;
+    (void)submitTime;
+#endif
+}
+
+size_t FrameExportServer::getConsumerCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return consumers.size();
+}
+
+void FrameExportServer::createSharedMemory() {
+#ifndef _WIN32
+    fds[0] = createSharedMemoryObject(sizeof(FrameExportControl));
+    control = new (mapShared(fds[0], sizeof(FrameExportControl))) FrameExportControl();
+
+    if (descriptor.transport == FrameExportTransport::SharedMemory) {
+        dataSize = static_cast<size_t>(descriptor.slotSize) * descriptor.slotCount;
+        fds.push_back(createSharedMemoryObject(dataSize));
+        data = static_cast<uint8_t *>(mapShared(fds.back(), dataSize));
+    }
+#endif
+}
+
+void FrameExportServer::listen() {
+#ifndef _WIN32
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("frame export socket path is too long: " + socketPath);
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error("failed to create the frame export socket");
+    }
+
+    // A socket left by an earlier run would make bind() fail
+    unlink(socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, 16) != 0) {
+        throw std::runtime_error("failed to listen on frame export socket " + socketPath + ": " +
+                                 std::strerror(errno));
+    }
+    LOG_INFO("Exporting frames on unix:" + socketPath + ".");
+#endif
+}
+
+void FrameExportServer::serve() {
+#ifndef _WIN32
+    pollfd pollFds[2] = {{listenFd, POLLIN, 0}, {wakeFds[0], POLLIN, 0}};
+    while (true) {
+        if (poll(pollFds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Frame export server stopped: " + std::string(std::strerror(errno)));
+            return;
+        }
+        if (pollFds[1].revents != 0) {
+            return;
+        }
+
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (!handshake(fd)) {
+            close(fd);
+            continue;
+        }
+        LOG_INFO("Frame export consumer connected.");
+        getExportMetrics().consumers.add(1.0);
+        std::lock_guard<std::mutex> lock(mutex);
+        consumers.push_back(fd);
+    }
+#endif
+}
+
+bool FrameExportServer::handshake(int fd) const {
+#ifndef _WIN32
+    // The descriptor is small enough to go out in one message with its fds attached
+    timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<char> ancillary(CMSG_SPACE(sizeof(int) * fds.size()));
+    iovec iov = {const_cast<FrameExportDescriptor *>(&descriptor), sizeof(descriptor)};
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = ancillary.data();
+    message.msg_controllen = ancillary.size();
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+    ssize_t result;
+    do {
+        result = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (result < 0 && errno == EINTR);
+    return result == static_cast<ssize_t>(sizeof(descriptor));
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+void FrameExportServer::release() {
+#ifndef _WIN32
+    for (int fd : consumers) {
+        close(fd);
+    }
+    getExportMetrics().consumers.add(-static_cast<double>(consumers.size()));
+    consumers.clear();
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    if (control != nullptr) {
+        munmap(control, sizeof(FrameExportControl));
+    }
+    if (data != nullptr) {
+        munmap(data, dataSize);
+    }
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    fds.clear();
+#endif
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "frame_export_protocol.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class FrameExportServer
+ * @brief Hands a ring of exported frames to consumer processes over a Unix socket
+ *
+ * A thread of its own accepts consumers and sends each one the ring's descriptor together with
+ * its file descriptors (see frame_export_protocol.hpp). The server owns the shared control
+ * block and, for the SharedMemory transport, the shared frame data. Publishing a frame updates
+ * the control block and notifies every consumer without blocking, so a slow or stuck consumer
+ * never holds up the producer.
+ */
+class FrameExportServer {
+  public:
+    /**
+     * @brief Creates the shared memory and starts accepting consumers
+     * @param socketPath Path of the Unix socket to listen on
+     * @param descriptor Description of the ring. fdCount is filled in by the server
+     * @param resourceFds For DeviceMemory, the memory fd of every slot followed by the timeline
+     * semaphore fd. Ownership passes to the server, which closes them even if it throws
+     * @throws std::runtime_error if the shared memory or the socket cannot be set up, or on
+     * Windows
+     */
+    FrameExportServer(const std::string &socketPath, const FrameExportDescriptor &descriptor,
+                      const std::vector<int> &resourceFds = {});
+
+    /**
+     * @brief Disconnects every consumer, stops listening and releases the shared memory
+     */
+    ~FrameExportServer();
+
+    FrameExportServer(const FrameExportServer &) = delete;
+    FrameExportServer &operator=(const FrameExportServer &) = delete;
+
+    /**
+     * @brief Returns the descriptor sent to consumers
+     */
+    const FrameExportDescriptor &getDescriptor() const;
+
+    /**
+     * @brief Returns the data of a slot in shared memory, or nullptr for DeviceMemory
+     */
+    uint8_t *getSlotData(uint32_t slot) const;
+
+    /**
+     * @brief Marks a slot as being overwritten by a new frame
+     *
+     * Must be called before the slot's data starts to change, so consumers still reading the
+     * previous frame can tell it was replaced
+     */
+    void beginSlot(uint32_t slot);
+
+    /**
+     * @brief Publishes a frame and notifies every consumer
+     * @param frame Number of the frame, counting from 1; it lives in slot frame % slotCount
+     * @param submitTime CLOCK_MONOTONIC time the frame was submitted, in nanoseconds
+     */
+    void publish(uint64_t frame, uint64_t submitTime);
+
+    /**
+     * @brief Returns the number of connected consumers
+     */
+    size_t getConsumerCount() const;
+
+  protected:
+    /// @brief Path of the listening socket
+    std::string socketPath;
+
+    /// @brief Descriptor sent to consumers
+    FrameExportDescriptor descriptor;
+
+    /// @brief File descriptors sent to consumers, control block first
+    std::vector<int> fds;
+
+    /// @brief The mapped control block
+    FrameExportControl *control = nullptr;
+
+    /// @brief The mapped frame data, SharedMemory only
+    uint8_t *data = nullptr;
+
+    /// @brief Size of the data mapping in bytes
+    size_t dataSize = 0;
+
+    /// @brief Listening socket
+    int listenFd = -1;
+
+    /// @brief Pipe written by the destructor to wake the accepting thread
+    int wakeFds[2] = {-1, -1};
+
+    /// @brief Guards consumers
+    mutable std::mutex mutex;
+
+    /// @brief Connections of the consumers that completed the handshake
+    std::vector<int> consumers;
+
+    /// @brief Accepts consumers until woken
+    std::thread thread;
+
+    /**
+     * @brief Creates and maps the control block and, for SharedMemory, the frame data
+     * @throws std::runtime_error on failure
+     */
+    void createSharedMemory();
+
+    /**
+     * @brief Binds and listens on the socket path
+     * @throws std::runtime_error on failure
+     */
+    void listen();
+
+    /**
+     * @brief Accepts consumers until the wake pipe is written
+     */
+    void serve();
+
+    /**
+     * @brief Sends the descriptor and file descriptors to a new consumer
+     * @param fd The consumer's connection
+     * @return false if the consumer went away
+     */
+    bool handshake(int fd) const;
+
+    /**
+     * @brief Closes every descriptor and unmaps the shared memory
+     */
+    void release();
+};
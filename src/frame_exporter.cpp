@@ -0,0 +1,446 @@
+#include "frame_exporter.hpp"
+#include "logger.hpp"
+#include "trace.hpp"
+#include "yuv_frame.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+namespace {
+
+/// @brief Format of the render targets and of the exported images
+constexpr VkFormat exportFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+/// @brief Usage of the exported images; consumers may copy or sample them
+constexpr VkImageUsageFlags exportUsage =
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+void closeFds(const std::vector<int> &fds) {
+#ifndef _WIN32
+    for (int fd : fds) {
+        close(fd);
+    }
+#else
+    (void)fds;
+#endif
+}
+
+VkImageMemoryBarrier makeImageBarrier(VkImage image, VkImageLayout oldLayout,
+                                      VkImageLayout newLayout, VkAccessFlags srcAccess,
+                                      VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+} // namespace
+
+FrameExporter::FrameExporter(std::shared_ptr<VulkanContext> context,
+                             const FrameExportConfig &config, VkExtent2D extent,
+                             uint32_t framesInFlight)
+    : context(std::move(context)), device(this->context->getDevice()), config(config),
+      extent(extent), pending(framesInFlight) {
+    if (config.slotCount == 0 || config.slotCount > frameExportMaxSlots) {
+        throw std::runtime_error("frame export needs between 1 and " +
+                                 std::to_string(frameExportMaxSlots) + " slots");
+    }
+
+    FrameExportDescriptor descriptor;
+    descriptor.format = config.format;
+    descriptor.width = extent.width;
+    descriptor.height = extent.height;
+    descriptor.slotCount = config.slotCount;
+
+    if (isDeviceExportSupported()) {
+        transport = FrameExportTransport::DeviceMemory;
+    } else if (!config.forceSharedMemory && config.format == FrameExportFormat::Rgba) {
+        LOG_WARN("Device cannot export memory and timeline semaphores, exporting frames through "
+                 "shared memory");
+    }
+    descriptor.transport = transport;
+
+    try {
+        std::vector<int> fds;
+        if (transport == FrameExportTransport::DeviceMemory) {
+            fds = createDeviceRing(descriptor);
+        } else {
+            createReadbackBuffers(descriptor, framesInFlight);
+        }
+        server = std::make_unique<FrameExportServer>(config.socketPath, descriptor, fds);
+    } catch (...) {
+        destroyRing();
+        throw;
+    }
+}
+
+FrameExporter::~FrameExporter() {
+    server.reset();
+    destroyRing();
+}
+
+FrameExportTransport FrameExporter::getTransport() const {
+    return transport;
+}
+
+void FrameExporter::recordCopy(VkCommandBuffer commandBuffer, VkImage image,
+                               uint32_t frameIndex) {
+    uint64_t frame = ++frameCount;
+    uint32_t slot = static_cast<uint32_t>(frame % config.slotCount);
+    pending[frameIndex] = {frame, 0};
+
+    // The render pass leaves the target in TRANSFER_SRC_OPTIMAL; wait for its writes
+    VkImageMemoryBarrier barriers[2] = {
+        makeImageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)};
+
+    if (transport == FrameExportTransport::SharedMemory) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             barriers);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               readbackBuffers[frameIndex], 1, &region);
+
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = readbackBuffers[frameIndex];
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0,
+                             nullptr);
+        return;
+    }
+
+    // Consumers still reading the slot's previous frame can tell it is being replaced
+    server->beginSlot(slot);
+
+    // The slot's previous contents are discarded, so it needs no acquire from the consumers
+    barriers[1] = makeImageBarrier(slotImages[slot], VK_IMAGE_LAYOUT_UNDEFINED,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                                   VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    VkImageCopy region = {};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.dstSubresource = region.srcSubresource;
+    region.extent = {extent.width, extent.height, 1};
+    vkCmdCopyImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slotImages[slot],
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    // Release the slot to the consumers' devices, which acquire it from the external family
+    VkImageMemoryBarrier release =
+        makeImageBarrier(slotImages[slot], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+    release.srcQueueFamilyIndex = context->getQueueFamilies().graphicsFamily.value();
+    release.dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &release);
+    signalValue = frame;
+}
+
+void FrameExporter::prepareSubmit(VkSubmitInfo &submitInfo) {
+    if (transport != FrameExportTransport::DeviceMemory) {
+        return;
+    }
+    timelineSubmitInfo = {};
+    timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineSubmitInfo.pNext = submitInfo.pNext;
+    timelineSubmitInfo.signalSemaphoreValueCount = 1;
+    timelineSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+    submitInfo.pNext = &timelineSubmitInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline;
+}
+
+void FrameExporter::submitted(uint32_t frameIndex, uint64_t submitTime) {
+    PendingFrame &frame = pending[frameIndex];
+    frame.submitTime = submitTime;
+
+    // Consumers wait for the timeline themselves, so the frame is announced straight away
+    if (transport == FrameExportTransport::DeviceMemory && frame.frame != 0) {
+        server->publish(frame.frame, submitTime);
+        frame = {};
+    }
+}
+
+void FrameExporter::retire(uint32_t frameIndex) {
+    PendingFrame &frame = pending[frameIndex];
+    if (transport != FrameExportTransport::SharedMemory || frame.frame == 0) {
+        return;
+    }
+    TRACE_SCOPE("export frame");
+
+    uint32_t slot = static_cast<uint32_t>(frame.frame % config.slotCount);
+    server->beginSlot(slot);
+
+    const uint8_t *rgba = readbackPixels[frameIndex];
+    uint8_t *out = server->getSlotData(slot);
+    if (config.format == FrameExportFormat::Rgba) {
+        std::memcpy(out, rgba, static_cast<size_t>(extent.width) * extent.height * 4);
+    } else {
+        Yuv420Planes planes;
+        planes.luma = out;
+        planes.lumaStride = extent.width;
+        planes.cb = out + static_cast<size_t>(extent.width) * extent.height;
+        planes.cr = planes.cb + 1;
+        planes.chromaStride = 2 * ((extent.width + 1) / 2);
+        planes.chromaStep = 2;
+        planes.width = extent.width;
+        planes.height = extent.height;
+        convertRgbaToYuv420(rgba, static_cast<ptrdiff_t>(extent.width) * 4, extent.width,
+                            extent.height, planes);
+    }
+
+    server->publish(frame.frame, frame.submitTime);
+    frame = {};
+}
+
+bool FrameExporter::isDeviceExportSupported() const {
+    if (config.forceSharedMemory || config.format != FrameExportFormat::Rgba ||
+        !context->isExternalMemorySupported() || !context->isTimelineSemaphoreSupported()) {
+        return false;
+    }
+    VkPhysicalDevice physicalDevice = context->getPhysicalDevice();
+
+    VkPhysicalDeviceExternalImageFormatInfo externalImageInfo = {};
+    externalImageInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+    externalImageInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+    VkPhysicalDeviceImageFormatInfo2 formatInfo = {};
+    formatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+    formatInfo.pNext = &externalImageInfo;
+    formatInfo.format = exportFormat;
+    formatInfo.type = VK_IMAGE_TYPE_2D;
+    formatInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    formatInfo.usage = exportUsage;
+
+    VkExternalImageFormatProperties externalImageProperties = {};
+    externalImageProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+    VkImageFormatProperties2 formatProperties = {};
+    formatProperties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+    formatProperties.pNext = &externalImageProperties;
+
+    if (vkGetPhysicalDeviceImageFormatProperties2(physicalDevice, &formatInfo,
+                                                  &formatProperties) != VK_SUCCESS ||
+        (externalImageProperties.externalMemoryProperties.externalMemoryFeatures &
+         VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT) == 0) {
+        return false;
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+
+    VkPhysicalDeviceExternalSemaphoreInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    semaphoreInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+    VkExternalSemaphoreProperties semaphoreProperties = {};
+    semaphoreProperties.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES;
+    vkGetPhysicalDeviceExternalSemaphoreProperties(physicalDevice, &semaphoreInfo,
+                                                   &semaphoreProperties);
+    return (semaphoreProperties.externalSemaphoreFeatures &
+            VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT) != 0;
+}
+
+std::vector<int> FrameExporter::createDeviceRing(FrameExportDescriptor &descriptor) {
+    auto getMemoryFd = reinterpret_cast<PFN_vkGetMemoryFdKHR>(
+        vkGetDeviceProcAddr(device, "vkGetMemoryFdKHR"));
+    auto getSemaphoreFd = reinterpret_cast<PFN_vkGetSemaphoreFdKHR>(
+        vkGetDeviceProcAddr(device, "vkGetSemaphoreFdKHR"));
+    if (getMemoryFd == nullptr || getSemaphoreFd == nullptr) {
+        throw std::runtime_error("failed to load the external memory fd functions");
+    }
+
+    // Consumers can only import the memory into the very same device and driver
+    VkPhysicalDeviceIDProperties idProperties = {};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(context->getPhysicalDevice(), &properties);
+    std::memcpy(descriptor.deviceUuid, idProperties.deviceUUID, VK_UUID_SIZE);
+    std::memcpy(descriptor.driverUuid, idProperties.driverUUID, VK_UUID_SIZE);
+    descriptor.vkFormat = exportFormat;
+    descriptor.imageUsage = exportUsage;
+    descriptor.imageTiling = VK_IMAGE_TILING_OPTIMAL;
+
+    std::vector<int> fds;
+    try {
+        for (uint32_t i = 0; i < config.slotCount; ++i) {
+            VkExternalMemoryImageCreateInfo externalInfo = {};
+            externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+            externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.pNext = &externalInfo;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = {extent.width, extent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = exportFormat;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = exportUsage;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkImage image;
+            if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create exportable image");
+            }
+            slotImages.push_back(image);
+
+            VkMemoryRequirements requirements;
+            vkGetImageMemoryRequirements(device, image, &requirements);
+            descriptor.slotSize = requirements.size;
+
+            // Allocations are always dedicated, which every driver accepts for import
+            VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+            dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+            dedicatedInfo.image = image;
+
+            VkExportMemoryAllocateInfo exportInfo = {};
+            exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+            exportInfo.pNext = &dedicatedInfo;
+            exportInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.pNext = &exportInfo;
+            allocInfo.allocationSize = requirements.size;
+            allocInfo.memoryTypeIndex = context->findMemoryType(
+                requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            VkDeviceMemory memory;
+            if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate exportable image memory");
+            }
+            slotMemory.push_back(memory);
+            vkBindImageMemory(device, image, memory, 0);
+
+            VkMemoryGetFdInfoKHR fdInfo = {};
+            fdInfo.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+            fdInfo.memory = memory;
+            fdInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+            int fd;
+            if (getMemoryFd(device, &fdInfo, &fd) != VK_SUCCESS) {
+                throw std::runtime_error("failed to export image memory");
+            }
+            fds.push_back(fd);
+        }
+
+        VkExportSemaphoreCreateInfo exportInfo = {};
+        exportInfo.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+        exportInfo.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+        VkSemaphoreTypeCreateInfo typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.pNext = &exportInfo;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create exportable timeline semaphore");
+        }
+
+        VkSemaphoreGetFdInfoKHR fdInfo = {};
+        fdInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+        fdInfo.semaphore = timeline;
+        fdInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+        int fd;
+        if (getSemaphoreFd(device, &fdInfo, &fd) != VK_SUCCESS) {
+            throw std::runtime_error("failed to export timeline semaphore");
+        }
+        fds.push_back(fd);
+    } catch (...) {
+        closeFds(fds);
+        throw;
+    }
+
+    LOG_INFO("Exporting frames in device memory (" + std::to_string(config.slotCount) +
+             " slots).");
+    return fds;
+}
+
+void FrameExporter::createReadbackBuffers(FrameExportDescriptor &descriptor,
+                                          uint32_t framesInFlight) {
+    size_t pixels = static_cast<size_t>(extent.width) * extent.height;
+    size_t chroma = static_cast<size_t>((extent.width + 1) / 2) * ((extent.height + 1) / 2);
+    descriptor.slotSize = config.format == FrameExportFormat::Rgba ? pixels * 4
+                                                                   : pixels + 2 * chroma;
+
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        context->createBuffer(pixels * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              buffer, memory);
+        readbackBuffers.push_back(buffer);
+        readbackMemory.push_back(memory);
+
+        void *mapped;
+        if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map frame export readback buffer");
+        }
+        readbackPixels.push_back(static_cast<const uint8_t *>(mapped));
+    }
+
+    LOG_INFO("Exporting frames through shared memory (" + std::to_string(config.slotCount) +
+             " slots).");
+}
+
+void FrameExporter::destroyRing() {
+    for (VkImage image : slotImages) {
+        vkDestroyImage(device, image, nullptr);
+    }
+    for (VkDeviceMemory memory : slotMemory) {
+        vkFreeMemory(device, memory, nullptr);
+    }
+    vkDestroySemaphore(device, timeline, nullptr);
+    for (VkBuffer buffer : readbackBuffers) {
+        vkDestroyBuffer(device, buffer, nullptr);
+    }
+    for (VkDeviceMemory memory : readbackMemory) {
+        vkFreeMemory(device, memory, nullptr);
+    }
+    slotImages.clear();
+    slotMemory.clear();
+    timeline = VK_NULL_HANDLE;
+    readbackBuffers.clear();
+    readbackMemory.clear();
+    readbackPixels.clear();
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include "context.hpp"
+#include "frame_export_server.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @struct FrameExportConfig
+ * @brief Configuration options for a FrameExporter
+ */
+struct FrameExportConfig {
+    /// @brief Path of the Unix socket consumers connect to
+    std::string socketPath;
+
+    /// @brief Number of frames in the ring, at most frameExportMaxSlots. A consumer has this
+    /// many frame times to use a frame before its slot is overwritten
+    uint32_t slotCount = 3;
+
+    /// @brief Layout of the exported frames. NV12 is only exported through shared memory
+    FrameExportFormat format = FrameExportFormat::Rgba;
+
+    /// @brief Export through shared memory even if the device can export its memory
+    bool forceSharedMemory = false;
+};
+
+/**
+ * @class FrameExporter
+ * @brief Shares every rendered frame of a headless renderer with other processes
+ *
+ * Where the device can export memory and timeline semaphores as file descriptors, each frame
+ * is copied on the GPU into a ring of exportable images, as part of the frame's own command
+ * buffer, and the frame's submission signals an exportable timeline semaphore with the frame
+ * number. Consumers import both into their own device, so frames never touch host memory.
+ *
+ * Otherwise, and for NV12, each frame is copied into a host-visible buffer instead. Once the
+ * frame's fence has signalled, it is converted into a ring in POSIX shared memory.
+ */
+class FrameExporter {
+  public:
+    /**
+     * @brief Creates the ring and starts accepting consumers
+     * @param context The context the frames are rendered on
+     * @param config Export options
+     * @param extent Size of the frames
+     * @param framesInFlight Number of frames the renderer keeps in flight
+     * @throws std::runtime_error if the ring or the socket cannot be created
+     */
+    FrameExporter(std::shared_ptr<VulkanContext> context, const FrameExportConfig &config,
+                  VkExtent2D extent, uint32_t framesInFlight);
+
+    /**
+     * @brief Disconnects consumers and destroys the ring. The renderer's frames must be idle
+     */
+    ~FrameExporter();
+
+    FrameExporter(const FrameExporter &) = delete;
+    FrameExporter &operator=(const FrameExporter &) = delete;
+
+    /**
+     * @brief Returns how frames reach consumers
+     */
+    FrameExportTransport getTransport() const;
+
+    /**
+     * @brief Records the export of a rendered frame at the end of its command buffer
+     * @param commandBuffer The frame's command buffer, after its render pass
+     * @param image The frame's render target, in TRANSFER_SRC_OPTIMAL
+     * @param frameIndex Index of the frame in flight
+     */
+    void recordCopy(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameIndex);
+
+    /**
+     * @brief Adds the signal of the exported timeline semaphore to the frame's submission
+     *
+     * The submit info must not signal other semaphores, and must be submitted before the next
+     * call
+     *
+     * @param submitInfo Submission of the frame last recorded with recordCopy
+     */
+    void prepareSubmit(VkSubmitInfo &submitInfo);
+
+    /**
+     * @brief Publishes a frame exported in device memory once it has been submitted
+     * @param frameIndex Index of the frame in flight
+     * @param submitTime Time the frame was submitted, as returned by Tracer::now()
+     */
+    void submitted(uint32_t frameIndex, uint64_t submitTime);
+
+    /**
+     * @brief Publishes a frame read back for shared memory once its fence has signalled
+     * @param frameIndex Index of the frame in flight
+     */
+    void retire(uint32_t frameIndex);
+
+  protected:
+    /**
+     * @struct PendingFrame
+     * @brief An exported frame that has not been published yet
+     */
+    struct PendingFrame {
+        /// @brief Number of the frame, 0 if there is none
+        uint64_t frame = 0;
+
+        /// @brief Time the frame was submitted
+        uint64_t submitTime = 0;
+    };
+
+    /// @brief The context the frames are rendered on
+    std::shared_ptr<VulkanContext> context;
+
+    /// @brief Logical device of the context
+    VkDevice device;
+
+    /// @brief Export options
+    FrameExportConfig config;
+
+    /// @brief Size of the frames
+    VkExtent2D extent;
+
+    /// @brief How frames reach consumers
+    FrameExportTransport transport = FrameExportTransport::SharedMemory;
+
+    /// @brief Serves the ring to consumers
+    std::unique_ptr<FrameExportServer> server;
+
+    /// @brief Number of the last frame recorded
+    uint64_t frameCount = 0;
+
+    /// @brief Frame recorded in each frame in flight and not yet published
+    std::vector<PendingFrame> pending;
+
+    /// @brief Exportable images of the ring (DeviceMemory)
+    std::vector<VkImage> slotImages;
+
+    /// @brief Dedicated, exportable memory of each image (DeviceMemory)
+    std::vector<VkDeviceMemory> slotMemory;
+
+    /// @brief Exportable timeline semaphore, signalled with the number of each frame
+    /// (DeviceMemory)
+    VkSemaphore timeline = VK_NULL_HANDLE;
+
+    /// @brief Chained into the submission of the frame being exported
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+
+    /// @brief Value signalled by the submission of the frame being exported
+    uint64_t signalValue = 0;
+
+    /// @brief Host-visible buffer each frame in flight is copied into (SharedMemory)
+    std::vector<VkBuffer> readbackBuffers;
+
+    /// @brief Memory of the readback buffers (SharedMemory)
+    std::vector<VkDeviceMemory> readbackMemory;
+
+    /// @brief Persistent mappings of the readback buffers (SharedMemory)
+    std::vector<const uint8_t *> readbackPixels;
+
+    /**
+     * @brief Returns whether frames can be exported in device memory
+     */
+    bool isDeviceExportSupported() const;
+
+    /**
+     * @brief Creates the exportable images and timeline semaphore, returning their fds
+     * @throws std::runtime_error on failure
+     */
+    std::vector<int> createDeviceRing(FrameExportDescriptor &descriptor);
+
+    /**
+     * @brief Creates the readback buffers of the shared memory ring
+     * @throws std::runtime_error on failure
+     */
+    void createReadbackBuffers(FrameExportDescriptor &descriptor, uint32_t framesInFlight);
+
+    /**
+     * @brief Destroys every Vulkan object of the ring
+     */
+    void destroyRing();
+};
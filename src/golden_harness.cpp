@@ -0,0 +1,326 @@
+#include "golden_harness.hpp"
+#include "snapshot_writer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+
+/**
+ * @struct Image
+ * @brief A decoded golden image, four bytes per pixel
+ */
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+uint32_t readBigEndian(const uint8_t *in) {
+    return uint32_t(in[0]) << 24 | uint32_t(in[1]) << 16 | uint32_t(in[2]) << 8 | in[3];
+}
+
+/**
+ * @brief Reads an 8-bit RGB or RGBA PNG without interlacing, as written by SnapshotWriter
+ * @throws std::runtime_error if the file cannot be read or uses other features
+ */
+Image loadPng(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to open golden image " + path);
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                              std::istreambuf_iterator<char>());
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (data.size() < 8 || !std::equal(signature, signature + 8, data.begin())) {
+        throw std::runtime_error(path + " is not a PNG file");
+    }
+
+    Image image;
+    uint32_t channels = 0;
+    std::vector<uint8_t> compressed;
+    for (size_t offset = 8; offset + 12 <= data.size();) {
+        uint32_t size = readBigEndian(&data[offset]);
+        std::string type(reinterpret_cast<const char *>(&data[offset + 4]), 4);
+        const uint8_t *body = &data[offset + 8];
+        if (offset + 12 + size > data.size()) {
+            throw std::runtime_error(path + " is truncated");
+        }
+
+        if (type == "IHDR" && size == 13) {
+            image.width = readBigEndian(body);
+            image.height = readBigEndian(body + 4);
+            channels = body[9] == 2 ? 3 : body[9] == 6 ? 4 : 0;
+            if (body[8] != 8 || channels == 0 || body[12] != 0) {
+                throw std::runtime_error(path + " is not an 8-bit RGB(A) PNG without interlacing");
+            }
+        } else if (type == "IDAT") {
+            compressed.insert(compressed.end(), body, body + size);
+        } else if (type == "IEND") {
+            break;
+        }
+        offset += 12 + size;
+    }
+    if (channels == 0) {
+        throw std::runtime_error(path + " has no image header");
+    }
+
+    size_t rowSize = size_t(image.width) * channels;
+    std::vector<uint8_t> filtered((rowSize + 1) * image.height);
+    uLongf filteredSize = static_cast<uLongf>(filtered.size());
+    if (uncompress(filtered.data(), &filteredSize, compressed.data(),
+                   static_cast<uLong>(compressed.size())) != Z_OK ||
+        filteredSize != filtered.size()) {
+        throw std::runtime_error("failed to decompress " + path);
+    }
+
+    // Undo the filters in place, then expand to RGBA
+    image.rgba.resize(size_t(image.width) * image.height * 4);
+    const uint8_t *previous = nullptr;
+    for (uint32_t y = 0; y < image.height; ++y) {
+        uint8_t filter = filtered[y * (rowSize + 1)];
+        uint8_t *row = &filtered[y * (rowSize + 1) + 1];
+        for (size_t i = 0; i < rowSize; ++i) {
+            int a = i >= channels ? row[i - channels] : 0;
+            int b = previous ? previous[i] : 0;
+            int c = previous && i >= channels ? previous[i - channels] : 0;
+            int predictor = 0;
+            switch (filter) {
+            case 0:
+                break;
+            case 1:
+                predictor = a;
+                break;
+            case 2:
+                predictor = b;
+                break;
+            case 3:
+                predictor = (a + b) / 2;
+                break;
+            case 4: {
+                int p = a + b - c;
+                int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                break;
+            }
+            default:
+                throw std::runtime_error(path + " has an invalid row filter");
+            }
+            row[i] = static_cast<uint8_t>(row[i] + predictor);
+        }
+
+        uint8_t *out = &image.rgba[size_t(y) * image.width * 4];
+        for (uint32_t x = 0; x < image.width; ++x) {
+            std::copy_n(row + x * channels, 3, out + x * 4);
+            out[x * 4 + 3] = channels == 4 ? row[x * channels + 3] : 255;
+        }
+        previous = row;
+    }
+    return image;
+}
+
+/**
+ * @brief Queues a copy of a frame to be written as a PNG
+ */
+void writeFrame(SnapshotWriter &writer, const std::string &path, const uint8_t *rgba,
+                VkExtent2D extent) {
+    auto pixels = std::make_shared<std::vector<uint8_t>>(
+        rgba, rgba + size_t(extent.width) * extent.height * 4);
+
+    SnapshotImage image;
+    image.pixels = pixels->data();
+    image.width = extent.width;
+    image.height = extent.height;
+    image.stride = static_cast<ptrdiff_t>(extent.width) * 4;
+    writer.write(path, image, [pixels]() {});
+}
+
+std::string formatMetrics(const ImageMetrics &metrics) {
+    std::ostringstream out;
+    out << "max abs diff = " << metrics.maxAbsDiff << ", PSNR = " << metrics.psnr
+        << " dB, SSIM = " << metrics.ssim;
+    return out.str();
+}
+
+} // namespace
+
+GoldenHarness::GoldenHarness(const GoldenConfig &config) : config(config) {}
+
+std::vector<GoldenCase> GoldenHarness::getDefaultCases() {
+    // The untransformed mesh, a sparse scene partly outside the view, and a dense one
+    std::vector<GoldenCase> cases(3);
+    cases[0].name = "single";
+    cases[1].name = "scatter";
+    cases[1].instanceCount = 512;
+    cases[1].sceneSeed = 7;
+    cases[2].name = "dense";
+    cases[2].instanceCount = 16384;
+    cases[2].sceneSeed = 42;
+    return cases;
+}
+
+GoldenReport GoldenHarness::run() {
+    std::vector<GoldenCase> cases = loadManifest();
+    auto context = std::make_shared<VulkanContext>(nullptr, config.context);
+
+    GoldenReport report;
+    double totalCompareMs = 0.0;
+    for (const GoldenCase &goldenCase : cases) {
+        std::string goldenPath = getPath(goldenCase.name + ".png");
+        if (!config.update && !std::ifstream(goldenPath).good()) {
+            LOG_ERROR("Golden case " + goldenCase.name + " failed: " + goldenPath +
+                      " does not exist; generate it on lavapipe with --golden-update " +
+                      config.directory);
+            ++report.missingCases;
+            continue;
+        }
+
+        RendererConfig rendererConfig;
+        rendererConfig.width = goldenCase.width;
+        rendererConfig.height = goldenCase.height;
+        rendererConfig.instanceCount = goldenCase.instanceCount;
+        rendererConfig.sceneSeed = goldenCase.sceneSeed;
+        rendererConfig.cullingMode = CullingMode::Cpu;
+        VulkanRenderer renderer(context, rendererConfig);
+
+        if (config.update) {
+            updateCase(renderer, goldenCase);
+            continue;
+        }
+
+        GoldenReport caseReport;
+        compareCase(renderer, goldenCase, caseReport);
+        report.frames += caseReport.frames;
+        report.failures += caseReport.failures;
+        report.maxCompareMs = std::max(report.maxCompareMs, caseReport.maxCompareMs);
+        totalCompareMs += caseReport.meanCompareMs * caseReport.frames;
+    }
+
+    if (config.update) {
+        writeManifest(cases);
+        LOG_INFO("Wrote " + std::to_string(cases.size()) + " golden images to " +
+                 config.directory + ".");
+        return report;
+    }
+
+    report.meanCompareMs = report.frames > 0 ? totalCompareMs / report.frames : 0.0;
+    std::ostringstream summary;
+    summary << "Golden: " << report.frames - report.failures << "/" << report.frames
+            << " frames passed, compare mean = " << report.meanCompareMs
+            << " ms, max = " << report.maxCompareMs << " ms";
+    if (report.missingCases > 0) {
+        summary << ", " << report.missingCases << "/" << cases.size()
+                << " cases failed without a golden image";
+    }
+    if (report.passed()) {
+        LOG_INFO(summary.str());
+    } else {
+        LOG_ERROR(summary.str());
+    }
+    return report;
+}
+
+std::vector<GoldenCase> GoldenHarness::loadManifest() const {
+    std::ifstream file(getPath("manifest.txt"));
+    if (!file) {
+        if (config.update) {
+            return getDefaultCases();
+        }
+        throw std::runtime_error("no golden manifest in " + config.directory +
+                                 "; create one with --golden-update");
+    }
+
+    std::vector<GoldenCase> cases;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        GoldenCase goldenCase;
+        std::istringstream fields(line);
+        if (!(fields >> goldenCase.name >> goldenCase.width >> goldenCase.height >>
+              goldenCase.instanceCount >> goldenCase.sceneSeed >>
+              goldenCase.tolerance.maxAbsDiff >> goldenCase.tolerance.minPsnr >>
+              goldenCase.tolerance.minSsim)) {
+            throw std::runtime_error("malformed golden manifest line: " + line);
+        }
+        cases.push_back(goldenCase);
+    }
+    return cases;
+}
+
+void GoldenHarness::writeManifest(const std::vector<GoldenCase> &cases) const {
+    std::ofstream file(getPath("manifest.txt"), std::ios::trunc);
+    file << "# name width height instances seed max_abs_diff min_psnr min_ssim\n";
+    for (const GoldenCase &goldenCase : cases) {
+        file << goldenCase.name << " " << goldenCase.width << " " << goldenCase.height << " "
+             << goldenCase.instanceCount << " " << goldenCase.sceneSeed << " "
+             << goldenCase.tolerance.maxAbsDiff << " " << goldenCase.tolerance.minPsnr << " "
+             << goldenCase.tolerance.minSsim << "\n";
+    }
+    if (!file.flush()) {
+        throw std::runtime_error("failed to write the golden manifest in " + config.directory);
+    }
+}
+
+std::string GoldenHarness::getPath(const std::string &name) const {
+    return config.directory + "/" + name;
+}
+
+void GoldenHarness::updateCase(VulkanRenderer &renderer, const GoldenCase &goldenCase) const {
+    SnapshotWriter writer;
+    renderer.drawFrame();
+    renderer.readFrame([&](const uint8_t *rgba, VkExtent2D extent) {
+        writeFrame(writer, getPath(goldenCase.name + ".png"), rgba, extent);
+    });
+    writer.wait();
+}
+
+void GoldenHarness::compareCase(VulkanRenderer &renderer, const GoldenCase &goldenCase,
+                                GoldenReport &report) const {
+    Image golden = loadPng(getPath(goldenCase.name + ".png"));
+    VkExtent2D extent = renderer.getExtent();
+    if (golden.width != extent.width || golden.height != extent.height) {
+        throw std::runtime_error("golden image of case " + goldenCase.name +
+                                 " does not match the size in the manifest");
+    }
+
+    SnapshotWriter writer;
+    double totalMs = 0.0;
+    for (uint32_t frame = 0; frame < config.framesPerCase; ++frame) {
+        renderer.drawFrame();
+        renderer.readFrame([&](const uint8_t *rgba, VkExtent2D size) {
+            auto start = std::chrono::steady_clock::now();
+            ImageMetrics metrics =
+                compareImages(rgba, static_cast<ptrdiff_t>(size.width) * 4, golden.rgba.data(),
+                              static_cast<ptrdiff_t>(golden.width) * 4, size.width, size.height);
+            double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+            totalMs += ms;
+            report.maxCompareMs = std::max(report.maxCompareMs, ms);
+            ++report.frames;
+
+            if (goldenCase.tolerance.accepts(metrics)) {
+                LOG_DEBUG(goldenCase.name + " frame " + std::to_string(frame) + ": " +
+                          formatMetrics(metrics));
+                return;
+            }
+
+            LOG_ERROR(goldenCase.name + " frame " + std::to_string(frame) +
+                      " differs from its golden image: " + formatMetrics(metrics));
+            if (report.failures++ == 0) {
+                writeFrame(writer, getPath(goldenCase.name + ".actual.png"), rgba, size);
+            }
+        });
+    }
+    report.meanCompareMs = report.frames > 0 ? totalMs / report.frames : 0.0;
+    writer.wait();
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include "context.hpp"
+#include "image_compare.hpp"
+#include "renderer.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @struct ImageTolerance
+ * @brief Largest differences from a golden image a frame may show and still pass
+ */
+struct ImageTolerance {
+    /// @brief Largest absolute difference of any colour channel
+    uint32_t maxAbsDiff = 1;
+
+    /// @brief Lowest PSNR in dB
+    double minPsnr = 50.0;
+
+    /// @brief Lowest mean SSIM
+    double minSsim = 0.999;
+
+    /**
+     * @brief Returns whether metrics are within the tolerance
+     */
+    bool accepts(const ImageMetrics &metrics) const {
+        return metrics.maxAbsDiff <= maxAbsDiff && metrics.psnr >= minPsnr &&
+               metrics.ssim >= minSsim;
+    }
+};
+
+/**
+ * @struct GoldenCase
+ * @brief A scene rendered by the golden harness and the golden image its frames must match
+ */
+struct GoldenCase {
+    /// @brief Name of the case; the golden image is <name>.png in the golden directory
+    std::string name;
+
+    /// @brief Size of the frames in pixels
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+
+    /// @brief Number of instances in the scene
+    uint32_t instanceCount = 1;
+
+    /// @brief Seed the instances are scattered with
+    uint32_t sceneSeed = 1;
+
+    /// @brief Differences from the golden image each frame may show
+    ImageTolerance tolerance;
+};
+
+/**
+ * @struct GoldenConfig
+ * @brief Configuration options for a GoldenHarness
+ */
+struct GoldenConfig {
+    /// @brief Directory holding manifest.txt and the golden images
+    std::string directory = "golden";
+
+    /// @brief Frames rendered and compared per case
+    uint32_t framesPerCase = 8;
+
+    /// @brief Whether to write new golden images instead of comparing against them
+    bool update = false;
+
+    /// @brief Context options, e.g. to pick the device
+    ContextConfig context;
+};
+
+/**
+ * @struct GoldenReport
+ * @brief Outcome of a GoldenHarness run
+ */
+struct GoldenReport {
+    /// @brief Frames compared
+    uint32_t frames = 0;
+
+    /// @brief Frames outside their tolerance
+    uint32_t failures = 0;
+
+    /// @brief Cases that could not be compared because their golden image does not exist
+    uint32_t missingCases = 0;
+
+    /// @brief Mean and largest time to compare one frame, in milliseconds
+    double meanCompareMs = 0.0;
+    double maxCompareMs = 0.0;
+
+    /**
+     * @brief Returns whether every case had a golden image and every frame passed
+     */
+    bool passed() const { return failures == 0 && missingCases == 0; }
+};
+
+/**
+ * @class GoldenHarness
+ * @brief Checks that the renderer still draws the expected pixels
+ *
+ * Each case of the manifest is rendered headless for a fixed number of frames, and every
+ * frame is compared in place in the readback buffer against the case's golden image, so
+ * regressions that only show after the frames in flight have cycled are caught too. Frames
+ * depend only on the case: the renderer has no time input, the scene comes from a fixed seed
+ * and instances are culled on the CPU, since the order in which the GPU cull pass compacts
+ * draws varies from run to run and overlapping instances would then be drawn in a different
+ * order.
+ *
+ * Golden images are meant to be rendered on lavapipe, the CPU driver, so that results do not
+ * depend on the GPU; the make targets select it. The manifest is a text file with one case
+ * per line:
+ *
+ *     # name width height instances seed max_abs_diff min_psnr min_ssim
+ *     single 1920 1080 1 1 1 50 0.999
+ *
+ * When a frame fails, the first failing frame of its case is written next to the golden image
+ * as <name>.actual.png. A case without a golden image fails the run, so that a missing or
+ * misnamed image cannot turn the check into a no-op.
+ */
+class GoldenHarness {
+  public:
+    /**
+     * @brief Creates a harness; the context is created by run()
+     * @param config Harness options
+     */
+    explicit GoldenHarness(const GoldenConfig &config);
+
+    /**
+     * @brief Renders every case and compares the frames, or writes new golden images
+     * @return The comparison results; in update mode, no frames are compared
+     * @throws std::runtime_error if the manifest cannot be read, or a golden image cannot be
+     * decoded or written
+     */
+    GoldenReport run();
+
+    /**
+     * @brief Returns the cases written to a new manifest
+     */
+    static std::vector<GoldenCase> getDefaultCases();
+
+  protected:
+    /// @brief Harness options
+    GoldenConfig config;
+
+    /**
+     * @brief Reads the manifest, or returns the default cases in update mode if there is none
+     */
+    std::vector<GoldenCase> loadManifest() const;
+
+    /**
+     * @brief Writes a manifest listing the cases
+     */
+    void writeManifest(const std::vector<GoldenCase> &cases) const;
+
+    /**
+     * @brief Returns the path of a file in the golden directory
+     */
+    std::string getPath(const std::string &name) const;
+
+    /**
+     * @brief Renders one frame of a case and writes it as the case's golden image
+     */
+    void updateCase(VulkanRenderer &renderer, const GoldenCase &goldenCase) const;
+
+    /**
+     * @brief Renders the frames of a case and compares each with its golden image
+     */
+    void compareCase(VulkanRenderer &renderer, const GoldenCase &goldenCase,
+                     GoldenReport &report) const;
+};
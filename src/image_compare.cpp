@@ -0,0 +1,405 @@
+#include "image_compare.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IMAGE_COMPARE_HAVE_AVX2 1
+#endif
+
+namespace {
+
+/// @brief SSIM stabilising constants for 8-bit samples, (0.01 * 255)^2 and (0.03 * 255)^2
+constexpr double ssimC1 = 6.5025;
+constexpr double ssimC2 = 58.5225;
+
+void rowErrorScalar(const uint8_t *a, const uint8_t *b, uint32_t width, ErrorSums &sums) {
+    uint64_t squared = 0;
+    uint32_t maxAbs = sums.maxAbs;
+    for (uint32_t x = 0; x < width; ++x, a += 4, b += 4) {
+        for (int c = 0; c < 3; ++c) {
+            uint32_t diff = static_cast<uint32_t>(std::abs(a[c] - b[c]));
+            squared += diff * diff;
+            maxAbs = std::max(maxAbs, diff);
+        }
+    }
+    sums.squared += squared;
+    sums.maxAbs = maxAbs;
+}
+
+void sampleErrorScalar(const uint8_t *a, const uint8_t *b, uint32_t width, ErrorSums &sums) {
+    uint64_t squared = 0;
+    uint32_t maxAbs = sums.maxAbs;
+    for (uint32_t x = 0; x < width; ++x) {
+        uint32_t diff = static_cast<uint32_t>(std::abs(a[x] - b[x]));
+        squared += diff * diff;
+        maxAbs = std::max(maxAbs, diff);
+    }
+    sums.squared += squared;
+    sums.maxAbs = maxAbs;
+}
+
+void lumaRowScalar(const uint8_t *rgba, uint32_t width, uint8_t *luma) {
+    for (uint32_t x = 0; x < width; ++x, rgba += 4) {
+        luma[x] = static_cast<uint8_t>((38 * rgba[0] + 75 * rgba[1] + 15 * rgba[2] + 64) >> 7);
+    }
+}
+
+void blockSumsScalar(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB,
+                     uint32_t blockCount, BlockSums *sums) {
+    for (uint32_t block = 0; block < blockCount; ++block) {
+        BlockSums s = {};
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                uint32_t va = a[y * strideA + block * 4 + x];
+                uint32_t vb = b[y * strideB + block * 4 + x];
+                s.sumA += va;
+                s.sumB += vb;
+                s.sumSquares += va * va + vb * vb;
+                s.sumProducts += va * vb;
+            }
+        }
+        sums[block] = s;
+    }
+}
+
+#ifdef IMAGE_COMPARE_HAVE_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET void rowErrorAvx2(const uint8_t *a, const uint8_t *b, uint32_t width,
+                              ErrorSums &sums) {
+    // Alpha differences are masked out of both the maximum and the squares
+    const __m256i colourMask = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i maxAbs = zero;
+    uint64_t squared = 0;
+    uint32_t x = 0;
+    while (x + 8 <= width) {
+        // Eight pixels add at most 2 * 2 * 255^2 per 32-bit lane, so flush well before overflow
+        __m256i partial = zero;
+        uint32_t end = std::min(width & ~7u, x + 8 * 2048);
+        for (; x < end; x += 8) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + x * 4));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + x * 4));
+            __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            diff = _mm256_and_si256(diff, colourMask);
+            maxAbs = _mm256_max_epu8(maxAbs, diff);
+
+            __m256i low = _mm256_unpacklo_epi8(diff, zero);
+            __m256i high = _mm256_unpackhi_epi8(diff, zero);
+            partial = _mm256_add_epi32(partial, _mm256_madd_epi16(low, low));
+            partial = _mm256_add_epi32(partial, _mm256_madd_epi16(high, high));
+        }
+
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), partial);
+        for (uint32_t lane : lanes) {
+            squared += lane;
+        }
+    }
+
+    alignas(32) uint8_t maxBytes[32];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(maxBytes), maxAbs);
+    sums.squared += squared;
+    sums.maxAbs = std::max<uint32_t>(sums.maxAbs, *std::max_element(maxBytes, maxBytes + 32));
+
+    rowErrorScalar(a + x * 4, b + x * 4, width - x, sums);
+}
+
+AVX2_TARGET void sampleErrorAvx2(const uint8_t *a, const uint8_t *b, uint32_t width,
+                                 ErrorSums &sums) {
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i maxAbs = zero;
+    uint64_t squared = 0;
+    uint32_t x = 0;
+    while (x + 32 <= width) {
+        // 32 samples add at most 2 * 2 * 255^2 per 32-bit lane, so flush well before overflow
+        __m256i partial = zero;
+        uint32_t end = std::min(width & ~31u, x + 32 * 2048);
+        for (; x < end; x += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + x));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + x));
+            __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+            maxAbs = _mm256_max_epu8(maxAbs, diff);
+
+            __m256i low = _mm256_unpacklo_epi8(diff, zero);
+            __m256i high = _mm256_unpackhi_epi8(diff, zero);
+            partial = _mm256_add_epi32(partial, _mm256_madd_epi16(low, low));
+            partial = _mm256_add_epi32(partial, _mm256_madd_epi16(high, high));
+        }
+
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), partial);
+        for (uint32_t lane : lanes) {
+            squared += lane;
+        }
+    }
+
+    alignas(32) uint8_t maxBytes[32];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(maxBytes), maxAbs);
+    sums.squared += squared;
+    sums.maxAbs = std::max<uint32_t>(sums.maxAbs, *std::max_element(maxBytes, maxBytes + 32));
+
+    sampleErrorScalar(a + x, b + x, width - x, sums);
+}
+
+AVX2_TARGET void lumaRowAvx2(const uint8_t *rgba, uint32_t width, uint8_t *luma) {
+    const __m256i weights = _mm256_set1_epi32(38 | 75 << 8 | 15 << 16);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i rounding = _mm256_set1_epi32(64);
+    const __m256i gather = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rgba + x * 4));
+
+        // 38R + 75G and 15B fit in signed 16 bits, and are summed into one 32-bit lane per pixel
+        __m256i y = _mm256_madd_epi16(_mm256_maddubs_epi16(pixels, weights), ones);
+        y = _mm256_srli_epi32(_mm256_add_epi32(y, rounding), 7);
+
+        // Pack each 128-bit half down to four bytes, then move both into the low eight bytes
+        y = _mm256_packs_epi32(y, y);
+        y = _mm256_packus_epi16(y, y);
+        y = _mm256_permutevar8x32_epi32(y, gather);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(luma + x), _mm256_castsi256_si128(y));
+    }
+
+    lumaRowScalar(rgba + x * 4, width - x, luma + x);
+}
+
+AVX2_TARGET void blockSumsAvx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                               ptrdiff_t strideB, uint32_t blockCount, BlockSums *sums) {
+    uint32_t block = 0;
+    for (; block + 4 <= blockCount; block += 4) {
+        __m256i sumA = _mm256_setzero_si256();
+        __m256i sumB = _mm256_setzero_si256();
+        __m256i sumSquares = _mm256_setzero_si256();
+        __m256i sumProducts = _mm256_setzero_si256();
+
+        // Sixteen pixels (four blocks) per row, in 16-bit lanes
+        for (int y = 0; y < 4; ++y) {
+            __m256i va = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + y * strideA + block * 4)));
+            __m256i vb = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + y * strideB + block * 4)));
+            sumA = _mm256_add_epi16(sumA, va);
+            sumB = _mm256_add_epi16(sumB, vb);
+            sumSquares = _mm256_add_epi32(sumSquares, _mm256_madd_epi16(va, va));
+            sumSquares = _mm256_add_epi32(sumSquares, _mm256_madd_epi16(vb, vb));
+            sumProducts = _mm256_add_epi32(sumProducts, _mm256_madd_epi16(va, vb));
+        }
+
+        // Column sums of two neighbouring pixels per 32-bit lane, two lanes per block
+        const __m256i ones = _mm256_set1_epi16(1);
+        alignas(32) uint32_t lanes[4][8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[0]), _mm256_madd_epi16(sumA, ones));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[1]), _mm256_madd_epi16(sumB, ones));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[2]), sumSquares);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes[3]), sumProducts);
+        for (int i = 0; i < 4; ++i) {
+            BlockSums &s = sums[block + i];
+            s.sumA = lanes[0][2 * i] + lanes[0][2 * i + 1];
+            s.sumB = lanes[1][2 * i] + lanes[1][2 * i + 1];
+            s.sumSquares = lanes[2][2 * i] + lanes[2][2 * i + 1];
+            s.sumProducts = lanes[3][2 * i] + lanes[3][2 * i + 1];
+        }
+    }
+
+    blockSumsScalar(a + block * 4, strideA, b + block * 4, strideB, blockCount - block,
+                    sums + block);
+}
+
+const ImageCompareFunctions avx2Functions = {rowErrorAvx2, sampleErrorAvx2, lumaRowAvx2,
+                                             blockSumsAvx2};
+
+#endif
+
+const ImageCompareFunctions scalarFunctions = {rowErrorScalar, sampleErrorScalar, lumaRowScalar,
+                                               blockSumsScalar};
+
+/**
+ * @brief SSIM of a window of n pixels from its sums
+ */
+double ssimWindow(double sumA, double sumB, double sumSquares, double sumProducts, double n) {
+    double meanA = sumA / n;
+    double meanB = sumB / n;
+    double variances = (sumSquares - (sumA * sumA + sumB * sumB) / n) / std::max(n - 1.0, 1.0);
+    double covariance = (sumProducts - sumA * sumB / n) / std::max(n - 1.0, 1.0);
+    return (2.0 * meanA * meanB + ssimC1) * (2.0 * covariance + ssimC2) /
+           ((meanA * meanA + meanB * meanB + ssimC1) * (variances + ssimC2));
+}
+
+/**
+ * @brief SSIM of sample planes smaller than one window, compared whole
+ */
+double ssimWhole(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB,
+                 uint32_t width, uint32_t height) {
+    double sumA = 0.0, sumB = 0.0, sumSquares = 0.0, sumProducts = 0.0;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            double va = a[y * strideA + x];
+            double vb = b[y * strideB + x];
+            sumA += va;
+            sumB += vb;
+            sumSquares += va * va + vb * vb;
+            sumProducts += va * vb;
+        }
+    }
+    return ssimWindow(sumA, sumB, sumSquares, sumProducts, double(width) * height);
+}
+
+/**
+ * @brief Mean SSIM of the 8x8 windows made of two blocks from each of two rows of block sums
+ * @param top Block sums of the window's upper four rows
+ * @param bottom Block sums of the window's lower four rows
+ * @param blockCount Number of blocks per row
+ * @param blockStep Distance between the first blocks of neighbouring windows
+ * @param windowCount Incremented for each window
+ * @return Sum of the windows' SSIM
+ */
+double sumWindows(const BlockSums *top, const BlockSums *bottom, uint32_t blockCount,
+                  uint32_t blockStep, uint64_t &windowCount) {
+    double ssimSum = 0.0;
+    for (uint32_t block = 0; block + 1 < blockCount; block += blockStep) {
+        const BlockSums &s0 = top[block];
+        const BlockSums &s1 = top[block + 1];
+        const BlockSums &s2 = bottom[block];
+        const BlockSums &s3 = bottom[block + 1];
+        ssimSum += ssimWindow(s0.sumA + s1.sumA + s2.sumA + s3.sumA,
+                              s0.sumB + s1.sumB + s2.sumB + s3.sumB,
+                              s0.sumSquares + s1.sumSquares + s2.sumSquares + s3.sumSquares,
+                              s0.sumProducts + s1.sumProducts + s2.sumProducts + s3.sumProducts,
+                              64.0);
+        ++windowCount;
+    }
+    return ssimSum;
+}
+
+} // namespace
+
+const ImageCompareFunctions &getScalarImageCompareFunctions() {
+    return scalarFunctions;
+}
+
+const ImageCompareFunctions &getImageCompareFunctions() {
+#ifdef IMAGE_COMPARE_HAVE_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return avx2Functions;
+    }
+#endif
+    return scalarFunctions;
+}
+
+ImageMetrics compareImages(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                           ptrdiff_t strideB, uint32_t width, uint32_t height,
+                           const ImageCompareFunctions &functions) {
+    ImageMetrics metrics;
+    if (width == 0 || height == 0) {
+        return metrics;
+    }
+
+    ErrorSums errors;
+    bool windowed = width >= 8 && height >= 8;
+    uint32_t blockCount = width / 4;
+
+    // Four rows of luma per image, and the block sums of the current and previous strips
+    std::vector<uint8_t> luma(windowed ? 8 * size_t(width) : 0);
+    std::vector<BlockSums> current(windowed ? blockCount : 0);
+    std::vector<BlockSums> previous(windowed ? blockCount : 0);
+    uint8_t *lumaA = luma.data();
+    uint8_t *lumaB = luma.data() + 4 * size_t(width);
+
+    double ssimSum = 0.0;
+    uint64_t windowCount = 0;
+    uint32_t y = 0;
+    for (; windowed && y + 4 <= height; y += 4) {
+        for (uint32_t row = 0; row < 4; ++row) {
+            const uint8_t *rowA = a + (y + row) * strideA;
+            const uint8_t *rowB = b + (y + row) * strideB;
+            functions.rowError(rowA, rowB, width, errors);
+            functions.lumaRow(rowA, width, lumaA + row * width);
+            functions.lumaRow(rowB, width, lumaB + row * width);
+        }
+        functions.blockSums(lumaA, width, lumaB, width, blockCount, current.data());
+
+        // Each window covers two blocks of this strip and the two above them
+        if (y > 0) {
+            ssimSum += sumWindows(previous.data(), current.data(), blockCount, 1, windowCount);
+        }
+        std::swap(previous, current);
+    }
+
+    // Rows below the last whole strip only count towards the error
+    for (; y < height; ++y) {
+        functions.rowError(a + y * strideA, b + y * strideB, width, errors);
+    }
+
+    metrics.maxAbsDiff = errors.maxAbs;
+    metrics.psnr = computePsnr(errors.squared, 3 * uint64_t(width) * height);
+    if (errors.maxAbs == 0) {
+        metrics.ssim = 1.0;
+    } else if (windowed) {
+        metrics.ssim = ssimSum / windowCount;
+    } else {
+        // Images smaller than a window are converted to luma whole
+        std::vector<uint8_t> lumaPlanes(2 * size_t(width) * height);
+        uint8_t *planeA = lumaPlanes.data();
+        uint8_t *planeB = planeA + size_t(width) * height;
+        for (uint32_t row = 0; row < height; ++row) {
+            functions.lumaRow(a + row * strideA, width, planeA + row * width);
+            functions.lumaRow(b + row * strideB, width, planeB + row * width);
+        }
+        metrics.ssim = ssimWhole(planeA, width, planeB, width, width, height);
+    }
+    return metrics;
+}
+
+double computePsnr(uint64_t squared, uint64_t sampleCount) {
+    if (squared == 0 || sampleCount == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double mse = double(squared) / double(sampleCount);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+ErrorSums comparePlanes(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB,
+                        uint32_t width, uint32_t height, const ImageCompareFunctions &functions) {
+    ErrorSums errors;
+    for (uint32_t y = 0; y < height; ++y) {
+        functions.sampleError(a + y * strideA, b + y * strideB, width, errors);
+    }
+    return errors;
+}
+
+double computeSsim(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB,
+                   uint32_t width, uint32_t height, uint32_t step,
+                   const ImageCompareFunctions &functions) {
+    if (width == 0 || height == 0) {
+        return 1.0;
+    }
+    if (width < 8 || height < 8) {
+        return ssimWhole(a, strideA, b, strideB, width, height);
+    }
+
+    step = std::max(step & ~3u, 4u);
+    uint32_t blockCount = width / 4;
+    std::vector<BlockSums> top(blockCount);
+    std::vector<BlockSums> bottom(blockCount);
+
+    double ssimSum = 0.0;
+    uint64_t windowCount = 0;
+    for (uint32_t y = 0; y + 8 <= height; y += step) {
+        functions.blockSums(a + y * strideA, strideA, b + y * strideB, strideB, blockCount,
+                            top.data());
+        functions.blockSums(a + (y + 4) * strideA, strideA, b + (y + 4) * strideB, strideB,
+                            blockCount, bottom.data());
+        ssimSum += sumWindows(top.data(), bottom.data(), blockCount, step / 4, windowCount);
+    }
+    return ssimSum / windowCount;
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/**
+ * @struct ImageMetrics
+ * @brief Differences between two RGBA images. Alpha is ignored
+ */
+struct ImageMetrics {
+    /// @brief Largest absolute difference of any colour channel
+    uint32_t maxAbsDiff = 0;
+
+    /// @brief PSNR of the colour channels in dB, infinite for identical images
+    double psnr = std::numeric_limits<double>::infinity();
+
+    /// @brief Mean SSIM of the luma over 8x8 windows spaced 4 pixels apart, 1 for identical
+    /// images
+    double ssim = 1.0;
+};
+
+/**
+ * @struct ErrorSums
+ * @brief Running error totals of a comparison
+ */
+struct ErrorSums {
+    /// @brief Sum of the squared colour channel differences
+    uint64_t squared = 0;
+
+    /// @brief Largest absolute colour channel difference
+    uint32_t maxAbs = 0;
+};
+
+/**
+ * @struct BlockSums
+ * @brief Sums over a 4x4 block of two luma planes a and b, from which SSIM is computed
+ */
+struct BlockSums {
+    /// @brief Sum of a and of b
+    uint32_t sumA;
+    uint32_t sumB;
+
+    /// @brief Sum of a * a + b * b
+    uint32_t sumSquares;
+
+    /// @brief Sum of a * b
+    uint32_t sumProducts;
+};
+
+/**
+ * @brief Adds the errors of one row of RGBA pixels to running totals
+ * @param a First row
+ * @param b Second row
+ * @param width Width of the rows in pixels
+ * @param sums Totals to add to
+ */
+using RowError = void (*)(const uint8_t *a, const uint8_t *b, uint32_t width, ErrorSums &sums);
+
+/**
+ * @brief Adds the errors of one row of 8-bit samples of a single plane to running totals
+ * @param a First row
+ * @param b Second row
+ * @param width Width of the rows in samples
+ * @param sums Totals to add to
+ */
+using SampleError = void (*)(const uint8_t *a, const uint8_t *b, uint32_t width,
+                             ErrorSums &sums);
+
+/**
+ * @brief Converts one row of RGBA pixels to full-range BT.601 luma, (38R + 75G + 15B + 64) >> 7
+ * @param rgba The row
+ * @param width Width of the row in pixels
+ * @param luma Receives width bytes
+ */
+using LumaRow = void (*)(const uint8_t *rgba, uint32_t width, uint8_t *luma);
+
+/**
+ * @brief Computes the sums of the 4x4 blocks along four rows of two luma planes
+ * @param a First row of the first plane
+ * @param strideA Distance between rows of the first plane in bytes
+ * @param b First row of the second plane
+ * @param strideB Distance between rows of the second plane in bytes
+ * @param blockCount Number of blocks, the width in pixels divided by four
+ * @param sums Receives blockCount sums
+ */
+using LumaBlockSums = void (*)(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                               ptrdiff_t strideB, uint32_t blockCount, BlockSums *sums);
+
+/**
+ * @struct ImageCompareFunctions
+ * @brief Table of image comparison kernels
+ */
+struct ImageCompareFunctions {
+    /// @brief Error totals of a row
+    RowError rowError;
+
+    /// @brief Error totals of a row of plane samples
+    SampleError sampleError;
+
+    /// @brief RGBA to luma conversion of a row
+    LumaRow lumaRow;
+
+    /// @brief SSIM sums of a row of 4x4 blocks
+    LumaBlockSums blockSums;
+};
+
+/**
+ * @brief Returns the portable scalar kernels
+ *
+ * These are the reference implementations the SIMD kernels must match exactly
+ */
+const ImageCompareFunctions &getScalarImageCompareFunctions();
+
+/**
+ * @brief Returns the fastest kernels supported by the running CPU
+ *
+ * The CPU is checked once. AVX2 kernels are used on x86 processors that support AVX2, the
+ * scalar kernels otherwise
+ */
+const ImageCompareFunctions &getImageCompareFunctions();
+
+/**
+ * @brief Compares two RGBA images of the same size
+ *
+ * The images are walked once in strips of four rows, so only a few rows of luma are held at
+ * a time. SSIM follows the usual fast formulation: luma sums over 4x4 blocks are combined
+ * into overlapping 8x8 windows, and rows or columns beyond the last whole block are left out.
+ * Images smaller than one window are compared as a single window
+ *
+ * @param a First image, four bytes per pixel
+ * @param strideA Distance between rows of the first image in bytes
+ * @param b Second image, four bytes per pixel
+ * @param strideB Distance between rows of the second image in bytes
+ * @param width Width of the images in pixels
+ * @param height Height of the images in pixels
+ * @param functions Kernels to compare with
+ * @return The differences between the images
+ */
+ImageMetrics compareImages(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                           ptrdiff_t strideB, uint32_t width, uint32_t height,
+                           const ImageCompareFunctions &functions = getImageCompareFunctions());
+
+/**
+ * @brief Returns the PSNR in dB of 8-bit samples from their summed squared error
+ * @param squared Sum of the squared differences
+ * @param sampleCount Number of samples compared
+ * @return The PSNR, infinite when there is no error
+ */
+double computePsnr(uint64_t squared, uint64_t sampleCount);
+
+/**
+ * @brief Compares two planes of 8-bit samples, e.g. one plane of two YUV frames
+ * @param a First plane
+ * @param strideA Distance between rows of the first plane in bytes
+ * @param b Second plane
+ * @param strideB Distance between rows of the second plane in bytes
+ * @param width Width of the planes in samples
+ * @param height Height of the planes in samples
+ * @param functions Kernels to compare with
+ * @return The summed squared error and the largest difference
+ */
+ErrorSums comparePlanes(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB,
+                        uint32_t width, uint32_t height,
+                        const ImageCompareFunctions &functions = getImageCompareFunctions());
+
+/**
+ * @brief Computes the mean SSIM of two luma planes over a grid of 8x8 windows
+ *
+ * Windows start every "step" pixels in both directions, so a step of 4 matches the windows of
+ * compareImages() and larger steps measure a subsample at a fraction of the cost. Planes
+ * smaller than one window are compared as a single window
+ *
+ * @param a First plane
+ * @param strideA Distance between rows of the first plane in bytes
+ * @param b Second plane
+ * @param strideB Distance between rows of the second plane in bytes
+ * @param width Width of the planes in pixels
+ * @param height Height of the planes in pixels
+ * @param step Distance between windows in pixels, rounded down to a multiple of 4 (at least 4)
+ * @param functions Kernels to compare with
+ * @return The mean SSIM, 1 for identical planes
+ */
+double computeSsim(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB,
+                   uint32_t width, uint32_t height, uint32_t step,
+                   const ImageCompareFunctions &functions = getImageCompareFunctions());
@@ -0,0 +1,651 @@
+#include "intra_predict.hpp"
+#include "pixel.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INTRA_HAVE_AVX2 1
+#endif
+
+namespace {
+
+uint8_t clip(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+// Sample p[x, -1] of the standard, where x = -1 is the above-left sample
+int topSample(const IntraNeighbours &n, int x) {
+    return x < 0 ? n.topLeft : n.top[x];
+}
+
+// Sample p[-1, y] of the standard, where y = -1 is the above-left sample
+int leftSample(const IntraNeighbours &n, int y) {
+    return y < 0 ? n.topLeft : n.left[y];
+}
+
+template <int N>
+void predictVertical(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        std::memcpy(block + y * stride, n.top, N);
+    }
+}
+
+template <int N>
+void predictHorizontal(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        std::memset(block + y * stride, n.left[y], N);
+    }
+}
+
+template <int N>
+int dcValue(const IntraNeighbours &n) {
+    constexpr int log2N = N == 4 ? 2 : N == 8 ? 3 : 4;
+    int top = 0, left = 0;
+    for (int i = 0; i < N; ++i) {
+        top += n.top[i];
+        left += n.left[i];
+    }
+
+    if (n.hasTop && n.hasLeft) {
+        return (top + left + N) >> (log2N + 1);
+    }
+    if (n.hasLeft) {
+        return (left + N / 2) >> log2N;
+    }
+    if (n.hasTop) {
+        return (top + N / 2) >> log2N;
+    }
+    return 128;
+}
+
+template <int N>
+void predictDc(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    int dc = dcValue<N>(n);
+    for (int y = 0; y < N; ++y) {
+        std::memset(block + y * stride, dc, N);
+    }
+}
+
+// The directional modes follow the Intra 4x4 and 8x8 formulas of the standard, which are
+// identical apart from the block size
+
+template <int N>
+void predictDiagonalDownLeft(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int value;
+            if (x == N - 1 && y == N - 1) {
+                value = (n.top[2 * N - 2] + 3 * n.top[2 * N - 1] + 2) >> 2;
+            } else {
+                value = (n.top[x + y] + 2 * n.top[x + y + 1] + n.top[x + y + 2] + 2) >> 2;
+            }
+            block[y * stride + x] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+template <int N>
+void predictDiagonalDownRight(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int value;
+            if (x > y) {
+                value = (topSample(n, x - y - 2) + 2 * topSample(n, x - y - 1) +
+                         topSample(n, x - y) + 2) >>
+                        2;
+            } else if (x < y) {
+                value = (leftSample(n, y - x - 2) + 2 * leftSample(n, y - x - 1) +
+                         leftSample(n, y - x) + 2) >>
+                        2;
+            } else {
+                value = (n.top[0] + 2 * n.topLeft + n.left[0] + 2) >> 2;
+            }
+            block[y * stride + x] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+template <int N>
+void predictVerticalRight(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int z = 2 * x - y;
+            int i = x - (y >> 1);
+            int value;
+            if (z >= 0 && (z & 1) == 0) {
+                value = (topSample(n, i - 1) + topSample(n, i) + 1) >> 1;
+            } else if (z >= 0) {
+                value = (topSample(n, i - 2) + 2 * topSample(n, i - 1) + topSample(n, i) + 2) >> 2;
+            } else if (z == -1) {
+                value = (n.left[0] + 2 * n.topLeft + n.top[0] + 2) >> 2;
+            } else {
+                int j = y - 2 * x;
+                value = (leftSample(n, j - 1) + 2 * leftSample(n, j - 2) + leftSample(n, j - 3) +
+                         2) >>
+                        2;
+            }
+            block[y * stride + x] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+template <int N>
+void predictHorizontalDown(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int z = 2 * y - x;
+            int j = y - (x >> 1);
+            int value;
+            if (z >= 0 && (z & 1) == 0) {
+                value = (leftSample(n, j - 1) + leftSample(n, j) + 1) >> 1;
+            } else if (z >= 0) {
+                value = (leftSample(n, j - 2) + 2 * leftSample(n, j - 1) + leftSample(n, j) + 2) >>
+                        2;
+            } else if (z == -1) {
+                value = (n.left[0] + 2 * n.topLeft + n.top[0] + 2) >> 2;
+            } else {
+                int i = x - 2 * y;
+                value = (topSample(n, i - 1) + 2 * topSample(n, i - 2) + topSample(n, i - 3) + 2) >>
+                        2;
+            }
+            block[y * stride + x] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+template <int N>
+void predictVerticalLeft(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int i = x + (y >> 1);
+            int value;
+            if ((y & 1) == 0) {
+                value = (n.top[i] + n.top[i + 1] + 1) >> 1;
+            } else {
+                value = (n.top[i] + 2 * n.top[i + 1] + n.top[i + 2] + 2) >> 2;
+            }
+            block[y * stride + x] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+template <int N>
+void predictHorizontalUp(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            int z = x + 2 * y;
+            int j = y + (x >> 1);
+            int value;
+            if (z < 2 * N - 3 && (z & 1) == 0) {
+                value = (n.left[j] + n.left[j + 1] + 1) >> 1;
+            } else if (z < 2 * N - 3) {
+                value = (n.left[j] + 2 * n.left[j + 1] + n.left[j + 2] + 2) >> 2;
+            } else if (z == 2 * N - 3) {
+                value = (n.left[N - 2] + 3 * n.left[N - 1] + 2) >> 2;
+            } else {
+                value = n.left[N - 1];
+            }
+            block[y * stride + x] = static_cast<uint8_t>(value);
+        }
+    }
+}
+
+void predictPlane16x16(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    int h = 0, v = 0;
+    for (int i = 0; i < 8; ++i) {
+        h += (i + 1) * (n.top[8 + i] - topSample(n, 6 - i));
+        v += (i + 1) * (n.left[8 + i] - leftSample(n, 6 - i));
+    }
+
+    int a = 16 * (n.left[15] + n.top[15]);
+    int b = (5 * h + 32) >> 6;
+    int c = (5 * v + 32) >> 6;
+    for (int y = 0; y < 16; ++y) {
+        for (int x = 0; x < 16; ++x) {
+            block[y * stride + x] = clip((a + b * (x - 7) + c * (y - 7) + 16) >> 5);
+        }
+    }
+}
+
+const IntraFunctions scalarFunctions = {
+    {predictVertical<4>, predictHorizontal<4>, predictDc<4>, predictDiagonalDownLeft<4>,
+     predictDiagonalDownRight<4>, predictVerticalRight<4>, predictHorizontalDown<4>,
+     predictVerticalLeft<4>, predictHorizontalUp<4>},
+    {predictVertical<8>, predictHorizontal<8>, predictDc<8>, predictDiagonalDownLeft<8>,
+     predictDiagonalDownRight<8>, predictVerticalRight<8>, predictHorizontalDown<8>,
+     predictVerticalLeft<8>, predictHorizontalUp<8>},
+    {predictVertical<16>, predictHorizontal<16>, predictDc<16>, predictPlane16x16},
+};
+
+#ifdef INTRA_HAVE_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// Every sample of a directional mode is a 2-tap average (a + b + 1) >> 1 or a 3-tap average
+// (a + 2b + c + 2) >> 2 of the edge. The edge is laid out as one line,
+//   left[N - 1], left[N - 1], ..., left[0], topLeft, top[0], ..., top[2N - 1], top[2N - 1]
+// with the ends repeated, so that both averages can be computed along it at once and each
+// mode becomes a byte shuffle of them. A sample is described by which average it takes and
+// where its first (2-tap) or centre (3-tap) sample lies on the line
+struct EdgeSource {
+    bool threeTap;
+    int index;
+};
+
+EdgeSource directionalSource(IntraMode mode, int n, int x, int y) {
+    switch (mode) {
+    case IntraMode::DiagonalDownLeft:
+        return {true, n + 3 + x + y};
+    case IntraMode::DiagonalDownRight:
+        return {true, n + 1 + x - y};
+    case IntraMode::VerticalRight: {
+        int z = 2 * x - y;
+        if (z >= 0) {
+            return {(z & 1) != 0, n + 1 + x - (y >> 1)};
+        }
+        return z == -1 ? EdgeSource{true, n + 1} : EdgeSource{true, n + 2 + 2 * x - y};
+    }
+    case IntraMode::HorizontalDown: {
+        int z = 2 * y - x;
+        if (z >= 0) {
+            return (z & 1) == 0 ? EdgeSource{false, n - y + (x >> 1)}
+                                : EdgeSource{true, n - y + (x >> 1) + 1};
+        }
+        return z == -1 ? EdgeSource{true, n + 1} : EdgeSource{true, n + x - 2 * y};
+    }
+    case IntraMode::VerticalLeft:
+        return (y & 1) == 0 ? EdgeSource{false, n + 2 + x + (y >> 1)}
+                            : EdgeSource{true, n + 3 + x + (y >> 1)};
+    case IntraMode::HorizontalUp: {
+        int z = x + 2 * y;
+        if (z < 2 * n - 3) {
+            return {(z & 1) != 0, n - 1 - y - (x >> 1)};
+        }
+        // The repeated left[N - 1] at the start of the line makes these averages exact
+        return z == 2 * n - 3 ? EdgeSource{true, 1} : EdgeSource{false, 0};
+    }
+    default:
+        throw std::runtime_error("not a directional intra mode");
+    }
+}
+
+// Shuffle controls of one directional mode: each output row is gathered from a 16-byte
+// window of the 2-tap [0] and 3-tap [1] averages starting at "base". 4x4 blocks fit in one
+// window, so their whole block is gathered at once in row 0
+struct DirectionalShuffle {
+    int base[8];
+    alignas(16) int8_t control[2][8][16];
+};
+
+constexpr int firstDirectionalMode = static_cast<int>(IntraMode::DiagonalDownLeft);
+constexpr int directionalModeCount = static_cast<int>(intraModeCount) - firstDirectionalMode;
+
+template <int N>
+const DirectionalShuffle &directionalShuffle(IntraMode mode) {
+    static const std::array<DirectionalShuffle, directionalModeCount> shuffles = [] {
+        std::array<DirectionalShuffle, directionalModeCount> result = {};
+        for (int m = 0; m < directionalModeCount; ++m) {
+            IntraMode directional = static_cast<IntraMode>(firstDirectionalMode + m);
+            DirectionalShuffle &shuffle = result[m];
+            std::memset(shuffle.control, 0x80, sizeof(shuffle.control));
+
+            for (int y = 0; y < N; ++y) {
+                int row = N == 4 ? 0 : y;
+                int lane = N == 4 ? y * 4 : 0;
+                if (N != 4) {
+                    shuffle.base[y] = 3 * N;
+                    for (int x = 0; x < N; ++x) {
+                        shuffle.base[y] =
+                            std::min(shuffle.base[y], directionalSource(directional, N, x, y).index);
+                    }
+                }
+                for (int x = 0; x < N; ++x) {
+                    EdgeSource source = directionalSource(directional, N, x, y);
+                    shuffle.control[source.threeTap][row][lane + x] =
+                        static_cast<int8_t>(source.index - shuffle.base[row]);
+                }
+            }
+        }
+        return result;
+    }();
+    return shuffles[static_cast<int>(mode) - firstDirectionalMode];
+}
+
+// Gathers one row of a directional prediction from the 2-tap and 3-tap edge averages
+AVX2_TARGET inline __m128i gatherRow(const uint8_t (*averages)[64], const DirectionalShuffle &shuffle,
+                                     int row) {
+    const uint8_t *twoTap = averages[0] + shuffle.base[row];
+    const uint8_t *threeTap = averages[1] + shuffle.base[row];
+    return _mm_or_si128(
+        _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(twoTap)),
+                         _mm_load_si128(reinterpret_cast<const __m128i *>(shuffle.control[0][row]))),
+        _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(threeTap)),
+                         _mm_load_si128(reinterpret_cast<const __m128i *>(shuffle.control[1][row]))));
+}
+
+template <int N, IntraMode Mode>
+AVX2_TARGET void predictDirectionalAvx2(uint8_t *block, ptrdiff_t stride,
+                                        const IntraNeighbours &n) {
+    // The line starts one byte in, so the sample before each position can be loaded too
+    alignas(32) uint8_t edge[64] = {};
+    uint8_t *line = edge + 1;
+    line[0] = n.left[N - 1];
+    for (int y = 0; y < N; ++y) {
+        line[N - y] = n.left[y];
+    }
+    line[N + 1] = n.topLeft;
+    std::memcpy(line + N + 2, n.top, 2 * N);
+    line[3 * N + 2] = n.top[2 * N - 1];
+
+    __m256i previous = _mm256_load_si256(reinterpret_cast<const __m256i *>(edge));
+    __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(line));
+    __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(line + 1));
+
+    // (a + 2b + c + 2) >> 2 == avg(b, avg(a, c) - ((a ^ c) & 1)) exactly
+    __m256i outer = _mm256_sub_epi8(_mm256_avg_epu8(previous, next),
+                                    _mm256_and_si256(_mm256_xor_si256(previous, next),
+                                                     _mm256_set1_epi8(1)));
+    alignas(32) uint8_t averages[2][64] = {};
+    _mm256_store_si256(reinterpret_cast<__m256i *>(averages[0]), _mm256_avg_epu8(current, next));
+    _mm256_store_si256(reinterpret_cast<__m256i *>(averages[1]), _mm256_avg_epu8(current, outer));
+
+    const DirectionalShuffle &shuffle = directionalShuffle<N>(Mode);
+    if (N == 4) {
+        alignas(16) uint8_t rows[16];
+        _mm_store_si128(reinterpret_cast<__m128i *>(rows), gatherRow(averages, shuffle, 0));
+        for (int y = 0; y < 4; ++y) {
+            std::memcpy(block + y * stride, rows + y * 4, 4);
+        }
+    } else {
+        for (int y = 0; y < N; ++y) {
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(block + y * stride),
+                             gatherRow(averages, shuffle, y));
+        }
+    }
+}
+
+AVX2_TARGET void predictVertical16x16Avx2(uint8_t *block, ptrdiff_t stride,
+                                          const IntraNeighbours &n) {
+    __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(n.top));
+    for (int y = 0; y < 16; ++y) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(block + y * stride), top);
+    }
+}
+
+AVX2_TARGET void predictHorizontal16x16Avx2(uint8_t *block, ptrdiff_t stride,
+                                            const IntraNeighbours &n) {
+    for (int y = 0; y < 16; ++y) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(block + y * stride),
+                         _mm_set1_epi8(static_cast<char>(n.left[y])));
+    }
+}
+
+AVX2_TARGET void predictDc16x16Avx2(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &n) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(n.top)), zero);
+    __m128i left =
+        _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(n.left)), zero);
+    int topSum = _mm_cvtsi128_si32(_mm_add_epi64(top, _mm_unpackhi_epi64(top, top)));
+    int leftSum = _mm_cvtsi128_si32(_mm_add_epi64(left, _mm_unpackhi_epi64(left, left)));
+
+    int dc = 128;
+    if (n.hasTop && n.hasLeft) {
+        dc = (topSum + leftSum + 16) >> 5;
+    } else if (n.hasLeft) {
+        dc = (leftSum + 8) >> 4;
+    } else if (n.hasTop) {
+        dc = (topSum + 8) >> 4;
+    }
+
+    __m128i value = _mm_set1_epi8(static_cast<char>(dc));
+    for (int y = 0; y < 16; ++y) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(block + y * stride), value);
+    }
+}
+
+// Sum of (i + 1) * (after[i] - mirrored[i]) over eight samples
+AVX2_TARGET inline int planeGradient(const uint8_t *after, const uint8_t *mirrored) {
+    __m128i difference = _mm_sub_epi16(
+        _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(after))),
+        _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(mirrored))));
+    __m128i sum = _mm_madd_epi16(difference, _mm_setr_epi16(1, 2, 3, 4, 5, 6, 7, 8));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+AVX2_TARGET void predictPlane16x16Avx2(uint8_t *block, ptrdiff_t stride,
+                                       const IntraNeighbours &n) {
+    // Gradients weigh the differences of edge samples mirrored about the centre
+    alignas(16) uint8_t before[2][8];
+    for (int i = 0; i < 8; ++i) {
+        before[0][i] = static_cast<uint8_t>(topSample(n, 6 - i));
+        before[1][i] = static_cast<uint8_t>(leftSample(n, 6 - i));
+    }
+    int h = planeGradient(n.top + 8, before[0]);
+    int v = planeGradient(n.left + 8, before[1]);
+
+    int a = 16 * (n.left[15] + n.top[15]);
+    int b = (5 * h + 32) >> 6;
+    int c = (5 * v + 32) >> 6;
+
+    // All intermediate values fit in 16 bits
+    __m128i bVector = _mm_set1_epi16(static_cast<int16_t>(b));
+    __m128i start = _mm_set1_epi16(static_cast<int16_t>(a - 7 * b - 7 * c + 16));
+    __m128i left = _mm_add_epi16(start, _mm_mullo_epi16(bVector, _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m128i right = _mm_add_epi16(left, _mm_slli_epi16(bVector, 3));
+    __m128i step = _mm_set1_epi16(static_cast<int16_t>(c));
+    for (int y = 0; y < 16; ++y) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(block + y * stride),
+                         _mm_packus_epi16(_mm_srai_epi16(left, 5), _mm_srai_epi16(right, 5)));
+        left = _mm_add_epi16(left, step);
+        right = _mm_add_epi16(right, step);
+    }
+}
+
+// Vertical, horizontal and DC 4x4/8x8 predictions are plain fills, which the compiler already
+// turns into single stores
+const IntraFunctions avx2Functions = {
+    {predictVertical<4>, predictHorizontal<4>, predictDc<4>,
+     predictDirectionalAvx2<4, IntraMode::DiagonalDownLeft>,
+     predictDirectionalAvx2<4, IntraMode::DiagonalDownRight>,
+     predictDirectionalAvx2<4, IntraMode::VerticalRight>,
+     predictDirectionalAvx2<4, IntraMode::HorizontalDown>,
+     predictDirectionalAvx2<4, IntraMode::VerticalLeft>,
+     predictDirectionalAvx2<4, IntraMode::HorizontalUp>},
+    {predictVertical<8>, predictHorizontal<8>, predictDc<8>,
+     predictDirectionalAvx2<8, IntraMode::DiagonalDownLeft>,
+     predictDirectionalAvx2<8, IntraMode::DiagonalDownRight>,
+     predictDirectionalAvx2<8, IntraMode::VerticalRight>,
+     predictDirectionalAvx2<8, IntraMode::HorizontalDown>,
+     predictDirectionalAvx2<8, IntraMode::VerticalLeft>,
+     predictDirectionalAvx2<8, IntraMode::HorizontalUp>},
+    {predictVertical16x16Avx2, predictHorizontal16x16Avx2, predictDc16x16Avx2,
+     predictPlane16x16Avx2},
+};
+
+#endif
+
+// Tries every available mode of a block and keeps the cheapest
+template <int N>
+IntraDecision decideIntraMode(const IntraPredict *predictors, size_t modeCount,
+                              bool (*available)(int, const IntraNeighbours &),
+                              const uint8_t *source, ptrdiff_t sourceStride,
+                              const IntraNeighbours &neighbours, int predictedMode, int lambda,
+                              uint8_t *prediction, ptrdiff_t predictionStride) {
+    constexpr BlockSize size =
+        N == 4 ? BlockSize::B4x4 : N == 8 ? BlockSize::B8x8 : BlockSize::B16x16;
+    const PixelCompare satd = getPixelFunctions().satd[static_cast<size_t>(size)];
+
+    alignas(16) uint8_t candidate[N * N];
+    IntraDecision best = {-1, 0};
+    for (size_t mode = 0; mode < modeCount; ++mode) {
+        if (!available(static_cast<int>(mode), neighbours)) {
+            continue;
+        }
+
+        predictors[mode](candidate, N, neighbours);
+        int cost = satd(source, sourceStride, candidate, N);
+        if (predictedMode >= 0) {
+            cost += lambda * (static_cast<int>(mode) == predictedMode ? 1 : 4);
+        }
+        if (best.mode < 0 || cost < best.cost) {
+            best = {static_cast<int>(mode), cost};
+        }
+    }
+
+    // DC is always available, so a mode was chosen
+    predictors[best.mode](prediction, predictionStride, neighbours);
+    return best;
+}
+
+bool isAvailable(int mode, const IntraNeighbours &neighbours) {
+    return isIntraModeAvailable(static_cast<IntraMode>(mode), neighbours);
+}
+
+bool isAvailable16x16(int mode, const IntraNeighbours &neighbours) {
+    return isIntra16x16ModeAvailable(static_cast<Intra16x16Mode>(mode), neighbours);
+}
+
+} // namespace
+
+IntraNeighbours gatherIntraNeighbours(const uint8_t *block, ptrdiff_t stride, int size,
+                                      bool hasLeft, bool hasTop, bool hasTopLeft,
+                                      bool hasTopRight) {
+    IntraNeighbours n;
+    std::memset(n.left, 128, sizeof(n.left));
+    std::memset(n.top, 128, sizeof(n.top));
+    n.topLeft = 128;
+    n.hasLeft = hasLeft;
+    n.hasTop = hasTop;
+    n.hasTopLeft = hasTopLeft;
+    n.hasTopRight = hasTopRight && hasTop && size != 16;
+
+    if (hasLeft) {
+        for (int y = 0; y < size; ++y) {
+            n.left[y] = block[y * stride - 1];
+        }
+    }
+    if (hasTop) {
+        const uint8_t *above = block - stride;
+        std::memcpy(n.top, above, size);
+        if (n.hasTopRight) {
+            std::memcpy(n.top + size, above + size, size);
+        } else {
+            std::memset(n.top + size, above[size - 1], size);
+        }
+    }
+    if (hasTopLeft) {
+        n.topLeft = block[-stride - 1];
+    }
+    return n;
+}
+
+IntraNeighbours filterIntra8x8Neighbours(const IntraNeighbours &n) {
+    IntraNeighbours filtered = n;
+
+    if (n.hasTop) {
+        filtered.top[0] = n.hasTopLeft ? (n.topLeft + 2 * n.top[0] + n.top[1] + 2) >> 2
+                                       : (3 * n.top[0] + n.top[1] + 2) >> 2;
+        for (int x = 1; x < 15; ++x) {
+            filtered.top[x] = (n.top[x - 1] + 2 * n.top[x] + n.top[x + 1] + 2) >> 2;
+        }
+        filtered.top[15] = (n.top[14] + 3 * n.top[15] + 2) >> 2;
+    }
+
+    if (n.hasTopLeft) {
+        if (n.hasTop && n.hasLeft) {
+            filtered.topLeft = (n.top[0] + 2 * n.topLeft + n.left[0] + 2) >> 2;
+        } else if (n.hasTop) {
+            filtered.topLeft = (3 * n.topLeft + n.top[0] + 2) >> 2;
+        } else if (n.hasLeft) {
+            filtered.topLeft = (3 * n.topLeft + n.left[0] + 2) >> 2;
+        }
+    }
+
+    if (n.hasLeft) {
+        filtered.left[0] = n.hasTopLeft ? (n.topLeft + 2 * n.left[0] + n.left[1] + 2) >> 2
+                                        : (3 * n.left[0] + n.left[1] + 2) >> 2;
+        for (int y = 1; y < 7; ++y) {
+            filtered.left[y] = (n.left[y - 1] + 2 * n.left[y] + n.left[y + 1] + 2) >> 2;
+        }
+        filtered.left[7] = (n.left[6] + 3 * n.left[7] + 2) >> 2;
+    }
+
+    return filtered;
+}
+
+bool isIntraModeAvailable(IntraMode mode, const IntraNeighbours &n) {
+    switch (mode) {
+    case IntraMode::Vertical:
+    case IntraMode::DiagonalDownLeft:
+    case IntraMode::VerticalLeft:
+        return n.hasTop;
+    case IntraMode::Horizontal:
+    case IntraMode::HorizontalUp:
+        return n.hasLeft;
+    case IntraMode::Dc:
+        return true;
+    case IntraMode::DiagonalDownRight:
+    case IntraMode::VerticalRight:
+    case IntraMode::HorizontalDown:
+        return n.hasTop && n.hasLeft && n.hasTopLeft;
+    }
+    return false;
+}
+
+bool isIntra16x16ModeAvailable(Intra16x16Mode mode, const IntraNeighbours &n) {
+    switch (mode) {
+    case Intra16x16Mode::Vertical:
+        return n.hasTop;
+    case Intra16x16Mode::Horizontal:
+        return n.hasLeft;
+    case Intra16x16Mode::Dc:
+        return true;
+    case Intra16x16Mode::Plane:
+        return n.hasTop && n.hasLeft && n.hasTopLeft;
+    }
+    return false;
+}
+
+const IntraFunctions &getScalarIntraFunctions() {
+    return scalarFunctions;
+}
+
+const IntraFunctions &getIntraFunctions() {
+#ifdef INTRA_HAVE_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return avx2Functions;
+    }
+#endif
+    return scalarFunctions;
+}
+
+IntraDecision decideIntra4x4Mode(const uint8_t *source, ptrdiff_t sourceStride,
+                                 const IntraNeighbours &neighbours, IntraMode predictedMode,
+                                 int lambda, uint8_t *prediction, ptrdiff_t predictionStride) {
+    return decideIntraMode<4>(getIntraFunctions().predict4x4, intraModeCount, isAvailable, source,
+                              sourceStride, neighbours, static_cast<int>(predictedMode), lambda,
+                              prediction, predictionStride);
+}
+
+IntraDecision decideIntra8x8Mode(const uint8_t *source, ptrdiff_t sourceStride,
+                                 const IntraNeighbours &neighbours, IntraMode predictedMode,
+                                 int lambda, uint8_t *prediction, ptrdiff_t predictionStride) {
+    return decideIntraMode<8>(getIntraFunctions().predict8x8, intraModeCount, isAvailable, source,
+                              sourceStride, filterIntra8x8Neighbours(neighbours),
+                              static_cast<int>(predictedMode), lambda, prediction,
+                              predictionStride);
+}
+
+IntraDecision decideIntra16x16Mode(const uint8_t *source, ptrdiff_t sourceStride,
+                                   const IntraNeighbours &neighbours, uint8_t *prediction,
+                                   ptrdiff_t predictionStride) {
+    return decideIntraMode<16>(getIntraFunctions().predict16x16, intra16x16ModeCount,
+                               isAvailable16x16, source, sourceStride, neighbours, -1, 0,
+                               prediction, predictionStride);
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @enum IntraMode
+ * @brief Intra 4x4 and 8x8 prediction modes, numbered as in the H.264 bitstream
+ */
+enum class IntraMode : uint8_t {
+    Vertical,
+    Horizontal,
+    Dc,
+    DiagonalDownLeft,
+    DiagonalDownRight,
+    VerticalRight,
+    HorizontalDown,
+    VerticalLeft,
+    HorizontalUp,
+};
+
+/// @brief Number of IntraMode values
+constexpr size_t intraModeCount = 9;
+
+/**
+ * @enum Intra16x16Mode
+ * @brief Intra 16x16 prediction modes, numbered as in the H.264 bitstream
+ */
+enum class Intra16x16Mode : uint8_t { Vertical, Horizontal, Dc, Plane };
+
+/// @brief Number of Intra16x16Mode values
+constexpr size_t intra16x16ModeCount = 4;
+
+/**
+ * @struct IntraNeighbours
+ * @brief Reconstructed samples bordering a block, from which it is predicted
+ *
+ * Unavailable samples are set to 128. If the top-right samples are unavailable but the top
+ * ones are, the last top sample is repeated in their place, as the standard specifies
+ */
+struct IntraNeighbours {
+    /// @brief Column left of the block, top to bottom
+    uint8_t left[16];
+
+    /// @brief Row above the block followed by the row above-right, left to right
+    uint8_t top[32];
+
+    /// @brief Sample above-left of the block
+    uint8_t topLeft;
+
+    /// @brief Whether the left column is available
+    bool hasLeft;
+
+    /// @brief Whether the row above is available
+    bool hasTop;
+
+    /// @brief Whether the above-left sample is available
+    bool hasTopLeft;
+
+    /// @brief Whether the row above-right is available
+    bool hasTopRight;
+};
+
+/**
+ * @brief Reads the neighbours of a block from the frame being reconstructed
+ * @param block Top-left sample of the block
+ * @param stride Distance between rows in bytes
+ * @param size Width and height of the block (4, 8 or 16)
+ * @param hasLeft Whether the left column is available
+ * @param hasTop Whether the row above is available
+ * @param hasTopLeft Whether the above-left sample is available
+ * @param hasTopRight Whether the row above-right is available (ignored for 16x16 blocks)
+ * @return The neighbours
+ */
+IntraNeighbours gatherIntraNeighbours(const uint8_t *block, ptrdiff_t stride, int size,
+                                      bool hasLeft, bool hasTop, bool hasTopLeft, bool hasTopRight);
+
+/**
+ * @brief Applies the reference sample filter that precedes Intra 8x8 prediction
+ * @param neighbours Neighbours of an 8x8 block as gathered
+ * @return The filtered neighbours, to pass to the 8x8 predictors
+ */
+IntraNeighbours filterIntra8x8Neighbours(const IntraNeighbours &neighbours);
+
+/**
+ * @brief Returns whether the samples an Intra 4x4 or 8x8 mode reads are available
+ */
+bool isIntraModeAvailable(IntraMode mode, const IntraNeighbours &neighbours);
+
+/**
+ * @brief Returns whether the samples an Intra 16x16 mode reads are available
+ */
+bool isIntra16x16ModeAvailable(Intra16x16Mode mode, const IntraNeighbours &neighbours);
+
+/**
+ * @brief Predicts a block from its neighbours
+ * @param block Receives the prediction
+ * @param stride Distance between rows of the prediction in bytes
+ * @param neighbours Neighbours of the block (filtered, for 8x8 blocks)
+ */
+using IntraPredict = void (*)(uint8_t *block, ptrdiff_t stride, const IntraNeighbours &neighbours);
+
+/**
+ * @struct IntraFunctions
+ * @brief Table of intra predictors, indexed by mode
+ */
+struct IntraFunctions {
+    /// @brief Intra 4x4 predictors
+    IntraPredict predict4x4[intraModeCount];
+
+    /// @brief Intra 8x8 predictors
+    IntraPredict predict8x8[intraModeCount];
+
+    /// @brief Intra 16x16 predictors
+    IntraPredict predict16x16[intra16x16ModeCount];
+};
+
+/**
+ * @brief Returns the portable scalar predictors
+ *
+ * These transcribe the formulas of the standard and are the reference the SIMD predictors
+ * must match exactly
+ */
+const IntraFunctions &getScalarIntraFunctions();
+
+/**
+ * @brief Returns the fastest predictors supported by the running CPU
+ */
+const IntraFunctions &getIntraFunctions();
+
+/**
+ * @struct IntraDecision
+ * @brief The mode chosen for a block and its cost
+ */
+struct IntraDecision {
+    /// @brief The chosen mode (an IntraMode or Intra16x16Mode value)
+    int mode;
+
+    /// @brief SATD of the prediction plus the lambda-weighted bits of signalling the mode
+    int cost;
+};
+
+/**
+ * @brief Chooses the Intra 4x4 mode of a block by SATD
+ *
+ * Signalling the predicted mode costs one bit, any other four
+ *
+ * @param source Source block
+ * @param sourceStride Distance between rows of the source in bytes
+ * @param neighbours Neighbours of the block
+ * @param predictedMode Mode predicted from the neighbouring blocks
+ * @param lambda Weight of one bit in SATD units
+ * @param prediction Receives the prediction of the chosen mode
+ * @param predictionStride Distance between rows of the prediction in bytes
+ * @return The decision
+ */
+IntraDecision decideIntra4x4Mode(const uint8_t *source, ptrdiff_t sourceStride,
+                                 const IntraNeighbours &neighbours, IntraMode predictedMode,
+                                 int lambda, uint8_t *prediction, ptrdiff_t predictionStride);
+
+/**
+ * @brief Chooses the Intra 8x8 mode of a block by SATD
+ *
+ * The neighbours are filtered before prediction. Mode signalling is costed as for 4x4 blocks
+ *
+ * @param source Source block
+ * @param sourceStride Distance between rows of the source in bytes
+ * @param neighbours Unfiltered neighbours of the block
+ * @param predictedMode Mode predicted from the neighbouring blocks
+ * @param lambda Weight of one bit in SATD units
+ * @param prediction Receives the prediction of the chosen mode
+ * @param predictionStride Distance between rows of the prediction in bytes
+ * @return The decision
+ */
+IntraDecision decideIntra8x8Mode(const uint8_t *source, ptrdiff_t sourceStride,
+                                 const IntraNeighbours &neighbours, IntraMode predictedMode,
+                                 int lambda, uint8_t *prediction, ptrdiff_t predictionStride);
+
+/**
+ * @brief Chooses the Intra 16x16 mode of a macroblock by SATD
+ *
+ * The mode is part of mb_type, whose length does not depend on it, so no bits are added
+ *
+ * @param source Source macroblock
+ * @param sourceStride Distance between rows of the source in bytes
+ * @param neighbours Neighbours of the macroblock
+ * @param prediction Receives the prediction of the chosen mode
+ * @param predictionStride Distance between rows of the prediction in bytes
+ * @return The decision
+ */
+IntraDecision decideIntra16x16Mode(const uint8_t *source, ptrdiff_t sourceStride,
+                                   const IntraNeighbours &neighbours, uint8_t *prediction,
+                                   ptrdiff_t predictionStride);
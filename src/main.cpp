@@ -1,15 +1,888 @@
 #include "encoder.hpp"
+#include "frame_export_client.hpp"
+#include "golden_harness.hpp"
 #include "logger.hpp"
+#include "metrics_server.hpp"
 #include "renderer.hpp"
+#include "rtp_sender.hpp"
+#include "session_host.hpp"
+#include "software_encoder.hpp"
+#include "trace.hpp"
 #include "window.hpp"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+/**
+ * @struct RunOptions
+ * @brief Command line options of the application
+ */
+struct RunOptions {
+    /// @brief Maximum number of headless sessions. If 0, a single windowed renderer is run
+    uint32_t sessions = 0;
+
+    /// @brief Frames rendered per session at each step of the session sweep, or in total by
+    /// the batch render
+    uint32_t frames = 300;
+
+    /// @brief Worker threads of the session host (0 for one per hardware thread)
+    uint32_t threads = 0;
+
+    /// @brief Maximum number of software encoder threads. If set without sessions, the
+    /// software encoder is benchmarked on its own
+    uint32_t encodeThreads = 0;
+
+    /// @brief Slices per frame of the software encoder
+    uint32_t slices = 8;
+
+    /// @brief UDP port on 127.0.0.1 the encoder benchmark streams RTP to (0 to disable)
+    uint32_t rtpPort = 0;
+
+    /// @brief Percentage of the frame interval RTP packets are paced over (0 to disable)
+    uint32_t rtpPacing = 0;
+
+    /// @brief Frames the encoder quality statistics are averaged and logged over (0 to disable)
+    uint32_t qualityWindow = 0;
+
+    /// @brief Path of the H.264 stream each session of the session sweep writes. The session
+    /// index is added to the file name when there are several
+    std::string outputPath = "session.h264";
+
+    /// @brief Path of the lossless capture of each session (empty to disable). The extension
+    /// selects the format: .y4m, .nv12 or .rgba
+    std::string capturePath;
+
+    /// @brief Path of a snapshot taken by the window (empty to disable). The extension selects
+    /// the format: .png or .ppm
+    std::string snapshotPath;
+
+    /// @brief Index of the frame the window snapshots
+    uint32_t snapshotFrame = 60;
+
+    /// @brief Directory of the golden images to compare against (empty to disable)
+    std::string goldenPath;
+
+    /// @brief Whether to write new golden images to goldenPath instead
+    bool goldenUpdate = false;
+
+    /// @brief Frames rendered and compared per golden case
+    uint32_t goldenFrames = 8;
+
+    /// @brief Path of the exported trace (empty to disable). The extension selects the
+    /// format: .json, or .pftrace / .perfetto-trace
+    std::string tracePath;
+
+    /// @brief Frame the trace capture starts at
+    uint32_t traceStart = 0;
+
+    /// @brief Frames captured before the trace is exported (0 to capture until exit)
+    uint32_t traceFrames = 0;
+
+    /// @brief TCP port on 127.0.0.1 the metrics are served on (0 to disable)
+    uint32_t metricsPort = 0;
+
+    /// @brief Path of a Unix socket the metrics are served on instead (empty to disable)
+    std::string metricsSocket;
+
+    /// @brief Whether the window draws every frame rather than idling while the scene is
+    /// unchanged
+    bool continuous = false;
+
+    /// @brief Whether the scene animates, which the window draws continuously
+    bool animate = false;
+
+    /// @brief Path of the H.264 stream the batch render writes (empty to disable)
+    std::string batchPath;
+
+    /// @brief Width of the batch render, in pixels
+    uint32_t width = 1920;
+
+    /// @brief Height of the batch render, in pixels
+    uint32_t height = 1080;
+
+    /// @brief Frame rate of the batch render's and the animation's virtual clocks
+    uint32_t fps = 60;
+
+    /// @brief Segments the batch render codes concurrently (0 for one per hardware thread)
+    uint32_t batchSegments = 0;
+
+    /// @brief Path of the Unix socket each session exports its frames on (empty to disable)
+    std::string exportSocket;
+
+    /// @brief Layout of the exported frames: rgba or nv12
+    std::string exportFormat = "rgba";
+
+    /// @brief Frames in the export ring of each session
+    uint32_t exportSlots = 3;
+
+    /// @brief Whether frames are exported through shared memory even if the device could
+    /// export its memory
+    bool exportShm = false;
+
+    /// @brief Frames exported through each path by the export latency benchmark (0 to disable)
+    uint32_t exportBench = 0;
+
+    /// @brief Size of the procedural texture streamed into the scene (0 to draw it untextured)
+    uint32_t textureSize = 0;
+
+    /// @brief Percentage of the output size the scene is rendered at
+    uint32_t renderScale = 100;
+
+    /// @brief Percentage of the output size dynamic resolution may lower the render size to
+    /// while GPU frames take longer than the frame interval at fps (100 to disable)
+    uint32_t minRenderScale = 100;
+};
+
+/**
+ * @brief Parses the command line
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return The parsed options
+ * @throws std::runtime_error on unknown or malformed arguments
+ */
+static RunOptions parseOptions(int argc, char **argv) {
+    RunOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("missing value for argument " + arg);
+        }
+
+        if (arg == "--output") {
+            options.outputPath = argv[++i];
+            continue;
+        }
+        if (arg == "--capture") {
+            options.capturePath = argv[++i];
+            continue;
+        }
+        if (arg == "--snapshot") {
+            options.snapshotPath = argv[++i];
+            continue;
+        }
+        if (arg == "--trace") {
+            options.tracePath = argv[++i];
+            continue;
+        }
+        if (arg == "--batch") {
+            options.batchPath = argv[++i];
+            continue;
+        }
+        if (arg == "--metrics-socket") {
+            options.metricsSocket = argv[++i];
+            continue;
+        }
+        if (arg == "--export-socket") {
+            options.exportSocket = argv[++i];
+            continue;
+        }
+        if (arg == "--export-format") {
+            options.exportFormat = argv[++i];
+            continue;
+        }
+        if (arg == "--golden" || arg == "--golden-update") {
+            options.goldenPath = argv[++i];
+            options.goldenUpdate = arg == "--golden-update";
+            continue;
+        }
+
+        uint32_t value = static_cast<uint32_t>(std::stoul(argv[++i]));
+        if (arg == "--sessions") {
+            options.sessions = value;
+        } else if (arg == "--frames") {
+            options.frames = value;
+        } else if (arg == "--threads") {
+            options.threads = value;
+        } else if (arg == "--encode-threads") {
+            options.encodeThreads = value;
+        } else if (arg == "--slices") {
+            options.slices = value;
+        } else if (arg == "--rtp-port") {
+            if (value > 65535) {
+                throw std::runtime_error("RTP port must be below 65536");
+            }
+            options.rtpPort = value;
+        } else if (arg == "--rtp-pacing") {
+            options.rtpPacing = value;
+        } else if (arg == "--quality-window") {
+            options.qualityWindow = value;
+        } else if (arg == "--snapshot-frame") {
+            options.snapshotFrame = value;
+        } else if (arg == "--golden-frames") {
+            options.goldenFrames = value;
+        } else if (arg == "--trace-start") {
+            options.traceStart = value;
+        } else if (arg == "--trace-frames") {
+            options.traceFrames = value;
+        } else if (arg == "--continuous") {
+            options.continuous = value != 0;
+        } else if (arg == "--animate") {
+            options.animate = value != 0;
+        } else if (arg == "--width") {
+            options.width = value;
+        } else if (arg == "--height") {
+            options.height = value;
+        } else if (arg == "--fps") {
+            options.fps = value;
+        } else if (arg == "--batch-segments") {
+            options.batchSegments = value;
+        } else if (arg == "--export-slots") {
+            options.exportSlots = value;
+        } else if (arg == "--export-shm") {
+            options.exportShm = value != 0;
+        } else if (arg == "--export-bench") {
+            options.exportBench = value;
+        } else if (arg == "--texture-size") {
+            options.textureSize = value;
+        } else if (arg == "--render-scale") {
+            options.renderScale = value;
+        } else if (arg == "--min-render-scale") {
+            options.minRenderScale = value;
+        } else if (arg == "--metrics-port") {
+            if (value > 65535) {
+                throw std::runtime_error("metrics port must be below 65536");
+            }
+            options.metricsPort = value;
+        } else {
+            throw std::runtime_error("unknown argument " + arg);
+        }
+    }
+
+    return options;
+}
+
+/**
+ * @brief Returns the path of a session's file
+ * @param path Path given on the command line
+ * @param session Index of the session, added to the file name when there are several
+ * @param sessionCount Number of sessions
+ */
+static std::string getSessionPath(const std::string &path, uint32_t session,
+                                  uint32_t sessionCount) {
+    if (sessionCount <= 1) {
+        return path;
+    }
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = path.size();
+    }
+    return path.substr(0, dot) + "_" + std::to_string(session) + path.substr(dot);
+}
+
+/**
+ * @brief Returns the capture options of a session
+ * @param options Command line options, whose capture path must be set
+ * @param session Index of the session, added to the file name when there are several
+ * @param sessionCount Number of sessions
+ * @throws std::runtime_error if the extension names no capture format
+ */
+static RawCaptureConfig getCaptureConfig(const RunOptions &options, uint32_t session,
+                                         uint32_t sessionCount) {
+    const std::string &path = options.capturePath;
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+
+    RawCaptureConfig capture;
+    if (extension == ".y4m") {
+        capture.format = RawCaptureFormat::Y4m;
+    } else if (extension == ".nv12") {
+        capture.format = RawCaptureFormat::Nv12;
+    } else if (extension == ".rgba") {
+        capture.format = RawCaptureFormat::Rgba;
+    } else {
+        throw std::runtime_error("capture path must end in .y4m, .nv12 or .rgba");
+    }
+
+    capture.path = getSessionPath(path, session, sessionCount);
+    return capture;
+}
+
+/**
+ * @brief Returns the frame export options of a session
+ * @param options Command line options, whose export socket must be set
+ * @param session Index of the session, added to the socket name when there are several
+ * @param sessionCount Number of sessions
+ * @throws std::runtime_error if the export format is unknown
+ */
+static FrameExportConfig getExportConfig(const RunOptions &options, uint32_t session,
+                                         uint32_t sessionCount) {
+    FrameExportConfig frameExport;
+    if (options.exportFormat == "rgba") {
+        frameExport.format = FrameExportFormat::Rgba;
+    } else if (options.exportFormat == "nv12") {
+        frameExport.format = FrameExportFormat::Nv12;
+    } else {
+        throw std::runtime_error("export format must be rgba or nv12");
+    }
+    frameExport.slotCount = options.exportSlots;
+    frameExport.forceSharedMemory = options.exportShm;
+
+    frameExport.socketPath = getSessionPath(options.exportSocket, session, sessionCount);
+    return frameExport;
+}
+
+/**
+ * @brief Returns the encoder quality options, if quality measurement is enabled
+ * @param options Command line options
+ */
+static std::optional<QualityConfig> getQualityConfig(const RunOptions &options) {
+    if (options.qualityWindow == 0) {
+        return std::nullopt;
+    }
+    QualityConfig quality;
+    quality.window = options.qualityWindow;
+    return quality;
+}
+
+/**
+ * @brief Returns the tracer options
+ * @param options Command line options, whose trace path must be set
+ * @throws std::runtime_error if the extension names no trace format
+ */
+static TraceConfig getTraceConfig(const RunOptions &options) {
+    const std::string &path = options.tracePath;
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+
+    TraceConfig trace;
+    if (extension == ".json") {
+        trace.format = TraceFormat::Chrome;
+    } else if (extension == ".pftrace" || extension == ".perfetto-trace") {
+        trace.format = TraceFormat::Perfetto;
+    } else {
+        throw std::runtime_error("trace path must end in .json, .pftrace or .perfetto-trace");
+    }
+
+    trace.path = path;
+    trace.startFrame = options.traceStart;
+    trace.frameCount = options.traceFrames;
+    return trace;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Starts or stops the trace capture on SIGUSR1
+ */
+static void handleTraceSignal(int) {
+    Tracer::requestToggle();
+}
+#endif
+
+/**
+ * @brief Creates a session host that spreads its sessions across every suitable device, or
+ * keeps them on one shared context if a device is selected
+ * @param context Context of the selected device, or null to place the sessions
+ * @param config Renderer configuration, whose context options are used
+ * @param options Command line options
+ * @param placement Counts the streams on each device, and must outlive the host
+ */
+static std::unique_ptr<SessionHost> createSessionHost(std::shared_ptr<VulkanContext> context,
+                                                      const RendererConfig &config,
+                                                      const RunOptions &options,
+                                                      DevicePlacement &placement) {
+    if (context) {
+        return std::make_unique<SessionHost>(context, options.threads, options.encodeThreads);
+    }
+    return std::make_unique<SessionHost>(config.context, placement, options.threads,
+                                         options.encodeThreads);
+}
+
+/**
+ * @brief Returns the shared context of the device selected by the configuration, or null if
+ * no device is selected and sessions are placed across devices
+ */
+static std::shared_ptr<VulkanContext> getSelectedContext(const RendererConfig &config) {
+    const DeviceSelection &device = config.context.device;
+    if (!device.index.has_value() && !device.uuid.has_value()) {
+        return nullptr;
+    }
+    return std::make_shared<VulkanContext>(nullptr, config.context);
+}
+
+/**
+ * @brief Renders and encodes headless sessions and reports how throughput scales
+ *
+ * The number of sessions doubles from 1 up to the requested maximum. Sessions are spread
+ * across every suitable device, sharing one context per device, unless a device is selected.
+ * Every session encodes its frames into a file of its own, overwritten at each step. Each
+ * step logs the streams placed on each device and reports the total frames per second
+ * and the per-stream frame step latency
+ *
+ * @param config Renderer configuration applied to every session
+ * @param options Command line options
+ */
+static void runSessionSweep(const RendererConfig &config, const RunOptions &options) {
+    std::shared_ptr<VulkanContext> context = getSelectedContext(config);
+    DevicePlacement placement;
+
+    std::vector<uint32_t> steps;
+    for (uint32_t n = 1; n < options.sessions; n *= 2) {
+        steps.push_back(n);
+    }
+    steps.push_back(options.sessions);
+
+    for (uint32_t sessionCount : steps) {
+        std::unique_ptr<SessionHost> host = createSessionHost(context, config, options, placement);
+        for (uint32_t i = 0; i < sessionCount; ++i) {
+            SessionConfig sessionConfig;
+            sessionConfig.renderer = config;
+            sessionConfig.outputPath = getSessionPath(options.outputPath, i, sessionCount);
+            sessionConfig.softwareEncoder.slices = options.slices;
+            sessionConfig.softwareEncoder.quality = getQualityConfig(options);
+            if (!options.capturePath.empty()) {
+                sessionConfig.capture = getCaptureConfig(options, i, sessionCount);
+            }
+            if (!options.exportSocket.empty()) {
+                sessionConfig.renderer.frameExport = getExportConfig(options, i, sessionCount);
+            }
+            host->addSession(sessionConfig);
+        }
+        placement.logLoad();
+
+        HostStats stats = host->run(options.frames);
+
+        double meanLatency = 0.0;
+        double p99Latency = 0.0;
+        for (const SessionStats &session : stats.sessions) {
+            meanLatency += session.meanLatencyMs / stats.sessions.size();
+            p99Latency = std::max(p99Latency, session.p99LatencyMs);
+        }
+
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2) << "sessions = " << sessionCount
+               << ", total fps = " << stats.totalFps
+               << ", fps per stream = " << stats.totalFps / sessionCount
+               << ", mean step latency = " << meanLatency << " ms"
+               << ", worst p99 step latency = " << p99Latency << " ms";
+        LOG_INFO(report.str());
+    }
+}
+
+/**
+ * @brief Renders and encodes a clip headless as fast as the device allows
+ *
+ * Frame i of the clip is stamped i / fps on a virtual clock, so the stream's timing does not
+ * depend on how fast it was made. The clip is cut at IDR frames into segments, which are
+ * rendered and coded concurrently as sessions of one host, keeping the GPU, the readback and
+ * the encoder threads busy. Segments are spread across every suitable device unless a device
+ * is selected. Each segment starts with an IDR frame and its parameter sets, so
+ * the segments are joined into one stream by concatenation. Reports the wall time and the
+ * speed-up over realtime
+ *
+ * @param config Renderer configuration, whose size is replaced by the batch's
+ * @param options Command line options, whose batch path must be set
+ * @throws std::runtime_error if the options are invalid, or a segment is empty or cannot be
+ * joined
+ */
+static void runBatch(const RendererConfig &config, const RunOptions &options) {
+    if (options.frames == 0 || options.width == 0 || options.height == 0 || options.fps == 0) {
+        throw std::runtime_error("batch frames, width, height and fps must not be zero");
+    }
+
+    SessionConfig sessionConfig;
+    sessionConfig.renderer = config;
+    sessionConfig.renderer.width = options.width;
+    sessionConfig.renderer.height = options.height;
+    sessionConfig.rateControl.frameRateNumerator = options.fps;
+    sessionConfig.rateControl.frameRateDenominator = 1;
+    sessionConfig.softwareEncoder.slices = options.slices;
+    sessionConfig.softwareEncoder.quality = getQualityConfig(options);
+
+    // Segments hold whole IDR periods of the software encoder, which codes every session, so
+    // the joined stream has the GOPs of a single encoder
+    uint32_t idrPeriod = std::max(sessionConfig.softwareEncoder.idrPeriod, 1u);
+    uint32_t periodCount = (options.frames + idrPeriod - 1) / idrPeriod;
+    uint32_t segmentCount = options.batchSegments != 0
+                                ? options.batchSegments
+                                : std::max(std::thread::hardware_concurrency(), 1u);
+    segmentCount = std::min(segmentCount, periodCount);
+
+    std::vector<uint32_t> frameCounts;
+    std::vector<std::string> segmentPaths;
+    DevicePlacement placement;
+    HostStats stats;
+    {
+        std::unique_ptr<SessionHost> host =
+            createSessionHost(getSelectedContext(config), config, options, placement);
+        for (uint32_t segment = 0; segment < segmentCount; ++segment) {
+            uint32_t first = segment * periodCount / segmentCount * idrPeriod;
+            uint32_t last = std::min((segment + 1) * periodCount / segmentCount * idrPeriod,
+                                     options.frames);
+            frameCounts.push_back(last - first);
+            segmentPaths.push_back(options.batchPath + ".part" + std::to_string(segment));
+
+            sessionConfig.outputPath = segmentPaths.back();
+            sessionConfig.renderer.animationStart = first;
+            host->addSession(sessionConfig);
+        }
+
+        stats = host->run(frameCounts);
+
+        // Destroying the host drains the encoders, which completes the segment files
+    }
+
+    std::ofstream output(options.batchPath, std::ios::binary | std::ios::trunc);
+    for (const std::string &path : segmentPaths) {
+        std::ifstream segment(path, std::ios::binary);
+        if (!segment) {
+            throw std::runtime_error("failed to join batch segment " + path);
+        }
+
+        // An empty segment would leave a hole in the clip that no decoder reports
+        if (segment.peek() == std::ifstream::traits_type::eof()) {
+            throw std::runtime_error("batch segment " + path + " has no coded frames");
+        }
+        if (!(output << segment.rdbuf())) {
+            throw std::runtime_error("failed to join batch segment " + path);
+        }
+        segment.close();
+        std::remove(path.c_str());
+    }
+    if (!output.flush()) {
+        throw std::runtime_error("failed to write " + options.batchPath);
+    }
+
+    double clipSeconds = static_cast<double>(options.frames) / options.fps;
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2) << "batch: " << options.frames << " frames at "
+           << options.width << "x" << options.height << ", " << clipSeconds << " s of video in "
+           << stats.seconds << " s wall time (" << segmentCount << " segments)"
+           << ", fps = " << stats.totalFps << ", speed-up over realtime = "
+           << clipSeconds / stats.seconds << "x";
+    LOG_INFO(report.str());
+}
+
+/**
+ * @struct ExportLatency
+ * @brief What the export benchmark's consumer saw of the frames
+ */
+struct ExportLatency {
+    /// @brief Time from submission until each frame was ready, in milliseconds
+    std::vector<double> latenciesMs;
+
+    /// @brief Frames replaced before they could be used
+    uint32_t overwritten = 0;
+};
+
+/**
+ * @brief Imports an exported timeline semaphore into a device
+ * @param device The device
+ * @param fd The semaphore's file descriptor, which the caller keeps
+ * @throws std::runtime_error if the semaphore cannot be imported
+ */
+static VkSemaphore importTimeline(VkDevice device, int fd) {
+#ifdef _WIN32
+    (void)device;
+    (void)fd;
+    throw std::runtime_error("frame export is not supported on Windows");
+#else
+    auto importSemaphoreFd = reinterpret_cast<PFN_vkImportSemaphoreFdKHR>(
+        vkGetDeviceProcAddr(device, "vkImportSemaphoreFdKHR"));
+
+    VkSemaphoreTypeCreateInfo typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    VkSemaphore timeline;
+    if (importSemaphoreFd == nullptr ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create a semaphore to import the timeline into");
+    }
+
+    // A successful import takes ownership of the fd, so a duplicate is imported
+    VkImportSemaphoreFdInfoKHR importInfo = {};
+    importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+    importInfo.semaphore = timeline;
+    importInfo.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+    importInfo.fd = dup(fd);
+    if (importInfo.fd < 0 || importSemaphoreFd(device, &importInfo) != VK_SUCCESS) {
+        if (importInfo.fd >= 0) {
+            close(importInfo.fd);
+        }
+        vkDestroySemaphore(device, timeline, nullptr);
+        throw std::runtime_error("failed to import the exported timeline semaphore");
+    }
+    return timeline;
+#endif
+}
+
+/**
+ * @brief Uses exported frames the way a consumer process would, until the producer goes away
+ *
+ * A frame in device memory is ready once the exported timeline semaphore, imported into the
+ * producer's device, reaches its number. A frame in shared memory is ready once it has been
+ * copied out of the ring
+ *
+ * @param client Connection to the producer
+ * @param device Device the timeline semaphore is imported into (DeviceMemory)
+ * @throws std::runtime_error if the timeline semaphore cannot be imported
+ */
+static ExportLatency consumeExportedFrames(FrameExportClient &client, VkDevice device) {
+    const FrameExportDescriptor &descriptor = client.getDescriptor();
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    if (descriptor.transport == FrameExportTransport::DeviceMemory) {
+        timeline = importTimeline(device, client.getTimelineFd());
+    }
+
+    ExportLatency latency;
+    std::vector<uint8_t> pixels;
+    uint64_t frame;
+    while (client.receive(frame)) {
+        const FrameExportSlot &slot = client.getControl().slots[frame % descriptor.slotCount];
+        bool ready;
+        if (timeline != VK_NULL_HANDLE) {
+            VkSemaphoreWaitInfo waitInfo = {};
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &timeline;
+            waitInfo.pValues = &frame;
+            ready = vkWaitSemaphores(device, &waitInfo, 1000000000ull) == VK_SUCCESS;
+        } else {
+            ready = client.readSharedFrame(frame, pixels);
+        }
+        uint64_t readyTime = Tracer::now();
+        if (!ready || slot.frame.load(std::memory_order_acquire) != frame) {
+            ++latency.overwritten;
+            continue;
+        }
+        latency.latenciesMs.push_back(
+            (readyTime - slot.submitTime.load(std::memory_order_relaxed)) / 1e6);
+    }
+
+    if (timeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, timeline, nullptr);
+    }
+    return latency;
+}
+
+/**
+ * @brief Compares the latency of frames exported in device memory with frames copied through
+ * shared memory
+ *
+ * A headless renderer exports its frames once through each path, the device memory path only
+ * if the device can export its memory. Frames are drawn at "--fps", so that the latency does
+ * not include a backlog of queued frames, and a consumer thread connected to the export socket
+ * uses each frame as frame_consumer would. Reports the latency from submission until a frame
+ * is ready for each path, and how much of it the copy adds
+ *
+ * @param config Renderer configuration, whose context and size options are used
+ * @param options Command line options
+ * @throws std::runtime_error if the export format is unknown, or the frames cannot be exported
+ */
+static void runExportBenchmark(const RendererConfig &config, const RunOptions &options) {
+    auto context = std::make_shared<VulkanContext>(nullptr, config.context);
+    auto frameInterval = std::chrono::nanoseconds(1000000000ull / std::max(options.fps, 1u));
+
+    RendererConfig rendererConfig = config;
+    rendererConfig.frameExport = getExportConfig(options, 0, 1);
+    if (options.exportSocket.empty()) {
+        rendererConfig.frameExport->socketPath = "/tmp/vulkantest-export-bench.sock";
+    }
+
+    std::optional<double> deviceP50;
+    for (bool forceSharedMemory : {false, true}) {
+        rendererConfig.frameExport->forceSharedMemory = forceSharedMemory;
+        std::optional<VulkanRenderer> renderer;
+        renderer.emplace(context, rendererConfig);
+        FrameExportClient client(rendererConfig.frameExport->socketPath);
+        bool device = client.getDescriptor().transport == FrameExportTransport::DeviceMemory;
+        if (!forceSharedMemory && !device) {
+            LOG_WARN("Frames cannot be exported in device memory; only the copy is measured");
+            continue;
+        }
+
+        ExportLatency latency;
+        std::exception_ptr consumerError;
+        std::thread consumer([&] {
+            try {
+                latency = consumeExportedFrames(client, context->getDevice());
+            } catch (...) {
+                consumerError = std::current_exception();
+            }
+        });
+        try {
+            auto nextFrame = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < options.exportBench; ++i) {
+                renderer->drawFrame();
+                nextFrame += frameInterval;
+                std::this_thread::sleep_until(nextFrame);
+            }
+            renderer->waitForFrames();
+        } catch (...) {
+            renderer.reset();
+            consumer.join();
+            throw;
+        }
+        // Destroying the renderer closes the socket, which ends the consumer
+        renderer.reset();
+        consumer.join();
+        if (consumerError) {
+            std::rethrow_exception(consumerError);
+        }
+
+        std::vector<double> &sorted = latency.latenciesMs;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) {
+            size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+            return sorted.empty() ? 0.0 : sorted[index];
+        };
+        double mean = 0.0;
+        for (double value : sorted) {
+            mean += value / sorted.size();
+        }
+        if (device) {
+            deviceP50 = percentile(0.5);
+        }
+
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(3)
+               << "export = " << (device ? "device memory" : "shared memory copy")
+               << ", frames = " << sorted.size() << ", overwritten = " << latency.overwritten
+               << ", submit to ready: mean = " << mean << " ms, p50 = " << percentile(0.5)
+               << " ms, p99 = " << percentile(0.99) << " ms, max = " << percentile(1.0)
+               << " ms";
+        LOG_INFO(report.str());
+        if (!device && deviceP50) {
+            std::ostringstream comparison;
+            comparison << std::fixed << std::setprecision(3)
+                       << "the shared memory copy adds " << percentile(0.5) - *deviceP50
+                       << " ms at p50 over device memory export";
+            LOG_INFO(comparison.str());
+        }
+    }
+}
+
+/**
+ * @brief Fills a frame with a synthetic picture that pans and changes brightness over time
+ * @param frame The frame to fill, allocated for the picture size
+ * @param index Index of the frame, which sets the motion
+ */
+static void fillSyntheticFrame(YuvFrame &frame, uint32_t index) {
+    for (int plane = 0; plane < 3; ++plane) {
+        uint32_t shift = plane == 0 ? 0 : 1;
+        uint32_t width = frame.width >> shift;
+        uint32_t height = frame.height >> shift;
+        uint32_t pan = (index * 3) >> shift;
+        size_t stride = frame.stride(plane);
+        uint8_t *row = frame.planes[plane].data();
+
+        for (uint32_t y = 0; y < height; ++y, row += stride) {
+            for (uint32_t x = 0; x < width; ++x) {
+                uint32_t u = x + pan;
+                uint32_t v = y + (pan >> 1);
+                uint32_t value = plane == 0 ? 16 + ((u + v) >> 3) % 128 + (((u ^ v) >> 4) & 1) * 64
+                                            : 64 * plane + ((u >> 2) + (v >> 3)) % 64;
+                row[x] = static_cast<uint8_t>(value);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Runs the software encoder on synthetic 1080p content and reports how it scales
+ *
+ * The number of encoder threads doubles from 1 up to the requested maximum (at most 32).
+ * Each step reports the frames coded per second and the size of the stream
+ *
+ * @param options Command line options
+ */
+static void runEncoderSweep(const RunOptions &options) {
+    SoftwareEncoderConfig config;
+    config.width = 1920;
+    config.height = 1080;
+    config.slices = options.slices;
+    config.quality = getQualityConfig(options);
+
+    // A short cycle of source frames keeps frame generation out of the measurement
+    const uint32_t sourceCount = 16;
+    std::vector<YuvFrame> sources(sourceCount);
+    for (uint32_t i = 0; i < sourceCount; ++i) {
+        sources[i].allocate(config.width, config.height);
+        fillSyntheticFrame(sources[i], i);
+    }
+
+    uint32_t maxThreads = std::min<uint32_t>(options.encodeThreads, 32);
+    std::vector<uint32_t> steps;
+    for (uint32_t n = 1; n < maxThreads; n *= 2) {
+        steps.push_back(n);
+    }
+    steps.push_back(maxThreads);
+
+    for (uint32_t threadCount : steps) {
+        ThreadPool pool(threadCount);
+        std::unique_ptr<RtpSender> sender;
+        if (options.rtpPort != 0) {
+            RtpSenderConfig rtpConfig;
+            rtpConfig.port = static_cast<uint16_t>(options.rtpPort);
+            rtpConfig.pacing = options.rtpPacing / 100.0;
+            sender = std::make_unique<RtpSender>(rtpConfig);
+        }
+
+        HostBitstreamRing ring(static_cast<size_t>(config.width) * config.height);
+        size_t bytes = 0;
+        auto countBytes = [&bytes, &ring, &sender](const EncodedFrame &frame) {
+            bytes += frame.view.size;
+            if (sender) {
+                sender->send(frame);
+            }
+            ring.release(frame.view);
+        };
+        SoftwareEncoder encoder(config, RateControlConfig(), pool, countBytes, &ring);
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < options.frames; ++i) {
+            Tracer::markFrame();
+            encoder.encodeFrame(sources[i % sourceCount]);
+        }
+        encoder.flush();
+        double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2) << "encoder threads = " << threadCount
+               << ", slices = " << encoder.getSliceCount()
+               << ", fps = " << options.frames / seconds
+               << ", mean frame size = " << bytes / 1024.0 / options.frames << " KiB";
+        LOG_INFO(report.str());
+    }
+}
 
 /**
  * @brief Entry point for the VulkanTest application
  *
  * This function initialises the renderer and window,
- * enters the main event loop, and handles basic error reporting
+ * enters the main event loop, and handles basic error reporting.
+ * With "--sessions N", headless sessions are benchmarked instead, each encoding into a file named
+ * after "--output PATH", and with "--encode-threads N" alone, the software encoder. "--golden DIR"
+ * compares headless frames against the golden images in DIR, and "--golden-update DIR" writes new
+ * ones. "--trace PATH" exports a timeline of the frames selected by "--trace-start" and
+ * "--trace-frames", and SIGUSR1 starts or stops a capture. "--metrics-port N" and "--metrics-socket
+ * PATH" serve Prometheus metrics while any of these run. "--batch PATH" renders "--frames" frames
+ * of "--width" x "--height" at "--fps" into an H.264 stream as fast as possible. "--export-socket
+ * PATH" shares the frames of every session with other processes. "--export-bench N" compares the
+ * latency of N frames exported in device memory with the shared memory copy. "--animate 1" moves
+ * the camera and scene and adds per-pixel noise on a virtual clock of "--fps" frames per second.
+ * "--texture-size N" streams an N x N texture into the scene.
+ * "--render-scale P" renders the scene at P% of the output size, and "--min-render-scale P" lets
+ * dynamic resolution lower it to P% while GPU frames overrun the frame interval
  */
-int main() {
+int main(int argc, char **argv) {
 // Print the current build mode to the console
 #ifdef NDEBUG
     LOG_INFO("Mode: release");
@@ -18,17 +891,98 @@ int main() {
 #endif
 
     try {
+        RunOptions options = parseOptions(argc, argv);
+
+        // Select a specific GPU by index or UUID, if configured
+        RendererConfig config;
+        config.context.device = getEnvironmentDeviceSelection();
+        config.animate = options.animate;
+        config.animationRate = options.fps;
+        config.textureSize = options.textureSize;
+        config.renderScale = options.renderScale / 100.0f;
+        config.minRenderScale = options.minRenderScale / 100.0f;
+        config.gpuFrameBudgetMs = 1000.0 / std::max(options.fps, 1u);
+
+        if (!options.tracePath.empty()) {
+            Tracer::configure(getTraceConfig(options));
+#ifndef _WIN32
+            std::signal(SIGUSR1, handleTraceSignal);
+#endif
+        }
+
+        // Served until main returns, so the whole run can be scraped
+        std::optional<MetricsServer> metricsServer;
+        if (options.metricsPort != 0 || !options.metricsSocket.empty()) {
+            MetricsServerConfig metrics;
+            metrics.port = static_cast<uint16_t>(options.metricsPort);
+            metrics.socketPath = options.metricsSocket;
+            metricsServer.emplace(MetricsRegistry::getDefault(), metrics);
+        }
+
+        if (!options.goldenPath.empty()) {
+            GoldenConfig golden;
+            golden.directory = options.goldenPath;
+            golden.framesPerCase = options.goldenFrames;
+            golden.update = options.goldenUpdate;
+            golden.context = config.context;
+            GoldenHarness harness(golden);
+            bool passed = harness.run().passed();
+            Tracer::finish();
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (!options.batchPath.empty()) {
+            runBatch(config, options);
+            Tracer::finish();
+            return EXIT_SUCCESS;
+        }
+
+        if (options.exportBench > 0) {
+            runExportBenchmark(config, options);
+            Tracer::finish();
+            return EXIT_SUCCESS;
+        }
+
+        if (options.sessions > 0) {
+            runSessionSweep(config, options);
+            Tracer::finish();
+            return EXIT_SUCCESS;
+        }
+
+        if (options.encodeThreads > 0) {
+            runEncoderSweep(options);
+            Tracer::finish();
+            return EXIT_SUCCESS;
+        }
+
         // Create the Vulkan renderer and window
         VulkanWindow window = VulkanWindow();
-        VulkanRenderer renderer = VulkanRenderer(&window);
+        VulkanRenderer renderer = VulkanRenderer(&window, config);
 
-        // Show the window and start the event loop
-        window.pollEvents([&]() { renderer.drawFrame(); });
+        // Show the window and start the event loop. Frames are drawn on a render thread, which
+        // idles once a static scene is on screen unless a snapshot or trace is waiting
+        uint32_t frame = 0;
+        WindowCallbacks callbacks;
+        callbacks.draw = [&]() {
+            if (frame++ == options.snapshotFrame && !options.snapshotPath.empty()) {
+                renderer.requestSnapshot(options.snapshotPath);
+            }
+            renderer.drawFrame();
+        };
+        callbacks.resize = [&](uint32_t, uint32_t) { renderer.notifyResize(); };
+        callbacks.isAnimating = [&]() {
+            return options.continuous || options.animate || !options.tracePath.empty() ||
+                   (!options.snapshotPath.empty() && frame <= options.snapshotFrame);
+        };
+        window.runEventLoop(callbacks);
 
         renderer.waitForLogicalDevices();
+        renderer.waitForFrames();
+        Tracer::finish();
     } catch (std::exception &e) {
-        // Print any exception message and exit with failure
+        // Print any exception message and exit with failure, keeping the trace leading to it
         LOG_ERROR(e.what());
+        Tracer::finish();
         return EXIT_FAILURE;
     }
 
@@ -0,0 +1,235 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+/**
+ * @brief Formats a sample value as Prometheus expects, including +Inf, -Inf and NaN
+ *
+ * Uses the fewest significant digits that read back as the same value, so bucket bounds such
+ * as 0.1 print as written rather than as 0.10000000000000001
+ */
+std::string formatValue(double value) {
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    char text[32];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    return std::string(text, result.ptr);
+}
+
+/**
+ * @brief Escapes a label value ("\\", "\"" and newlines) or, without quotes, a help text
+ */
+std::string escape(const std::string &text, bool quotes) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '\\') {
+            escaped += "\\\\";
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else if (c == '"' && quotes) {
+            escaped += "\\\"";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Formats a label set, with an optional extra label such as a histogram's "le"
+ */
+std::string formatLabels(const MetricLabels &labels, const char *extraName = nullptr,
+                         const std::string &extraValue = "") {
+    if (labels.empty() && extraName == nullptr) {
+        return "";
+    }
+    std::string text = "{";
+    for (const auto &[name, value] : labels) {
+        text += name + "=\"" + escape(value, true) + "\",";
+    }
+    if (extraName != nullptr) {
+        text += std::string(extraName) + "=\"" + extraValue + "\",";
+    }
+    text.back() = '}';
+    return text;
+}
+
+} // namespace
+
+void Gauge::add(double amount) {
+    double current = value.load(std::memory_order_relaxed);
+    while (!value.compare_exchange_weak(current, current + amount, std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds(std::move(bounds)), counts(new std::atomic<uint64_t>[this->bounds.size() + 1]) {
+    if (!std::is_sorted(this->bounds.begin(), this->bounds.end())) {
+        throw std::runtime_error("histogram bounds must be in increasing order");
+    }
+    for (size_t i = 0; i <= this->bounds.size(); ++i) {
+        counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::observe(double value) {
+    size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.add(value);
+}
+
+const std::vector<double> &Histogram::getBounds() const {
+    return bounds;
+}
+
+std::vector<uint64_t> Histogram::getCounts() const {
+    std::vector<uint64_t> values(bounds.size() + 1);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = counts[i].load(std::memory_order_relaxed);
+    }
+    return values;
+}
+
+double Histogram::getSum() const {
+    return sum.get();
+}
+
+MetricsRegistry &MetricsRegistry::getDefault() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+Counter &MetricsRegistry::getCounter(const std::string &name, const std::string &help,
+                                     const MetricLabels &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series &series = getSeries(name, help, MetricType::Counter, labels);
+    if (!series.counter) {
+        series.counter = std::make_unique<Counter>();
+    }
+    return *series.counter;
+}
+
+Gauge &MetricsRegistry::getGauge(const std::string &name, const std::string &help,
+                                 const MetricLabels &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series &series = getSeries(name, help, MetricType::Gauge, labels);
+    if (series.callback) {
+        throw std::runtime_error("metric " + name + " is read by a callback");
+    }
+    if (!series.gauge) {
+        series.gauge = std::make_unique<Gauge>();
+    }
+    return *series.gauge;
+}
+
+Histogram &MetricsRegistry::getHistogram(const std::string &name, const std::string &help,
+                                         const MetricLabels &labels,
+                                         const std::vector<double> &bounds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series &series = getSeries(name, help, MetricType::Histogram, labels);
+    if (!series.histogram) {
+        series.histogram = std::make_unique<Histogram>(bounds);
+    }
+    return *series.histogram;
+}
+
+uint64_t MetricsRegistry::addCallback(const std::string &name, const std::string &help,
+                                      const MetricLabels &labels, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Series &series = getSeries(name, help, MetricType::Gauge, labels);
+    if (series.gauge) {
+        throw std::runtime_error("metric " + name + " is already a gauge");
+    }
+    series.callback = std::move(read);
+    series.callbackId = nextCallbackId++;
+    return series.callbackId;
+}
+
+void MetricsRegistry::removeCallback(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto family = families.begin(); family != families.end(); ++family) {
+        std::vector<Series> &series = family->second.series;
+        auto found = std::find_if(series.begin(), series.end(),
+                                  [id](const Series &entry) { return entry.callbackId == id; });
+        if (found == series.end()) {
+            continue;
+        }
+        series.erase(found);
+        if (series.empty()) {
+            families.erase(family);
+        }
+        return;
+    }
+}
+
+std::string MetricsRegistry::expose() const {
+    static const char *typeNames[] = {"counter", "gauge", "histogram"};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string text;
+    for (const auto &[name, family] : families) {
+        text += "# HELP " + name + " " + escape(family.help, false) + "\n";
+        text += "# TYPE " + name + " " + typeNames[static_cast<int>(family.type)] + "\n";
+
+        for (const Series &series : family.series) {
+            if (series.counter) {
+                text += name + formatLabels(series.labels) + " " +
+                        std::to_string(series.counter->get()) + "\n";
+            } else if (series.gauge || series.callback) {
+                double value = series.gauge ? series.gauge->get() : series.callback();
+                text += name + formatLabels(series.labels) + " " + formatValue(value) + "\n";
+            } else if (series.histogram) {
+                // Buckets are exposed cumulatively, and the count is that of the +Inf bucket
+                const std::vector<double> &bounds = series.histogram->getBounds();
+                std::vector<uint64_t> counts = series.histogram->getCounts();
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < counts.size(); ++i) {
+                    cumulative += counts[i];
+                    std::string bound = i < bounds.size() ? formatValue(bounds[i]) : "+Inf";
+                    text += name + "_bucket" + formatLabels(series.labels, "le", bound) + " " +
+                            std::to_string(cumulative) + "\n";
+                }
+                text += name + "_sum" + formatLabels(series.labels) + " " +
+                        formatValue(series.histogram->getSum()) + "\n";
+                text += name + "_count" + formatLabels(series.labels) + " " +
+                        std::to_string(cumulative) + "\n";
+            }
+        }
+    }
+    return text;
+}
+
+std::vector<double> MetricsRegistry::getLatencyBounds() {
+    return {0.00025, 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.133, 0.25,
+            0.5,     1.0};
+}
+
+MetricsRegistry::Series &MetricsRegistry::getSeries(const std::string &name,
+                                                    const std::string &help, MetricType type,
+                                                    const MetricLabels &labels) {
+    auto [entry, inserted] = families.try_emplace(name);
+    Family &family = entry->second;
+    if (inserted) {
+        family.help = help;
+        family.type = type;
+    } else if (family.type != type) {
+        throw std::runtime_error("metric " + name + " is registered with another type");
+    }
+
+    for (Series &series : family.series) {
+        if (series.labels == labels) {
+            return series;
+        }
+    }
+    family.series.emplace_back();
+    family.series.back().labels = labels;
+    return family.series.back();
+}
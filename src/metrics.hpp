@@ -0,0 +1,231 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Label names and values of a series, e.g. {{"heap", "0"}}
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @class Counter
+ * @brief A value that only increases, such as frames rendered
+ */
+class Counter {
+  public:
+    /**
+     * @brief Adds to the counter; lock-free
+     */
+    void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the current value
+     */
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+  protected:
+    /// @brief Current value
+    std::atomic<uint64_t> value{0};
+};
+
+/**
+ * @class Gauge
+ * @brief A value that goes up and down, such as a queue depth
+ */
+class Gauge {
+  public:
+    /**
+     * @brief Sets the gauge; lock-free
+     */
+    void set(double amount) { value.store(amount, std::memory_order_relaxed); }
+
+    /**
+     * @brief Adds to the gauge, or subtracts a negative amount; lock-free
+     */
+    void add(double amount);
+
+    /**
+     * @brief Returns the current value
+     */
+    double get() const { return value.load(std::memory_order_relaxed); }
+
+  protected:
+    /// @brief Current value
+    std::atomic<double> value{0.0};
+};
+
+/**
+ * @class Histogram
+ * @brief Counts observations, such as stage times, in buckets of fixed upper bounds
+ */
+class Histogram {
+  public:
+    /**
+     * @param bounds Upper bounds of the buckets in increasing order; a +Inf bucket is added
+     */
+    explicit Histogram(std::vector<double> bounds);
+
+    /**
+     * @brief Adds an observation; lock-free
+     */
+    void observe(double value);
+
+    /**
+     * @brief Returns the upper bounds of the buckets, without the +Inf bucket
+     */
+    const std::vector<double> &getBounds() const;
+
+    /**
+     * @brief Returns the number of observations in each bucket, +Inf last. Counts are not
+     * cumulative
+     */
+    std::vector<uint64_t> getCounts() const;
+
+    /**
+     * @brief Returns the sum of all observations
+     */
+    double getSum() const;
+
+  protected:
+    /// @brief Upper bounds of the buckets, without the +Inf bucket
+    std::vector<double> bounds;
+
+    /// @brief Observations per bucket, one more than there are bounds
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+
+    /// @brief Sum of all observations
+    Gauge sum;
+};
+
+/**
+ * @class MetricsRegistry
+ * @brief Holds the metrics of the process and renders them in the Prometheus text format
+ *
+ * Metrics are looked up by name and labels once, usually when the instrumented object is
+ * created, and updated through the returned reference without locking. Looking up an existing
+ * series returns it, so objects of the same kind share their series. Values that are cheaper to
+ * read when scraped, like device memory usage, are registered as callbacks instead.
+ */
+class MetricsRegistry {
+  public:
+    /**
+     * @brief Returns the registry of the process, which the built-in metrics are added to
+     */
+    static MetricsRegistry &getDefault();
+
+    /**
+     * @brief Returns the counter of a series, creating it on first use
+     * @param name Metric name, by convention ending in "_total"
+     * @param help Description of the metric
+     * @param labels Labels of the series
+     * @throws std::runtime_error if the name is registered with another type
+     */
+    Counter &getCounter(const std::string &name, const std::string &help,
+                        const MetricLabels &labels = {});
+
+    /**
+     * @brief Returns the gauge of a series, creating it on first use
+     * @param name Metric name
+     * @param help Description of the metric
+     * @param labels Labels of the series
+     * @throws std::runtime_error if the name is registered with another type
+     */
+    Gauge &getGauge(const std::string &name, const std::string &help,
+                    const MetricLabels &labels = {});
+
+    /**
+     * @brief Returns the histogram of a series, creating it on first use
+     * @param name Metric name, with its unit as suffix (e.g. "_seconds")
+     * @param help Description of the metric
+     * @param labels Labels of the series
+     * @param bounds Upper bounds of the buckets, used when the series is created
+     * @throws std::runtime_error if the name is registered with another type
+     */
+    Histogram &getHistogram(const std::string &name, const std::string &help,
+                            const MetricLabels &labels = {},
+                            const std::vector<double> &bounds = getLatencyBounds());
+
+    /**
+     * @brief Adds a gauge whose value is read when the metrics are scraped
+     *
+     * A callback registered again for the same series replaces the earlier one
+     *
+     * @param name Metric name
+     * @param help Description of the metric
+     * @param labels Labels of the series
+     * @param read Returns the value. Runs on the scraping thread with the registry locked, so
+     * it must not call into the registry
+     * @return Identifier to pass to removeCallback()
+     * @throws std::runtime_error if the name is registered with another type
+     */
+    uint64_t addCallback(const std::string &name, const std::string &help,
+                         const MetricLabels &labels, std::function<double()> read);
+
+    /**
+     * @brief Removes a callback gauge. Once this returns, the callback is not running and is
+     * not called again
+     */
+    void removeCallback(uint64_t id);
+
+    /**
+     * @brief Renders every metric in the Prometheus text exposition format, version 0.0.4
+     */
+    std::string expose() const;
+
+    /**
+     * @brief Returns bucket bounds for stage times in seconds, from 0.25 ms to 1 s
+     */
+    static std::vector<double> getLatencyBounds();
+
+  protected:
+    /**
+     * @enum MetricType
+     * @brief Type of a metric family
+     */
+    enum class MetricType { Counter, Gauge, Histogram };
+
+    /**
+     * @struct Series
+     * @brief A metric with one set of labels. Exactly one value member is set
+     */
+    struct Series {
+        MetricLabels labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<double()> callback;
+        uint64_t callbackId = 0;
+    };
+
+    /**
+     * @struct Family
+     * @brief The series of one metric name
+     */
+    struct Family {
+        std::string help;
+        MetricType type;
+        std::vector<Series> series;
+    };
+
+    /// @brief Guards families and nextCallbackId
+    mutable std::mutex mutex;
+
+    /// @brief Metric families by name, which keeps the exposition sorted
+    std::map<std::string, Family> families;
+
+    /// @brief Identifier of the next callback
+    uint64_t nextCallbackId = 1;
+
+    /**
+     * @brief Returns the series of a name and labels, creating it if needed. Called with the
+     * mutex held
+     * @throws std::runtime_error if the name is registered with another type
+     */
+    Series &getSeries(const std::string &name, const std::string &help, MetricType type,
+                      const MetricLabels &labels);
+};
@@ -0,0 +1,211 @@
+#include "metrics_server.hpp"
+#include "logger.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+    #include <arpa/inet.h>
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+/// @brief Largest request accepted; scrapers send a few hundred bytes
+constexpr size_t maxRequestSize = 8192;
+
+#ifndef _WIN32
+/**
+ * @brief Sends a whole buffer, returning false if the peer went away
+ */
+bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+    return true;
+}
+#endif
+
+std::string formatResponse(const std::string &status, const std::string &contentType,
+                           const std::string &body, bool includeBody) {
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType +
+           "\r\nContent-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + (includeBody ? body : "");
+}
+
+} // namespace
+
+MetricsServer::MetricsServer(MetricsRegistry &registry, const MetricsServerConfig &config)
+    : registry(registry), config(config) {
+#ifdef _WIN32
+    throw std::runtime_error("the metrics endpoint is not supported on Windows");
+#else
+    listen();
+    if (pipe2(wakeFds, O_CLOEXEC) != 0) {
+        close(listenFd);
+        throw std::runtime_error("failed to create the metrics server wake pipe");
+    }
+    thread = std::thread(&MetricsServer::serve, this);
+#endif
+}
+
+MetricsServer::~MetricsServer() {
+#ifndef _WIN32
+    if (thread.joinable()) {
+        char wake = 0;
+        while (write(wakeFds[1], &wake, 1) < 0 && errno == EINTR) {
+        }
+        thread.join();
+    }
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    close(listenFd);
+    if (!config.socketPath.empty()) {
+        unlink(config.socketPath.c_str());
+    }
+#endif
+}
+
+uint16_t MetricsServer::getPort() const {
+    return port;
+}
+
+void MetricsServer::listen() {
+#ifndef _WIN32
+    if (!config.socketPath.empty()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (config.socketPath.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("metrics socket path is too long: " + config.socketPath);
+        }
+        std::strcpy(address.sun_path, config.socketPath.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("failed to create the metrics socket");
+        }
+
+        // A socket left by an earlier run would make bind() fail
+        unlink(config.socketPath.c_str());
+        if (bind(listenFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, 16) != 0) {
+            close(listenFd);
+            throw std::runtime_error("failed to listen on metrics socket " + config.socketPath +
+                                     ": " + std::strerror(errno));
+        }
+        LOG_INFO("Serving metrics on unix:" + config.socketPath + ".");
+        return;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) != 1) {
+        throw std::runtime_error("invalid metrics address " + config.host);
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error("failed to create the metrics socket");
+    }
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    socklen_t size = sizeof(address);
+    if (bind(listenFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(listenFd, 16) != 0 ||
+        getsockname(listenFd, reinterpret_cast<sockaddr *>(&address), &size) != 0) {
+        close(listenFd);
+        throw std::runtime_error("failed to listen for metrics on " + config.host + ":" +
+                                 std::to_string(config.port) + ": " + std::strerror(errno));
+    }
+    port = ntohs(address.sin_port);
+    LOG_INFO("Serving metrics on http://" + config.host + ":" + std::to_string(port) +
+             "/metrics.");
+#endif
+}
+
+void MetricsServer::serve() {
+#ifndef _WIN32
+    pollfd fds[2] = {{listenFd, POLLIN, 0}, {wakeFds[0], POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("Metrics server stopped: " + std::string(std::strerror(errno)));
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        answer(fd);
+        close(fd);
+    }
+#endif
+}
+
+void MetricsServer::answer(int fd) const {
+#ifndef _WIN32
+    // A stalled scraper must not hold up the next one for long
+    timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < maxRequestSize) {
+        ssize_t result = recv(fd, buffer, sizeof(buffer), 0);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return;
+        }
+        request.append(buffer, static_cast<size_t>(result));
+    }
+
+    // Request line: METHOD SP TARGET SP VERSION
+    std::string line = request.substr(0, request.find("\r\n"));
+    size_t methodEnd = line.find(' ');
+    size_t targetEnd = line.find(' ', methodEnd + 1);
+    std::string method = line.substr(0, methodEnd);
+    std::string target = methodEnd == std::string::npos
+                             ? ""
+                             : line.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+    target = target.substr(0, target.find('?'));
+
+    const std::string plainText = "text/plain; charset=utf-8";
+    std::string response;
+    if (method != "GET" && method != "HEAD") {
+        response = formatResponse("405 Method Not Allowed", plainText, "", true);
+    } else if (target != "/metrics") {
+        response = formatResponse("404 Not Found", plainText, "metrics are served at /metrics\n",
+                                  method == "GET");
+    } else {
+        response = formatResponse("200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                                  registry.expose(), method == "GET");
+    }
+    sendAll(fd, response);
+#else
+    (void)fd;
+#endif
+}
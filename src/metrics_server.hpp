@@ -0,0 +1,87 @@
+#pragma once
+#include "metrics.hpp"
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/**
+ * @struct MetricsServerConfig
+ * @brief Configuration options for a MetricsServer
+ */
+struct MetricsServerConfig {
+    /// @brief IPv4 address the TCP endpoint listens on. The default only accepts local scrapers
+    std::string host = "127.0.0.1";
+
+    /// @brief TCP port of the endpoint. If 0, a free port is picked; see getPort()
+    uint16_t port = 9464;
+
+    /// @brief Path of a Unix socket to listen on instead of TCP (empty to use TCP)
+    std::string socketPath;
+};
+
+/**
+ * @class MetricsServer
+ * @brief Serves a MetricsRegistry to Prometheus scrapers over HTTP
+ *
+ * A thread of its own accepts connections and answers "GET /metrics" with the text exposition
+ * format, one request per connection, so scrapes never run on a render or encode thread.
+ */
+class MetricsServer {
+  public:
+    /**
+     * @brief Starts listening and serving
+     * @param registry The metrics to serve, which must outlive the server
+     * @param config Server options
+     * @throws std::runtime_error if the socket cannot be bound, or on Windows
+     */
+    MetricsServer(MetricsRegistry &registry, const MetricsServerConfig &config);
+
+    /**
+     * @brief Stops serving and closes the socket
+     */
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    /**
+     * @brief Returns the TCP port the server listens on, or 0 for a Unix socket
+     */
+    uint16_t getPort() const;
+
+  protected:
+    /// @brief The metrics served
+    MetricsRegistry &registry;
+
+    /// @brief Server options
+    MetricsServerConfig config;
+
+    /// @brief Listening socket
+    int listenFd = -1;
+
+    /// @brief Pipe written by the destructor to wake the serving thread
+    int wakeFds[2] = {-1, -1};
+
+    /// @brief TCP port bound, 0 for a Unix socket
+    uint16_t port = 0;
+
+    /// @brief Accepts and answers connections until woken
+    std::thread thread;
+
+    /**
+     * @brief Binds and listens on the configured TCP address or Unix socket
+     * @throws std::runtime_error on failure
+     */
+    void listen();
+
+    /**
+     * @brief Accepts connections until the wake pipe is written
+     */
+    void serve();
+
+    /**
+     * @brief Reads one request from a connection and answers it
+     * @param fd The connection, closed by the caller
+     */
+    void answer(int fd) const;
+};
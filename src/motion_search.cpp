@@ -0,0 +1,518 @@
+#include "motion_search.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Quarter-pel positions map to one or two full/half-pel planes (0 full, 1 horizontal,
+// 2 vertical, 3 centre), indexed by ((mv.y & 3) << 2) + (mv.x & 3)
+constexpr int qpelPlane0[16] = {0, 1, 1, 1, 0, 1, 1, 1, 2, 3, 3, 3, 0, 1, 1, 1};
+constexpr int qpelPlane1[16] = {0, 0, 1, 0, 2, 2, 3, 2, 2, 2, 3, 2, 2, 2, 3, 2};
+
+// Width of the border on which the 6-tap filter is not evaluated
+constexpr int filterBorder = 3;
+
+// Integer search range used when refining partitions around the 16x16 vector, in pixels
+constexpr int partitionRange = 4;
+
+// Bits of the mb_type and sub_mb_type codes of each partitioning
+constexpr int mbType16x16Bits = 1;
+constexpr int mbType16x8Bits = 3;
+constexpr int mbType8x8Bits = 5;
+constexpr int subMbType8x8Bits = 1;
+constexpr int subMbType4x4Bits = 5;
+
+uint8_t clip(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+int tap6(int a, int b, int c, int d, int e, int f) {
+    return a - 5 * b + 20 * c + 20 * d - 5 * e + f;
+}
+
+MotionVector roundToFullPel(MotionVector mv) {
+    return {static_cast<int16_t>(((mv.x + 2) >> 2) * 4), static_cast<int16_t>(((mv.y + 2) >> 2) * 4)};
+}
+
+} // namespace
+
+void ReferenceFrame::build(const PlaneView &luma) {
+    width = luma.width;
+    height = luma.height;
+    stride = static_cast<ptrdiff_t>(width) + 2 * padding;
+    const int rows = static_cast<int>(height) + 2 * padding;
+
+    for (auto &plane : planes) {
+        plane.resize(static_cast<size_t>(stride) * rows);
+    }
+
+    // Full-pel plane with replicated edges
+    uint8_t *full = planes[0].data();
+    for (int y = 0; y < rows; ++y) {
+        int sourceY = std::clamp(y - padding, 0, static_cast<int>(height) - 1);
+        const uint8_t *source = luma.data + sourceY * luma.stride;
+        uint8_t *row = full + y * stride;
+        std::fill(row, row + padding, source[0]);
+        std::copy(source, source + width, row + padding);
+        std::fill(row + padding + width, row + stride, source[width - 1]);
+    }
+
+    // Half-pel planes. The filter needs three samples on either side, so the outermost border
+    // keeps the full-pel value; motion vectors never reach that far into the padding
+    std::copy(planes[0].begin(), planes[0].end(), planes[1].begin());
+    std::copy(planes[0].begin(), planes[0].end(), planes[2].begin());
+    std::copy(planes[0].begin(), planes[0].end(), planes[3].begin());
+
+    std::vector<int> intermediate(static_cast<size_t>(stride) * rows);
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t *row = full + y * stride;
+        int *unclipped = intermediate.data() + y * stride;
+        uint8_t *horizontal = planes[1].data() + y * stride;
+        for (int x = filterBorder - 1; x < stride - filterBorder; ++x) {
+            unclipped[x] = tap6(row[x - 2], row[x - 1], row[x], row[x + 1], row[x + 2], row[x + 3]);
+            horizontal[x] = clip((unclipped[x] + 16) >> 5);
+        }
+    }
+
+    for (int y = filterBorder - 1; y < rows - filterBorder; ++y) {
+        uint8_t *vertical = planes[2].data() + y * stride;
+        uint8_t *centre = planes[3].data() + y * stride;
+        for (int x = filterBorder - 1; x < stride - filterBorder; ++x) {
+            const uint8_t *column = full + x;
+            vertical[x] = clip((tap6(column[(y - 2) * stride], column[(y - 1) * stride],
+                                     column[y * stride], column[(y + 1) * stride],
+                                     column[(y + 2) * stride], column[(y + 3) * stride]) +
+                                16) >>
+                               5);
+
+            // The centre sample filters the unrounded horizontal intermediates vertically
+            const int *b = intermediate.data() + x;
+            centre[x] = clip((tap6(b[(y - 2) * stride], b[(y - 1) * stride], b[y * stride],
+                                   b[(y + 1) * stride], b[(y + 2) * stride], b[(y + 3) * stride]) +
+                              512) >>
+                             10);
+        }
+    }
+}
+
+uint32_t ReferenceFrame::getWidth() const {
+    return width;
+}
+
+uint32_t ReferenceFrame::getHeight() const {
+    return height;
+}
+
+ptrdiff_t ReferenceFrame::getStride() const {
+    return stride;
+}
+
+const uint8_t *ReferenceFrame::fullPel(int x, int y) const {
+    return planePointer(0, x, y);
+}
+
+const uint8_t *ReferenceFrame::predict(uint8_t *scratch, ptrdiff_t scratchStride, int x, int y,
+                                       MotionVector mv, int width, int height,
+                                       const PixelFunctions &pixels,
+                                       ptrdiff_t &predictionStride) const {
+    int index = ((mv.y & 3) << 2) + (mv.x & 3);
+    int baseX = x + (mv.x >> 2);
+    int baseY = y + (mv.y >> 2);
+
+    const uint8_t *first = planePointer(qpelPlane0[index], baseX, baseY + ((mv.y & 3) == 3));
+    if ((index & 5) == 0) {
+        predictionStride = stride;
+        return first;
+    }
+
+    const uint8_t *second = planePointer(qpelPlane1[index], baseX + ((mv.x & 3) == 3), baseY);
+    pixels.average(scratch, scratchStride, first, second, stride, width, height);
+    predictionStride = scratchStride;
+    return scratch;
+}
+
+const uint8_t *ReferenceFrame::planePointer(int plane, int x, int y) const {
+    return planes[plane].data() + (y + padding) * stride + x + padding;
+}
+
+MotionSearch::MotionSearch(uint32_t width, uint32_t height, const MotionSearchPreset &preset)
+    : preset(preset), mbWidth(width / 16), mbHeight(height / 16), pixels(getPixelFunctions()) {
+    if (width == 0 || height == 0 || width % 16 != 0 || height % 16 != 0) {
+        throw std::runtime_error("motion search requires dimensions that are multiples of 16");
+    }
+
+    field.resize(static_cast<size_t>(mbWidth) * mbHeight);
+    previousField.resize(field.size());
+    rowProgress = std::make_unique<std::atomic<uint32_t>[]>(mbHeight);
+}
+
+void MotionSearch::search(const PlaneView &current, const ReferenceFrame &reference, int qp,
+                          ThreadPool *pool) {
+    beginFrame(current, reference, qp);
+
+    if (pool == nullptr) {
+        for (uint32_t y = 0; y < mbHeight; ++y) {
+            searchRow(y, 0);
+        }
+        return;
+    }
+
+    // The pool runs tasks in submission order, so every row waited on has already started
+    std::vector<std::future<void>> rows;
+    rows.reserve(mbHeight);
+    for (uint32_t y = 0; y < mbHeight; ++y) {
+        rows.push_back(pool->submit([this, y]() { searchRow(y, 0); }));
+    }
+    for (auto &row : rows) {
+        row.get();
+    }
+}
+
+void MotionSearch::beginFrame(const PlaneView &current, const ReferenceFrame &reference, int qp) {
+    if (current.width != mbWidth * 16 || current.height != mbHeight * 16 ||
+        reference.getWidth() != current.width || reference.getHeight() != current.height) {
+        throw std::runtime_error("motion search frame size does not match");
+    }
+
+    this->current = current;
+    this->reference = &reference;
+
+    // Same QP to lambda relation as the rate controller's qscale, rounded to whole units
+    lambda = std::max(1, static_cast<int>(std::lround(std::pow(2.0, (qp - 12) / 6.0))));
+
+    previousField.swap(field);
+    for (uint32_t y = 0; y < mbHeight; ++y) {
+        rowProgress[y].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MotionSearch::searchSlice(uint32_t firstRow, uint32_t rowCount) {
+    if (firstRow + rowCount > mbHeight) {
+        throw std::runtime_error("motion search slice lies outside the frame");
+    }
+    for (uint32_t y = firstRow; y < firstRow + rowCount; ++y) {
+        searchRow(y, firstRow);
+    }
+}
+
+const std::vector<MacroblockMotion> &MotionSearch::getMotionField() const {
+    return field;
+}
+
+uint32_t MotionSearch::getWidthInMbs() const {
+    return mbWidth;
+}
+
+uint32_t MotionSearch::getHeightInMbs() const {
+    return mbHeight;
+}
+
+MotionVector MotionSearch::median(MotionVector a, MotionVector b, MotionVector c) {
+    auto median3 = [](int16_t p, int16_t q, int16_t r) {
+        return std::max(std::min(p, q), std::min(std::max(p, q), r));
+    };
+    return {median3(a.x, b.x, c.x), median3(a.y, b.y, c.y)};
+}
+
+int MotionSearch::signedGolombBits(int value) {
+    unsigned int code = value > 0 ? 2 * value : -2 * value + 1;
+    int length = 1;
+    while (code > 1) {
+        code >>= 1;
+        length += 2;
+    }
+    return length;
+}
+
+void MotionSearch::searchRow(uint32_t mbY, uint32_t firstRow) {
+    for (uint32_t mbX = 0; mbX < mbWidth; ++mbX) {
+        // Wait for the top-right neighbour
+        if (mbY > firstRow) {
+            uint32_t needed = std::min(mbX + 2, mbWidth);
+            while (rowProgress[mbY - 1].load(std::memory_order_acquire) < needed) {
+                std::this_thread::yield();
+            }
+        }
+
+        searchMacroblock(mbX, mbY, firstRow);
+        rowProgress[mbY].store(mbX + 1, std::memory_order_release);
+    }
+}
+
+void MotionSearch::searchMacroblock(uint32_t mbX, uint32_t mbY, uint32_t firstRow) {
+    std::array<MotionVector, 3> neighbours;
+    MotionVector predictor = predictVector(mbX, mbY, firstRow, neighbours);
+
+    std::vector<MotionVector> candidates = {predictor, MotionVector()};
+    candidates.insert(candidates.end(), neighbours.begin(), neighbours.end());
+    candidates.push_back(previousField[mbY * mbWidth + mbX].mvs[0]);
+
+    MacroblockMotion result;
+    Block block = makeBlock(mbX, mbY, 0, 0, BlockSize::B16x16, predictor);
+    int cost16x16;
+    MotionVector mv16x16 = searchBlock(block, candidates, preset.searchRange, cost16x16);
+    result.mvs.fill(mv16x16);
+    result.cost = cost16x16 + lambda * mbType16x16Bits;
+
+    if (!preset.partitions) {
+        field[mbY * mbWidth + mbX] = result;
+        return;
+    }
+
+    // Partitions are refined around the 16x16 vector, with bits counted against the same
+    // macroblock predictor
+    const std::vector<MotionVector> partitionCandidates = {mv16x16, predictor};
+
+    std::array<MotionVector, 2> mvs16x8;
+    int cost16x8 = lambda * mbType16x8Bits;
+    for (int part = 0; part < 2; ++part) {
+        int cost;
+        block = makeBlock(mbX, mbY, 0, part * 8, BlockSize::B16x8, predictor);
+        mvs16x8[part] = searchBlock(block, partitionCandidates, partitionRange, cost);
+        cost16x8 += cost;
+    }
+
+    std::array<MotionVector, 4> mvs8x8;
+    std::array<std::array<MotionVector, 4>, 4> mvs4x4;
+    std::array<bool, 4> split = {};
+    int cost8x8 = lambda * mbType8x8Bits;
+    for (int part = 0; part < 4; ++part) {
+        int offsetX = (part & 1) * 8;
+        int offsetY = (part >> 1) * 8;
+        int cost;
+        block = makeBlock(mbX, mbY, offsetX, offsetY, BlockSize::B8x8, predictor);
+        mvs8x8[part] = searchBlock(block, partitionCandidates, partitionRange, cost);
+        cost += lambda * subMbType8x8Bits;
+
+        if (preset.partitions4x4) {
+            const std::vector<MotionVector> subCandidates = {mvs8x8[part], predictor};
+            int cost4x4 = lambda * subMbType4x4Bits;
+            for (int sub = 0; sub < 4; ++sub) {
+                int subCost;
+                block = makeBlock(mbX, mbY, offsetX + (sub & 1) * 4, offsetY + (sub >> 1) * 4,
+                                  BlockSize::B4x4, predictor);
+                mvs4x4[part][sub] = searchBlock(block, subCandidates, partitionRange / 2, subCost);
+                cost4x4 += subCost;
+            }
+            if (cost4x4 < cost) {
+                split[part] = true;
+                cost = cost4x4;
+            }
+        }
+        cost8x8 += cost;
+    }
+
+    if (cost16x8 < result.cost && cost16x8 <= cost8x8) {
+        result.mode = PartitionMode::P16x8;
+        result.cost = cost16x8;
+        for (int i = 0; i < 16; ++i) {
+            result.mvs[i] = mvs16x8[i / 8];
+        }
+    } else if (cost8x8 < result.cost) {
+        result.mode = PartitionMode::P8x8;
+        result.cost = cost8x8;
+        result.split4x4 = split;
+        for (int i = 0; i < 16; ++i) {
+            int row = i / 4;
+            int column = i % 4;
+            int part = (row / 2) * 2 + column / 2;
+            int sub = (row % 2) * 2 + column % 2;
+            result.mvs[i] = split[part] ? mvs4x4[part][sub] : mvs8x8[part];
+        }
+    }
+
+    field[mbY * mbWidth + mbX] = result;
+}
+
+MotionVector MotionSearch::searchBlock(const Block &block,
+                                       const std::vector<MotionVector> &candidates, int range,
+                                       int &cost) const {
+    auto clampVector = [&block](MotionVector mv) {
+        return MotionVector{static_cast<int16_t>(std::clamp<int>(mv.x, block.minX, block.maxX)),
+                            static_cast<int16_t>(std::clamp<int>(mv.y, block.minY, block.maxY))};
+    };
+
+    // Rank the candidates at full-pel
+    std::vector<MotionVector> starts;
+    std::vector<int> startCosts;
+    for (MotionVector candidate : candidates) {
+        MotionVector start = clampVector(roundToFullPel(candidate));
+        if (std::find(starts.begin(), starts.end(), start) != starts.end()) {
+            continue;
+        }
+        starts.push_back(start);
+        startCosts.push_back(fullPelCost(block, start));
+    }
+
+    MotionVector best;
+    int bestCost = -1;
+    if (preset.searchAllPredictors) {
+        for (size_t i = 0; i < starts.size(); ++i) {
+            int found;
+            MotionVector mv = patternSearch(block, starts[i], startCosts[i], range, found);
+            if (bestCost < 0 || found < bestCost) {
+                best = mv;
+                bestCost = found;
+            }
+        }
+    } else {
+        size_t first = std::min_element(startCosts.begin(), startCosts.end()) - startCosts.begin();
+        best = patternSearch(block, starts[first], startCosts[first], range, bestCost);
+    }
+
+    return refineSubpel(block, best, cost);
+}
+
+MotionVector MotionSearch::patternSearch(const Block &block, MotionVector start, int startCost,
+                                         int range, int &cost) const {
+    static constexpr int diamond[4][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}};
+    static constexpr int hexagon[6][2] = {{-2, 0}, {-1, -2}, {1, -2}, {2, 0}, {1, 2}, {-1, 2}};
+    static constexpr int square[8][2] = {{-1, -1}, {0, -1}, {1, -1}, {-1, 0},
+                                         {1, 0},   {-1, 1}, {0, 1},  {1, 1}};
+
+    MotionVector best = start;
+    cost = startCost;
+
+    // Moves the best vector to the cheapest of a set of pixel offsets, if any is cheaper
+    auto step = [&](const int (*offsets)[2], size_t count) {
+        MotionVector centre = best;
+        for (size_t i = 0; i < count; ++i) {
+            int x = centre.x + offsets[i][0] * 4;
+            int y = centre.y + offsets[i][1] * 4;
+            if (x < block.minX || x > block.maxX || y < block.minY || y > block.maxY ||
+                std::abs(x - start.x) > range * 4 || std::abs(y - start.y) > range * 4) {
+                continue;
+            }
+
+            MotionVector mv = {static_cast<int16_t>(x), static_cast<int16_t>(y)};
+            int candidateCost = fullPelCost(block, mv);
+            if (candidateCost < cost) {
+                best = mv;
+                cost = candidateCost;
+            }
+        }
+        return best != centre;
+    };
+
+    if (preset.method == SearchMethod::Diamond) {
+        for (int i = 0; i < range && step(diamond, 4); ++i) {
+        }
+    } else {
+        for (int i = 0; i < range / 2 && step(hexagon, 6); ++i) {
+        }
+        step(square, 8);
+    }
+
+    return best;
+}
+
+MotionVector MotionSearch::refineSubpel(const Block &block, MotionVector start, int &cost) const {
+    MotionVector best = start;
+    cost = subpelCost(block, start);
+    if (preset.subpel == SubpelLevel::None) {
+        return best;
+    }
+
+    auto refine = [&](int distance) {
+        MotionVector centre = best;
+        for (int dy = -distance; dy <= distance; dy += distance) {
+            for (int dx = -distance; dx <= distance; dx += distance) {
+                int x = centre.x + dx;
+                int y = centre.y + dy;
+                if ((dx == 0 && dy == 0) || x < block.minX || x > block.maxX || y < block.minY ||
+                    y > block.maxY) {
+                    continue;
+                }
+
+                MotionVector mv = {static_cast<int16_t>(x), static_cast<int16_t>(y)};
+                int candidateCost = subpelCost(block, mv);
+                if (candidateCost < cost) {
+                    best = mv;
+                    cost = candidateCost;
+                }
+            }
+        }
+    };
+
+    refine(2);
+    if (preset.subpel == SubpelLevel::Quarter) {
+        refine(1);
+    }
+    return best;
+}
+
+int MotionSearch::fullPelCost(const Block &block, MotionVector mv) const {
+    const uint8_t *prediction = reference->fullPel(block.x + (mv.x >> 2), block.y + (mv.y >> 2));
+    int distortion = pixels.sad[static_cast<size_t>(block.size)](
+        block.source, current.stride, prediction, reference->getStride());
+    return distortion + vectorCost(block, mv);
+}
+
+int MotionSearch::subpelCost(const Block &block, MotionVector mv) const {
+    size_t size = static_cast<size_t>(block.size);
+    uint8_t scratch[16 * 16];
+    ptrdiff_t predictionStride;
+    const uint8_t *prediction =
+        reference->predict(scratch, 16, block.x, block.y, mv, blockWidths[size],
+                           blockHeights[size], pixels, predictionStride);
+
+    PixelCompare compare = preset.satd ? pixels.satd[size] : pixels.sad[size];
+    return compare(block.source, current.stride, prediction, predictionStride) +
+           vectorCost(block, mv);
+}
+
+int MotionSearch::vectorCost(const Block &block, MotionVector mv) const {
+    return lambda * (signedGolombBits(mv.x - block.predictor.x) +
+                     signedGolombBits(mv.y - block.predictor.y));
+}
+
+MotionSearch::Block MotionSearch::makeBlock(uint32_t mbX, uint32_t mbY, int offsetX, int offsetY,
+                                            BlockSize size, MotionVector predictor) const {
+    Block block;
+    block.x = static_cast<int>(mbX * 16) + offsetX;
+    block.y = static_cast<int>(mbY * 16) + offsetY;
+    block.source = current.data + block.y * current.stride + block.x;
+    block.size = size;
+    block.predictor = predictor;
+
+    // Keep the block and the extra sample quarter-pel averaging reads inside the padding
+    const int reach = ReferenceFrame::padding - 8;
+    block.minX = (-reach - block.x) * 4;
+    block.maxX = (static_cast<int>(current.width) + reach - blockWidths[static_cast<size_t>(size)] -
+                  block.x) *
+                 4;
+    block.minY = (-reach - block.y) * 4;
+    block.maxY = (static_cast<int>(current.height) + reach -
+                  blockHeights[static_cast<size_t>(size)] - block.y) *
+                 4;
+    return block;
+}
+
+MotionVector MotionSearch::predictVector(uint32_t mbX, uint32_t mbY, uint32_t firstRow,
+                                         std::array<MotionVector, 3> &neighbours) const {
+    // Neighbouring 4x4 blocks: A is left, B above and C above-right (above-left if C is outside
+    // the picture) of the top-left 4x4 block. Rows above the slice are unavailable
+    bool hasA = mbX > 0;
+    bool hasB = mbY > firstRow;
+    bool hasC = hasB && mbX + 1 < mbWidth;
+    bool hasD = hasB && mbX > 0;
+
+    auto at = [this](uint32_t x, uint32_t y) -> const MacroblockMotion & {
+        return field[y * mbWidth + x];
+    };
+    neighbours[0] = hasA ? at(mbX - 1, mbY).mvs[3] : MotionVector();
+    neighbours[1] = hasB ? at(mbX, mbY - 1).mvs[12] : MotionVector();
+    neighbours[2] = hasC   ? at(mbX + 1, mbY - 1).mvs[12]
+                    : hasD ? at(mbX - 1, mbY - 1).mvs[15]
+                           : MotionVector();
+
+    // With only the left neighbour available, it is the prediction
+    if (hasA && !hasB) {
+        return neighbours[0];
+    }
+    return median(neighbours[0], neighbours[1], neighbours[2]);
+}
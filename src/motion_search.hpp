@@ -0,0 +1,430 @@
+#pragma once
+#include "pixel.hpp"
+#include "thread_pool.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @struct MotionVector
+ * @brief A motion vector in quarter-pel units
+ */
+struct MotionVector {
+    /// @brief Horizontal displacement in quarter pixels
+    int16_t x = 0;
+
+    /// @brief Vertical displacement in quarter pixels
+    int16_t y = 0;
+
+    bool operator==(const MotionVector &other) const { return x == other.x && y == other.y; }
+    bool operator!=(const MotionVector &other) const { return !(*this == other); }
+};
+
+/**
+ * @enum SearchMethod
+ * @brief Integer-pel search pattern
+ *
+ * Diamond: Repeated 4-point small diamond, cheapest and most prone to local minima
+ * Hexagon: Repeated 6-point hexagon followed by an 8-point square refinement
+ */
+enum class SearchMethod { Diamond, Hexagon };
+
+/**
+ * @enum SubpelLevel
+ * @brief Precision of the fractional refinement after the integer search
+ */
+enum class SubpelLevel { None, Half, Quarter };
+
+/**
+ * @enum MotionPreset
+ * @brief Quality/speed trade-off of the motion search, see motionSearchPresets
+ */
+enum class MotionPreset { UltraFast, Fast, Medium, Slow };
+
+/**
+ * @struct MotionSearchPreset
+ * @brief Parameters of the motion search
+ */
+struct MotionSearchPreset {
+    /// @brief Human readable preset name
+    const char *name;
+
+    /// @brief Integer-pel search pattern
+    SearchMethod method;
+
+    /// @brief Largest integer displacement searched from the best predictor, in pixels
+    int searchRange;
+
+    /// @brief Precision of the fractional refinement
+    SubpelLevel subpel;
+
+    /// @brief Whether fractional refinement and mode decision use SATD (otherwise SAD)
+    bool satd;
+
+    /// @brief Whether 16x8 and 8x8 partitions are evaluated
+    bool partitions;
+
+    /// @brief Whether 8x8 partitions may be split further into 4x4 blocks
+    bool partitions4x4;
+
+    /// @brief Whether the pattern search runs from every predictor (otherwise the best one)
+    bool searchAllPredictors;
+};
+
+/**
+ * @brief Quality/speed preset table, indexed by MotionPreset
+ *
+ * | Preset    | Pattern | Range | Sub-pel | Metric | Partitions          |
+ * |-----------|---------|-------|---------|--------|---------------------|
+ * | UltraFast | Diamond | 8     | -       | SAD    | 16x16               |
+ * | Fast      | Hexagon | 16    | Half    | SAD    | 16x16               |
+ * | Medium    | Hexagon | 16    | Quarter | SATD   | 16x16, 16x8, 8x8    |
+ * | Slow      | Hexagon | 32    | Quarter | SATD   | 16x16 - 4x4, all predictors searched |
+ */
+constexpr MotionSearchPreset motionSearchPresets[] = {
+    {"ultrafast", SearchMethod::Diamond, 8, SubpelLevel::None, false, false, false, false},
+    {"fast", SearchMethod::Hexagon, 16, SubpelLevel::Half, false, false, false, false},
+    {"medium", SearchMethod::Hexagon, 16, SubpelLevel::Quarter, true, true, false, false},
+    {"slow", SearchMethod::Hexagon, 32, SubpelLevel::Quarter, true, true, true, true},
+};
+
+/**
+ * @brief Returns the parameters of a preset
+ */
+constexpr const MotionSearchPreset &getMotionSearchPreset(MotionPreset preset) {
+    return motionSearchPresets[static_cast<size_t>(preset)];
+}
+
+/**
+ * @enum PartitionMode
+ * @brief Partitioning of a macroblock chosen by the motion search
+ */
+enum class PartitionMode { P16x16, P16x8, P8x8 };
+
+/**
+ * @struct MacroblockMotion
+ * @brief Motion search result of one macroblock
+ */
+struct MacroblockMotion {
+    /// @brief Chosen partitioning
+    PartitionMode mode = PartitionMode::P16x16;
+
+    /// @brief For P8x8, whether each 8x8 block (raster order) is split into 4x4 blocks
+    std::array<bool, 4> split4x4 = {};
+
+    /// @brief Motion vector of every 4x4 block of the macroblock, in raster order
+    std::array<MotionVector, 16> mvs = {};
+
+    /// @brief Distortion plus lambda-weighted motion vector and mode bits of the choice
+    int cost = 0;
+};
+
+/**
+ * @class ReferenceFrame
+ * @brief A padded luma reference with precomputed half-pel planes
+ *
+ * The full-pel plane is padded by replicating its edges, so motion vectors may point up to
+ * "padding - 8" pixels outside the picture. The horizontal, vertical and centre half-pel
+ * planes are interpolated with the H.264 6-tap filter (1, -5, 20, 20, -5, 1), and quarter-pel
+ * samples are formed on demand by averaging the two nearest full/half-pel samples.
+ */
+class ReferenceFrame {
+  public:
+    /// @brief Border added around each plane, in pixels
+    static constexpr int padding = 48;
+
+    /**
+     * @brief Copies and pads a luma plane and interpolates its half-pel planes
+     * @param luma The reconstructed luma plane of the reference picture
+     */
+    void build(const PlaneView &luma);
+
+    /**
+     * @brief Returns the width of the picture (excluding padding)
+     */
+    uint32_t getWidth() const;
+
+    /**
+     * @brief Returns the height of the picture (excluding padding)
+     */
+    uint32_t getHeight() const;
+
+    /**
+     * @brief Returns the distance between rows of every plane in bytes
+     */
+    ptrdiff_t getStride() const;
+
+    /**
+     * @brief Returns a pointer to a full-pel sample (may lie in the padding)
+     * @param x Horizontal position in pixels
+     * @param y Vertical position in pixels
+     */
+    const uint8_t *fullPel(int x, int y) const;
+
+    /**
+     * @brief Forms the motion-compensated prediction of a block
+     *
+     * If the vector points at a full- or half-pel position, no averaging is needed and the
+     * returned pointer addresses the reference plane directly. Otherwise the averaged samples
+     * are written to "scratch" and that is returned
+     *
+     * @param scratch Buffer of at least width x height bytes with rows "scratchStride" apart
+     * @param scratchStride Distance between rows of the scratch buffer in bytes
+     * @param x Horizontal position of the block in pixels
+     * @param y Vertical position of the block in pixels
+     * @param mv Motion vector in quarter pixels
+     * @param width Width of the block in pixels
+     * @param height Height of the block in pixels
+     * @param pixels Kernels used for the averaging
+     * @param predictionStride Receives the row distance of the returned prediction
+     * @return The prediction
+     */
+    const uint8_t *predict(uint8_t *scratch, ptrdiff_t scratchStride, int x, int y,
+                           MotionVector mv, int width, int height, const PixelFunctions &pixels,
+                           ptrdiff_t &predictionStride) const;
+
+  protected:
+    /// @brief Width of the picture
+    uint32_t width = 0;
+
+    /// @brief Height of the picture
+    uint32_t height = 0;
+
+    /// @brief Distance between rows of the padded planes
+    ptrdiff_t stride = 0;
+
+    /// @brief Full-pel, horizontal, vertical and centre half-pel planes, including padding
+    std::array<std::vector<uint8_t>, 4> planes;
+
+    /**
+     * @brief Returns a pointer into one of the planes
+     * @param plane Plane index (0 full, 1 horizontal, 2 vertical, 3 centre)
+     * @param x Horizontal position in pixels
+     * @param y Vertical position in pixels
+     */
+    const uint8_t *planePointer(int plane, int x, int y) const;
+};
+
+/**
+ * @class MotionSearch
+ * @brief Block-matching motion estimation for P frames
+ *
+ * Every 16x16 macroblock is searched from a set of predictor candidates (the median and
+ * neighbouring vectors, zero and the co-located vector of the previous frame) with a diamond
+ * or hexagon pattern, then refined to half or quarter pel. Depending on the preset, 16x8,
+ * 8x8 and 4x4 partitions are then searched around the 16x16 result and the cheapest
+ * partitioning is kept. Costs are distortion plus lambda times the exp-Golomb length of the
+ * motion vector difference.
+ *
+ * Rows of macroblocks can be searched concurrently on a ThreadPool. A macroblock depends on
+ * its left, top and top-right neighbours, so each row trails the row above by two macroblocks
+ * (a wavefront).
+ */
+class MotionSearch {
+  public:
+    /**
+     * @brief Creates a motion search for frames of a given size
+     * @param width Width of the frames in pixels (a multiple of 16)
+     * @param height Height of the frames in pixels (a multiple of 16)
+     * @param preset Search parameters
+     * @throws std::runtime_error if the dimensions are not multiples of 16
+     */
+    MotionSearch(uint32_t width, uint32_t height,
+                 const MotionSearchPreset &preset = getMotionSearchPreset(MotionPreset::Medium));
+
+    /**
+     * @brief Searches every macroblock of a frame against a reference
+     * @param current Luma plane of the frame being coded
+     * @param reference The reference frame
+     * @param qp Quantiser of the frame, used to weight motion vector bits against distortion
+     * @param pool Optional pool to search rows concurrently on (nullptr searches inline)
+     */
+    void search(const PlaneView &current, const ReferenceFrame &reference, int qp,
+                ThreadPool *pool = nullptr);
+
+    /**
+     * @brief Starts a frame whose slices are then searched with searchSlice
+     * @param current Luma plane of the frame being coded
+     * @param reference The reference frame
+     * @param qp Quantiser of the frame, used to weight motion vector bits against distortion
+     */
+    void beginFrame(const PlaneView &current, const ReferenceFrame &reference, int qp);
+
+    /**
+     * @brief Searches the macroblock rows of one slice on the calling thread
+     *
+     * Vectors are only predicted from macroblocks of the same slice, as in the bitstream, so
+     * the slices of a frame can be searched concurrently without waiting on each other
+     *
+     * @param firstRow First macroblock row of the slice
+     * @param rowCount Number of macroblock rows in the slice
+     * @throws std::runtime_error if the rows lie outside the frame
+     */
+    void searchSlice(uint32_t firstRow, uint32_t rowCount);
+
+    /**
+     * @brief Returns the results of the last search, in raster order
+     */
+    const std::vector<MacroblockMotion> &getMotionField() const;
+
+    /**
+     * @brief Returns the width of the frame in macroblocks
+     */
+    uint32_t getWidthInMbs() const;
+
+    /**
+     * @brief Returns the height of the frame in macroblocks
+     */
+    uint32_t getHeightInMbs() const;
+
+    /**
+     * @brief Returns the component-wise median of three vectors
+     */
+    static MotionVector median(MotionVector a, MotionVector b, MotionVector c);
+
+    /**
+     * @brief Returns the length of a signed exp-Golomb code
+     * @param value The value to code
+     * @return Length of se(v) in bits
+     */
+    static int signedGolombBits(int value);
+
+  protected:
+    /**
+     * @struct Block
+     * @brief A block being searched and its cost parameters
+     */
+    struct Block {
+        /// @brief Top-left source pixel
+        const uint8_t *source;
+
+        /// @brief Position of the block in the frame, in pixels
+        int x, y;
+
+        /// @brief Size of the block
+        BlockSize size;
+
+        /// @brief Predicted vector that vector bits are counted against
+        MotionVector predictor;
+
+        /// @brief Smallest and largest vector components keeping the block within the padding
+        int minX, maxX, minY, maxY;
+    };
+
+    /// @brief Search parameters
+    MotionSearchPreset preset;
+
+    /// @brief Width of the frames in macroblocks
+    uint32_t mbWidth;
+
+    /// @brief Height of the frames in macroblocks
+    uint32_t mbHeight;
+
+    /// @brief Pixel kernels used for block comparison
+    const PixelFunctions &pixels;
+
+    /// @brief Results of the current search
+    std::vector<MacroblockMotion> field;
+
+    /// @brief Results of the previous search, used for temporal predictors
+    std::vector<MacroblockMotion> previousField;
+
+    /// @brief Number of macroblocks completed in each row of the current search
+    std::unique_ptr<std::atomic<uint32_t>[]> rowProgress;
+
+    /// @brief Source plane of the current search
+    PlaneView current = {};
+
+    /// @brief Reference of the current search
+    const ReferenceFrame *reference = nullptr;
+
+    /// @brief Weight of one bit of side information in distortion units
+    int lambda = 1;
+
+    /**
+     * @brief Searches one row of macroblocks, waiting on the row above as needed
+     * @param mbY Row index
+     * @param firstRow First row of the slice containing the row
+     */
+    void searchRow(uint32_t mbY, uint32_t firstRow);
+
+    /**
+     * @brief Searches one macroblock and stores its result in the field
+     * @param mbX Column index
+     * @param mbY Row index
+     * @param firstRow First row of the slice containing the macroblock
+     */
+    void searchMacroblock(uint32_t mbX, uint32_t mbY, uint32_t firstRow);
+
+    /**
+     * @brief Searches a block from a list of candidate vectors
+     * @param block The block to search
+     * @param candidates Candidate vectors in quarter pixels
+     * @param range Largest integer displacement from the starting point, in pixels
+     * @param cost Receives the cost of the returned vector
+     * @return The best vector found
+     */
+    MotionVector searchBlock(const Block &block, const std::vector<MotionVector> &candidates,
+                             int range, int &cost) const;
+
+    /**
+     * @brief Runs the integer-pel pattern search from a starting vector
+     * @param block The block to search
+     * @param start Integer-pel starting vector (quarter-pel units, multiple of 4)
+     * @param startCost Cost of the starting vector
+     * @param range Largest integer displacement from the start, in pixels
+     * @param cost Receives the cost of the returned vector
+     * @return The best integer-pel vector
+     */
+    MotionVector patternSearch(const Block &block, MotionVector start, int startCost, int range,
+                               int &cost) const;
+
+    /**
+     * @brief Refines a vector to half or quarter pel as configured
+     * @param block The block to search
+     * @param start Integer-pel vector to refine
+     * @param cost Receives the cost of the returned vector
+     * @return The refined vector
+     */
+    MotionVector refineSubpel(const Block &block, MotionVector start, int &cost) const;
+
+    /**
+     * @brief Returns the integer-pel SAD cost of a vector, including vector bits
+     */
+    int fullPelCost(const Block &block, MotionVector mv) const;
+
+    /**
+     * @brief Returns the sub-pel cost of a vector with the configured metric
+     */
+    int subpelCost(const Block &block, MotionVector mv) const;
+
+    /**
+     * @brief Returns the lambda-weighted bits of a vector relative to the block predictor
+     */
+    int vectorCost(const Block &block, MotionVector mv) const;
+
+    /**
+     * @brief Returns a block description for part of a macroblock
+     * @param mbX Column index of the macroblock
+     * @param mbY Row index of the macroblock
+     * @param offsetX Horizontal offset of the block within the macroblock
+     * @param offsetY Vertical offset of the block within the macroblock
+     * @param size Size of the block
+     * @param predictor Predicted vector of the block
+     */
+    Block makeBlock(uint32_t mbX, uint32_t mbY, int offsetX, int offsetY, BlockSize size,
+                    MotionVector predictor) const;
+
+    /**
+     * @brief Returns the median predictor and spatial neighbours of a macroblock
+     * @param mbX Column index
+     * @param mbY Row index
+     * @param firstRow First row of the slice containing the macroblock
+     * @param neighbours Receives the left, top and top-right (or top-left) vectors
+     * @return The median predictor
+     */
+    MotionVector predictVector(uint32_t mbX, uint32_t mbY, uint32_t firstRow,
+                               std::array<MotionVector, 3> &neighbours) const;
+};
@@ -0,0 +1,280 @@
+#include "pixel.hpp"
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_HAVE_AVX2 1
+#endif
+
+namespace {
+
+template <int W, int H>
+int sadScalar(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB) {
+    int sum = 0;
+    for (int y = 0; y < H; ++y, a += strideA, b += strideB) {
+        for (int x = 0; x < W; ++x) {
+            sum += std::abs(a[x] - b[x]);
+        }
+    }
+    return sum;
+}
+
+int satd4x4Scalar(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB) {
+    int d[4][4];
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            d[y][x] = a[y * strideA + x] - b[y * strideB + x];
+        }
+    }
+
+    // Horizontal then vertical 4-point Hadamard transforms
+    int t[4][4];
+    for (int y = 0; y < 4; ++y) {
+        int s01 = d[y][0] + d[y][1], d01 = d[y][0] - d[y][1];
+        int s23 = d[y][2] + d[y][3], d23 = d[y][2] - d[y][3];
+        t[y][0] = s01 + s23;
+        t[y][1] = d01 + d23;
+        t[y][2] = s01 - s23;
+        t[y][3] = d01 - d23;
+    }
+
+    int sum = 0;
+    for (int x = 0; x < 4; ++x) {
+        int s01 = t[0][x] + t[1][x], d01 = t[0][x] - t[1][x];
+        int s23 = t[2][x] + t[3][x], d23 = t[2][x] - t[3][x];
+        sum += std::abs(s01 + s23) + std::abs(d01 + d23) + std::abs(s01 - s23) +
+               std::abs(d01 - d23);
+    }
+
+    return sum;
+}
+
+template <int W, int H>
+int satdScalar(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b, ptrdiff_t strideB) {
+    int sum = 0;
+    for (int y = 0; y < H; y += 4) {
+        for (int x = 0; x < W; x += 4) {
+            sum += satd4x4Scalar(a + y * strideA + x, strideA, b + y * strideB + x, strideB);
+        }
+    }
+    return sum >> 1;
+}
+
+void averageScalar(uint8_t *dst, ptrdiff_t dstStride, const uint8_t *a, const uint8_t *b,
+                   ptrdiff_t srcStride, int width, int height) {
+    for (int y = 0; y < height; ++y, dst += dstStride, a += srcStride, b += srcStride) {
+        for (int x = 0; x < width; ++x) {
+            dst[x] = static_cast<uint8_t>((a[x] + b[x] + 1) >> 1);
+        }
+    }
+}
+
+#ifdef PIXEL_HAVE_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// Sums the eight 64-bit SAD partials produced by _mm256_sad_epu8
+AVX2_TARGET inline int horizontalSum64(__m256i v) {
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// Sums the eight 32-bit lanes of a vector
+AVX2_TARGET inline int horizontalSum32(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// Loads two 16-byte rows into the low and high halves of a vector
+AVX2_TARGET inline __m256i loadRows16(const uint8_t *row0, const uint8_t *row1) {
+    return _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row0))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1)), 1);
+}
+
+// Loads four 8-byte rows into one vector
+AVX2_TARGET inline __m256i loadRows8(const uint8_t *p, ptrdiff_t stride) {
+    __m128i r01 = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)),
+                                     _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + stride)));
+    __m128i r23 =
+        _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + 2 * stride)),
+                           _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + 3 * stride)));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(r01), r23, 1);
+}
+
+// Loads four 4-byte rows into one vector
+AVX2_TARGET inline __m128i loadRows4(const uint8_t *p, ptrdiff_t stride) {
+    int32_t r0, r1, r2, r3;
+    __builtin_memcpy(&r0, p, 4);
+    __builtin_memcpy(&r1, p + stride, 4);
+    __builtin_memcpy(&r2, p + 2 * stride, 4);
+    __builtin_memcpy(&r3, p + 3 * stride, 4);
+    return _mm_setr_epi32(r0, r1, r2, r3);
+}
+
+template <int H>
+AVX2_TARGET int sad16Avx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                          ptrdiff_t strideB) {
+    __m256i sum = _mm256_setzero_si256();
+    for (int y = 0; y < H; y += 2) {
+        __m256i va = loadRows16(a + y * strideA, a + (y + 1) * strideA);
+        __m256i vb = loadRows16(b + y * strideB, b + (y + 1) * strideB);
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+    }
+    return horizontalSum64(sum);
+}
+
+AVX2_TARGET int sad8x8Avx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                           ptrdiff_t strideB) {
+    __m256i sum = _mm256_sad_epu8(loadRows8(a, strideA), loadRows8(b, strideB));
+    sum = _mm256_add_epi64(sum, _mm256_sad_epu8(loadRows8(a + 4 * strideA, strideA),
+                                                loadRows8(b + 4 * strideB, strideB)));
+    return horizontalSum64(sum);
+}
+
+AVX2_TARGET int sad4x4Avx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                           ptrdiff_t strideB) {
+    __m128i sum = _mm_sad_epu8(loadRows4(a, strideA), loadRows4(b, strideB));
+    return _mm_cvtsi128_si32(_mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum)));
+}
+
+// Applies the 4-point Hadamard transform within every group of four 16-bit lanes
+AVX2_TARGET inline __m256i hadamardLanes4(__m256i v) {
+    const __m256i signPairs = _mm256_setr_epi16(1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1,
+                                                1, -1);
+    const __m256i signQuads = _mm256_setr_epi16(1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1,
+                                                -1, -1);
+
+    // (x0 + x1, x0 - x1, x2 + x3, x2 - x3)
+    __m256i swapped = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xB1), 0xB1);
+    v = _mm256_add_epi16(swapped, _mm256_sign_epi16(v, signPairs));
+
+    // Butterfly between the pairs
+    swapped = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0x4E), 0x4E);
+    return _mm256_add_epi16(swapped, _mm256_sign_epi16(v, signQuads));
+}
+
+// SATD of the 4x4 blocks held in four rows of sixteen 16-bit differences, not yet halved
+AVX2_TARGET inline __m256i satdRows(__m256i d0, __m256i d1, __m256i d2, __m256i d3) {
+    // Vertical Hadamard across the four rows
+    __m256i s01 = _mm256_add_epi16(d0, d1), d01 = _mm256_sub_epi16(d0, d1);
+    __m256i s23 = _mm256_add_epi16(d2, d3), d23 = _mm256_sub_epi16(d2, d3);
+
+    __m256i t0 = hadamardLanes4(_mm256_add_epi16(s01, s23));
+    __m256i t1 = hadamardLanes4(_mm256_add_epi16(d01, d23));
+    __m256i t2 = hadamardLanes4(_mm256_sub_epi16(s01, s23));
+    __m256i t3 = hadamardLanes4(_mm256_sub_epi16(d01, d23));
+
+    __m256i sum = _mm256_add_epi16(_mm256_abs_epi16(t0), _mm256_abs_epi16(t1));
+    sum = _mm256_add_epi16(sum, _mm256_abs_epi16(t2));
+    sum = _mm256_add_epi16(sum, _mm256_abs_epi16(t3));
+    return _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+}
+
+AVX2_TARGET inline __m256i diff16(const uint8_t *a, const uint8_t *b) {
+    return _mm256_sub_epi16(
+        _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a))),
+        _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b))));
+}
+
+// Differences of an 8-pixel row (low half) and the row four below it (high half)
+AVX2_TARGET inline __m256i diff8Pair(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                                     ptrdiff_t strideB) {
+    __m128i va = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(a)),
+                                    _mm_loadl_epi64(reinterpret_cast<const __m128i *>(a + 4 * strideA)));
+    __m128i vb = _mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(b)),
+                                    _mm_loadl_epi64(reinterpret_cast<const __m128i *>(b + 4 * strideB)));
+    return _mm256_sub_epi16(_mm256_cvtepu8_epi16(va), _mm256_cvtepu8_epi16(vb));
+}
+
+template <int H>
+AVX2_TARGET int satd16Avx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                           ptrdiff_t strideB) {
+    __m256i sum = _mm256_setzero_si256();
+    for (int y = 0; y < H; y += 4) {
+        const uint8_t *pa = a + y * strideA;
+        const uint8_t *pb = b + y * strideB;
+        sum = _mm256_add_epi32(
+            sum, satdRows(diff16(pa, pb), diff16(pa + strideA, pb + strideB),
+                          diff16(pa + 2 * strideA, pb + 2 * strideB),
+                          diff16(pa + 3 * strideA, pb + 3 * strideB)));
+    }
+    return horizontalSum32(sum) >> 1;
+}
+
+AVX2_TARGET int satd8x8Avx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                            ptrdiff_t strideB) {
+    __m256i sum = satdRows(diff8Pair(a, strideA, b, strideB),
+                           diff8Pair(a + strideA, strideA, b + strideB, strideB),
+                           diff8Pair(a + 2 * strideA, strideA, b + 2 * strideB, strideB),
+                           diff8Pair(a + 3 * strideA, strideA, b + 3 * strideB, strideB));
+    return horizontalSum32(sum) >> 1;
+}
+
+AVX2_TARGET int satd4x4Avx2(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                            ptrdiff_t strideB) {
+    // Rows 0-1 land in the low half and rows 2-3 in the high half, so the vertical transform
+    // pairs rows with 64-bit unpacks before the horizontal transform within lane groups
+    __m256i d = _mm256_sub_epi16(_mm256_cvtepu8_epi16(loadRows4(a, strideA)),
+                                 _mm256_cvtepu8_epi16(loadRows4(b, strideB)));
+    __m128i r01 = _mm256_castsi256_si128(d);
+    __m128i r23 = _mm256_extracti128_si256(d, 1);
+
+    __m128i s = _mm_add_epi16(r01, r23); // (r0 + r2, r1 + r3)
+    __m128i t = _mm_sub_epi16(r01, r23); // (r0 - r2, r1 - r3)
+    __m128i u0 = _mm_unpacklo_epi64(s, t);
+    __m128i u1 = _mm_unpackhi_epi64(s, t);
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_add_epi16(u0, u1)),
+                                        _mm_sub_epi16(u0, u1), 1);
+
+    v = _mm256_abs_epi16(hadamardLanes4(v));
+    return horizontalSum32(_mm256_madd_epi16(v, _mm256_set1_epi16(1))) >> 1;
+}
+
+AVX2_TARGET void averageAvx2(uint8_t *dst, ptrdiff_t dstStride, const uint8_t *a,
+                             const uint8_t *b, ptrdiff_t srcStride, int width, int height) {
+    for (int y = 0; y < height; ++y, dst += dstStride, a += srcStride, b += srcStride) {
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_avg_epu8(va, vb));
+        }
+        for (; x < width; ++x) {
+            dst[x] = static_cast<uint8_t>((a[x] + b[x] + 1) >> 1);
+        }
+    }
+}
+
+const PixelFunctions avx2Functions = {
+    {sad16Avx2<16>, sad16Avx2<8>, sad8x8Avx2, sad4x4Avx2},
+    {satd16Avx2<16>, satd16Avx2<8>, satd8x8Avx2, satd4x4Avx2},
+    averageAvx2,
+};
+
+#endif
+
+const PixelFunctions scalarFunctions = {
+    {sadScalar<16, 16>, sadScalar<16, 8>, sadScalar<8, 8>, sadScalar<4, 4>},
+    {satdScalar<16, 16>, satdScalar<16, 8>, satdScalar<8, 8>, satdScalar<4, 4>},
+    averageScalar,
+};
+
+} // namespace
+
+const PixelFunctions &getScalarPixelFunctions() {
+    return scalarFunctions;
+}
+
+const PixelFunctions &getPixelFunctions() {
+#ifdef PIXEL_HAVE_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return avx2Functions;
+    }
+#endif
+    return scalarFunctions;
+}
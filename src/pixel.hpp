@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @enum BlockSize
+ * @brief Block sizes supported by the pixel comparison kernels
+ */
+enum class BlockSize { B16x16, B16x8, B8x8, B4x4 };
+
+/// @brief Number of BlockSize values
+constexpr size_t blockSizeCount = 4;
+
+/// @brief Width of each BlockSize in pixels
+constexpr int blockWidths[blockSizeCount] = {16, 16, 8, 4};
+
+/// @brief Height of each BlockSize in pixels
+constexpr int blockHeights[blockSizeCount] = {16, 8, 8, 4};
+
+/**
+ * @struct PlaneView
+ * @brief Non-owning view of an 8-bit image plane (e.g. the luma plane of a frame)
+ */
+struct PlaneView {
+    /// @brief First pixel of the plane
+    const uint8_t *data;
+
+    /// @brief Width of the plane in pixels
+    uint32_t width;
+
+    /// @brief Height of the plane in pixels
+    uint32_t height;
+
+    /// @brief Distance between rows in bytes
+    ptrdiff_t stride;
+};
+
+/**
+ * @brief Compares two blocks of 8-bit pixels
+ * @param a First block
+ * @param strideA Distance between rows of the first block in bytes
+ * @param b Second block
+ * @param strideB Distance between rows of the second block in bytes
+ * @return The distortion between the blocks
+ */
+using PixelCompare = int (*)(const uint8_t *a, ptrdiff_t strideA, const uint8_t *b,
+                             ptrdiff_t strideB);
+
+/**
+ * @brief Averages two blocks of pixels with rounding, as used for quarter-pel prediction
+ * @param dst Destination block
+ * @param dstStride Distance between rows of the destination in bytes
+ * @param a First source block
+ * @param b Second source block
+ * @param srcStride Distance between rows of both sources in bytes
+ * @param width Width of the blocks in pixels
+ * @param height Height of the blocks in pixels
+ */
+using PixelAverage = void (*)(uint8_t *dst, ptrdiff_t dstStride, const uint8_t *a,
+                              const uint8_t *b, ptrdiff_t srcStride, int width, int height);
+
+/**
+ * @struct PixelFunctions
+ * @brief Table of pixel kernels, indexed by BlockSize
+ *
+ * SATD is the sum of absolute 4x4 Hadamard-transformed differences, halved, summed over all
+ * 4x4 sub-blocks of the block.
+ */
+struct PixelFunctions {
+    /// @brief Sum of absolute differences per block size
+    PixelCompare sad[blockSizeCount];
+
+    /// @brief Sum of absolute transformed differences per block size
+    PixelCompare satd[blockSizeCount];
+
+    /// @brief Rounded average of two blocks
+    PixelAverage average;
+};
+
+/**
+ * @brief Returns the portable scalar kernels
+ *
+ * These are the reference implementations the SIMD kernels must match exactly
+ */
+const PixelFunctions &getScalarPixelFunctions();
+
+/**
+ * @brief Returns the fastest kernels supported by the running CPU
+ *
+ * The CPU is checked once. AVX2 kernels are used on x86 processors that support AVX2, the
+ * scalar kernels otherwise
+ */
+const PixelFunctions &getPixelFunctions();
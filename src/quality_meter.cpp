@@ -0,0 +1,103 @@
+#include "quality_meter.hpp"
+#include "image_compare.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+/**
+ * @brief Returns the mean squared error a PSNR stands for, 0 for an infinite PSNR
+ */
+double psnrToMse(double psnr) {
+    return std::isinf(psnr) ? 0.0 : 255.0 * 255.0 / std::pow(10.0, psnr / 10.0);
+}
+
+double mseToPsnr(double mse) {
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse)
+                     : std::numeric_limits<double>::infinity();
+}
+
+} // namespace
+
+QualityMeter::QualityMeter(uint32_t width, uint32_t height, const QualityConfig &config)
+    : config(config), width(width), height(height) {
+    this->config.window = std::max(config.window, 1u);
+}
+
+void QualityMeter::measure(const YuvFrame &source, const YuvFrame &reconstruction,
+                           FrameQuality &quality) const {
+    const ImageCompareFunctions &functions = getImageCompareFunctions();
+    double psnr[3];
+    for (int plane = 0; plane < 3; ++plane) {
+        uint32_t planeWidth = plane == 0 ? width : (width + 1) / 2;
+        uint32_t planeHeight = plane == 0 ? height : (height + 1) / 2;
+        ErrorSums errors = comparePlanes(
+            source.planes[plane].data(), source.stride(plane), reconstruction.planes[plane].data(),
+            reconstruction.stride(plane), planeWidth, planeHeight, functions);
+        psnr[plane] = computePsnr(errors.squared, uint64_t(planeWidth) * planeHeight);
+    }
+    quality.psnrY = psnr[0];
+    quality.psnrU = psnr[1];
+    quality.psnrV = psnr[2];
+    quality.ssim = computeSsim(source.planes[0].data(), source.stride(0),
+                               reconstruction.planes[0].data(), reconstruction.stride(0), width,
+                               height, config.ssimStep, functions);
+}
+
+void QualityMeter::addFrame(const FrameQuality &quality) {
+    entries.push_back({quality.bits,
+                       {psnrToMse(quality.psnrY), psnrToMse(quality.psnrU),
+                        psnrToMse(quality.psnrV)},
+                       quality.psnrY,
+                       quality.ssim});
+    if (entries.size() > config.window) {
+        entries.pop_front();
+    }
+    ++frameCount;
+
+    QualityStats stats = getStats();
+    if (config.report) {
+        config.report(quality, stats);
+        return;
+    }
+    if (frameCount % config.window == 0) {
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2) << "Quality of the last " << stats.frames
+               << " frames: PSNR Y/U/V = " << stats.psnrY << "/" << stats.psnrU << "/"
+               << stats.psnrV << " dB (min Y " << stats.minPsnrY << " dB), SSIM = "
+               << std::setprecision(4) << stats.ssim << ", mean frame size = "
+               << std::setprecision(1) << stats.bitsPerFrame / 8192.0 << " KiB";
+        LOG_INFO(report.str());
+    }
+}
+
+QualityStats QualityMeter::getStats() const {
+    QualityStats stats;
+    if (entries.empty()) {
+        return stats;
+    }
+
+    double bits = 0.0, ssim = 0.0, mse[3] = {};
+    stats.minPsnrY = std::numeric_limits<double>::infinity();
+    for (const Entry &entry : entries) {
+        bits += double(entry.bits);
+        ssim += entry.ssim;
+        for (int plane = 0; plane < 3; ++plane) {
+            mse[plane] += entry.mse[plane];
+        }
+        stats.minPsnrY = std::min(stats.minPsnrY, entry.psnrY);
+    }
+
+    double count = double(entries.size());
+    stats.frames = static_cast<uint32_t>(entries.size());
+    stats.bitsPerFrame = bits / count;
+    stats.psnrY = mseToPsnr(mse[0] / count);
+    stats.psnrU = mseToPsnr(mse[1] / count);
+    stats.psnrV = mseToPsnr(mse[2] / count);
+    stats.ssim = ssim / count;
+    return stats;
+}
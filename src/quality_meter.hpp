@@ -0,0 +1,148 @@
+#pragma once
+#include "yuv_frame.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+/**
+ * @struct FrameQuality
+ * @brief Quality and size of one coded frame
+ */
+struct FrameQuality {
+    /// @brief Index of the frame in coding order
+    uint64_t frameIndex = 0;
+
+    /// @brief Whether the frame is an IDR picture
+    bool idr = false;
+
+    /// @brief QP the frame was coded with
+    int qp = 0;
+
+    /// @brief Size of the access unit in bits
+    uint64_t bits = 0;
+
+    /// @brief PSNR of the Y, Cb and Cr planes in dB, infinite for lossless planes
+    double psnrY = 0.0;
+    double psnrU = 0.0;
+    double psnrV = 0.0;
+
+    /// @brief Mean SSIM of the luma over the measured windows
+    double ssim = 0.0;
+};
+
+/**
+ * @struct QualityStats
+ * @brief Quality and size averaged over the most recent frames
+ */
+struct QualityStats {
+    /// @brief Number of frames averaged
+    uint32_t frames = 0;
+
+    /// @brief Mean size of the frames in bits
+    double bitsPerFrame = 0.0;
+
+    /// @brief PSNR of the Y, Cb and Cr planes in dB, from the mean squared error of the frames
+    double psnrY = 0.0;
+    double psnrU = 0.0;
+    double psnrV = 0.0;
+
+    /// @brief Lowest luma PSNR of any frame, in dB
+    double minPsnrY = 0.0;
+
+    /// @brief Mean SSIM of the frames
+    double ssim = 0.0;
+};
+
+/**
+ * @struct QualityConfig
+ * @brief Configuration options for a QualityMeter
+ */
+struct QualityConfig {
+    /// @brief Distance between the 8x8 SSIM windows in pixels, in both directions. 4 measures
+    /// every window of a 4-pixel grid; 16 measures one in sixteen of them
+    uint32_t ssimStep = 16;
+
+    /// @brief Number of frames the rolling statistics are averaged over
+    uint32_t window = 60;
+
+    /// @brief Receives each frame's quality and the statistics including it. Must not call
+    /// back into the encoder. If unset, the statistics are logged once per window
+    std::function<void(const FrameQuality &, const QualityStats &)> report;
+};
+
+/**
+ * @class QualityMeter
+ * @brief Measures what an encoder does to picture quality
+ *
+ * Each source frame is compared with the encoder's reconstruction of it, which is exactly what
+ * a decoder shows, so no decoding is needed. Planes are compared with the SIMD kernels of
+ * image_compare, and SSIM is sampled on a sparse grid of windows, so a 1080p frame takes a few
+ * milliseconds on one worker.
+ *
+ * measure() may run on any thread. addFrame() keeps the rolling statistics and must be
+ * serialised by the caller.
+ */
+class QualityMeter {
+  public:
+    /**
+     * @brief Creates a meter for pictures of the given size
+     * @param width Width of the pictures in pixels, without padding
+     * @param height Height of the pictures in pixels, without padding
+     * @param config Meter options
+     */
+    QualityMeter(uint32_t width, uint32_t height, const QualityConfig &config);
+
+    /**
+     * @brief Compares a reconstruction with its source, filling the PSNR and SSIM fields
+     *
+     * The padding of frames sized in whole macroblocks is left out
+     *
+     * @param source The source frame
+     * @param reconstruction The encoder's reconstruction of it
+     * @param quality Receives the metrics
+     */
+    void measure(const YuvFrame &source, const YuvFrame &reconstruction,
+                 FrameQuality &quality) const;
+
+    /**
+     * @brief Adds a measured frame, whose size is set, to the statistics and reports it
+     */
+    void addFrame(const FrameQuality &quality);
+
+    /**
+     * @brief Returns the statistics of the most recent frames
+     */
+    QualityStats getStats() const;
+
+  protected:
+    /**
+     * @struct Entry
+     * @brief A frame of the rolling window
+     */
+    struct Entry {
+        /// @brief Size in bits
+        uint64_t bits;
+
+        /// @brief Mean squared error of the Y, Cb and Cr planes
+        double mse[3];
+
+        /// @brief Luma PSNR
+        double psnrY;
+
+        /// @brief SSIM
+        double ssim;
+    };
+
+    /// @brief Meter options
+    QualityConfig config;
+
+    /// @brief Size of the pictures without padding
+    uint32_t width;
+    uint32_t height;
+
+    /// @brief The most recent frames, oldest first
+    std::deque<Entry> entries;
+
+    /// @brief Frames added so far
+    uint64_t frameCount = 0;
+};
@@ -0,0 +1,205 @@
+#include "rate_control.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+RateController::RateController(const RateControlConfig &config) : config(config) {
+    if (config.frameRateNumerator == 0 || config.frameRateDenominator == 0) {
+        throw std::runtime_error("rate control requires a non-zero frame rate");
+    }
+
+    double fps = static_cast<double>(config.frameRateNumerator) / config.frameRateDenominator;
+    averageFrameBits = config.bitrate / fps;
+
+    // CBR drains the buffer at the target rate, capped VBR at the peak rate
+    double drainRate = config.mode == RateControlMode::Vbr
+                           ? std::max(config.maxBitrate, config.bitrate)
+                           : config.bitrate;
+    vbvInflow = drainRate / fps;
+    vbvSize = config.vbvBufferSize > 0 ? config.vbvBufferSize : config.bitrate;
+    vbvFill = vbvSize * std::clamp(config.vbvInitialFullness, 0.0f, 1.0f);
+}
+
+double RateController::estimateComplexity(const uint8_t *luma, const uint8_t *previousLuma,
+                                          uint32_t width, uint32_t height, size_t stride) {
+    const uint32_t blockSize = 16;
+    double complexity = 0.0;
+
+    // Cost each 16x16 block as it would be coded: intra, or inter if that is cheaper
+    for (uint32_t by = 0; by + 2 < height; by += blockSize) {
+        for (uint32_t bx = 0; bx + 2 < width; bx += blockSize) {
+            uint32_t yEnd = std::min(by + blockSize, height - 2);
+            uint32_t xEnd = std::min(bx + blockSize, width - 2);
+
+            uint32_t intraCost = 0;
+            uint32_t interCost = 0;
+            for (uint32_t y = by; y < yEnd; y += 2) {
+                const uint8_t *row = luma + y * stride;
+                const uint8_t *below = row + 2 * stride;
+                for (uint32_t x = bx; x < xEnd; x += 2) {
+                    intraCost += std::abs(row[x] - row[x + 2]) + std::abs(row[x] - below[x]);
+                }
+
+                if (previousLuma != nullptr) {
+                    const uint8_t *previousRow = previousLuma + y * stride;
+                    for (uint32_t x = bx; x < xEnd; x += 2) {
+                        interCost += std::abs(row[x] - previousRow[x]);
+                    }
+                }
+            }
+
+            complexity += previousLuma != nullptr ? std::min(intraCost, interCost) : intraCost;
+        }
+    }
+
+    return std::max(complexity, 1.0);
+}
+
+void RateController::addFrame(bool intra, double complexity) {
+    queue.push_back({intra, std::max(complexity, 1.0)});
+}
+
+bool RateController::isReady() const {
+    return queue.size() > config.lookahead;
+}
+
+RateDecision RateController::beginFrame() {
+    if (frameInProgress) {
+        throw std::runtime_error("rate control frame begun before the previous one ended");
+    }
+    if (queue.empty()) {
+        throw std::runtime_error("rate control has no queued frame");
+    }
+
+    currentFrame = queue.front();
+    int type = currentFrame.intra ? 0 : 1;
+
+    RateDecision decision = {frameCount, config.qp, static_cast<uint64_t>(averageFrameBits)};
+    if (config.mode == RateControlMode::ConstantQp) {
+        decision.qp = config.qp - (currentFrame.intra ? config.intraQpOffset : 0);
+    } else {
+        double target = planTargetBits();
+
+        // Calibrate the model of a frame type so its first frame is coded at the initial QP
+        if (model[type] <= 0.0) {
+            model[type] = target * qpToQscale(config.qp) / currentFrame.complexity;
+        }
+
+        double qscale = model[type] * currentFrame.complexity / target;
+        decision.qp = static_cast<int>(std::lround(qscaleToQp(qscale)));
+        decision.targetBits = static_cast<uint64_t>(target);
+
+        // Keep the quality of consecutive inter frames steady
+        if (!currentFrame.intra && lastInterQp >= 0) {
+            decision.qp = std::clamp(decision.qp, lastInterQp - config.maxQpStep,
+                                     lastInterQp + config.maxQpStep);
+        }
+    }
+
+    decision.qp = std::clamp(decision.qp, config.minQp, config.maxQp);
+    if (!currentFrame.intra) {
+        lastInterQp = decision.qp;
+    }
+
+    queue.pop_front();
+    frameInProgress = true;
+    currentDecision = decision;
+    return decision;
+}
+
+RateReport RateController::endFrame(uint64_t actualBits) {
+    if (!frameInProgress) {
+        throw std::runtime_error("rate control frame ended without being begun");
+    }
+    frameInProgress = false;
+
+    // Refine the model of this frame type with what the frame actually cost
+    int type = currentFrame.intra ? 0 : 1;
+    double observed =
+        std::max<double>(actualBits, 1.0) * qpToQscale(currentDecision.qp) / currentFrame.complexity;
+    model[type] = model[type] > 0.0 ? 0.5 * model[type] + 0.5 * observed : observed;
+
+    double frameWeight = weight(currentFrame.complexity);
+    averageWeight = frameCount == 0 ? frameWeight : 0.9 * averageWeight + 0.1 * frameWeight;
+
+    // The decoder removes the frame from its buffer, then the channel refills it
+    vbvFill -= static_cast<double>(actualBits);
+    if (vbvFill < 0.0) {
+        if (config.mode != RateControlMode::ConstantQp) {
+            LOG_WARN("VBV underflow on frame " + std::to_string(frameCount) + " (" +
+                     std::to_string(actualBits) + " bits)");
+        }
+        vbvFill = 0.0;
+    }
+    vbvFill = std::min(vbvFill + vbvInflow, vbvSize);
+
+    totalBits += static_cast<double>(actualBits);
+
+    RateReport report = {frameCount,           currentFrame.intra, currentDecision.qp,
+                         currentDecision.targetBits, actualBits,   vbvFill / vbvSize};
+    ++frameCount;
+    return report;
+}
+
+const RateControlConfig &RateController::getConfig() const {
+    return config;
+}
+
+double RateController::qpToQscale(double qp) {
+    // The H.264 quantiser step size doubles every 6 QP
+    return 0.85 * std::pow(2.0, (qp - 12.0) / 6.0);
+}
+
+double RateController::qscaleToQp(double qscale) {
+    return 12.0 + 6.0 * std::log2(qscale / 0.85);
+}
+
+double RateController::weight(double complexity) {
+    // Complex frames get more bits, but less than proportionally (as x264's qcompress 0.6)
+    return std::pow(complexity, 0.4);
+}
+
+double RateController::planTargetBits() const {
+    // Mean weight over the lookahead window, steadied by the history of coded frames
+    double windowWeight = 0.0;
+    for (const QueuedFrame &frame : queue) {
+        windowWeight += weight(frame.complexity);
+    }
+    double meanWeight = windowWeight / queue.size();
+    if (frameCount > 0) {
+        meanWeight = 0.5 * meanWeight + 0.5 * averageWeight;
+    }
+
+    // Steer back towards the long-term target: the buffer level for CBR, total bits for VBR
+    double drift;
+    if (config.mode == RateControlMode::Cbr) {
+        drift = (vbvFill - vbvSize * config.vbvInitialFullness) / vbvSize;
+    } else {
+        drift = (averageFrameBits * frameCount - totalBits) / vbvSize;
+    }
+    double correction = std::clamp(1.0 + drift, 0.5, 1.5);
+
+    // Share out the budget of the window and scale it down wherever the planned frames would
+    // drain the buffer below its low-water mark
+    const double lowWater = 0.1 * vbvSize;
+    double planned = 0.0;
+    double scale = 1.0;
+    for (size_t k = 0; k < queue.size(); ++k) {
+        planned += averageFrameBits * correction * weight(queue[k].complexity) / meanWeight;
+        double available = vbvFill + k * vbvInflow - lowWater;
+        scale = std::min(scale, std::max(available, 0.0) / planned);
+    }
+
+    double target = averageFrameBits * correction * weight(queue.front().complexity) /
+                    meanWeight * scale;
+
+    // A CBR buffer that would overflow must be drained, so spend at least the excess
+    if (config.mode == RateControlMode::Cbr) {
+        target = std::max(target, vbvFill + vbvInflow - vbvSize);
+    }
+
+    return std::max(target, 0.05 * averageFrameBits);
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+/**
+ * @enum RateControlMode
+ * @brief Selects how the encoder governs bitrate
+ *
+ * ConstantQp: Every frame is coded at a fixed QP, the bitrate follows the content
+ * Cbr: Constant bitrate, constrained by a VBV/HRD buffer drained at the target bitrate
+ * Vbr: Variable bitrate averaging the target bitrate, capped by a VBV buffer drained at the
+ *      maximum bitrate
+ */
+enum class RateControlMode { ConstantQp, Cbr, Vbr };
+
+/**
+ * @struct RateControlConfig
+ * @brief Configuration options for a RateController
+ */
+struct RateControlConfig {
+    /// @brief Rate control mode
+    RateControlMode mode = RateControlMode::Cbr;
+
+    /// @brief Target average bitrate in bits per second
+    uint32_t bitrate = 4000000;
+
+    /// @brief Peak bitrate in bits per second (Vbr only)
+    uint32_t maxBitrate = 6000000;
+
+    /// @brief Size of the VBV/HRD buffer in bits. If 0, one second at the target bitrate
+    uint32_t vbvBufferSize = 0;
+
+    /// @brief Fullness of the VBV buffer when the stream starts, as a fraction of its size
+    float vbvInitialFullness = 0.9f;
+
+    /// @brief Frame rate numerator
+    uint32_t frameRateNumerator = 60;
+
+    /// @brief Frame rate denominator
+    uint32_t frameRateDenominator = 1;
+
+    /// @brief QP of P frames in ConstantQp mode, and of the first frame otherwise
+    int qp = 26;
+
+    /// @brief QP offset applied to intra frames in ConstantQp mode
+    int intraQpOffset = 3;
+
+    /// @brief Lowest QP the controller may choose
+    int minQp = 10;
+
+    /// @brief Highest QP the controller may choose
+    int maxQp = 51;
+
+    /// @brief Largest QP change between consecutive inter frames
+    int maxQpStep = 4;
+
+    /// @brief Number of future frames whose complexity is known before a frame is coded
+    uint32_t lookahead = 0;
+};
+
+/**
+ * @struct RateDecision
+ * @brief Rate control decision for the frame about to be coded
+ */
+struct RateDecision {
+    /// @brief Index of the frame in coding order
+    uint64_t frameIndex;
+
+    /// @brief QP to code the frame with
+    int qp;
+
+    /// @brief Number of bits the frame should take
+    uint64_t targetBits;
+};
+
+/**
+ * @struct RateReport
+ * @brief Target and actual size of a coded frame
+ */
+struct RateReport {
+    /// @brief Index of the frame in coding order
+    uint64_t frameIndex;
+
+    /// @brief Whether the frame was intra coded
+    bool intra;
+
+    /// @brief QP the frame was coded with
+    int qp;
+
+    /// @brief Number of bits the controller asked for
+    uint64_t targetBits;
+
+    /// @brief Number of bits the frame took
+    uint64_t actualBits;
+
+    /// @brief Fullness of the VBV buffer after the frame, as a fraction of its size
+    double vbvFullness;
+};
+
+/**
+ * @class RateController
+ * @brief Chooses per-frame QPs and bit budgets to meet a bitrate under a VBV buffer model
+ *
+ * Frames enter the controller through addFrame() with a cheap complexity estimate (see
+ * estimateComplexity). Once "lookahead" further frames have been added, beginFrame() returns
+ * the QP and target size of the oldest frame, and endFrame() feeds back the size it was coded
+ * to. Budgets are shared out in proportion to a compressed complexity over the lookahead
+ * window, scaled down where the planned frames would underflow the VBV buffer. The QP is
+ * derived from a per-frame-type model of bits x qscale / complexity, which is refined after
+ * every frame. The decisions drive the software encoder's QP directly.
+ */
+class RateController {
+  public:
+    /**
+     * @brief Creates a controller with a full (configured) VBV buffer
+     * @param config Rate control options
+     */
+    explicit RateController(const RateControlConfig &config = RateControlConfig());
+
+    /**
+     * @brief Estimates the coding complexity of a frame from its luma plane
+     *
+     * Samples every other pixel of every other row. Without a previous frame the estimate is
+     * the sum of absolute horizontal and vertical gradients (an intra cost). With one, it is
+     * the lower of that and the sum of absolute differences to the previous frame (an inter
+     * cost). The result is only meaningful relative to other estimates of the same resolution
+     *
+     * @param luma Luma plane of the frame
+     * @param previousLuma Luma plane of the previous frame, or nullptr for an intra estimate
+     * @param width Width of the plane in pixels
+     * @param height Height of the plane in pixels
+     * @param stride Distance between rows in bytes
+     * @return The complexity estimate, at least 1
+     */
+    static double estimateComplexity(const uint8_t *luma, const uint8_t *previousLuma,
+                                     uint32_t width, uint32_t height, size_t stride);
+
+    /**
+     * @brief Queues a frame for coding
+     * @param intra Whether the frame will be intra coded
+     * @param complexity Complexity estimate of the frame
+     */
+    void addFrame(bool intra, double complexity);
+
+    /**
+     * @brief Returns whether enough frames are queued to fill the lookahead window
+     */
+    bool isReady() const;
+
+    /**
+     * @brief Decides the QP and bit budget of the oldest queued frame
+     *
+     * May be called before isReady() returns true when the stream is being flushed
+     *
+     * @return The decision for the frame
+     * @throws std::runtime_error if no frame is queued or the previous frame was not ended
+     */
+    RateDecision beginFrame();
+
+    /**
+     * @brief Reports the coded size of the frame returned by beginFrame
+     * @param actualBits Size of the coded frame in bits
+     * @return Target and actual size of the frame
+     * @throws std::runtime_error if no frame was begun
+     */
+    RateReport endFrame(uint64_t actualBits);
+
+    /**
+     * @brief Returns the configuration of the controller
+     */
+    const RateControlConfig &getConfig() const;
+
+  protected:
+    /**
+     * @struct QueuedFrame
+     * @brief A frame waiting in the lookahead window
+     */
+    struct QueuedFrame {
+        /// @brief Whether the frame will be intra coded
+        bool intra;
+
+        /// @brief Complexity estimate of the frame
+        double complexity;
+    };
+
+    /// @brief Configuration the controller was created with
+    RateControlConfig config;
+
+    /// @brief Frames added but not yet begun, oldest first
+    std::deque<QueuedFrame> queue;
+
+    /// @brief Size of the VBV buffer in bits
+    double vbvSize;
+
+    /// @brief Bits currently in the VBV buffer
+    double vbvFill;
+
+    /// @brief Bits entering the VBV buffer per frame
+    double vbvInflow;
+
+    /// @brief Average number of bits per frame at the target bitrate
+    double averageFrameBits;
+
+    /// @brief Model constants (bits x qscale / complexity) of intra [0] and inter [1] frames
+    double model[2] = {0.0, 0.0};
+
+    /// @brief Running average of the compressed complexity of coded frames
+    double averageWeight = 0.0;
+
+    /// @brief Total bits of the frames coded so far
+    double totalBits = 0.0;
+
+    /// @brief Number of frames coded so far
+    uint64_t frameCount = 0;
+
+    /// @brief QP of the previous inter frame (-1 before the first)
+    int lastInterQp = -1;
+
+    /// @brief Whether a frame has been begun but not ended
+    bool frameInProgress = false;
+
+    /// @brief The frame that has been begun
+    QueuedFrame currentFrame = {};
+
+    /// @brief The decision made for the frame that has been begun
+    RateDecision currentDecision = {};
+
+    /**
+     * @brief Converts a QP to the H.264 quantiser step size
+     */
+    static double qpToQscale(double qp);
+
+    /**
+     * @brief Converts a quantiser step size to a QP
+     */
+    static double qscaleToQp(double qscale);
+
+    /**
+     * @brief Compresses a complexity estimate so bits are spread less than proportionally
+     */
+    static double weight(double complexity);
+
+    /**
+     * @brief Plans the bit budget of the oldest queued frame
+     * @return The budget in bits
+     */
+    double planTargetBits() const;
+};
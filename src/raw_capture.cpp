@@ -0,0 +1,322 @@
+#include "raw_capture.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "yuv_frame.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+/// @brief Alignment of O_DIRECT buffers, offsets and sizes
+constexpr size_t pageSize = 4096;
+
+size_t alignUp(size_t value) {
+    return (value + pageSize - 1) / pageSize * pageSize;
+}
+
+/**
+ * @struct CaptureMetrics
+ * @brief Metrics shared by every capture of the process
+ */
+struct CaptureMetrics {
+    Counter &frames;
+    Counter &droppedFrames;
+    Counter &bytesWritten;
+    Gauge &queuedChunks;
+};
+
+const CaptureMetrics &getCaptureMetrics() {
+    static const CaptureMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        return CaptureMetrics{
+            registry.getCounter("vulkantest_capture_frames_total", "Frames captured"),
+            registry.getCounter("vulkantest_capture_dropped_frames_total",
+                                "Frames dropped because the disk fell behind"),
+            registry.getCounter("vulkantest_capture_bytes_written_total",
+                                "Bytes written to capture files"),
+            registry.getGauge("vulkantest_capture_queued_chunks",
+                              "Capture chunks waiting to be written")};
+    }();
+    return metrics;
+}
+
+} // namespace
+
+RawCapture::RawCapture(const RawCaptureConfig &config, uint32_t width, uint32_t height)
+    : config(config), width(width), height(height) {
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("capture size must not be zero");
+    }
+
+    size_t chromaSize = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+    pixelSize = config.format == RawCaptureFormat::Rgba
+                    ? static_cast<size_t>(width) * height * 4
+                    : static_cast<size_t>(width) * height + 2 * chromaSize;
+    if (config.format == RawCaptureFormat::Y4m) {
+        frameHeader = "FRAME\n";
+    }
+
+    // A chunk holds at least one frame after the remainder carried over from the last one
+    this->config.chunkSize = alignUp(std::max(config.chunkSize, getFrameSize() + pageSize));
+    this->config.chunkCount = std::max(config.chunkCount, 2u);
+
+#ifdef _WIN32
+    throw std::runtime_error("raw capture is not supported on Windows");
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if (config.direct) {
+        fd = open(config.path.c_str(), flags | O_DIRECT, 0644);
+        direct = fd >= 0;
+        if (fd < 0 && errno == EINVAL) {
+            LOG_WARN("O_DIRECT is not supported for " + config.path + ", using buffered writes.");
+        }
+    }
+    if (fd < 0) {
+        fd = open(config.path.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        throw std::runtime_error("failed to create capture file " + config.path);
+    }
+
+    for (uint32_t i = 0; i < this->config.chunkCount; ++i) {
+        void *chunk = std::aligned_alloc(pageSize, this->config.chunkSize);
+        if (chunk == nullptr) {
+            release();
+            throw std::runtime_error("failed to allocate capture buffers");
+        }
+        chunks.push_back(static_cast<uint8_t *>(chunk));
+        freeChunks.push_back(i);
+    }
+    currentChunk = freeChunks.front();
+    freeChunks.pop_front();
+
+    if (config.format == RawCaptureFormat::Y4m) {
+        // Chroma is sited between the luma samples, as the 2x2 average puts it
+        std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" +
+                             std::to_string(height) + " F" +
+                             std::to_string(config.frameRateNumerator) + ":" +
+                             std::to_string(config.frameRateDenominator) +
+                             " Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+        std::memcpy(chunks[currentChunk], header.data(), header.size());
+        currentFill = header.size();
+    }
+
+    startTime = std::chrono::steady_clock::now();
+    writer = std::thread([this] { writeLoop(); });
+
+    LOG_INFO("Capturing " + std::to_string(width) + "x" + std::to_string(height) + " frames to " +
+             config.path + (direct ? " (O_DIRECT)." : " (buffered)."));
+#endif
+}
+
+RawCapture::~RawCapture() {
+    try {
+        close();
+    } catch (const std::exception &e) {
+        LOG_ERROR(e.what());
+    }
+}
+
+bool RawCapture::writeFrame(const uint8_t *rgba, ptrdiff_t stride) {
+    TRACE_SCOPE("capture frame");
+    uint8_t *out;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        if (closed) {
+            throw std::runtime_error("capture is closed");
+        }
+        if (stats.frames + stats.droppedFrames == 0) {
+            startTime = std::chrono::steady_clock::now();
+        }
+
+        if (currentFill + getFrameSize() > config.chunkSize) {
+            if (freeChunks.empty()) {
+                ++stats.droppedFrames;
+                getCaptureMetrics().droppedFrames.add();
+                return false;
+            }
+            rotateChunk();
+        }
+        out = chunks[currentChunk] + currentFill;
+        currentFill += getFrameSize();
+        ++stats.frames;
+    }
+    getCaptureMetrics().frames.add();
+
+    // The writer never touches the current chunk, so it is filled without the lock
+    std::memcpy(out, frameHeader.data(), frameHeader.size());
+    convertFrame(rgba, stride, out + frameHeader.size());
+    return true;
+}
+
+void RawCapture::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) {
+            return;
+        }
+        closed = true;
+        if (writer.joinable()) {
+            // The last page is padded for O_DIRECT and truncated away below
+            size_t size = alignUp(currentFill);
+            std::memset(chunks[currentChunk] + currentFill, 0, size - currentFill);
+            if (size > 0) {
+                queue.push_back({currentChunk, size, currentOffset});
+                getCaptureMetrics().queuedChunks.add(1.0);
+            }
+            closing = true;
+        }
+    }
+    condition.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+
+#ifndef _WIN32
+    uint64_t fileSize = currentOffset + currentFill;
+    if (fd >= 0 && ftruncate(fd, static_cast<off_t>(fileSize)) != 0 && error.empty()) {
+        error = "failed to truncate capture file " + config.path;
+    }
+#endif
+    release();
+
+    RawCaptureStats totals = getStats();
+    LOG_INFO("Captured " + std::to_string(totals.frames) + " frames (" +
+             std::to_string(totals.droppedFrames) + " dropped) to " + config.path + " at " +
+             std::to_string(static_cast<uint64_t>(totals.getBandwidth() / 1e6)) + " MB/s.");
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
+
+RawCaptureStats RawCapture::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+size_t RawCapture::getFrameSize() const {
+    return frameHeader.size() + pixelSize;
+}
+
+void RawCapture::rotateChunk() {
+    size_t aligned = currentFill / pageSize * pageSize;
+    size_t next = freeChunks.front();
+    freeChunks.pop_front();
+    std::memcpy(chunks[next], chunks[currentChunk] + aligned, currentFill - aligned);
+
+    queue.push_back({currentChunk, aligned, currentOffset});
+    getCaptureMetrics().queuedChunks.add(1.0);
+    condition.notify_all();
+
+    currentOffset += aligned;
+    currentFill -= aligned;
+    currentChunk = next;
+}
+
+void RawCapture::convertFrame(const uint8_t *rgba, ptrdiff_t stride, uint8_t *out) const {
+    if (config.format == RawCaptureFormat::Rgba) {
+        size_t rowSize = static_cast<size_t>(width) * 4;
+        for (uint32_t y = 0; y < height; ++y) {
+            std::memcpy(out + y * rowSize, rgba + y * stride, rowSize);
+        }
+        return;
+    }
+
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (height + 1) / 2;
+    Yuv420Planes planes;
+    planes.luma = out;
+    planes.lumaStride = width;
+    planes.cb = out + static_cast<size_t>(width) * height;
+    planes.width = width;
+    planes.height = height;
+    if (config.format == RawCaptureFormat::Nv12) {
+        planes.cr = planes.cb + 1;
+        planes.chromaStride = 2 * chromaWidth;
+        planes.chromaStep = 2;
+    } else {
+        planes.cr = planes.cb + static_cast<size_t>(chromaWidth) * chromaHeight;
+        planes.chromaStride = chromaWidth;
+    }
+    convertRgbaToYuv420(rgba, stride, width, height, planes);
+}
+
+void RawCapture::writeLoop() {
+#ifndef _WIN32
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return !queue.empty() || closing; });
+        if (queue.empty()) {
+            return;
+        }
+        Write write = queue.front();
+        queue.pop_front();
+        lock.unlock();
+
+        uint64_t writeStart = Tracer::isEnabled() ? Tracer::now() : 0;
+        const uint8_t *data = chunks[write.chunk];
+        size_t written = 0;
+        std::string failure;
+        while (written < write.size) {
+            ssize_t result = pwrite(fd, data + written, write.size - written,
+                                    static_cast<off_t>(write.offset + written));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                failure = "failed to write capture file " + config.path + ": " +
+                          std::strerror(result < 0 ? errno : EIO);
+                break;
+            }
+            written += static_cast<size_t>(result);
+        }
+
+        // Buffered writes are flushed and dropped from the page cache, as O_DIRECT would
+        if (!direct && failure.empty()) {
+            sync_file_range(fd, static_cast<off_t>(write.offset), static_cast<off_t>(write.size),
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                                SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd, static_cast<off_t>(write.offset), static_cast<off_t>(write.size),
+                          POSIX_FADV_DONTNEED);
+        }
+        if (writeStart != 0) {
+            Tracer::record("capture write", writeStart, Tracer::now());
+        }
+
+        lock.lock();
+        if (!failure.empty() && error.empty()) {
+            error = failure;
+        }
+        stats.bytesWritten += written;
+        getCaptureMetrics().bytesWritten.add(written);
+        getCaptureMetrics().queuedChunks.add(-1.0);
+        stats.seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        freeChunks.push_back(write.chunk);
+    }
+#endif
+}
+
+void RawCapture::release() {
+    for (uint8_t *chunk : chunks) {
+        std::free(chunk);
+    }
+    chunks.clear();
+#ifndef _WIN32
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+}
@@ -0,0 +1,230 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @enum RawCaptureFormat
+ * @brief Layout of the frames written by a RawCapture
+ *
+ * Y4m: YUV4MPEG2 stream of BT.601 limited-range I420 frames, readable by ffmpeg and most
+ * quality tools. Nv12: headerless semi-planar 4:2:0 frames. Rgba: headerless frames exactly
+ * as read back, four bytes per pixel
+ */
+enum class RawCaptureFormat { Y4m, Nv12, Rgba };
+
+/**
+ * @struct RawCaptureConfig
+ * @brief Configuration options for a RawCapture
+ */
+struct RawCaptureConfig {
+    /// @brief Path of the capture file
+    std::string path;
+
+    /// @brief Layout of the frames
+    RawCaptureFormat format = RawCaptureFormat::Y4m;
+
+    /// @brief Frame rate written in the Y4M header
+    uint32_t frameRateNumerator = 30;
+    uint32_t frameRateDenominator = 1;
+
+    /// @brief Size of each write in bytes, rounded up to hold at least one frame
+    size_t chunkSize = 8 << 20;
+
+    /// @brief Number of chunks. One is filled while the others are queued or being written,
+    /// so more chunks absorb longer disk stalls before frames are dropped
+    uint32_t chunkCount = 4;
+
+    /// @brief Whether to bypass the page cache with O_DIRECT. File systems that refuse it
+    /// fall back to buffered writes that are dropped from the cache once on disk
+    bool direct = true;
+};
+
+/**
+ * @struct RawCaptureStats
+ * @brief Totals of a RawCapture
+ */
+struct RawCaptureStats {
+    /// @brief Frames accepted for writing
+    uint64_t frames = 0;
+
+    /// @brief Frames dropped because every chunk was still queued for the disk
+    uint64_t droppedFrames = 0;
+
+    /// @brief Bytes the disk has written
+    uint64_t bytesWritten = 0;
+
+    /// @brief Time from the first frame to the last completed write, in seconds
+    double seconds = 0.0;
+
+    /**
+     * @brief Returns the sustained write bandwidth in bytes per second
+     */
+    double getBandwidth() const { return seconds > 0.0 ? bytesWritten / seconds : 0.0; }
+};
+
+/**
+ * @class RawCapture
+ * @brief Streams lossless frames to disk without stalling the render loop
+ *
+ * Frames are converted straight from the readback buffer into large page-aligned chunks,
+ * which a writer thread hands to the disk in order. With O_DIRECT the data bypasses the page
+ * cache, so multi-GB/s captures neither evict the working set nor pay for a second copy.
+ * While one chunk is filled, the others are queued, so the disk always has the next write
+ * waiting.
+ *
+ * O_DIRECT writes must be multiples of the page size. A full chunk is written up to its last
+ * page boundary and the remainder is carried into the next chunk; the final partial page is
+ * padded and the file truncated to its real size on close().
+ *
+ * writeFrame() never waits for the disk: when no chunk is free, the frame is dropped and
+ * counted. Not thread-safe; frames are written from one thread.
+ */
+class RawCapture {
+  public:
+    /**
+     * @brief Creates the capture file and starts the writer thread
+     * @param config Capture options
+     * @param width Width of the frames in pixels
+     * @param height Height of the frames in pixels
+     * @throws std::runtime_error if the file cannot be created or the buffers allocated
+     */
+    RawCapture(const RawCaptureConfig &config, uint32_t width, uint32_t height);
+
+    /**
+     * @brief Closes the capture; errors are logged rather than thrown
+     */
+    ~RawCapture();
+
+    RawCapture(const RawCapture &) = delete;
+    RawCapture &operator=(const RawCapture &) = delete;
+
+    /**
+     * @brief Queues one frame
+     * @param rgba First pixel of the frame, four bytes per pixel (R, G, B, A)
+     * @param stride Distance between rows in bytes
+     * @return False if the frame was dropped because the disk is behind
+     * @throws std::runtime_error if an earlier write failed
+     */
+    bool writeFrame(const uint8_t *rgba, ptrdiff_t stride);
+
+    /**
+     * @brief Writes the queued frames, truncates the file to its size and logs the totals
+     * @throws std::runtime_error if a write failed
+     */
+    void close();
+
+    /**
+     * @brief Returns the totals so far
+     */
+    RawCaptureStats getStats() const;
+
+    /**
+     * @brief Returns the size of one frame in the file, including its header
+     */
+    size_t getFrameSize() const;
+
+  protected:
+    /**
+     * @struct Write
+     * @brief A chunk queued for the disk
+     */
+    struct Write {
+        /// @brief Index of the chunk
+        size_t chunk;
+
+        /// @brief Bytes to write, a multiple of the page size
+        size_t size;
+
+        /// @brief Offset in the file
+        uint64_t offset;
+    };
+
+    /// @brief Capture options
+    RawCaptureConfig config;
+
+    /// @brief Size of the frames in pixels
+    uint32_t width;
+    uint32_t height;
+
+    /// @brief Per-frame header ("FRAME\n" for Y4M)
+    std::string frameHeader;
+
+    /// @brief Size of a frame's pixels in the file
+    size_t pixelSize;
+
+    /// @brief The capture file
+    int fd = -1;
+
+    /// @brief Whether the file was opened with O_DIRECT
+    bool direct = false;
+
+    /// @brief Page-aligned chunks
+    std::vector<uint8_t *> chunks;
+
+    /// @brief Chunk being filled
+    size_t currentChunk = 0;
+
+    /// @brief Bytes of the current chunk filled
+    size_t currentFill = 0;
+
+    /// @brief Offset in the file of the current chunk
+    uint64_t currentOffset = 0;
+
+    /// @brief Guards the queue, free chunks, stats and error
+    mutable std::mutex mutex;
+
+    /// @brief Signalled when a write is queued or completes
+    std::condition_variable condition;
+
+    /// @brief Chunks ready to be filled
+    std::deque<size_t> freeChunks;
+
+    /// @brief Chunks queued for the disk, in file order
+    std::deque<Write> queue;
+
+    /// @brief Set by close() once the last chunk is queued
+    bool closing = false;
+
+    /// @brief Whether close() has finished
+    bool closed = false;
+
+    /// @brief First write error, reported by the next call
+    std::string error;
+
+    /// @brief Totals so far
+    RawCaptureStats stats;
+
+    /// @brief Time of the first frame
+    std::chrono::steady_clock::time_point startTime;
+
+    /// @brief Writes the queued chunks
+    std::thread writer;
+
+    /**
+     * @brief Queues the current chunk up to its last page boundary and moves the remainder
+     * to a free chunk, which becomes current. Called with the lock held
+     */
+    void rotateChunk();
+
+    /**
+     * @brief Converts a frame into memory in the capture format
+     */
+    void convertFrame(const uint8_t *rgba, ptrdiff_t stride, uint8_t *out) const;
+
+    /**
+     * @brief Runs on the writer thread
+     */
+    void writeLoop();
+
+    /**
+     * @brief Frees the chunks and closes the file
+     */
+    void release();
+};
@@ -1,12 +1,119 @@
 #include "renderer.hpp"
+#include "shader_registry.hpp"
 
-VulkanRenderer::VulkanRenderer(SurfaceProvider *surfaceProvider)
-    : surfaceProvider(surfaceProvider) {
+namespace {
+
+/// @brief Format of the render targets: linear RGBA, which the encoder's colour conversion
+/// expects to read back
+constexpr VkFormat renderTargetFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+/**
+ * @brief Limits a fraction of the output size to what the render targets can hold
+ */
+float clampRenderScale(float scale) {
+    return std::clamp(scale, 1.0f / 16.0f, 1.0f);
+}
+
+/**
+ * @brief Returns a barrier on the colour of a single-level image
+ */
+VkImageMemoryBarrier makeImageBarrier(VkImage image, VkImageLayout oldLayout,
+                                      VkImageLayout newLayout, VkAccessFlags srcAccess,
+                                      VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+/// @brief Renderers created so far, used to name their GPU tracks
+std::atomic<uint32_t> rendererCount{0};
+
+/**
+ * @struct RendererMetrics
+ * @brief Metrics shared by every renderer of the process
+ */
+struct RendererMetrics {
+    Counter &frames;
+    Counter &renderScaleChanges;
+    Histogram &recordSeconds;
+    Histogram &cullSeconds;
+    Histogram &gpuFrameSeconds;
+    Histogram &gpuCullSeconds;
+    Histogram &gpuRenderPassSeconds;
+};
+
+const RendererMetrics &getRendererMetrics() {
+    static const RendererMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        const char *cpuHelp = "Host time of renderer stages";
+        const char *gpuHelp = "Device time of renderer stages, from timestamp queries";
+        return RendererMetrics{
+            registry.getCounter("vulkantest_frames_rendered_total", "Frames submitted"),
+            registry.getCounter("vulkantest_render_scale_changes_total",
+                                "Render size changes made by dynamic resolution"),
+            registry.getHistogram("vulkantest_render_cpu_seconds", cpuHelp, {{"stage", "record"}}),
+            registry.getHistogram("vulkantest_render_cpu_seconds", cpuHelp, {{"stage", "cull"}}),
+            registry.getHistogram("vulkantest_render_gpu_seconds", gpuHelp, {{"stage", "frame"}}),
+            registry.getHistogram("vulkantest_render_gpu_seconds", gpuHelp, {{"stage", "cull"}}),
+            registry.getHistogram("vulkantest_render_gpu_seconds", gpuHelp,
+                                  {{"stage", "render_pass"}})};
+    }();
+    return metrics;
+}
+
+/**
+ * @brief Returns the RGBA pixels of a square checkerboard of 8x8 cells, shaded diagonally so
+ * that every mip level differs
+ */
+std::vector<uint8_t> makeProceduralTexture(uint32_t size) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+    uint8_t *pixel = pixels.data();
+    for (uint32_t y = 0; y < size; ++y) {
+        for (uint32_t x = 0; x < size; ++x, pixel += 4) {
+            uint32_t cellX = static_cast<uint32_t>(uint64_t(x) * 8 / size);
+            uint32_t cellY = static_cast<uint32_t>(uint64_t(y) * 8 / size);
+            uint32_t base = ((cellX ^ cellY) & 1) != 0 ? 255 : 160;
+            pixel[0] = static_cast<uint8_t>(base);
+            pixel[1] = static_cast<uint8_t>(base - uint64_t(x) * 64 / size);
+            pixel[2] = static_cast<uint8_t>(base - uint64_t(y) * 64 / size);
+            pixel[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+double getSecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+VulkanRenderer::VulkanRenderer(SurfaceProvider *surfaceProvider, const RendererConfig &config)
+    : VulkanRenderer(std::make_shared<VulkanContext>(surfaceProvider, config.context), config) {}
+
+VulkanRenderer::VulkanRenderer(std::shared_ptr<VulkanContext> context,
+                               const RendererConfig &config)
+    : context(std::move(context)), config(config), cullingMode(config.cullingMode),
+      instanceCount(config.instanceCount) {
     init();
 }
 
+std::shared_ptr<VulkanContext> VulkanRenderer::getContext() const {
+    return context;
+}
+
 VkInstance VulkanRenderer::getInstance() const {
-    return instance;
+    return context->getInstance();
 }
 
 VkDevice VulkanRenderer::getDevice() const {
@@ -14,11 +121,11 @@ VkDevice VulkanRenderer::getDevice() const {
 }
 
 VkPhysicalDevice VulkanRenderer::getPhysicalDevice() const {
-    return physicalDevice;
+    return context->getPhysicalDevice();
 }
 
 uint32_t VulkanRenderer::getGraphicsQueueFamilyIndex() {
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    const VulkanContext::QueueFamilyIndices &indices = context->getQueueFamilies();
 
     if (!indices.graphicsFamily.has_value()) {
         throw std::runtime_error("failed to find graphics queue family");
@@ -27,262 +134,80 @@ uint32_t VulkanRenderer::getGraphicsQueueFamilyIndex() {
     return indices.graphicsFamily.value();
 }
 
-std::vector<char> VulkanRenderer::readFile(const std::string &filename) {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file");
-    }
-
-    size_t fileSize = (size_t)file.tellg();
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-
-    return buffer;
+AssetFile VulkanRenderer::readFile(const std::string &filename) {
+    return AssetFile(filename);
 }
 
 void VulkanRenderer::init() {
     LOG_INFO("Initialising Vulkan renderer...");
 
-    // Create the Vulkan instance (entry point into the Vulkan API)
-    createInstance();
-
-    // Set up the debug messenger (if validation layers are enabled)
-    setupDebugMessenger();
+    device = context->getDevice();
+    surface = context->getSurface();
 
-    // If we have a surface provider, create and attach the VK surface
-    if (surfaceProvider) {
-        surface = surfaceProvider->createSurface(instance);
-        if (surface != VK_NULL_HANDLE) {
-            LOG_DEBUG("VK surface attached. Enabling extension " +
-                      std::string(VK_KHR_SWAPCHAIN_EXTENSION_NAME));
-            deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-        }
+    // GPU culling writes the draw count on the device, which requires drawIndirectCount
+    if (cullingMode == CullingMode::Gpu && !context->isDrawIndirectCountSupported()) {
+        LOG_WARN("Device does not support drawIndirectCount, falling back to CPU culling");
+        cullingMode = CullingMode::Cpu;
     }
 
-    // Pick the physical device
-    pickPhysicalDevice();
-
-    // Create a logical device from the physical device
-    createLogicalDevice();
+    // The cull shader names each surviving instance through firstInstance, which indirect
+    // draws may only set with drawIndirectFirstInstance
+    if (cullingMode == CullingMode::Gpu && !context->isDrawIndirectFirstInstanceSupported()) {
+        LOG_WARN("Device does not support drawIndirectFirstInstance, falling back to CPU culling");
+        cullingMode = CullingMode::Cpu;
+    }
 
-    // Create a swap chain if we have a surface attached
+    // The scene is always rendered offscreen at the output size, and scaled into a swap chain
+    // if we have a surface attached
     if (surface != VK_NULL_HANDLE) {
         createSwapChain();
-        createImageViews();
     }
+    createRenderTargets();
+    createImageViews();
 
     // Create objects for our graphics pipeline
     createRenderPass();
+    createDescriptorSetLayouts();
     createGraphicsPipeline();
+    createCullPipeline();
     createFramebuffers();
+    if (surface != VK_NULL_HANDLE && !presentBlit) {
+        createPresentPipeline();
+        createPresentDescriptorSets();
+        createPresentFramebuffers();
+    }
 
     // Create objects to draw our frames
     createCommandPool();
+    createSceneBuffers();
+    createFrameUniformBuffer();
+    createTextures();
+    createDescriptorSets();
     createCommandBuffers();
     createSyncObjects();
-}
-
-void VulkanRenderer::setupDebugMessenger() {
-    if (!enableValidationLayers) {
-        return;
-    }
-
-    VkDebugUtilsMessengerCreateInfoEXT createInfo = {};
-    populateDebugMessengerCreateInfo(createInfo);
-
-    // Create the Vulkan debug messenger extension if available
-    if (createDebugUtilsMessengerEXT(&createInfo, nullptr) != VK_SUCCESS) {
-        throw std::runtime_error("failed to set up debug messenger");
-    }
-}
-
-void VulkanRenderer::populateDebugMessengerCreateInfo(
-    VkDebugUtilsMessengerCreateInfoEXT &createInfo) {
-    createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-
-    // Configure what severity levels will trigger the callback
-    createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-                                 VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-                                 VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-
-    // Configure which message types will be handled
-    createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-
-    createInfo.pfnUserCallback = debugCallback;
-    createInfo.pUserData = nullptr; // Optional user-specific data
-}
-
-VkResult
-VulkanRenderer::createDebugUtilsMessengerEXT(const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-                                             const VkAllocationCallbacks *pAllocator) {
-    // Query function pointer to the extension function (not loaded by default)
-    auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-        instance, "vkCreateDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        return func(instance, pCreateInfo, pAllocator, &debugMessenger);
-    } else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
-    }
-}
-
-void VulkanRenderer::destroyDebugUtilsMessenger(const VkAllocationCallbacks *pAllocator) {
-    // Destroy the debug messenger via its extension
-    auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-        instance, "vkDestroyDebugUtilsMessengerEXT");
-    if (func != nullptr) {
-        func(instance, debugMessenger, pAllocator);
-    }
-}
-
-void VulkanRenderer::createInstance() {
-    // Fail early if validation layers are requested but unavailable
-    if (enableValidationLayers && !checkValidationLayerSupport()) {
-        throw std::runtime_error("validation layers requested but not available");
-    }
-
-    // Fill in application info (optional, but helps some drivers optimise)
-    VkApplicationInfo appInfo = {};
-    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.pApplicationName = "Vulkan Renderer and Encoder";
-    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.pEngineName = "No Engine";
-    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_3;
-
-    // Fill in instance creation info
-    VkInstanceCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    createInfo.pApplicationInfo = &appInfo;
-
-    // Vulkan is a platform agnostic API, which means we need to pass an extension interface.
-    // List required extensions (e.g. from GLFW)
-    auto extensions = getRequiredExtensions();
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-    createInfo.ppEnabledExtensionNames = extensions.data();
-
-    // Enable validation layers if requested (when running in debug mode)
-    VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = {};
-    if (enableValidationLayers) {
-        createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-        createInfo.ppEnabledLayerNames = validationLayers.data();
-
-        // Hook debug messenger creation into instance creation
-        populateDebugMessengerCreateInfo(debugCreateInfo);
-        createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
-    } else {
-        createInfo.enabledLayerCount = 0;
-        createInfo.pNext = nullptr;
-    }
-
-    // Finally, create the Vulkan instance
-    if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create vulkan instance");
-    }
-}
-
-void VulkanRenderer::pickPhysicalDevice() {
-    uint32_t deviceCount = 0;
-    vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-
-    if (deviceCount == 0) {
-        throw std::runtime_error("failed to find GPUs with Vulkan support");
+    createTimestampQueries();
+    frameSnapshots.resize(maxFramesInFlight);
+
+    // Dynamic resolution is driven by the GPU frame times the timestamps measure
+    float maxScale = clampRenderScale(config.renderScale);
+    float minScale = std::min(clampRenderScale(config.minRenderScale), maxScale);
+    if (minScale < maxScale && timestampQueryPool == VK_NULL_HANDLE) {
+        LOG_WARN("Dynamic resolution requires timestamps, keeping the render size fixed");
+    } else if (minScale < maxScale) {
+        resolutionController.emplace(minScale, maxScale, config.gpuFrameBudgetMs);
     }
 
-    // Retrieve all physical devices
-    std::vector<VkPhysicalDevice> devices(deviceCount);
-    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-
-    // Select the first suitable physical device
-    for (const auto &device : devices) {
-        if (isDeviceSuitable(device)) {
-            physicalDevice = device;
-            break;
+    if (config.frameExport) {
+        if (surface != VK_NULL_HANDLE) {
+            throw std::runtime_error("frame export requires a headless renderer");
         }
+        frameExporter = std::make_unique<FrameExporter>(context, *config.frameExport,
+                                                        outputExtent, maxFramesInFlight);
     }
-
-    if (physicalDevice == VK_NULL_HANDLE) {
-        throw std::runtime_error("failed to find a suitable GPU");
-    }
-
-    // Log the selected device name
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
-
-    std::string deviceName = deviceProperties.deviceName;
-    LOG_INFO("Using device " + deviceName);
-}
-
-void VulkanRenderer::createLogicalDevice() {
-    // Find queue family indices for the selected physical device
-    QueueFamilyIndices indicies = findQueueFamilies(physicalDevice);
-
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indicies.graphicsFamily.value()};
-
-    // If surface is attached insert present queue family
-    if (surface != VK_NULL_HANDLE) {
-        uniqueQueueFamilies.insert(indicies.presentFamily.value());
-    }
-
-    // Iterate over queue families and fill queue create info
-    float queuePriority = 1.0f;
-    for (uint32_t queueFamily : uniqueQueueFamilies) {
-        VkDeviceQueueCreateInfo queueCreateInfo{};
-        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfo.queueFamilyIndex = queueFamily;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriority;
-        queueCreateInfos.push_back(queueCreateInfo);
-    }
-
-    // Enable required device features (none for now)
-    VkPhysicalDeviceFeatures deviceFeatures = {};
-
-    // Fill in the device creation info
-    VkDeviceCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.pQueueCreateInfos = queueCreateInfos.data();
-    createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-
-    createInfo.pEnabledFeatures = &deviceFeatures;
-
-    // Enable device extensions (e.g. H.264 encoding)
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
-
-    // Enable validation layers if requested
-    if (enableValidationLayers) {
-        createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-        createInfo.ppEnabledLayerNames = validationLayers.data();
-    } else {
-        createInfo.enabledLayerCount = 0;
-    }
-
-    // Create the logical device
-    if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create logical device");
-    }
-
-    // Retrieve a handle to the graphics queue from the created device
-    vkGetDeviceQueue(device, indicies.graphicsFamily.value(), 0, &graphicsQueue);
-
-    // Optionally retrieve handle to the present queue from the created device
-    if (surface != VK_NULL_HANDLE) {
-        vkGetDeviceQueue(device, indicies.presentFamily.value(), 0, &presentQueue);
-    }
-
-    LOG_INFO("Vulkan logical device created.");
 }
 
 void VulkanRenderer::createSwapChain() {
-    SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+    VulkanContext::SwapChainSupportDetails swapChainSupport = context->querySwapChainSupport();
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
     VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
@@ -302,9 +227,24 @@ void VulkanRenderer::createSwapChain() {
     createInfo.imageColorSpace = surfaceFormat.colorSpace;
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
-    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    // The output frames are blitted into the swapchain images where the surface allows it, and
+    // otherwise drawn into them by the present pass
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(context->getPhysicalDevice(), surfaceFormat.format,
+                                        &formatProperties);
+    if ((swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+        (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)) {
+        createInfo.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    } else {
+        if (presentBlit) {
+            LOG_WARN("Surface does not allow blits into its images, presenting with a render pass");
+        }
+        presentBlit = false;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    }
+
+    const VulkanContext::QueueFamilyIndices &indices = context->getQueueFamilies();
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
     if (indices.graphicsFamily != indices.presentFamily) {
@@ -337,25 +277,76 @@ void VulkanRenderer::createSwapChain() {
     LOG_INFO("Vulkan swapchain created.");
 }
 
+void VulkanRenderer::createRenderTargets() {
+    // Whole macroblocks can be read from the targets, whatever the output size
+    outputExtent = {config.width, config.height};
+    targetExtent = {(config.width + 15) & ~15u, (config.height + 15) & ~15u};
+    setRenderScale(clampRenderScale(config.renderScale));
+
+    // The present pass samples whichever images hold the output
+    VkImageUsageFlags sampled = presentBlit ? 0 : VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    renderTargets.resize(maxFramesInFlight);
+    renderTargetsMemory.resize(maxFramesInFlight);
+    for (size_t i = 0; i < (size_t)maxFramesInFlight; ++i) {
+        context->createImage(targetExtent.width, targetExtent.height, renderTargetFormat,
+                             VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | sampled,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderTargets[i],
+                             renderTargetsMemory[i]);
+    }
+
+    // Unless the scene is always rendered at the output size, it is scaled into output images
+    float maxScale = clampRenderScale(config.renderScale);
+    if (maxScale < 1.0f || clampRenderScale(config.minRenderScale) < maxScale) {
+        outputImages.resize(maxFramesInFlight);
+        outputImagesMemory.resize(maxFramesInFlight);
+        for (size_t i = 0; i < (size_t)maxFramesInFlight; ++i) {
+            context->createImage(targetExtent.width, targetExtent.height, renderTargetFormat,
+                                 VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT | sampled,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outputImages[i],
+                                 outputImagesMemory[i]);
+        }
+    }
+
+    LOG_INFO("Render targets created (" + std::to_string(outputExtent.width) + "x" +
+             std::to_string(outputExtent.height) + ", padded to " +
+             std::to_string(targetExtent.width) + "x" + std::to_string(targetExtent.height) +
+             ").");
+}
+
+void VulkanRenderer::setRenderScale(float scale) {
+    auto scaleSide = [scale](uint32_t side) {
+        return std::clamp<uint32_t>(static_cast<uint32_t>(std::lround(side * scale)), 1, side);
+    };
+    renderExtent = {scaleSide(outputExtent.width), scaleSide(outputExtent.height)};
+}
+
+VkImage VulkanRenderer::getOutputImage(uint32_t frameIndex) const {
+    return outputImages.empty() ? renderTargets[frameIndex] : outputImages[frameIndex];
+}
+
 void VulkanRenderer::recreateSwapChain() {
-    vkDeviceWaitIdle(device);
+    context->waitIdle();
 
     cleanupSwapChain();
 
     createSwapChain();
-    createImageViews();
-    createFramebuffers();
+    if (!presentBlit) {
+        createPresentFramebuffers();
+    }
 }
 
 void VulkanRenderer::createImageViews() {
-    swapChainImageViews.resize(swapChainImages.size());
+    renderTargetViews.resize(renderTargets.size());
 
-    for (size_t i = 0; i < swapChainImages.size(); i++) {
+    for (size_t i = 0; i < renderTargets.size(); i++) {
         VkImageViewCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        createInfo.image = swapChainImages[i];
+        createInfo.image = renderTargets[i];
         createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        createInfo.format = swapChainImageFormat;
+        createInfo.format = renderTargetFormat;
         createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
         createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
         createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -366,8 +357,7 @@ void VulkanRenderer::createImageViews() {
         createInfo.subresourceRange.baseArrayLayer = 0;
         createInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) !=
-            VK_SUCCESS) {
+        if (vkCreateImageView(device, &createInfo, nullptr, &renderTargetViews[i]) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image views!");
         }
     }
@@ -376,11 +366,14 @@ void VulkanRenderer::createImageViews() {
 }
 
 void VulkanRenderer::createGraphicsPipeline() {
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
+    auto start = std::chrono::steady_clock::now();
 
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    VkShaderModule vertShaderModule = loadShaderModule("vert.spv");
+    VkShaderModule fragShaderModule = loadShaderModule("frag.spv");
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    LOG_DEBUG("Graphics shader modules loaded in " + std::to_string(elapsed.count()) + " us");
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -449,10 +442,17 @@ void VulkanRenderer::createGraphicsPipeline() {
     dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
     dynamicState.pDynamicStates = dynamicStates.data();
 
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawPushConstants);
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &sceneDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) !=
         VK_SUCCESS) {
@@ -475,7 +475,7 @@ void VulkanRenderer::createGraphicsPipeline() {
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
+    if (vkCreateGraphicsPipelines(device, context->getPipelineCache(), 1, &pipelineInfo, nullptr,
                                   &graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline");
     }
@@ -486,22 +486,492 @@ void VulkanRenderer::createGraphicsPipeline() {
     LOG_INFO("Graphics pipeline created.");
 }
 
+void VulkanRenderer::createDescriptorSetLayouts() {
+    // The vertex shader reads per-instance transforms from the instance buffer, both shaders
+    // read the current frame's slot of the uniform ring through a dynamic offset, and the
+    // fragment shader samples the scene texture
+    std::array<VkDescriptorSetLayoutBinding, 3> sceneBindings = {};
+    sceneBindings[0].binding = 0;
+    sceneBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sceneBindings[0].descriptorCount = 1;
+    sceneBindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    sceneBindings[1].binding = 1;
+    sceneBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    sceneBindings[1].descriptorCount = 1;
+    sceneBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    sceneBindings[2].binding = 2;
+    sceneBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sceneBindings[2].descriptorCount = 1;
+    sceneBindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(sceneBindings.size());
+    layoutInfo.pBindings = sceneBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &sceneDescriptorSetLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create scene descriptor set layout");
+    }
+
+    // The cull pass reads the instances and writes the indirect commands and draw count
+    std::array<VkDescriptorSetLayoutBinding, 3> cullBindings = {};
+    for (uint32_t i = 0; i < cullBindings.size(); ++i) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    layoutInfo.pBindings = cullBindings.data();
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullDescriptorSetLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull descriptor set layout");
+    }
+}
+
+void VulkanRenderer::createCullPipeline() {
+    if (cullingMode != CullingMode::Gpu) {
+        return;
+    }
+
+    VkShaderModule cullShaderModule = loadShaderModule("cull.spv");
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline layout");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = cullShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = cullPipelineLayout;
+
+    if (vkCreateComputePipelines(device, context->getPipelineCache(), 1, &pipelineInfo, nullptr,
+                                 &cullPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline");
+    }
+
+    vkDestroyShaderModule(device, cullShaderModule, nullptr);
+
+    LOG_INFO("Cull compute pipeline created.");
+}
+
+void VulkanRenderer::createSceneBuffers() {
+    // A single instance reproduces the untransformed mesh. Larger scenes are scattered around
+    // (and partly outside) the view so that culling has something to reject
+    instances.resize(instanceCount);
+    if (instanceCount == 1) {
+        instances[0] = {{0.0f, 0.0f, 0.0f, 0.71f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+    } else {
+        std::mt19937 rng(config.sceneSeed);
+        std::uniform_real_distribution<float> position(-2.0f, 2.0f);
+        std::uniform_real_distribution<float> scale(0.01f, 0.05f);
+
+        for (InstanceData &instance : instances) {
+            float x = position(rng);
+            float y = position(rng);
+            float s = scale(rng);
+            instance = {{x, y, 0.0f, 0.71f * s}, {x, y, s, 0.0f}};
+        }
+    }
+
+    createDeviceLocalBuffer(meshIndices.data(), sizeof(uint32_t) * meshIndices.size(),
+                            VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexBufferMemory);
+    createDeviceLocalBuffer(instances.data(), sizeof(InstanceData) * instances.size(),
+                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, instanceBuffer,
+                            instanceBufferMemory);
+
+    // Every instance may survive, so size the indirect buffers for the whole scene
+    VkDeviceSize indirectSize = sizeof(VkDrawIndexedIndirectCommand) * instanceCount;
+
+    indirectBuffers.resize(maxFramesInFlight);
+    indirectBuffersMemory.resize(maxFramesInFlight);
+    indirectBuffersMapped.resize(maxFramesInFlight, nullptr);
+    drawCountBuffers.resize(maxFramesInFlight, VK_NULL_HANDLE);
+    drawCountBuffersMemory.resize(maxFramesInFlight, VK_NULL_HANDLE);
+
+    for (size_t i = 0; i < (size_t)maxFramesInFlight; ++i) {
+        if (cullingMode == CullingMode::Gpu) {
+            context->createBuffer(
+                indirectSize,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectBuffers[i], indirectBuffersMemory[i]);
+            context->createBuffer(sizeof(uint32_t),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCountBuffers[i],
+                                  drawCountBuffersMemory[i]);
+        } else if (!context->isDrawIndirectFirstInstanceSupported()) {
+            // The surviving instances are drawn directly, from commands kept in host memory
+            directDrawCommands.resize(instanceCount);
+        } else {
+            context->createBuffer(
+                indirectSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                indirectBuffers[i], indirectBuffersMemory[i]);
+            vkMapMemory(device, indirectBuffersMemory[i], 0, indirectSize, 0,
+                        &indirectBuffersMapped[i]);
+        }
+    }
+
+    LOG_INFO("Scene buffers created (" + std::to_string(instanceCount) + " instances).");
+}
+
+void VulkanRenderer::createFrameUniformBuffer() {
+    // Each frame in flight owns a slot, written by the host once the frame's fence has signalled
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->getPhysicalDevice(), &properties);
+    VkDeviceSize alignment =
+        std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+    frameUniformStride = (sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+
+    VkDeviceSize size = frameUniformStride * maxFramesInFlight;
+    context->createBuffer(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                          frameUniformBuffer, frameUniformBufferMemory);
+
+    void *mapped = nullptr;
+    if (vkMapMemory(device, frameUniformBufferMemory, 0, size, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("failed to map frame uniform buffer");
+    }
+    frameUniformsMapped = static_cast<uint8_t *>(mapped);
+    animationFrame = config.animationStart;
+}
+
+void VulkanRenderer::updateFrameUniforms(uint32_t frameIndex) {
+    // Without animation every frame is drawn at time 0, which reproduces the static scene
+    uint64_t frame = animationFrame++;
+    float seconds = 0.0f;
+    if (config.animate) {
+        seconds = static_cast<float>(static_cast<double>(frame) /
+                                     std::max(config.animationRate, 1u));
+    }
+
+    // The camera drifts and zooms slowly over the scene
+    frameUniforms.camera = {0.5f * std::sin(0.31f * seconds), 0.5f * std::sin(0.23f * seconds),
+                            1.0f + 0.25f * std::sin(0.5f * seconds), 0.0f};
+    frameUniforms.time = {seconds, static_cast<float>(config.animate ? frame : 0), 0.0f, 0.0f};
+
+    float width = static_cast<float>(renderExtent.width);
+    float height = static_cast<float>(renderExtent.height);
+    frameUniforms.viewport = {width, height, 1.0f / width, 1.0f / height};
+
+    std::memcpy(frameUniformsMapped + frameIndex * frameUniformStride, &frameUniforms,
+                sizeof(FrameUniforms));
+}
+
+void VulkanRenderer::createTextures() {
+    textureUploader = std::make_unique<TextureUploader>(context, config.textureUpload);
+
+    // Mip levels are blended trilinearly, and the texture repeats over each instance
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler");
+    }
+
+    // The placeholder is bound from the first frame, so it is uploaded before rendering starts
+    static const uint8_t white[4] = {255, 255, 255, 255};
+    placeholderTexture = textureUploader->createTexture(1, 1, white, false);
+    textureUploader->flush();
+    textureUploader->waitIdle();
+
+    if (config.textureSize == 0) {
+        return;
+    }
+    sceneTexturePixels = makeProceduralTexture(config.textureSize);
+    sceneTexture = textureUploader->createTexture(config.textureSize, config.textureSize,
+                                                  sceneTexturePixels.data());
+    LOG_INFO("Streaming a " + std::to_string(config.textureSize) + "x" +
+             std::to_string(config.textureSize) + " scene texture" +
+             (textureUploader->usesTransferQueue() ? " on the transfer queue." : "."));
+}
+
+void VulkanRenderer::updateSceneTexture() {
+    textureUploader->flush();
+    if (!sceneTexture || sceneTextureBound || !textureUploader->isReady(*sceneTexture)) {
+        return;
+    }
+
+    // The textured set has never been bound, so it can be written while frames are in flight
+    VkDescriptorImageInfo imageInfo = {textureSampler, textureUploader->getView(*sceneTexture),
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = texturedDescriptorSet;
+    write.dstBinding = 2;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    sceneTextureBound = true;
+    sceneTexturePixels.clear();
+    sceneTexturePixels.shrink_to_fit();
+    LOG_INFO("Scene texture ready.");
+}
+
+void VulkanRenderer::createDescriptorSets() {
+    // Two scene sets, one sampling the placeholder and one the scene texture
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 2 + 3 * maxFramesInFlight;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = 2;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 2 + maxFramesInFlight;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    std::array<VkDescriptorSetLayout, 2> sceneLayouts = {sceneDescriptorSetLayout,
+                                                          sceneDescriptorSetLayout};
+    std::array<VkDescriptorSet, 2> sceneSets = {};
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(sceneLayouts.size());
+    allocInfo.pSetLayouts = sceneLayouts.data();
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, sceneSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate scene descriptor sets");
+    }
+    sceneDescriptorSet = sceneSets[0];
+    texturedDescriptorSet = sceneSets[1];
+
+    // The uniform binding covers one slot, and the dynamic offset selects which when bound.
+    // The textured set's image is written by updateSceneTexture() once the texture is ready
+    VkDescriptorBufferInfo instanceInfo = {instanceBuffer, 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo uniformInfo = {frameUniformBuffer, 0, sizeof(FrameUniforms)};
+    VkDescriptorImageInfo placeholderInfo = {textureSampler,
+                                             textureUploader->getView(placeholderTexture),
+                                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+
+    std::array<VkWriteDescriptorSet, 5> sceneWrites = {};
+    for (uint32_t i = 0; i < sceneWrites.size(); ++i) {
+        sceneWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        sceneWrites[i].dstSet = sceneSets[i / 3];
+        sceneWrites[i].dstBinding = i % 3;
+        sceneWrites[i].descriptorCount = 1;
+    }
+    sceneWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sceneWrites[0].pBufferInfo = &instanceInfo;
+    sceneWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    sceneWrites[1].pBufferInfo = &uniformInfo;
+    sceneWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sceneWrites[2].pImageInfo = &placeholderInfo;
+    sceneWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sceneWrites[3].pBufferInfo = &instanceInfo;
+    sceneWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    sceneWrites[4].pBufferInfo = &uniformInfo;
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(sceneWrites.size()), sceneWrites.data(),
+                           0, nullptr);
+
+    if (cullingMode != CullingMode::Gpu) {
+        return;
+    }
+
+    cullDescriptorSets.resize(maxFramesInFlight);
+    std::vector<VkDescriptorSetLayout> layouts(maxFramesInFlight, cullDescriptorSetLayout);
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, cullDescriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate cull descriptor sets");
+    }
+
+    for (size_t i = 0; i < (size_t)maxFramesInFlight; ++i) {
+        std::array<VkDescriptorBufferInfo, 3> bufferInfos = {{
+            {instanceBuffer, 0, VK_WHOLE_SIZE},
+            {indirectBuffers[i], 0, VK_WHOLE_SIZE},
+            {drawCountBuffers[i], 0, VK_WHOLE_SIZE},
+        }};
+
+        std::array<VkWriteDescriptorSet, 3> writes = {};
+        for (uint32_t binding = 0; binding < writes.size(); ++binding) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = cullDescriptorSets[i];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].descriptorCount = 1;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0,
+                               nullptr);
+    }
+}
+
+std::array<std::array<float, 4>, 6> VulkanRenderer::computeFrustumPlanes() const {
+    // The camera maps a position p to (p - centre) * zoom in normalised device coordinates, so
+    // the frustum is the clip volume -1 <= x, y <= 1 and 0 <= z <= 1 mapped back to the scene
+    float centreX = frameUniforms.camera[0];
+    float centreY = frameUniforms.camera[1];
+    float halfSize = 1.0f / frameUniforms.camera[2];
+    return {{
+        {1.0f, 0.0f, 0.0f, halfSize - centreX},
+        {-1.0f, 0.0f, 0.0f, halfSize + centreX},
+        {0.0f, 1.0f, 0.0f, halfSize - centreY},
+        {0.0f, -1.0f, 0.0f, halfSize + centreY},
+        {0.0f, 0.0f, 1.0f, 0.0f},
+        {0.0f, 0.0f, -1.0f, 1.0f},
+    }};
+}
+
+uint32_t VulkanRenderer::cullInstancesOnCpu(uint32_t frameIndex) {
+    TRACE_SCOPE("cpu cull");
+    auto start = std::chrono::steady_clock::now();
+    const auto planes = computeFrustumPlanes();
+    VkDrawIndexedIndirectCommand *commands = directDrawCommands.data();
+    if (directDrawCommands.empty()) {
+        commands = static_cast<VkDrawIndexedIndirectCommand *>(indirectBuffersMapped[frameIndex]);
+    }
+
+    uint32_t drawCount = 0;
+    for (uint32_t i = 0; i < instanceCount; ++i) {
+        const auto &bounds = instances[i].bounds;
+
+        bool visible = true;
+        for (const auto &plane : planes) {
+            float distance =
+                plane[0] * bounds[0] + plane[1] * bounds[1] + plane[2] * bounds[2] + plane[3];
+            if (distance < -bounds[3]) {
+                visible = false;
+                break;
+            }
+        }
+
+        if (visible) {
+            commands[drawCount++] = {static_cast<uint32_t>(meshIndices.size()), 1, 0, 0, i};
+        }
+    }
+
+    double seconds = getSecondsSince(start);
+    getRendererMetrics().cullSeconds.observe(seconds);
+    cullStats.cpuFrames++;
+    cullStats.cpuSeconds += seconds;
+    return drawCount;
+}
+
+void VulkanRenderer::createDeviceLocalBuffer(const void *data, VkDeviceSize size,
+                                             VkBufferUsageFlags usage, VkBuffer &buffer,
+                                             VkDeviceMemory &bufferMemory) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    context->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                          stagingBuffer, stagingBufferMemory);
+
+    void *mapped;
+    vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped);
+    memcpy(mapped, data, static_cast<size_t>(size));
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    context->createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+    copyBuffer(stagingBuffer, buffer, size);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+void VulkanRenderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // Wait on a fence rather than the queue, which other streams may be submitting to
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create copy fence");
+    }
+
+    if (context->submit(submitInfo, fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit buffer copy");
+    }
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+
+    vkDestroyFence(device, fence, nullptr);
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+}
+
 void VulkanRenderer::createFramebuffers() {
-    swapChainFramebuffers.resize(swapChainImageViews.size());
+    framebuffers.resize(renderTargetViews.size());
 
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {swapChainImageViews[i]};
+    for (size_t i = 0; i < renderTargetViews.size(); i++) {
+        VkImageView attachments[] = {renderTargetViews[i]};
 
         VkFramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = renderPass;
         framebufferInfo.attachmentCount = 1;
         framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = swapChainExtent.width;
-        framebufferInfo.height = swapChainExtent.height;
+        framebufferInfo.width = targetExtent.width;
+        framebufferInfo.height = targetExtent.height;
         framebufferInfo.layers = 1;
 
-        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) !=
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffers[i]) !=
             VK_SUCCESS) {
             throw std::runtime_error("failed to create framebuffer");
         }
@@ -511,12 +981,10 @@ void VulkanRenderer::createFramebuffers() {
 }
 
 void VulkanRenderer::createCommandPool() {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+    poolInfo.queueFamilyIndex = getGraphicsQueueFamilyIndex();
 
     if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create command pool");
@@ -541,19 +1009,76 @@ void VulkanRenderer::createCommandBuffers() {
 }
 
 void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    TRACE_SCOPE("record commands");
+    auto start = std::chrono::steady_clock::now();
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin recording command buffer");
     }
+    updateFrameUniforms(currentFrame);
+
+    // Time the frame on the GPU, for the metrics and any running trace capture
+    FrameTiming &timing = frameTimings[currentFrame];
+    timing.timestamped = timestampQueryPool != VK_NULL_HANDLE;
+    timing.snapshotCopies = !requestedSnapshots.empty();
+    uint32_t firstQuery = currentFrame * frameTimestampQueries;
+    if (timing.timestamped) {
+        vkCmdResetQueryPool(commandBuffer, timestampQueryPool, firstQuery, frameTimestampQueries);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool,
+                            firstQuery);
+    }
+
+    // Cull the scene before the render pass. The GPU path resets the draw count, dispatches the
+    // cull shader and makes the compacted commands visible to the indirect draw
+    uint32_t cpuDrawCount = 0;
+    if (cullingMode == CullingMode::Gpu) {
+        vkCmdFillBuffer(commandBuffer, drawCountBuffers[currentFrame], 0, sizeof(uint32_t), 0);
+
+        VkMemoryBarrier resetBarrier = {};
+        resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &resetBarrier, 0, nullptr,
+                             0, nullptr);
+
+        CullPushConstants cullParams = {};
+        cullParams.planes = computeFrustumPlanes();
+        cullParams.instanceCount = instanceCount;
+        cullParams.indexCount = static_cast<uint32_t>(meshIndices.size());
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout,
+                                0, 1, &cullDescriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(CullPushConstants), &cullParams);
+        vkCmdDispatch(commandBuffer, (instanceCount + 63) / 64, 1, 1);
+
+        VkMemoryBarrier cullBarrier = {};
+        cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &cullBarrier, 0, nullptr,
+                             0, nullptr);
+    } else {
+        cpuDrawCount = cullInstancesOnCpu(currentFrame);
+    }
+    if (timing.timestamped) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                            timestampQueryPool, firstQuery + 1);
+    }
 
     VkRenderPassBeginInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    renderPassInfo.framebuffer = framebuffers[currentFrame];
+    // The whole target is cleared, padding included, so macroblocks read from it are defined.
+    // The scene is only drawn into its top left renderExtent pixels
     renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapChainExtent;
+    renderPassInfo.renderArea.extent = targetExtent;
 
     VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
     renderPassInfo.clearValueCount = 1;
@@ -566,36 +1091,266 @@ void VulkanRenderer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
+    viewport.width = (float)renderExtent.width;
+    viewport.height = (float)renderExtent.height;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
+    scissor.extent = renderExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    uint32_t uniformOffset = static_cast<uint32_t>(currentFrame * frameUniformStride);
+    VkDescriptorSet sceneSet = sceneTextureBound ? texturedDescriptorSet : sceneDescriptorSet;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                            &sceneSet, 1, &uniformOffset);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    // The whole scene is one draw, so its per-draw data is pushed once
+    DrawPushConstants drawParams = {};
+    drawParams.tint = {1.0f, 1.0f, 1.0f, 1.0f};
+    drawParams.spin = config.animate ? 1.0f : 0.0f;
+    drawParams.noise = config.animate ? 0.25f : 0.0f;
+    vkCmdPushConstants(commandBuffer, pipelineLayout,
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                       sizeof(DrawPushConstants), &drawParams);
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (cullingMode == CullingMode::Gpu) {
+        vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffers[currentFrame], 0,
+                                      drawCountBuffers[currentFrame], 0, instanceCount, stride);
+    } else if (!directDrawCommands.empty()) {
+        // Unlike indirect draws, direct ones may start at any instance without a feature
+        for (uint32_t i = 0; i < cpuDrawCount; ++i) {
+            const VkDrawIndexedIndirectCommand &command = directDrawCommands[i];
+            vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount,
+                             command.firstIndex, command.vertexOffset, command.firstInstance);
+        }
+    } else if (context->isMultiDrawIndirectSupported()) {
+        vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[currentFrame], 0, cpuDrawCount,
+                                 stride);
+    } else {
+        for (uint32_t i = 0; i < cpuDrawCount; ++i) {
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[currentFrame], i * stride, 1,
+                                     stride);
+        }
+    }
 
     vkCmdEndRenderPass(commandBuffer);
+    if (timing.timestamped) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                            timestampQueryPool, firstQuery + 2);
+    }
+
+    recordOutputScaling(commandBuffer);
+    VkImage output = getOutputImage(currentFrame);
+    if (!requestedSnapshots.empty()) {
+        recordSnapshotCopies(commandBuffer, output);
+    }
+    if (frameExporter) {
+        frameExporter->recordCopy(commandBuffer, output, currentFrame);
+    }
+    if (surface != VK_NULL_HANDLE && presentBlit) {
+        recordPresentBlit(commandBuffer, swapChainImages[imageIndex]);
+    } else if (surface != VK_NULL_HANDLE) {
+        recordPresentDraw(commandBuffer, imageIndex);
+    }
+    if (timing.timestamped) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            timestampQueryPool, firstQuery + 3);
+    }
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer");
     }
+    getRendererMetrics().recordSeconds.observe(getSecondsSince(start));
 }
 
-void VulkanRenderer::createRenderPass() {
+void VulkanRenderer::recordOutputScaling(VkCommandBuffer commandBuffer) {
+    VkImage renderTarget = renderTargets[currentFrame];
+
+    // The render targets are the output, so they only wait for the render pass's writes
+    if (outputImages.empty()) {
+        VkImageMemoryBarrier barrier = makeImageBarrier(
+            renderTarget, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+        return;
+    }
+
+    // The output image's previous frame may still be being read back by a later submission,
+    // so the blit also waits for earlier transfers
+    VkImage output = outputImages[currentFrame];
+    VkImageMemoryBarrier barriers[2] = {
+        makeImageBarrier(renderTarget, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT),
+        makeImageBarrier(output, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         0, VK_ACCESS_TRANSFER_WRITE_BIT)};
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    // The blit only covers the output size, so a padded image's previous contents are cleared
+    if (outputExtent.width != targetExtent.width || outputExtent.height != targetExtent.height) {
+        VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        vkCmdClearColorImage(commandBuffer, output, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1,
+                             &barriers[1].subresourceRange);
+
+        VkImageMemoryBarrier clearBarrier = makeImageBarrier(
+            output, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &clearBarrier);
+    }
+
+    VkImageBlit blit = {};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1] = {int32_t(renderExtent.width), int32_t(renderExtent.height), 1};
+    blit.dstSubresource = blit.srcSubresource;
+    blit.dstOffsets[1] = {int32_t(outputExtent.width), int32_t(outputExtent.height), 1};
+    vkCmdBlitImage(commandBuffer, renderTarget, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, output,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+    VkImageMemoryBarrier outputBarrier =
+        makeImageBarrier(output, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                         VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &outputBarrier);
+}
+
+void VulkanRenderer::recordPresentBlit(VkCommandBuffer commandBuffer, VkImage image) {
+    // The image's old contents are discarded. Its acquire semaphore is waited on at the
+    // transfer stage, which this barrier's first scope chains to
+    VkImageMemoryBarrier barrier =
+        makeImageBarrier(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                         VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Bars around the output are cleared to the render pass's clear colour
+    VkRect2D rect = getPresentRect();
+    if (rect.extent.width < swapChainExtent.width || rect.extent.height < swapChainExtent.height) {
+        VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 1.0f}};
+        vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1,
+                             &barrier.subresourceRange);
+
+        barrier = makeImageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+    }
+
+    VkImageBlit blit = {};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1] = {int32_t(outputExtent.width), int32_t(outputExtent.height), 1};
+    blit.dstSubresource = blit.srcSubresource;
+    blit.dstOffsets[0] = {rect.offset.x, rect.offset.y, 0};
+    blit.dstOffsets[1] = {rect.offset.x + int32_t(rect.extent.width),
+                          rect.offset.y + int32_t(rect.extent.height), 1};
+    vkCmdBlitImage(commandBuffer, getOutputImage(currentFrame),
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+    barrier = makeImageBarrier(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+}
+
+void VulkanRenderer::recordPresentDraw(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    // Earlier barriers made the output's writes available, so this only waits for the copies
+    // out of it before it is sampled
+    VkImage output = getOutputImage(currentFrame);
+    VkImageMemoryBarrier barrier = makeImageBarrier(
+        output, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0,
+        VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+
+    // The pass clears the bars around the output to the render pass's clear colour
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = presentRenderPass;
+    renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = swapChainExtent;
+
+    VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearColor;
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, presentPipeline);
+
+    VkRect2D rect = getPresentRect();
+    VkViewport viewport{};
+    viewport.x = (float)rect.offset.x;
+    viewport.y = (float)rect.offset.y;
+    viewport.width = (float)rect.extent.width;
+    viewport.height = (float)rect.extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+
+    // Only the output size of the padded image is drawn
+    float scale[2] = {float(outputExtent.width) / targetExtent.width,
+                      float(outputExtent.height) / targetExtent.height};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, presentPipelineLayout,
+                            0, 1, &presentDescriptorSets[currentFrame], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, presentPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                       sizeof(scale), scale);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    // Readbacks submitted after the frame copy from the output in the transfer layout
+    barrier = makeImageBarrier(output, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 0,
+                               VK_ACCESS_TRANSFER_READ_BIT);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+VkRect2D VulkanRenderer::getPresentRect() const {
+    // Fit the output inside the window, centred, keeping its aspect ratio
+    double scale = std::min(double(swapChainExtent.width) / outputExtent.width,
+                            double(swapChainExtent.height) / outputExtent.height);
+    int32_t width = std::max(int32_t(std::lround(outputExtent.width * scale)), 1);
+    int32_t height = std::max(int32_t(std::lround(outputExtent.height * scale)), 1);
+    int32_t x = (int32_t(swapChainExtent.width) - width) / 2;
+    int32_t y = (int32_t(swapChainExtent.height) - height) / 2;
+    return {{x, y}, {uint32_t(width), uint32_t(height)}};
+}
+
+void VulkanRenderer::createRenderPass() {
     VkAttachmentDescription colorAttachment = {};
-    colorAttachment.format = swapChainImageFormat;
+    colorAttachment.format = renderTargetFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    // Render targets are left ready to be scaled or copied out
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
@@ -606,159 +1361,330 @@ void VulkanRenderer::createRenderPass() {
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
 
+    // A render target's previous frame may still be being copied out by a readback submitted
+    // after it, which the clear must not overwrite
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask =
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
     VkRenderPassCreateInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     renderPassInfo.attachmentCount = 1;
     renderPassInfo.pAttachments = &colorAttachment;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
 
     if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass!");
     }
 }
 
-VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char> &code) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+void VulkanRenderer::createPresentPipeline() {
+    VkAttachmentDescription colorAttachment = {};
+    colorAttachment.format = swapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create shader module");
-    }
+    VkAttachmentReference colorAttachmentRef = {};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-    return shaderModule;
-}
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
 
-bool VulkanRenderer::isDeviceSuitable(VkPhysicalDevice device) {
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    std::string deviceName = deviceProperties.deviceName;
+    // The image's acquire semaphore is waited on at the colour attachment stage, which the
+    // layout transition and clear chain to
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
-    QueueFamilyIndices indicies = findQueueFamilies(device);
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
 
-    bool swapChainAdequate = true; // If no surface attached simply set this to true
-    if (surface != VK_NULL_HANDLE) {
-        swapChainAdequate = false;
-        if (extensionsSupported) {
-            // Swap chain support is sufficient for this tutorial if there is at least one supported
-            // image format and one supported presentation mode
-            SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-            swapChainAdequate =
-                !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
-        }
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &presentRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create present render pass");
     }
 
-    if (!indicies.isComplete(surface)) {
-        LOG_WARN("Device " + std::string(deviceProperties.deviceName) +
-                 " is missing required queue families");
-    }
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    if (!extensionsSupported) {
-        LOG_WARN("Device " + std::string(deviceProperties.deviceName) +
-                 " is missing required extensions");
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &presentDescriptorSetLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create present descriptor set layout");
     }
 
-    if (surface != VK_NULL_HANDLE && !swapChainAdequate) {
-        LOG_WARN("Device " + std::string(deviceProperties.deviceName) +
-                 " is missing swap chain support");
+    // The vertex shader scales the texture coordinates to the output's part of the image
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = 2 * sizeof(float);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &presentDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &presentPipelineLayout) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create present pipeline layout");
     }
 
-    return indicies.isComplete(surface) && extensionsSupported && swapChainAdequate;
-}
+    VkShaderModule vertShaderModule = loadShaderModule("present_vert.spv");
+    VkShaderModule fragShaderModule = loadShaderModule("present_frag.spv");
 
-bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device) {
-    uint32_t extensionCount;
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
 
-    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
-    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
-                                         availableExtensions.data());
+    // One triangle covering the viewport, generated from the vertex index
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-    for (const auto &extension : availableExtensions) {
-        LOG_VERBOSE("Found device extension " + std::string(extension.extensionName));
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-        std::size_t erased = requiredExtensions.erase(extension.extensionName);
-        if (erased > 0) {
-            LOG_DEBUG("Found required device extension " + std::string(extension.extensionName));
-        }
-    }
+    VkPipelineViewportStateCreateInfo viewportState = {};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
 
-    if (!requiredExtensions.empty()) {
-        for (const auto &missing : requiredExtensions) {
-            LOG_WARN("Missing device extension: " + std::string(missing));
-        }
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    // The letterboxed region follows the window
+    std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = presentPipelineLayout;
+    pipelineInfo.renderPass = presentRenderPass;
+    pipelineInfo.subpass = 0;
+
+    VkResult result = vkCreateGraphicsPipelines(device, context->getPipelineCache(), 1,
+                                                &pipelineInfo, nullptr, &presentPipeline);
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to create present pipeline");
     }
 
-    return requiredExtensions.empty();
+    LOG_INFO("Present pipeline created.");
 }
 
-VulkanRenderer::QueueFamilyIndices VulkanRenderer::findQueueFamilies(VkPhysicalDevice device) {
-    QueueFamilyIndices indices;
-
-    uint32_t queueFamilyCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+void VulkanRenderer::createPresentDescriptorSets() {
+    // Output frames are scaled bilinearly, and never sampled past their edges
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &presentSampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create present sampler");
+    }
 
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+    // Without output images, the render targets' views are sampled directly
+    outputImageViews.resize(outputImages.size());
+    for (size_t i = 0; i < outputImages.size(); i++) {
+        VkImageViewCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = outputImages[i];
+        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        createInfo.format = renderTargetFormat;
+        createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        createInfo.subresourceRange.levelCount = 1;
+        createInfo.subresourceRange.layerCount = 1;
 
-    for (std::size_t i = 0; i < queueFamilies.size(); ++i) {
-        // Look for a queue family that supports graphics commands
-        if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            indices.graphicsFamily = i;
+        if (vkCreateImageView(device, &createInfo, nullptr, &outputImageViews[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create output image view");
         }
+    }
 
-        // Check to see if present support is available for the device.
-        // Only needed if we have a surface attached
-        if (surface != VK_NULL_HANDLE) {
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = maxFramesInFlight;
 
-            if (presentSupport) {
-                indices.presentFamily = i;
-            }
-        }
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = maxFramesInFlight;
 
-        // Stop early if all required queues are found
-        if (indices.isComplete(surface)) {
-            break;
-        }
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &presentDescriptorPool) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to create present descriptor pool");
+    }
+
+    presentDescriptorSets.resize(maxFramesInFlight);
+    std::vector<VkDescriptorSetLayout> layouts(maxFramesInFlight, presentDescriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = presentDescriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, presentDescriptorSets.data()) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate present descriptor sets");
     }
 
-    return indices;
+    for (size_t i = 0; i < (size_t)maxFramesInFlight; ++i) {
+        VkDescriptorImageInfo imageInfo = {
+            presentSampler, outputImages.empty() ? renderTargetViews[i] : outputImageViews[i],
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = presentDescriptorSets[i];
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
 }
 
-VulkanRenderer::SwapChainSupportDetails
-VulkanRenderer::querySwapChainSupport(VkPhysicalDevice device) {
-    SwapChainSupportDetails details;
+void VulkanRenderer::createPresentFramebuffers() {
+    swapChainImageViews.resize(swapChainImages.size());
+    swapChainFramebuffers.resize(swapChainImages.size());
 
-    if (surface != VK_NULL_HANDLE) {
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+    for (size_t i = 0; i < swapChainImages.size(); i++) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = swapChainImages[i];
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = swapChainImageFormat;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &swapChainImageViews[i]) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create swap chain image view");
+        }
 
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = presentRenderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &swapChainImageViews[i];
+        framebufferInfo.width = swapChainExtent.width;
+        framebufferInfo.height = swapChainExtent.height;
+        framebufferInfo.layers = 1;
 
-        if (formatCount != 0) {
-            details.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount,
-                                                 details.formats.data());
+        if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to create swap chain framebuffer");
         }
+    }
+}
+
+VkShaderModule VulkanRenderer::createShaderModule(const uint32_t *code, size_t codeSize) {
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = codeSize;
+    createInfo.pCode = code;
 
-        uint32_t presentModeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create shader module");
+    }
 
-        if (presentModeCount != 0) {
-            details.presentModes.resize(presentModeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount,
-                                                      details.presentModes.data());
+    return shaderModule;
+}
+
+VkShaderModule VulkanRenderer::loadShaderModule(const std::string &name) {
+    // Development override: prefer a freshly compiled shader from disk if one exists
+    const char *overrideDir = std::getenv("VULKAN_SHADER_DIR");
+    if (overrideDir != nullptr) {
+        std::string path = std::string(overrideDir) + "/" + name;
+        if (std::ifstream(path).good()) {
+            LOG_DEBUG("Loading shader " + name + " from override directory " + overrideDir);
+            AssetFile code = readFile(path);
+            return createShaderModule(reinterpret_cast<const uint32_t *>(code.data()),
+                                      code.size());
         }
     }
 
-    return details;
+    const EmbeddedShader *shader = findEmbeddedShader(name);
+    if (shader == nullptr) {
+        throw std::runtime_error("unknown shader " + name);
+    }
+
+    return createShaderModule(shader->code, shader->codeSize);
 }
 
 VkSurfaceFormatKHR
@@ -798,7 +1724,7 @@ VkExtent2D VulkanRenderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capa
             return {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
         }
 
-        surfaceProvider->getFrameBufferSize(&width, &height);
+        context->getSurfaceProvider()->getFrameBufferSize(&width, &height);
 
         VkExtent2D actualExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
 
@@ -812,16 +1738,46 @@ VkExtent2D VulkanRenderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capa
 }
 
 void VulkanRenderer::waitForLogicalDevices() {
-    vkDeviceWaitIdle(device);
+    context->waitIdle();
 }
 
-void VulkanRenderer::createSyncObjects() {
-    // Query how many swapchain images we have
-    vkGetSwapchainImagesKHR(device, swapChain, &swapchainImageCount, nullptr);
+void VulkanRenderer::waitForFrames() {
+    if (!inFlightFences.empty()) {
+        vkWaitForFences(device, static_cast<uint32_t>(inFlightFences.size()),
+                        inFlightFences.data(), VK_TRUE, UINT64_MAX);
+    }
+    if (frameExporter) {
+        // The oldest frame in flight is the next to draw; frames are published in order
+        uint32_t frameCount = static_cast<uint32_t>(maxFramesInFlight);
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            frameExporter->retire((currentFrame + i) % frameCount);
+        }
+    }
+    for (uint32_t i = 0; i < frameSnapshots.size(); ++i) {
+        retireSnapshots(i);
+    }
+    for (uint32_t i = 0; i < frameTimings.size(); ++i) {
+        if (frameTimings[i].timestamped) {
+            retireTimestamps(i);
+        }
+    }
+    for (Readback &readback : readbacks) {
+        if (readback.done.valid()) {
+            readback.done.wait();
+            readback.done = {};
+        }
+        if (readback.submitted) {
+            vkWaitForFences(device, 1, &readback.fence, VK_TRUE, UINT64_MAX);
+            retireReadback(readback);
+        }
+    }
+}
 
-    // Allocate per-image semaphores
-    imageAvailableSemaphores.resize(swapchainImageCount);
-    renderFinishedSemaphores.resize(swapchainImageCount);
+void VulkanRenderer::createSyncObjects() {
+    // Allocate per-image semaphores (presentation only, offscreen frames are fenced)
+    size_t semaphoreCount = surface != VK_NULL_HANDLE ? swapChainImages.size() : 0;
+    imageAvailableSemaphores.resize(semaphoreCount);
+    renderFinishedSemaphores.resize(semaphoreCount);
 
     // Per-frame fences (used for CPU-GPU synchronization)
     inFlightFences.resize(maxFramesInFlight);
@@ -833,7 +1789,7 @@ void VulkanRenderer::createSyncObjects() {
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (size_t i = 0; i < (size_t)swapchainImageCount; ++i) {
+    for (size_t i = 0; i < semaphoreCount; ++i) {
         if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
                 VK_SUCCESS ||
             vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
@@ -852,7 +1808,56 @@ void VulkanRenderer::createSyncObjects() {
 }
 
 void VulkanRenderer::drawFrame() {
+    Tracer::markFrame();
+    TRACE_SCOPE("draw frame");
+
     vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    if (!frameSnapshots[currentFrame].empty()) {
+        retireSnapshots(currentFrame);
+    }
+    if (frameTimings[currentFrame].timestamped) {
+        retireTimestamps(currentFrame);
+    }
+    if (frameExporter) {
+        // Later frames that have already finished are published now rather than when their
+        // fence is next waited on; they finish in submission order
+        uint32_t frameCount = static_cast<uint32_t>(maxFramesInFlight);
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            uint32_t frame = (currentFrame + i) % frameCount;
+            if (i > 0 && vkGetFenceStatus(device, inFlightFences[frame]) != VK_SUCCESS) {
+                break;
+            }
+            frameExporter->retire(frame);
+        }
+    }
+    updateSceneTexture();
+
+    // Offscreen targets are owned per frame in flight, so there is nothing to acquire or present
+    if (surface == VK_NULL_HANDLE) {
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+        recordCommandBuffer(commandBuffers[currentFrame], currentFrame);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+        if (frameExporter) {
+            frameExporter->prepareSubmit(submitInfo);
+        }
+
+        frameTimings[currentFrame].submitTime = Tracer::now();
+        if (context->submit(submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer");
+        }
+        getRendererMetrics().frames.add();
+        if (frameExporter) {
+            frameExporter->submitted(currentFrame, frameTimings[currentFrame].submitTime);
+        }
+
+        currentFrame = (currentFrame + 1) % maxFramesInFlight;
+        return;
+    }
 
     uint32_t imageIndex;
     VkResult result =
@@ -875,7 +1880,10 @@ void VulkanRenderer::drawFrame() {
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
     VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    // The image is first written by the present blit or the present pass
+    VkPipelineStageFlags waitStages[] = {presentBlit
+                                             ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                                             : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
@@ -887,9 +1895,11 @@ void VulkanRenderer::drawFrame() {
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+    frameTimings[currentFrame].submitTime = Tracer::now();
+    if (context->submit(submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
         throw std::runtime_error("failed to submit draw command buffer");
     }
+    getRendererMetrics().frames.add();
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -901,9 +1911,11 @@ void VulkanRenderer::drawFrame() {
     presentInfo.pSwapchains = swapChains;
     presentInfo.pImageIndices = &imageIndex;
 
-    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    result = context->present(presentInfo);
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+        framebufferResized) {
+        framebufferResized = false;
         recreateSwapChain();
     } else if (result != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image");
@@ -912,70 +1924,522 @@ void VulkanRenderer::drawFrame() {
     currentFrame = (currentFrame + 1) % maxFramesInFlight;
 }
 
-bool VulkanRenderer::checkValidationLayerSupport() {
-    uint32_t layerCount;
-    vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+void VulkanRenderer::notifyResize() {
+    framebufferResized = true;
+}
 
-    std::vector<VkLayerProperties> availableLayers(layerCount);
-    vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+VkExtent2D VulkanRenderer::getExtent() const {
+    return outputExtent;
+}
 
-    // Check if all requested validation layers are available
-    for (const char *layerName : validationLayers) {
-        bool layerFound = false;
+CullStats VulkanRenderer::getCullStats() const {
+    CullStats stats = cullStats;
+    stats.mode = cullingMode;
+    return stats;
+}
 
-        for (const auto &layerProperties : availableLayers) {
-            if (strcmp(layerName, layerProperties.layerName) == 0) {
-                layerFound = true;
-                break;
-            }
+void VulkanRenderer::createReadbackResources() {
+    VkDeviceSize size = VkDeviceSize(outputExtent.width) * outputExtent.height * 4;
+    readbacks.resize(readbackSlotCount);
+    for (Readback &readback : readbacks) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &readback.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create readback buffer");
         }
 
-        if (!layerFound) {
-            return false;
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, readback.buffer, &memRequirements);
+
+        // Readers convert the pixels in place, so prefer cached memory
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        const VkMemoryPropertyFlags hostVisible =
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        try {
+            allocInfo.memoryTypeIndex = context->findMemoryType(
+                memRequirements.memoryTypeBits, hostVisible | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        } catch (const std::runtime_error &) {
+            allocInfo.memoryTypeIndex =
+                context->findMemoryType(memRequirements.memoryTypeBits, hostVisible);
         }
+
+        void *mapped = nullptr;
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &readback.memory) != VK_SUCCESS ||
+            vkBindBufferMemory(device, readback.buffer, readback.memory, 0) != VK_SUCCESS ||
+            vkMapMemory(device, readback.memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate readback buffer memory");
+        }
+        readback.pixels = static_cast<const uint8_t *>(mapped);
+
+        VkCommandBufferAllocateInfo commandInfo = {};
+        commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandInfo.commandPool = commandPool;
+        commandInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device, &commandInfo, &readback.commandBuffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate readback command buffer");
+        }
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(device, &fenceInfo, nullptr, &readback.fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create readback fence");
+        }
+    }
+}
+
+VulkanRenderer::Readback &VulkanRenderer::submitReadback() {
+    if (surface != VK_NULL_HANDLE) {
+        throw std::runtime_error("only headless renderers can be read back");
+    }
+    if (readbacks.empty()) {
+        createReadbackResources();
+    }
+
+    uint32_t slot = nextReadback;
+    nextReadback = (nextReadback + 1) % readbackSlotCount;
+    Readback &readback = readbacks[slot];
+    if (readback.done.valid()) {
+        TRACE_SCOPE("wait for readback");
+        readback.done.wait();
+        readback.done = {};
+    }
+    if (readback.submitted) {
+        vkWaitForFences(device, 1, &readback.fence, VK_TRUE, UINT64_MAX);
+        retireReadback(readback);
+    }
+
+    vkResetFences(device, 1, &readback.fence);
+    vkResetCommandBuffer(readback.commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(readback.commandBuffer, &beginInfo);
+
+    // Each slot's queries follow those of the frames in flight
+    readback.timestamped = timestampQueryPool != VK_NULL_HANDLE && Tracer::isEnabled();
+    uint32_t firstQuery = maxFramesInFlight * frameTimestampQueries + 2 * slot;
+    if (readback.timestamped) {
+        vkCmdResetQueryPool(readback.commandBuffer, timestampQueryPool, firstQuery, 2);
+        vkCmdWriteTimestamp(readback.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                            timestampQueryPool, firstQuery);
+    }
+
+    // drawFrame has already advanced currentFrame past the frame to read. The frame was
+    // submitted earlier on the same queue and its last barrier makes the output available
+    // to transfer reads in TRANSFER_SRC_OPTIMAL, so the copy needs no wait of its own
+    uint32_t frame = (currentFrame + maxFramesInFlight - 1) % maxFramesInFlight;
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {outputExtent.width, outputExtent.height, 1};
+    vkCmdCopyImageToBuffer(readback.commandBuffer, getOutputImage(frame),
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = readback.buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(readback.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    if (readback.timestamped) {
+        vkCmdWriteTimestamp(readback.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            timestampQueryPool, firstQuery + 1);
     }
 
-    return true;
+    vkEndCommandBuffer(readback.commandBuffer);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &readback.commandBuffer;
+
+    readback.submitTime = Tracer::now();
+    if (context->submit(submitInfo, readback.fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit frame readback");
+    }
+    readback.submitted = true;
+    return readback;
 }
 
-std::vector<const char *> VulkanRenderer::getRequiredExtensions() {
-    std::vector<const char *> extensions;
+void VulkanRenderer::retireReadback(Readback &readback) {
+    readback.submitted = false;
+    if (!readback.timestamped) {
+        return;
+    }
+    readback.timestamped = false;
+
+    uint32_t slot = static_cast<uint32_t>(&readback - readbacks.data());
+    uint32_t firstQuery = maxFramesInFlight * frameTimestampQueries + 2 * slot;
+    uint64_t ticks[2];
+    if (vkGetQueryPoolResults(device, timestampQueryPool, firstQuery, 2, sizeof(ticks), ticks,
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+        updateGpuClock(readback.submitTime, ticks[0]);
+        Tracer::record("gpu readback copy", toHostTime(ticks[0]), toHostTime(ticks[1]), gpuTrack);
+    }
+}
+
+void VulkanRenderer::readFrame(std::vector<uint8_t> &rgba) {
+    readFrame([&rgba](const uint8_t *pixels, VkExtent2D extent) {
+        rgba.assign(pixels, pixels + size_t(extent.width) * extent.height * 4);
+    });
+}
+
+void VulkanRenderer::readFrame(const FrameReader &reader) {
+    TRACE_SCOPE("read frame");
+    Readback &readback = submitReadback();
+    vkWaitForFences(device, 1, &readback.fence, VK_TRUE, UINT64_MAX);
+    retireReadback(readback);
+    reader(readback.pixels, outputExtent);
+}
 
-    if (surfaceProvider) {
-        extensions = surfaceProvider->getRequiredInstanceExtensions();
+std::shared_future<void> VulkanRenderer::readFrameAsync(ThreadPool &pool, FrameReader reader) {
+    TRACE_SCOPE("read frame");
+    Readback &readback = submitReadback();
+
+    // The slot is not reused before the reader returns, so the task may hold on to it
+    VkFence fence = readback.fence;
+    const uint8_t *pixels = readback.pixels;
+    VkExtent2D extent = outputExtent;
+    auto read = [device = device, fence, pixels, extent, reader = std::move(reader)] {
+        {
+            TRACE_SCOPE("wait for readback copy");
+            vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        }
+        reader(pixels, extent);
+    };
+    readback.done = pool.submit(std::move(read)).share();
+    return readback.done;
+}
+
+void VulkanRenderer::requestSnapshot(const std::string &path) {
+    if (!snapshotWriter) {
+        snapshotWriter = std::make_unique<SnapshotWriter>();
     }
 
-    // Add debug utils extension if validation is enabled
-    if (enableValidationLayers) {
-        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    Snapshot snapshot;
+    snapshot.path = path;
+    createSnapshotBuffer(snapshot);
+    requestedSnapshots.push_back(std::move(snapshot));
+}
+
+void VulkanRenderer::waitForSnapshots() {
+    waitForFrames();
+    if (snapshotWriter) {
+        snapshotWriter->wait();
+    }
+}
+
+void VulkanRenderer::createSnapshotBuffer(Snapshot &snapshot) {
+    // Snapshots are taken of the output, which is always RGBA
+    snapshot.extent = outputExtent;
+    snapshot.bgra = false;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = VkDeviceSize(outputExtent.width) * outputExtent.height * 4;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &snapshot.buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create snapshot buffer");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, snapshot.buffer, &memRequirements);
+
+    // The encoder reads every pixel more than once, so prefer cached memory
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    const VkMemoryPropertyFlags hostVisible =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    try {
+        allocInfo.memoryTypeIndex = context->findMemoryType(
+            memRequirements.memoryTypeBits, hostVisible | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    } catch (const std::runtime_error &) {
+        allocInfo.memoryTypeIndex =
+            context->findMemoryType(memRequirements.memoryTypeBits, hostVisible);
+    }
+
+    void *mapped = nullptr;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &snapshot.memory) != VK_SUCCESS ||
+        vkBindBufferMemory(device, snapshot.buffer, snapshot.memory, 0) != VK_SUCCESS ||
+        vkMapMemory(device, snapshot.memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        vkDestroyBuffer(device, snapshot.buffer, nullptr);
+        vkFreeMemory(device, snapshot.memory, nullptr);
+        throw std::runtime_error("failed to allocate snapshot buffer memory");
+    }
+    snapshot.pixels = static_cast<const uint8_t *>(mapped);
+}
+
+void VulkanRenderer::recordSnapshotCopies(VkCommandBuffer commandBuffer, VkImage image) {
+    // recordOutputScaling() has left the output ready to be copied from
+    std::vector<Snapshot> &recorded = frameSnapshots[currentFrame];
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    for (Snapshot &snapshot : requestedSnapshots) {
+        // The output was resized since the request, which is rare enough to pay for here
+        if (snapshot.extent.width != outputExtent.width ||
+            snapshot.extent.height != outputExtent.height) {
+            vkDestroyBuffer(device, snapshot.buffer, nullptr);
+            vkFreeMemory(device, snapshot.memory, nullptr);
+            createSnapshotBuffer(snapshot);
+        }
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {snapshot.extent.width, snapshot.extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               snapshot.buffer, 1, &region);
+
+        VkBufferMemoryBarrier bufferBarrier = {};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = snapshot.buffer;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        bufferBarriers.push_back(bufferBarrier);
+
+        recorded.push_back(std::move(snapshot));
+    }
+    requestedSnapshots.clear();
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr,
+                         static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(), 0,
+                         nullptr);
+}
+
+void VulkanRenderer::retireSnapshots(uint32_t frameIndex) {
+    for (const Snapshot &snapshot : frameSnapshots[frameIndex]) {
+        SnapshotImage image;
+        image.pixels = snapshot.pixels;
+        image.width = snapshot.extent.width;
+        image.height = snapshot.extent.height;
+        image.stride = static_cast<ptrdiff_t>(snapshot.extent.width) * 4;
+        image.bgra = snapshot.bgra;
+
+        VkBuffer buffer = snapshot.buffer;
+        VkDeviceMemory memory = snapshot.memory;
+        snapshotWriter->write(snapshot.path, image, [device = device, buffer, memory]() {
+            vkDestroyBuffer(device, buffer, nullptr);
+            vkFreeMemory(device, memory, nullptr);
+        });
+    }
+    frameSnapshots[frameIndex].clear();
+}
+
+void VulkanRenderer::createTimestampQueries() {
+    frameTimings.resize(maxFramesInFlight);
+    if (!context->isTimestampSupported()) {
+        LOG_WARN("Graphics queue does not support timestamps, GPU work will not be traced");
+        return;
+    }
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = maxFramesInFlight * frameTimestampQueries + 2 * readbackSlotCount;
+
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool");
+    }
+
+    gpuTrack = Tracer::createTrack("GPU, renderer " + std::to_string(++rendererCount));
+}
+
+void VulkanRenderer::retireTimestamps(uint32_t frameIndex) {
+    FrameTiming &timing = frameTimings[frameIndex];
+    timing.timestamped = false;
+
+    uint64_t ticks[frameTimestampQueries];
+    if (vkGetQueryPoolResults(device, timestampQueryPool, frameIndex * frameTimestampQueries,
+                              frameTimestampQueries, sizeof(ticks), ticks, sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+
+    updateGpuClock(timing.submitTime, ticks[0]);
+    uint64_t times[frameTimestampQueries];
+    for (uint32_t i = 0; i < frameTimestampQueries; ++i) {
+        times[i] = toHostTime(ticks[i]);
+    }
+
+    const RendererMetrics &metrics = getRendererMetrics();
+    metrics.gpuFrameSeconds.observe((times[3] - times[0]) * 1e-9);
+    if (cullingMode == CullingMode::Gpu) {
+        metrics.gpuCullSeconds.observe((times[1] - times[0]) * 1e-9);
+        cullStats.gpuFrames++;
+        cullStats.gpuSeconds += (times[1] - times[0]) * 1e-9;
+    }
+    metrics.gpuRenderPassSeconds.observe((times[2] - times[1]) * 1e-9);
+
+    // The new size applies from the next frame recorded; the render targets are not resized
+    if (resolutionController && resolutionController->update((times[3] - times[0]) * 1e-6)) {
+        setRenderScale(resolutionController->getScale());
+        metrics.renderScaleChanges.add();
+        LOG_INFO("Dynamic resolution: rendering at " + std::to_string(renderExtent.width) + "x" +
+                 std::to_string(renderExtent.height) + ".");
+    }
+
+    if (!Tracer::isEnabled()) {
+        return;
+    }
+    Tracer::record("gpu frame", times[0], times[3], gpuTrack);
+    if (cullingMode == CullingMode::Gpu) {
+        Tracer::record("gpu cull", times[0], times[1], gpuTrack);
+    }
+    Tracer::record("gpu render pass", times[1], times[2], gpuTrack);
+    if (timing.snapshotCopies) {
+        Tracer::record("gpu snapshot copy", times[2], times[3], gpuTrack);
+    }
+}
+
+void VulkanRenderer::updateGpuClock(uint64_t submitTime, uint64_t startTicks) {
+    double period = context->getTimestampPeriod();
+
+    // The tracer's steady clock is CLOCK_MONOTONIC, the host domain the context calibrates
+    uint64_t deviceTicks, hostNanoseconds;
+    if ((!gpuClockCalibrated || submitTime - gpuClockCalibrationTime > 1000000000) &&
+        context->sampleCalibratedTimestamps(deviceTicks, hostNanoseconds)) {
+        gpuClockOffset = int64_t(hostNanoseconds) - int64_t(double(deviceTicks) * period);
+        gpuClockValid = gpuClockCalibrated = true;
+        gpuClockCalibrationTime = submitTime;
+        return;
     }
 
-    return extensions;
+    // Work cannot start before it is submitted, so each submission bounds the offset from below
+    if (!gpuClockCalibrated) {
+        int64_t offset = int64_t(submitTime) - int64_t(double(startTicks) * period);
+        gpuClockOffset = gpuClockValid ? std::max(gpuClockOffset, offset) : offset;
+        gpuClockValid = true;
+    }
+}
+
+uint64_t VulkanRenderer::toHostTime(uint64_t ticks) const {
+    return uint64_t(int64_t(double(ticks) * context->getTimestampPeriod()) + gpuClockOffset);
 }
 
 void VulkanRenderer::cleanupSwapChain() {
     for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
         vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
-    }
-
-    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
         vkDestroyImageView(device, swapChainImageViews[i], nullptr);
     }
+    swapChainFramebuffers.clear();
+    swapChainImageViews.clear();
 
     if (swapChain != VK_NULL_HANDLE) {
         vkDestroySwapchainKHR(device, swapChain, nullptr);
+        swapChain = VK_NULL_HANDLE;
+    }
+}
+
+void VulkanRenderer::cleanupRenderTargets() {
+    for (size_t i = 0; i < framebuffers.size(); i++) {
+        vkDestroyFramebuffer(device, framebuffers[i], nullptr);
+    }
+
+    for (size_t i = 0; i < renderTargetViews.size(); i++) {
+        vkDestroyImageView(device, renderTargetViews[i], nullptr);
+    }
+
+    for (size_t i = 0; i < renderTargetsMemory.size(); i++) {
+        vkDestroyImage(device, renderTargets[i], nullptr);
+        vkFreeMemory(device, renderTargetsMemory[i], nullptr);
+    }
+
+    for (size_t i = 0; i < outputImageViews.size(); i++) {
+        vkDestroyImageView(device, outputImageViews[i], nullptr);
+    }
+
+    for (size_t i = 0; i < outputImagesMemory.size(); i++) {
+        vkDestroyImage(device, outputImages[i], nullptr);
+        vkFreeMemory(device, outputImagesMemory[i], nullptr);
     }
 }
 
 void VulkanRenderer::shutdown() {
     LOG_INFO("Shutting down Vulkan renderer.");
 
+    // Other streams may still be using the device, so only wait for this renderer's frames
+    waitForFrames();
+    frameExporter.reset();
+
+    // The writer destroys the buffers of the snapshots it encodes, so it goes first
+    snapshotWriter.reset();
+    for (const Snapshot &snapshot : requestedSnapshots) {
+        vkDestroyBuffer(device, snapshot.buffer, nullptr);
+        vkFreeMemory(device, snapshot.memory, nullptr);
+    }
+    requestedSnapshots.clear();
+
     cleanupSwapChain();
+    cleanupRenderTargets();
 
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyRenderPass(device, renderPass, nullptr);
 
+    // The present pass only exists for surfaces that cannot be blitted into
+    vkDestroyPipeline(device, presentPipeline, nullptr);
+    vkDestroyPipelineLayout(device, presentPipelineLayout, nullptr);
+    vkDestroyRenderPass(device, presentRenderPass, nullptr);
+    vkDestroyDescriptorPool(device, presentDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, presentDescriptorSetLayout, nullptr);
+    vkDestroySampler(device, presentSampler, nullptr);
+
+    // Destroy culling and scene resources (null handles are ignored by vkDestroy*)
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, sceneDescriptorSetLayout, nullptr);
+
+    for (size_t i = 0; i < indirectBuffers.size(); ++i) {
+        vkDestroyBuffer(device, indirectBuffers[i], nullptr);
+        vkFreeMemory(device, indirectBuffersMemory[i], nullptr);
+        vkDestroyBuffer(device, drawCountBuffers[i], nullptr);
+        vkFreeMemory(device, drawCountBuffersMemory[i], nullptr);
+    }
+
+    // The uploader waits for its uploads before destroying the textures
+    textureUploader.reset();
+    vkDestroySampler(device, textureSampler, nullptr);
+
+    vkDestroyBuffer(device, frameUniformBuffer, nullptr);
+    vkFreeMemory(device, frameUniformBufferMemory, nullptr);
+    vkDestroyBuffer(device, instanceBuffer, nullptr);
+    vkFreeMemory(device, instanceBufferMemory, nullptr);
+    vkDestroyBuffer(device, indexBuffer, nullptr);
+    vkFreeMemory(device, indexBufferMemory, nullptr);
+
+    // waitForFrames() has waited for the readers and copies
+    for (const Readback &readback : readbacks) {
+        vkDestroyFence(device, readback.fence, nullptr);
+        vkDestroyBuffer(device, readback.buffer, nullptr);
+        vkFreeMemory(device, readback.memory, nullptr);
+    }
+    readbacks.clear();
+    vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+
     // Destroy per-image semaphores (sized by swapchain image count)
     for (VkSemaphore semaphore : renderFinishedSemaphores) {
         vkDestroySemaphore(device, semaphore, nullptr);
@@ -991,73 +2455,10 @@ void VulkanRenderer::shutdown() {
     }
 
     vkDestroyCommandPool(device, commandPool, nullptr);
-    vkDestroyDevice(device, nullptr);
-
-    if (enableValidationLayers) {
-        destroyDebugUtilsMessenger(nullptr);
-    }
 
-    if (surface != VK_NULL_HANDLE) {
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-    }
-
-    vkDestroyInstance(instance, nullptr);
+    // The context (and with it the device) is destroyed once the last stream releases it
 }
 
 VulkanRenderer::~VulkanRenderer() {
     shutdown();
 }
-
-VKAPI_ATTR VkBool32 VKAPI_CALL VulkanRenderer::debugCallback(
-    VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-    VkDebugUtilsMessageTypeFlagsEXT messageType,
-    const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData) {
-
-    // Map enum values to strings for readable output
-    std::map<VkDebugUtilsMessageTypeFlagsEXT, std::string> messageTypes{
-        {VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT, "General"},
-        {VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT, "Performance"},
-        {VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT, "Validation"}};
-    std::map<VkDebugUtilsMessageSeverityFlagBitsEXT, std::string> messageSeverityTypes{
-        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT, "Verbose"},
-        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT, "Info"},
-        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT, "Warning"},
-        {VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT, "Error"}};
-
-    // Log formatted debug message at relevant log-level
-    std::string message = "SEVERITY = " + messageSeverityTypes[messageSeverity] +
-                          ", TYPE = " + messageTypes[messageType] + ": " + pCallbackData->pMessage;
-    switch (messageSeverity) {
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-        LOG_VERBOSE(message);
-        if (pUserData != nullptr) {
-            LOG_VERBOSE("User data: " + std::string((char *)pUserData));
-        }
-        break;
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-        LOG_INFO(message);
-        if (pUserData != nullptr) {
-            LOG_INFO("User data: " + std::string((char *)pUserData));
-        }
-        break;
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-        LOG_WARN(message);
-        if (pUserData != nullptr) {
-            LOG_WARN("User data: " + std::string((char *)pUserData));
-        }
-        break;
-    case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-        LOG_ERROR(message);
-        if (pUserData != nullptr) {
-            LOG_ERROR("User data: " + std::string((char *)pUserData));
-        }
-        break;
-    default:
-        LOG_INFO(message);
-        if (pUserData != nullptr) {
-            LOG_INFO("User data: " + std::string((char *)pUserData));
-        }
-    }
-
-    return VK_FALSE; // Always return false to not interrupt Vulkan calls
-}
@@ -1,88 +1,227 @@
 
 #pragma once
 #define GLFW_INCLUDE_VULKAN
+#include "asset_file.hpp"
+#include "context.hpp"
+#include "frame_exporter.hpp"
 #include "logger.hpp"
-#include "surface_provider.hpp"
+#include "metrics.hpp"
+#include "resolution_controller.hpp"
+#include "snapshot_writer.hpp"
+#include "texture_uploader.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 #include <GLFW/glfw3.h>
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
 #include <optional>
+#include <random>
 #include <set>
 #include <vector>
 
+/**
+ * @enum CullingMode
+ * @brief Selects where per-instance frustum culling is performed
+ *
+ * Cpu: Instances are culled on the host and written to a mapped indirect buffer
+ * Gpu: A compute pass culls instances and compacts surviving draws on the device
+ */
+enum class CullingMode { Cpu, Gpu };
+
+/**
+ * @struct CullStats
+ * @brief Time a renderer has spent culling its scene
+ */
+struct CullStats {
+    /// @brief Culling mode in effect, after any downgrade for missing device features
+    CullingMode mode = CullingMode::Cpu;
+
+    /// @brief Frames culled on the host
+    uint64_t cpuFrames = 0;
+
+    /// @brief Host time spent culling those frames
+    double cpuSeconds = 0.0;
+
+    /// @brief Frames culled on the device whose timestamps have been read
+    uint64_t gpuFrames = 0;
+
+    /// @brief Device time of the cull pass of those frames
+    double gpuSeconds = 0.0;
+};
+
+/**
+ * @struct RendererConfig
+ * @brief Configuration options for a VulkanRenderer
+ */
+struct RendererConfig {
+    /// @brief Configuration of the VulkanContext, used only when the renderer creates its own
+    ContextConfig context;
+
+    /// @brief Width of the output frames, which are read back, exported and encoded. A window
+    /// shows them scaled to its own size, so resizing it leaves them unchanged
+    uint32_t width = 800;
+
+    /// @brief Height of the output frames
+    uint32_t height = 600;
+
+    /// @brief Fraction of the output size the scene is rendered at, and the largest dynamic
+    /// resolution raises it to. Below 1, frames are scaled up to the output size on the GPU
+    float renderScale = 1.0f;
+
+    /// @brief Fraction of the output size dynamic resolution may lower the render size to
+    /// while GPU frames take longer than gpuFrameBudgetMs. At renderScale or above, the render
+    /// size is fixed. Requires timestamp queries
+    float minRenderScale = 1.0f;
+
+    /// @brief GPU time a frame may take before dynamic resolution lowers the render size
+    double gpuFrameBudgetMs = 1000.0 / 60.0;
+
+    /// @brief Requested culling mode, downgraded to Cpu if the device lacks drawIndirectCount
+    /// or drawIndirectFirstInstance
+    CullingMode cullingMode = CullingMode::Gpu;
+
+    /// @brief Number of instances in the scene
+    uint32_t instanceCount = 1;
+
+    /// @brief Seed used to scatter instances when the scene holds more than one
+    uint32_t sceneSeed = 1;
+
+    /// @brief If set, every frame is shared with other processes. Headless renderers only
+    std::optional<FrameExportConfig> frameExport;
+
+    /// @brief Whether the camera pans, the instances spin and the pixels carry noise. Frame n
+    /// is drawn at n / animationRate seconds on a virtual clock, so frames are reproducible
+    bool animate = false;
+
+    /// @brief Frame rate of the animation's virtual clock
+    uint32_t animationRate = 60;
+
+    /// @brief Number of the first frame drawn, so that a clip can be split between renderers
+    uint64_t animationStart = 0;
+
+    /// @brief Size of the procedural texture the scene is drawn with (0 to draw it untextured).
+    /// The texture streams in over several frames, and is sampled once it is complete
+    uint32_t textureSize = 0;
+
+    /// @brief Options of the texture uploader
+    TextureUploadConfig textureUpload;
+};
+
 /**
  * @class VulkanRenderer
- * @brief Handles Vulkan initialisation, rendering, and frame capture.
+ * @brief Handles per-stream Vulkan state, rendering, and frame capture.
  *
- * This class encapsulates the setup and teardown of Vulkan components,
- * and provides methods to render frames.
+ * This class encapsulates the setup and teardown of the render targets, pipelines, command
+ * buffers and sync objects of one stream, and provides methods to render frames. Device-level
+ * state lives in a VulkanContext, which is either created by the renderer or shared between
+ * several renderers. Without a surface, frames are rendered into offscreen images.
  */
 class VulkanRenderer {
 
   public:
     /**
-     * @struct SwapChainSupportDetails
-     * @brief Holds details about swap chain support for a physical device
+     * @struct InstanceData
+     * @brief Per-instance data consumed by the cull compute shader and the vertex shader
      *
-     * This structure is populated by querying the Vulkan physical device and surface
-     * for information needed to create a swap chain. It includes capabilities,
-     * supported surface formats, and present modes
+     * The layout matches the std430 "Instance" struct declared in the shaders
      */
-    struct SwapChainSupportDetails {
-        /// @brief Surface capabilities, such as min/max image count and size
-        VkSurfaceCapabilitiesKHR capabilities;
+    struct InstanceData {
+        /// @brief Bounding sphere centre (xyz) and radius (w)
+        std::array<float, 4> bounds;
 
-        /// @brief List of supported surface formats
-        std::vector<VkSurfaceFormatKHR> formats;
+        /// @brief Screen-space offset (xy) and uniform scale (z)
+        std::array<float, 4> transform;
+    };
+
+    /**
+     * @struct CullPushConstants
+     * @brief Push constants passed to the cull compute shader
+     */
+    struct CullPushConstants {
+        /// @brief Frustum planes as (normal.xyz, distance), normals pointing inwards
+        std::array<std::array<float, 4>, 6> planes;
+
+        /// @brief Number of instances to test
+        uint32_t instanceCount;
 
-        /// @brief List of supported presentation modes
-        std::vector<VkPresentModeKHR> presentModes;
+        /// @brief Number of indices drawn for each surviving instance
+        uint32_t indexCount;
     };
 
     /**
-     * @brief Holds indices of queue families supported by a physical device
+     * @struct FrameUniforms
+     * @brief Per-frame data read by the graphics shaders from the uniform ring
      *
-     * This struct is used to track which queue families (e.g. graphics, compute, etc.)
-     * are available on a Vulkan physical device. Only the graphics queue family is
-     * currently required and checked.
+     * The layout matches the std140 "Frame" block declared in the shaders
      */
-    struct QueueFamilyIndices {
-        /// @brief Index of a queue family that supports graphics commands
-        std::optional<uint32_t> graphicsFamily;
+    struct FrameUniforms {
+        /// @brief Centre of the view (xy) and zoom (z)
+        std::array<float, 4> camera;
 
-        /// @brief Index of a queue family that supports presenting/drawing
-        std::optional<uint32_t> presentFamily;
+        /// @brief Time in seconds (x) and frame number (y) on the animation clock
+        std::array<float, 4> time;
 
-        /**
-         * @brief Checks if all required queue families have been found
-         *
-         * @return true if the graphics queue family has been assigned
-         */
-        bool isComplete(VkSurfaceKHR surface) {
+        /// @brief Size of the render target in pixels (xy) and its reciprocal (zw)
+        std::array<float, 4> viewport;
+    };
+
+    /**
+     * @struct DrawPushConstants
+     * @brief Per-draw data pushed to the graphics shaders
+     */
+    struct DrawPushConstants {
+        /// @brief Colour the mesh's vertex colours are multiplied by
+        std::array<float, 4> tint;
 
-            // If we have no surface attached, do not check for queue family that supports drawing
-            if (surface == VK_NULL_HANDLE) {
-                return graphicsFamily.has_value();
-            }
+        /// @brief Rotation rate of the instances, in radians per second
+        float spin;
 
-            return graphicsFamily.has_value() && presentFamily.has_value();
-        }
+        /// @brief Amplitude of the per-pixel noise added to every fragment
+        float noise;
     };
 
     /**
-     * @brief Constructs the VulkanRenderer and initialising Vulkan resources
+     * @brief Constructs the VulkanRenderer with its own VulkanContext
+     * @param surfaceProvider Optional provider of a presentation surface (nullptr for headless)
+     * @param config Renderer configuration options
      */
-    VulkanRenderer(SurfaceProvider *surfaceProvider = nullptr);
+    VulkanRenderer(SurfaceProvider *surfaceProvider = nullptr,
+                   const RendererConfig &config = RendererConfig());
+
+    /**
+     * @brief Constructs the VulkanRenderer on an existing, possibly shared, VulkanContext
+     *
+     * The renderer presents to the context's surface if it has one. Only one renderer may
+     * present to a surface, so renderers sharing a context are normally headless
+     *
+     * @param context The context to create the per-stream resources on
+     * @param config Renderer configuration options (the context options are ignored)
+     */
+    VulkanRenderer(std::shared_ptr<VulkanContext> context,
+                   const RendererConfig &config = RendererConfig());
 
     /**
      * @brief Destructs the VulkanRenderer and cleans up all Vulkan resources
      */
     ~VulkanRenderer();
 
+    /**
+     * @brief Returns the context this renderer was created on
+     * @return The shared VulkanContext
+     */
+    std::shared_ptr<VulkanContext> getContext() const;
+
     /**
      * @brief Returns the Vulkan instance associated with this renderer
      * @return The VkInstance used for all Vulkan operations
@@ -113,65 +252,178 @@ class VulkanRenderer {
     void waitForLogicalDevices();
 
     /**
-     * @brief Draws a single frame to the screen.
+     * @brief Waits for all frames submitted by this renderer to complete
+     *
+     * Unlike waitForLogicalDevices, this does not wait for work submitted by other streams
+     * sharing the context. Exported frames still waiting for their fence are published
+     */
+    void waitForFrames();
+
+    /**
+     * @brief Draws a single frame to the screen, or to the next offscreen target if headless.
      */
     void drawFrame();
 
     /**
-     * @brief Reads the contents of a binary file into a byte buffer.
+     * @brief Tells the renderer the surface was resized, so the swap chain is recreated after
+     * the next present. Some platforms never report the old swap chain as out of date. Must
+     * be called from the thread that draws the frames
+     */
+    void notifyResize();
+
+    /**
+     * @brief Returns the size of the output frames
+     * @return The configured width and height, whatever the window and render sizes
+     */
+    VkExtent2D getExtent() const;
+
+    /**
+     * @brief Returns the time spent culling so far. The device time of a frame is only
+     * included once the frame's fence has been waited on
+     */
+    CullStats getCullStats() const;
+
+    /**
+     * @brief Copies the last rendered frame back to host memory as tightly packed RGBA
      *
-     * Opens the specified file in binary mode and reads all contents into a std::vector<char>.
-     * This is typically used for reading SPIR-V shader files or other binary assets needed for
-     * Vulkan rendering
+     * Waits for the frame to finish rendering, then copies its offscreen target into a
+     * host-visible buffer. Only headless renderers can be read back
      *
-     * @param filename The path to the file to be read
-     * @return A vector containing the binary contents of the file
+     * @param rgba Receives width * height * 4 bytes
+     * @throws std::runtime_error if the renderer presents to a surface or the copy fails
+     */
+    void readFrame(std::vector<uint8_t> &rgba);
+
+    /**
+     * @brief Reads the pixels of a frame in place, in the mapped readback buffer
+     */
+    using FrameReader = std::function<void(const uint8_t *rgba, VkExtent2D extent)>;
+
+    /**
+     * @brief Copies the last rendered frame into the readback buffer and passes it to a
+     * reader, which sees tightly packed RGBA without a further copy
+     * @param reader Called once with the frame, which is only valid during the call
+     * @throws std::runtime_error if the renderer presents to a surface or the copy fails
+     */
+    void readFrame(const FrameReader &reader);
+
+    /**
+     * @brief Copies the last rendered frame into a readback buffer and passes it to a reader
+     * on a thread pool, without waiting for the frame or the copy
+     *
+     * Up to readbackSlotCount frames are read back at once; a call only waits when the
+     * reader of the oldest is still running
      *
-     * @throws std::runtime_error if the file cannot be opened
+     * @param pool Pool the reader runs on, after the copy has completed
+     * @param reader Called once with the frame, which is only valid during the call
+     * @return Becomes ready once the reader has returned, holding any exception it threw
+     * @throws std::runtime_error if the renderer presents to a surface or the copy fails
      */
-    static std::vector<char> readFile(const std::string &filename);
+    std::shared_future<void> readFrameAsync(ThreadPool &pool, FrameReader reader);
 
-  protected:
-    /// @brief The Vulkan instance used by the renderer
-    VkInstance instance;
+    /// @brief Frames that can be read back at once
+    static constexpr uint32_t readbackSlotCount = 3;
 
-    /// @brief The debug messenger for Vulkan validation layer messages
-    VkDebugUtilsMessengerEXT debugMessenger;
+    /**
+     * @brief Requests a snapshot of the next frame, written to a PNG or PPM file in the
+     * background
+     *
+     * The copy is recorded into the next frame's command buffer, after its render pass. Once
+     * that frame's fence has been waited on, the pixels are handed to a SnapshotWriter that
+     * encodes them on its own threads, so the render loop never waits for the GPU or the
+     * encoder. The host-visible buffer the frame is copied into is allocated here rather than
+     * in drawFrame(). Must be called from the thread that draws the frames
+     *
+     * @param path Path of the file; ".ppm" selects PPM, anything else PNG
+     * @throws std::runtime_error if the buffer cannot be created
+     */
+    void requestSnapshot(const std::string &path);
 
-    /// @brief The selected physical GPU device
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    /**
+     * @brief Waits until every snapshot recorded into a drawn frame has been written
+     */
+    void waitForSnapshots();
 
-    /// @brief The logical device created from the selected physical GPU
-    VkDevice device;
+    /**
+     * @brief Opens a binary asset file as a read-only view.
+     *
+     * Large files (meshes, textures, YUV clips) are memory-mapped so their contents can be
+     * copied straight from the page cache into staging memory. Small files such as SPIR-V
+     * shaders are read into a buffer owned by the returned object. See AssetFile for details
+     *
+     * @param filename The path to the file to be read
+     * @return An AssetFile that keeps the contents alive until it is destroyed
+     *
+     * @throws std::runtime_error if the file cannot be opened, mapped or read
+     */
+    static AssetFile readFile(const std::string &filename);
 
-    /// @brief Graphics queue retrieved from the logical device
-    VkQueue graphicsQueue;
+  protected:
+    /// @brief Device-level state, possibly shared with other renderers
+    std::shared_ptr<VulkanContext> context;
 
-    /// @brief Present queue retrieved from the logical device (if surface attached)
-    VkQueue presentQueue;
+    /// @brief The logical device of the context
+    VkDevice device;
 
-    /// @brief The Vulkan surface used for presentation, if attached (may be VK_NULL_HANDLE for
+    /// @brief The Vulkan surface of the context, if attached (may be VK_NULL_HANDLE for
     /// headless rendering)
     VkSurfaceKHR surface = VK_NULL_HANDLE;
 
     /// @brief The Vulkan swapchain used for presenting rendered images to the surface
     VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 
-    /// @brief The list of images associated with the swapchain
+    /// @brief The swapchain images, which the output frames are scaled into for presentation
     std::vector<VkImage> swapChainImages;
 
-    /// @brief Image views created from the swapchain images for use in framebuffers
-    std::vector<VkImageView> swapChainImageViews;
-
     /// @brief The format used by the swapchain images
     VkFormat swapChainImageFormat;
 
-    /// @brief The resolution of the swapchain images
-    VkExtent2D swapChainExtent;
+    /// @brief The resolution of the swapchain images, which follows the window
+    VkExtent2D swapChainExtent = {};
+
+    /// @brief Whether output frames are blitted into the swapchain images. Otherwise the surface
+    /// does not allow blits into them, and the present pass draws the frames instead
+    bool presentBlit = true;
+
+    /// @brief Views of the swapchain images, for the present pass
+    std::vector<VkImageView> swapChainImageViews;
+
+    /// @brief Framebuffers of the present pass, one per swapchain image
+    std::vector<VkFramebuffer> swapChainFramebuffers;
+
+    /// @brief Offscreen images the scene is rendered into, one per frame in flight. They are
+    /// sized for the output, padded to whole 16x16 macroblocks, and the scene covers their top
+    /// left renderExtent pixels
+    std::vector<VkImage> renderTargets;
+
+    /// @brief Memory backing the render targets
+    std::vector<VkDeviceMemory> renderTargetsMemory;
 
-    /// @brief Optional surface provider used to create a rendering surface (e.g. window
-    /// surface)
-    SurfaceProvider *surfaceProvider;
+    /// @brief Views of the render targets for use in framebuffers
+    std::vector<VkImageView> renderTargetViews;
+
+    /// @brief Images the render targets are scaled up into, one per frame in flight, when the
+    /// render size can differ from the output size. Otherwise the render targets are the output
+    std::vector<VkImage> outputImages;
+
+    /// @brief Memory backing the output images
+    std::vector<VkDeviceMemory> outputImagesMemory;
+
+    /// @brief Views of the output images, which the present pass samples
+    std::vector<VkImageView> outputImageViews;
+
+    /// @brief Size of the output frames
+    VkExtent2D outputExtent = {};
+
+    /// @brief Size of the render targets and output images: the output size rounded up to a
+    /// multiple of 16
+    VkExtent2D targetExtent = {};
+
+    /// @brief Size the scene is currently rendered at
+    VkExtent2D renderExtent = {};
+
+    /// @brief Adjusts the render size to the GPU frame time, if dynamic resolution is enabled
+    std::optional<ResolutionController> resolutionController;
 
     /// @brief Vulkan render pass defining attachments and subpasses used during rendering
     VkRenderPass renderPass;
@@ -182,8 +434,30 @@ class VulkanRenderer {
     /// @brief The graphics pipeline encapsulating all fixed function and programmable stages
     VkPipeline graphicsPipeline;
 
-    /// @brief Framebuffers for each image in the swap chain
-    std::vector<VkFramebuffer> swapChainFramebuffers;
+    /// @brief Framebuffers for each render target
+    std::vector<VkFramebuffer> framebuffers;
+
+    /// @brief Render pass drawing the output frames into swapchain images that cannot be blitted
+    /// into
+    VkRenderPass presentRenderPass = VK_NULL_HANDLE;
+
+    /// @brief Descriptor set layout for the output image the present pass samples
+    VkDescriptorSetLayout presentDescriptorSetLayout = VK_NULL_HANDLE;
+
+    /// @brief Pipeline layout of the present pipeline
+    VkPipelineLayout presentPipelineLayout = VK_NULL_HANDLE;
+
+    /// @brief Pipeline drawing an output frame over the letterboxed region of a swapchain image
+    VkPipeline presentPipeline = VK_NULL_HANDLE;
+
+    /// @brief Descriptor pool from which the present descriptor sets are allocated
+    VkDescriptorPool presentDescriptorPool = VK_NULL_HANDLE;
+
+    /// @brief Per-frame descriptor sets sampling each frame in flight's output
+    std::vector<VkDescriptorSet> presentDescriptorSets;
+
+    /// @brief Bilinear, clamping sampler of the output frames
+    VkSampler presentSampler = VK_NULL_HANDLE;
 
     /// @brief Command pool used to allocate Vulkan command buffers
     VkCommandPool commandPool;
@@ -205,100 +479,404 @@ class VulkanRenderer {
     /// @brief Index of the current frame being rendered
     uint32_t currentFrame = 0;
 
-    /// @brief List of Vulkan validation layers to enable (if supported)
-    const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
+    /// @brief Set by notifyResize() until the swap chain is recreated
+    bool framebufferResized = false;
+
+    /// @brief Configuration the renderer was created with
+    RendererConfig config;
+
+    /// @brief Effective culling mode, downgraded to Cpu if the device lacks drawIndirectCount
+    /// or drawIndirectFirstInstance
+    CullingMode cullingMode = CullingMode::Gpu;
+
+    /// @brief Number of instances in the scene
+    uint32_t instanceCount = 1;
+
+    /// @brief Host copy of the scene instances, used for CPU culling
+    std::vector<InstanceData> instances;
+
+    /// @brief Indices of the mesh drawn once per surviving instance
+    const std::vector<uint32_t> meshIndices = {0, 1, 2};
+
+    /// @brief Device-local index buffer for the mesh
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+
+    /// @brief Memory backing the index buffer
+    VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+
+    /// @brief Device-local storage buffer holding all scene instances
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+
+    /// @brief Memory backing the instance buffer
+    VkDeviceMemory instanceBufferMemory = VK_NULL_HANDLE;
+
+    /// @brief Per-frame indirect draw command buffers (device-local for Gpu, mapped for Cpu)
+    std::vector<VkBuffer> indirectBuffers;
+
+    /// @brief Memory backing the indirect draw command buffers
+    std::vector<VkDeviceMemory> indirectBuffersMemory;
+
+    /// @brief Persistently mapped pointers to the indirect buffers (Cpu culling only)
+    std::vector<void *> indirectBuffersMapped;
+
+    /// @brief Commands of the surviving instances, drawn directly rather than indirectly when
+    /// the device lacks drawIndirectFirstInstance (Cpu culling only)
+    std::vector<VkDrawIndexedIndirectCommand> directDrawCommands;
+
+    /// @brief Time spent culling so far
+    CullStats cullStats;
+
+    /// @brief Per-frame buffers holding the number of draws written by the cull pass
+    std::vector<VkBuffer> drawCountBuffers;
+
+    /// @brief Memory backing the draw count buffers
+    std::vector<VkDeviceMemory> drawCountBuffersMemory;
+
+    /// @brief Host-visible buffer holding one FrameUniforms slot per frame in flight
+    VkBuffer frameUniformBuffer = VK_NULL_HANDLE;
+
+    /// @brief Memory backing the frame uniform buffer
+    VkDeviceMemory frameUniformBufferMemory = VK_NULL_HANDLE;
+
+    /// @brief Persistent mapping of the frame uniform buffer
+    uint8_t *frameUniformsMapped = nullptr;
+
+    /// @brief Distance between the slots of the frame uniform buffer, a multiple of the
+    /// device's minimum uniform buffer offset alignment
+    VkDeviceSize frameUniformStride = 0;
+
+    /// @brief Host copy of the uniforms of the frame being recorded
+    FrameUniforms frameUniforms = {};
+
+    /// @brief Number of the next frame on the animation clock
+    uint64_t animationFrame = 0;
+
+    /// @brief Descriptor set layout for the instance buffer, frame uniforms and texture of the
+    /// graphics pipeline
+    VkDescriptorSetLayout sceneDescriptorSetLayout = VK_NULL_HANDLE;
+
+    /// @brief Descriptor set layout for the instance, indirect and count buffers of the cull pass
+    VkDescriptorSetLayout cullDescriptorSetLayout = VK_NULL_HANDLE;
+
+    /// @brief Descriptor pool from which the scene and cull descriptor sets are allocated
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+
+    /// @brief Descriptor set binding the instance buffer and frame uniform ring for the graphics
+    /// pipeline, allocated once and offset to the current frame's slot when bound. It samples
+    /// the placeholder texture
+    VkDescriptorSet sceneDescriptorSet = VK_NULL_HANDLE;
+
+    /// @brief Copy of the scene descriptor set that samples the scene texture, written once the
+    /// texture is ready and bound from then on
+    VkDescriptorSet texturedDescriptorSet = VK_NULL_HANDLE;
+
+    /// @brief Streams textures to the device
+    std::unique_ptr<TextureUploader> textureUploader;
+
+    /// @brief White 1x1 texture sampled until the scene texture is ready, which leaves the
+    /// colours unchanged
+    uint32_t placeholderTexture = 0;
+
+    /// @brief Texture of the scene, if one was requested
+    std::optional<uint32_t> sceneTexture;
+
+    /// @brief Pixels of the scene texture, kept until its upload completes
+    std::vector<uint8_t> sceneTexturePixels;
+
+    /// @brief Whether the textured descriptor set has been written and is bound
+    bool sceneTextureBound = false;
+
+    /// @brief Trilinear, repeating sampler of the scene textures
+    VkSampler textureSampler = VK_NULL_HANDLE;
+
+    /// @brief Per-frame descriptor sets for the cull compute pass
+    std::vector<VkDescriptorSet> cullDescriptorSets;
+
+    /// @brief Pipeline layout of the cull compute pipeline
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+
+    /// @brief Compute pipeline that culls instances and compacts indirect draws
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+
+    /**
+     * @struct Readback
+     * @brief A host-visible buffer a frame is read back into, and the copy writing it
+     */
+    struct Readback {
+        /// @brief Buffer the frame is copied into
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+        /// @brief Memory backing the buffer
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+
+        /// @brief The buffer's persistently mapped pixels
+        const uint8_t *pixels = nullptr;
+
+        /// @brief Command buffer recording the copy
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
 
-    /// @brief List of Vulkan device extensions to enable
+        /// @brief Fence signalled when the copy completes
+        VkFence fence = VK_NULL_HANDLE;
 
-    std::vector<const char *> deviceExtensions = {
-        VK_KHR_VIDEO_QUEUE_EXTENSION_NAME, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
-        VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME, VK_KHR_VIDEO_ENCODE_H264_EXTENSION_NAME};
+        /// @brief Whether the copy has been submitted since the slot was last retired
+        bool submitted = false;
+
+        /// @brief Whether the copy writes timestamps, and when it was submitted
+        bool timestamped = false;
+        uint64_t submitTime = 0;
+
+        /// @brief Reader of an asynchronous readback, waited on before the slot is reused
+        std::shared_future<void> done;
+    };
+
+    /// @brief Readback slots, used in turn and created on first use
+    std::vector<Readback> readbacks;
+
+    /// @brief Slot the next frame is read back into
+    uint32_t nextReadback = 0;
+
+    /**
+     * @struct Snapshot
+     * @brief A requested snapshot and the host-visible buffer its frame is copied into
+     */
+    struct Snapshot {
+        /// @brief Path of the file
+        std::string path;
+
+        /// @brief Size of the frame the buffer holds
+        VkExtent2D extent = {};
+
+        /// @brief Whether the render targets store their pixels as B, G, R, A
+        bool bgra = false;
+
+        /// @brief Buffer the frame is copied into
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+        /// @brief Memory backing the buffer
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+
+        /// @brief The buffer's persistently mapped pixels
+        const uint8_t *pixels = nullptr;
+    };
+
+    /// @brief Snapshots requested since the last frame was recorded
+    std::vector<Snapshot> requestedSnapshots;
+
+    /// @brief Snapshots copied by each frame in flight, handed to the writer once the frame's
+    /// fence has been waited on
+    std::vector<std::vector<Snapshot>> frameSnapshots;
+
+    /// @brief Encodes and writes the snapshots, created on the first request
+    std::unique_ptr<SnapshotWriter> snapshotWriter;
+
+    /// @brief Shares the frames with other processes, if enabled
+    std::unique_ptr<FrameExporter> frameExporter;
 
     /// @brief Maximum number of frames that can be processed concurrently
     const int maxFramesInFlight = 2;
-    uint32_t swapchainImageCount = 0;
 
-    /// @brief Whether to enable validation layers (only in debug builds)
-#ifdef NDEBUG
-    const bool enableValidationLayers = false;
-#else
-    const bool enableValidationLayers = true;
-#endif
+    /**
+     * @struct FrameTiming
+     * @brief GPU timing state of a frame in flight
+     */
+    struct FrameTiming {
+        /// @brief Whether the frame's command buffer writes timestamps
+        bool timestamped = false;
+
+        /// @brief Whether the frame copies snapshots after its render pass
+        bool snapshotCopies = false;
+
+        /// @brief Host time the frame was submitted at, in steady clock nanoseconds
+        uint64_t submitTime = 0;
+    };
+
+    /// @brief Timestamps of every frame: frameTimestampQueries per frame in flight, then two
+    /// around each readback slot's copy while a trace capture runs. VK_NULL_HANDLE if
+    /// timestamps are unsupported
+    VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+
+    /// @brief Timestamps of a frame: its start, the end of culling, of the render pass and of
+    /// the frame
+    static constexpr uint32_t frameTimestampQueries = 4;
+
+    /// @brief GPU timing state of each frame in flight
+    std::vector<FrameTiming> frameTimings;
+
+    /// @brief Tracer track the GPU spans of this renderer are recorded on
+    uint32_t gpuTrack = 0;
+
+    /// @brief Nanoseconds added to device timestamps to convert them to steady clock time
+    int64_t gpuClockOffset = 0;
+
+    /// @brief Whether gpuClockOffset has been set, and whether it comes from calibrated
+    /// timestamps rather than from submission times
+    bool gpuClockValid = false;
+    bool gpuClockCalibrated = false;
+
+    /// @brief Host time the GPU clock was last calibrated at
+    uint64_t gpuClockCalibrationTime = 0;
 
     /**
-     * @brief Initialises Vulkan (instance, debug layers, etc.)
+     * @brief Initialises the per-stream Vulkan resources on the context
      */
     void init();
 
     /**
-     * @brief Sets up the Vulkan debug messenger for validation callback
+     * @brief Creates the Vulkan swap chain.
+     *
+     * Queries surface capabilities and selects optimal surface format, present mode,
+     * and extent for the swap chain configuration
      */
-    void setupDebugMessenger();
+    void createSwapChain();
 
     /**
-     * @brief Populates the debug messenger creation info struct
-     * @param createInfo The struct to fill with layer callback info.
+     * @brief Creates the readback slots' buffers, command buffers and fences
+     * @throws std::runtime_error if a resource cannot be created
      */
-    void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
+    void createReadbackResources();
 
     /**
-     * @brief Manually creates the debug messenger (if extension is available)
-     * @param pCreateInfo Creation parameters
-     * @param pAllocator Optional custom memory allocator
-     * @return VK_SUCCESS or error code
+     * @brief Records and submits the copy of the last rendered frame into the next readback
+     * slot, once the slot's previous reader has returned. Does not wait for the copy
+     * @return The slot
+     * @throws std::runtime_error if the renderer presents to a surface or the submission fails
      */
-    VkResult createDebugUtilsMessengerEXT(const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-                                          const VkAllocationCallbacks *pAllocator);
+    Readback &submitReadback();
 
     /**
-     * @brief Manually destroys the debug messenger
-     * @param pAllocator Optional custom memory allocator
+     * @brief Records the GPU span of a completed readback copy, if it wrote timestamps, and
+     * marks its slot free
      */
-    void destroyDebugUtilsMessenger(const VkAllocationCallbacks *pAllocator);
+    void retireReadback(Readback &readback);
 
     /**
-     * @brief Creates the Vulkan instance
+     * @brief Creates the host-visible buffer a snapshot is copied into, sized for the current
+     * render targets, and maps it
+     * @throws std::runtime_error if the buffer cannot be created
      */
-    void createInstance();
+    void createSnapshotBuffer(Snapshot &snapshot);
 
     /**
-     * @brief Picks a suitable physical GPU device that supports required features
-     *
-     * Enumerates all Vulkan-compatible devices and selects the first one that meets
-     * application requirements
-     *
-     * @throws std::runtime_error if no suitable GPU is found
+     * @brief Records the copies of the requested snapshots into a frame's command buffer
+     * @param commandBuffer The frame's command buffer, after its render pass
+     * @param image The render target the frame is drawn to
+     */
+    void recordSnapshotCopies(VkCommandBuffer commandBuffer, VkImage image);
+
+    /**
+     * @brief Hands the snapshots of a frame whose fence has been waited on to the writer,
+     * which destroys their buffers once encoded
+     * @param frameIndex Index of the frame in flight
+     */
+    void retireSnapshots(uint32_t frameIndex);
+
+    /**
+     * @brief Creates the timestamp query pool used to trace GPU work, if the queue supports it
      */
-    void pickPhysicalDevice();
+    void createTimestampQueries();
 
     /**
-     * @brief Creates the Vulkan logical device and retrieves the graphics queue
+     * @brief Adds the GPU stage times of a completed frame in flight to the metrics, and its
+     * spans to a running trace
+     * @param frameIndex Index of the frame in flight, whose fence has been waited on
+     */
+    void retireTimestamps(uint32_t frameIndex);
+
+    /**
+     * @brief Updates the offset between device timestamps and steady clock time
      *
-     * This function selects the appropriate queue family from the physical device,
-     * enables required features, and creates a logical device interface
+     * The offset comes from calibrated timestamps, refreshed about once a second. Without
+     * them, it is the smallest one that starts no submission before it was made
      *
-     * @throws std::runtime_error if device creation fails.
+     * @param submitTime Host time work was submitted at
+     * @param startTicks Device timestamp of the start of that work
      */
-    void createLogicalDevice();
+    void updateGpuClock(uint64_t submitTime, uint64_t startTicks);
 
     /**
-     * @brief Creates the Vulkan swap chain.
-     *
-     * Queries surface capabilities and selects optimal surface format, present mode,
-     * and extent for the swap chain configuration
+     * @brief Converts a device timestamp to steady clock nanoseconds
      */
-    void createSwapChain();
+    uint64_t toHostTime(uint64_t ticks) const;
 
     /**
-     * @brief Recreates the swap chain and all associated resources
+     * @brief Recreates the swap chain at the window's new size. The render targets are left
+     * unchanged
      */
     void recreateSwapChain();
 
     /**
-     * @brief Creates image views for all images in the swapchain
+     * @brief Creates the render targets, and the output images if the render size can differ
+     * from the output size
+     *
+     * One of each is created per frame in flight, at the output size padded to a multiple of 16
+     *
+     * @throws std::runtime_error if an image cannot be created
+     */
+    void createRenderTargets();
+
+    /**
+     * @brief Creates image views for all render targets
      */
     void createImageViews();
 
+    /**
+     * @brief Sets the render size from the output size and a fraction of it
+     */
+    void setRenderScale(float scale);
+
+    /**
+     * @brief Returns the image holding a frame in flight's output
+     */
+    VkImage getOutputImage(uint32_t frameIndex) const;
+
+    /**
+     * @brief Records the scaling of a frame's render target to the output size, if they
+     * differ, and leaves the output image ready to be copied from
+     * @param commandBuffer The frame's command buffer, after its render pass
+     */
+    void recordOutputScaling(VkCommandBuffer commandBuffer);
+
+    /**
+     * @brief Records the scaling of the frame's output into a swapchain image, letterboxed to
+     * keep its aspect ratio, and leaves the image ready to present
+     * @param commandBuffer The frame's command buffer, after the output is complete
+     * @param image The swapchain image to present
+     */
+    void recordPresentBlit(VkCommandBuffer commandBuffer, VkImage image);
+
+    /**
+     * @brief Records the drawing of the frame's output into a swapchain image, letterboxed to
+     * keep its aspect ratio, for surfaces that do not allow blits into their images
+     * @param commandBuffer The frame's command buffer, after the output is complete
+     * @param imageIndex Index of the swapchain image to present
+     */
+    void recordPresentDraw(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+    /**
+     * @brief Returns the region of the swapchain images the output is fitted into, centred and
+     * keeping its aspect ratio
+     */
+    VkRect2D getPresentRect() const;
+
+    /**
+     * @brief Creates the render pass and pipeline that draw the output frames into the
+     * swapchain images when they cannot be blitted into
+     * @throws std::runtime_error if an object cannot be created
+     */
+    void createPresentPipeline();
+
+    /**
+     * @brief Creates the sampler, output image views and descriptor sets of the present pass
+     * @throws std::runtime_error if an object cannot be created
+     */
+    void createPresentDescriptorSets();
+
+    /**
+     * @brief Creates the swapchain image views and framebuffers of the present pass
+     * @throws std::runtime_error if an object cannot be created
+     */
+    void createPresentFramebuffers();
+
     /**
      * @brief Creates the Vulkan graphics pipeline
      *
@@ -310,22 +888,118 @@ class VulkanRenderer {
      */
     void createGraphicsPipeline();
 
+    /**
+     * @brief Creates the descriptor set layouts used by the scene and the cull pass
+     *
+     * @throws std::runtime_error if a descriptor set layout cannot be created
+     */
+    void createDescriptorSetLayouts();
+
+    /**
+     * @brief Creates the compute pipeline used for GPU frustum culling
+     *
+     * Only created when the culling mode is Gpu
+     *
+     * @throws std::runtime_error if the pipeline or layout creation fails
+     */
+    void createCullPipeline();
+
+    /**
+     * @brief Generates the scene instances and uploads them with the mesh index buffer
+     *
+     * Also creates the per-frame indirect command and draw count buffers
+     */
+    void createSceneBuffers();
+
+    /**
+     * @brief Creates the persistently mapped ring of per-frame uniforms
+     * @throws std::runtime_error if the buffer cannot be created or mapped
+     */
+    void createFrameUniformBuffer();
+
+    /**
+     * @brief Advances the animation clock and writes the uniforms of the frame being recorded
+     * @param frameIndex Index of the frame in flight, whose fence has been waited on
+     */
+    void updateFrameUniforms(uint32_t frameIndex);
+
+    /**
+     * @brief Creates the texture uploader and sampler, uploads the placeholder texture and
+     * queues the scene texture
+     * @throws std::runtime_error if creation or the placeholder upload fails
+     */
+    void createTextures();
+
+    /**
+     * @brief Flushes the next part of the texture uploads, and switches to the textured
+     * descriptor set once the scene texture is ready
+     * @throws std::runtime_error if the flush fails
+     */
+    void updateSceneTexture();
+
+    /**
+     * @brief Creates the descriptor pool and writes the scene and cull descriptor sets
+     *
+     * @throws std::runtime_error if descriptor pool creation or set allocation fails
+     */
+    void createDescriptorSets();
+
+    /**
+     * @brief Culls all instances against the frustum on the host
+     *
+     * Writes one indirect draw command per surviving instance into the mapped indirect buffer
+     * of the given frame
+     *
+     * @param frameIndex Index of the frame in flight whose indirect buffer is written
+     * @return The number of draw commands written
+     */
+    uint32_t cullInstancesOnCpu(uint32_t frameIndex);
+
+    /**
+     * @brief Computes the frustum planes instances are culled against, from the camera of the
+     * frame being recorded
+     * @return Six planes as (normal.xyz, distance) with normals pointing inwards
+     */
+    std::array<std::array<float, 4>, 6> computeFrustumPlanes() const;
+
+    /**
+     * @brief Creates a device-local buffer and fills it through a temporary staging buffer
+     * @param data Pointer to the data to upload
+     * @param size Size of the data in bytes
+     * @param usage Buffer usage flags (transfer destination is added automatically)
+     * @param buffer Receives the created buffer
+     * @param bufferMemory Receives the allocated memory
+     */
+    void createDeviceLocalBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage,
+                                 VkBuffer &buffer, VkDeviceMemory &bufferMemory);
+
+    /**
+     * @brief Copies data between two buffers and waits for the copy to complete
+     *
+     * Waits on a fence rather than the queue, so other streams sharing the queue are not
+     * stalled
+     * @param srcBuffer Source buffer
+     * @param dstBuffer Destination buffer
+     * @param size Number of bytes to copy
+     */
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+
     /**
      * @brief Creates a basic Vulkan render pass
      *
-     * Configures a single-color attachment render pass suitable for on-screen rendering
-     * Sets load/store operations, layout transitions, and defines a basic subpass with a single
-     * attachment
+     * Configures a single-color attachment render pass for the render targets. Sets load/store
+     * operations, layout transitions, and defines a basic subpass with a single attachment.
+     * Render targets end in TRANSFER_SRC_OPTIMAL so they can be scaled or read back
      *
      * @throws std::runtime_error if the render pass creation fails
      */
     void createRenderPass();
 
     /**
-     * @brief Creates framebuffers for each swap chain image view
+     * @brief Creates framebuffers for each render target view
      *
-     * Sets up one framebuffer per image view in the swap chain, using the render pass.
-     * These framebuffers are used as rendering targets during drawing operations
+     * Sets up one framebuffer per render target, using the render pass. These framebuffers
+     * are used as rendering targets during drawing operations
      *
      * @throws std::runtime_error if framebuffer creation fails
      */
@@ -359,12 +1033,14 @@ class VulkanRenderer {
     /**
      * @brief Records commands into the given command buffer for rendering a frame
      *
-     * Begins command buffer recording, starts the render pass, binds the graphics pipeline,
-     * sets the viewport and scissor to cover the entire swap chain extent, issues a draw call,
-     * and ends the render pass and command buffer
+     * Begins command buffer recording, culls the scene instances (with a compute dispatch or on
+     * the host), starts the render pass, binds the graphics pipeline, sets the viewport and
+     * scissor to cover the render size, issues the indirect draws, ends the render pass, scales
+     * the frame to the output size, copies it into any requested snapshots, scales it into the
+     * swapchain image when presenting and ends the command buffer
      *
      * @param commandBuffer The command buffer to record commands into
-     * @param imageIndex Index of the swap chain image to render to (used to select framebuffer)
+     * @param imageIndex Index of the swap chain image to present (ignored when headless)
      *
      * @throws std::runtime_error if beginning or ending command buffer recording fails
      */
@@ -373,59 +1049,28 @@ class VulkanRenderer {
     /**
      * @brief Creates a Vulkan shader module from SPIR-V bytecode
      *
-     * Takes raw SPIR-V binary data and wraps it in a VkShaderModule, which can be used
-     * for pipeline shader stages
+     * Takes raw SPIR-V words and wraps them in a VkShaderModule, which can be used
+     * for pipeline shader stages. The code is passed to the driver without being copied
      *
-     * @param code The SPIR-V bytecode of the shader
+     * @param code Pointer to the SPIR-V words of the shader
+     * @param codeSize Size of the SPIR-V code in bytes
      * @return A VkShaderModule representing the compiled shader
      * @throws std::runtime_error if shader module creation fails
      */
-    VkShaderModule createShaderModule(const std::vector<char> &code);
-
-    /**
-     * @brief Checks if a given physical device is suitable for use
-     *
-     * Currently checks for graphics queue family support
-     *
-     * @param device The physical device to evaluate
-     * @return true if the device meets the required criteria
-     */
-    bool isDeviceSuitable(VkPhysicalDevice device);
+    VkShaderModule createShaderModule(const uint32_t *code, size_t codeSize);
 
     /**
-     * @brief Finds queue families that support required capabilities on a device
+     * @brief Creates a shader module for a named shader
      *
-     * Searches for queue families that support graphics commands
+     * Shaders are embedded into the binary at build time. If the "VULKAN_SHADER_DIR"
+     * environment variable is set and contains a file with the given name, that file is used
+     * instead, which allows iterating on shaders without rebuilding
      *
-     * @param device The physical device to query
-     * @return A QueueFamilyIndices struct with matching queue families
-     */
-    QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
-
-    /**
-     * @brief Checks whether a physical device supports all required Vulkan device extensions
-     *
-     * This function queries all available extensions on the provided Vulkan physical device
-     * and compares them against the list of required extensions defined in "deviceExtensions".
-     * It logs found and missing extensions for debugging purposes.
-     *
-     * @param device The Vulkan physical device to query for extension support.
-     * @return true if all required extensions are supported by the device, false otherwise.
-     */
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device);
-
-    /**
-     * @brief Queries the swap chain support details for a given physical device
-     *
-     * This function checks the capabilities, supported formats, and present modes
-     * of the swap chain for the currently attached Vulkan surface (if any).
-     * If no surface is present (headless mode), the returned details will be empty
-     *
-     * @param device The physical Vulkan device to query.
-     * @return A SwapChainSupportDetails struct containing surface capabilities,
-     *         supported formats, and present modes for the specified device
+     * @param name Name of the shader (e.g. "vert.spv")
+     * @return A VkShaderModule representing the compiled shader
+     * @throws std::runtime_error if the shader is unknown or module creation fails
      */
-    SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
+    VkShaderModule loadShaderModule(const std::string &name);
 
     /**
      * @brief Chooses the preferred surface format for the swap chain.
@@ -459,37 +1104,18 @@ class VulkanRenderer {
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
 
     /**
-     * @brief Checks if the requested validation layers are available
-     * @return True if all requested layers are supported
+     * @brief Destroys the Vulkan swap chain, if there is one, and the present pass's views and
+     * framebuffers of its images
      */
-    bool checkValidationLayerSupport();
+    void cleanupSwapChain();
 
     /**
-     * @brief Gets the required extensions for Vulkan initialisation
-     * @return A list of extension names
+     * @brief Destroys the framebuffers, render targets and output images
      */
-    std::vector<const char *> getRequiredExtensions();
-
-    /**
-     * @brief Cleans up resources associated with the Vulkan swap chain.
-     */
-    void cleanupSwapChain();
+    void cleanupRenderTargets();
 
     /**
      * @brief Shuts down the renderer and releases resources
      */
     void shutdown();
-
-    /**
-     * @brief Callback for Vulkan validation layer messages
-     * @param messageSeverity Severity of the message
-     * @param messageType Type of message (general, validation, performance)
-     * @param pCallbackData Message details
-     * @param pUserData Optional user data
-     * @return VK_FALSE to indicate message should not abort execution
-     */
-    static VKAPI_ATTR VkBool32 VKAPI_CALL
-    debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-                  VkDebugUtilsMessageTypeFlagsEXT messageType,
-                  const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData);
 };
@@ -0,0 +1,60 @@
+#include "resolution_controller.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/// @brief Frames after a change that were recorded at the old scale, and are ignored
+constexpr uint32_t settleFrames = 4;
+
+/// @brief Frames averaged at the new scale before it is judged
+constexpr uint32_t measureFrames = 16;
+
+/// @brief Weight of each new frame time in the moving average
+constexpr double smoothing = 0.125;
+
+/// @brief Fraction of the budget a new scale aims for, leaving headroom for variation
+constexpr double targetLoad = 0.85;
+
+/// @brief Fraction of the budget below which the scale is raised again
+constexpr double lowLoad = 0.6;
+
+/// @brief Granularity of the scale
+constexpr float scaleStep = 1.0f / 16.0f;
+
+} // namespace
+
+ResolutionController::ResolutionController(float minScale, float maxScale, double budgetMs)
+    : minScale(std::min(minScale, maxScale)), maxScale(maxScale), budgetMs(budgetMs),
+      scale(maxScale) {}
+
+bool ResolutionController::update(double gpuMs) {
+    uint32_t frame = framesSinceChange++;
+    if (frame < settleFrames) {
+        return false;
+    }
+    smoothedMs = frame == settleFrames ? gpuMs : smoothedMs + (gpuMs - smoothedMs) * smoothing;
+    if (frame < settleFrames + measureFrames || smoothedMs <= 0.0) {
+        return false;
+    }
+    if (smoothedMs <= budgetMs && (smoothedMs >= budgetMs * lowLoad || scale >= maxScale)) {
+        return false;
+    }
+
+    // Over budget the scale is rounded down, so one step always brings the time under it
+    float ideal = scale * static_cast<float>(std::sqrt(budgetMs * targetLoad / smoothedMs));
+    float steps = ideal / scaleStep;
+    float next = (smoothedMs > budgetMs ? std::floor(steps) : std::round(steps)) * scaleStep;
+    next = std::clamp(next, minScale, maxScale);
+    if (next == scale) {
+        return false;
+    }
+
+    scale = next;
+    framesSinceChange = 0;
+    return true;
+}
+
+float ResolutionController::getScale() const {
+    return scale;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * @class ResolutionController
+ * @brief Picks the fraction of the output size the scene is rendered at from GPU frame times
+ *
+ * The frame time is assumed to grow with the number of pixels drawn, so the scale that meets a
+ * target time is the current one times the square root of the target over the measured time.
+ * Times are smoothed, the scale moves in steps of 1/16, and after each change the frames still
+ * in flight at the old scale are ignored before the new one is judged, so that the render size
+ * neither oscillates nor reacts to a single slow frame
+ */
+class ResolutionController {
+  public:
+    /**
+     * @brief Creates a controller starting at the largest scale
+     * @param minScale Smallest scale the render size may be lowered to
+     * @param maxScale Largest scale, used while the GPU keeps within its budget
+     * @param budgetMs GPU time a frame may take, in milliseconds
+     */
+    ResolutionController(float minScale, float maxScale, double budgetMs);
+
+    /**
+     * @brief Adds the GPU time of a completed frame
+     * @param gpuMs GPU time of the frame in milliseconds
+     * @return Whether the scale changed
+     */
+    bool update(double gpuMs);
+
+    /**
+     * @brief Returns the fraction of the output size to render at
+     */
+    float getScale() const;
+
+  protected:
+    /// @brief Smallest scale the render size may be lowered to
+    float minScale;
+
+    /// @brief Largest scale, used while the GPU keeps within its budget
+    float maxScale;
+
+    /// @brief GPU time a frame may take, in milliseconds
+    double budgetMs;
+
+    /// @brief Current scale
+    float scale;
+
+    /// @brief Exponential moving average of the frame times since the last change
+    double smoothedMs = 0.0;
+
+    /// @brief Frames seen since the last change of scale
+    uint32_t framesSinceChange = 0;
+};
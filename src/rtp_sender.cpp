@@ -0,0 +1,350 @@
+#include "rtp_sender.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+    #include <arpa/inet.h>
+    #include <cerrno>
+    #include <netinet/in.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+/// @brief NAL unit types of the RTP payload format (RFC 6184, section 5.4)
+constexpr uint8_t nalStapA = 24;
+constexpr uint8_t nalFuA = 28;
+
+/// @brief Size of the fixed RTP header
+constexpr size_t fixedHeaderSize = 12;
+
+/// @brief Size of the one-byte header extension (RFC 8285) carrying a 64-bit send time
+constexpr size_t sendTimeExtensionSize = 16;
+
+/// @brief Identifier of the send time element of the header extension
+constexpr uint8_t sendTimeExtensionId = 1;
+
+/**
+ * @struct RtpMetrics
+ * @brief Metrics shared by every RTP sender of the process
+ */
+struct RtpMetrics {
+    Counter &packets;
+    Counter &bytes;
+    Counter &droppedPackets;
+};
+
+const RtpMetrics &getRtpMetrics() {
+    static const RtpMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        return RtpMetrics{
+            registry.getCounter("vulkantest_rtp_packets_sent_total", "RTP packets sent"),
+            registry.getCounter("vulkantest_rtp_bytes_sent_total",
+                                "Bytes of RTP packets sent, headers included"),
+            registry.getCounter("vulkantest_rtp_dropped_packets_total",
+                                "RTP packets the socket refused")};
+    }();
+    return metrics;
+}
+
+void writeBigEndian(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+} // namespace
+
+RtpSender::RtpSender(const RtpSenderConfig &config)
+    : config(config), rtpHeaderSize(fixedHeaderSize +
+                                    (config.sendTime ? sendTimeExtensionSize : 0)) {
+    if (config.mtu < rtpHeaderSize + 64) {
+        throw std::runtime_error("RTP MTU is too small");
+    }
+    if (config.frameRate <= 0.0) {
+        throw std::runtime_error("RTP frame rate must be positive");
+    }
+
+    // Random initial values make streams of successive runs distinguishable (RFC 3550)
+    std::random_device random;
+    if (this->config.ssrc == 0) {
+        this->config.ssrc = random() | 1u;
+    }
+    sequence = static_cast<uint16_t>(random());
+    this->config.batchSize = std::max(this->config.batchSize, 1u);
+
+#ifdef _WIN32
+    throw std::runtime_error("RTP output is not supported on Windows");
+#else
+    socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socketFd < 0) {
+        throw std::runtime_error("failed to create RTP socket");
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) != 1) {
+        close(socketFd);
+        throw std::runtime_error("invalid RTP receiver address " + config.host);
+    }
+    if (connect(socketFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        close(socketFd);
+        throw std::runtime_error("failed to connect RTP socket to " + config.host);
+    }
+
+    // An IDR frame at a high bitrate is hundreds of packets; a small buffer would drop them
+    int bufferSize = 4 << 20;
+    setsockopt(socketFd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+    LOG_INFO("Streaming RTP to " + config.host + ":" + std::to_string(config.port) + " (MTU " +
+             std::to_string(config.mtu) + ", payload type " +
+             std::to_string(config.payloadType) + ").");
+#endif
+}
+
+RtpSender::~RtpSender() {
+#ifndef _WIN32
+    if (socketFd >= 0) {
+        close(socketFd);
+    }
+#endif
+}
+
+void RtpSender::send(const EncodedFrame &frame) {
+    TRACE_SCOPE("rtp send");
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t timestamp =
+        static_cast<uint32_t>(std::llround(frame.frameIndex * 90000.0 / config.frameRate));
+    uint64_t sendTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+
+    packetise(frame.view.data, frame.view.size, timestamp, sendTime);
+    if (!packets.empty()) {
+        transmit();
+        ++stats.frames;
+    }
+}
+
+RtpSenderStats RtpSender::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void RtpSender::packetise(const uint8_t *data, size_t size, uint32_t timestamp,
+                          uint64_t sendTime) {
+    headersUsed = 0;
+    nalUnits.clear();
+    slices.clear();
+    packets.clear();
+
+    // NAL units contain no start code, so every 00 00 01 begins one
+    const uint8_t *end = data + size;
+    const uint8_t *nal = nullptr;
+    for (const uint8_t *p = data + 2; p < end; ++p) {
+        p = static_cast<const uint8_t *>(std::memchr(p, 1, end - p));
+        if (p == nullptr) {
+            break;
+        }
+        if (p[-1] == 0 && p[-2] == 0) {
+            if (nal != nullptr) {
+                nalUnits.push_back({nal, static_cast<size_t>(p - 2 - nal)});
+            }
+            nal = p + 1;
+        }
+    }
+    if (nal != nullptr) {
+        nalUnits.push_back({nal, static_cast<size_t>(end - nal)});
+    }
+
+    // The zero bytes before a start code are trailing_zero_8bits, not part of the NAL unit
+    for (Slice &unit : nalUnits) {
+        while (unit.size > 0 && unit.data[unit.size - 1] == 0) {
+            --unit.size;
+        }
+    }
+    nalUnits.erase(std::remove_if(nalUnits.begin(), nalUnits.end(),
+                                  [](const Slice &unit) { return unit.size == 0; }),
+                   nalUnits.end());
+
+    const size_t maxPayload = config.mtu - rtpHeaderSize;
+    const size_t fragmentSize = maxPayload - 2;
+
+    // Size the headers for the worst case, so the slices pointing into them stay valid
+    size_t maxPackets = 0;
+    for (const Slice &unit : nalUnits) {
+        maxPackets += unit.size / fragmentSize + 2;
+    }
+    size_t maxHeaders = maxPackets * (rtpHeaderSize + 2) + nalUnits.size() * 2;
+    if (headers.size() < maxHeaders) {
+        headers.resize(maxHeaders);
+    }
+
+    // Small NAL units are gathered into a STAP-A packet, or sent alone if only one fits
+    size_t groupStart = 0;
+    size_t groupSize = 1;
+    auto flushGroup = [&](size_t groupEnd) {
+        if (groupEnd == groupStart) {
+            return;
+        }
+        if (groupEnd - groupStart == 1) {
+            beginPacket(timestamp, sendTime, 0);
+            addToPacket(nalUnits[groupStart].data, nalUnits[groupStart].size);
+        } else {
+            uint8_t *stapHeader = beginPacket(timestamp, sendTime, 1);
+            uint8_t forbidden = 0;
+            uint8_t nri = 0;
+            for (size_t i = groupStart; i < groupEnd; ++i) {
+                forbidden |= nalUnits[i].data[0] & 0x80;
+                nri = std::max<uint8_t>(nri, nalUnits[i].data[0] & 0x60);
+
+                uint8_t *nalSize = allocateHeader(2);
+                writeBigEndian(nalSize, nalUnits[i].size, 2);
+                addToPacket(nalSize, 2);
+                addToPacket(nalUnits[i].data, nalUnits[i].size);
+            }
+            stapHeader[0] = forbidden | nri | nalStapA;
+        }
+        groupStart = groupEnd;
+        groupSize = 1;
+    };
+
+    for (size_t i = 0; i < nalUnits.size(); ++i) {
+        const Slice &unit = nalUnits[i];
+        if (unit.size > maxPayload) {
+            flushGroup(i);
+
+            // FU-A: the NAL header is split between the FU indicator and the FU header
+            uint8_t nalHeader = unit.data[0];
+            const uint8_t *payload = unit.data + 1;
+            size_t remaining = unit.size - 1;
+            bool first = true;
+            while (remaining > 0) {
+                size_t count = std::min(remaining, fragmentSize);
+                uint8_t *fuHeader = beginPacket(timestamp, sendTime, 2);
+                fuHeader[0] = (nalHeader & 0xE0) | nalFuA;
+                fuHeader[1] = (first ? 0x80 : 0) | (count == remaining ? 0x40 : 0) |
+                              (nalHeader & 0x1F);
+                addToPacket(payload, count);
+                payload += count;
+                remaining -= count;
+                first = false;
+            }
+            groupStart = i + 1;
+            continue;
+        }
+
+        if (groupSize + 2 + unit.size > maxPayload) {
+            flushGroup(i);
+        }
+        groupSize += 2 + unit.size;
+    }
+    flushGroup(nalUnits.size());
+
+    if (!packets.empty()) {
+        // The marker bit ends the access unit
+        uint8_t *lastHeader = const_cast<uint8_t *>(slices[packets.back().firstSlice].data);
+        lastHeader[1] |= 0x80;
+    }
+}
+
+uint8_t *RtpSender::beginPacket(uint32_t timestamp, uint64_t sendTime,
+                                size_t payloadHeaderSize) {
+    uint8_t *header = allocateHeader(rtpHeaderSize + payloadHeaderSize);
+    header[0] = 0x80 | (config.sendTime ? 0x10 : 0); // version 2, extension bit
+    header[1] = config.payloadType & 0x7F;
+    writeBigEndian(header + 2, sequence++, 2);
+    writeBigEndian(header + 4, timestamp, 4);
+    writeBigEndian(header + 8, config.ssrc, 4);
+
+    if (config.sendTime) {
+        // Profile 0xBEDE, three words: one 8-byte element and three bytes of padding
+        uint8_t *extension = header + fixedHeaderSize;
+        writeBigEndian(extension, 0xBEDE0003, 4);
+        extension[4] = (sendTimeExtensionId << 4) | 7;
+        writeBigEndian(extension + 5, sendTime, 8);
+        std::memset(extension + 13, 0, 3);
+    }
+
+    packets.push_back({slices.size(), 0});
+    addToPacket(header, rtpHeaderSize + payloadHeaderSize);
+    return header + rtpHeaderSize;
+}
+
+uint8_t *RtpSender::allocateHeader(size_t size) {
+    uint8_t *header = headers.data() + headersUsed;
+    headersUsed += size;
+    return header;
+}
+
+void RtpSender::addToPacket(const uint8_t *data, size_t size) {
+    slices.push_back({data, size});
+    ++packets.back().sliceCount;
+}
+
+void RtpSender::transmit() {
+#ifndef _WIN32
+    iovs.resize(slices.size());
+    for (size_t i = 0; i < slices.size(); ++i) {
+        iovs[i].iov_base = const_cast<uint8_t *>(slices[i].data);
+        iovs[i].iov_len = slices[i].size;
+    }
+    messages.assign(packets.size(), mmsghdr());
+    for (size_t i = 0; i < packets.size(); ++i) {
+        messages[i].msg_hdr.msg_iov = &iovs[packets[i].firstSlice];
+        messages[i].msg_hdr.msg_iovlen = packets[i].sliceCount;
+    }
+
+    // With pacing, batch n is sent n / batches of the way through the paced window
+    auto start = std::chrono::steady_clock::now();
+    double window = config.pacing > 0.0 ? std::min(config.pacing, 1.0) / config.frameRate : 0.0;
+    size_t sent = 0;
+    while (sent < packets.size()) {
+        if (window > 0.0 && sent > 0) {
+            std::this_thread::sleep_until(
+                start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                            std::chrono::duration<double>(window * sent / packets.size())));
+        }
+
+        unsigned int count =
+            static_cast<unsigned int>(std::min<size_t>(config.batchSize, packets.size() - sent));
+        int result = sendmmsg(socketFd, &messages[sent], count, 0);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // A connected socket reports ECONNREFUSED while nobody listens; skip the packet
+            if (!errorReported) {
+                LOG_WARN("RTP send failed: " + std::string(std::strerror(errno)));
+                errorReported = true;
+            }
+            ++stats.droppedPackets;
+            getRtpMetrics().droppedPackets.add();
+            ++sent;
+            continue;
+        }
+
+        uint64_t bytes = 0;
+        for (int i = 0; i < result; ++i) {
+            bytes += messages[sent + i].msg_len;
+        }
+        stats.bytes += bytes;
+        stats.packets += result;
+        getRtpMetrics().packets.add(static_cast<uint64_t>(result));
+        getRtpMetrics().bytes.add(bytes);
+        sent += result;
+    }
+#endif
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include "software_encoder.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+#endif
+
+/**
+ * @struct RtpSenderConfig
+ * @brief Configuration options for an RtpSender
+ */
+struct RtpSenderConfig {
+    /// @brief IPv4 address of the receiver
+    std::string host = "127.0.0.1";
+
+    /// @brief UDP port of the receiver
+    uint16_t port = 5004;
+
+    /// @brief Largest UDP payload in bytes, RTP header included
+    size_t mtu = 1200;
+
+    /// @brief Dynamic RTP payload type announced for H.264
+    uint8_t payloadType = 96;
+
+    /// @brief Synchronisation source identifier. If 0, one is picked at random
+    uint32_t ssrc = 0;
+
+    /// @brief Frame rate of the stream, which sets the 90 kHz timestamps and pacing interval
+    double frameRate = 30.0;
+
+    /// @brief Fraction of the frame interval a frame's packets are spread over (0 to 1). If 0,
+    /// each frame is sent as fast as the socket takes it
+    double pacing = 0.0;
+
+    /// @brief Packets handed to the kernel per sendmmsg() call, and per burst when pacing
+    uint32_t batchSize = 32;
+
+    /// @brief Whether packets carry the time their frame was sent in a header extension, from
+    /// which a receiver on the same host measures frame latency
+    bool sendTime = true;
+};
+
+/**
+ * @struct RtpSenderStats
+ * @brief Totals of an RtpSender since it was created
+ */
+struct RtpSenderStats {
+    /// @brief Access units sent
+    uint64_t frames = 0;
+
+    /// @brief Packets sent
+    uint64_t packets = 0;
+
+    /// @brief Packets the socket refused, e.g. while no receiver is listening
+    uint64_t droppedPackets = 0;
+
+    /// @brief UDP payload bytes sent
+    uint64_t bytes = 0;
+};
+
+/**
+ * @class RtpSender
+ * @brief Streams H.264 access units over RTP/UDP as described by RFC 6184
+ *
+ * Uses packetization-mode 1: NAL units that fit in a packet are sent on their own or, when
+ * several small ones fit together (typically the SPS and PPS), aggregated into a STAP-A
+ * packet. Larger NAL units are split into FU-A fragments. The last packet of an access unit
+ * has the marker bit set.
+ *
+ * Packets are gathered with scatter/gather I/O: only the RTP and payload headers are written
+ * by the sender, while the NAL unit bytes are passed to the kernel straight from the
+ * encoder's bitstream ring. Packets go out in sendmmsg() batches, optionally paced over part
+ * of the frame interval to avoid bursts that overflow receive buffers.
+ *
+ * send() can be registered as a VulkanEncoder frame consumer. It is thread-safe, but frames
+ * must be sent in coding order. With pacing, send() blocks its caller for up to the paced
+ * part of the frame interval.
+ */
+class RtpSender {
+  public:
+    /**
+     * @brief Creates a UDP socket connected to the receiver
+     * @param config Sender options
+     * @throws std::runtime_error if the address is invalid, the MTU is too small or the
+     * socket cannot be created
+     */
+    explicit RtpSender(const RtpSenderConfig &config);
+
+    /**
+     * @brief Closes the socket
+     */
+    ~RtpSender();
+
+    RtpSender(const RtpSender &) = delete;
+    RtpSender &operator=(const RtpSender &) = delete;
+
+    /**
+     * @brief Packetises and sends one access unit
+     *
+     * Send errors do not throw, since the receiver of a live preview may come and go; the
+     * packets are counted as dropped instead
+     *
+     * @param frame The access unit, in Annex B format, read through its view
+     */
+    void send(const EncodedFrame &frame);
+
+    /**
+     * @brief Returns the totals since the sender was created
+     */
+    RtpSenderStats getStats() const;
+
+  protected:
+    /**
+     * @struct Slice
+     * @brief A run of bytes of a packet, in the headers or in the frame
+     */
+    struct Slice {
+        /// @brief First byte
+        const uint8_t *data;
+
+        /// @brief Number of bytes
+        size_t size;
+    };
+
+    /**
+     * @struct Packet
+     * @brief An RTP packet as a run of slices
+     */
+    struct Packet {
+        /// @brief First slice of the packet, the RTP header
+        size_t firstSlice;
+
+        /// @brief Number of slices
+        size_t sliceCount;
+    };
+
+    /// @brief Sender options
+    RtpSenderConfig config;
+
+    /// @brief The UDP socket
+    int socketFd = -1;
+
+    /// @brief Size of the RTP header, extension included
+    size_t rtpHeaderSize;
+
+    /// @brief Next RTP sequence number
+    uint16_t sequence;
+
+    /// @brief Guards the packet state and totals
+    mutable std::mutex mutex;
+
+    /// @brief Totals since the sender was created
+    RtpSenderStats stats;
+
+    /// @brief Headers written by the sender, sized for the current frame up front so the
+    /// slices pointing into it stay valid
+    std::vector<uint8_t> headers;
+
+    /// @brief Bytes of "headers" used by the current frame
+    size_t headersUsed = 0;
+
+    /// @brief NAL units of the current frame, without their start codes
+    std::vector<Slice> nalUnits;
+
+    /// @brief Slices of the current frame's packets
+    std::vector<Slice> slices;
+
+    /// @brief Packets of the current frame
+    std::vector<Packet> packets;
+
+#ifndef _WIN32
+    /// @brief I/O vectors of the packets being sent
+    std::vector<iovec> iovs;
+
+    /// @brief Messages handed to sendmmsg()
+    std::vector<mmsghdr> messages;
+#endif
+
+    /// @brief Whether a send error has been reported
+    bool errorReported = false;
+
+    /**
+     * @brief Splits the packets of one access unit
+     * @param data The access unit in Annex B format
+     * @param size Size of the access unit in bytes
+     * @param timestamp RTP timestamp of the access unit
+     * @param sendTime Send time carried in the header extension, in microseconds
+     */
+    void packetise(const uint8_t *data, size_t size, uint32_t timestamp, uint64_t sendTime);
+
+    /**
+     * @brief Writes an RTP header and starts a packet with it
+     * @param timestamp RTP timestamp of the access unit
+     * @param sendTime Send time carried in the header extension, in microseconds
+     * @param payloadHeaderSize Bytes to reserve after the RTP header
+     * @return The reserved bytes, for the payload header
+     */
+    uint8_t *beginPacket(uint32_t timestamp, uint64_t sendTime, size_t payloadHeaderSize);
+
+    /**
+     * @brief Takes bytes from "headers" for the current frame
+     */
+    uint8_t *allocateHeader(size_t size);
+
+    /**
+     * @brief Adds bytes to the current packet
+     */
+    void addToPacket(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Sends the packets of the current frame, paced if configured
+     */
+    void transmit();
+};
@@ -0,0 +1,237 @@
+#include "session_host.hpp"
+#include <algorithm>
+#include <numeric>
+
+SessionHost::SessionHost(std::shared_ptr<VulkanContext> context, size_t threadCount,
+                         size_t encodeThreadCount)
+    : context(std::move(context)), encodePool(encodeThreadCount), pool(threadCount) {
+    LOG_INFO("Session host started with " + std::to_string(pool.size()) + " worker threads and " +
+             std::to_string(encodePool.size()) + " encoder threads.");
+}
+
+SessionHost::SessionHost(const ContextConfig &contextConfig, DevicePlacement &placement,
+                         size_t threadCount, size_t encodeThreadCount)
+    : contextConfig(contextConfig), placement(&placement), encodePool(encodeThreadCount),
+      pool(threadCount) {
+    this->contextConfig.device = DeviceSelection();
+    this->contextConfig.placement = nullptr;
+    LOG_INFO("Session host started with " + std::to_string(pool.size()) + " worker threads and " +
+             std::to_string(encodePool.size()) +
+             " encoder threads, placing sessions across devices.");
+}
+
+SessionHost::~SessionHost() {
+    // Workers are idle between runs, so the sessions can be torn down from this thread
+    for (auto &session : sessions) {
+        session->renderer->waitForFrames();
+        if (session->encoder) {
+            try {
+                session->encoder->finish();
+            } catch (const std::exception &e) {
+                LOG_ERROR(e.what());
+            }
+        }
+        if (placement != nullptr) {
+            placement->release(session->renderer->getContext()->getPhysicalDeviceIndex());
+        }
+    }
+}
+
+size_t SessionHost::addSession(const SessionConfig &config) {
+    std::shared_ptr<VulkanContext> sessionContext = placement != nullptr ? placeSession() : context;
+
+    auto session = std::make_unique<Session>();
+    try {
+        session->renderer = std::make_unique<VulkanRenderer>(sessionContext, config.renderer);
+        if (!config.outputPath.empty()) {
+            session->encoder = std::make_unique<VulkanEncoder>(
+                session->renderer.get(), config.outputPath, config.rateControl,
+                config.softwareEncoder, &encodePool);
+
+            if (config.rtp) {
+                session->rtpSender = std::make_unique<RtpSender>(*config.rtp);
+                RtpSender *sender = session->rtpSender.get();
+                session->encoder->addConsumer(
+                    [sender](const EncodedFrame &frame) { sender->send(frame); });
+            }
+        }
+
+        if (config.capture) {
+            VkExtent2D extent = session->renderer->getExtent();
+            session->capture =
+                std::make_unique<RawCapture>(*config.capture, extent.width, extent.height);
+        }
+    } catch (...) {
+        if (placement != nullptr) {
+            placement->release(sessionContext->getPhysicalDeviceIndex());
+        }
+        throw;
+    }
+
+    sessions.push_back(std::move(session));
+    return sessions.size() - 1;
+}
+
+std::shared_ptr<VulkanContext> SessionHost::placeSession() {
+    // The first context goes on the highest scored device, and lists the candidates
+    if (deviceCandidates.empty()) {
+        auto first = std::make_shared<VulkanContext>(nullptr, contextConfig);
+        deviceContexts[first->getPhysicalDeviceIndex()] = first;
+        deviceCandidates = first->getDeviceCandidates();
+    }
+
+    DeviceCandidate chosen = placement->acquire(deviceCandidates);
+    auto it = deviceContexts.find(chosen.index);
+    if (it != deviceContexts.end()) {
+        return it->second;
+    }
+
+    try {
+        ContextConfig config = contextConfig;
+        config.device.index = chosen.index;
+        auto deviceContext = std::make_shared<VulkanContext>(nullptr, config);
+        deviceContexts[chosen.index] = deviceContext;
+        return deviceContext;
+    } catch (...) {
+        placement->release(chosen.index);
+        throw;
+    }
+}
+
+size_t SessionHost::getSessionCount() const {
+    return sessions.size();
+}
+
+HostStats SessionHost::run(uint32_t frameCount) {
+    return run(std::vector<uint32_t>(sessions.size(), frameCount));
+}
+
+HostStats SessionHost::run(const std::vector<uint32_t> &frameCounts) {
+    if (frameCounts.size() != sessions.size()) {
+        throw std::runtime_error("run needs one frame count per session");
+    }
+
+    HostStats stats;
+    uint64_t totalFrames = std::accumulate(frameCounts.begin(), frameCounts.end(), uint64_t(0));
+    if (totalFrames == 0) {
+        return stats;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(runMutex);
+        activeSessions =
+            frameCounts.size() - std::count(frameCounts.begin(), frameCounts.end(), 0u);
+        firstError = nullptr;
+    }
+    aborted = false;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        Session &session = *sessions[i];
+        session.framesRemaining = frameCounts[i];
+        session.latenciesMs.clear();
+        session.latenciesMs.reserve(frameCounts[i]);
+        if (frameCounts[i] > 0) {
+            scheduleFrame(session);
+        }
+    }
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(runMutex);
+        runCondition.wait(lock, [this]() { return activeSessions == 0; });
+        error = firstError;
+    }
+
+    // Count the GPU work of the last frames in the run
+    for (auto &session : sessions) {
+        session->renderer->waitForFrames();
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    stats.seconds = std::chrono::duration<double>(elapsed).count();
+    for (const auto &session : sessions) {
+        stats.sessions.push_back(summarise(*session));
+    }
+    stats.totalFps = static_cast<double>(totalFrames) / stats.seconds;
+
+    return stats;
+}
+
+void SessionHost::scheduleFrame(Session &session) {
+    pool.submit([this, &session]() {
+        try {
+            stepSession(session);
+        } catch (...) {
+            aborted = true;
+            finishSession(std::current_exception());
+            return;
+        }
+
+        if (aborted || --session.framesRemaining == 0) {
+            finishSession(nullptr);
+        } else {
+            scheduleFrame(session);
+        }
+    });
+}
+
+void SessionHost::stepSession(Session &session) {
+    auto start = std::chrono::steady_clock::now();
+
+    session.renderer->drawFrame();
+    if (session.capture) {
+        // Frames are converted straight out of the readback buffer; a slow disk drops them
+        RawCapture &capture = *session.capture;
+        session.renderer->readFrame([&capture](const uint8_t *rgba, VkExtent2D extent) {
+            capture.writeFrame(rgba, static_cast<ptrdiff_t>(extent.width) * 4);
+        });
+    }
+    if (session.encoder) {
+        session.encoder->encodeFrame();
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    session.latenciesMs.push_back(std::chrono::duration<double, std::milli>(elapsed).count());
+}
+
+void SessionHost::finishSession(std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock(runMutex);
+        if (error && !firstError) {
+            firstError = error;
+        }
+        --activeSessions;
+    }
+    runCondition.notify_all();
+}
+
+SessionStats SessionHost::summarise(const Session &session) {
+    SessionStats stats;
+    stats.deviceIndex = session.renderer->getContext()->getPhysicalDeviceIndex();
+    stats.frames = static_cast<uint32_t>(session.latenciesMs.size());
+    if (session.latenciesMs.empty()) {
+        return stats;
+    }
+
+    std::vector<double> sorted = session.latenciesMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    auto percentile = [&sorted](double p) {
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        return sorted[index];
+    };
+
+    stats.meanLatencyMs = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+    stats.p50LatencyMs = percentile(0.50);
+    stats.p99LatencyMs = percentile(0.99);
+    stats.maxLatencyMs = sorted.back();
+
+    return stats;
+}
@@ -0,0 +1,259 @@
+#pragma once
+#include "context.hpp"
+#include "encoder.hpp"
+#include "raw_capture.hpp"
+#include "renderer.hpp"
+#include "rtp_sender.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @struct SessionConfig
+ * @brief Configuration of one render/encode stream hosted by a SessionHost
+ */
+struct SessionConfig {
+    /// @brief Renderer options. The context options are ignored, the host's context is used
+    RendererConfig renderer;
+
+    /// @brief Path of the encoded output. If empty, the session renders without encoding
+    std::string outputPath;
+
+    /// @brief Rate control options of the session's encoder
+    RateControlConfig rateControl;
+
+    /// @brief Software encoder options of the session's encoder
+    SoftwareEncoderConfig softwareEncoder;
+
+    /// @brief If set, the coded frames are also streamed over RTP. Requires an output path
+    std::optional<RtpSenderConfig> rtp;
+
+    /// @brief If set, every rendered frame is read back and captured losslessly
+    std::optional<RawCaptureConfig> capture;
+};
+
+/**
+ * @struct SessionStats
+ * @brief Frame step latencies of one session over a run
+ */
+struct SessionStats {
+    /// @brief Index of the device the session runs on, in vkEnumeratePhysicalDevices order
+    uint32_t deviceIndex = 0;
+
+    /// @brief Number of frames rendered
+    uint32_t frames = 0;
+
+    /// @brief Mean time to render (and encode) one frame, in milliseconds
+    double meanLatencyMs = 0.0;
+
+    /// @brief Median frame step time, in milliseconds
+    double p50LatencyMs = 0.0;
+
+    /// @brief 99th percentile frame step time, in milliseconds
+    double p99LatencyMs = 0.0;
+
+    /// @brief Slowest frame step, in milliseconds
+    double maxLatencyMs = 0.0;
+};
+
+/**
+ * @struct HostStats
+ * @brief Aggregate results of a SessionHost run
+ */
+struct HostStats {
+    /// @brief Wall-clock duration of the run, in seconds
+    double seconds = 0.0;
+
+    /// @brief Frames rendered per second across all sessions
+    double totalFps = 0.0;
+
+    /// @brief Per-session statistics, in the order sessions were added
+    std::vector<SessionStats> sessions;
+};
+
+/**
+ * @class SessionHost
+ * @brief Runs many render/encode streams in one process on a shared VulkanContext
+ *
+ * A host can also spread its sessions across every suitable device through a
+ * DevicePlacement, with one context per device shared by the sessions placed on it.
+ *
+ * Each session owns a headless VulkanRenderer and, optionally, a VulkanEncoder. Frames are
+ * scheduled on a worker thread pool: every task renders one frame of one session and then
+ * queues that session's next frame, so a session never runs on two workers at once while
+ * sessions are free to move between workers. With fewer workers than sessions, sessions are
+ * interleaved in FIFO order.
+ *
+ * Software encoders run their slice tasks on a second pool shared by all sessions, so a
+ * frame's encoding overlaps the rendering of the next frames.
+ */
+class SessionHost {
+  public:
+    /**
+     * @brief Creates a host on a shared context
+     * @param context The context every session is created on
+     * @param threadCount Number of worker threads (0 for one per hardware thread)
+     * @param encodeThreadCount Number of software encoder threads (0 for one per hardware
+     * thread)
+     */
+    SessionHost(std::shared_ptr<VulkanContext> context, size_t threadCount = 0,
+                size_t encodeThreadCount = 0);
+
+    /**
+     * @brief Creates a host that places each session on the least loaded suitable device
+     *
+     * The context of a device is created when the first session is placed on it. Each session
+     * counts as one stream of the placement layer until the host is destroyed
+     *
+     * @param contextConfig Options of the contexts. Any device selection or placement in them
+     * is ignored
+     * @param placement Counts the streams on each device, possibly shared with other hosts.
+     * Must outlive the host
+     * @param threadCount Number of worker threads (0 for one per hardware thread)
+     * @param encodeThreadCount Number of software encoder threads (0 for one per hardware
+     * thread)
+     */
+    SessionHost(const ContextConfig &contextConfig, DevicePlacement &placement,
+                size_t threadCount = 0, size_t encodeThreadCount = 0);
+
+    /**
+     * @brief Waits for outstanding frames and destroys all sessions
+     */
+    ~SessionHost();
+
+    /**
+     * @brief Creates a session on the host's context, or on the device it is placed on
+     * @param config Session configuration
+     * @return Index of the new session
+     * @throws std::runtime_error if the session cannot be created, which leaves it unplaced
+     */
+    size_t addSession(const SessionConfig &config);
+
+    /**
+     * @brief Returns the number of sessions
+     */
+    size_t getSessionCount() const;
+
+    /**
+     * @brief Renders a number of frames on every session and waits for completion
+     * @param frameCount Frames to render per session
+     * @return Throughput and per-session latency statistics of the run
+     * @throws The first exception raised by any session; the remaining frames are abandoned
+     */
+    HostStats run(uint32_t frameCount);
+
+    /**
+     * @brief Renders a number of frames on each session and waits for completion
+     * @param frameCounts Frames to render per session, in the order sessions were added. A
+     * session given 0 frames sits the run out
+     * @return Throughput and per-session latency statistics of the run
+     * @throws std::runtime_error if there is not one count per session
+     * @throws The first exception raised by any session; the remaining frames are abandoned
+     */
+    HostStats run(const std::vector<uint32_t> &frameCounts);
+
+  protected:
+    /**
+     * @struct Session
+     * @brief Per-stream state owned by the host
+     */
+    struct Session {
+        /// @brief The session's renderer
+        std::unique_ptr<VulkanRenderer> renderer;
+
+        /// @brief Streams the encoder's frames (may be null). Declared before the encoder,
+        /// which calls it until destroyed
+        std::unique_ptr<RtpSender> rtpSender;
+
+        /// @brief The session's encoder (may be null)
+        std::unique_ptr<VulkanEncoder> encoder;
+
+        /// @brief Lossless capture of the rendered frames (may be null)
+        std::unique_ptr<RawCapture> capture;
+
+        /// @brief Frames still to render in the current run
+        uint32_t framesRemaining = 0;
+
+        /// @brief Step latencies of the current run, in milliseconds
+        std::vector<double> latenciesMs;
+    };
+
+    /// @brief Context shared by all sessions (null when sessions are placed across devices)
+    std::shared_ptr<VulkanContext> context;
+
+    /// @brief Options of the contexts created for placed sessions
+    ContextConfig contextConfig;
+
+    /// @brief Placement layer the sessions are spread across devices with (may be null)
+    DevicePlacement *placement = nullptr;
+
+    /// @brief Suitable devices sessions may be placed on, listed by the first context created
+    std::vector<DeviceCandidate> deviceCandidates;
+
+    /// @brief Context of each device a session has been placed on, keyed by device index
+    std::map<uint32_t, std::shared_ptr<VulkanContext>> deviceContexts;
+
+    /// @brief Workers that run the software encoders of all sessions. Declared before the
+    /// sessions, whose encoders wait for their tasks when destroyed
+    ThreadPool encodePool;
+
+    /// @brief Sessions owned by the host
+    std::vector<std::unique_ptr<Session>> sessions;
+
+    /// @brief Guards activeSessions and firstError
+    std::mutex runMutex;
+
+    /// @brief Signalled when a session finishes its frames
+    std::condition_variable runCondition;
+
+    /// @brief Sessions that have not finished the current run
+    size_t activeSessions = 0;
+
+    /// @brief First exception raised during the current run
+    std::exception_ptr firstError;
+
+    /// @brief Set when a session fails, to stop scheduling further frames
+    std::atomic<bool> aborted{false};
+
+    /// @brief Workers that render the sessions' frames. Declared last so the workers are joined
+    /// before any state they touch is destroyed
+    ThreadPool pool;
+
+    /**
+     * @brief Places a new session on the least loaded device
+     * @return The context of the device, created if no session was placed on it before
+     * @throws std::runtime_error if the context cannot be created, which leaves it unplaced
+     */
+    std::shared_ptr<VulkanContext> placeSession();
+
+    /**
+     * @brief Queues the next frame of a session on the pool
+     * @param session The session to step
+     */
+    void scheduleFrame(Session &session);
+
+    /**
+     * @brief Renders (and encodes) one frame of a session
+     * @param session The session to step
+     */
+    void stepSession(Session &session);
+
+    /**
+     * @brief Marks a session as finished for the current run
+     * @param error Exception raised by the session, if any
+     */
+    void finishSession(std::exception_ptr error);
+
+    /**
+     * @brief Computes the latency statistics of a session
+     * @param session The session to summarise
+     * @return The session's statistics
+     */
+    static SessionStats summarise(const Session &session);
+};
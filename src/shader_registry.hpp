@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @file shader_registry.hpp
+ * @brief SPIR-V shaders embedded into the binary at build time
+ *
+ * The "*.inc" files are generated by the Makefile from the GLSL sources in "shaders/" using
+ * "glslc -mfmt=num", which emits the SPIR-V words as a comma-separated list of integers.
+ */
+
+/**
+ * @struct EmbeddedShader
+ * @brief A SPIR-V module compiled into the binary
+ */
+struct EmbeddedShader {
+    /// @brief Name of the shader, matching its ".spv" file name in the override directory
+    std::string_view name;
+
+    /// @brief Pointer to the SPIR-V words
+    const uint32_t *code;
+
+    /// @brief Size of the SPIR-V code in bytes
+    size_t codeSize;
+};
+
+namespace embedded_spirv {
+
+/// @brief Vertex shader (shaders/shader.vert)
+alignas(4) constexpr uint32_t vert[] = {
+#include "shader.vert.inc"
+};
+
+/// @brief Fragment shader (shaders/shader.frag)
+alignas(4) constexpr uint32_t frag[] = {
+#include "shader.frag.inc"
+};
+
+/// @brief Frustum culling compute shader (shaders/cull.comp)
+alignas(4) constexpr uint32_t cull[] = {
+#include "cull.comp.inc"
+};
+
+/// @brief Vertex shader of the present pass (shaders/present.vert)
+alignas(4) constexpr uint32_t presentVert[] = {
+#include "present.vert.inc"
+};
+
+/// @brief Fragment shader of the present pass (shaders/present.frag)
+alignas(4) constexpr uint32_t presentFrag[] = {
+#include "present.frag.inc"
+};
+
+} // namespace embedded_spirv
+
+/// @brief Registry of every embedded shader, keyed by name
+constexpr EmbeddedShader embeddedShaders[] = {
+    {"vert.spv", embedded_spirv::vert, sizeof(embedded_spirv::vert)},
+    {"frag.spv", embedded_spirv::frag, sizeof(embedded_spirv::frag)},
+    {"cull.spv", embedded_spirv::cull, sizeof(embedded_spirv::cull)},
+    {"present_vert.spv", embedded_spirv::presentVert, sizeof(embedded_spirv::presentVert)},
+    {"present_frag.spv", embedded_spirv::presentFrag, sizeof(embedded_spirv::presentFrag)},
+};
+
+/**
+ * @brief Looks up an embedded shader by name
+ * @param name Name of the shader (e.g. "vert.spv")
+ * @return Pointer to the registry entry, or nullptr if no shader has that name
+ */
+constexpr const EmbeddedShader *findEmbeddedShader(std::string_view name) {
+    for (const EmbeddedShader &shader : embeddedShaders) {
+        if (shader.name == name) {
+            return &shader;
+        }
+    }
+    return nullptr;
+}
+
+static_assert(findEmbeddedShader("vert.spv") != nullptr, "vertex shader is not embedded");
+static_assert(findEmbeddedShader("frag.spv") != nullptr, "fragment shader is not embedded");
+static_assert(findEmbeddedShader("cull.spv") != nullptr, "cull shader is not embedded");
+static_assert(findEmbeddedShader("present_vert.spv") != nullptr,
+              "present vertex shader is not embedded");
+static_assert(findEmbeddedShader("present_frag.spv") != nullptr,
+              "present fragment shader is not embedded");
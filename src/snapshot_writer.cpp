@@ -0,0 +1,414 @@
+#include "snapshot_writer.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+
+/// @brief Bytes per pixel of the RGB rows written
+constexpr size_t bytesPerPixel = 3;
+
+/// @brief PNG filter types, in the order of their type bytes
+constexpr size_t filterCount = 5;
+
+size_t getThreadCount(size_t threadCount) {
+    if (threadCount != 0) {
+        return threadCount;
+    }
+    return std::min<size_t>(4, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+bool isPpm(const std::string &path) {
+    std::string extension = path.substr(std::min(path.size(), path.rfind('.')));
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".ppm";
+}
+
+/**
+ * @brief Converts one row of four-byte pixels to RGB
+ */
+void convertRow(const SnapshotImage &image, uint32_t row, uint8_t *rgb) {
+    const uint8_t *in = image.pixels + ptrdiff_t(row) * image.stride;
+    size_t red = image.bgra ? 2 : 0;
+    size_t blue = 2 - red;
+    for (uint32_t x = 0; x < image.width; ++x, in += 4, rgb += 3) {
+        rgb[0] = in[red];
+        rgb[1] = in[1];
+        rgb[2] = in[blue];
+    }
+}
+
+uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+/**
+ * @brief Applies every PNG filter to a row and returns the one to keep
+ *
+ * Each candidate is written with its filter type byte. The one whose bytes, read as signed
+ * values, have the smallest sum of magnitudes is kept
+ *
+ * @param row The row
+ * @param previous The row above, zeros for the first row
+ * @param size Size of the rows in bytes
+ * @param candidates Receives the filtered rows, filterCount * (size + 1) bytes
+ * @return The filtered row to write, size + 1 bytes
+ */
+const uint8_t *filterRow(const uint8_t *row, const uint8_t *previous, size_t size,
+                         uint8_t *candidates) {
+    std::array<uint8_t *, filterCount> out;
+    for (size_t filter = 0; filter < filterCount; ++filter) {
+        out[filter] = candidates + filter * (size + 1);
+        out[filter][0] = static_cast<uint8_t>(filter);
+        ++out[filter];
+    }
+
+    std::array<uint64_t, filterCount> costs = {};
+    for (size_t i = 0; i < size; ++i) {
+        int x = row[i];
+        int a = i >= bytesPerPixel ? row[i - bytesPerPixel] : 0;
+        int b = previous[i];
+        int c = i >= bytesPerPixel ? previous[i - bytesPerPixel] : 0;
+
+        out[0][i] = static_cast<uint8_t>(x);
+        out[1][i] = static_cast<uint8_t>(x - a);
+        out[2][i] = static_cast<uint8_t>(x - b);
+        out[3][i] = static_cast<uint8_t>(x - (a + b) / 2);
+        out[4][i] = static_cast<uint8_t>(x - paeth(a, b, c));
+
+        for (size_t filter = 0; filter < filterCount; ++filter) {
+            int value = out[filter][i];
+            costs[filter] += value < 128 ? value : 256 - value;
+        }
+    }
+
+    size_t best = std::min_element(costs.begin(), costs.end()) - costs.begin();
+    return candidates + best * (size + 1);
+}
+
+/**
+ * @brief Runs deflate() until the input is consumed and, when flushing, the output complete
+ * @param stream The deflate stream, with its input set
+ * @param flush Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH
+ * @param out Output buffer, grown as needed
+ * @param used Bytes of "out" already written, updated
+ */
+void deflateInto(z_stream &stream, int flush, std::vector<uint8_t> &out, size_t &used) {
+    while (true) {
+        if (out.size() - used < 64) {
+            out.resize(std::max<size_t>(out.size() * 2, 4096));
+        }
+        stream.next_out = out.data() + used;
+        stream.avail_out = static_cast<uInt>(out.size() - used);
+
+        int result = deflate(&stream, flush);
+        used = out.size() - stream.avail_out;
+        if (result == Z_STREAM_END) {
+            return;
+        }
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            throw std::runtime_error("failed to deflate snapshot");
+        }
+
+        // Output left over means deflate() has flushed everything it was given
+        if (stream.avail_in == 0 && stream.avail_out != 0 && flush != Z_FINISH) {
+            return;
+        }
+    }
+}
+
+void writeBigEndian(uint8_t *out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+/**
+ * @brief Writes a PNG chunk whose data is the concatenation of several parts
+ */
+void writeChunk(std::ofstream &file, const char *type,
+                std::initializer_list<std::pair<const uint8_t *, size_t>> parts) {
+    size_t size = 0;
+    for (const auto &part : parts) {
+        size += part.second;
+    }
+
+    uint8_t header[8];
+    writeBigEndian(header, static_cast<uint32_t>(size));
+    std::copy_n(type, 4, header + 4);
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    uLong crc = crc32(0, header + 4, 4);
+    for (const auto &part : parts) {
+        file.write(reinterpret_cast<const char *>(part.first), part.second);
+        crc = crc32(crc, part.first, static_cast<uInt>(part.second));
+    }
+
+    uint8_t trailer[4];
+    writeBigEndian(trailer, static_cast<uint32_t>(crc));
+    file.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+}
+
+/**
+ * @struct SnapshotMetrics
+ * @brief Metrics shared by every snapshot writer of the process
+ */
+struct SnapshotMetrics {
+    Counter &written;
+    Counter &failed;
+    Gauge &pending;
+};
+
+const SnapshotMetrics &getSnapshotMetrics() {
+    static const SnapshotMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        return SnapshotMetrics{
+            registry.getCounter("vulkantest_snapshots_written_total", "Snapshots written"),
+            registry.getCounter("vulkantest_snapshots_failed_total",
+                                "Snapshots that could not be encoded or written"),
+            registry.getGauge("vulkantest_snapshots_pending",
+                              "Snapshots queued or being encoded")};
+    }();
+    return metrics;
+}
+
+} // namespace
+
+SnapshotWriter::SnapshotWriter(const SnapshotConfig &config)
+    : config(config), pool(getThreadCount(config.threadCount)) {
+    this->config.compressionLevel = std::clamp(config.compressionLevel, 1, 9);
+    this->config.bandHeight = std::max(config.bandHeight, 1u);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    wait();
+}
+
+void SnapshotWriter::write(const std::string &path, const SnapshotImage &image,
+                           Release release) {
+    if (image.width == 0 || image.height == 0) {
+        throw std::runtime_error("snapshot image is empty");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++activeJobs;
+    }
+    getSnapshotMetrics().pending.add(1.0);
+
+    if (isPpm(path)) {
+        pool.submit([this, path, image, release = std::move(release)] {
+            bool success = true;
+            try {
+                writePpm(path, image);
+            } catch (const std::exception &e) {
+                LOG_ERROR(e.what());
+                success = false;
+            }
+            if (release) {
+                release();
+            }
+            finish(path, success);
+        });
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->path = path;
+    job->image = image;
+    job->release = std::move(release);
+
+    uint32_t bandCount = (image.height + config.bandHeight - 1) / config.bandHeight;
+    job->bands.resize(bandCount);
+    job->checksums.resize(bandCount);
+    job->pendingBands = bandCount;
+
+    for (uint32_t band = 0; band < bandCount; ++band) {
+        pool.submit([this, job, band] {
+            try {
+                encodeBand(*job, band);
+            } catch (const std::exception &e) {
+                LOG_ERROR(e.what());
+                job->failed = true;
+            }
+            if (--job->pendingBands > 0) {
+                return;
+            }
+
+            // This was the last band, so the pixels are no longer needed
+            if (job->release) {
+                job->release();
+            }
+
+            bool success = !job->failed;
+            if (success) {
+                try {
+                    writePng(*job);
+                } catch (const std::exception &e) {
+                    LOG_ERROR(e.what());
+                    success = false;
+                }
+            }
+            finish(job->path, success);
+        });
+    }
+}
+
+void SnapshotWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return activeJobs == 0; });
+}
+
+void SnapshotWriter::encodeBand(Job &job, uint32_t band) const {
+    TRACE_SCOPE("snapshot band");
+    const SnapshotImage &image = job.image;
+    uint32_t firstRow = band * config.bandHeight;
+    uint32_t endRow = std::min(image.height, firstRow + config.bandHeight);
+    bool last = endRow == image.height;
+    size_t rowSize = size_t(image.width) * bytesPerPixel;
+
+    // The filters predict from the row above, which for the first row of a band lies in the
+    // previous band and is simply converted again
+    std::vector<uint8_t> previous(rowSize, 0);
+    std::vector<uint8_t> current(rowSize);
+    std::vector<uint8_t> candidates(filterCount * (rowSize + 1));
+    if (firstRow > 0) {
+        convertRow(image, firstRow - 1, previous.data());
+    }
+
+    z_stream stream = {};
+    if (deflateInit2(&stream, config.compressionLevel, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("failed to initialise deflate for snapshot " + job.path);
+    }
+
+    std::vector<uint8_t> &out = job.bands[band];
+    out.resize(deflateBound(&stream, uLong(endRow - firstRow) * (rowSize + 1)) + 16);
+    size_t used = 0;
+    uLong checksum = adler32(0, nullptr, 0);
+
+    try {
+        for (uint32_t row = firstRow; row < endRow; ++row) {
+            convertRow(image, row, current.data());
+            const uint8_t *filtered =
+                filterRow(current.data(), previous.data(), rowSize, candidates.data());
+            checksum = adler32(checksum, filtered, static_cast<uInt>(rowSize + 1));
+
+            stream.next_in = const_cast<Bytef *>(filtered);
+            stream.avail_in = static_cast<uInt>(rowSize + 1);
+            int flush = row + 1 < endRow ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH;
+            deflateInto(stream, flush, out, used);
+
+            std::swap(previous, current);
+        }
+    } catch (...) {
+        deflateEnd(&stream);
+        throw;
+    }
+
+    deflateEnd(&stream);
+    out.resize(used);
+    job.checksums[band] = static_cast<uint32_t>(checksum);
+}
+
+void SnapshotWriter::writePng(const Job &job) const {
+    TRACE_SCOPE("snapshot write");
+    const SnapshotImage &image = job.image;
+    std::ofstream file(job.path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("failed to create snapshot " + job.path);
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    // 8-bit RGB, deflate, adaptive filtering, no interlacing
+    uint8_t header[13] = {};
+    writeBigEndian(header, image.width);
+    writeBigEndian(header + 4, image.height);
+    header[8] = 8;
+    header[9] = 2;
+    writeChunk(file, "IHDR", {{header, sizeof(header)}});
+
+    // zlib header for a 32K window, with the level hint and check bits
+    int level = config.compressionLevel;
+    int levelHint = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    int flags = levelHint << 6;
+    flags += 31 - (0x78 * 256 + flags) % 31;
+    uint8_t streamHeader[2] = {0x78, static_cast<uint8_t>(flags)};
+
+    // One IDAT chunk per band; the stream header and checksum ride in the first and last
+    size_t rowSize = size_t(image.width) * bytesPerPixel + 1;
+    uLong checksum = job.checksums[0];
+    for (size_t band = 1; band < job.bands.size(); ++band) {
+        uint32_t firstRow = uint32_t(band) * config.bandHeight;
+        uint32_t rows = std::min(config.bandHeight, image.height - firstRow);
+        checksum = adler32_combine(checksum, job.checksums[band], z_off_t(rows * rowSize));
+    }
+    uint8_t trailer[4];
+    writeBigEndian(trailer, static_cast<uint32_t>(checksum));
+
+    for (size_t band = 0; band < job.bands.size(); ++band) {
+        bool first = band == 0;
+        bool last = band + 1 == job.bands.size();
+        writeChunk(file, "IDAT",
+                   {{streamHeader, first ? sizeof(streamHeader) : 0},
+                    {job.bands[band].data(), job.bands[band].size()},
+                    {trailer, last ? sizeof(trailer) : 0}});
+    }
+    writeChunk(file, "IEND", {});
+
+    if (!file.flush()) {
+        throw std::runtime_error("failed to write snapshot " + job.path);
+    }
+}
+
+void SnapshotWriter::writePpm(const std::string &path, const SnapshotImage &image) const {
+    TRACE_SCOPE("snapshot write");
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("failed to create snapshot " + path);
+    }
+
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    std::vector<uint8_t> rgb(size_t(image.width) * bytesPerPixel);
+    for (uint32_t row = 0; row < image.height; ++row) {
+        convertRow(image, row, rgb.data());
+        file.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+    }
+
+    if (!file.flush()) {
+        throw std::runtime_error("failed to write snapshot " + path);
+    }
+}
+
+void SnapshotWriter::finish(const std::string &path, bool success) {
+    const SnapshotMetrics &metrics = getSnapshotMetrics();
+    (success ? metrics.written : metrics.failed).add();
+    metrics.pending.add(-1.0);
+    if (success) {
+        LOG_INFO("Wrote snapshot " + path + ".");
+    }
+
+    // Notified under the lock, since the writer may be destroyed as soon as wait() returns
+    std::lock_guard<std::mutex> lock(mutex);
+    --activeJobs;
+    condition.notify_all();
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "thread_pool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @struct SnapshotConfig
+ * @brief Configuration options for a SnapshotWriter
+ */
+struct SnapshotConfig {
+    /// @brief Number of worker threads. If 0, one per hardware thread up to four
+    size_t threadCount = 0;
+
+    /// @brief zlib level of PNG files, from 1 (fastest) to 9 (smallest)
+    int compressionLevel = 1;
+
+    /// @brief Rows per band; the bands of a PNG file are filtered and compressed in parallel
+    uint32_t bandHeight = 64;
+};
+
+/**
+ * @struct SnapshotImage
+ * @brief Pixels of a snapshot, four bytes per pixel
+ */
+struct SnapshotImage {
+    /// @brief First pixel of the image
+    const uint8_t *pixels = nullptr;
+
+    /// @brief Size of the image in pixels
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    /// @brief Distance between rows in bytes
+    ptrdiff_t stride = 0;
+
+    /// @brief Whether the pixels are stored as B, G, R, A (swapchain images) rather than
+    /// R, G, B, A
+    bool bgra = false;
+};
+
+/**
+ * @class SnapshotWriter
+ * @brief Writes still images to PNG or PPM files on a pool of background threads
+ *
+ * The format is picked from the file extension: ".ppm" writes a binary PPM, anything else a
+ * PNG. Alpha is dropped, so both are 8-bit RGB.
+ *
+ * A PNG is split into bands of rows that are filtered and deflated as separate tasks. Each
+ * row gets the filter whose output has the smallest sum of absolute values, the heuristic
+ * libpng uses. Every band but the last ends with a sync flush, so the compressed bands are
+ * concatenated into one zlib stream, and the band checksums are combined into its Adler-32.
+ * Bands do not share a history, which costs a little compression for linear speedup.
+ *
+ * Tasks never wait on other tasks: the band that finishes last writes the file. Errors are
+ * logged, since snapshots are a debugging aid that should not take the caller down.
+ */
+class SnapshotWriter {
+  public:
+    /**
+     * @brief Called on a worker thread once a snapshot's pixels are no longer needed
+     */
+    using Release = std::function<void()>;
+
+    /**
+     * @brief Starts the worker threads
+     * @param config Writer options
+     */
+    explicit SnapshotWriter(const SnapshotConfig &config = SnapshotConfig());
+
+    /**
+     * @brief Waits for the queued snapshots to be written
+     */
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    /**
+     * @brief Queues a snapshot and returns at once
+     * @param path Path of the file; ".ppm" selects PPM, anything else PNG
+     * @param image The pixels, which must stay valid until "release" is called
+     * @param release Called once the pixels have been encoded, before the file is written.
+     * May be empty
+     * @throws std::runtime_error if the image is empty
+     */
+    void write(const std::string &path, const SnapshotImage &image, Release release);
+
+    /**
+     * @brief Blocks until every queued snapshot has been written
+     */
+    void wait();
+
+  protected:
+    /**
+     * @struct Job
+     * @brief A PNG being encoded
+     */
+    struct Job {
+        /// @brief Path of the file
+        std::string path;
+
+        /// @brief The pixels
+        SnapshotImage image;
+
+        /// @brief Called once the pixels are no longer needed
+        Release release;
+
+        /// @brief Deflated bytes of each band
+        std::vector<std::vector<uint8_t>> bands;
+
+        /// @brief Adler-32 of each band's filtered rows
+        std::vector<uint32_t> checksums;
+
+        /// @brief Bands still being encoded
+        std::atomic<uint32_t> pendingBands{0};
+
+        /// @brief Whether a band failed
+        std::atomic<bool> failed{false};
+    };
+
+    /// @brief Writer options
+    SnapshotConfig config;
+
+    /// @brief Snapshots queued and not yet written
+    uint32_t activeJobs = 0;
+
+    /// @brief Guards activeJobs
+    std::mutex mutex;
+
+    /// @brief Signalled when a snapshot has been written
+    std::condition_variable condition;
+
+    /// @brief Workers encoding the snapshots, declared last so they are joined before the
+    /// state they use is destroyed
+    ThreadPool pool;
+
+    /**
+     * @brief Filters and deflates one band of a PNG
+     */
+    void encodeBand(Job &job, uint32_t band) const;
+
+    /**
+     * @brief Writes a PNG from its deflated bands
+     */
+    void writePng(const Job &job) const;
+
+    /**
+     * @brief Writes a PPM
+     */
+    void writePpm(const std::string &path, const SnapshotImage &image) const;
+
+    /**
+     * @brief Logs the outcome of a snapshot and wakes wait()
+     */
+    void finish(const std::string &path, bool success);
+};
@@ -0,0 +1,1147 @@
+#include "software_encoder.hpp"
+#include "bitstream.hpp"
+#include "cavlc.hpp"
+#include "intra_predict.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "transform.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// QPc of each QP from 30 up; below 30 QPc equals QP
+constexpr uint8_t chromaQpTable[22] = {29, 30, 31, 32, 32, 33, 34, 34, 35, 35, 36,
+                                       36, 37, 37, 37, 38, 38, 38, 39, 39, 39, 39};
+
+// Code number of coded_block_pattern (luma | chroma << 4) in me(v), for I_NxN and inter
+// macroblocks
+constexpr uint8_t intraCbpCodes[48] = {3,  29, 30, 17, 31, 18, 37, 8,  32, 38, 19, 9,
+                                       20, 10, 11, 2,  16, 33, 34, 21, 35, 22, 39, 4,
+                                       36, 40, 23, 5,  24, 6,  7,  1,  41, 42, 43, 25,
+                                       44, 26, 46, 12, 45, 47, 27, 13, 28, 14, 15, 0};
+constexpr uint8_t interCbpCodes[48] = {0,  2,  3,  7,  4,  8,  17, 13, 5,  18, 9,  14,
+                                       10, 15, 16, 11, 1,  32, 33, 36, 34, 37, 44, 40,
+                                       35, 45, 38, 41, 39, 42, 43, 19, 6,  24, 25, 20,
+                                       26, 21, 46, 28, 27, 47, 22, 29, 23, 30, 31, 12};
+
+// Levels from Table A-1: level_idc, MaxMBPS, MaxFS and Baseline MaxBR (kbit/s)
+struct Level {
+    int idc;
+    uint32_t maxMbps;
+    uint32_t maxFs;
+    uint32_t maxBitrate;
+};
+
+constexpr Level levels[] = {
+    {10, 1485, 99, 64},           {11, 3000, 396, 192},         {12, 6000, 396, 384},
+    {13, 11880, 396, 768},        {20, 11880, 396, 2000},       {21, 19800, 792, 4000},
+    {22, 20250, 1620, 4000},      {30, 40500, 1620, 10000},     {31, 108000, 3600, 14000},
+    {32, 216000, 5120, 20000},    {40, 245760, 8192, 20000},    {42, 522240, 8704, 50000},
+    {50, 589824, 22080, 135000},  {51, 983040, 36864, 240000},  {52, 2073600, 36864, 240000},
+};
+
+// Slice types of slice_type, NAL unit types and the reference priority of every NAL unit
+constexpr uint32_t sliceTypeP = 5;
+constexpr uint32_t sliceTypeI = 7;
+constexpr int nalSlice = 1;
+constexpr int nalIdrSlice = 5;
+constexpr int nalSps = 7;
+constexpr int nalPps = 8;
+constexpr int nalRefIdc = 3;
+
+// An 8x8 inter block whose levels are at most this many ones is not worth its bits
+constexpr int decimateThreshold = 2;
+
+int chromaQp(int qp) {
+    return qp < 30 ? qp : chromaQpTable[qp - 30];
+}
+
+// Position of a luma 4x4 block, given in bitstream order, within its macroblock
+int blockX(int block) {
+    return (block / 4 % 2) * 8 + (block % 4 % 2) * 4;
+}
+
+int blockY(int block) {
+    return (block / 4 / 2) * 8 + (block % 4 / 2) * 4;
+}
+
+int rasterIndex(int block) {
+    return blockY(block) + blockX(block) / 4;
+}
+
+int countNonZero(const int16_t *levels, int count) {
+    int total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += levels[i] != 0;
+    }
+    return total;
+}
+
+void copyBlock(uint8_t *dst, ptrdiff_t dstStride, const uint8_t *src, ptrdiff_t srcStride,
+               int width, int height) {
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(dst + y * dstStride, src + y * srcStride, width);
+    }
+}
+
+// 2x2 Hadamard transform of chroma DC coefficients, its own inverse up to scale
+void hadamard2x2(int16_t *dc) {
+    int a = dc[0] + dc[1], b = dc[0] - dc[1], c = dc[2] + dc[3], d = dc[2] - dc[3];
+    dc[0] = static_cast<int16_t>(a + c);
+    dc[1] = static_cast<int16_t>(b + d);
+    dc[2] = static_cast<int16_t>(a - c);
+    dc[3] = static_cast<int16_t>(b - d);
+}
+
+/**
+ * @struct EncoderMetrics
+ * @brief Metrics shared by every software encoder of the process
+ */
+struct EncoderMetrics {
+    Counter &frames;
+    Counter &bytes;
+    Gauge &queueDepth;
+    Histogram &latencySeconds;
+};
+
+const EncoderMetrics &getEncoderMetrics() {
+    static const EncoderMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        return EncoderMetrics{
+            registry.getCounter("vulkantest_frames_encoded_total", "Frames coded"),
+            registry.getCounter("vulkantest_encoded_bytes_total", "Bytes of coded frames"),
+            registry.getGauge("vulkantest_encoder_queue_depth",
+                              "Frames queued or being coded by the software encoders"),
+            registry.getHistogram("vulkantest_encode_latency_seconds",
+                                  "Time from queueing a frame to its output, software encoder")};
+    }();
+    return metrics;
+}
+
+} // namespace
+
+/**
+ * @class SoftwareEncoder::SliceCoder
+ * @brief Codes the macroblocks of one slice into the frame's reconstruction
+ *
+ * Neighbours outside the slice are treated as unavailable for both intra and motion vector
+ * prediction, so slices are independent of each other
+ */
+class SoftwareEncoder::SliceCoder {
+  public:
+    SliceCoder(SoftwareEncoder &encoder, Frame &frame, uint32_t firstRow)
+        : encoder(encoder), frame(frame), firstRow(firstRow), mbWidth(encoder.mbWidth),
+          lumaQuant(frame.rate.qp), chromaQuant(chromaQp(frame.rate.qp)),
+          lambda(std::max(1, static_cast<int>(std::lround(
+                                 std::pow(2.0, (frame.rate.qp - 12) / 6.0))))),
+          pixels(getPixelFunctions()), transforms(getTransformFunctions()) {
+        const YuvFrame *previous = &encoder.reconstructions[(frame.index + 1) & 1];
+        for (int plane = 0; plane < 3; ++plane) {
+            source[plane] = frame.source.planes[plane].data();
+            reconstruction[plane] = frame.reconstruction->planes[plane].data();
+            reference[plane] = previous->planes[plane].data();
+            stride[plane] = frame.source.stride(plane);
+        }
+    }
+
+    /**
+     * @brief Codes one macroblock
+     */
+    void code(uint32_t mbX, uint32_t mbY);
+
+  protected:
+    SoftwareEncoder &encoder;
+    Frame &frame;
+    uint32_t firstRow;
+    uint32_t mbWidth;
+    QuantTables lumaQuant;
+    QuantTables chromaQuant;
+    int lambda;
+    const PixelFunctions &pixels;
+    const TransformFunctions &transforms;
+    const uint8_t *source[3];
+    uint8_t *reconstruction[3];
+    const uint8_t *reference[3];
+    ptrdiff_t stride[3];
+
+    /// @brief Position and neighbours of the current macroblock (nullptr if unavailable)
+    uint32_t mbX = 0, mbY = 0;
+    const Macroblock *left = nullptr, *top = nullptr, *topRight = nullptr, *topLeft = nullptr;
+
+    const uint8_t *lumaSource() const { return source[0] + (mbY * stride[0] + mbX) * 16; }
+    uint8_t *lumaReconstruction() const {
+        return reconstruction[0] + (mbY * stride[0] + mbX) * 16;
+    }
+
+    MotionVector predictMotion(MotionVector &skip) const;
+    int codeIntra4x4(Macroblock &mb);
+    void codeIntra16x16(Macroblock &mb, const uint8_t *prediction);
+    void codeInter(Macroblock &mb, const uint8_t *prediction, ptrdiff_t predictionStride);
+    void predictChromaDc(uint8_t prediction[2][64]) const;
+    void predictChromaInter(MotionVector mv, uint8_t prediction[2][64]) const;
+    void codeChroma(Macroblock &mb, const uint8_t prediction[2][64], bool intra);
+};
+
+MotionVector SoftwareEncoder::SliceCoder::predictMotion(MotionVector &skip) const {
+    struct Neighbour {
+        bool available;
+        int ref;
+        MotionVector mv;
+    };
+    auto neighbour = [](const Macroblock *mb) {
+        if (mb == nullptr) {
+            return Neighbour{false, -1, {}};
+        }
+        bool inter = mb->type == MacroblockType::Skip || mb->type == MacroblockType::Inter;
+        return inter ? Neighbour{true, 0, mb->mv} : Neighbour{true, -1, {}};
+    };
+
+    Neighbour a = neighbour(left);
+    Neighbour b = neighbour(top);
+    Neighbour c = neighbour(topRight != nullptr ? topRight : topLeft);
+
+    MotionVector predictor;
+    if (!b.available && !c.available && a.available) {
+        predictor = a.mv;
+    } else if ((a.ref == 0) + (b.ref == 0) + (c.ref == 0) == 1) {
+        predictor = a.ref == 0 ? a.mv : b.ref == 0 ? b.mv : c.mv;
+    } else {
+        predictor = MotionSearch::median(a.mv, b.mv, c.mv);
+    }
+
+    MotionVector zero;
+    bool zeroSkip = !a.available || !b.available || (a.ref == 0 && a.mv == zero) ||
+                    (b.ref == 0 && b.mv == zero);
+    skip = zeroSkip ? zero : predictor;
+    return predictor;
+}
+
+int SoftwareEncoder::SliceCoder::codeIntra4x4(Macroblock &mb) {
+    const uint8_t *src = lumaSource();
+    uint8_t *rec = lumaReconstruction();
+    const ptrdiff_t s = stride[0];
+    const int shift = lumaQuant.quantShift4x4;
+    const int32_t bias = QuantTables::deadzone(shift, true);
+
+    mb.type = MacroblockType::Intra4x4;
+    int cost = 0;
+    for (int block = 0; block < 16; ++block) {
+        const int x = blockX(block), y = blockY(block), raster = rasterIndex(block);
+        // The top-right samples of the right column and of blocks 3 and 11 are decoded later
+        bool hasTopRight = block == 5   ? topRight != nullptr
+                           : block == 0 || block == 1 || block == 4 ? top != nullptr
+                           : block != 3 && block != 7 && block != 11 && block != 13 &&
+                                 block != 15;
+        bool hasTopLeft = x > 0 && y > 0 ? true
+                          : y > 0        ? left != nullptr
+                          : x > 0        ? top != nullptr
+                                         : topLeft != nullptr;
+        IntraNeighbours neighbours =
+            gatherIntraNeighbours(rec + y * s + x, s, 4, x > 0 || left != nullptr,
+                                  y > 0 || top != nullptr, hasTopLeft, hasTopRight);
+
+        // Neighbours coded in other modes predict DC; missing ones force it
+        auto modeOf = [](const Macroblock *n, int index) {
+            return n == nullptr                          ? -1
+                   : n->type == MacroblockType::Intra4x4 ? n->intra4x4Modes[index]
+                                                         : 2;
+        };
+        int modeA = x > 0 ? mb.intra4x4Modes[raster - 1] : modeOf(left, raster + 3);
+        int modeB = y > 0 ? mb.intra4x4Modes[raster - 4] : modeOf(top, raster + 12);
+        int predicted = modeA < 0 || modeB < 0 ? 2 : std::min(modeA, modeB);
+
+        alignas(16) uint8_t prediction[16];
+        IntraDecision decision = decideIntra4x4Mode(
+            src + y * s + x, s, neighbours, static_cast<IntraMode>(predicted), lambda,
+            prediction, 4);
+        cost += decision.cost;
+        mb.intra4x4Modes[raster] = static_cast<uint8_t>(decision.mode);
+        mb.intra4x4Codes[block] =
+            decision.mode == predicted
+                ? -1
+                : static_cast<int8_t>(decision.mode < predicted ? decision.mode
+                                                                : decision.mode - 1);
+
+        alignas(32) int16_t coefficients[16];
+        transforms.forward4x4(coefficients, src + y * s + x, s, prediction, 4);
+        bool nonZero =
+            transforms.quantize(coefficients, lumaQuant.quant4x4, bias, shift, 16);
+        copyBlock(rec + y * s + x, s, prediction, 4, 4, 4);
+        for (int i = 0; i < 16; ++i) {
+            mb.luma[block][i] = coefficients[zigzag4x4[i]];
+        }
+        mb.lumaTotals[raster] = static_cast<uint8_t>(countNonZero(mb.luma[block], 16));
+        if (nonZero) {
+            mb.cbpLuma |= static_cast<uint8_t>(1 << (block / 4));
+            transforms.dequantize(coefficients, lumaQuant.dequant4x4, 0, 16);
+            transforms.inverse4x4(rec + y * s + x, s, coefficients);
+        }
+    }
+    return cost;
+}
+
+void SoftwareEncoder::SliceCoder::codeIntra16x16(Macroblock &mb, const uint8_t *prediction) {
+    const uint8_t *src = lumaSource();
+    uint8_t *rec = lumaReconstruction();
+    const ptrdiff_t s = stride[0];
+
+    alignas(32) int16_t coefficients[16][16];
+    alignas(32) int16_t dc[16];
+    for (int raster = 0; raster < 16; ++raster) {
+        int x = raster % 4 * 4, y = raster / 4 * 4;
+        transforms.forward4x4(coefficients[raster], src + y * s + x, s,
+                              prediction + y * 16 + x, 16);
+        dc[raster] = coefficients[raster][0];
+        coefficients[raster][0] = 0;
+    }
+
+    transforms.forwardDc(dc);
+    transforms.quantize(dc, lumaQuant.quantDc,
+                        QuantTables::deadzone(lumaQuant.quantShiftDc, true),
+                        lumaQuant.quantShiftDc, 16);
+    for (int i = 0; i < 16; ++i) {
+        mb.lumaDc[i] = dc[zigzag4x4[i]];
+    }
+
+    const int32_t bias = QuantTables::deadzone(lumaQuant.quantShift4x4, true);
+    bool anyAc = false;
+    for (int raster = 0; raster < 16; ++raster) {
+        anyAc |= transforms.quantize(coefficients[raster], lumaQuant.quant4x4, bias,
+                                     lumaQuant.quantShift4x4, 16);
+    }
+    mb.cbpLuma = anyAc ? 15 : 0;
+    for (int block = 0; block < 16; ++block) {
+        int raster = rasterIndex(block);
+        for (int i = 1; i < 16; ++i) {
+            mb.luma[block][i - 1] = coefficients[raster][zigzag4x4[i]];
+        }
+        mb.lumaTotals[raster] = static_cast<uint8_t>(countNonZero(mb.luma[block], 15));
+    }
+
+    transforms.inverseDc(dc);
+    transforms.dequantize(dc, lumaQuant.dequantDc, lumaQuant.dequantShiftDc, 16);
+    copyBlock(rec, s, prediction, 16, 16, 16);
+    for (int raster = 0; raster < 16; ++raster) {
+        int x = raster % 4 * 4, y = raster / 4 * 4;
+        transforms.dequantize(coefficients[raster], lumaQuant.dequant4x4, 0, 16);
+        coefficients[raster][0] = dc[raster];
+        transforms.inverse4x4(rec + y * s + x, s, coefficients[raster]);
+    }
+}
+
+void SoftwareEncoder::SliceCoder::codeInter(Macroblock &mb, const uint8_t *prediction,
+                                           ptrdiff_t predictionStride) {
+    const uint8_t *src = lumaSource();
+    uint8_t *rec = lumaReconstruction();
+    const ptrdiff_t s = stride[0];
+    const int shift = lumaQuant.quantShift4x4;
+    const int32_t bias = QuantTables::deadzone(shift, false);
+
+    alignas(32) int16_t coefficients[16][16];
+    for (int block = 0; block < 16; ++block) {
+        int x = blockX(block), y = blockY(block);
+        transforms.forward4x4(coefficients[block], src + y * s + x, s,
+                              prediction + y * predictionStride + x, predictionStride);
+        transforms.quantize(coefficients[block], lumaQuant.quant4x4, bias, shift, 16);
+    }
+
+    copyBlock(rec, s, prediction, predictionStride, 16, 16);
+    for (int block8x8 = 0; block8x8 < 4; ++block8x8) {
+        // Drop 8x8 blocks holding only a couple of isolated ones
+        int ones = 0;
+        bool larger = false;
+        for (int block = block8x8 * 4; block < block8x8 * 4 + 4; ++block) {
+            for (int i = 0; i < 16; ++i) {
+                int level = std::abs(coefficients[block][i]);
+                ones += level == 1;
+                larger |= level > 1;
+            }
+        }
+        if (larger || ones > decimateThreshold) {
+            mb.cbpLuma |= static_cast<uint8_t>(1 << block8x8);
+        } else if (ones > 0) {
+            std::memset(coefficients[block8x8 * 4], 0, sizeof(coefficients[0]) * 4);
+        }
+
+        for (int block = block8x8 * 4; block < block8x8 * 4 + 4; ++block) {
+            int raster = rasterIndex(block);
+            for (int i = 0; i < 16; ++i) {
+                mb.luma[block][i] = coefficients[block][zigzag4x4[i]];
+            }
+            mb.lumaTotals[raster] = static_cast<uint8_t>(countNonZero(mb.luma[block], 16));
+            if (mb.lumaTotals[raster] != 0) {
+                int x = blockX(block), y = blockY(block);
+                transforms.dequantize(coefficients[block], lumaQuant.dequant4x4, 0, 16);
+                transforms.inverse4x4(rec + y * s + x, s, coefficients[block]);
+            }
+        }
+    }
+}
+
+void SoftwareEncoder::SliceCoder::predictChromaDc(uint8_t prediction[2][64]) const {
+    const ptrdiff_t s = stride[1];
+    for (int plane = 0; plane < 2; ++plane) {
+        const uint8_t *rec = reconstruction[plane + 1] + (mbY * s + mbX) * 8;
+        int topSums[2] = {}, leftSums[2] = {};
+        for (int i = 0; i < 8; ++i) {
+            if (top != nullptr) {
+                topSums[i / 4] += rec[i - s];
+            }
+            if (left != nullptr) {
+                leftSums[i / 4] += rec[i * s - 1];
+            }
+        }
+
+        // The diagonal blocks average both edges; the others prefer the edge they touch
+        for (int block = 0; block < 4; ++block) {
+            int bx = block & 1, by = block >> 1;
+            bool hasTop = top != nullptr, hasLeft = left != nullptr;
+            int value = 128;
+            if (bx == by && hasTop && hasLeft) {
+                value = (topSums[bx] + leftSums[by] + 4) >> 3;
+            } else if (bx == 1 && by == 0) {
+                value = hasTop ? (topSums[1] + 2) >> 2 : hasLeft ? (leftSums[0] + 2) >> 2 : 128;
+            } else if (bx == 0 && by == 1) {
+                value = hasLeft ? (leftSums[1] + 2) >> 2 : hasTop ? (topSums[0] + 2) >> 2 : 128;
+            } else if (hasLeft) {
+                value = (leftSums[by] + 2) >> 2;
+            } else if (hasTop) {
+                value = (topSums[bx] + 2) >> 2;
+            }
+            for (int y = 0; y < 4; ++y) {
+                std::memset(prediction[plane] + (by * 4 + y) * 8 + bx * 4, value, 4);
+            }
+        }
+    }
+}
+
+void SoftwareEncoder::SliceCoder::predictChromaInter(MotionVector mv,
+                                                    uint8_t prediction[2][64]) const {
+    // Luma quarter-pel vectors are eighth-pel in the half-resolution chroma planes
+    const int width = static_cast<int>(encoder.mbWidth * 8);
+    const int height = static_cast<int>(encoder.mbHeight * 8);
+    const int baseX = static_cast<int>(mbX * 8) + (mv.x >> 3);
+    const int baseY = static_cast<int>(mbY * 8) + (mv.y >> 3);
+    const int fx = mv.x & 7, fy = mv.y & 7;
+    const int wA = (8 - fx) * (8 - fy), wB = fx * (8 - fy), wC = (8 - fx) * fy, wD = fx * fy;
+
+    int columns[9];
+    for (int x = 0; x < 9; ++x) {
+        columns[x] = std::clamp(baseX + x, 0, width - 1);
+    }
+    for (int plane = 0; plane < 2; ++plane) {
+        const uint8_t *ref = reference[plane + 1];
+        for (int y = 0; y < 8; ++y) {
+            const uint8_t *row0 = ref + std::clamp(baseY + y, 0, height - 1) * stride[1];
+            const uint8_t *row1 = ref + std::clamp(baseY + y + 1, 0, height - 1) * stride[1];
+            for (int x = 0; x < 8; ++x) {
+                int a = row0[columns[x]], b = row0[columns[x + 1]];
+                int c = row1[columns[x]], d = row1[columns[x + 1]];
+                prediction[plane][y * 8 + x] =
+                    static_cast<uint8_t>((wA * a + wB * b + wC * c + wD * d + 32) >> 6);
+            }
+        }
+    }
+}
+
+void SoftwareEncoder::SliceCoder::codeChroma(Macroblock &mb, const uint8_t prediction[2][64],
+                                            bool intra) {
+    const ptrdiff_t s = stride[1];
+    const int shift = chromaQuant.quantShift4x4;
+    const int32_t bias = QuantTables::deadzone(shift, intra);
+    const int32_t dcBias = QuantTables::deadzone(chromaQuant.quantShiftDc, intra);
+
+    alignas(32) int16_t coefficients[2][4][16];
+    alignas(32) int16_t dc[2][16] = {};
+    bool anyDc = false, anyAc = false;
+    for (int plane = 0; plane < 2; ++plane) {
+        const uint8_t *src = source[plane + 1] + (mbY * s + mbX) * 8;
+        for (int block = 0; block < 4; ++block) {
+            int x = (block & 1) * 4, y = (block >> 1) * 4;
+            transforms.forward4x4(coefficients[plane][block], src + y * s + x, s,
+                                  prediction[plane] + y * 8 + x, 8);
+            dc[plane][block] = coefficients[plane][block][0];
+            coefficients[plane][block][0] = 0;
+            anyAc |= transforms.quantize(coefficients[plane][block], chromaQuant.quant4x4, bias,
+                                         shift, 16);
+        }
+        hadamard2x2(dc[plane]);
+        anyDc |= transforms.quantize(dc[plane], chromaQuant.quantDc, dcBias,
+                                     chromaQuant.quantShiftDc, 16);
+    }
+    mb.cbpChroma = anyAc ? 2 : anyDc ? 1 : 0;
+
+    for (int plane = 0; plane < 2; ++plane) {
+        uint8_t *rec = reconstruction[plane + 1] + (mbY * s + mbX) * 8;
+        copyBlock(rec, s, prediction[plane], 8, 8, 8);
+
+        std::copy(dc[plane], dc[plane] + 4, mb.chromaDc[plane]);
+        hadamard2x2(dc[plane]);
+        for (int block = 0; block < 4; ++block) {
+            int16_t *c = coefficients[plane][block];
+            for (int i = 1; i < 16; ++i) {
+                mb.chromaAc[plane][block][i - 1] = mb.cbpChroma == 2 ? c[zigzag4x4[i]] : 0;
+            }
+            int total = mb.cbpChroma == 2 ? countNonZero(mb.chromaAc[plane][block], 15) : 0;
+            mb.chromaTotals[plane * 4 + block] = static_cast<uint8_t>(total);
+            if (total != 0) {
+                transforms.dequantize(c, chromaQuant.dequant4x4, 0, 16);
+            } else {
+                std::memset(c, 0, sizeof(coefficients[0][0]));
+            }
+            c[0] = static_cast<int16_t>((dc[plane][block] * chromaQuant.dequant4x4[0]) >> 1);
+            if (total != 0 || c[0] != 0) {
+                int x = (block & 1) * 4, y = (block >> 1) * 4;
+                transforms.inverse4x4(rec + y * s + x, s, c);
+            }
+        }
+    }
+}
+
+void SoftwareEncoder::SliceCoder::code(uint32_t x, uint32_t y) {
+    mbX = x;
+    mbY = y;
+    const size_t index = static_cast<size_t>(y) * mbWidth + x;
+    Macroblock *mbs = frame.macroblocks.data();
+    bool hasTop = y > firstRow;
+    left = x > 0 ? &mbs[index - 1] : nullptr;
+    top = hasTop ? &mbs[index - mbWidth] : nullptr;
+    topRight = hasTop && x + 1 < mbWidth ? &mbs[index - mbWidth + 1] : nullptr;
+    topLeft = hasTop && x > 0 ? &mbs[index - mbWidth - 1] : nullptr;
+
+    Macroblock &mb = mbs[index];
+    mb = Macroblock{};
+
+    const uint8_t *src = lumaSource();
+    alignas(32) uint8_t intraPrediction[256];
+    IntraNeighbours neighbours = gatherIntraNeighbours(
+        lumaReconstruction(), stride[0], 16, left != nullptr, top != nullptr,
+        topLeft != nullptr, false);
+    IntraDecision intra16x16 =
+        decideIntra16x16Mode(src, stride[0], neighbours, intraPrediction, 16);
+
+    // Inter prediction from the motion search, or from the skip vector if that is as good
+    alignas(32) uint8_t scratch[2][256];
+    const uint8_t *interPrediction = nullptr;
+    ptrdiff_t interStride = 0;
+    MotionVector mv, skipMv, predictor;
+    int interCost = 0;
+    if (!frame.idr) {
+        predictor = predictMotion(skipMv);
+        const int pixelX = static_cast<int>(x * 16), pixelY = static_cast<int>(y * 16);
+        auto cost = [&](MotionVector candidate, uint8_t *buffer, const uint8_t *&pred,
+                        ptrdiff_t &predStride) {
+            pred = encoder.reference.predict(buffer, 16, pixelX, pixelY, candidate, 16, 16,
+                                             pixels, predStride);
+            return pixels.satd[static_cast<size_t>(BlockSize::B16x16)](src, stride[0], pred,
+                                                                       predStride) +
+                   lambda * (MotionSearch::signedGolombBits(candidate.x - predictor.x) +
+                             MotionSearch::signedGolombBits(candidate.y - predictor.y));
+        };
+
+        mv = encoder.motionSearch.getMotionField()[index].mvs[0];
+        interCost = cost(mv, scratch[0], interPrediction, interStride);
+
+        const int reach = ReferenceFrame::padding - 8;
+        const int referenceWidth = static_cast<int>(encoder.reference.getWidth());
+        const int referenceHeight = static_cast<int>(encoder.reference.getHeight());
+        bool skipInBounds = skipMv.x >= (-reach - pixelX) * 4 &&
+                            skipMv.x <= (referenceWidth + reach - 16 - pixelX) * 4 &&
+                            skipMv.y >= (-reach - pixelY) * 4 &&
+                            skipMv.y <= (referenceHeight + reach - 16 - pixelY) * 4;
+        if (skipMv != mv && skipInBounds) {
+            const uint8_t *skipPrediction;
+            ptrdiff_t skipStride;
+            int skipCost = cost(skipMv, scratch[1], skipPrediction, skipStride);
+            if (skipCost <= interCost) {
+                mv = skipMv;
+                interCost = skipCost;
+                interPrediction = skipPrediction;
+                interStride = skipStride;
+            }
+        }
+    }
+
+    alignas(32) uint8_t chromaPrediction[2][64];
+    if (frame.idr || intra16x16.cost < interCost) {
+        // Intra 4x4 is coded as it is decided, since each block predicts from the last
+        int intra4x4Cost = codeIntra4x4(mb) + lambda * 24;
+        if (intra16x16.cost <= intra4x4Cost) {
+            mb = Macroblock{};
+            mb.type = MacroblockType::Intra16x16;
+            mb.intra16x16Mode = static_cast<uint8_t>(intra16x16.mode);
+            codeIntra16x16(mb, intraPrediction);
+        }
+        predictChromaDc(chromaPrediction);
+        codeChroma(mb, chromaPrediction, true);
+        return;
+    }
+
+    mb.type = MacroblockType::Inter;
+    mb.mv = mv;
+    mb.mvd = {static_cast<int16_t>(mv.x - predictor.x), static_cast<int16_t>(mv.y - predictor.y)};
+    codeInter(mb, interPrediction, interStride);
+    predictChromaInter(mv, chromaPrediction);
+    codeChroma(mb, chromaPrediction, false);
+    if (mv == skipMv && mb.cbpLuma == 0 && mb.cbpChroma == 0) {
+        mb.type = MacroblockType::Skip;
+    }
+}
+
+SoftwareEncoder::SoftwareEncoder(const SoftwareEncoderConfig &config,
+                                 const RateControlConfig &rateControlConfig, ThreadPool &pool,
+                                 OutputCallback output, BitstreamRing *bitstream)
+    : config(config), pool(pool), output(std::move(output)), bitstream(bitstream),
+      mbWidth((config.width + 15) / 16), mbHeight((config.height + 15) / 16),
+      rateController(rateControlConfig),
+      motionSearch(std::max(mbWidth, 1u) * 16, std::max(mbHeight, 1u) * 16,
+                   [&config] {
+                       // Only P_L0_16x16 is coded, so smaller partitions are not searched
+                       MotionSearchPreset preset = getMotionSearchPreset(config.motionPreset);
+                       preset.partitions = false;
+                       preset.partitions4x4 = false;
+                       return preset;
+                   }()),
+      lastQp(rateControlConfig.qp) {
+    if (config.width == 0 || config.height == 0) {
+        throw std::runtime_error("software encoder picture size must not be zero");
+    }
+    this->config.idrPeriod = std::max(config.idrPeriod, 1u);
+    this->config.maxFramesInFlight =
+        std::max(config.maxFramesInFlight, rateControlConfig.lookahead + 2);
+
+    uint32_t sliceCount = std::clamp(config.slices, 1u, mbHeight);
+    for (uint32_t slice = 0; slice <= sliceCount; ++slice) {
+        sliceRows.push_back(slice * mbHeight / sliceCount);
+    }
+    for (YuvFrame &reconstruction : reconstructions) {
+        reconstruction.allocate(config.width, config.height);
+    }
+    if (config.quality) {
+        qualityMeter =
+            std::make_unique<QualityMeter>(config.width, config.height, *config.quality);
+    }
+    writeParameterSets();
+}
+
+SoftwareEncoder::~SoftwareEncoder() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    stopping = true;
+    stateCondition.wait(lock, [this] { return activeTasks == 0; });
+    getEncoderMetrics().queueDepth.add(-static_cast<double>(frames.size()));
+}
+
+uint32_t SoftwareEncoder::getSliceCount() const {
+    return static_cast<uint32_t>(sliceRows.size() - 1);
+}
+
+void SoftwareEncoder::encodeFrame(YuvFrame frame) {
+    if (frame.width != mbWidth * 16 || frame.height != mbHeight * 16) {
+        throw std::runtime_error("frame size does not match the software encoder");
+    }
+
+    // The complexity estimate only reads the caller's frames, so it runs without the lock
+    bool idr = framesQueued % config.idrPeriod == 0;
+    double complexity = RateController::estimateComplexity(
+        frame.planes[0].data(), idr ? nullptr : previousLuma.data(), frame.width, frame.height,
+        frame.stride(0));
+    previousLuma = frame.planes[0];
+
+    std::unique_lock<std::mutex> lock(stateMutex);
+    stateCondition.wait(lock, [this] {
+        return error != nullptr || frames.size() < config.maxFramesInFlight;
+    });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    std::unique_ptr<Frame> queued;
+    if (spareFrames.empty()) {
+        queued = std::make_unique<Frame>();
+        queued->macroblocks.resize(static_cast<size_t>(mbWidth) * mbHeight);
+        queued->slices.resize(getSliceCount());
+    } else {
+        queued = std::move(spareFrames.back());
+        spareFrames.pop_back();
+    }
+    queued->index = framesQueued++;
+    queued->idr = idr;
+    nextFrameNum = idr ? 0 : nextFrameNum;
+    queued->frameNum = nextFrameNum;
+    nextFrameNum = (nextFrameNum + 1) % 16;
+    queued->idrPicId = idr ? nextIdrPicId++ % 65536 : 0;
+    queued->complexity = complexity;
+    queued->source = std::move(frame);
+    queued->reconstruction = &reconstructions[queued->index & 1];
+    queued->stage = FrameStage::Queued;
+    queued->pendingTasks = 0;
+    queued->queueTime = std::chrono::steady_clock::now();
+
+    frames.push_back(std::move(queued));
+    getEncoderMetrics().queueDepth.add(1.0);
+    schedule();
+}
+
+void SoftwareEncoder::flush() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    flushing = true;
+    schedule();
+    stateCondition.wait(lock, [this] {
+        return error != nullptr || (frames.empty() && pendingQuality.empty());
+    });
+    flushing = false;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void SoftwareEncoder::submit(std::function<void()> task, std::function<void()> done) {
+    ++activeTasks;
+    pool.submit([this, task = std::move(task), done = std::move(done)] {
+        std::exception_ptr failure;
+        try {
+            task();
+        } catch (...) {
+            failure = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (!failure) {
+            try {
+                done();
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        }
+        if (failure && !error) {
+            error = failure;
+        }
+        --activeTasks;
+        stateCondition.notify_all();
+    });
+}
+
+void SoftwareEncoder::runSlices(Frame &frame, std::function<void(Frame &, uint32_t)> work,
+                                std::function<void(Frame &)> done) {
+    frame.pendingTasks = getSliceCount();
+    for (uint32_t slice = 0; slice < getSliceCount(); ++slice) {
+        submit([&frame, work, slice] { work(frame, slice); },
+               [&frame, done] {
+                   if (--frame.pendingTasks == 0) {
+                       done(frame);
+                   }
+               });
+    }
+}
+
+void SoftwareEncoder::schedule() {
+    if (stopping || error) {
+        return;
+    }
+
+    // Analysis needs the reference built from the previous frame; IDR frames need none
+    for (auto &queued : frames) {
+        Frame &frame = *queued;
+        if (frame.stage != FrameStage::Queued) {
+            continue;
+        }
+        if (frame.idr) {
+            frame.stage = FrameStage::Analysed;
+            continue;
+        }
+        if (referenceIndex == static_cast<int64_t>(frame.index) - 1) {
+            frame.stage = FrameStage::Analysing;
+            motionSearch.beginFrame(frame.source.view(0), reference, lastQp);
+            runSlices(
+                frame,
+                [this](Frame &, uint32_t slice) {
+                    TRACE_SCOPE("motion search slice");
+                    uint32_t rowCount = sliceRows[slice + 1] - sliceRows[slice];
+                    motionSearch.searchSlice(sliceRows[slice], rowCount);
+                },
+                [this](Frame &analysed) {
+                    analysed.stage = FrameStage::Analysed;
+                    schedule();
+                });
+        }
+        break;
+    }
+
+    for (auto &queued : frames) {
+        if (framesAwaitingRate > rateController.getConfig().lookahead) {
+            break;
+        }
+        if (queued->index == framesRated) {
+            rateController.addFrame(queued->idr, queued->complexity);
+            ++framesRated;
+            ++framesAwaitingRate;
+        }
+    }
+
+    // The rate controller takes one frame at a time, so only the oldest frame is coded
+    if (frames.empty() || frames.front()->stage != FrameStage::Analysed ||
+        !(rateController.isReady() || flushing) ||
+        measuringReconstruction[frames.front()->index & 1]) {
+        return;
+    }
+    Frame &frame = *frames.front();
+    frame.rate = rateController.beginFrame();
+    --framesAwaitingRate;
+    lastQp = frame.rate.qp;
+    frame.stage = FrameStage::Coding;
+    runSlices(
+        frame, [this](Frame &coded, uint32_t slice) { codeSlice(coded, slice); },
+        [this](Frame &coded) {
+            coded.stage = FrameStage::EntropyCoding;
+            if (qualityMeter) {
+                measureQuality(coded);
+            }
+            if ((coded.index + 1) % config.idrPeriod != 0) {
+                const YuvFrame *reconstruction = coded.reconstruction;
+                int64_t index = static_cast<int64_t>(coded.index);
+                submit(
+                    [this, reconstruction] {
+                        TRACE_SCOPE("build reference");
+                        reference.build(reconstruction->view(0));
+                    },
+                    [this, index] {
+                        referenceIndex = index;
+                        schedule();
+                    });
+            }
+            runSlices(
+                coded, [this](Frame &written, uint32_t slice) { writeSlice(written, slice); },
+                [this](Frame &written) { finishFrame(written); });
+        });
+}
+
+void SoftwareEncoder::measureQuality(Frame &frame) {
+    FrameQuality &quality = pendingQuality[frame.index].quality;
+    quality.frameIndex = frame.index;
+    quality.idr = frame.idr;
+    quality.qp = frame.rate.qp;
+
+    // Entropy coding only needs the levels, so the source moves to the task
+    auto source = std::make_shared<YuvFrame>(std::move(frame.source));
+    auto metrics = std::make_shared<FrameQuality>();
+    const YuvFrame *reconstruction = frame.reconstruction;
+    uint64_t index = frame.index;
+    measuringReconstruction[index & 1] = true;
+    auto measure = [this, source, reconstruction, metrics] {
+        TRACE_SCOPE("measure quality");
+        qualityMeter->measure(*source, *reconstruction, *metrics);
+    };
+    submit(measure, [this, index, metrics] {
+        measuringReconstruction[index & 1] = false;
+        PendingQuality &pending = pendingQuality[index];
+        pending.quality.psnrY = metrics->psnrY;
+        pending.quality.psnrU = metrics->psnrU;
+        pending.quality.psnrV = metrics->psnrV;
+        pending.quality.ssim = metrics->ssim;
+        pending.measured = true;
+        completeQuality();
+        schedule();
+    });
+}
+
+void SoftwareEncoder::completeQuality() {
+    // Measurements may finish out of order, but frames are reported in coding order
+    while (!pendingQuality.empty()) {
+        auto oldest = pendingQuality.begin();
+        if (!oldest->second.measured || !oldest->second.sized) {
+            break;
+        }
+        if (!stopping) {
+            qualityMeter->addFrame(oldest->second.quality);
+        }
+        pendingQuality.erase(oldest);
+        stateCondition.notify_all();
+    }
+}
+
+void SoftwareEncoder::codeSlice(Frame &frame, uint32_t slice) {
+    TRACE_SCOPE("code slice");
+    SliceCoder coder(*this, frame, sliceRows[slice]);
+    for (uint32_t mbY = sliceRows[slice]; mbY < sliceRows[slice + 1]; ++mbY) {
+        for (uint32_t mbX = 0; mbX < mbWidth; ++mbX) {
+            coder.code(mbX, mbY);
+        }
+    }
+}
+
+void SoftwareEncoder::writeSlice(Frame &frame, uint32_t slice) {
+    TRACE_SCOPE("write slice");
+    const uint32_t firstRow = sliceRows[slice];
+    BitWriter writer;
+
+    // slice_header
+    writer.writeUe(firstRow * mbWidth);
+    writer.writeUe(frame.idr ? sliceTypeI : sliceTypeP);
+    writer.writeUe(0);
+    writer.writeBits(frame.frameNum, 4);
+    if (frame.idr) {
+        writer.writeUe(frame.idrPicId);
+    } else {
+        writer.writeBit(false); // num_ref_idx_active_override_flag
+        writer.writeBit(false); // ref_pic_list_modification_flag_l0
+    }
+    if (frame.idr) {
+        writer.writeBit(false); // no_output_of_prior_pics_flag
+        writer.writeBit(false); // long_term_reference_flag
+    } else {
+        writer.writeBit(false); // adaptive_ref_pic_marking_mode_flag
+    }
+    writer.writeSe(frame.rate.qp - 26);
+    writer.writeUe(1); // disable_deblocking_filter_idc
+
+    // slice_data
+    const Macroblock *mbs = frame.macroblocks.data();
+    uint32_t skipRun = 0;
+    for (uint32_t mbY = firstRow; mbY < sliceRows[slice + 1]; ++mbY) {
+        for (uint32_t mbX = 0; mbX < mbWidth; ++mbX) {
+            const size_t index = static_cast<size_t>(mbY) * mbWidth + mbX;
+            const Macroblock &mb = mbs[index];
+            if (mb.type == MacroblockType::Skip) {
+                ++skipRun;
+                continue;
+            }
+            if (!frame.idr) {
+                writer.writeUe(skipRun);
+                skipRun = 0;
+            }
+
+            const uint32_t intraOffset = frame.idr ? 0 : 5;
+            const uint32_t cbp = mb.cbpLuma | (mb.cbpChroma << 4);
+            switch (mb.type) {
+            case MacroblockType::Inter:
+                writer.writeUe(0);
+                writer.writeSe(mb.mvd.x);
+                writer.writeSe(mb.mvd.y);
+                writer.writeUe(interCbpCodes[cbp]);
+                break;
+            case MacroblockType::Intra4x4:
+                writer.writeUe(intraOffset);
+                for (int8_t code : mb.intra4x4Codes) {
+                    writer.writeBit(code < 0);
+                    if (code >= 0) {
+                        writer.writeBits(static_cast<uint32_t>(code), 3);
+                    }
+                }
+                writer.writeUe(0); // intra_chroma_pred_mode DC
+                writer.writeUe(intraCbpCodes[cbp]);
+                break;
+            default:
+                writer.writeUe(intraOffset + 1 + mb.intra16x16Mode + 4 * mb.cbpChroma +
+                               (mb.cbpLuma != 0 ? 12 : 0));
+                writer.writeUe(0);
+                break;
+            }
+            if (cbp == 0 && mb.type != MacroblockType::Intra16x16) {
+                continue;
+            }
+            writer.writeSe(0); // mb_qp_delta
+
+            // nC is predicted from the blocks left and above, within the slice
+            const Macroblock *left = mbX > 0 ? &mbs[index - 1] : nullptr;
+            const Macroblock *top = mbY > firstRow ? &mbs[index - mbWidth] : nullptr;
+            auto lumaNc = [&](int raster) {
+                int x = raster % 4, y = raster / 4;
+                int a = x > 0 ? mb.lumaTotals[raster - 1]
+                        : left != nullptr ? left->lumaTotals[raster + 3]
+                                          : -1;
+                int b = y > 0 ? mb.lumaTotals[raster - 4]
+                        : top != nullptr ? top->lumaTotals[raster + 12]
+                                         : -1;
+                return predictCavlcNc(a, b);
+            };
+
+            bool intra16x16 = mb.type == MacroblockType::Intra16x16;
+            if (intra16x16) {
+                writeCavlcResidual(writer, mb.lumaDc, 16, lumaNc(0));
+            }
+            for (int block = 0; block < 16; ++block) {
+                if (mb.cbpLuma & (1 << (block / 4))) {
+                    writeCavlcResidual(writer, mb.luma[block], intra16x16 ? 15 : 16,
+                                       lumaNc(rasterIndex(block)));
+                }
+            }
+
+            if (mb.cbpChroma != 0) {
+                for (int plane = 0; plane < 2; ++plane) {
+                    writeCavlcResidual(writer, mb.chromaDc[plane], 4, -1);
+                }
+            }
+            if (mb.cbpChroma == 2) {
+                for (int plane = 0; plane < 2; ++plane) {
+                    for (int block = 0; block < 4; ++block) {
+                        int x = block & 1, y = block >> 1, i = plane * 4 + block;
+                        int a = x > 0 ? mb.chromaTotals[i - 1]
+                                : left != nullptr ? left->chromaTotals[i + 1]
+                                                  : -1;
+                        int b = y > 0 ? mb.chromaTotals[i - 2]
+                                : top != nullptr ? top->chromaTotals[i + 2]
+                                                 : -1;
+                        writeCavlcResidual(writer, mb.chromaAc[plane][block], 15,
+                                           predictCavlcNc(a, b));
+                    }
+                }
+            }
+        }
+    }
+    if (skipRun > 0) {
+        writer.writeUe(skipRun);
+    }
+    writer.writeTrailingBits();
+    frame.slices[slice] = writer.getBytes();
+}
+
+void SoftwareEncoder::finishFrame(Frame &frame) {
+    EncodedFrame encoded{frame.index, frame.idr, frame.rate.qp, {}, {}};
+    size_t prefixSize = frame.idr ? parameterSets.size() : 0;
+    size_t maxSize = prefixSize;
+    for (const std::vector<uint8_t> &slice : frame.slices) {
+        maxSize += maxNalUnitSize(slice.size());
+    }
+
+    // NAL units are written straight into the ring, so the frame is never copied
+    BitstreamSpan span;
+    uint8_t *out;
+    if (bitstream != nullptr) {
+        span = bitstream->reserve(maxSize);
+        out = span.data;
+    } else {
+        encoded.data.resize(maxSize);
+        out = encoded.data.data();
+    }
+    std::copy_n(parameterSets.data(), prefixSize, out);
+    size_t size = prefixSize;
+    for (const std::vector<uint8_t> &slice : frame.slices) {
+        size += writeNalUnit(out + size, nalRefIdc, frame.idr ? nalIdrSlice : nalSlice,
+                             slice.data(), slice.size());
+    }
+    if (bitstream != nullptr) {
+        encoded.view = bitstream->commit(span, size);
+    } else {
+        encoded.data.resize(size);
+        encoded.view.data = encoded.data.data();
+        encoded.view.size = size;
+    }
+
+    rateController.endFrame(size * 8);
+    if (!stopping) {
+        output(encoded);
+    } else if (bitstream != nullptr) {
+        bitstream->release(encoded.view);
+    }
+    if (qualityMeter) {
+        PendingQuality &pending = pendingQuality[frame.index];
+        pending.quality.bits = size * 8;
+        pending.sized = true;
+        completeQuality();
+    }
+
+    const EncoderMetrics &metrics = getEncoderMetrics();
+    metrics.frames.add();
+    metrics.bytes.add(size);
+    metrics.queueDepth.add(-1.0);
+    metrics.latencySeconds.observe(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - frame.queueTime).count());
+
+    // The frame is the oldest, since frames are coded one at a time
+    frame.source = YuvFrame();
+    spareFrames.push_back(std::move(frames.front()));
+    frames.pop_front();
+    stateCondition.notify_all();
+    schedule();
+}
+
+void SoftwareEncoder::writeParameterSets() {
+    const RateControlConfig &rate = rateController.getConfig();
+    const uint32_t frameSize = mbWidth * mbHeight;
+    const double frameRate =
+        static_cast<double>(rate.frameRateNumerator) / std::max(rate.frameRateDenominator, 1u);
+    const uint32_t bitrate =
+        rate.mode == RateControlMode::Vbr ? rate.maxBitrate : rate.bitrate;
+    int levelIdc = levels[std::size(levels) - 1].idc;
+    for (const Level &level : levels) {
+        // Neither dimension may exceed sqrt(8 * MaxFS) macroblocks
+        if (frameSize <= level.maxFs && frameSize * frameRate <= level.maxMbps &&
+            mbWidth * mbWidth <= 8 * level.maxFs && mbHeight * mbHeight <= 8 * level.maxFs &&
+            (rate.mode == RateControlMode::ConstantQp ||
+             bitrate <= level.maxBitrate * 1000ull)) {
+            levelIdc = level.idc;
+            break;
+        }
+    }
+
+    // seq_parameter_set_rbsp: Constrained Baseline, POC type 2, one reference frame
+    BitWriter sps;
+    sps.writeBits(66, 8);   // profile_idc
+    sps.writeBits(0xC0, 8); // constraint_set0_flag, constraint_set1_flag
+    sps.writeBits(static_cast<uint32_t>(levelIdc), 8);
+    sps.writeUe(0); // seq_parameter_set_id
+    sps.writeUe(0); // log2_max_frame_num_minus4
+    sps.writeUe(2); // pic_order_cnt_type
+    sps.writeUe(1); // max_num_ref_frames
+    sps.writeBit(false); // gaps_in_frame_num_value_allowed_flag
+    sps.writeUe(mbWidth - 1);
+    sps.writeUe(mbHeight - 1);
+    sps.writeBit(true); // frame_mbs_only_flag
+    sps.writeBit(true); // direct_8x8_inference_flag
+    uint32_t cropRight = (mbWidth * 16 - config.width) / 2;
+    uint32_t cropBottom = (mbHeight * 16 - config.height) / 2;
+    sps.writeBit(cropRight != 0 || cropBottom != 0);
+    if (cropRight != 0 || cropBottom != 0) {
+        sps.writeUe(0);
+        sps.writeUe(cropRight);
+        sps.writeUe(0);
+        sps.writeUe(cropBottom);
+    }
+
+    // vui_parameters: only timing_info, so players time frames by the configured frame rate
+    // rather than the wall clock the frames were coded at. A frame lasts two ticks
+    sps.writeBit(true);  // vui_parameters_present_flag
+    sps.writeBit(false); // aspect_ratio_info_present_flag
+    sps.writeBit(false); // overscan_info_present_flag
+    sps.writeBit(false); // video_signal_type_present_flag
+    sps.writeBit(false); // chroma_loc_info_present_flag
+    sps.writeBit(true);  // timing_info_present_flag
+    uint32_t numUnitsInTick = std::max(rate.frameRateDenominator, 1u);
+    uint32_t timeScale = rate.frameRateNumerator * 2;
+    sps.writeBits(numUnitsInTick, 32);
+    sps.writeBits(timeScale, 32);
+    sps.writeBit(true);  // fixed_frame_rate_flag
+    sps.writeBit(false); // nal_hrd_parameters_present_flag
+    sps.writeBit(false); // vcl_hrd_parameters_present_flag
+    sps.writeBit(false); // pic_struct_present_flag
+    sps.writeBit(false); // bitstream_restriction_flag
+    sps.writeTrailingBits();
+
+    // pic_parameter_set_rbsp: CAVLC, one active reference, deblocking control present
+    BitWriter pps;
+    pps.writeUe(0);       // pic_parameter_set_id
+    pps.writeUe(0);       // seq_parameter_set_id
+    pps.writeBit(false);  // entropy_coding_mode_flag
+    pps.writeBit(false);  // bottom_field_pic_order_in_frame_present_flag
+    pps.writeUe(0);       // num_slice_groups_minus1
+    pps.writeUe(0);       // num_ref_idx_l0_default_active_minus1
+    pps.writeUe(0);       // num_ref_idx_l1_default_active_minus1
+    pps.writeBit(false);  // weighted_pred_flag
+    pps.writeBits(0, 2);  // weighted_bipred_idc
+    pps.writeSe(0);       // pic_init_qp_minus26
+    pps.writeSe(0);       // pic_init_qs_minus26
+    pps.writeSe(0);       // chroma_qp_index_offset
+    pps.writeBit(true);   // deblocking_filter_control_present_flag
+    pps.writeBit(false);  // constrained_intra_pred_flag
+    pps.writeBit(false);  // redundant_pic_cnt_present_flag
+    pps.writeTrailingBits();
+
+    parameterSets.clear();
+    appendNalUnit(parameterSets, nalRefIdc, nalSps, sps.getBytes().data(), sps.getBytes().size());
+    appendNalUnit(parameterSets, nalRefIdc, nalPps, pps.getBytes().data(), pps.getBytes().size());
+}
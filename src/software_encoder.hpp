@@ -0,0 +1,422 @@
+#pragma once
+#include "bitstream_ring.hpp"
+#include "motion_search.hpp"
+#include "quality_meter.hpp"
+#include "rate_control.hpp"
+#include "thread_pool.hpp"
+#include "yuv_frame.hpp"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/**
+ * @struct SoftwareEncoderConfig
+ * @brief Configuration options for a SoftwareEncoder
+ */
+struct SoftwareEncoderConfig {
+    /// @brief Width of the pictures in pixels (set from the renderer by VulkanEncoder)
+    uint32_t width = 0;
+
+    /// @brief Height of the pictures in pixels (set from the renderer by VulkanEncoder)
+    uint32_t height = 0;
+
+    /// @brief Slices per frame, coded concurrently. Clamped to the number of macroblock rows
+    uint32_t slices = 1;
+
+    /// @brief Distance between IDR frames, in frames
+    uint32_t idrPeriod = 120;
+
+    /// @brief Motion search preset. Only 16x16 partitions are coded, so partition search is
+    /// disabled whatever the preset
+    MotionPreset motionPreset = MotionPreset::Fast;
+
+    /// @brief Frames that may be queued or in flight before encodeFrame blocks. Raised to the
+    /// rate control lookahead plus two if lower
+    uint32_t maxFramesInFlight = 4;
+
+    /// @brief Measures the PSNR and SSIM of each coded frame against its source, if set
+    std::optional<QualityConfig> quality;
+};
+
+/**
+ * @struct EncodedFrame
+ * @brief One coded access unit
+ */
+struct EncodedFrame {
+    /// @brief Index of the frame in coding (and display) order
+    uint64_t frameIndex;
+
+    /// @brief Whether the frame is an IDR picture, preceded by the SPS and PPS
+    bool idr;
+
+    /// @brief QP the frame was coded with
+    int qp;
+
+    /// @brief The access unit in Annex B format, when the encoder has no bitstream ring
+    std::vector<uint8_t> data;
+
+    /// @brief The access unit's bytes, in the bitstream ring or in "data"
+    BitstreamView view;
+};
+
+/**
+ * @class SoftwareEncoder
+ * @brief H.264 Constrained Baseline encoder running on a thread pool
+ *
+ * Frames are coded as IDR or P pictures with CAVLC, one reference frame and the deblocking
+ * filter disabled. Macroblocks are coded as P_Skip, P_L0_16x16, I_NxN (Intra 4x4) or
+ * I_16x16, with DC chroma prediction.
+ *
+ * Each frame is split into slices of whole macroblock rows, which do not predict from each
+ * other, and passes through three stages, each running one task per slice on the pool:
+ * - analysis: motion search against the reconstruction of the previous frame
+ * - coding: mode decision, transform, quantisation and reconstruction, keeping the levels
+ * - entropy coding: CAVLC of the kept levels into one NAL unit per slice
+ *
+ * As soon as a frame is reconstructed, its half-pel reference planes are interpolated and the
+ * next frame's analysis starts, while the frame is still being entropy coded. A frame is coded
+ * once the previous one has been entropy coded, whose size the rate controller needs.
+ *
+ * encodeFrame() only queues a frame and schedules whatever work is ready, so it returns at
+ * once unless maxFramesInFlight frames are already queued. Tasks never wait on other tasks,
+ * so one pool can be shared by the encoders of many sessions.
+ *
+ * With quality measurement enabled, each reconstructed frame is compared with its source by
+ * one more task, alongside entropy coding. Output does not wait for it; only the coding of the
+ * frame two later, which overwrites the reconstruction, does.
+ */
+class SoftwareEncoder {
+  public:
+    /**
+     * @brief Receives coded frames, in coding order, on a worker thread
+     *
+     * Must not call back into the encoder
+     */
+    using OutputCallback = std::function<void(const EncodedFrame &)>;
+
+    /**
+     * @brief Creates an encoder
+     * @param config Encoder options
+     * @param rateControlConfig Rate control options
+     * @param pool Pool the encoding tasks run on, which must outlive the encoder
+     * @param output Receives the coded frames
+     * @param bitstream Ring the access units are written into, which must outlive the encoder.
+     * Each frame is committed before it is output and its view is released by the owner of
+     * the ring. Without a ring, each frame is written into its own vector
+     * @throws std::runtime_error if the picture size is zero
+     */
+    SoftwareEncoder(const SoftwareEncoderConfig &config,
+                    const RateControlConfig &rateControlConfig, ThreadPool &pool,
+                    OutputCallback output, BitstreamRing *bitstream = nullptr);
+
+    /**
+     * @brief Waits for running tasks; frames not yet coded are discarded
+     */
+    ~SoftwareEncoder();
+
+    SoftwareEncoder(const SoftwareEncoder &) = delete;
+    SoftwareEncoder &operator=(const SoftwareEncoder &) = delete;
+
+    /**
+     * @brief Queues a frame for encoding
+     *
+     * Blocks only while maxFramesInFlight frames are queued. Must not be called concurrently
+     * with itself or flush()
+     *
+     * @param frame The frame, allocated for the configured picture size
+     * @throws std::runtime_error if the frame has the wrong size, or the first error raised
+     * by an encoding task
+     */
+    void encodeFrame(YuvFrame frame);
+
+    /**
+     * @brief Codes every queued frame and waits until all have been output
+     * @throws The first error raised by an encoding task
+     */
+    void flush();
+
+    /**
+     * @brief Returns the number of slices per frame
+     */
+    uint32_t getSliceCount() const;
+
+  protected:
+    /**
+     * @enum MacroblockType
+     * @brief Coding mode of a macroblock
+     */
+    enum class MacroblockType : uint8_t { Skip, Inter, Intra4x4, Intra16x16 };
+
+    /**
+     * @struct Macroblock
+     * @brief Decisions and quantised levels of a coded macroblock, kept for entropy coding
+     *
+     * Levels are stored in scan order. Blocks are indexed in raster order within the
+     * macroblock (or within a chroma component), except the luma levels, which are indexed in
+     * the bitstream's 8x8-then-4x4 block order
+     */
+    struct Macroblock {
+        /// @brief Coding mode
+        MacroblockType type = MacroblockType::Skip;
+
+        /// @brief Intra 16x16 prediction mode
+        uint8_t intra16x16Mode = 0;
+
+        /// @brief coded_block_pattern luma bits (one per 8x8 block) and chroma value (0 to 2)
+        uint8_t cbpLuma = 0;
+        uint8_t cbpChroma = 0;
+
+        /// @brief Intra 4x4 mode of each 4x4 block (raster order), for mode prediction
+        std::array<uint8_t, 16> intra4x4Modes = {};
+
+        /// @brief Signalled Intra 4x4 mode of each block (bitstream order): -1 when the
+        /// predicted mode is used, otherwise rem_intra4x4_pred_mode
+        std::array<int8_t, 16> intra4x4Codes = {};
+
+        /// @brief Motion vector (also of skipped macroblocks) and its coded difference
+        MotionVector mv;
+        MotionVector mvd;
+
+        /// @brief TotalCoeff of each luma 4x4 block (raster order), from which nC is predicted
+        std::array<uint8_t, 16> lumaTotals = {};
+
+        /// @brief TotalCoeff of each chroma AC block, Cb then Cr (raster order)
+        std::array<uint8_t, 8> chromaTotals = {};
+
+        /// @brief Intra 16x16 luma DC levels
+        int16_t lumaDc[16];
+
+        /// @brief Luma levels of each 4x4 block (AC blocks of Intra 16x16 use the first 15)
+        int16_t luma[16][16];
+
+        /// @brief Chroma DC levels of Cb and Cr
+        int16_t chromaDc[2][4];
+
+        /// @brief Chroma AC levels of Cb and Cr
+        int16_t chromaAc[2][4][15];
+    };
+
+    /**
+     * @class SliceCoder
+     * @brief Codes the macroblocks of one slice (defined with the encoder's source)
+     */
+    class SliceCoder;
+
+    /**
+     * @enum FrameStage
+     * @brief Progress of a frame through the pipeline
+     */
+    enum class FrameStage { Queued, Analysing, Analysed, Coding, EntropyCoding };
+
+    /**
+     * @struct Frame
+     * @brief A frame in the pipeline
+     */
+    struct Frame {
+        /// @brief Index of the frame in coding order
+        uint64_t index = 0;
+
+        /// @brief Whether the frame is coded as an IDR picture
+        bool idr = false;
+
+        /// @brief frame_num of the slice headers
+        uint32_t frameNum = 0;
+
+        /// @brief idr_pic_id of the slice headers (IDR pictures only)
+        uint32_t idrPicId = 0;
+
+        /// @brief Complexity estimate passed to the rate controller
+        double complexity = 0.0;
+
+        /// @brief Rate control decision of the frame
+        RateDecision rate = {};
+
+        /// @brief Source picture
+        YuvFrame source;
+
+        /// @brief Reconstruction the frame is coded into
+        YuvFrame *reconstruction = nullptr;
+
+        /// @brief Coded macroblocks, in raster order
+        std::vector<Macroblock> macroblocks;
+
+        /// @brief RBSP of each slice
+        std::vector<std::vector<uint8_t>> slices;
+
+        /// @brief Pipeline stage
+        FrameStage stage = FrameStage::Queued;
+
+        /// @brief Tasks of the current stage still running
+        uint32_t pendingTasks = 0;
+
+        /// @brief Time the frame was queued at
+        std::chrono::steady_clock::time_point queueTime;
+    };
+
+    /// @brief Encoder options
+    SoftwareEncoderConfig config;
+
+    /// @brief Pool the tasks run on
+    ThreadPool &pool;
+
+    /// @brief Receives the coded frames
+    OutputCallback output;
+
+    /// @brief Ring the access units are written into, or null
+    BitstreamRing *bitstream;
+
+    /// @brief Width and height of the frames in macroblocks
+    uint32_t mbWidth;
+    uint32_t mbHeight;
+
+    /// @brief First macroblock row of each slice, followed by the number of rows
+    std::vector<uint32_t> sliceRows;
+
+    /// @brief Sequence and picture parameter sets, emitted before every IDR picture
+    std::vector<uint8_t> parameterSets;
+
+    /// @brief Decides the QP of each frame. Guarded by stateMutex
+    RateController rateController;
+
+    /// @brief Motion search of the frame being analysed
+    MotionSearch motionSearch;
+
+    /// @brief Interpolated reconstruction of the last coded frame
+    ReferenceFrame reference;
+
+    /// @brief Index of the frame the reference was built from, or -1 if none
+    int64_t referenceIndex = -1;
+
+    /// @brief Reconstructions of the last two frames, alternately written
+    std::array<YuvFrame, 2> reconstructions;
+
+    /// @brief Frames queued or in flight, oldest first
+    std::deque<std::unique_ptr<Frame>> frames;
+
+    /// @brief Frames that have been output, kept to reuse their storage
+    std::vector<std::unique_ptr<Frame>> spareFrames;
+
+    /**
+     * @struct PendingQuality
+     * @brief Quality of a frame that has not been both measured and output
+     */
+    struct PendingQuality {
+        /// @brief The frame's quality so far
+        FrameQuality quality;
+
+        /// @brief Whether the metrics and the size have been filled in
+        bool measured = false;
+        bool sized = false;
+    };
+
+    /// @brief Measures the quality of coded frames, or null if disabled
+    std::unique_ptr<QualityMeter> qualityMeter;
+
+    /// @brief Frames whose quality is not yet complete, by index
+    std::map<uint64_t, PendingQuality> pendingQuality;
+
+    /// @brief Whether each reconstruction is being measured, so must not be coded into yet
+    std::array<bool, 2> measuringReconstruction = {};
+
+    /// @brief Luma of the last queued frame, for its successor's complexity estimate
+    std::vector<uint8_t> previousLuma;
+
+    /// @brief Number of frames queued so far
+    uint64_t framesQueued = 0;
+
+    /// @brief Number of frames passed to the rate controller so far, and of those not yet begun.
+    /// Frames are passed no further ahead than the lookahead, so that the decisions do not
+    /// depend on how far the caller has run ahead of the encoder
+    uint64_t framesRated = 0;
+    uint32_t framesAwaitingRate = 0;
+
+    /// @brief frame_num and idr_pic_id of the next frame
+    uint32_t nextFrameNum = 0;
+    uint32_t nextIdrPicId = 0;
+
+    /// @brief QP of the last frame begun, which weights the next frame's motion search
+    int lastQp;
+
+    /// @brief Whether queued frames are being flushed, so the lookahead need not be full
+    bool flushing = false;
+
+    /// @brief Whether the encoder is being destroyed, so no further work is scheduled
+    bool stopping = false;
+
+    /// @brief Tasks submitted to the pool that have not finished
+    uint32_t activeTasks = 0;
+
+    /// @brief First error raised by a task
+    std::exception_ptr error;
+
+    /// @brief Guards the pipeline state
+    std::mutex stateMutex;
+
+    /// @brief Signalled when a frame is output, a task finishes or an error occurs
+    std::condition_variable stateCondition;
+
+    /**
+     * @brief Starts every stage whose inputs are ready. Called with stateMutex held
+     */
+    void schedule();
+
+    /**
+     * @brief Submits one task per slice of a stage; the last to finish calls "done"
+     *
+     * Called with stateMutex held. "work" runs without the lock, "done" with it
+     *
+     * @param frame The frame the tasks work on
+     * @param work Work on one slice
+     * @param done Completes the stage
+     */
+    void runSlices(Frame &frame, std::function<void(Frame &, uint32_t)> work,
+                   std::function<void(Frame &)> done);
+
+    /**
+     * @brief Submits a task. Called with stateMutex held
+     * @param task Work run without the lock
+     * @param done Run with the lock once the task succeeds
+     */
+    void submit(std::function<void()> task, std::function<void()> done);
+
+    /**
+     * @brief Finishes a coded frame: assembles, rate-controls and outputs its access unit
+     */
+    void finishFrame(Frame &frame);
+
+    /**
+     * @brief Submits the quality measurement of a frame that has just been coded. Called with
+     * stateMutex held; takes over the frame's source
+     */
+    void measureQuality(Frame &frame);
+
+    /**
+     * @brief Adds the quality of the oldest frames that have been both measured and output to
+     * the meter. Called with stateMutex held
+     */
+    void completeQuality();
+
+    /**
+     * @brief Codes the macroblocks of one slice and reconstructs them
+     */
+    void codeSlice(Frame &frame, uint32_t slice);
+
+    /**
+     * @brief Writes the NAL unit payload of one slice
+     */
+    void writeSlice(Frame &frame, uint32_t slice);
+
+    /**
+     * @brief Writes the SPS and PPS of the stream into parameterSets
+     */
+    void writeParameterSets();
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free FIFO between exactly one producer thread and one consumer thread
+ *
+ * Items are copied into a ring of fixed capacity. Each side only writes its own index, and the
+ * indices live on separate cache lines, so push and pop never contend on a line the other side
+ * is writing.
+ *
+ * @tparam T Type of the items, which must be copy-assignable
+ * @tparam Capacity Number of slots, a power of two
+ */
+template <typename T, size_t Capacity> class SpscQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+  public:
+    /**
+     * @brief Appends an item; producer thread only
+     * @return false if the queue is full, in which case the item is not added
+     */
+    bool push(const T &item) {
+        size_t tail = writeIndex.load(std::memory_order_relaxed);
+        if (tail - readIndex.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots[tail & (Capacity - 1)] = item;
+        writeIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item; consumer thread only
+     * @param item Receives the item
+     * @return false if the queue is empty
+     */
+    bool pop(T &item) {
+        size_t head = readIndex.load(std::memory_order_relaxed);
+        if (head == writeIndex.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[head & (Capacity - 1)];
+        readIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+  protected:
+    /// @brief Index of the next slot to write, advanced by the producer
+    alignas(64) std::atomic<size_t> writeIndex{0};
+
+    /// @brief Index of the next slot to read, advanced by the consumer
+    alignas(64) std::atomic<size_t> readIndex{0};
+
+    /// @brief The ring of items
+    alignas(64) std::array<T, Capacity> slots{};
+};
@@ -0,0 +1,64 @@
+#include "staging_ring.hpp"
+
+StagingRing::StagingRing(size_t capacity) : capacity(capacity) {}
+
+std::optional<size_t> StagingRing::allocate(size_t size, size_t alignment) {
+    if (size == 0 || size > capacity) {
+        return std::nullopt;
+    }
+
+    // Everything has been reclaimed, so start again from the beginning of the buffer
+    if (used == 0) {
+        head = 0;
+        tail = 0;
+    } else if (head == tail) {
+        return std::nullopt;
+    }
+
+    size_t offset = (head + alignment - 1) & ~(alignment - 1);
+    size_t consumed = 0;
+    if (head >= tail) {
+        // The free space runs from head to the end of the buffer, then from its start to tail
+        if (offset + size <= capacity) {
+            consumed = offset + size - head;
+        } else if (size <= tail) {
+            consumed = capacity - head + size;
+            offset = 0;
+        } else {
+            return std::nullopt;
+        }
+    } else if (offset + size <= tail) {
+        consumed = offset + size - head;
+    } else {
+        return std::nullopt;
+    }
+
+    head = (offset + size) % capacity;
+    used += consumed;
+    pendingBytes += consumed;
+    return offset;
+}
+
+void StagingRing::retire(uint64_t value) {
+    if (pendingBytes == 0) {
+        return;
+    }
+    batches.push_back({head, pendingBytes, value});
+    pendingBytes = 0;
+}
+
+void StagingRing::reclaim(uint64_t completedValue) {
+    while (!batches.empty() && batches.front().value <= completedValue) {
+        used -= batches.front().bytes;
+        tail = batches.front().end;
+        batches.pop_front();
+    }
+}
+
+size_t StagingRing::getCapacity() const {
+    return capacity;
+}
+
+size_t StagingRing::getUsed() const {
+    return used;
+}
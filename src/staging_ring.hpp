@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+/**
+ * @class StagingRing
+ * @brief Allocator of regions of a fixed-size staging buffer, reclaimed by timeline value
+ *
+ * Regions are allocated one after another and wrap around to the start of the buffer. The
+ * regions allocated since the last retire() form a batch, which is tagged with the timeline
+ * value of the submission that reads them. Once the device has completed that value, the
+ * batch's space is reclaimed. The ring never allocates host or device memory after
+ * construction; an allocation that does not fit fails and is retried once batches complete.
+ * The ring only hands out offsets: the caller owns the buffer and its mapping
+ */
+class StagingRing {
+  public:
+    /**
+     * @brief Creates an empty ring
+     * @param capacity Size of the staging buffer in bytes
+     */
+    explicit StagingRing(size_t capacity);
+
+    /**
+     * @brief Allocates a region for the current batch
+     * @param size Size of the region in bytes
+     * @param alignment Alignment of the region's offset, a power of two
+     * @return Offset of the region, or nullopt if it does not fit until batches complete
+     */
+    std::optional<size_t> allocate(size_t size, size_t alignment);
+
+    /**
+     * @brief Closes the current batch
+     * @param value Timeline value signalled once the device has read the batch's regions
+     */
+    void retire(uint64_t value);
+
+    /**
+     * @brief Reclaims the space of every batch whose timeline value has completed
+     * @param completedValue Timeline value the device has completed
+     */
+    void reclaim(uint64_t completedValue);
+
+    /**
+     * @brief Returns the size of the staging buffer in bytes
+     */
+    size_t getCapacity() const;
+
+    /**
+     * @brief Returns the bytes in use by regions and the padding between them
+     */
+    size_t getUsed() const;
+
+  protected:
+    /**
+     * @struct Batch
+     * @brief Regions read by one submission
+     */
+    struct Batch {
+        /// @brief Offset just past the batch's last region, where the ring's free space starts
+        /// once the batch is reclaimed
+        size_t end = 0;
+
+        /// @brief Bytes the batch occupies, including padding and skipped space at the end
+        size_t bytes = 0;
+
+        /// @brief Timeline value after which the regions may be overwritten
+        uint64_t value = 0;
+    };
+
+    /// @brief Size of the staging buffer in bytes
+    size_t capacity;
+
+    /// @brief Offset the next region is allocated from
+    size_t head = 0;
+
+    /// @brief Offset of the oldest region in use
+    size_t tail = 0;
+
+    /// @brief Bytes in use, which tells a full ring from an empty one when head == tail
+    size_t used = 0;
+
+    /// @brief Bytes allocated since the last retire()
+    size_t pendingBytes = 0;
+
+    /// @brief Retired batches awaiting completion, oldest first
+    std::deque<Batch> batches;
+};
@@ -0,0 +1,550 @@
+#include "texture_uploader.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+/// @brief Format of every texture: four bytes per pixel, in the order they are given
+constexpr VkFormat textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+/**
+ * @struct UploadMetrics
+ * @brief Metrics shared by every texture uploader
+ */
+struct UploadMetrics {
+    Counter &bytes;
+    Gauge &pending;
+};
+
+const UploadMetrics &getUploadMetrics() {
+    static const UploadMetrics metrics = [] {
+        MetricsRegistry &registry = MetricsRegistry::getDefault();
+        return UploadMetrics{
+            registry.getCounter("vulkantest_texture_upload_bytes_total",
+                                "Bytes of texture data copied to the device"),
+            registry.getGauge("vulkantest_texture_upload_pending_bytes",
+                              "Bytes of texture data queued and not yet copied")};
+    }();
+    return metrics;
+}
+
+/**
+ * @brief Returns a barrier covering every mip level of a texture's colour
+ */
+VkImageMemoryBarrier makeTextureBarrier(VkImage image, uint32_t mipLevels) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+} // namespace
+
+TextureUploader::TextureUploader(std::shared_ptr<VulkanContext> context,
+                                 const TextureUploadConfig &config)
+    : context(context), device(context->getDevice()), config(config),
+      staging(config.stagingSize), freeBatches(std::max(config.batchesInFlight, 1u)) {
+    if (!context->isTimelineSemaphoreSupported()) {
+        throw std::runtime_error("texture uploads require timeline semaphores");
+    }
+
+    const VulkanContext::QueueFamilyIndices &families = context->getQueueFamilies();
+    graphicsFamily = families.graphicsFamily.value();
+    copyFamily = context->getTransferQueue() != VK_NULL_HANDLE ? families.transferFamily.value()
+                                                                : graphicsFamily;
+
+    // Both limits are powers of two, and copies of four-byte texels need four-byte offsets
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context->getPhysicalDevice(), &properties);
+    copyAlignment = std::max<size_t>(properties.limits.optimalBufferCopyOffsetAlignment, 4);
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(context->getPhysicalDevice(), textureFormat,
+                                        &formatProperties);
+    linearBlit = (formatProperties.optimalTilingFeatures &
+                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+    if (!linearBlit) {
+        LOG_WARN("Device cannot filter textures linearly, downsampling mips by point sampling");
+    }
+
+    // A partially built uploader is not destroyed by the destructor, so clean up here
+    try {
+        context->createBuffer(config.stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              stagingBuffer, stagingMemory);
+
+        void *mapped = nullptr;
+        if (vkMapMemory(device, stagingMemory, 0, config.stagingSize, 0, &mapped) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map texture staging buffer");
+        }
+        stagingMapped = static_cast<uint8_t *>(mapped);
+
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = copyFamily;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &copyCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture upload command pool");
+        }
+        if (copyFamily != graphicsFamily) {
+            poolInfo.queueFamilyIndex = graphicsFamily;
+            if (vkCreateCommandPool(device, &poolInfo, nullptr, &mipCommandPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create mip generation command pool");
+            }
+        }
+
+        batches.resize(std::max(config.batchesInFlight, 1u));
+        for (Batch &batch : batches) {
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = copyCommandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(device, &allocInfo, &batch.copyCommands) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate texture upload command buffer");
+            }
+            if (mipCommandPool != VK_NULL_HANDLE) {
+                allocInfo.commandPool = mipCommandPool;
+                if (vkAllocateCommandBuffers(device, &allocInfo, &batch.mipCommands) !=
+                    VK_SUCCESS) {
+                    throw std::runtime_error("failed to allocate mip generation command buffer");
+                }
+            }
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &copyTimeline) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture upload timeline semaphores");
+        }
+    } catch (...) {
+        release();
+        throw;
+    }
+
+    LOG_INFO("Texture uploader created (" + std::to_string(config.stagingSize >> 20) +
+             " MiB staging ring, " + (usesTransferQueue() ? "transfer" : "graphics") +
+             " queue).");
+}
+
+TextureUploader::~TextureUploader() {
+    waitIdle();
+    release();
+}
+
+uint32_t TextureUploader::createTexture(uint32_t width, uint32_t height, const uint8_t *rgba,
+                                        bool mipmapped) {
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("texture size must not be zero");
+    }
+    if (static_cast<size_t>(width) * 4 > config.stagingSize) {
+        throw std::runtime_error("texture rows do not fit in the staging ring");
+    }
+
+    Texture texture;
+    texture.extent = {width, height};
+    texture.pixels = rgba;
+    if (mipmapped) {
+        for (uint32_t size = std::max(width, height); size > 1; size /= 2) {
+            ++texture.mipLevels;
+        }
+    }
+
+    context->createImage(width, height, textureFormat,
+                         VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                             VK_IMAGE_USAGE_SAMPLED_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.memory,
+                         texture.mipLevels);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = texture.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = textureFormat;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = texture.mipLevels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &texture.view) != VK_SUCCESS) {
+        vkDestroyImage(device, texture.image, nullptr);
+        vkFreeMemory(device, texture.memory, nullptr);
+        throw std::runtime_error("failed to create texture image view");
+    }
+
+    uint32_t handle = static_cast<uint32_t>(textures.size());
+    textures.push_back(texture);
+    queued.push_back(handle);
+
+    size_t bytes = static_cast<size_t>(width) * height * 4;
+    pendingBytes += bytes;
+    getUploadMetrics().pending.add(static_cast<double>(bytes));
+    return handle;
+}
+
+bool TextureUploader::isReady(uint32_t texture) const {
+    uint64_t readyValue = textures.at(texture).readyValue;
+    return readyValue != 0 && readyValue <= getCompletedValue(timeline);
+}
+
+VkImageView TextureUploader::getView(uint32_t texture) const {
+    return textures.at(texture).view;
+}
+
+uint32_t TextureUploader::getMipLevels(uint32_t texture) const {
+    return textures.at(texture).mipLevels;
+}
+
+size_t TextureUploader::flush() {
+    if (queued.empty()) {
+        return 0;
+    }
+    TRACE_SCOPE("texture upload");
+
+    staging.reclaim(getCompletedValue(copyTimeline));
+    int32_t batchIndex = freeBatches.acquire(getCompletedValue(timeline));
+    if (batchIndex < 0) {
+        return 0;
+    }
+    Batch &batch = batches[batchIndex];
+    bool transfer = usesTransferQueue();
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(batch.copyCommands, 0);
+    if (vkBeginCommandBuffer(batch.copyCommands, &beginInfo) != VK_SUCCESS) {
+        freeBatches.release(batchIndex, 0);
+        throw std::runtime_error("failed to begin texture upload command buffer");
+    }
+
+    // Copy whole rows of the oldest textures until the budget or the ring runs out. Rows that
+    // do not fit in the ring are halved, so the space before its end is used too
+    size_t copied = 0;
+    finishedTextures.clear();
+    while (!queued.empty() && copied < config.frameBudget) {
+        Texture &texture = textures[queued.front()];
+        size_t rowBytes = static_cast<size_t>(texture.extent.width) * 4;
+        size_t rows = std::min<size_t>(texture.extent.height - texture.copiedRows,
+                                       std::max<size_t>((config.frameBudget - copied) / rowBytes,
+                                                        1));
+
+        std::optional<size_t> offset;
+        while (rows > 0 && !(offset = staging.allocate(rows * rowBytes, copyAlignment))) {
+            rows /= 2;
+        }
+        if (!offset) {
+            break;
+        }
+
+        if (texture.copiedRows == 0) {
+            VkImageMemoryBarrier barrier = makeTextureBarrier(texture.image, texture.mipLevels);
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            vkCmdPipelineBarrier(batch.copyCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                                 &barrier);
+        }
+
+        std::memcpy(stagingMapped + *offset, texture.pixels + texture.copiedRows * rowBytes,
+                    rows * rowBytes);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = *offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, static_cast<int32_t>(texture.copiedRows), 0};
+        region.imageExtent = {texture.extent.width, static_cast<uint32_t>(rows), 1};
+        vkCmdCopyBufferToImage(batch.copyCommands, stagingBuffer, texture.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        texture.copiedRows += static_cast<uint32_t>(rows);
+        copied += rows * rowBytes;
+        if (texture.copiedRows == texture.extent.height) {
+            finishedTextures.push_back(queued.front());
+            queued.pop_front();
+        }
+    }
+
+    if (copied == 0) {
+        vkEndCommandBuffer(batch.copyCommands);
+        freeBatches.release(batchIndex, 0);
+        return 0;
+    }
+
+    // With a transfer queue, finished textures are released to the graphics queue, which
+    // acquires them once the copies have completed and generates their mips. Otherwise the
+    // mips are generated in the same command buffer as the copies
+    VkCommandBuffer mipCommands = batch.copyCommands;
+    if (transfer) {
+        for (uint32_t handle : finishedTextures) {
+            const Texture &texture = textures[handle];
+            VkImageMemoryBarrier barrier = makeTextureBarrier(texture.image, texture.mipLevels);
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = copyFamily;
+            barrier.dstQueueFamilyIndex = graphicsFamily;
+            vkCmdPipelineBarrier(batch.copyCommands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+                                 1, &barrier);
+        }
+        if (vkEndCommandBuffer(batch.copyCommands) != VK_SUCCESS) {
+            freeBatches.release(batchIndex, 0);
+            throw std::runtime_error("failed to record texture upload command buffer");
+        }
+        submitCopies(batch.copyCommands);
+        staging.retire(copyValue);
+
+        if (!finishedTextures.empty()) {
+            mipCommands = batch.mipCommands;
+            vkResetCommandBuffer(mipCommands, 0);
+            if (vkBeginCommandBuffer(mipCommands, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin mip generation command buffer");
+            }
+            for (uint32_t handle : finishedTextures) {
+                const Texture &texture = textures[handle];
+                VkImageMemoryBarrier barrier =
+                    makeTextureBarrier(texture.image, texture.mipLevels);
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.srcQueueFamilyIndex = copyFamily;
+                barrier.dstQueueFamilyIndex = graphicsFamily;
+                vkCmdPipelineBarrier(mipCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                                     &barrier);
+            }
+        }
+    }
+
+    for (uint32_t handle : finishedTextures) {
+        recordMipChain(mipCommands, textures[handle]);
+    }
+
+    if (!transfer) {
+        if (vkEndCommandBuffer(batch.copyCommands) != VK_SUCCESS) {
+            freeBatches.release(batchIndex, 0);
+            throw std::runtime_error("failed to record texture upload command buffer");
+        }
+        submitCopies(batch.copyCommands);
+        staging.retire(copyValue);
+    } else if (!finishedTextures.empty()) {
+        if (vkEndCommandBuffer(mipCommands) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record mip generation command buffer");
+        }
+        submitMips(mipCommands);
+    } else {
+        // No texture was finished, but the batch is still released on the graphics queue's
+        // timeline, which an empty submission signals once the copies have completed
+        submitMips(VK_NULL_HANDLE);
+    }
+
+    for (uint32_t handle : finishedTextures) {
+        textures[handle].readyValue = timelineValue;
+        textures[handle].pixels = nullptr;
+    }
+    freeBatches.release(batchIndex, timelineValue);
+
+    pendingBytes -= copied;
+    getUploadMetrics().bytes.add(copied);
+    getUploadMetrics().pending.add(-static_cast<double>(copied));
+    return copied;
+}
+
+size_t TextureUploader::getPendingBytes() const {
+    return pendingBytes;
+}
+
+bool TextureUploader::usesTransferQueue() const {
+    return copyFamily != graphicsFamily;
+}
+
+void TextureUploader::waitIdle() const {
+    if (timeline == VK_NULL_HANDLE || timelineValue == 0) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &timelineValue;
+
+    if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+        throw std::runtime_error("failed to wait for texture uploads");
+    }
+}
+
+uint64_t TextureUploader::getCompletedValue(VkSemaphore semaphore) const {
+    uint64_t value = 0;
+    if (vkGetSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS) {
+        throw std::runtime_error("failed to read texture upload timeline value");
+    }
+    return value;
+}
+
+void TextureUploader::submitCopies(VkCommandBuffer commandBuffer) {
+    bool transfer = usesTransferQueue();
+    VkSemaphore signalSemaphores[] = {copyTimeline, timeline};
+    uint64_t signalValues[] = {copyValue + 1, timelineValue + 1};
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = transfer ? 1 : 2;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = transfer ? 1 : 2;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+
+    VkResult result = transfer ? context->submitTransfer(submitInfo, VK_NULL_HANDLE)
+                               : context->submit(submitInfo, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit texture uploads");
+    }
+    copyValue = signalValues[0];
+    if (!transfer) {
+        timelineValue = signalValues[1];
+    }
+}
+
+void TextureUploader::submitMips(VkCommandBuffer commandBuffer) {
+    uint64_t signalValue = timelineValue + 1;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &copyValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &copyTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = commandBuffer != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline;
+
+    if (context->submit(submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit mip generation");
+    }
+    timelineValue = signalValue;
+}
+
+void TextureUploader::recordMipChain(VkCommandBuffer commandBuffer,
+                                     const Texture &texture) const {
+    // Each level is downsampled from the one above it, which is then ready to be sampled
+    VkImageMemoryBarrier barrier = makeTextureBarrier(texture.image, 1);
+    int32_t width = static_cast<int32_t>(texture.extent.width);
+    int32_t height = static_cast<int32_t>(texture.extent.height);
+
+    for (uint32_t level = 1; level < texture.mipLevels; ++level) {
+        barrier.subresourceRange.baseMipLevel = level - 1;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        int32_t nextWidth = std::max(width / 2, 1);
+        int32_t nextHeight = std::max(height / 2, 1);
+
+        VkImageBlit blit = {};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.srcOffsets[1] = {width, height, 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        blit.dstOffsets[1] = {nextWidth, nextHeight, 1};
+        vkCmdBlitImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                       linearBlit ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &barrier);
+
+        width = nextWidth;
+        height = nextHeight;
+    }
+
+    barrier.subresourceRange.baseMipLevel = texture.mipLevels - 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+}
+
+void TextureUploader::release() {
+    for (const Texture &texture : textures) {
+        vkDestroyImageView(device, texture.view, nullptr);
+        vkDestroyImage(device, texture.image, nullptr);
+        vkFreeMemory(device, texture.memory, nullptr);
+    }
+    textures.clear();
+    queued.clear();
+    getUploadMetrics().pending.add(-static_cast<double>(pendingBytes));
+    pendingBytes = 0;
+
+    // Destroying the pools frees their command buffers, and freeing the memory unmaps it
+    vkDestroySemaphore(device, timeline, nullptr);
+    vkDestroySemaphore(device, copyTimeline, nullptr);
+    vkDestroyCommandPool(device, mipCommandPool, nullptr);
+    vkDestroyCommandPool(device, copyCommandPool, nullptr);
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingMemory, nullptr);
+    timeline = VK_NULL_HANDLE;
+    copyTimeline = VK_NULL_HANDLE;
+    mipCommandPool = VK_NULL_HANDLE;
+    copyCommandPool = VK_NULL_HANDLE;
+    stagingBuffer = VK_NULL_HANDLE;
+    stagingMemory = VK_NULL_HANDLE;
+    stagingMapped = nullptr;
+    batches.clear();
+}
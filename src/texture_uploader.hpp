@@ -0,0 +1,265 @@
+#pragma once
+#include "context.hpp"
+#include "staging_ring.hpp"
+#include "timeline_free_list.hpp"
+#include <deque>
+#include <memory>
+#include <vector>
+
+/**
+ * @struct TextureUploadConfig
+ * @brief Configuration options for a TextureUploader
+ */
+struct TextureUploadConfig {
+    /// @brief Size of the staging ring in bytes. A row of a texture must fit in it
+    size_t stagingSize = 64 * 1024 * 1024;
+
+    /// @brief Bytes copied per flush(), so a large upload is spread over several frames. A
+    /// flush goes over by less than a row of the texture it stops in
+    size_t frameBudget = 16 * 1024 * 1024;
+
+    /// @brief Flushes that may be in flight on the device at once
+    uint32_t batchesInFlight = 3;
+};
+
+/**
+ * @class TextureUploader
+ * @brief Streams RGBA textures into device-local, mipmapped images
+ *
+ * Textures are queued with pointers to their pixels, and each flush() copies the next part of
+ * the queue through a persistently mapped staging ring. All of a frame's copies go in one
+ * submission, on the dedicated transfer queue when the device has one. The ring is reclaimed
+ * with a timeline semaphore the copies signal, so uploads never allocate staging memory of
+ * their own.
+ *
+ * Once its last row has been copied, a texture's mip chain is generated on the graphics queue
+ * with vkCmdBlitImage (after a queue family ownership transfer, when the copies ran on the
+ * transfer queue) and the image is left in SHADER_READ_ONLY_OPTIMAL. The texture is then
+ * ready to be sampled by any later submission on the graphics queue. Every flush ends with a
+ * submission on the graphics queue that signals a second timeline, which gates the textures
+ * and command buffers. Each timeline is signalled from one queue only, so its values
+ * complete in the order they are signalled
+ */
+class TextureUploader {
+  public:
+    /**
+     * @brief Creates the staging ring, command buffers and timeline semaphores
+     * @param context The context the textures are created on
+     * @param config Upload options
+     * @throws std::runtime_error if the device lacks timeline semaphores or creation fails
+     */
+    TextureUploader(std::shared_ptr<VulkanContext> context, const TextureUploadConfig &config);
+
+    /**
+     * @brief Waits for the uploads in flight and destroys every texture
+     */
+    ~TextureUploader();
+
+    TextureUploader(const TextureUploader &) = delete;
+    TextureUploader &operator=(const TextureUploader &) = delete;
+
+    /**
+     * @brief Creates a texture and queues the upload of its pixels
+     * @param width Width of the texture in pixels
+     * @param height Height of the texture in pixels
+     * @param rgba Pixels of the texture, four bytes each, row by row. They are read by later
+     * flushes, so they must stay valid until the texture is ready
+     * @param mipmapped Whether to generate a full mip chain
+     * @return Handle of the texture
+     * @throws std::runtime_error if a row does not fit in the staging ring or creation fails
+     */
+    uint32_t createTexture(uint32_t width, uint32_t height, const uint8_t *rgba,
+                           bool mipmapped = true);
+
+    /**
+     * @brief Returns whether a texture's upload and mip generation have completed
+     */
+    bool isReady(uint32_t texture) const;
+
+    /**
+     * @brief Returns the view of a texture covering all of its mip levels
+     */
+    VkImageView getView(uint32_t texture) const;
+
+    /**
+     * @brief Returns the number of mip levels of a texture
+     */
+    uint32_t getMipLevels(uint32_t texture) const;
+
+    /**
+     * @brief Copies the next part of the queue, up to the frame budget, and submits it
+     *
+     * Does nothing while all batches are in flight or the staging ring is full, so that a
+     * frame never waits for earlier uploads
+     *
+     * @return Number of bytes copied
+     * @throws std::runtime_error if recording or submission fails
+     */
+    size_t flush();
+
+    /**
+     * @brief Returns the number of bytes queued and not yet copied
+     */
+    size_t getPendingBytes() const;
+
+    /**
+     * @brief Returns whether copies run on the dedicated transfer queue
+     */
+    bool usesTransferQueue() const;
+
+    /**
+     * @brief Waits until every flushed upload has completed on the device
+     */
+    void waitIdle() const;
+
+  protected:
+    /**
+     * @struct Texture
+     * @brief A texture and the progress of its upload
+     */
+    struct Texture {
+        /// @brief Device-local image with the texture's mip chain
+        VkImage image = VK_NULL_HANDLE;
+
+        /// @brief Memory backing the image
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+
+        /// @brief View of all mip levels
+        VkImageView view = VK_NULL_HANDLE;
+
+        /// @brief Size of mip level 0
+        VkExtent2D extent = {};
+
+        /// @brief Number of mip levels
+        uint32_t mipLevels = 1;
+
+        /// @brief Pixels still to be copied, owned by the caller
+        const uint8_t *pixels = nullptr;
+
+        /// @brief Rows of mip level 0 copied so far
+        uint32_t copiedRows = 0;
+
+        /// @brief Timeline value signalled once the texture is ready, 0 until it is submitted
+        uint64_t readyValue = 0;
+    };
+
+    /**
+     * @struct Batch
+     * @brief Command buffers of one flush
+     */
+    struct Batch {
+        /// @brief Copies, recorded for the transfer queue if there is one
+        VkCommandBuffer copyCommands = VK_NULL_HANDLE;
+
+        /// @brief Ownership acquisition and mip generation on the graphics queue, used only
+        /// with a transfer queue
+        VkCommandBuffer mipCommands = VK_NULL_HANDLE;
+    };
+
+    /// @brief The context the textures are created on
+    std::shared_ptr<VulkanContext> context;
+
+    /// @brief Logical device of the context
+    VkDevice device;
+
+    /// @brief Upload options
+    TextureUploadConfig config;
+
+    /// @brief Queue family of the copies: the transfer family if there is one, else graphics
+    uint32_t copyFamily = 0;
+
+    /// @brief Queue family the mips are generated on and the textures are sampled from
+    uint32_t graphicsFamily = 0;
+
+    /// @brief Whether mip levels are downsampled with a linear filter
+    bool linearBlit = true;
+
+    /// @brief Alignment of staging regions, suitable for copies of four-byte texels
+    size_t copyAlignment = 4;
+
+    /// @brief Host-visible buffer the ring's regions lie in
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+
+    /// @brief Memory backing the staging buffer
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+
+    /// @brief Persistent mapping of the staging buffer
+    uint8_t *stagingMapped = nullptr;
+
+    /// @brief Allocates the staging buffer's regions
+    StagingRing staging;
+
+    /// @brief Command pool of the copy family
+    VkCommandPool copyCommandPool = VK_NULL_HANDLE;
+
+    /// @brief Command pool of the graphics family, used only with a transfer queue
+    VkCommandPool mipCommandPool = VK_NULL_HANDLE;
+
+    /// @brief Command buffers of each flush that may be in flight
+    std::vector<Batch> batches;
+
+    /// @brief Batches whose last submission has completed, or will once its value has
+    TimelineFreeList freeBatches;
+
+    /// @brief Signalled by the copies of each flush on the copy queue, gating the ring
+    VkSemaphore copyTimeline = VK_NULL_HANDLE;
+
+    /// @brief Last value signalled on the copy timeline
+    uint64_t copyValue = 0;
+
+    /// @brief Signalled on the graphics queue once each flush has completed, gating the
+    /// batches and textures
+    VkSemaphore timeline = VK_NULL_HANDLE;
+
+    /// @brief Last value signalled on the timeline
+    uint64_t timelineValue = 0;
+
+    /// @brief Every texture created, indexed by handle
+    std::vector<Texture> textures;
+
+    /// @brief Textures with rows still to copy, in the order they were created
+    std::deque<uint32_t> queued;
+
+    /// @brief Textures whose last rows the current flush copies, kept to avoid reallocation
+    std::vector<uint32_t> finishedTextures;
+
+    /// @brief Bytes queued and not yet copied
+    size_t pendingBytes = 0;
+
+    /**
+     * @brief Returns the value the device has completed on a timeline
+     */
+    uint64_t getCompletedValue(VkSemaphore semaphore) const;
+
+    /**
+     * @brief Submits the copies of a flush, signalling the next copy timeline value
+     *
+     * Without a transfer queue, the copies are followed by the mip generation in the same
+     * command buffer, so the submission completes the flush and signals the timeline as well
+     *
+     * @param commandBuffer The copies
+     * @throws std::runtime_error if the submission fails
+     */
+    void submitCopies(VkCommandBuffer commandBuffer);
+
+    /**
+     * @brief Completes a flush whose copies ran on the transfer queue, signalling the next
+     * timeline value on the graphics queue once the copies have completed
+     * @param commandBuffer Ownership acquisition and mip generation, or VK_NULL_HANDLE if no
+     * texture was finished
+     * @throws std::runtime_error if the submission fails
+     */
+    void submitMips(VkCommandBuffer commandBuffer);
+
+    /**
+     * @brief Records the generation of a texture's mip chain from level 0
+     *
+     * Level 0 must be in TRANSFER_DST_OPTIMAL. Every level ends in SHADER_READ_ONLY_OPTIMAL
+     */
+    void recordMipChain(VkCommandBuffer commandBuffer, const Texture &texture) const;
+
+    /**
+     * @brief Destroys every Vulkan object
+     */
+    void release();
+};
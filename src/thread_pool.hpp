@@ -0,0 +1,65 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed-size pool of worker threads executing queued tasks in FIFO order
+ *
+ * Tasks may submit further tasks, which is how sessions chain their frames without holding a
+ * worker between frames. Pending tasks are drained before the pool is destroyed.
+ */
+class ThreadPool {
+  public:
+    /**
+     * @brief Starts the worker threads
+     * @param threadCount Number of workers. If 0, one worker per hardware thread is started
+     */
+    explicit ThreadPool(size_t threadCount = 0);
+
+    /**
+     * @brief Runs the remaining tasks and joins the worker threads
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Queues a task for execution on a worker thread
+     * @param task The task to run
+     * @return A future that becomes ready when the task has run, and rethrows its exception
+     */
+    std::future<void> submit(std::function<void()> task);
+
+    /**
+     * @brief Returns the number of worker threads
+     */
+    size_t size() const;
+
+  protected:
+    /// @brief The worker threads
+    std::vector<std::thread> workers;
+
+    /// @brief Tasks waiting for a worker
+    std::queue<std::packaged_task<void()>> tasks;
+
+    /// @brief Guards the task queue and the stopping flag
+    std::mutex queueMutex;
+
+    /// @brief Signalled when a task is queued or the pool is stopping
+    std::condition_variable queueCondition;
+
+    /// @brief Set when the pool is being destroyed
+    bool stopping = false;
+
+    /**
+     * @brief Worker loop, runs tasks until the pool is stopped and the queue is empty
+     */
+    void workerLoop();
+};
@@ -0,0 +1,34 @@
+#include "timeline_free_list.hpp"
+#include <algorithm>
+#include <limits>
+
+TimelineFreeList::TimelineFreeList(uint32_t count) : lastUses(count, 0) {
+    freeIndices.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        freeIndices.push_back(i);
+    }
+}
+
+int32_t TimelineFreeList::acquire(uint64_t completedValue) {
+    for (auto it = freeIndices.begin(); it != freeIndices.end(); ++it) {
+        if (lastUses[*it] <= completedValue) {
+            int32_t index = static_cast<int32_t>(*it);
+            freeIndices.erase(it);
+            return index;
+        }
+    }
+    return -1;
+}
+
+void TimelineFreeList::release(uint32_t index, uint64_t lastUse) {
+    lastUses[index] = lastUse;
+    freeIndices.push_back(index);
+}
+
+uint64_t TimelineFreeList::getReadyValue() const {
+    uint64_t ready = std::numeric_limits<uint64_t>::max();
+    for (uint32_t index : freeIndices) {
+        ready = std::min(ready, lastUses[index]);
+    }
+    return ready;
+}
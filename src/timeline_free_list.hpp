@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class TimelineFreeList
+ * @brief Free list of interchangeable resources whose reuse is gated by a timeline value
+ *
+ * A resource is released with the timeline value of the last submission that used it, and
+ * may only be handed out again once the device has completed that value. The list is sized
+ * up front and never allocates afterwards
+ */
+class TimelineFreeList {
+  public:
+    /**
+     * @brief Creates a list in which every resource is free
+     * @param count Number of resources
+     */
+    explicit TimelineFreeList(uint32_t count);
+
+    /**
+     * @brief Takes the free resource that has been idle the longest
+     * @param completedValue Timeline value the device has completed
+     * @return Index of the resource, or -1 if none has completed its last use
+     */
+    int32_t acquire(uint64_t completedValue);
+
+    /**
+     * @brief Returns a resource to the list
+     * @param index Index of the resource, as returned by acquire()
+     * @param lastUse Timeline value signalled by the last submission using the resource
+     */
+    void release(uint32_t index, uint64_t lastUse);
+
+    /**
+     * @brief Returns the timeline value after which acquire() can succeed
+     * @return The smallest last use of the free resources, or UINT64_MAX if none is free
+     */
+    uint64_t getReadyValue() const;
+
+  protected:
+    /// @brief Free resources, oldest release first
+    std::vector<uint32_t> freeIndices;
+
+    /// @brief Timeline value of the last use of each resource
+    std::vector<uint64_t> lastUses;
+};
@@ -0,0 +1,465 @@
+#include "trace.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+/**
+ * @struct TraceEvent
+ * @brief A recorded span
+ */
+struct TraceEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+    uint32_t track;
+};
+
+/**
+ * @struct ThreadBuffer
+ * @brief Ring of events recorded by one thread and drained by the exporter
+ *
+ * "written" is only advanced by the owning thread and "read" only by the exporter, so
+ * neither side takes a lock. The buffer outlives its thread and is handed to the next new
+ * thread once the owner has exited
+ */
+struct ThreadBuffer {
+    ThreadBuffer(size_t capacity, uint32_t track) : events(capacity), track(track) {}
+
+    /// @brief Event slots; the capacity is a power of two
+    std::vector<TraceEvent> events;
+
+    /// @brief Track of the owning thread
+    uint32_t track;
+
+    /// @brief Number of events written and read so far
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> read{0};
+
+    /// @brief Events dropped because the ring was full
+    std::atomic<uint64_t> dropped{0};
+
+    /// @brief Whether a running thread owns the buffer
+    std::atomic<bool> owned{true};
+};
+
+/**
+ * @struct TrackInfo
+ * @brief Name of a track and whether it belongs to a thread
+ */
+struct TrackInfo {
+    std::string name;
+    bool thread;
+};
+
+/**
+ * @struct TracerState
+ * @brief State shared by every thread. Created on first use, so it exists before any scope
+ */
+struct TracerState {
+    /// @brief Guards buffers, tracks and nextTrack
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::map<uint32_t, TrackInfo> tracks;
+    uint32_t nextTrack = 1;
+
+    /// @brief Serialises starting and exporting captures, and guards the fields below
+    std::mutex exportMutex;
+    uint64_t captureStart = 0;
+    uint32_t captureCount = 0;
+
+    /// @brief Set once by configure(), before any frame
+    TraceConfig config;
+    std::atomic<bool> configured{false};
+
+    /// @brief Frames marked so far, and whether a toggle has been requested
+    std::atomic<uint64_t> frame{0};
+    std::atomic<bool> toggleRequested{false};
+};
+
+TracerState &getState() {
+    static TracerState state;
+    return state;
+}
+
+/**
+ * @struct ThreadSlot
+ * @brief Releases the thread's buffer when the thread exits
+ */
+struct ThreadSlot {
+    ThreadBuffer *buffer = nullptr;
+
+    ~ThreadSlot() {
+        if (buffer != nullptr) {
+            buffer->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadSlot threadSlot;
+
+ThreadBuffer &getThreadBuffer() {
+    if (threadSlot.buffer != nullptr) {
+        return *threadSlot.buffer;
+    }
+
+    TracerState &state = getState();
+    std::lock_guard<std::mutex> lock(state.registryMutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : state.buffers) {
+        bool owned = false;
+        if (buffer->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+            threadSlot.buffer = buffer.get();
+            return *buffer;
+        }
+    }
+
+    size_t capacity = 1;
+    while (capacity < std::max<size_t>(state.config.eventsPerThread, 64)) {
+        capacity *= 2;
+    }
+    uint32_t track = state.nextTrack++;
+    state.buffers.push_back(std::make_unique<ThreadBuffer>(capacity, track));
+    state.tracks[track] = {"thread " + std::to_string(track), true};
+    threadSlot.buffer = state.buffers.back().get();
+    return *threadSlot.buffer;
+}
+
+/**
+ * @brief Moves the unread events of a buffer that started at or after "since" into "events"
+ */
+void drain(ThreadBuffer &buffer, uint64_t since, std::vector<TraceEvent> &events) {
+    uint64_t written = buffer.written.load(std::memory_order_acquire);
+    uint64_t mask = buffer.events.size() - 1;
+    for (uint64_t i = buffer.read.load(std::memory_order_relaxed); i < written; ++i) {
+        const TraceEvent &event = buffer.events[i & mask];
+        if (event.start >= since) {
+            events.push_back(event);
+        }
+    }
+    buffer.read.store(written, std::memory_order_release);
+}
+
+void writeJsonString(std::ostream &out, const std::string &text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+/**
+ * @brief Writes a Chrome trace event JSON file, with times relative to "origin"
+ */
+void writeChromeTrace(std::ostream &out, const std::vector<TraceEvent> &events,
+                      const std::map<uint32_t, TrackInfo> &tracks, uint64_t origin) {
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto &[track, info] : tracks) {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << track << ",\"args\":{\"name\":";
+        writeJsonString(out, info.name);
+        out << "}}";
+        first = false;
+    }
+
+    char times[64];
+    for (const TraceEvent &event : events) {
+        std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+                      double(event.start - origin) / 1000.0, double(event.duration) / 1000.0);
+        out << (first ? "\n" : ",\n") << "{\"name\":";
+        writeJsonString(out, event.name);
+        out << ",\"ph\":\"X\"," << times << ",\"pid\":1,\"tid\":" << event.track << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+void writeVarint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void writeVarintField(std::string &out, uint32_t field, uint64_t value) {
+    writeVarint(out, uint64_t(field) << 3);
+    writeVarint(out, value);
+}
+
+void writeBytesField(std::string &out, uint32_t field, const std::string &bytes) {
+    writeVarint(out, uint64_t(field) << 3 | 2);
+    writeVarint(out, bytes.size());
+    out += bytes;
+}
+
+// Field numbers of perfetto/trace/trace_packet.proto and the track event protos
+constexpr uint32_t tracePacket = 1;
+constexpr uint32_t packetTimestamp = 8;
+constexpr uint32_t packetSequenceId = 10;
+constexpr uint32_t packetTrackEvent = 11;
+constexpr uint32_t packetSequenceFlags = 13;
+constexpr uint32_t packetClockId = 58;
+constexpr uint32_t packetTrackDescriptor = 60;
+constexpr uint32_t descriptorUuid = 1;
+constexpr uint32_t descriptorName = 2;
+constexpr uint32_t descriptorThread = 4;
+constexpr uint32_t threadPid = 1;
+constexpr uint32_t threadTid = 2;
+constexpr uint32_t threadName = 5;
+constexpr uint32_t eventType = 9;
+constexpr uint32_t eventTrackUuid = 11;
+constexpr uint32_t eventName = 23;
+constexpr uint64_t sliceBegin = 1;
+constexpr uint64_t sliceEnd = 2;
+constexpr uint64_t incrementalStateCleared = 1;
+constexpr uint64_t clockMonotonic = 3;
+
+/**
+ * @brief Writes a Perfetto protobuf trace
+ *
+ * Each span becomes a begin and an end event on its track's descriptor. Events are sorted by
+ * time; at equal times ends come first, outer spans begin first and inner spans end first
+ */
+void writePerfettoTrace(std::ostream &out, const std::vector<TraceEvent> &events,
+                        const std::map<uint32_t, TrackInfo> &tracks) {
+    std::string trace;
+    bool first = true;
+    for (const auto &[track, info] : tracks) {
+        std::string descriptor;
+        writeVarintField(descriptor, descriptorUuid, track);
+        if (info.thread) {
+            std::string thread;
+            writeVarintField(thread, threadPid, 1);
+            writeVarintField(thread, threadTid, track);
+            writeBytesField(thread, threadName, info.name);
+            writeBytesField(descriptor, descriptorThread, thread);
+        } else {
+            writeBytesField(descriptor, descriptorName, info.name);
+        }
+
+        std::string packet;
+        writeVarintField(packet, packetSequenceId, 1);
+        if (first) {
+            writeVarintField(packet, packetSequenceFlags, incrementalStateCleared);
+            first = false;
+        }
+        writeBytesField(packet, packetTrackDescriptor, descriptor);
+        writeBytesField(trace, tracePacket, packet);
+    }
+
+    struct Edge {
+        uint64_t time;
+        bool end;
+        const TraceEvent *event;
+    };
+    std::vector<Edge> edges;
+    edges.reserve(events.size() * 2);
+    for (const TraceEvent &event : events) {
+        edges.push_back({event.start, false, &event});
+        edges.push_back({event.start + event.duration, true, &event});
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+        if (a.time != b.time) {
+            return a.time < b.time;
+        }
+        if (a.end != b.end) {
+            return a.end;
+        }
+        return a.end ? a.event->duration < b.event->duration
+                     : a.event->duration > b.event->duration;
+    });
+
+    for (const Edge &edge : edges) {
+        std::string trackEvent;
+        writeVarintField(trackEvent, eventType, edge.end ? sliceEnd : sliceBegin);
+        writeVarintField(trackEvent, eventTrackUuid, edge.event->track);
+        if (!edge.end) {
+            writeBytesField(trackEvent, eventName, edge.event->name);
+        }
+
+        std::string packet;
+        writeVarintField(packet, packetTimestamp, edge.time);
+        writeVarintField(packet, packetClockId, clockMonotonic);
+        writeVarintField(packet, packetSequenceId, 1);
+        writeBytesField(packet, packetTrackEvent, trackEvent);
+        writeBytesField(trace, tracePacket, packet);
+    }
+    out.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+}
+
+/**
+ * @brief Returns the path of a capture; captures after the first add "_N" to the stem
+ */
+std::string getCapturePath(const std::string &path, uint32_t capture) {
+    if (capture == 0) {
+        return path;
+    }
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        dot = path.size();
+    }
+    return path.substr(0, dot) + "_" + std::to_string(capture) + path.substr(dot);
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::enabled{false};
+
+void Tracer::configure(const TraceConfig &config) {
+    TracerState &state = getState();
+    {
+        std::lock_guard<std::mutex> lock(state.registryMutex);
+        state.config = config;
+    }
+    state.configured.store(true, std::memory_order_release);
+}
+
+uint64_t Tracer::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+void Tracer::markFrame() {
+    TracerState &state = getState();
+    if (!state.configured.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    uint64_t frame = state.frame.fetch_add(1, std::memory_order_relaxed);
+    bool toggle = state.toggleRequested.load(std::memory_order_relaxed) &&
+                  state.toggleRequested.exchange(false, std::memory_order_relaxed);
+    bool begin = frame == state.config.startFrame;
+    bool end = state.config.frameCount > 0 &&
+               frame == state.config.startFrame + state.config.frameCount;
+    if (!toggle && !begin && !end) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(state.exportMutex);
+    if (toggle) {
+        isEnabled() ? stop() : start();
+    }
+    if (begin && !isEnabled()) {
+        start();
+    }
+    if (end && isEnabled()) {
+        stop();
+    }
+}
+
+void Tracer::requestToggle() {
+    getState().toggleRequested.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::finish() {
+    TracerState &state = getState();
+    std::lock_guard<std::mutex> lock(state.exportMutex);
+    if (isEnabled()) {
+        stop();
+    }
+}
+
+void Tracer::record(const char *name, uint64_t start, uint64_t end, uint32_t track) {
+    ThreadBuffer &buffer = getThreadBuffer();
+    uint64_t written = buffer.written.load(std::memory_order_relaxed);
+    if (written - buffer.read.load(std::memory_order_acquire) >= buffer.events.size()) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer.events[written & (buffer.events.size() - 1)] = {
+        name, start, end > start ? end - start : 0, track != 0 ? track : buffer.track};
+    buffer.written.store(written + 1, std::memory_order_release);
+}
+
+uint32_t Tracer::createTrack(const std::string &name) {
+    TracerState &state = getState();
+    std::lock_guard<std::mutex> lock(state.registryMutex);
+    uint32_t track = state.nextTrack++;
+    state.tracks[track] = {name, false};
+    return track;
+}
+
+void Tracer::setThreadName(const std::string &name) {
+    ThreadBuffer &buffer = getThreadBuffer();
+    TracerState &state = getState();
+    std::lock_guard<std::mutex> lock(state.registryMutex);
+    state.tracks[buffer.track].name = name;
+}
+
+void Tracer::start() {
+    TracerState &state = getState();
+
+    // Events left from before the capture are discarded
+    std::vector<TraceEvent> stale;
+    {
+        std::lock_guard<std::mutex> lock(state.registryMutex);
+        for (const std::unique_ptr<ThreadBuffer> &buffer : state.buffers) {
+            drain(*buffer, std::numeric_limits<uint64_t>::max(), stale);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    state.captureStart = now();
+    enabled.store(true, std::memory_order_relaxed);
+    LOG_INFO("Trace capture started.");
+}
+
+void Tracer::stop() {
+    TracerState &state = getState();
+    enabled.store(false, std::memory_order_relaxed);
+
+    // Scopes still open when the capture stops are recorded later and left for the next one
+    std::vector<TraceEvent> events;
+    std::map<uint32_t, TrackInfo> tracks;
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(state.registryMutex);
+        for (const std::unique_ptr<ThreadBuffer> &buffer : state.buffers) {
+            drain(*buffer, state.captureStart, events);
+            dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+        }
+        tracks = state.tracks;
+    }
+    std::sort(events.begin(), events.end(),
+              [](const TraceEvent &a, const TraceEvent &b) { return a.start < b.start; });
+
+    std::string path = getCapturePath(state.config.path, state.captureCount++);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (state.config.format == TraceFormat::Perfetto) {
+        writePerfettoTrace(file, events, tracks);
+    } else {
+        writeChromeTrace(file, events, tracks, state.captureStart);
+    }
+    if (!file.flush()) {
+        LOG_ERROR("Failed to write trace " + path);
+        return;
+    }
+
+    std::string message = "Wrote trace " + path + " (" + std::to_string(events.size()) +
+                          " events";
+    if (dropped > 0) {
+        message += ", " + std::to_string(dropped) + " dropped";
+    }
+    LOG_INFO(message + ").");
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @enum TraceFormat
+ * @brief File format traces are exported in
+ *
+ * Chrome: JSON trace event format, read by chrome://tracing and ui.perfetto.dev
+ * Perfetto: Perfetto protobuf trace, read by ui.perfetto.dev and trace_processor
+ */
+enum class TraceFormat { Chrome, Perfetto };
+
+/**
+ * @struct TraceConfig
+ * @brief Configuration options of the Tracer
+ */
+struct TraceConfig {
+    /// @brief Path of the exported trace. Later captures of the same run add "_N" to the stem
+    std::string path = "trace.json";
+
+    /// @brief Format of the exported trace
+    TraceFormat format = TraceFormat::Chrome;
+
+    /// @brief Frame the capture starts at, counted over every renderer
+    uint64_t startFrame = 0;
+
+    /// @brief Number of frames captured before the trace is exported. If 0, the capture runs
+    /// until it is toggled off or the tracer is finished
+    uint64_t frameCount = 0;
+
+    /// @brief Capacity of each thread's event buffer. Events are dropped while it is full
+    size_t eventsPerThread = 1 << 16;
+};
+
+/**
+ * @class Tracer
+ * @brief Records timed scopes from every thread, and GPU spans, for export as a timeline
+ *
+ * Each thread records into a buffer of its own, a single-producer ring that the exporter
+ * drains without locks, so recording never blocks. While no capture is running, a scope costs
+ * one relaxed atomic load. Timestamps are steady clock nanoseconds; GPU spans are converted
+ * to that clock by the renderer and recorded on tracks of their own.
+ *
+ * A capture starts and stops at a window of frames given by the configuration, or whenever
+ * requestToggle() is called, e.g. from a signal handler. Stopping exports the events recorded
+ * since the capture started.
+ */
+class Tracer {
+  public:
+    /**
+     * @brief Configures the tracer; the capture starts at the configured frame
+     */
+    static void configure(const TraceConfig &config);
+
+    /**
+     * @brief Returns whether a capture is running
+     */
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the steady clock time in nanoseconds
+     */
+    static uint64_t now();
+
+    /**
+     * @brief Advances the frame count, starting or stopping a capture when due
+     *
+     * Called by every renderer at the start of each frame. Toggles requested since the last
+     * frame take effect here
+     */
+    static void markFrame();
+
+    /**
+     * @brief Asks for the capture to be started, or stopped and exported, at the next frame
+     *
+     * Only sets a flag, so it may be called from a signal handler
+     */
+    static void requestToggle();
+
+    /**
+     * @brief Stops and exports a running capture, e.g. before the application exits
+     */
+    static void finish();
+
+    /**
+     * @brief Records a span on the calling thread's buffer
+     * @param name Name of the span, a string that outlives the tracer (e.g. a literal)
+     * @param start Start time in steady clock nanoseconds
+     * @param end End time in steady clock nanoseconds
+     * @param track Track the span is shown on, from createTrack(), or 0 for the calling thread
+     */
+    static void record(const char *name, uint64_t start, uint64_t end, uint32_t track = 0);
+
+    /**
+     * @brief Creates a track for spans that do not belong to a thread, such as GPU work
+     * @param name Name the track is shown with
+     * @return The track, to be passed to record()
+     */
+    static uint32_t createTrack(const std::string &name);
+
+    /**
+     * @brief Names the calling thread's track
+     */
+    static void setThreadName(const std::string &name);
+
+  protected:
+    /// @brief Whether a capture is running
+    static std::atomic<bool> enabled;
+
+    /**
+     * @brief Starts a capture. Called with the export mutex held
+     */
+    static void start();
+
+    /**
+     * @brief Stops the capture and exports it. Called with the export mutex held
+     */
+    static void stop();
+};
+
+/**
+ * @class TraceScope
+ * @brief Records the lifetime of a scope as a span on the current thread
+ */
+class TraceScope {
+  public:
+    /**
+     * @param name Name of the span, a string that outlives the tracer (e.g. a literal)
+     */
+    explicit TraceScope(const char *name)
+        : name(name), start(Tracer::isEnabled() ? Tracer::now() : 0) {}
+
+    ~TraceScope() {
+        if (start != 0) {
+            Tracer::record(name, start, Tracer::now());
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+  private:
+    /// @brief Name of the span
+    const char *name;
+
+    /// @brief Start time, or 0 if no capture was running when the scope was entered
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+/**
+ * @def TRACE_SCOPE
+ * @brief Records the enclosing scope as a span with the given name
+ */
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,577 @@
+#include "transform.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSFORM_HAVE_AVX2 1
+#endif
+
+namespace {
+
+// Normalisation of the H.264 4x4 and 8x8 transforms, per QP % 6 and coefficient class
+constexpr int32_t quant4Scale[6][3] = {{13107, 8066, 5243}, {11916, 7490, 4660},
+                                       {10082, 6554, 4194}, {9362, 5825, 3647},
+                                       {8192, 5243, 3355},  {7282, 4559, 2893}};
+constexpr int32_t dequant4Scale[6][3] = {{10, 13, 16}, {11, 14, 18}, {13, 16, 20},
+                                         {14, 18, 23}, {16, 20, 25}, {18, 23, 29}};
+constexpr int32_t quant8Scale[6][6] = {{13107, 11428, 20972, 12222, 16777, 15481},
+                                       {11916, 10826, 19174, 11058, 14980, 14290},
+                                       {10082, 8943, 15978, 9675, 12710, 11985},
+                                       {9362, 8228, 14913, 8931, 11984, 11259},
+                                       {8192, 7346, 13159, 7740, 10486, 9777},
+                                       {7282, 6428, 11570, 6830, 9118, 8640}};
+constexpr int32_t dequant8Scale[6][6] = {{20, 18, 32, 19, 25, 24}, {22, 19, 35, 21, 28, 26},
+                                         {26, 23, 42, 24, 33, 31}, {28, 25, 45, 26, 35, 33},
+                                         {32, 28, 51, 30, 40, 38}, {36, 32, 58, 34, 46, 43}};
+
+// Class of each position of a 4x4 tile of an 8x8 block, by (y % 4) * 4 + x % 4
+constexpr int class8x8[16] = {0, 3, 4, 3, 3, 1, 5, 1, 4, 5, 2, 5, 3, 1, 5, 1};
+
+int16_t saturate16(int value) {
+    return static_cast<int16_t>(std::clamp(value, -32768, 32767));
+}
+
+uint8_t clip(int value) {
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+void forward4(int *x, int step) {
+    int s03 = x[0] + x[3 * step], d03 = x[0] - x[3 * step];
+    int s12 = x[step] + x[2 * step], d12 = x[step] - x[2 * step];
+    x[0] = s03 + s12;
+    x[step] = 2 * d03 + d12;
+    x[2 * step] = s03 - s12;
+    x[3 * step] = d03 - 2 * d12;
+}
+
+void inverse4(int *x, int step) {
+    int e = x[0] + x[2 * step], f = x[0] - x[2 * step];
+    int g = (x[step] >> 1) - x[3 * step], h = x[step] + (x[3 * step] >> 1);
+    x[0] = e + h;
+    x[step] = f + g;
+    x[2 * step] = f - g;
+    x[3 * step] = e - h;
+}
+
+void forward8(int *x, int step) {
+    int s07 = x[0] + x[7 * step], d07 = x[0] - x[7 * step];
+    int s16 = x[step] + x[6 * step], d16 = x[step] - x[6 * step];
+    int s25 = x[2 * step] + x[5 * step], d25 = x[2 * step] - x[5 * step];
+    int s34 = x[3 * step] + x[4 * step], d34 = x[3 * step] - x[4 * step];
+
+    int a0 = s07 + s34, a1 = s16 + s25, a2 = s07 - s34, a3 = s16 - s25;
+    int a4 = d16 + d25 + (d07 + (d07 >> 1));
+    int a5 = d07 - d34 - (d25 + (d25 >> 1));
+    int a6 = d07 + d34 - (d16 + (d16 >> 1));
+    int a7 = d16 - d25 + (d34 + (d34 >> 1));
+
+    x[0] = a0 + a1;
+    x[step] = a4 + (a7 >> 2);
+    x[2 * step] = a2 + (a3 >> 1);
+    x[3 * step] = a5 + (a6 >> 2);
+    x[4 * step] = a0 - a1;
+    x[5 * step] = a6 - (a5 >> 2);
+    x[6 * step] = (a2 >> 1) - a3;
+    x[7 * step] = (a4 >> 2) - a7;
+}
+
+void inverse8(int *x, int step) {
+    int s0 = x[0], s1 = x[step], s2 = x[2 * step], s3 = x[3 * step];
+    int s4 = x[4 * step], s5 = x[5 * step], s6 = x[6 * step], s7 = x[7 * step];
+
+    int a0 = s0 + s4, a2 = s0 - s4;
+    int a4 = (s2 >> 1) - s6, a6 = (s6 >> 1) + s2;
+    int b0 = a0 + a6, b2 = a2 + a4, b4 = a2 - a4, b6 = a0 - a6;
+
+    int a1 = -s3 + s5 - s7 - (s7 >> 1);
+    int a3 = s1 + s7 - s3 - (s3 >> 1);
+    int a5 = -s1 + s7 + s5 + (s5 >> 1);
+    int a7 = s3 + s5 + s1 + (s1 >> 1);
+    int b1 = (a7 >> 2) + a1, b3 = a3 + (a5 >> 2);
+    int b5 = (a3 >> 2) - a5, b7 = a7 - (a1 >> 2);
+
+    x[0] = b0 + b7;
+    x[step] = b2 + b5;
+    x[2 * step] = b4 + b3;
+    x[3 * step] = b6 + b1;
+    x[4 * step] = b6 - b1;
+    x[5 * step] = b4 - b3;
+    x[6 * step] = b2 - b5;
+    x[7 * step] = b0 - b7;
+}
+
+void hadamard4(int *x, int step) {
+    int s01 = x[0] + x[step], d01 = x[0] - x[step];
+    int s23 = x[2 * step] + x[3 * step], d23 = x[2 * step] - x[3 * step];
+    x[0] = s01 + s23;
+    x[step] = s01 - s23;
+    x[2 * step] = d01 - d23;
+    x[3 * step] = d01 + d23;
+}
+
+// The transforms run over rows first, then columns, as the standard specifies for the
+// inverse. Their rounding shifts make the order matter
+template <int N, void (*Transform)(int *, int)>
+void forwardScalar(int16_t *coefficients, const uint8_t *source, ptrdiff_t sourceStride,
+                   const uint8_t *prediction, ptrdiff_t predictionStride) {
+    int block[N * N];
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            block[y * N + x] = source[y * sourceStride + x] - prediction[y * predictionStride + x];
+        }
+    }
+    for (int y = 0; y < N; ++y) {
+        Transform(block + y * N, 1);
+    }
+    for (int x = 0; x < N; ++x) {
+        Transform(block + x, N);
+    }
+    for (int i = 0; i < N * N; ++i) {
+        coefficients[i] = static_cast<int16_t>(block[i]);
+    }
+}
+
+template <int N, void (*Transform)(int *, int)>
+void inverseScalar(uint8_t *block, ptrdiff_t stride, const int16_t *coefficients) {
+    int residual[N * N];
+    std::copy(coefficients, coefficients + N * N, residual);
+    for (int y = 0; y < N; ++y) {
+        Transform(residual + y * N, 1);
+    }
+    for (int x = 0; x < N; ++x) {
+        Transform(residual + x, N);
+    }
+    for (int y = 0; y < N; ++y) {
+        for (int x = 0; x < N; ++x) {
+            block[y * stride + x] = clip(block[y * stride + x] + ((residual[y * N + x] + 32) >> 6));
+        }
+    }
+}
+
+void forwardDcScalar(int16_t *dc) {
+    int block[16];
+    std::copy(dc, dc + 16, block);
+    for (int y = 0; y < 4; ++y) {
+        hadamard4(block + y * 4, 1);
+    }
+    for (int x = 0; x < 4; ++x) {
+        hadamard4(block + x, 4);
+    }
+    for (int i = 0; i < 16; ++i) {
+        dc[i] = saturate16((block[i] + 1) >> 1);
+    }
+}
+
+void inverseDcScalar(int16_t *dc) {
+    int block[16];
+    std::copy(dc, dc + 16, block);
+    for (int y = 0; y < 4; ++y) {
+        hadamard4(block + y * 4, 1);
+    }
+    for (int x = 0; x < 4; ++x) {
+        hadamard4(block + x, 4);
+    }
+    for (int i = 0; i < 16; ++i) {
+        dc[i] = saturate16(block[i]);
+    }
+}
+
+bool quantizeScalar(int16_t *coefficients, const int32_t *multipliers, int32_t bias, int shift,
+                    int count) {
+    bool nonZero = false;
+    for (int i = 0; i < count; ++i) {
+        int coefficient = coefficients[i];
+        int level = (std::abs(coefficient) * multipliers[i] + bias) >> shift;
+        level = coefficient > 0 ? level : coefficient < 0 ? -level : 0;
+        coefficients[i] = saturate16(level);
+        nonZero |= level != 0;
+    }
+    return nonZero;
+}
+
+void dequantizeScalar(int16_t *coefficients, const int32_t *scales, int shift, int count) {
+    int rounding = shift > 0 ? 1 << (shift - 1) : 0;
+    for (int i = 0; i < count; ++i) {
+        coefficients[i] = saturate16((coefficients[i] * scales[i] + rounding) >> shift);
+    }
+}
+
+#ifdef TRANSFORM_HAVE_AVX2
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// Differences of a 4-pixel row, in the low four 16-bit lanes
+AVX2_TARGET inline __m128i residual4(const uint8_t *source, const uint8_t *prediction) {
+    int32_t s, p;
+    __builtin_memcpy(&s, source, 4);
+    __builtin_memcpy(&p, prediction, 4);
+    return _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(s)),
+                         _mm_cvtepu8_epi16(_mm_cvtsi32_si128(p)));
+}
+
+// Differences of an 8-pixel row
+AVX2_TARGET inline __m128i residual8(const uint8_t *source, const uint8_t *prediction) {
+    return _mm_sub_epi16(
+        _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(source))),
+        _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(prediction))));
+}
+
+// Transposes a 4x4 block of 16-bit values held in the low halves of four registers
+AVX2_TARGET inline void transpose4x4(__m128i *r) {
+    __m128i t0 = _mm_unpacklo_epi16(r[0], r[1]);
+    __m128i t1 = _mm_unpacklo_epi16(r[2], r[3]);
+    __m128i c01 = _mm_unpacklo_epi32(t0, t1);
+    __m128i c23 = _mm_unpackhi_epi32(t0, t1);
+    r[0] = c01;
+    r[1] = _mm_unpackhi_epi64(c01, c01);
+    r[2] = c23;
+    r[3] = _mm_unpackhi_epi64(c23, c23);
+}
+
+// Transposes a 4x4 block of 32-bit values
+AVX2_TARGET inline void transpose4x4Wide(__m128i *r) {
+    __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+    __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+    __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+    __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+    r[0] = _mm_unpacklo_epi64(t0, t1);
+    r[1] = _mm_unpackhi_epi64(t0, t1);
+    r[2] = _mm_unpacklo_epi64(t2, t3);
+    r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+// Transposes an 8x8 block of 16-bit values
+AVX2_TARGET inline void transpose8x8(__m128i *r) {
+    __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]), a1 = _mm_unpackhi_epi16(r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]), a3 = _mm_unpackhi_epi16(r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]), a5 = _mm_unpackhi_epi16(r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]), a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2), b1 = _mm_unpackhi_epi32(a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3), b3 = _mm_unpackhi_epi32(a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6), b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7), b7 = _mm_unpackhi_epi32(a5, a7);
+
+    r[0] = _mm_unpacklo_epi64(b0, b4);
+    r[1] = _mm_unpackhi_epi64(b0, b4);
+    r[2] = _mm_unpacklo_epi64(b1, b5);
+    r[3] = _mm_unpackhi_epi64(b1, b5);
+    r[4] = _mm_unpacklo_epi64(b2, b6);
+    r[5] = _mm_unpackhi_epi64(b2, b6);
+    r[6] = _mm_unpacklo_epi64(b3, b7);
+    r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+// The 1-D transforms below work across registers, so each lane transforms one row or column
+
+AVX2_TARGET inline void forward4Lanes(__m128i *x) {
+    __m128i s03 = _mm_add_epi16(x[0], x[3]), d03 = _mm_sub_epi16(x[0], x[3]);
+    __m128i s12 = _mm_add_epi16(x[1], x[2]), d12 = _mm_sub_epi16(x[1], x[2]);
+    x[0] = _mm_add_epi16(s03, s12);
+    x[1] = _mm_add_epi16(_mm_add_epi16(d03, d03), d12);
+    x[2] = _mm_sub_epi16(s03, s12);
+    x[3] = _mm_sub_epi16(d03, _mm_add_epi16(d12, d12));
+}
+
+AVX2_TARGET inline void inverse4Lanes(__m128i *x) {
+    __m128i e = _mm_add_epi16(x[0], x[2]), f = _mm_sub_epi16(x[0], x[2]);
+    __m128i g = _mm_sub_epi16(_mm_srai_epi16(x[1], 1), x[3]);
+    __m128i h = _mm_add_epi16(x[1], _mm_srai_epi16(x[3], 1));
+    x[0] = _mm_add_epi16(e, h);
+    x[1] = _mm_add_epi16(f, g);
+    x[2] = _mm_sub_epi16(f, g);
+    x[3] = _mm_sub_epi16(e, h);
+}
+
+AVX2_TARGET inline void forward8Lanes(__m128i *x) {
+    __m128i s07 = _mm_add_epi16(x[0], x[7]), d07 = _mm_sub_epi16(x[0], x[7]);
+    __m128i s16 = _mm_add_epi16(x[1], x[6]), d16 = _mm_sub_epi16(x[1], x[6]);
+    __m128i s25 = _mm_add_epi16(x[2], x[5]), d25 = _mm_sub_epi16(x[2], x[5]);
+    __m128i s34 = _mm_add_epi16(x[3], x[4]), d34 = _mm_sub_epi16(x[3], x[4]);
+
+    __m128i a0 = _mm_add_epi16(s07, s34), a1 = _mm_add_epi16(s16, s25);
+    __m128i a2 = _mm_sub_epi16(s07, s34), a3 = _mm_sub_epi16(s16, s25);
+    __m128i a4 = _mm_add_epi16(_mm_add_epi16(d16, d25),
+                               _mm_add_epi16(d07, _mm_srai_epi16(d07, 1)));
+    __m128i a5 = _mm_sub_epi16(_mm_sub_epi16(d07, d34),
+                               _mm_add_epi16(d25, _mm_srai_epi16(d25, 1)));
+    __m128i a6 = _mm_sub_epi16(_mm_add_epi16(d07, d34),
+                               _mm_add_epi16(d16, _mm_srai_epi16(d16, 1)));
+    __m128i a7 = _mm_add_epi16(_mm_sub_epi16(d16, d25),
+                               _mm_add_epi16(d34, _mm_srai_epi16(d34, 1)));
+
+    x[0] = _mm_add_epi16(a0, a1);
+    x[1] = _mm_add_epi16(a4, _mm_srai_epi16(a7, 2));
+    x[2] = _mm_add_epi16(a2, _mm_srai_epi16(a3, 1));
+    x[3] = _mm_add_epi16(a5, _mm_srai_epi16(a6, 2));
+    x[4] = _mm_sub_epi16(a0, a1);
+    x[5] = _mm_sub_epi16(a6, _mm_srai_epi16(a5, 2));
+    x[6] = _mm_sub_epi16(_mm_srai_epi16(a2, 1), a3);
+    x[7] = _mm_sub_epi16(_mm_srai_epi16(a4, 2), a7);
+}
+
+AVX2_TARGET inline void inverse8Lanes(__m128i *x) {
+    __m128i a0 = _mm_add_epi16(x[0], x[4]), a2 = _mm_sub_epi16(x[0], x[4]);
+    __m128i a4 = _mm_sub_epi16(_mm_srai_epi16(x[2], 1), x[6]);
+    __m128i a6 = _mm_add_epi16(_mm_srai_epi16(x[6], 1), x[2]);
+    __m128i b0 = _mm_add_epi16(a0, a6), b2 = _mm_add_epi16(a2, a4);
+    __m128i b4 = _mm_sub_epi16(a2, a4), b6 = _mm_sub_epi16(a0, a6);
+
+    __m128i a1 = _mm_sub_epi16(_mm_sub_epi16(x[5], x[3]),
+                               _mm_add_epi16(x[7], _mm_srai_epi16(x[7], 1)));
+    __m128i a3 = _mm_sub_epi16(_mm_add_epi16(x[1], x[7]),
+                               _mm_add_epi16(x[3], _mm_srai_epi16(x[3], 1)));
+    __m128i a5 = _mm_add_epi16(_mm_sub_epi16(x[7], x[1]),
+                               _mm_add_epi16(x[5], _mm_srai_epi16(x[5], 1)));
+    __m128i a7 = _mm_add_epi16(_mm_add_epi16(x[3], x[5]),
+                               _mm_add_epi16(x[1], _mm_srai_epi16(x[1], 1)));
+    __m128i b1 = _mm_add_epi16(_mm_srai_epi16(a7, 2), a1);
+    __m128i b3 = _mm_add_epi16(a3, _mm_srai_epi16(a5, 2));
+    __m128i b5 = _mm_sub_epi16(_mm_srai_epi16(a3, 2), a5);
+    __m128i b7 = _mm_sub_epi16(a7, _mm_srai_epi16(a1, 2));
+
+    x[0] = _mm_add_epi16(b0, b7);
+    x[1] = _mm_add_epi16(b2, b5);
+    x[2] = _mm_add_epi16(b4, b3);
+    x[3] = _mm_add_epi16(b6, b1);
+    x[4] = _mm_sub_epi16(b6, b1);
+    x[5] = _mm_sub_epi16(b4, b3);
+    x[6] = _mm_sub_epi16(b2, b5);
+    x[7] = _mm_sub_epi16(b0, b7);
+}
+
+AVX2_TARGET inline void hadamard4Lanes(__m128i *x) {
+    __m128i s01 = _mm_add_epi32(x[0], x[1]), d01 = _mm_sub_epi32(x[0], x[1]);
+    __m128i s23 = _mm_add_epi32(x[2], x[3]), d23 = _mm_sub_epi32(x[2], x[3]);
+    x[0] = _mm_add_epi32(s01, s23);
+    x[1] = _mm_sub_epi32(s01, s23);
+    x[2] = _mm_sub_epi32(d01, d23);
+    x[3] = _mm_add_epi32(d01, d23);
+}
+
+// Rows are transposed so the first pass runs along them, then transposed back for the columns
+
+AVX2_TARGET void forward4x4Avx2(int16_t *coefficients, const uint8_t *source,
+                                ptrdiff_t sourceStride, const uint8_t *prediction,
+                                ptrdiff_t predictionStride) {
+    __m128i r[4];
+    for (int y = 0; y < 4; ++y) {
+        r[y] = residual4(source + y * sourceStride, prediction + y * predictionStride);
+    }
+    transpose4x4(r);
+    forward4Lanes(r);
+    transpose4x4(r);
+    forward4Lanes(r);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(coefficients), _mm_unpacklo_epi64(r[0], r[1]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(coefficients + 8), _mm_unpacklo_epi64(r[2], r[3]));
+}
+
+AVX2_TARGET void inverse4x4Avx2(uint8_t *block, ptrdiff_t stride, const int16_t *coefficients) {
+    __m128i r[4];
+    for (int y = 0; y < 4; ++y) {
+        r[y] = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(coefficients + y * 4));
+    }
+    transpose4x4(r);
+    inverse4Lanes(r);
+    transpose4x4(r);
+    inverse4Lanes(r);
+
+    const __m128i rounding = _mm_set1_epi16(32);
+    for (int y = 0; y < 4; ++y) {
+        int32_t row;
+        __builtin_memcpy(&row, block + y * stride, 4);
+        __m128i residual = _mm_srai_epi16(_mm_add_epi16(r[y], rounding), 6);
+        __m128i sum = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(row)), residual);
+        row = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        __builtin_memcpy(block + y * stride, &row, 4);
+    }
+}
+
+AVX2_TARGET void forward8x8Avx2(int16_t *coefficients, const uint8_t *source,
+                                ptrdiff_t sourceStride, const uint8_t *prediction,
+                                ptrdiff_t predictionStride) {
+    __m128i r[8];
+    for (int y = 0; y < 8; ++y) {
+        r[y] = residual8(source + y * sourceStride, prediction + y * predictionStride);
+    }
+    transpose8x8(r);
+    forward8Lanes(r);
+    transpose8x8(r);
+    forward8Lanes(r);
+    for (int y = 0; y < 8; ++y) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(coefficients + y * 8), r[y]);
+    }
+}
+
+AVX2_TARGET void inverse8x8Avx2(uint8_t *block, ptrdiff_t stride, const int16_t *coefficients) {
+    __m128i r[8];
+    for (int y = 0; y < 8; ++y) {
+        r[y] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(coefficients + y * 8));
+    }
+    transpose8x8(r);
+    inverse8Lanes(r);
+    transpose8x8(r);
+    inverse8Lanes(r);
+
+    const __m128i rounding = _mm_set1_epi16(32);
+    for (int y = 0; y < 8; ++y) {
+        __m128i *row = reinterpret_cast<__m128i *>(block + y * stride);
+        __m128i residual = _mm_srai_epi16(_mm_add_epi16(r[y], rounding), 6);
+        __m128i sum = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(row)), residual);
+        _mm_storel_epi64(row, _mm_packus_epi16(sum, sum));
+    }
+}
+
+// The DC transforms widen to 32 bits, since sixteen DC coefficients can sum past 16 bits
+AVX2_TARGET inline void hadamardDc(const int16_t *dc, __m128i *r) {
+    for (int y = 0; y < 4; ++y) {
+        r[y] = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(dc + y * 4)));
+    }
+    transpose4x4Wide(r);
+    hadamard4Lanes(r);
+    transpose4x4Wide(r);
+    hadamard4Lanes(r);
+}
+
+AVX2_TARGET void forwardDcAvx2(int16_t *dc) {
+    __m128i r[4];
+    hadamardDc(dc, r);
+    const __m128i one = _mm_set1_epi32(1);
+    for (int y = 0; y < 4; ++y) {
+        r[y] = _mm_srai_epi32(_mm_add_epi32(r[y], one), 1);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dc), _mm_packs_epi32(r[0], r[1]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dc + 8), _mm_packs_epi32(r[2], r[3]));
+}
+
+AVX2_TARGET void inverseDcAvx2(int16_t *dc) {
+    __m128i r[4];
+    hadamardDc(dc, r);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dc), _mm_packs_epi32(r[0], r[1]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dc + 8), _mm_packs_epi32(r[2], r[3]));
+}
+
+AVX2_TARGET bool quantizeAvx2(int16_t *coefficients, const int32_t *multipliers, int32_t bias,
+                              int shift, int count) {
+    const __m256i rounding = _mm256_set1_epi32(bias);
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+    __m256i nonZero = _mm256_setzero_si256();
+
+    for (int i = 0; i < count; i += 16) {
+        __m256i *p = reinterpret_cast<__m256i *>(coefficients + i);
+        __m256i c = _mm256_loadu_si256(p);
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(c));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(c, 1));
+
+        __m256i scaledLo = _mm256_mullo_epi32(
+            _mm256_abs_epi32(lo),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(multipliers + i)));
+        __m256i scaledHi = _mm256_mullo_epi32(
+            _mm256_abs_epi32(hi),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(multipliers + i + 8)));
+        lo = _mm256_sign_epi32(_mm256_sra_epi32(_mm256_add_epi32(scaledLo, rounding), shiftCount),
+                               lo);
+        hi = _mm256_sign_epi32(_mm256_sra_epi32(_mm256_add_epi32(scaledHi, rounding), shiftCount),
+                               hi);
+
+        // Packing interleaves the 128-bit halves, so restore their order
+        __m256i levels = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+        _mm256_storeu_si256(p, levels);
+        nonZero = _mm256_or_si256(nonZero, levels);
+    }
+
+    return !_mm256_testz_si256(nonZero, nonZero);
+}
+
+AVX2_TARGET void dequantizeAvx2(int16_t *coefficients, const int32_t *scales, int shift,
+                                int count) {
+    const __m256i rounding = _mm256_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+    for (int i = 0; i < count; i += 16) {
+        __m256i *p = reinterpret_cast<__m256i *>(coefficients + i);
+        __m256i c = _mm256_loadu_si256(p);
+        __m256i lo = _mm256_mullo_epi32(
+            _mm256_cvtepi16_epi32(_mm256_castsi256_si128(c)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(scales + i)));
+        __m256i hi = _mm256_mullo_epi32(
+            _mm256_cvtepi16_epi32(_mm256_extracti128_si256(c, 1)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(scales + i + 8)));
+        lo = _mm256_sra_epi32(_mm256_add_epi32(lo, rounding), shiftCount);
+        hi = _mm256_sra_epi32(_mm256_add_epi32(hi, rounding), shiftCount);
+        _mm256_storeu_si256(p, _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+    }
+}
+
+const TransformFunctions avx2Functions = {
+    forward4x4Avx2, forward8x8Avx2, inverse4x4Avx2, inverse8x8Avx2,
+    forwardDcAvx2,  inverseDcAvx2,  quantizeAvx2,   dequantizeAvx2,
+};
+
+#endif
+
+const TransformFunctions scalarFunctions = {
+    forwardScalar<4, forward4>, forwardScalar<8, forward8>, inverseScalar<4, inverse4>,
+    inverseScalar<8, inverse8>, forwardDcScalar,            inverseDcScalar,
+    quantizeScalar,             dequantizeScalar,
+};
+
+} // namespace
+
+const TransformFunctions &getScalarTransformFunctions() {
+    return scalarFunctions;
+}
+
+const TransformFunctions &getTransformFunctions() {
+#ifdef TRANSFORM_HAVE_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return avx2Functions;
+    }
+#endif
+    return scalarFunctions;
+}
+
+QuantTables::QuantTables(int qp) : qp(qp) {
+    if (qp < 0 || qp > 51) {
+        throw std::runtime_error("QP out of range: " + std::to_string(qp));
+    }
+
+    const int remainder = qp % 6;
+    const int period = qp / 6;
+
+    for (int i = 0; i < 16; ++i) {
+        int positionClass = (i & 1) + ((i >> 2) & 1);
+        quant4x4[i] = quant4Scale[remainder][positionClass];
+        dequant4x4[i] = dequant4Scale[remainder][positionClass] << period;
+        quantDc[i] = quant4Scale[remainder][0];
+    }
+    for (int i = 0; i < 64; ++i) {
+        int positionClass = class8x8[((i >> 3) & 3) * 4 + (i & 3)];
+        quant8x8[i] = quant8Scale[remainder][positionClass];
+        dequant8x8[i] = dequant8Scale[remainder][positionClass];
+    }
+
+    quantShift4x4 = 15 + period;
+    quantShift8x8 = 16 + period;
+    quantShiftDc = 16 + period;
+
+    // 8x8 and DC scales carry two more bits than 4x4 ones; low QPs shift them back out with
+    // rounding, high QPs fold the difference into the scales
+    dequantShift8x8 = std::max(2 - period, 0);
+    dequantShiftDc = dequantShift8x8;
+    int extra = std::max(period - 2, 0);
+    for (int i = 0; i < 64; ++i) {
+        dequant8x8[i] <<= extra;
+    }
+    for (int i = 0; i < 16; ++i) {
+        dequantDc[i] = dequant4Scale[remainder][0] << extra;
+    }
+}
+
+int32_t QuantTables::deadzone(int shift, bool intra) {
+    return (1 << shift) / (intra ? 3 : 6);
+}
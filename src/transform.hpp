@@ -0,0 +1,167 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Computes the H.264 forward integer transform of a residual block
+ * @param coefficients Receives the coefficients in raster order (row = vertical frequency)
+ * @param source Source block
+ * @param sourceStride Distance between rows of the source in bytes
+ * @param prediction Prediction block subtracted from the source
+ * @param predictionStride Distance between rows of the prediction in bytes
+ */
+using ForwardTransform = void (*)(int16_t *coefficients, const uint8_t *source,
+                                  ptrdiff_t sourceStride, const uint8_t *prediction,
+                                  ptrdiff_t predictionStride);
+
+/**
+ * @brief Computes the H.264 inverse integer transform and adds it to a prediction
+ *
+ * Coefficients must come from a conforming stream, i.e. every intermediate value of the
+ * transform fits in 16 bits
+ *
+ * @param block Holds the prediction and receives the reconstruction
+ * @param stride Distance between rows of the block in bytes
+ * @param coefficients Dequantised coefficients in raster order
+ */
+using InverseTransform = void (*)(uint8_t *block, ptrdiff_t stride, const int16_t *coefficients);
+
+/**
+ * @brief Applies the 4x4 Hadamard transform to the DC coefficients of an Intra16x16 macroblock
+ *
+ * The forward transform halves its output with rounding, the inverse does not scale
+ *
+ * @param dc The sixteen DC coefficients in raster order, transformed in place
+ */
+using DcTransform = void (*)(int16_t *dc);
+
+/**
+ * @brief Quantises coefficients with a deadzone
+ *
+ * Each level is sign(c) * ((|c| * multiplier + bias) >> shift), saturated to 16 bits
+ *
+ * @param coefficients Coefficients, replaced by their levels
+ * @param multipliers Multiplier of each coefficient position
+ * @param bias Rounding offset; below half of (1 << shift) it widens the zero bin
+ * @param shift Right shift of the scaled coefficients
+ * @param count Number of coefficients (a multiple of 16)
+ * @return Whether any level is non-zero
+ */
+using Quantize = bool (*)(int16_t *coefficients, const int32_t *multipliers, int32_t bias,
+                          int shift, int count);
+
+/**
+ * @brief Rescales quantised levels to coefficients
+ *
+ * Each coefficient is (level * scale + rounding) >> shift, saturated to 16 bits, where
+ * rounding is half of (1 << shift)
+ *
+ * @param coefficients Levels, replaced by their coefficients
+ * @param scales Scale of each coefficient position
+ * @param shift Right shift of the scaled levels
+ * @param count Number of coefficients (a multiple of 16)
+ */
+using Dequantize = void (*)(int16_t *coefficients, const int32_t *scales, int shift, int count);
+
+/**
+ * @struct TransformFunctions
+ * @brief Table of transform and quantisation kernels
+ */
+struct TransformFunctions {
+    /// @brief 4x4 forward transform
+    ForwardTransform forward4x4;
+
+    /// @brief 8x8 forward transform
+    ForwardTransform forward8x8;
+
+    /// @brief 4x4 inverse transform
+    InverseTransform inverse4x4;
+
+    /// @brief 8x8 inverse transform
+    InverseTransform inverse8x8;
+
+    /// @brief Forward luma DC Hadamard transform
+    DcTransform forwardDc;
+
+    /// @brief Inverse luma DC Hadamard transform
+    DcTransform inverseDc;
+
+    /// @brief Deadzone quantisation
+    Quantize quantize;
+
+    /// @brief Dequantisation
+    Dequantize dequantize;
+};
+
+/**
+ * @brief Returns the portable scalar kernels
+ *
+ * These are the reference implementations the SIMD kernels must match exactly
+ */
+const TransformFunctions &getScalarTransformFunctions();
+
+/**
+ * @brief Returns the fastest kernels supported by the running CPU
+ */
+const TransformFunctions &getTransformFunctions();
+
+/**
+ * @struct QuantTables
+ * @brief Quantisation multipliers and dequantisation scales of one QP (flat scaling matrices)
+ */
+struct QuantTables {
+    /**
+     * @brief Computes the tables of a QP
+     * @param qp Quantisation parameter (0 to 51)
+     * @throws std::runtime_error if the QP is out of range
+     */
+    explicit QuantTables(int qp);
+
+    /**
+     * @brief Returns the deadzone rounding offset of a quantiser shift
+     *
+     * Intra blocks are rounded up from a third of the step, inter blocks from a sixth, which
+     * trades a little distortion for many more zero levels
+     *
+     * @param shift The quantiser shift
+     * @param intra Whether the block is intra predicted
+     */
+    static int32_t deadzone(int shift, bool intra);
+
+    /// @brief The quantisation parameter
+    int qp;
+
+    /// @brief Multipliers of 4x4 AC blocks, and their shift
+    int32_t quant4x4[16];
+    int quantShift4x4;
+
+    /// @brief Multipliers of 8x8 blocks, and their shift
+    int32_t quant8x8[64];
+    int quantShift8x8;
+
+    /// @brief Multipliers of Hadamard-transformed luma DC coefficients, and their shift
+    int32_t quantDc[16];
+    int quantShiftDc;
+
+    /// @brief Scales of 4x4 blocks (shift 0)
+    int32_t dequant4x4[16];
+
+    /// @brief Scales of 8x8 blocks, and their shift
+    int32_t dequant8x8[64];
+    int dequantShift8x8;
+
+    /// @brief Scales of luma DC coefficients after the inverse Hadamard, and their shift
+    int32_t dequantDc[16];
+    int dequantShiftDc;
+};
+
+/// @brief Frame zig-zag scan of 4x4 blocks: the raster index of each scan position
+constexpr uint8_t zigzag4x4[16] = {0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15};
+
+/// @brief Frame zig-zag scan of 8x8 blocks: the raster index of each scan position
+constexpr uint8_t zigzag8x8[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
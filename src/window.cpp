@@ -1,5 +1,15 @@
 #include "window.hpp"
 #include "logger.hpp"
+#include "trace.hpp"
+#include <thread>
+
+namespace {
+
+/// @brief Longest the event loop sleeps before checking on the render thread, in seconds. The
+/// render thread wakes it when it stops, so this is only a backstop
+constexpr double eventTimeout = 0.25;
+
+} // namespace
 
 VulkanWindow::VulkanWindow(const uint32_t w, const uint32_t h) {
     width = w;
@@ -25,6 +35,19 @@ void VulkanWindow::init() {
 
     // Create the GLFW window. We're not using fullscreen (4th param) or OpenGL sharing (5th param)
     window = glfwCreateWindow(width, height, "Vulkan", nullptr, nullptr);
+    if (window == nullptr) {
+        return;
+    }
+
+    // The render thread learns of resizes and damage from these, through the command queue
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, onFramebufferResize);
+    glfwSetWindowRefreshCallback(window, onRefresh);
+
+    int framebufferW = 0, framebufferH = 0;
+    glfwGetFramebufferSize(window, &framebufferW, &framebufferH);
+    framebufferWidth = framebufferW;
+    framebufferHeight = framebufferH;
 }
 
 VkSurfaceKHR VulkanWindow::createSurface(VkInstance instance) {
@@ -39,17 +62,98 @@ VkSurfaceKHR VulkanWindow::createSurface(VkInstance instance) {
     return surface;
 }
 
-void VulkanWindow::pollEvents(const std::function<void()> &drawCallback) const {
-
+void VulkanWindow::runEventLoop(const WindowCallbacks &callbacks) {
     if (window == nullptr) {
-        throw std::runtime_error("cannot poll window events, window is null");
+        throw std::runtime_error("cannot run the window event loop, window is null");
+    }
+
+    renderStopped = false;
+    std::exception_ptr error;
+    std::thread renderThread([this, &callbacks, &error] {
+        Tracer::setThreadName("render");
+        try {
+            renderLoop(callbacks);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        renderStopped = true;
+        glfwPostEmptyEvent();
+    });
+
+    // Main window loop: sleep until events arrive, until the user closes the window
+    while (!glfwWindowShouldClose(window) && !renderStopped) {
+        glfwWaitEventsTimeout(eventTimeout);
+    }
+
+    sendCommand({CommandType::Close, 0, 0});
+    renderThread.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void VulkanWindow::sendCommand(const Command &command) {
+    // The render thread drains the queue before each frame, so it is only full for a moment
+    while (!commands.push(command)) {
+        if (renderStopped) {
+            return;
+        }
+        std::this_thread::yield();
     }
 
-    // Main window loop: poll events until the user closes the window
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-        drawCallback();
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wakeRequested = true;
     }
+    wakeCondition.notify_one();
+}
+
+void VulkanWindow::renderLoop(const WindowCallbacks &callbacks) {
+    bool visible = framebufferWidth > 0 && framebufferHeight > 0;
+    bool redraw = true;
+    while (true) {
+        Command command;
+        while (commands.pop(command)) {
+            switch (command.type) {
+            case CommandType::Close:
+                return;
+            case CommandType::Resize:
+                visible = command.width > 0 && command.height > 0;
+                if (visible && callbacks.resize) {
+                    callbacks.resize(command.width, command.height);
+                }
+                redraw = true;
+                break;
+            case CommandType::Redraw:
+                redraw = true;
+                break;
+            }
+        }
+
+        if (visible && (redraw || !callbacks.isAnimating || callbacks.isAnimating())) {
+            redraw = false;
+            callbacks.draw();
+            continue;
+        }
+
+        // Nothing to draw: sleep until the event loop sends a command
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wakeCondition.wait(lock, [this] { return wakeRequested; });
+        wakeRequested = false;
+    }
+}
+
+void VulkanWindow::onFramebufferResize(GLFWwindow *glfwWindow, int width, int height) {
+    auto *self = static_cast<VulkanWindow *>(glfwGetWindowUserPointer(glfwWindow));
+    self->framebufferWidth = width;
+    self->framebufferHeight = height;
+    self->sendCommand(
+        {CommandType::Resize, static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
+}
+
+void VulkanWindow::onRefresh(GLFWwindow *glfwWindow) {
+    auto *self = static_cast<VulkanWindow *>(glfwGetWindowUserPointer(glfwWindow));
+    self->sendCommand({CommandType::Redraw, 0, 0});
 }
 
 std::vector<const char *> VulkanWindow::getRequiredInstanceExtensions() const {
@@ -61,7 +165,8 @@ std::vector<const char *> VulkanWindow::getRequiredInstanceExtensions() const {
 }
 
 void VulkanWindow::getFrameBufferSize(int *width, int *height) const {
-    glfwGetFramebufferSize(window, width, height);
+    *width = framebufferWidth;
+    *height = framebufferHeight;
 }
 
 GLFWwindow *VulkanWindow::getGLFWWindow() const {
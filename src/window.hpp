@@ -1,9 +1,13 @@
 #pragma once
 #define GLFW_INCLUDE_VULKAN
+#include "spsc_queue.hpp"
 #include "surface_provider.hpp"
 #include <GLFW/glfw3.h>
+#include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
 #include <vector>
 
@@ -13,6 +17,23 @@ constexpr uint32_t WIDTH = 800;
 /// @brief Default window height in pixels
 constexpr uint32_t HEIGHT = 600;
 
+/**
+ * @struct WindowCallbacks
+ * @brief What the render thread of VulkanWindow::runEventLoop does. All run on that thread
+ */
+struct WindowCallbacks {
+    /// @brief Draws and presents one frame
+    std::function<void()> draw;
+
+    /// @brief Called with the new framebuffer size in pixels before the next frame is drawn
+    std::function<void(uint32_t width, uint32_t height)> resize;
+
+    /// @brief Returns whether the next frame would differ from the last one drawn. While it
+    /// returns false, the render thread sleeps until the window needs redrawing. If unset,
+    /// frames are drawn continuously
+    std::function<bool()> isAnimating;
+};
+
 /**
  * @class VulkanWindow
  * @brief Manages the creation and display of a GLFW window for Vulkan rendering
@@ -34,9 +55,17 @@ class VulkanWindow : public SurfaceProvider {
     ~VulkanWindow();
 
     /**
-     * @brief Starts the event loop for the window
+     * @brief Runs the event loop until the window is closed, drawing on a render thread
+     *
+     * The calling thread, which must be the main thread, sleeps in glfwWaitEventsTimeout and
+     * passes resizes, redraw requests and the close to the render thread through a lock-free
+     * queue. Slow input handling therefore never delays a frame, and no core spins while the
+     * window is idle. While the framebuffer has zero size, as when minimised, nothing is drawn
+     *
+     * @param callbacks What the render thread does
+     * @throws The exception raised by a callback, after the render thread has stopped
      */
-    void pollEvents(const std::function<void()> &drawCallback) const;
+    void runEventLoop(const WindowCallbacks &callbacks);
 
     /**
      * @brief Creates a Vulkan-compatible surface from the GLFW window
@@ -52,7 +81,8 @@ class VulkanWindow : public SurfaceProvider {
     std::vector<const char *> getRequiredInstanceExtensions() const override;
 
     /**
-     * @brief Retrieves the current size of the framebuffer in pixels
+     * @brief Retrieves the current size of the framebuffer in pixels. Unlike GLFW's query,
+     * this may be called from the render thread
      * @param width Reference to an integer that will receive the framebuffer width
      * @param height Reference to an integer that will receive the framebuffer height
      */
@@ -74,8 +104,68 @@ class VulkanWindow : public SurfaceProvider {
     /// @brief Height of the created window in pixels
     uint32_t height;
 
+    /**
+     * @enum CommandType
+     * @brief Kind of a command from the event loop to the render thread
+     */
+    enum class CommandType { Resize, Redraw, Close };
+
+    /**
+     * @struct Command
+     * @brief A command from the event loop to the render thread
+     */
+    struct Command {
+        CommandType type = CommandType::Redraw;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+
+    /// @brief Commands from the event loop to the render thread
+    SpscQueue<Command, 64> commands;
+
+    /// @brief Framebuffer size, updated by the event loop for the render thread
+    std::atomic<int> framebufferWidth{0};
+
+    /// @brief Framebuffer height, updated by the event loop for the render thread
+    std::atomic<int> framebufferHeight{0};
+
+    /// @brief Guards wakeRequested. The queue does not need it; it only lets the render thread
+    /// sleep when idle
+    std::mutex wakeMutex;
+
+    /// @brief Signalled when a command is queued
+    std::condition_variable wakeCondition;
+
+    /// @brief Set when a command is queued, cleared by the render thread when it wakes
+    bool wakeRequested = false;
+
+    /// @brief Set while no render thread runs. Set by the render thread when it stops, which
+    /// ends the event loop
+    std::atomic<bool> renderStopped{true};
+
     /**
      * @brief Initialises GLFW and creates the window
      */
     void init();
+
+    /**
+     * @brief Queues a command for the render thread and wakes it. Waits while the queue is full
+     */
+    void sendCommand(const Command &command);
+
+    /**
+     * @brief Draws frames and applies commands until told to close
+     * @param callbacks What to draw and how to resize
+     */
+    void renderLoop(const WindowCallbacks &callbacks);
+
+    /**
+     * @brief Queues a resize when the framebuffer size changes; called by GLFW
+     */
+    static void onFramebufferResize(GLFWwindow *window, int width, int height);
+
+    /**
+     * @brief Queues a redraw when the window contents are damaged; called by GLFW
+     */
+    static void onRefresh(GLFWwindow *window);
 };
@@ -0,0 +1,85 @@
+#include "yuv_frame.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// BT.601 limited-range coefficients in 8.8 fixed point
+uint8_t toLuma(int r, int g, int b) {
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+uint8_t toCb(int r, int g, int b) {
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+uint8_t toCr(int r, int g, int b) {
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+} // namespace
+
+void YuvFrame::allocate(uint32_t pictureWidth, uint32_t pictureHeight) {
+    width = (pictureWidth + 15) & ~15u;
+    height = (pictureHeight + 15) & ~15u;
+    planes[0].resize(static_cast<size_t>(width) * height);
+    planes[1].resize(static_cast<size_t>(width / 2) * (height / 2));
+    planes[2].resize(planes[1].size());
+}
+
+PlaneView YuvFrame::view(int plane) const {
+    uint32_t shift = plane == 0 ? 0 : 1;
+    return {planes[plane].data(), width >> shift, height >> shift, stride(plane)};
+}
+
+void convertRgbaToYuv420(const uint8_t *rgba, ptrdiff_t stride, uint32_t width, uint32_t height,
+                         const Yuv420Planes &planes) {
+    // Pixels beyond the image repeat its last column and row
+    auto pixel = [&](uint32_t x, uint32_t y) {
+        return rgba + std::min(y, height - 1) * stride + std::min(x, width - 1) * 4;
+    };
+
+    for (uint32_t y = 0; y < planes.height; y += 2) {
+        uint8_t *cb = planes.cb + (y / 2) * planes.chromaStride;
+        uint8_t *cr = planes.cr + (y / 2) * planes.chromaStride;
+        for (uint32_t x = 0; x < planes.width; x += 2) {
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for (uint32_t i = 0; i < 4; ++i) {
+                uint32_t px = x + (i & 1);
+                uint32_t py = y + (i >> 1);
+                const uint8_t *p = pixel(px, py);
+                if (px < planes.width && py < planes.height) {
+                    planes.luma[py * planes.lumaStride + px] = toLuma(p[0], p[1], p[2]);
+                }
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            r = (r + 2) >> 2;
+            g = (g + 2) >> 2;
+            b = (b + 2) >> 2;
+            cb[(x / 2) * planes.chromaStep] = toCb(r, g, b);
+            cr[(x / 2) * planes.chromaStep] = toCr(r, g, b);
+        }
+    }
+}
+
+void convertRgbaToYuv(const uint8_t *rgba, ptrdiff_t stride, uint32_t width, uint32_t height,
+                      YuvFrame &frame) {
+    if (width == 0 || height == 0 || frame.width != ((width + 15) & ~15u) ||
+        frame.height != ((height + 15) & ~15u)) {
+        throw std::runtime_error("frame is not allocated for the image size");
+    }
+
+    Yuv420Planes planes;
+    planes.luma = frame.planes[0].data();
+    planes.lumaStride = frame.stride(0);
+    planes.cb = frame.planes[1].data();
+    planes.cr = frame.planes[2].data();
+    planes.chromaStride = frame.stride(1);
+    planes.width = frame.width;
+    planes.height = frame.height;
+    convertRgbaToYuv420(rgba, stride, width, height, planes);
+}
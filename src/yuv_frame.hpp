@@ -0,0 +1,101 @@
+#pragma once
+#include "pixel.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @struct YuvFrame
+ * @brief An 8-bit 4:2:0 frame in three planes (I420), sized in whole macroblocks
+ *
+ * Pictures whose size is not a multiple of 16 are padded to one by replicating their last
+ * column and row; the encoder crops the padding off again in the sequence header
+ */
+struct YuvFrame {
+    /// @brief Width of the luma plane in pixels (a multiple of 16)
+    uint32_t width = 0;
+
+    /// @brief Height of the luma plane in pixels (a multiple of 16)
+    uint32_t height = 0;
+
+    /// @brief Y, Cb and Cr planes. Rows are packed: luma rows are "width" bytes apart, chroma
+    /// rows "width / 2"
+    std::array<std::vector<uint8_t>, 3> planes;
+
+    /**
+     * @brief Sizes the planes for a picture, rounding its dimensions up to whole macroblocks
+     * @param pictureWidth Width of the picture in pixels
+     * @param pictureHeight Height of the picture in pixels
+     */
+    void allocate(uint32_t pictureWidth, uint32_t pictureHeight);
+
+    /**
+     * @brief Returns a view of one plane
+     * @param plane Plane index (0 Y, 1 Cb, 2 Cr)
+     */
+    PlaneView view(int plane) const;
+
+    /**
+     * @brief Returns the distance between rows of a plane in bytes
+     * @param plane Plane index (0 Y, 1 Cb, 2 Cr)
+     */
+    ptrdiff_t stride(int plane) const { return plane == 0 ? width : width / 2; }
+};
+
+/**
+ * @struct Yuv420Planes
+ * @brief Destination of a 4:2:0 conversion, planar (I420) or semi-planar (NV12)
+ */
+struct Yuv420Planes {
+    /// @brief First luma sample
+    uint8_t *luma = nullptr;
+
+    /// @brief Distance between luma rows in bytes
+    ptrdiff_t lumaStride = 0;
+
+    /// @brief First Cb and Cr samples (cr = cb + 1 for NV12)
+    uint8_t *cb = nullptr;
+    uint8_t *cr = nullptr;
+
+    /// @brief Distance between chroma rows in bytes
+    ptrdiff_t chromaStride = 0;
+
+    /// @brief Distance between chroma samples of a row: 1 for I420, 2 for NV12
+    ptrdiff_t chromaStep = 1;
+
+    /// @brief Size of the luma plane in pixels; the chroma planes are half of it, rounded up
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+/**
+ * @brief Converts an RGBA image to BT.601 limited-range 4:2:0 planes of any layout
+ *
+ * Each chroma sample is converted from the average of a 2x2 block of pixels. Planes larger
+ * than the image are filled by edge replication
+ *
+ * @param rgba First pixel of the image, four bytes per pixel (R, G, B, A)
+ * @param stride Distance between rows of the image in bytes
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param planes Receive the converted image, at least as large as it
+ */
+void convertRgbaToYuv420(const uint8_t *rgba, ptrdiff_t stride, uint32_t width, uint32_t height,
+                         const Yuv420Planes &planes);
+
+/**
+ * @brief Converts an RGBA image to BT.601 limited-range 4:2:0
+ *
+ * Each chroma sample is converted from the average of a 2x2 block of pixels. The frame must
+ * have been allocated for the image's size; its padding is filled by edge replication
+ *
+ * @param rgba First pixel of the image, four bytes per pixel (R, G, B, A)
+ * @param stride Distance between rows of the image in bytes
+ * @param width Width of the image in pixels
+ * @param height Height of the image in pixels
+ * @param frame Receives the converted frame
+ * @throws std::runtime_error if the frame was allocated for a different size
+ */
+void convertRgbaToYuv(const uint8_t *rgba, ptrdiff_t stride, uint32_t width, uint32_t height,
+                      YuvFrame &frame);
@@ -0,0 +1,645 @@
+/**
+ * @file cabac_test.cpp
+ * @brief Checks the CABAC coder against a decoder written from the standard and times it
+ *
+ * The decoder follows the arithmetic decoding engine of H.264 9.3.3.2 and the residual block
+ * syntax of 7.3.5.3.3, with its own context offsets and state transitions, so it shares only
+ * the LPS range table with the encoder. Two kinds of slices are round-tripped through it:
+ *
+ * - Random sequences of decision, bypass and terminate bins. Contexts get skewed bin
+ *   probabilities, so their states reach both ends of the table. Each sequence ends with a
+ *   terminating one, and the rbsp_stop_one_bit and alignment that follow it are checked too.
+ * - Random residual blocks of every category, with levels from single ones to the largest
+ *   that fit an int16_t, which exercises the Exp-Golomb suffix.
+ *
+ * Every slice starts from the contexts of a random SliceQP, slice type and cabac_init_idc.
+ * The decoded bins and levels must match the coded ones. The bin counter must count as many
+ * bins as the decoder reads, and the estimator must leave the contexts as the encoder does.
+ * The first mismatch of each check is printed, and the exit status is non-zero if there is
+ * any.
+ *
+ * Afterwards, the residual of a 1080p frame is coded and estimated for a number of rounds,
+ * and the throughput is printed in bins per second. Build with MODE=release for meaningful
+ * timings.
+ *
+ * Usage: cabac_test [--cases N] [--rounds N]
+ */
+#include "cabac.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @struct Checker
+ * @brief Counts mismatches and reports the first of each check
+ */
+struct Checker {
+    /// @brief Checks with at least one mismatch
+    int failedChecks = 0;
+
+    /// @brief Comparisons made
+    uint64_t comparisons = 0;
+
+    /// @brief Name of the check being run
+    std::string check;
+
+    /// @brief Whether the check being run has mismatched already
+    bool failed = false;
+
+    void begin(const std::string &name) {
+        check = name;
+        failed = false;
+    }
+
+    /**
+     * @brief Records the outcome of a comparison
+     * @param equal Whether the values match
+     * @param what Description of the inputs, printed on the first mismatch
+     */
+    void expect(bool equal, const std::string &what) {
+        ++comparisons;
+        if (!equal && !failed) {
+            failed = true;
+            ++failedChecks;
+            std::printf("FAIL %s: %s\n", check.c_str(), what.c_str());
+        }
+    }
+};
+
+/// @brief transIdxLPS of Table 9-45, by pStateIdx
+constexpr uint8_t transIdxLps[64] = {
+    0,  0,  1,  2,  2,  4,  4,  5,  6,  7,  8,  9,  9,  11, 11, 12,
+    13, 13, 15, 15, 16, 16, 18, 18, 19, 19, 21, 21, 22, 22, 23, 24,
+    24, 25, 26, 26, 27, 27, 28, 29, 29, 30, 30, 30, 31, 32, 32, 33,
+    33, 33, 34, 34, 35, 35, 35, 36, 36, 36, 37, 37, 37, 38, 38, 63,
+};
+
+/**
+ * @class CabacDecoder
+ * @brief Arithmetic decoding engine of H.264 9.3.3.2, bit by bit as the standard writes it
+ */
+class CabacDecoder {
+  public:
+    /**
+     * @brief Initialises the engine (9.3.1.2) on coded bytes, with the contexts of a model
+     */
+    CabacDecoder(const std::vector<uint8_t> &bytes, const CabacContextModel &model)
+        : bytes(bytes) {
+        for (size_t i = 0; i < cabacContextCount; ++i) {
+            uint8_t packed = model.getContext(static_cast<int>(i));
+            states[i] = packed >> 1;
+            mps[i] = packed & 1;
+        }
+        offset = readBits(9);
+    }
+
+    /**
+     * @brief DecodeDecision (9.3.3.2.1)
+     */
+    int decodeDecision(int context) {
+        ++bins;
+        int state = states[context];
+        uint32_t rangeLps = cabacRangeLps[state][(range >> 6) & 3];
+        range -= rangeLps;
+        int bin;
+        if (offset >= range) {
+            bin = !mps[context];
+            offset -= range;
+            range = rangeLps;
+            if (state == 0) {
+                mps[context] = 1 - mps[context];
+            }
+            states[context] = transIdxLps[state];
+        } else {
+            bin = mps[context];
+            states[context] = static_cast<uint8_t>(state < 62 ? state + 1 : 62);
+        }
+        while (range < 256) {
+            range <<= 1;
+            offset = (offset << 1) | readBits(1);
+        }
+        return bin;
+    }
+
+    /**
+     * @brief DecodeBypass (9.3.3.2.3)
+     */
+    int decodeBypass() {
+        ++bins;
+        offset = (offset << 1) | readBits(1);
+        if (offset >= range) {
+            offset -= range;
+            return 1;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief DecodeTerminate (9.3.3.2.2.3)
+     *
+     * After a one, the rbsp_stop_one_bit is the last bit the engine has read (9.3.4.6)
+     */
+    int decodeTerminate() {
+        ++bins;
+        range -= 2;
+        if (offset >= range) {
+            return 1;
+        }
+        while (range < 256) {
+            range <<= 1;
+            offset = (offset << 1) | readBits(1);
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Returns the packed state of a context, as CabacContextModel stores it
+     */
+    uint8_t getContext(int context) const {
+        return static_cast<uint8_t>((states[context] << 1) | mps[context]);
+    }
+
+    /**
+     * @brief Returns the number of bits read
+     */
+    size_t getPosition() const { return position; }
+
+    /**
+     * @brief Returns whether the engine read past the end of the bytes
+     */
+    bool isOverrun() const { return overrun; }
+
+    /**
+     * @brief Returns the number of bins decoded
+     */
+    uint64_t getBins() const { return bins; }
+
+  protected:
+    /// @brief The coded bytes
+    const std::vector<uint8_t> &bytes;
+
+    /// @brief pStateIdx of each context
+    std::array<uint8_t, cabacContextCount> states{};
+
+    /// @brief valMPS of each context
+    std::array<uint8_t, cabacContextCount> mps{};
+
+    /// @brief codIRange
+    uint32_t range = 510;
+
+    /// @brief codIOffset
+    uint32_t offset = 0;
+
+    /// @brief Bits read so far
+    size_t position = 0;
+
+    /// @brief Whether a read went past the end of the bytes
+    bool overrun = false;
+
+    /// @brief Bins decoded so far
+    uint64_t bins = 0;
+
+    uint32_t readBits(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; ++i, ++position) {
+            int bit = 0;
+            if (position < bytes.size() * 8) {
+                bit = (bytes[position / 8] >> (7 - position % 8)) & 1;
+            } else {
+                overrun = true;
+            }
+            value = (value << 1) | bit;
+        }
+        return value;
+    }
+};
+
+/// @brief ctxIdxOffset of coded_block_flag, significant_coeff_flag,
+/// last_significant_coeff_flag and coeff_abs_level_minus1 (Table 9-34, frame macroblocks), by
+/// ctxBlockCat. Luma 8x8 blocks (ctxBlockCat 5) have their own offsets and no coded_block_flag
+constexpr int codedBlockFlagContexts[5] = {85 + 0, 85 + 4, 85 + 8, 85 + 12, 85 + 16};
+constexpr int significantContexts[6] = {105 + 0, 105 + 15, 105 + 29, 105 + 44, 105 + 47, 402};
+constexpr int lastSignificantContexts[6] = {166 + 0, 166 + 15, 166 + 29,
+                                            166 + 44, 166 + 47, 417};
+constexpr int absLevelContexts[6] = {227 + 0, 227 + 10, 227 + 20, 227 + 30, 227 + 39, 426};
+
+/// @brief maxNumCoeff, by ctxBlockCat
+constexpr int maxCoefficients[6] = {16, 15, 16, 4, 15, 64};
+
+/// @brief ctxIdxInc of significant_coeff_flag (frame coded) and last_significant_coeff_flag of
+/// 8x8 blocks, by levelListIdx (Table 9-43)
+constexpr uint8_t significant8x8[63] = {
+    0,  1,  2,  3,  4,  5,  5,  4,  4,  3,  3,  4,  4,  4,  5,  5,  4,  4,  4,  4,  3,
+    3,  6,  7,  7,  7,  8,  9,  10, 9,  8,  7,  7,  6,  11, 12, 13, 11, 6,  7,  8,  9,
+    14, 10, 9,  8,  6,  11, 12, 13, 11, 6,  9,  14, 10, 9,  11, 12, 13, 11, 14, 10, 12,
+};
+constexpr uint8_t lastSignificant8x8[63] = {
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8,
+};
+
+/**
+ * @brief Parses residual_block_cabac (7.3.5.3.3) into levels in scan order
+ *
+ * coeff_abs_level_minus1 is a UEG0 value with signedValFlag 0 and uCoff 14 (9.3.2.3), and its
+ * ctxIdxInc follows 9.3.3.1.3
+ */
+void readResidual(CabacDecoder &decoder, int16_t *levels, CabacBlockCategory category,
+                  int codedBlockFlagInc) {
+    int cat = static_cast<int>(category);
+    int count = maxCoefficients[cat];
+    std::fill(levels, levels + count, 0);
+    if (category != CabacBlockCategory::Luma8x8 &&
+        !decoder.decodeDecision(codedBlockFlagContexts[cat] + codedBlockFlagInc)) {
+        return;
+    }
+
+    std::array<bool, 64> significant{};
+    int numCoeff = count;
+    for (int i = 0; i < numCoeff - 1; ++i) {
+        int inc = i;
+        int lastInc = i;
+        if (category == CabacBlockCategory::Luma8x8) {
+            inc = significant8x8[i];
+            lastInc = lastSignificant8x8[i];
+        } else if (category == CabacBlockCategory::ChromaDc) {
+            // NumC8x8 is 1 in 4:2:0
+            inc = lastInc = std::min(i, 2);
+        }
+        significant[i] = decoder.decodeDecision(significantContexts[cat] + inc);
+        if (significant[i] && decoder.decodeDecision(lastSignificantContexts[cat] + lastInc)) {
+            numCoeff = i + 1;
+        }
+    }
+    significant[numCoeff - 1] = true;
+
+    int numDecodAbsLevelEq1 = 0;
+    int numDecodAbsLevelGt1 = 0;
+    int maxGt1Inc = 4 - (category == CabacBlockCategory::ChromaDc ? 1 : 0);
+    for (int i = numCoeff - 1; i >= 0; --i) {
+        if (!significant[i]) {
+            continue;
+        }
+        int first = numDecodAbsLevelGt1 != 0 ? 0 : std::min(4, 1 + numDecodAbsLevelEq1);
+        int rest = 5 + std::min(maxGt1Inc, numDecodAbsLevelGt1);
+        uint32_t value = 0;
+        if (decoder.decodeDecision(absLevelContexts[cat] + first)) {
+            value = 1;
+            while (value < 14 && decoder.decodeDecision(absLevelContexts[cat] + rest)) {
+                ++value;
+            }
+        }
+        if (value == 14) {
+            // Exp-Golomb suffix of order 0 (9.3.2.3)
+            int k = 0;
+            while (decoder.decodeBypass()) {
+                value += 1u << k;
+                ++k;
+            }
+            while (k-- > 0) {
+                value += static_cast<uint32_t>(decoder.decodeBypass()) << k;
+            }
+        }
+        int level = static_cast<int>(value) + 1;
+        levels[i] = static_cast<int16_t>(decoder.decodeBypass() ? -level : level);
+        if (level == 1) {
+            ++numDecodAbsLevelEq1;
+        } else {
+            ++numDecodAbsLevelGt1;
+        }
+    }
+}
+
+/**
+ * @brief Initialises a model with the contexts of a random slice
+ * @return Description of the slice, for mismatch reports
+ */
+std::string initializeRandomSlice(CabacContextModel &model, std::mt19937 &random) {
+    int qp = static_cast<int>(random() % 52);
+    int cabacInitIdc = static_cast<int>(random() % 4);
+    bool intra = cabacInitIdc == 3;
+    model.initialize(qp, intra, intra ? 0 : cabacInitIdc);
+    return "qp " + std::to_string(qp) +
+           (intra ? " intra" : " cabac_init_idc " + std::to_string(cabacInitIdc));
+}
+
+/**
+ * @brief Checks that the coded bytes end at the stop bit, the last bit the decoder read, and
+ * that only zero bits follow it in its byte
+ */
+void checkTermination(Checker &checker, const CabacDecoder &decoder,
+                      const std::vector<uint8_t> &bytes, const std::string &what) {
+    size_t stopBit = decoder.getPosition() - 1;
+    bool terminated = !decoder.isOverrun() && bytes.size() == stopBit / 8 + 1;
+    if (terminated) {
+        uint8_t tail = static_cast<uint8_t>(0xff >> (stopBit % 8));
+        terminated = (bytes.back() & tail) == (0x80 >> (stopBit % 8));
+    }
+    checker.expect(terminated, "no stop bit and alignment after the last bin, " + what);
+}
+
+void checkArithmetic(Checker &checker, int cases, std::mt19937 &random) {
+    checker.begin("arithmetic");
+    // Kind 0 is a decision, 1 a bypass and 2 a terminate bin
+    struct Bin {
+        int kind;
+        int context;
+        int value;
+    };
+    std::vector<Bin> bins;
+    CabacEncoder encoder;
+    for (int c = 0; c < cases; ++c) {
+        CabacContextModel model;
+        std::string what =
+            "case " + std::to_string(c) + ", " + initializeRandomSlice(model, random);
+        static_cast<CabacContextModel &>(encoder) = model;
+        encoder.reset();
+        CabacBinCounter counter;
+
+        // A few contexts, each with its own probability of a one, from never to always
+        int contextCount = 1 + static_cast<int>(random() % 8);
+        std::array<int, 8> contexts;
+        std::array<uint32_t, 8> ones;
+        for (int i = 0; i < contextCount; ++i) {
+            contexts[i] = static_cast<int>(random() % cabacContextCount);
+            ones[i] = random() % 1001;
+        }
+
+        bins.clear();
+        int length = static_cast<int>(random() % 2000);
+        for (int i = 0; i < length; ++i) {
+            uint32_t kind = random() % 16;
+            Bin bin = {0, 0, 0};
+            if (kind < 12) {
+                int index = static_cast<int>(random() % contextCount);
+                bin = {0, contexts[index], random() % 1000 < ones[index]};
+                encoder.encodeDecision(bin.context, bin.value);
+                counter.encodeDecision(bin.context, bin.value);
+            } else if (kind < 15) {
+                bin = {1, 0, static_cast<int>(random() % 2)};
+                encoder.encodeBypass(bin.value);
+                counter.encodeBypass(bin.value);
+            } else {
+                bin = {2, 0, 0};
+                encoder.encodeTerminate(0);
+                counter.encodeTerminate(0);
+            }
+            bins.push_back(bin);
+        }
+        bins.push_back({2, 0, 1});
+        encoder.encodeTerminate(1);
+        counter.encodeTerminate(1);
+
+        CabacDecoder decoder(encoder.getBytes(), model);
+        for (size_t i = 0; i < bins.size(); ++i) {
+            const Bin &bin = bins[i];
+            int value = bin.kind == 0   ? decoder.decodeDecision(bin.context)
+                        : bin.kind == 1 ? decoder.decodeBypass()
+                                        : decoder.decodeTerminate();
+            checker.expect(value == bin.value, "bin " + std::to_string(i) + " of " +
+                                                   std::to_string(bins.size()) + " differs, " +
+                                                   what);
+            if (value != bin.value) {
+                break;
+            }
+        }
+        for (int i = 0; i < contextCount; ++i) {
+            checker.expect(decoder.getContext(contexts[i]) == encoder.getContext(contexts[i]),
+                           "context " + std::to_string(contexts[i]) + " differs, " + what);
+        }
+        checkTermination(checker, decoder, encoder.getBytes(), what);
+        checker.expect(counter.getBins() == decoder.getBins(),
+                       std::to_string(counter.getBins()) + " bins counted, " +
+                           std::to_string(decoder.getBins()) + " decoded, " + what);
+    }
+}
+
+/**
+ * @brief Fills a block with random levels
+ *
+ * Pattern 0 is sparse small levels, 1 is dense small levels, 2 mixes in levels large enough
+ * for an Exp-Golomb suffix, up to the int16_t range, and 3 is all zero
+ */
+void fillLevels(int16_t *levels, int count, int pattern, std::mt19937 &random) {
+    for (int i = 0; i < count; ++i) {
+        int level = 0;
+        if (pattern == 0 && random() % 4 == 0) {
+            level = 1 + static_cast<int>(random() % 3);
+        } else if (pattern == 1) {
+            level = 1 + static_cast<int>(random() % 20);
+        } else if (pattern == 2 && random() % 2 == 0) {
+            level = 1 + static_cast<int>(random() % (random() % 2 ? 32 : 32767));
+        }
+        levels[i] = static_cast<int16_t>(random() % 2 ? level : -level);
+    }
+}
+
+void checkResidual(Checker &checker, int cases, std::mt19937 &random) {
+    checker.begin("residual");
+    struct Block {
+        CabacBlockCategory category;
+        int codedBlockFlagInc;
+        std::array<int16_t, 64> levels;
+    };
+    std::vector<Block> blocks;
+    CabacEncoder encoder;
+    for (int c = 0; c < cases; ++c) {
+        CabacContextModel model;
+        std::string what =
+            "case " + std::to_string(c) + ", " + initializeRandomSlice(model, random);
+        static_cast<CabacContextModel &>(encoder) = model;
+        encoder.reset();
+        CabacEstimator estimator(model);
+        CabacBinCounter counter;
+
+        // Each block is followed by a zero end_of_slice_flag, as a macroblock would be
+        blocks.clear();
+        int blockCount = 1 + static_cast<int>(random() % 64);
+        for (int i = 0; i < blockCount; ++i) {
+            Block block = {static_cast<CabacBlockCategory>(random() % 6),
+                           static_cast<int>(random() % 4),
+                           {}};
+            int count = maxCoefficients[static_cast<int>(block.category)];
+            fillLevels(block.levels.data(), count, static_cast<int>(random() % 4), random);
+            // 8x8 blocks have no coded_block_flag, so they must have a level
+            if (block.category == CabacBlockCategory::Luma8x8 &&
+                std::all_of(block.levels.begin(), block.levels.end(),
+                            [](int16_t level) { return level == 0; })) {
+                block.levels[random() % count] = 1;
+            }
+            blocks.push_back(block);
+            writeCabacResidual(encoder, block.levels.data(), block.category,
+                               block.codedBlockFlagInc);
+            writeCabacResidual(estimator, block.levels.data(), block.category,
+                               block.codedBlockFlagInc);
+            writeCabacResidual(counter, block.levels.data(), block.category,
+                               block.codedBlockFlagInc);
+            int endOfSlice = i == blockCount - 1;
+            encoder.encodeTerminate(endOfSlice);
+            counter.encodeTerminate(endOfSlice);
+        }
+
+        CabacDecoder decoder(encoder.getBytes(), model);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            const Block &block = blocks[i];
+            std::array<int16_t, 64> levels{};
+            readResidual(decoder, levels.data(), block.category, block.codedBlockFlagInc);
+            bool equal = levels == block.levels;
+            checker.expect(equal, "block " + std::to_string(i) + " of category " +
+                                      std::to_string(static_cast<int>(block.category)) +
+                                      " differs, " + what);
+            int endOfSlice = decoder.decodeTerminate();
+            checker.expect(endOfSlice == (i == blocks.size() - 1),
+                           "end_of_slice_flag after block " + std::to_string(i) +
+                               " differs, " + what);
+            if (!equal) {
+                break;
+            }
+        }
+        checkTermination(checker, decoder, encoder.getBytes(), what);
+        checker.expect(counter.getBins() == decoder.getBins(),
+                       std::to_string(counter.getBins()) + " bins counted, " +
+                           std::to_string(decoder.getBins()) + " decoded, " + what);
+
+        bool sameContexts = true;
+        for (size_t i = 0; i < cabacContextCount; ++i) {
+            int context = static_cast<int>(i);
+            sameContexts &= estimator.getContext(context) == encoder.getContext(context);
+        }
+        checker.expect(sameContexts, "the estimator's contexts differ from the encoder's, " +
+                                         what);
+    }
+}
+
+/**
+ * @brief Codes the residual of a 1080p frame and prints the throughput in bins per second
+ *
+ * The residual is made up of random 4x4 and 8x8 luma blocks whose levels shrink with
+ * frequency, as quantised coefficients do. Each round initialises an I slice and codes every
+ * block, once with the arithmetic coder and once with the estimator used to price coding
+ * decisions
+ *
+ * @param rounds Rounds timed per coder
+ */
+void benchmark(int rounds, std::mt19937 &random) {
+    const uint32_t macroblocks = (1920 / 16) * (1088 / 16);
+    const int qp = 26;
+
+    // Half of the macroblocks use 4x4 transforms, the other half 8x8 ones
+    struct Block {
+        CabacBlockCategory category;
+        std::array<int16_t, 64> levels;
+    };
+    std::vector<Block> blocks;
+    std::geometric_distribution<int> magnitude(0.6);
+    for (uint32_t mb = 0; mb < macroblocks; ++mb) {
+        bool transform8x8 = mb % 2 == 1;
+        int count = transform8x8 ? 64 : 16;
+        for (int i = 0; i < (transform8x8 ? 4 : 16); ++i) {
+            Block block = {transform8x8 ? CabacBlockCategory::Luma8x8
+                                        : CabacBlockCategory::Luma4x4,
+                           {}};
+            for (int j = 0; j < count; ++j) {
+                // Roughly one coefficient in two is significant at DC, falling with frequency
+                if (random() % count < static_cast<uint32_t>(count - j) / 2) {
+                    int level = 1 + magnitude(random) * (count - j) / count;
+                    block.levels[j] = static_cast<int16_t>(random() % 2 ? level : -level);
+                }
+            }
+            // 8x8 blocks have no coded_block_flag, so they must be coded
+            if (transform8x8 && block.levels[0] == 0) {
+                block.levels[0] = 1;
+            }
+            blocks.push_back(block);
+        }
+    }
+
+    CabacBinCounter counter;
+    for (const Block &block : blocks) {
+        writeCabacResidual(counter, block.levels.data(), block.category, 0);
+    }
+    const double bins = static_cast<double>(counter.getBins()) * rounds;
+
+    auto getSeconds = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    CabacEncoder encoder;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        encoder.reset();
+        encoder.initialize(qp, true);
+        for (const Block &block : blocks) {
+            writeCabacResidual(encoder, block.levels.data(), block.category, 0);
+        }
+        encoder.encodeTerminate(1);
+        bytes += encoder.getBytes().size();
+    }
+    double encodeSeconds = getSeconds(start);
+
+    CabacEstimator estimator;
+    uint64_t cost = 0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        estimator.initialize(qp, true);
+        estimator.clearCost();
+        for (const Block &block : blocks) {
+            writeCabacResidual(estimator, block.levels.data(), block.category, 0);
+        }
+        cost += estimator.getCost();
+    }
+    double estimateSeconds = getSeconds(start);
+
+    std::printf("%zu blocks, %.2f Mbins per round\n", blocks.size(), counter.getBins() / 1e6);
+    std::printf("encode   %9.2f Mbins/s  %.2f bits per bin\n", bins / encodeSeconds / 1e6,
+                bytes * 8.0 / bins);
+    std::printf("estimate %9.2f Mbins/s  %.2f%% of the coded size\n",
+                bins / estimateSeconds / 1e6, cost / 256.0 / (bytes * 8.0) * 100.0);
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: cabac_test [--cases N] [--rounds N]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int cases = 2000;
+    int rounds = 20;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char *end = nullptr;
+        long value = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : -1;
+        if ((arg != "--cases" && arg != "--rounds") || end == nullptr || *end != '\0' ||
+            value < 0 || value > 1000000000) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        (arg == "--cases" ? cases : rounds) = static_cast<int>(value);
+        ++i;
+    }
+
+    std::mt19937 random(1);
+    Checker checker;
+    checkArithmetic(checker, cases, random);
+    checkResidual(checker, cases, random);
+    std::printf("%llu comparisons, %d checks mismatched\n",
+                static_cast<unsigned long long>(checker.comparisons), checker.failedChecks);
+    if (checker.failedChecks > 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (rounds > 0) {
+        benchmark(rounds, random);
+    }
+    return EXIT_SUCCESS;
+}
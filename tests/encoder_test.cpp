@@ -0,0 +1,296 @@
+/**
+ * @file encoder_test.cpp
+ * @brief Checks that streams of the software encoder decode to exactly its reconstruction
+ *
+ * Each case codes synthetic frames with the software encoder, writes the stream to a file and
+ * decodes it with ffmpeg (libavcodec). The encoder's quality meter reports the PSNR and SSIM
+ * of every reconstructed frame against its source; the decoded frames are measured against
+ * the same sources by the same meter, and the results must be identical. As any differing
+ * sample changes the squared error, this holds only if the decoder's output matches the
+ * reconstruction bit for bit. The cases cover IDR and P frames, several slices, rate control
+ * modes and picture sizes that are cropped from whole macroblocks.
+ *
+ * If ffmpeg cannot be run, the test is reported as skipped.
+ *
+ * Usage: encoder_test [--frames N] [--output-dir DIR] [--ffmpeg PATH]
+ */
+#include "quality_meter.hpp"
+#include "software_encoder.hpp"
+#include "thread_pool.hpp"
+#include "yuv_frame.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+
+namespace {
+
+/**
+ * @struct TestCase
+ * @brief Encoder settings of one stream
+ */
+struct TestCase {
+    /// @brief Name of the case, also naming its stream
+    const char *name;
+
+    /// @brief Size of the pictures in pixels
+    uint32_t width;
+    uint32_t height;
+
+    /// @brief Slices per frame
+    uint32_t slices;
+
+    /// @brief Distance between IDR frames
+    uint32_t idrPeriod;
+
+    /// @brief Rate control mode
+    RateControlMode mode;
+};
+
+const TestCase testCases[] = {
+    {"cqp", 352, 288, 1, 8, RateControlMode::ConstantQp},
+    {"cbr_slices", 640, 360, 4, 12, RateControlMode::Cbr},
+    {"vbr_cropped", 330, 190, 3, 30, RateControlMode::Vbr},
+};
+
+/// @brief Exit status of the shell when it cannot find a command
+constexpr int commandNotFound = 127;
+
+/**
+ * @brief Fills a frame, padding included, with a textured picture that moves over time, with
+ * noise so that both intra and inter modes are chosen
+ * @param frame The frame to fill, allocated for the picture size
+ * @param index Index of the frame, which sets the motion
+ */
+void fillFrame(YuvFrame &frame, uint32_t index) {
+    std::mt19937 random(index);
+    for (int plane = 0; plane < 3; ++plane) {
+        uint32_t shift = plane == 0 ? 0 : 1;
+        uint32_t width = frame.width >> shift;
+        uint32_t height = frame.height >> shift;
+        uint32_t pan = (index * 5) >> shift;
+        uint8_t *row = frame.planes[plane].data();
+
+        for (uint32_t y = 0; y < height; ++y, row += frame.stride(plane)) {
+            for (uint32_t x = 0; x < width; ++x) {
+                uint32_t u = x + pan;
+                uint32_t v = y + (pan >> 2);
+                uint32_t value = plane == 0 ? 32 + ((u * v) >> 6) % 160 + (random() & 15)
+                                            : 48 * plane + ((u >> 3) ^ (v >> 3)) % 96;
+                row[x] = static_cast<uint8_t>(value);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Decodes a stream with ffmpeg into frames sized in whole macroblocks
+ * @param ffmpeg Path of the ffmpeg executable
+ * @param path Path of the stream
+ * @param width Width of the pictures in pixels
+ * @param height Height of the pictures in pixels
+ * @return The decoded frames, or nothing if ffmpeg could not be run
+ * @throws std::runtime_error if ffmpeg fails to decode the stream
+ */
+std::optional<std::vector<YuvFrame>> decodeStream(const std::string &ffmpeg,
+                                                  const std::string &path, uint32_t width,
+                                                  uint32_t height) {
+    std::string decodedPath = path + ".yuv";
+    std::string command = ffmpeg + " -v error -y -i '" + path +
+                          "' -f rawvideo -pix_fmt yuv420p '" + decodedPath + "' 2>&1";
+    FILE *messages = popen(command.c_str(), "r");
+    if (messages == nullptr) {
+        return std::nullopt;
+    }
+    std::string log;
+    char buffer[256];
+    while (std::fgets(buffer, sizeof(buffer), messages) != nullptr) {
+        log += buffer;
+    }
+    int status = pclose(messages);
+    if (status == -1 || (WIFEXITED(status) && WEXITSTATUS(status) == commandNotFound)) {
+        return std::nullopt;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !log.empty()) {
+        throw std::runtime_error("ffmpeg failed to decode " + path + ": " + log);
+    }
+
+    std::ifstream input(decodedPath, std::ios::binary);
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (height + 1) / 2;
+    std::vector<YuvFrame> frames;
+    while (input.peek() != EOF) {
+        YuvFrame frame;
+        frame.allocate(width, height);
+        for (int plane = 0; plane < 3; ++plane) {
+            uint32_t planeWidth = plane == 0 ? width : chromaWidth;
+            uint32_t planeHeight = plane == 0 ? height : chromaHeight;
+            uint8_t *row = frame.planes[plane].data();
+            for (uint32_t y = 0; y < planeHeight; ++y, row += frame.stride(plane)) {
+                input.read(reinterpret_cast<char *>(row), planeWidth);
+            }
+        }
+        if (!input) {
+            throw std::runtime_error("ffmpeg output of " + path + " ends within a frame");
+        }
+        frames.push_back(std::move(frame));
+    }
+    input.close();
+    std::remove(decodedPath.c_str());
+    return frames;
+}
+
+/**
+ * @brief Codes, decodes and compares one case
+ * @param testCase The case
+ * @param frameCount Frames to code
+ * @param outputDir Directory the stream is written to
+ * @param ffmpeg Path of the ffmpeg executable
+ * @param pool Pool the encoder runs on
+ * @return Whether the case passed, or nothing if ffmpeg could not be run
+ */
+std::optional<bool> runCase(const TestCase &testCase, uint32_t frameCount,
+                            const std::string &outputDir, const std::string &ffmpeg,
+                            ThreadPool &pool) {
+    std::string path = outputDir + "/encoder_test_" + testCase.name + ".h264";
+    std::ofstream output(path, std::ios::binary);
+    if (!output.is_open()) {
+        throw std::runtime_error("failed to open " + path);
+    }
+
+    // Every frame is measured with the densest SSIM grid, so no sample goes unchecked
+    QualityConfig quality;
+    quality.ssimStep = 4;
+    std::mutex qualityMutex;
+    std::vector<FrameQuality> reported(frameCount);
+    quality.report = [&](const FrameQuality &frame, const QualityStats &) {
+        std::lock_guard<std::mutex> lock(qualityMutex);
+        reported.at(frame.frameIndex) = frame;
+    };
+
+    SoftwareEncoderConfig config;
+    config.width = testCase.width;
+    config.height = testCase.height;
+    config.slices = testCase.slices;
+    config.idrPeriod = testCase.idrPeriod;
+    config.quality = quality;
+
+    RateControlConfig rateControl;
+    rateControl.mode = testCase.mode;
+    rateControl.frameRateNumerator = 30;
+    rateControl.bitrate = testCase.width * testCase.height * 4;
+    rateControl.maxBitrate = rateControl.bitrate * 2;
+
+    std::vector<YuvFrame> sources(frameCount);
+    {
+        auto write = [&output](const EncodedFrame &frame) {
+            output.write(reinterpret_cast<const char *>(frame.data.data()),
+                         static_cast<std::streamsize>(frame.data.size()));
+        };
+        SoftwareEncoder encoder(config, rateControl, pool, write);
+        for (uint32_t i = 0; i < frameCount; ++i) {
+            sources[i].allocate(testCase.width, testCase.height);
+            fillFrame(sources[i], i);
+            encoder.encodeFrame(sources[i]);
+        }
+        encoder.flush();
+    }
+    output.close();
+
+    std::optional<std::vector<YuvFrame>> decoded =
+        decodeStream(ffmpeg, path, testCase.width, testCase.height);
+    if (!decoded) {
+        return std::nullopt;
+    }
+    if (decoded->size() != frameCount) {
+        std::printf("%s: decoded %zu frames of %u\n", testCase.name, decoded->size(), frameCount);
+        return false;
+    }
+
+    QualityMeter meter(testCase.width, testCase.height, quality);
+    double psnrY = 0.0;
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        FrameQuality measured;
+        meter.measure(sources[i], (*decoded)[i], measured);
+        const FrameQuality &expected = reported[i];
+        if (measured.psnrY != expected.psnrY || measured.psnrU != expected.psnrU ||
+            measured.psnrV != expected.psnrV || measured.ssim != expected.ssim) {
+            std::printf("%s: frame %u (%s, qp %d) decodes to PSNR %.8f/%.8f/%.8f SSIM %.8f, "
+                        "the encoder reconstructed %.8f/%.8f/%.8f SSIM %.8f\n",
+                        testCase.name, i, expected.idr ? "IDR" : "P", expected.qp,
+                        measured.psnrY, measured.psnrU, measured.psnrV, measured.ssim,
+                        expected.psnrY, expected.psnrU, expected.psnrV, expected.ssim);
+            return false;
+        }
+        psnrY += measured.psnrY;
+    }
+    std::printf("%s: %ux%u, %u slices, %u frames decoded bit-exact, mean luma PSNR %.2f dB\n",
+                testCase.name, testCase.width, testCase.height, testCase.slices, frameCount,
+                psnrY / frameCount);
+    return true;
+}
+
+void printUsage() {
+    std::printf("Usage: encoder_test [--frames N] [--output-dir DIR] [--ffmpeg PATH]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    uint32_t frameCount = 24;
+    std::string outputDir = ".";
+    std::string ffmpeg = "ffmpeg";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        std::string value = argv[++i];
+        if (arg == "--frames") {
+            char *end = nullptr;
+            long frames = std::strtol(value.c_str(), &end, 10);
+            if (*end != '\0' || frames < 1 || frames > 100000) {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+            frameCount = static_cast<uint32_t>(frames);
+        } else if (arg == "--output-dir") {
+            outputDir = value;
+        } else if (arg == "--ffmpeg") {
+            ffmpeg = value;
+        } else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    ThreadPool pool;
+    int failed = 0;
+    try {
+        for (const TestCase &testCase : testCases) {
+            std::optional<bool> passed = runCase(testCase, frameCount, outputDir, ffmpeg, pool);
+            if (!passed) {
+                std::printf("SKIPPED: %s could not be run, so streams cannot be decoded\n",
+                            ffmpeg.c_str());
+                return EXIT_SUCCESS;
+            }
+            failed += *passed ? 0 : 1;
+        }
+    } catch (const std::exception &e) {
+        std::printf("error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%d of %zu cases failed\n", failed, std::size(testCases));
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
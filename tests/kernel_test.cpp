@@ -0,0 +1,469 @@
+/**
+ * @file kernel_test.cpp
+ * @brief Checks that the SIMD encoder kernels match the scalar ones and times both
+ *
+ * Every kernel of pixel.hpp, transform.hpp and intra_predict.hpp is run on the same inputs
+ * through the scalar table and through the table selected for the CPU, and the outputs must be
+ * identical. The inputs cover every block size, intra mode and neighbour availability, every QP
+ * and both deadzones, saturated blocks (all 0 against all 255) and random content read at odd
+ * strides. Transform inputs come from the forward -> quantise -> dequantise pipeline of the
+ * encoder, as the inverse transforms only accept coefficients of a conforming stream. The
+ * first mismatch of each kernel is printed, and the exit status is non-zero if there is any.
+ *
+ * Afterwards, each kernel is timed through both tables and the time per call and the speedup
+ * are printed. Build with MODE=release for meaningful timings.
+ *
+ * Usage: kernel_test [--cases N] [--calls N]
+ */
+#include "intra_predict.hpp"
+#include "pixel.hpp"
+#include "transform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+/// @brief Distance between rows of the test buffers, odd so SIMD loads are unaligned
+constexpr ptrdiff_t bufferStride = 67;
+
+/// @brief Rows of the test buffers
+constexpr int bufferRows = 48;
+
+/**
+ * @struct Checker
+ * @brief Counts mismatches and reports the first of each kernel
+ */
+struct Checker {
+    /// @brief Kernels with at least one mismatch
+    int failedKernels = 0;
+
+    /// @brief Comparisons made
+    uint64_t comparisons = 0;
+
+    /// @brief Name of the kernel being checked
+    std::string kernel;
+
+    /// @brief Whether the kernel being checked has mismatched already
+    bool failed = false;
+
+    void begin(const std::string &name) {
+        kernel = name;
+        failed = false;
+    }
+
+    /**
+     * @brief Compares two outputs of the current kernel
+     * @param equal Whether the outputs match
+     * @param what Description of the inputs, printed on the first mismatch
+     */
+    void expect(bool equal, const std::string &what) {
+        ++comparisons;
+        if (!equal && !failed) {
+            failed = true;
+            ++failedKernels;
+            std::printf("FAIL %s: %s\n", kernel.c_str(), what.c_str());
+        }
+    }
+};
+
+/**
+ * @brief Fills a buffer with test content
+ *
+ * Pattern 0 is random, 1 is all 0, 2 is all 255, 3 is a 0/255 checkerboard and 4 is random
+ * 0 or 255, which together reach the largest differences and transform values
+ */
+void fill(std::vector<uint8_t> &buffer, int pattern, std::mt19937 &random) {
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        switch (pattern) {
+        case 1:
+            buffer[i] = 0;
+            break;
+        case 2:
+            buffer[i] = 255;
+            break;
+        case 3:
+            buffer[i] = ((i % bufferStride) + (i / bufferStride)) % 2 ? 255 : 0;
+            break;
+        case 4:
+            buffer[i] = random() % 2 ? 255 : 0;
+            break;
+        default:
+            buffer[i] = static_cast<uint8_t>(random());
+            break;
+        }
+    }
+}
+
+/// @brief Number of fill patterns
+constexpr int patternCount = 5;
+
+/**
+ * @brief Returns the pattern of a test case: each fixed pattern once, random ones after
+ */
+int getPattern(int testCase) {
+    return testCase < patternCount ? testCase : testCase % 2 ? 0 : 4;
+}
+
+const char *blockSizeNames[blockSizeCount] = {"16x16", "16x8", "8x8", "4x4"};
+
+void checkPixel(Checker &checker, int cases, std::mt19937 &random) {
+    const PixelFunctions &scalar = getScalarPixelFunctions();
+    const PixelFunctions &selected = getPixelFunctions();
+    std::vector<uint8_t> a(bufferStride * bufferRows), b(a.size());
+
+    for (size_t size = 0; size < blockSizeCount; ++size) {
+        for (bool satd : {false, true}) {
+            checker.begin(std::string(satd ? "satd " : "sad ") + blockSizeNames[size]);
+            PixelCompare reference = satd ? scalar.satd[size] : scalar.sad[size];
+            PixelCompare candidate = satd ? selected.satd[size] : selected.sad[size];
+            for (int testCase = 0; testCase < cases; ++testCase) {
+                fill(a, getPattern(testCase), random);
+                fill(b, getPattern(testCase + 1), random);
+                int offsetA = random() % 32, offsetB = random() % 32;
+                int expected = reference(a.data() + offsetA, bufferStride, b.data() + offsetB,
+                                         bufferStride);
+                int actual = candidate(a.data() + offsetA, bufferStride, b.data() + offsetB,
+                                       bufferStride);
+                checker.expect(expected == actual, "case " + std::to_string(testCase) +
+                                                       ": " + std::to_string(expected) +
+                                                       " != " + std::to_string(actual));
+            }
+        }
+    }
+
+    checker.begin("average");
+    std::vector<uint8_t> expected(a.size()), actual(a.size());
+    for (int testCase = 0; testCase < cases; ++testCase) {
+        fill(a, getPattern(testCase), random);
+        fill(b, getPattern(testCase + 1), random);
+        int width = 1 + random() % 32, height = 1 + random() % 16;
+        std::fill(expected.begin(), expected.end(), 0);
+        std::fill(actual.begin(), actual.end(), 0);
+        scalar.average(expected.data(), bufferStride, a.data(), b.data(), bufferStride, width,
+                       height);
+        selected.average(actual.data(), bufferStride, a.data(), b.data(), bufferStride, width,
+                         height);
+        checker.expect(expected == actual, "case " + std::to_string(testCase) + ", " +
+                                               std::to_string(width) + "x" +
+                                               std::to_string(height));
+    }
+}
+
+/**
+ * @brief Runs a kernel that transforms coefficients in place through both tables
+ * @return Whether both produced the same coefficients (and the same return value)
+ */
+template <typename Kernel, typename... Args>
+bool compareInPlace(Kernel reference, Kernel candidate, int16_t *coefficients, int count,
+                    Args... args) {
+    std::vector<int16_t> copy(coefficients, coefficients + count);
+    if constexpr (std::is_same_v<decltype(reference(coefficients, args...)), void>) {
+        reference(coefficients, args...);
+        candidate(copy.data(), args...);
+        return std::equal(copy.begin(), copy.end(), coefficients);
+    } else {
+        bool expected = reference(coefficients, args...);
+        bool actual = candidate(copy.data(), args...);
+        return expected == actual && std::equal(copy.begin(), copy.end(), coefficients);
+    }
+}
+
+void checkTransform(Checker &checker, int cases, std::mt19937 &random) {
+    const TransformFunctions &scalar = getScalarTransformFunctions();
+    const TransformFunctions &selected = getTransformFunctions();
+    std::vector<uint8_t> source(bufferStride * bufferRows), prediction(source.size());
+    std::vector<uint8_t> expectedBlock(source.size()), actualBlock(source.size());
+    std::vector<QuantTables> tables;
+    for (int qp = 0; qp <= 51; ++qp) {
+        tables.emplace_back(qp);
+    }
+
+    // Each size checks its forward transform, then quantisation, dequantisation and the
+    // inverse transform of the result at every QP, with both deadzones
+    for (int size : {4, 8}) {
+        std::string name = size == 4 ? "4x4" : "8x8";
+        ForwardTransform forwardReference = size == 4 ? scalar.forward4x4 : scalar.forward8x8;
+        ForwardTransform forwardCandidate =
+            size == 4 ? selected.forward4x4 : selected.forward8x8;
+        InverseTransform inverseReference = size == 4 ? scalar.inverse4x4 : scalar.inverse8x8;
+        InverseTransform inverseCandidate =
+            size == 4 ? selected.inverse4x4 : selected.inverse8x8;
+        const int count = size * size;
+
+        for (int testCase = 0; testCase < cases; ++testCase) {
+            fill(source, getPattern(testCase), random);
+            fill(prediction, getPattern(testCase + 2), random);
+            int offset = random() % 32;
+            std::string what = "case " + std::to_string(testCase);
+
+            int16_t coefficients[64], copy[64];
+            checker.begin("forward " + name);
+            forwardReference(coefficients, source.data() + offset, bufferStride,
+                             prediction.data() + offset, bufferStride);
+            forwardCandidate(copy, source.data() + offset, bufferStride,
+                             prediction.data() + offset, bufferStride);
+            checker.expect(std::equal(coefficients, coefficients + count, copy), what);
+
+            const QuantTables &quant = tables[testCase % tables.size()];
+            bool intra = testCase / tables.size() % 2 == 0;
+            what += ", qp " + std::to_string(quant.qp) + (intra ? " intra" : " inter");
+            const int32_t *multipliers = size == 4 ? quant.quant4x4 : quant.quant8x8;
+            int shift = size == 4 ? quant.quantShift4x4 : quant.quantShift8x8;
+            checker.begin("quantize " + name);
+            checker.expect(compareInPlace(scalar.quantize, selected.quantize, coefficients, count,
+                                          multipliers, QuantTables::deadzone(shift, intra),
+                                          shift, count),
+                           what);
+
+            checker.begin("dequantize " + name);
+            const int32_t *scales = size == 4 ? quant.dequant4x4 : quant.dequant8x8;
+            int dequantShift = size == 4 ? 0 : quant.dequantShift8x8;
+            checker.expect(compareInPlace(scalar.dequantize, selected.dequantize, coefficients,
+                                          count, scales, dequantShift, count),
+                           what);
+
+            checker.begin("inverse " + name);
+            expectedBlock = prediction;
+            actualBlock = prediction;
+            inverseReference(expectedBlock.data() + offset, bufferStride, coefficients);
+            inverseCandidate(actualBlock.data() + offset, bufferStride, coefficients);
+            checker.expect(expectedBlock == actualBlock, what);
+        }
+    }
+
+    // The luma DC path of Intra16x16 macroblocks: the DC of sixteen 4x4 blocks
+    for (int testCase = 0; testCase < cases; ++testCase) {
+        fill(source, getPattern(testCase), random);
+        fill(prediction, getPattern(testCase + 2), random);
+        int16_t dc[16], coefficients[16];
+        for (int block = 0; block < 16; ++block) {
+            ptrdiff_t offset = (block / 4) * 4 * bufferStride + (block % 4) * 4;
+            scalar.forward4x4(coefficients, source.data() + offset, bufferStride,
+                              prediction.data() + offset, bufferStride);
+            dc[block] = coefficients[0];
+        }
+        const QuantTables &quant = tables[testCase % tables.size()];
+        std::string what = "case " + std::to_string(testCase) + ", qp " + std::to_string(quant.qp);
+
+        checker.begin("forward dc");
+        checker.expect(compareInPlace(scalar.forwardDc, selected.forwardDc, dc, 16), what);
+        checker.begin("quantize dc");
+        checker.expect(compareInPlace(scalar.quantize, selected.quantize, dc, 16, quant.quantDc,
+                                      QuantTables::deadzone(quant.quantShiftDc, true),
+                                      quant.quantShiftDc, 16),
+                       what);
+        checker.begin("inverse dc");
+        checker.expect(compareInPlace(scalar.inverseDc, selected.inverseDc, dc, 16), what);
+        checker.begin("dequantize dc");
+        checker.expect(compareInPlace(scalar.dequantize, selected.dequantize, dc, 16,
+                                      quant.dequantDc, quant.dequantShiftDc, 16),
+                       what);
+    }
+}
+
+void checkIntra(Checker &checker, int cases, std::mt19937 &random) {
+    const IntraFunctions &scalar = getScalarIntraFunctions();
+    const IntraFunctions &selected = getIntraFunctions();
+    std::vector<uint8_t> frame(bufferStride * bufferRows);
+    std::vector<uint8_t> expected(bufferStride * 16), actual(expected.size());
+
+    for (int size : {4, 8, 16}) {
+        const IntraPredict *reference = size == 4   ? scalar.predict4x4
+                                        : size == 8 ? scalar.predict8x8
+                                                    : scalar.predict16x16;
+        const IntraPredict *candidate = size == 4   ? selected.predict4x4
+                                        : size == 8 ? selected.predict8x8
+                                                    : selected.predict16x16;
+        size_t modeCount = size == 16 ? intra16x16ModeCount : intraModeCount;
+
+        for (size_t mode = 0; mode < modeCount; ++mode) {
+            checker.begin("intra " + std::to_string(size) + "x" + std::to_string(size) +
+                          " mode " + std::to_string(mode));
+            // Every combination of available neighbours, for each test case
+            for (int testCase = 0; testCase < cases; ++testCase) {
+                for (int availability = 0; availability < 16; ++availability) {
+                    fill(frame, getPattern(testCase), random);
+                    IntraNeighbours neighbours = gatherIntraNeighbours(
+                        frame.data() + 16 * bufferStride + 16, bufferStride, size,
+                        availability & 1, availability & 2, availability & 4, availability & 8);
+                    bool available =
+                        size == 16
+                            ? isIntra16x16ModeAvailable(static_cast<Intra16x16Mode>(mode),
+                                                        neighbours)
+                            : isIntraModeAvailable(static_cast<IntraMode>(mode), neighbours);
+                    if (!available) {
+                        continue;
+                    }
+                    if (size == 8) {
+                        neighbours = filterIntra8x8Neighbours(neighbours);
+                    }
+
+                    std::fill(expected.begin(), expected.end(), 0);
+                    std::fill(actual.begin(), actual.end(), 0);
+                    reference[mode](expected.data(), bufferStride, neighbours);
+                    candidate[mode](actual.data(), bufferStride, neighbours);
+                    checker.expect(expected == actual,
+                                   "case " + std::to_string(testCase) + ", neighbours " +
+                                       std::to_string(availability));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Times a kernel through both tables and prints the time per call
+ * @param name Kernel name
+ * @param calls Calls timed per table
+ * @param run Runs the kernel once through the scalar (false) or selected (true) table
+ */
+template <typename Run> void timeKernel(const char *name, int calls, Run run) {
+    double nanoseconds[2];
+    for (bool selected : {false, true}) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; ++i) {
+            run(selected, i);
+        }
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        nanoseconds[selected] = elapsed.count() / calls;
+    }
+    std::printf("%-22s scalar %9.2f ns  selected %9.2f ns  %6.2fx\n", name, nanoseconds[0],
+                nanoseconds[1], nanoseconds[0] / nanoseconds[1]);
+}
+
+void benchmark(int calls, std::mt19937 &random) {
+    std::vector<uint8_t> a(bufferStride * bufferRows), b(a.size()), block(a.size());
+    fill(a, 0, random);
+    fill(b, 0, random);
+    // Keeps the results observable
+    uint64_t checksum = 0;
+    auto offset = [](int i) { return (i * 7) % 32; };
+
+    const PixelFunctions *pixels[2] = {&getScalarPixelFunctions(), &getPixelFunctions()};
+    for (size_t size = 0; size < blockSizeCount; ++size) {
+        for (bool satd : {false, true}) {
+            std::string name = std::string(satd ? "satd " : "sad ") + blockSizeNames[size];
+            timeKernel(name.c_str(), calls, [&](bool selected, int i) {
+                PixelCompare compare =
+                    satd ? pixels[selected]->satd[size] : pixels[selected]->sad[size];
+                checksum += compare(a.data() + offset(i), bufferStride, b.data(), bufferStride);
+            });
+        }
+    }
+    timeKernel("average 16x16", calls, [&](bool selected, int i) {
+        pixels[selected]->average(block.data(), bufferStride, a.data() + offset(i), b.data(),
+                                  bufferStride, 16, 16);
+    });
+
+    const TransformFunctions *transforms[2] = {&getScalarTransformFunctions(),
+                                               &getTransformFunctions()};
+    QuantTables quant(28);
+    int16_t coefficients[64];
+    timeKernel("forward 4x4", calls, [&](bool selected, int i) {
+        transforms[selected]->forward4x4(coefficients, a.data() + offset(i), bufferStride,
+                                         b.data(), bufferStride);
+    });
+    timeKernel("forward 8x8", calls, [&](bool selected, int i) {
+        transforms[selected]->forward8x8(coefficients, a.data() + offset(i), bufferStride,
+                                         b.data(), bufferStride);
+    });
+    timeKernel("quantize 4x4", calls, [&](bool selected, int i) {
+        getScalarTransformFunctions().forward4x4(coefficients, a.data() + offset(i),
+                                                 bufferStride, b.data(), bufferStride);
+        checksum += transforms[selected]->quantize(
+            coefficients, quant.quant4x4, QuantTables::deadzone(quant.quantShift4x4, true),
+            quant.quantShift4x4, 16);
+    });
+    timeKernel("dequantize 4x4", calls, [&](bool selected, int) {
+        transforms[selected]->dequantize(coefficients, quant.dequant4x4, 0, 16);
+    });
+    timeKernel("inverse 4x4", calls, [&](bool selected, int) {
+        transforms[selected]->inverse4x4(block.data(), bufferStride, coefficients);
+    });
+    timeKernel("inverse 8x8", calls, [&](bool selected, int) {
+        transforms[selected]->inverse8x8(block.data(), bufferStride, coefficients);
+    });
+    timeKernel("forward dc", calls, [&](bool selected, int i) {
+        coefficients[i % 16] = static_cast<int16_t>(i % 1024);
+        transforms[selected]->forwardDc(coefficients);
+    });
+    timeKernel("inverse dc", calls, [&](bool selected, int i) {
+        coefficients[i % 16] = static_cast<int16_t>(i % 1024);
+        transforms[selected]->inverseDc(coefficients);
+    });
+
+    const IntraFunctions *intra[2] = {&getScalarIntraFunctions(), &getIntraFunctions()};
+    IntraNeighbours neighbours = gatherIntraNeighbours(a.data() + 16 * bufferStride + 16,
+                                                       bufferStride, 8, true, true, true, true);
+    IntraNeighbours filtered = filterIntra8x8Neighbours(neighbours);
+    for (size_t mode = 0; mode < intraModeCount; ++mode) {
+        std::string name = "intra 4x4 mode " + std::to_string(mode);
+        timeKernel(name.c_str(), calls, [&](bool selected, int) {
+            intra[selected]->predict4x4[mode](block.data(), bufferStride, neighbours);
+        });
+        name = "intra 8x8 mode " + std::to_string(mode);
+        timeKernel(name.c_str(), calls, [&](bool selected, int) {
+            intra[selected]->predict8x8[mode](block.data(), bufferStride, filtered);
+        });
+    }
+    for (size_t mode = 0; mode < intra16x16ModeCount; ++mode) {
+        std::string name = "intra 16x16 mode " + std::to_string(mode);
+        timeKernel(name.c_str(), calls, [&](bool selected, int) {
+            intra[selected]->predict16x16[mode](block.data(), bufferStride, neighbours);
+        });
+    }
+
+    checksum += block[0] + coefficients[0];
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+}
+
+void printUsage() {
+    std::fprintf(stderr, "usage: kernel_test [--cases N] [--calls N]\n");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    int cases = 2000;
+    int calls = 200000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char *end = nullptr;
+        long value = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : -1;
+        if ((arg != "--cases" && arg != "--calls") || end == nullptr || *end != '\0' ||
+            value < 0 || value > 1000000000) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        (arg == "--cases" ? cases : calls) = static_cast<int>(value);
+        ++i;
+    }
+
+    bool simd = &getPixelFunctions() != &getScalarPixelFunctions();
+    std::printf("selected kernels: %s\n", simd ? "simd" : "scalar (no SIMD support)");
+
+    std::mt19937 random(1);
+    Checker checker;
+    checkPixel(checker, cases, random);
+    checkTransform(checker, cases, random);
+    checkIntra(checker, cases, random);
+    std::printf("%llu comparisons, %d kernels mismatched\n",
+                static_cast<unsigned long long>(checker.comparisons), checker.failedKernels);
+    if (checker.failedKernels > 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (calls > 0) {
+        benchmark(calls, random);
+    }
+    return EXIT_SUCCESS;
+}
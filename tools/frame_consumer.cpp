@@ -0,0 +1,483 @@
+/**
+ * @file frame_consumer.cpp
+ * @brief Example consumer of the frames a VulkanTest session exports
+ *
+ * Connects to the export socket of a session and receives the frame ring's descriptor and file
+ * descriptors. Frames exported in device memory are imported into a Vulkan device of the
+ * consumer's own, picked by the producer's device UUID, and a frame counts as ready once the
+ * exported timeline semaphore reaches its number. Frames exported through shared memory are
+ * ready once they have been copied out of the ring. For each frame, the latency from the
+ * producer's submission to ready is measured, and a summary is printed on exit. Frames
+ * replaced before they were used are counted as overwritten. With --output, the frames are
+ * also written to a raw file in the exported layout (RGBA or NV12).
+ *
+ * Usage: frame_consumer --socket PATH [--frames N] [--output FILE]
+ */
+#include "../src/frame_export_client.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace {
+
+/**
+ * @struct Stats
+ * @brief What the consumer saw of the frames
+ */
+struct Stats {
+    std::vector<double> latenciesMs;
+    uint64_t overwritten = 0;
+    uint64_t missed = 0;
+};
+
+uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * @class DeviceImporter
+ * @brief Imports the exported images and timeline semaphore into a device of its own
+ */
+class DeviceImporter {
+  public:
+    explicit DeviceImporter(const FrameExportClient &client) : descriptor(client.getDescriptor()) {
+        createDevice();
+        importRing(client);
+    }
+
+    ~DeviceImporter() {
+        if (device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDeviceWaitIdle(device);
+        vkDestroyFence(device, fence, nullptr);
+        vkDestroyCommandPool(device, commandPool, nullptr);
+        vkDestroyBuffer(device, readbackBuffer, nullptr);
+        vkFreeMemory(device, readbackMemory, nullptr);
+        for (size_t i = 0; i < images.size(); ++i) {
+            vkDestroyImage(device, images[i], nullptr);
+            vkFreeMemory(device, memory[i], nullptr);
+        }
+        vkDestroySemaphore(device, timeline, nullptr);
+        vkDestroyDevice(device, nullptr);
+        vkDestroyInstance(instance, nullptr);
+    }
+
+    DeviceImporter(const DeviceImporter &) = delete;
+    DeviceImporter &operator=(const DeviceImporter &) = delete;
+
+    /**
+     * @brief Waits until the frame has been rendered and copied into its slot
+     * @return false if it did not complete within a second
+     */
+    bool wait(uint64_t frame) const {
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &frame;
+        return vkWaitSemaphores(device, &waitInfo, 1000000000ull) == VK_SUCCESS;
+    }
+
+    /**
+     * @brief Copies a slot's image to the host, acquiring it from the producer first
+     */
+    void read(uint32_t slot, std::vector<uint8_t> &pixels) {
+        if (readbackBuffer == VK_NULL_HANDLE) {
+            createReadback();
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkResetCommandBuffer(commandBuffer, 0);
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        // Matches the producer's release of the slot to the external queue family
+        VkImageMemoryBarrier acquire = {};
+        acquire.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        acquire.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        acquire.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        acquire.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        acquire.srcQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL;
+        acquire.dstQueueFamilyIndex = queueFamily;
+        acquire.image = images[slot];
+        acquire.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        acquire.subresourceRange.levelCount = 1;
+        acquire.subresourceRange.layerCount = 1;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &acquire);
+
+        VkBufferImageCopy region = {};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {descriptor.width, descriptor.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, images[slot], VK_IMAGE_LAYOUT_GENERAL,
+                               readbackBuffer, 1, &region);
+
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = readbackBuffer;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        vkResetFences(device, 1, &fence);
+        if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit the readback");
+        }
+        vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+
+        const uint8_t *mapped = static_cast<const uint8_t *>(readbackPixels);
+        pixels.assign(mapped, mapped + size_t(descriptor.width) * descriptor.height * 4);
+    }
+
+  private:
+    const FrameExportDescriptor &descriptor;
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    std::vector<VkImage> images;
+    std::vector<VkDeviceMemory> memory;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    VkBuffer readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+    void *readbackPixels = nullptr;
+
+    uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const {
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+            if ((typeBits & (1u << i)) != 0 &&
+                (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+        throw std::runtime_error("no suitable memory type");
+    }
+
+    void createDevice() {
+        VkApplicationInfo appInfo = {};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "frame_consumer";
+        appInfo.apiVersion = VK_API_VERSION_1_3;
+        VkInstanceCreateInfo instanceInfo = {};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &appInfo;
+        if (vkCreateInstance(&instanceInfo, nullptr, &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create a Vulkan instance");
+        }
+
+        // Memory can only be imported into the device that exported it
+        uint32_t count = 0;
+        vkEnumeratePhysicalDevices(instance, &count, nullptr);
+        std::vector<VkPhysicalDevice> devices(count);
+        vkEnumeratePhysicalDevices(instance, &count, devices.data());
+        for (VkPhysicalDevice candidate : devices) {
+            VkPhysicalDeviceIDProperties idProperties = {};
+            idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties.pNext = &idProperties;
+            vkGetPhysicalDeviceProperties2(candidate, &properties);
+            if (std::memcmp(idProperties.deviceUUID, descriptor.deviceUuid, VK_UUID_SIZE) == 0 &&
+                std::memcmp(idProperties.driverUUID, descriptor.driverUuid, VK_UUID_SIZE) == 0) {
+                physicalDevice = candidate;
+            }
+        }
+        if (physicalDevice == VK_NULL_HANDLE) {
+            throw std::runtime_error("the producer's device is not available here");
+        }
+
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+        while (queueFamily < familyCount &&
+               (families[queueFamily].queueFlags &
+                (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT)) == 0) {
+            ++queueFamily;
+        }
+        if (queueFamily == familyCount) {
+            throw std::runtime_error("the device has no queue that can copy");
+        }
+
+        float priority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo = {};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &priority;
+
+        VkPhysicalDeviceVulkan12Features features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        features.timelineSemaphore = VK_TRUE;
+
+        const char *extensions[] = {VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+                                    VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME};
+        VkDeviceCreateInfo deviceInfo = {};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.pNext = &features;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        deviceInfo.enabledExtensionCount = 2;
+        deviceInfo.ppEnabledExtensionNames = extensions;
+        if (vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create a device with external memory support");
+        }
+        vkGetDeviceQueue(device, queueFamily, 0, &queue);
+    }
+
+    void importRing(const FrameExportClient &client) {
+        auto importSemaphoreFd = reinterpret_cast<PFN_vkImportSemaphoreFdKHR>(
+            vkGetDeviceProcAddr(device, "vkImportSemaphoreFdKHR"));
+
+        VkSemaphoreTypeCreateInfo typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create the timeline semaphore");
+        }
+
+        // A successful import takes ownership of the fd, so import duplicates
+        VkImportSemaphoreFdInfoKHR semaphoreImport = {};
+        semaphoreImport.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+        semaphoreImport.semaphore = timeline;
+        semaphoreImport.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+        semaphoreImport.fd = dup(client.getTimelineFd());
+        if (importSemaphoreFd(device, &semaphoreImport) != VK_SUCCESS) {
+            close(semaphoreImport.fd);
+            throw std::runtime_error("failed to import the timeline semaphore");
+        }
+
+        for (uint32_t i = 0; i < descriptor.slotCount; ++i) {
+            // The image must be created exactly like the producer's
+            VkExternalMemoryImageCreateInfo externalInfo = {};
+            externalInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+            externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.pNext = &externalInfo;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = static_cast<VkFormat>(descriptor.vkFormat);
+            imageInfo.extent = {descriptor.width, descriptor.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = static_cast<VkImageTiling>(descriptor.imageTiling);
+            imageInfo.usage = descriptor.imageUsage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            VkImage image;
+            if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create an image to import into");
+            }
+            images.push_back(image);
+
+            VkMemoryRequirements requirements;
+            vkGetImageMemoryRequirements(device, image, &requirements);
+
+            VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+            dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+            dedicatedInfo.image = image;
+
+            VkImportMemoryFdInfoKHR memoryImport = {};
+            memoryImport.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR;
+            memoryImport.pNext = &dedicatedInfo;
+            memoryImport.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+            memoryImport.fd = dup(client.getMemoryFd(i));
+
+            VkMemoryAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.pNext = &memoryImport;
+            allocInfo.allocationSize = descriptor.slotSize;
+            allocInfo.memoryTypeIndex =
+                findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            VkDeviceMemory imported;
+            if (vkAllocateMemory(device, &allocInfo, nullptr, &imported) != VK_SUCCESS) {
+                close(memoryImport.fd);
+                throw std::runtime_error("failed to import the memory of slot " +
+                                         std::to_string(i));
+            }
+            memory.push_back(imported);
+            vkBindImageMemory(device, image, imported, 0);
+        }
+    }
+
+    void createReadback() {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = VkDeviceSize(descriptor.width) * descriptor.height * 4;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &readbackBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create the readback buffer");
+        }
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, readbackBuffer, &requirements);
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = requirements.size;
+        allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits,
+                                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (vkAllocateMemory(device, &allocInfo, nullptr, &readbackMemory) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate the readback buffer");
+        }
+        vkBindBufferMemory(device, readbackBuffer, readbackMemory, 0);
+        vkMapMemory(device, readbackMemory, 0, VK_WHOLE_SIZE, 0, &readbackPixels);
+
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+        vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
+
+        VkCommandBufferAllocateInfo commandInfo = {};
+        commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandInfo.commandPool = commandPool;
+        commandInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandInfo.commandBufferCount = 1;
+        vkAllocateCommandBuffers(device, &commandInfo, &commandBuffer);
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        vkCreateFence(device, &fenceInfo, nullptr, &fence);
+    }
+};
+
+double getPercentile(std::vector<double> values, double percentile) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(percentile / 100.0 * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string socketPath;
+    uint64_t frameLimit = 0;
+    std::string outputPath;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--socket") {
+            socketPath = argv[i + 1];
+        } else if (arg == "--frames") {
+            frameLimit = std::stoull(argv[i + 1]);
+        } else if (arg == "--output") {
+            outputPath = argv[i + 1];
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (socketPath.empty()) {
+        std::fprintf(stderr, "usage: frame_consumer --socket PATH [--frames N] [--output FILE]\n");
+        return EXIT_FAILURE;
+    }
+
+    try {
+        FrameExportClient client(socketPath);
+        const FrameExportDescriptor &descriptor = client.getDescriptor();
+        bool device = descriptor.transport == FrameExportTransport::DeviceMemory;
+        const char *format = descriptor.format == FrameExportFormat::Rgba ? "RGBA" : "NV12";
+        std::printf("%ux%u %s frames in %u slots, exported through %s\n", descriptor.width,
+                    descriptor.height, format, descriptor.slotCount,
+                    device ? "device memory" : "shared memory");
+
+        std::unique_ptr<DeviceImporter> importer;
+        if (device) {
+            importer = std::make_unique<DeviceImporter>(client);
+        }
+        FILE *output = outputPath.empty() ? nullptr : std::fopen(outputPath.c_str(), "wb");
+
+        Stats stats;
+        std::vector<uint8_t> pixels;
+        uint64_t lastFrame = 0;
+        uint64_t received = 0;
+        uint64_t frame;
+        while ((frameLimit == 0 || received < frameLimit) && client.receive(frame)) {
+            ++received;
+            if (lastFrame != 0 && frame > lastFrame + 1) {
+                stats.missed += frame - lastFrame - 1;
+            }
+            lastFrame = frame;
+
+            const FrameExportSlot &slot = client.getControl().slots[frame % descriptor.slotCount];
+            bool ready = device ? importer->wait(frame) : client.readSharedFrame(frame, pixels);
+            uint64_t readyTime = now();
+            if (!ready || slot.frame.load(std::memory_order_acquire) != frame) {
+                ++stats.overwritten;
+                continue;
+            }
+            stats.latenciesMs.push_back(
+                (readyTime - slot.submitTime.load(std::memory_order_relaxed)) / 1e6);
+
+            if (output != nullptr) {
+                if (device) {
+                    importer->read(static_cast<uint32_t>(frame % descriptor.slotCount), pixels);
+                    if (slot.frame.load(std::memory_order_acquire) != frame) {
+                        ++stats.overwritten;
+                        continue;
+                    }
+                }
+                std::fwrite(pixels.data(), 1, pixels.size(), output);
+            }
+        }
+        if (output != nullptr) {
+            std::fclose(output);
+        }
+
+        double mean = 0.0;
+        for (double latency : stats.latenciesMs) {
+            mean += latency / stats.latenciesMs.size();
+        }
+        std::printf("frames = %llu, overwritten = %llu, missed = %llu\n",
+                    static_cast<unsigned long long>(received),
+                    static_cast<unsigned long long>(stats.overwritten),
+                    static_cast<unsigned long long>(stats.missed));
+        std::printf("submit to ready: mean = %.3f ms, p50 = %.3f ms, p99 = %.3f ms, max = %.3f "
+                    "ms\n",
+                    mean, getPercentile(stats.latenciesMs, 50.0),
+                    getPercentile(stats.latenciesMs, 99.0),
+                    getPercentile(stats.latenciesMs, 100.0));
+    } catch (const std::exception &e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,381 @@
+/**
+ * @file metrics_scrape.cpp
+ * @brief Scrapes the metrics endpoint of a running VulkanTest and checks the exposition
+ *
+ * Fetches /metrics over TCP or a Unix socket like a Prometheus scraper would, and checks the
+ * response: status and content type, the syntax of every sample, that each sample follows the
+ * TYPE line of its family, and that histogram buckets are cumulative and end in a +Inf bucket
+ * equal to the count. The body is printed unless --quiet is given, followed by a summary. With
+ * --count, it scrapes repeatedly and also checks that counters never decrease.
+ *
+ * Usage: metrics_scrape [--host ADDRESS] [--port N | --socket PATH] [--count N]
+ *                       [--interval MS] [--quiet 1]
+ */
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <netinet/in.h>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+/**
+ * @struct Target
+ * @brief Where the endpoint listens
+ */
+struct Target {
+    std::string host = "127.0.0.1";
+    uint16_t port = 9464;
+    std::string socketPath;
+};
+
+/**
+ * @brief Sends a GET request for /metrics and returns the whole response, or an empty string
+ */
+std::string fetch(const Target &target) {
+    int fd;
+    if (!target.socketPath.empty()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, target.socketPath.c_str(), sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 ||
+            connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+            std::perror("connect");
+            return "";
+        }
+    } else {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(target.port);
+        inet_pton(AF_INET, target.host.c_str(), &address.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 ||
+            connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+            std::perror("connect");
+            return "";
+        }
+    }
+
+    std::string request = "GET /metrics HTTP/1.1\r\nHost: " + target.host +
+                          "\r\nAccept: text/plain\r\nConnection: close\r\n\r\n";
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(request.size())) {
+        std::perror("send");
+        close(fd);
+        return "";
+    }
+
+    // The server closes the connection after the response
+    std::string response;
+    char buffer[65536];
+    ssize_t size;
+    while ((size = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<size_t>(size));
+    }
+    close(fd);
+    return response;
+}
+
+/**
+ * @struct Sample
+ * @brief A parsed sample line
+ */
+struct Sample {
+    std::string name;
+    std::string labels;
+    std::string le;
+    double value = 0.0;
+};
+
+/**
+ * @brief Parses "name{labels} value", returning false on a syntax error
+ */
+bool parseSample(const std::string &line, Sample &sample) {
+    size_t nameEnd = line.find_first_of("{ ");
+    if (nameEnd == 0 || nameEnd == std::string::npos) {
+        return false;
+    }
+    sample.name = line.substr(0, nameEnd);
+    for (char c : sample.name) {
+        if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == ':')) {
+            return false;
+        }
+    }
+
+    size_t valueStart = nameEnd;
+    sample.labels.clear();
+    sample.le.clear();
+    if (line[nameEnd] == '{') {
+        // Label values are quoted and may contain escaped quotes
+        size_t i = nameEnd + 1;
+        std::string labels;
+        while (i < line.size() && line[i] != '}') {
+            size_t equals = line.find("=\"", i);
+            if (equals == std::string::npos) {
+                return false;
+            }
+            std::string labelName = line.substr(i, equals - i);
+            std::string value;
+            for (i = equals + 2; i < line.size() && line[i] != '"'; ++i) {
+                if (line[i] == '\\' && i + 1 < line.size()) {
+                    ++i;
+                }
+                value += line[i];
+            }
+            if (i >= line.size()) {
+                return false;
+            }
+            if (labelName == "le") {
+                sample.le = value;
+            } else {
+                labels += labelName + "=" + value + ",";
+            }
+            ++i;
+            if (i < line.size() && line[i] == ',') {
+                ++i;
+            }
+        }
+        if (i >= line.size()) {
+            return false;
+        }
+        sample.labels = labels;
+        valueStart = i + 1;
+    }
+
+    if (valueStart >= line.size() || line[valueStart] != ' ') {
+        return false;
+    }
+    std::string value = line.substr(valueStart + 1);
+    if (value == "+Inf" || value == "-Inf" || value == "NaN") {
+        sample.value = value == "+Inf" ? INFINITY : value == "-Inf" ? -INFINITY : NAN;
+        return true;
+    }
+    char *end;
+    sample.value = std::strtod(value.c_str(), &end);
+    return *end == '\0' && end != value.c_str();
+}
+
+/**
+ * @brief Checks a response, printing every problem. Counter values are added to "counters"
+ * @return Number of problems found
+ */
+int check(const std::string &response, std::map<std::string, double> &counters,
+          size_t &sampleCount, size_t &familyCount) {
+    int problems = 0;
+    auto report = [&problems](const std::string &problem) {
+        std::fprintf(stderr, "problem: %s\n", problem.c_str());
+        ++problems;
+    };
+
+    size_t headerEnd = response.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        report("no complete HTTP response");
+        return problems;
+    }
+    std::string headers = response.substr(0, headerEnd);
+    if (headers.compare(0, 12, "HTTP/1.1 200") != 0) {
+        report("status is " + headers.substr(0, headers.find("\r\n")));
+    }
+    if (headers.find("Content-Type: text/plain; version=0.0.4") == std::string::npos) {
+        report("content type is not the Prometheus text format");
+    }
+
+    std::map<std::string, std::string> types;
+    std::map<std::string, double> bucketTotals;
+    std::map<std::string, double> lastBucket;
+    std::istringstream body(response.substr(headerEnd + 4));
+    std::string line;
+    sampleCount = 0;
+    while (std::getline(body, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (line.compare(0, 7, "# TYPE ") == 0) {
+            std::istringstream fields(line.substr(7));
+            std::string name, type;
+            fields >> name >> type;
+            if (types.count(name) != 0) {
+                report("TYPE of " + name + " is repeated");
+            }
+            types[name] = type;
+            continue;
+        }
+        if (line[0] == '#') {
+            continue;
+        }
+
+        Sample sample;
+        if (!parseSample(line, sample)) {
+            report("malformed sample: " + line);
+            continue;
+        }
+        ++sampleCount;
+
+        // Histogram samples belong to the family without their suffix
+        std::string family = sample.name;
+        for (const char *suffix : {"_bucket", "_sum", "_count"}) {
+            size_t length = std::strlen(suffix);
+            std::string base = family.size() > length
+                                   ? family.substr(0, family.size() - length)
+                                   : std::string();
+            if (!base.empty() && family.compare(base.size(), length, suffix) == 0 &&
+                types.count(base) != 0 && types[base] == "histogram") {
+                family = base;
+                break;
+            }
+        }
+        if (types.count(family) == 0) {
+            report("sample " + sample.name + " precedes the TYPE of its family");
+            continue;
+        }
+
+        std::string series = sample.name + "{" + sample.labels + "}";
+        if (types[family] == "counter") {
+            if (sample.value < 0.0) {
+                report("counter " + series + " is negative");
+            }
+            auto previous = counters.find(series);
+            if (previous != counters.end() && sample.value < previous->second) {
+                report("counter " + series + " decreased");
+            }
+            counters[series] = sample.value;
+        } else if (types[family] == "histogram") {
+            std::string key = family + "{" + sample.labels + "}";
+            if (sample.name == family + "_bucket") {
+                if (lastBucket.count(key) != 0 && sample.value < lastBucket[key]) {
+                    report("buckets of " + key + " are not cumulative");
+                }
+                lastBucket[key] = sample.value;
+                if (sample.le == "+Inf") {
+                    bucketTotals[key] = sample.value;
+                }
+            } else if (sample.name == family + "_count") {
+                if (bucketTotals.count(key) == 0) {
+                    report("histogram " + key + " has no +Inf bucket before its count");
+                } else if (bucketTotals[key] != sample.value) {
+                    report("count of " + key + " differs from its +Inf bucket");
+                }
+                lastBucket.erase(key);
+            }
+        }
+    }
+    familyCount = types.size();
+    return problems;
+}
+
+void printUsage() {
+    std::fprintf(stderr, "Usage: metrics_scrape [--host ADDRESS] [--port N | --socket PATH] "
+                         "[--count N]\n                      [--interval MS] [--quiet 1]\n");
+}
+
+/**
+ * @brief Parses a whole decimal number no larger than "max", returning false otherwise
+ */
+bool parseNumber(const char *text, uint32_t max, uint32_t &value) {
+    if (!std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long number = std::strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || number > max) {
+        return false;
+    }
+    value = static_cast<uint32_t>(number);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Target target;
+    uint32_t count = 1;
+    uint32_t intervalMs = 1000;
+    bool quiet = false;
+    for (int i = 1; i < argc; i += 2) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "%s needs a value\n", argv[i]);
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        const char *value = argv[i + 1];
+        uint32_t number = 0;
+        bool valid = true;
+        if (arg == "--host") {
+            in_addr address;
+            valid = inet_pton(AF_INET, value, &address) == 1;
+            target.host = value;
+        } else if (arg == "--socket") {
+            valid = *value != '\0';
+            target.socketPath = value;
+        } else if (arg == "--port") {
+            valid = parseNumber(value, 65535, number) && number > 0;
+            target.port = static_cast<uint16_t>(number);
+        } else if (arg == "--count") {
+            valid = parseNumber(value, UINT32_MAX, number) && number > 0;
+            count = number;
+        } else if (arg == "--interval") {
+            valid = parseNumber(value, UINT32_MAX, number);
+            intervalMs = number;
+        } else if (arg == "--quiet") {
+            valid = parseNumber(value, 1, number);
+            quiet = number != 0;
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        if (!valid) {
+            std::fprintf(stderr, "invalid value for %s: %s\n", argv[i], value);
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::map<std::string, double> counters;
+    int problems = 0;
+    for (uint32_t scrape = 0; scrape < count; ++scrape) {
+        if (scrape > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::string response = fetch(target);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                              start)
+                        .count();
+        if (response.empty()) {
+            return EXIT_FAILURE;
+        }
+
+        size_t samples = 0, families = 0;
+        problems += check(response, counters, samples, families);
+        if (!quiet) {
+            size_t headerEnd = response.find("\r\n\r\n");
+            std::fputs(response.c_str() + (headerEnd == std::string::npos ? 0 : headerEnd + 4),
+                       stdout);
+        }
+        std::printf("scrape %u: %zu families, %zu samples, %zu bytes in %.2f ms\n", scrape + 1,
+                    families, samples, response.size(), ms);
+    }
+
+    if (problems > 0) {
+        std::printf("%d problems found\n", problems);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,354 @@
+/**
+ * @file rtp_receiver.cpp
+ * @brief Receives an RTP/H.264 stream sent by RtpSender and reports latency and packet loss
+ *
+ * Depacketises single NAL unit, STAP-A and FU-A packets (RFC 6184) back into an Annex B
+ * stream, which can be written to a file and compared with the encoder's output. Frame
+ * latency is measured from the send time the sender puts in a header extension to the
+ * arrival of the frame's last packet, so sender and receiver must share a clock (the same
+ * host, or hosts synchronised with PTP).
+ *
+ * Usage: rtp_receiver [--port N] [--output FILE] [--frames N]
+ */
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/// @brief Packets read per recvmmsg() call
+constexpr unsigned int batchSize = 64;
+
+/// @brief Largest packet accepted
+constexpr size_t maxPacketSize = 65536;
+
+/// @brief Identifier of the send time element of the header extension
+constexpr uint8_t sendTimeExtensionId = 1;
+
+const uint8_t startCode[] = {0, 0, 0, 1};
+
+/// @brief Set by SIGINT and SIGTERM to print the totals and exit
+std::atomic<bool> stopRequested{false};
+
+void requestStop(int) {
+    stopRequested = true;
+}
+
+uint64_t nowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+uint64_t readBigEndian(const uint8_t *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+/**
+ * @struct Stats
+ * @brief Counters of one reporting interval or of the whole run
+ */
+struct Stats {
+    uint64_t packets = 0;
+    uint64_t lostPackets = 0;
+    uint64_t frames = 0;
+    uint64_t damagedFrames = 0;
+    uint64_t bytes = 0;
+    double latencySumMs = 0.0;
+    double maxLatencyMs = 0.0;
+    uint64_t latencyCount = 0;
+
+    void print(const char *label, double seconds) const {
+        double lossPercent =
+            packets + lostPackets > 0 ? 100.0 * lostPackets / (packets + lostPackets) : 0.0;
+        std::printf("%s: %llu frames (%llu damaged), %.2f Mbit/s, %llu packets, %llu lost "
+                    "(%.3f%%)",
+                    label, static_cast<unsigned long long>(frames),
+                    static_cast<unsigned long long>(damagedFrames),
+                    seconds > 0.0 ? bytes * 8 / seconds / 1e6 : 0.0,
+                    static_cast<unsigned long long>(packets),
+                    static_cast<unsigned long long>(lostPackets), lossPercent);
+        if (latencyCount > 0) {
+            std::printf(", latency mean %.3f ms, max %.3f ms", latencySumMs / latencyCount,
+                        maxLatencyMs);
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    void add(const Stats &other) {
+        packets += other.packets;
+        lostPackets += other.lostPackets;
+        frames += other.frames;
+        damagedFrames += other.damagedFrames;
+        bytes += other.bytes;
+        latencySumMs += other.latencySumMs;
+        maxLatencyMs = std::max(maxLatencyMs, other.maxLatencyMs);
+        latencyCount += other.latencyCount;
+    }
+};
+
+/**
+ * @class Depacketiser
+ * @brief Rebuilds access units from RTP packets and tracks loss and latency
+ */
+class Depacketiser {
+  public:
+    explicit Depacketiser(std::ofstream *output) : output(output) {}
+
+    /**
+     * @brief Handles one RTP packet
+     */
+    void receive(const uint8_t *packet, size_t size, uint64_t arrival) {
+        if (size < 12 || (packet[0] >> 6) != 2) {
+            return;
+        }
+        bool marker = packet[1] & 0x80;
+        uint16_t sequence = static_cast<uint16_t>(readBigEndian(packet + 2, 2));
+        uint32_t timestamp = static_cast<uint32_t>(readBigEndian(packet + 4, 4));
+        stats.packets++;
+        stats.bytes += size;
+
+        if (started) {
+            uint16_t gap = static_cast<uint16_t>(sequence - expectedSequence);
+            if (gap != 0 && gap < 0x8000) {
+                stats.lostPackets += gap;
+                damaged = true;
+                fragmenting = false;
+            } else if (gap != 0) {
+                // A late or duplicate packet, already counted as lost
+                return;
+            }
+        }
+        started = true;
+        expectedSequence = static_cast<uint16_t>(sequence + 1);
+
+        // A new timestamp without a marker before it means the previous frame lost its end
+        if (haveFrame && timestamp != frameTimestamp) {
+            endFrame(arrival, true);
+        }
+        haveFrame = true;
+        frameTimestamp = timestamp;
+
+        size_t offset = 12 + 4 * (packet[0] & 0x0F);
+        if (packet[0] & 0x10) {
+            if (size < offset + 4) {
+                return;
+            }
+            size_t extensionSize = 4 * readBigEndian(packet + offset + 2, 2);
+            if (readBigEndian(packet + offset, 2) == 0xBEDE) {
+                readSendTime(packet + offset + 4, std::min(extensionSize, size - offset - 4));
+            }
+            offset += 4 + extensionSize;
+        }
+        if (packet[0] & 0x20) {
+            size -= std::min<size_t>(packet[size - 1], size);
+        }
+        if (offset < size) {
+            payload(packet + offset, size - offset);
+        }
+
+        if (marker) {
+            endFrame(arrival, false);
+        }
+    }
+
+    /// @brief Counters since the last report
+    Stats stats;
+
+  private:
+    std::ofstream *output;
+    std::vector<uint8_t> frame;
+    bool started = false;
+    uint16_t expectedSequence = 0;
+    bool haveFrame = false;
+    uint32_t frameTimestamp = 0;
+    uint64_t sendTime = 0;
+    bool damaged = false;
+    bool fragmenting = false;
+
+    void readSendTime(const uint8_t *elements, size_t size) {
+        for (size_t i = 0; i < size;) {
+            if (elements[i] == 0) {
+                ++i;
+                continue;
+            }
+            uint8_t id = elements[i] >> 4;
+            size_t length = (elements[i] & 0x0F) + 1;
+            if (id == sendTimeExtensionId && length == 8 && i + 9 <= size) {
+                sendTime = readBigEndian(elements + i + 1, 8);
+            }
+            i += 1 + length;
+        }
+    }
+
+    void appendNal(const uint8_t *data, size_t size) {
+        frame.insert(frame.end(), startCode, startCode + 4);
+        frame.insert(frame.end(), data, data + size);
+    }
+
+    void payload(const uint8_t *data, size_t size) {
+        uint8_t type = data[0] & 0x1F;
+        if (type >= 1 && type <= 23) {
+            appendNal(data, size);
+        } else if (type == 24) {
+            for (size_t i = 1; i + 2 <= size;) {
+                size_t nalSize = readBigEndian(data + i, 2);
+                if (i + 2 + nalSize > size) {
+                    damaged = true;
+                    break;
+                }
+                appendNal(data + i + 2, nalSize);
+                i += 2 + nalSize;
+            }
+        } else if (type == 28 && size >= 2) {
+            bool start = data[1] & 0x80;
+            if (start) {
+                frame.insert(frame.end(), startCode, startCode + 4);
+                frame.push_back(static_cast<uint8_t>((data[0] & 0xE0) | (data[1] & 0x1F)));
+                fragmenting = true;
+            }
+            if (fragmenting) {
+                frame.insert(frame.end(), data + 2, data + size);
+            }
+            if (data[1] & 0x40) {
+                fragmenting = false;
+            }
+        }
+    }
+
+    void endFrame(uint64_t arrival, bool incomplete) {
+        if (damaged || incomplete || frame.empty()) {
+            stats.damagedFrames++;
+        } else if (output != nullptr) {
+            output->write(reinterpret_cast<const char *>(frame.data()),
+                          static_cast<std::streamsize>(frame.size()));
+        }
+        stats.frames++;
+        if (sendTime != 0 && !incomplete) {
+            double latencyMs = (static_cast<int64_t>(arrival) - static_cast<int64_t>(sendTime)) /
+                               1000.0;
+            stats.latencySumMs += latencyMs;
+            stats.maxLatencyMs = std::max(stats.maxLatencyMs, latencyMs);
+            stats.latencyCount++;
+        }
+        frame.clear();
+        haveFrame = false;
+        damaged = false;
+        fragmenting = false;
+        sendTime = 0;
+    }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+    uint16_t port = 5004;
+    std::string outputPath;
+    uint64_t frameLimit = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--port") {
+            port = static_cast<uint16_t>(std::stoul(argv[i + 1]));
+        } else if (arg == "--output") {
+            outputPath = argv[i + 1];
+        } else if (arg == "--frames") {
+            frameLimit = std::stoull(argv[i + 1]);
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Without SA_RESTART, a signal interrupts recvmmsg() so the loop sees the request
+    struct sigaction action = {};
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    int socketFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (socketFd < 0) {
+        std::perror("socket");
+        return EXIT_FAILURE;
+    }
+    int bufferSize = 8 << 20;
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+    // Wake up periodically to report even when no packets arrive
+    timeval timeout = {1, 0};
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(socketFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+        std::perror("bind");
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream output;
+    if (!outputPath.empty()) {
+        output.open(outputPath, std::ios::out | std::ios::binary);
+        if (!output.is_open()) {
+            std::fprintf(stderr, "failed to open %s\n", outputPath.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    Depacketiser depacketiser(output.is_open() ? &output : nullptr);
+    std::printf("Listening for RTP on port %u\n", port);
+
+    std::vector<uint8_t> buffers(batchSize * maxPacketSize);
+    std::vector<iovec> iovs(batchSize);
+    std::vector<mmsghdr> messages(batchSize);
+    for (unsigned int i = 0; i < batchSize; ++i) {
+        iovs[i].iov_base = buffers.data() + i * maxPacketSize;
+        iovs[i].iov_len = maxPacketSize;
+        messages[i].msg_hdr.msg_iov = &iovs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    Stats total;
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    while (!stopRequested &&
+           (frameLimit == 0 || total.frames + depacketiser.stats.frames < frameLimit)) {
+        int count = recvmmsg(socketFd, messages.data(), batchSize, MSG_WAITFORONE, nullptr);
+        uint64_t arrival = nowMicroseconds();
+        for (int i = 0; i < count; ++i) {
+            depacketiser.receive(buffers.data() + i * maxPacketSize, messages[i].msg_len,
+                                 arrival);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        double interval = std::chrono::duration<double>(now - lastReport).count();
+        if (interval >= 1.0) {
+            depacketiser.stats.print("last second", interval);
+            total.add(depacketiser.stats);
+            depacketiser.stats = Stats();
+            lastReport = now;
+        }
+    }
+
+    total.add(depacketiser.stats);
+    total.print("total", std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                             .count());
+    close(socketFd);
+    return EXIT_SUCCESS;
+}